@@ -41,6 +41,7 @@ FIND_PACKAGE (GLEW REQUIRED)
 FIND_PACKAGE (TBB REQUIRED)
 FIND_PACKAGE (SndFile REQUIRED)
 FIND_PACKAGE (OpenAL REQUIRED)
+FIND_PACKAGE (Jack)
 FIND_PACKAGE (GLFW REQUIRED)
 FIND_PACKAGE (SFML 2 COMPONENTS graphics window system REQUIRED)
 
@@ -52,6 +53,7 @@ SET (FREETYPE_INCLUDE_PATH "${FREETYPE_INCLUDE_DIRS}")
 SET (FFMPEG_INCLUDE_PATH "${FFMPEG_INCLUDE_DIRS}")
 SET (ASMLIB_INCLUDE_PATH "${EXTERNAL_INCLUDE_PATH}")
 SET (FREEIMAGE_INCLUDE_PATH "${FreeImage_INCLUDE_DIRS}")
+SET (JACK_INCLUDE_PATH "${JACK_INCLUDE_DIRS}")
 
 set(CEF_INCLUDE_PATH "/opt/cef/include")
 set(CEF_PATH "/opt/cef")
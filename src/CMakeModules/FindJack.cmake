@@ -0,0 +1,56 @@
+# - Try to find the JACK audio connection kit
+#
+# Once done this will define
+#
+#  JACK_FOUND - system has libjack
+#  JACK_INCLUDE_DIRS - the libjack include directory
+#  JACK_LIBRARIES - Link these to use libjack
+#
+
+if (JACK_LIBRARIES AND JACK_INCLUDE_DIRS)
+  # in cache already
+  set(JACK_FOUND TRUE)
+else (JACK_LIBRARIES AND JACK_INCLUDE_DIRS)
+
+  find_path(JACK_INCLUDE_DIR
+    NAMES
+      jack/jack.h
+    PATHS
+      /usr/include
+      /usr/local/include
+      /opt/local/include
+  )
+
+  find_library(JACK_LIBRARY
+    NAMES
+      jack
+    PATHS
+      /usr/lib
+      /usr/local/lib
+      /opt/local/lib
+  )
+
+  set(JACK_INCLUDE_DIRS
+    ${JACK_INCLUDE_DIR}
+  )
+  set(JACK_LIBRARIES
+    ${JACK_LIBRARY}
+  )
+
+  if (JACK_INCLUDE_DIRS AND JACK_LIBRARIES)
+    set(JACK_FOUND TRUE)
+  endif (JACK_INCLUDE_DIRS AND JACK_LIBRARIES)
+
+  if (JACK_FOUND)
+    if (NOT Jack_FIND_QUIETLY)
+      message(STATUS "Found libjack: ${JACK_LIBRARIES}")
+    endif (NOT Jack_FIND_QUIETLY)
+  else (JACK_FOUND)
+    if (Jack_FIND_REQUIRED)
+      message(FATAL_ERROR "Could not find libjack")
+    endif (Jack_FIND_REQUIRED)
+  endif (JACK_FOUND)
+
+  mark_as_advanced(JACK_INCLUDE_DIRS JACK_LIBRARIES JACK_INCLUDE_DIR JACK_LIBRARY)
+
+endif (JACK_LIBRARIES AND JACK_INCLUDE_DIRS)
@@ -1,36 +1,85 @@
 #include "accelerator.h"
 
+#include "cpu/image/image_mixer.h"
 #include "ogl/image/image_mixer.h"
 #include "ogl/util/device.h"
 
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/property_tree/ptree.hpp>
 
 #include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
 
 #include <core/mixer/image/image_mixer.h>
 
+#include <map>
 #include <mutex>
 
 namespace caspar { namespace accelerator {
 
 struct accelerator::impl
 {
-    const std::wstring           path_;
-    std::mutex                   mutex_;
-    std::shared_ptr<ogl::device> ogl_device_;
+    const std::wstring                          path_;
+    std::mutex                                  mutex_;
+    std::map<int, std::shared_ptr<ogl::device>> ogl_devices_;
 
     impl(const std::wstring& path)
         : path_(path)
     {
     }
 
-    std::unique_ptr<core::image_mixer> create_image_mixer(int channel_id)
+    std::unique_ptr<core::image_mixer> create_image_mixer(int channel_id, int gpu, int color_depth)
     {
-        if (!ogl_device_) {
-            ogl_device_.reset(new ogl::device());
+        if (color_depth != 8 && color_depth != 10) {
+            CASPAR_THROW_EXCEPTION(user_error()
+                                   << msg_info(L"Invalid color depth " + std::to_wstring(color_depth) + L", 8 or 10."));
         }
 
-        return std::make_unique<ogl::image_mixer>(spl::make_shared_ptr(ogl_device_), channel_id);
+        // NOTE: A negative gpu index, or the cpu accelerator, always mixes on the cpu. The auto accelerator falls back
+        // to the cpu when no OpenGL device can be created.
+        if (gpu < 0 || boost::iequals(path_, L"cpu")) {
+            return create_cpu_image_mixer(channel_id, color_depth);
+        }
+
+        if (boost::iequals(path_, L"auto")) {
+            try {
+                return create_ogl_image_mixer(channel_id, gpu, color_depth);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(warning) << L"Failed to create an OpenGL device for channel " << channel_id
+                                    << L", mixing on the cpu.";
+                return create_cpu_image_mixer(channel_id, color_depth);
+            }
+        }
+
+        return create_ogl_image_mixer(channel_id, gpu, color_depth);
+    }
+
+    std::unique_ptr<core::image_mixer> create_cpu_image_mixer(int channel_id, int color_depth)
+    {
+        if (color_depth != 8) {
+            CASPAR_LOG(warning) << L"Channel " << channel_id << L" mixes on the cpu, which composites in 8 bit.";
+        }
+        return std::make_unique<cpu::image_mixer>(channel_id);
+    }
+
+    std::unique_ptr<core::image_mixer> create_ogl_image_mixer(int channel_id, int gpu, int color_depth)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto& ogl_device = ogl_devices_[gpu];
+        if (!ogl_device) {
+            try {
+                ogl_device.reset(new ogl::device(gpu));
+            } catch (...) {
+                ogl_devices_.erase(gpu);
+                throw;
+            }
+        }
+
+        auto channel_device = spl::make_shared_ptr(ogl_device->for_channel(channel_id));
+        return std::make_unique<ogl::image_mixer>(channel_device, channel_id, color_depth == 10);
     }
 };
 
@@ -41,9 +90,9 @@ accelerator::accelerator(const std::wstring& path)
 
 accelerator::~accelerator() {}
 
-std::unique_ptr<core::image_mixer> accelerator::create_image_mixer(int channel_id)
+std::unique_ptr<core::image_mixer> accelerator::create_image_mixer(int channel_id, int gpu, int color_depth)
 {
-    return impl_->create_image_mixer(channel_id);
+    return impl_->create_image_mixer(channel_id, gpu, color_depth);
 }
 
 }} // namespace caspar::accelerator
@@ -14,7 +14,9 @@ class accelerator
 
     accelerator& operator=(accelerator&) = delete;
 
-    std::unique_ptr<core::image_mixer> create_image_mixer(int channel_id);
+    // Channels with the same gpu index share one device, and with it its textures and buffers. Channels of a color
+    // depth of 10 are composited in 10 bit on the gpu, see ogl::image_mixer.
+    std::unique_ptr<core::image_mixer> create_image_mixer(int channel_id, int gpu, int color_depth = 8);
 
   private:
     struct impl;
@@ -0,0 +1,1034 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_mixer.h"
+
+#include "output_converter.h"
+
+#include <common/array.h>
+#include <common/diagnostics/trace.h>
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/log.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/geometry.h>
+#include <core/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <boost/any.hpp>
+
+#include <tbb/parallel_for.h>
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+namespace {
+
+template <typename Func>
+void for_rows(int begin, int end, Func&& func)
+{
+    tbb::parallel_for(tbb::blocked_range<int>(begin, end, 8), [&](const tbb::blocked_range<int>& rows) {
+        for (auto y = rows.begin(); y != rows.end(); ++y) {
+            func(y);
+        }
+    });
+}
+
+std::uint8_t clamp_byte(float value)
+{
+    return static_cast<std::uint8_t>(std::max(0.0f, std::min(255.0f, value + 0.5f)));
+}
+
+// The bgra of studio range Y, Cb and Cr at 8 bit levels.
+void ycbcr_to_bgra(float y, float cb, float cr, std::uint8_t a, bool is_hd, std::uint8_t* dst)
+{
+    y = 1.164f * (y - 16.0f);
+    cb -= 128.0f;
+    cr -= 128.0f;
+    if (is_hd) {
+        dst[0] = clamp_byte(y + 2.115f * cb);
+        dst[1] = clamp_byte(y - 0.534f * cr - 0.213f * cb);
+        dst[2] = clamp_byte(y + 1.793f * cr);
+    } else {
+        dst[0] = clamp_byte(y + 2.018f * cb);
+        dst[1] = clamp_byte(y - 0.813f * cr - 0.391f * cb);
+        dst[2] = clamp_byte(y + 1.596f * cr);
+    }
+    dst[3] = a;
+}
+
+std::uint16_t read_word(const std::uint8_t* ptr) { return static_cast<std::uint16_t>(ptr[0] | ptr[1] << 8); }
+
+// Decodes count pixels of a row of a DXT5 block into bgra. The colors of DXT5 blocks are always interpolated between
+// the two endpoints, whatever their order.
+void bc3_to_bgra(const std::uint8_t* block, int row, int count, std::uint8_t* dst)
+{
+    std::array<int, 8> alpha = {block[0], block[1]};
+    if (alpha[0] > alpha[1]) {
+        for (auto n = 1; n < 7; ++n) {
+            alpha[n + 1] = ((7 - n) * alpha[0] + n * alpha[1]) / 7;
+        }
+    } else {
+        for (auto n = 1; n < 5; ++n) {
+            alpha[n + 1] = ((5 - n) * alpha[0] + n * alpha[1]) / 5;
+        }
+        alpha[6] = 0;
+        alpha[7] = 255;
+    }
+
+    std::uint64_t alpha_bits = 0;
+    for (auto n = 0; n < 6; ++n) {
+        alpha_bits |= static_cast<std::uint64_t>(block[2 + n]) << (8 * n);
+    }
+
+    std::array<std::array<int, 3>, 4> colors;
+    for (auto n = 0; n < 2; ++n) {
+        const auto c = block[8 + n * 2] | block[9 + n * 2] << 8;
+        const auto r = (c >> 11) & 0x1F;
+        const auto g = (c >> 5) & 0x3F;
+        const auto b = c & 0x1F;
+        colors[n]    = {(b << 3) | (b >> 2), (g << 2) | (g >> 4), (r << 3) | (r >> 2)};
+    }
+    for (auto n = 0; n < 3; ++n) {
+        colors[2][n] = (2 * colors[0][n] + colors[1][n]) / 3;
+        colors[3][n] = (colors[0][n] + 2 * colors[1][n]) / 3;
+    }
+
+    const auto color_bits = block[12 + row];
+    for (auto x = 0; x < count; ++x, dst += 4) {
+        const auto& color = colors[(color_bits >> (2 * x)) & 0x3];
+        dst[0]            = static_cast<std::uint8_t>(color[0]);
+        dst[1]            = static_cast<std::uint8_t>(color[1]);
+        dst[2]            = static_cast<std::uint8_t>(color[2]);
+        dst[3]            = static_cast<std::uint8_t>(alpha[(alpha_bits >> (3 * (row * 4 + x))) & 0x7]);
+    }
+}
+
+// Converts the planes of frame into a bgra image of the size of its first plane, like the mixer shaders sample them.
+// Returns an empty image for formats which are not supported.
+image to_bgra(const core::const_frame& frame)
+{
+    const auto& desc   = frame.pixel_format_desc();
+    const auto& planes = desc.planes;
+    const auto& first  = planes.at(0);
+
+    auto width = first.width;
+    if (desc.format == core::pixel_format::uyvy) {
+        width = first.width * 2;
+    } else if (desc.format == core::pixel_format::v210) {
+        width = first.width * 3 / 2;
+    }
+    const auto height = first.height;
+    const auto is_hd  = height > 700;
+
+    for (std::size_t n = 0; n < planes.size(); ++n) {
+        if (frame.image_data(n).size() < static_cast<std::size_t>(planes[n].size)) {
+            return image();
+        }
+    }
+
+    if (desc.format == core::pixel_format::bgra) {
+        return image{frame.image_data(0), width, height};
+    }
+
+    auto plane_row = [&](int n, int y) {
+        const auto& plane = planes[n];
+        return frame.image_data(n).data() + static_cast<std::size_t>(y * plane.height / height) * plane.linesize;
+    };
+    auto plane_x = [&](int n, int x) { return x * planes[n].width / width; };
+
+    array<std::uint8_t> result(static_cast<std::size_t>(width) * height * 4);
+
+    auto convert_row = [&](int y, std::uint8_t* dst) {
+        const auto src = plane_row(0, y);
+        switch (desc.format) {
+            case core::pixel_format::gray:
+            case core::pixel_format::luma:
+                for (auto x = 0; x < width; ++x, dst += 4) {
+                    auto value = src[x];
+                    if (desc.format == core::pixel_format::luma) {
+                        value = clamp_byte((value - 16.575f) / 0.859f);
+                    }
+                    dst[0] = dst[1] = dst[2] = value;
+                    dst[3]                   = 255;
+                }
+                break;
+            case core::pixel_format::rgba:
+            case core::pixel_format::argb:
+            case core::pixel_format::abgr:
+            case core::pixel_format::bgr:
+            case core::pixel_format::rgb: {
+                // The offsets of b, g, r and a within a pixel, or -1 for opaque formats.
+                static const std::array<std::array<int, 4>, 5> offsets = {
+                    {{2, 1, 0, 3}, {3, 2, 1, 0}, {1, 2, 3, 0}, {0, 1, 2, -1}, {2, 1, 0, -1}}};
+                const auto& o = desc.format == core::pixel_format::rgba   ? offsets[0]
+                                : desc.format == core::pixel_format::argb ? offsets[1]
+                                : desc.format == core::pixel_format::abgr ? offsets[2]
+                                : desc.format == core::pixel_format::bgr  ? offsets[3]
+                                                                          : offsets[4];
+                const auto stride = first.stride;
+                for (auto x = 0; x < width; ++x, dst += 4) {
+                    const auto pixel = src + x * stride;
+                    dst[0]           = pixel[o[0]];
+                    dst[1]           = pixel[o[1]];
+                    dst[2]           = pixel[o[2]];
+                    dst[3]           = o[3] < 0 ? 255 : pixel[o[3]];
+                }
+                break;
+            }
+            case core::pixel_format::ycbcr:
+            case core::pixel_format::ycbcra: {
+                const auto cb = plane_row(1, y);
+                const auto cr = plane_row(2, y);
+                const auto a  = desc.format == core::pixel_format::ycbcra ? plane_row(3, y) : nullptr;
+                for (auto x = 0; x < width; ++x, dst += 4) {
+                    const auto c = plane_x(1, x);
+                    ycbcr_to_bgra(src[x], cb[c], cr[plane_x(2, x)], a ? a[plane_x(3, x)] : 255, is_hd, dst);
+                }
+                break;
+            }
+            case core::pixel_format::ycbcr10: {
+                const auto cb = plane_row(1, y);
+                const auto cr = plane_row(2, y);
+                for (auto x = 0; x < width; ++x, dst += 4) {
+                    ycbcr_to_bgra(read_word(src + x * 2) / 4.0f,
+                                  read_word(cb + plane_x(1, x) * 2) / 4.0f,
+                                  read_word(cr + plane_x(2, x) * 2) / 4.0f,
+                                  255,
+                                  is_hd,
+                                  dst);
+                }
+                break;
+            }
+            case core::pixel_format::nv12:
+            case core::pixel_format::p010: {
+                const auto cbcr = plane_row(1, y);
+                const auto wide = desc.format == core::pixel_format::p010;
+                for (auto x = 0; x < width; ++x, dst += 4) {
+                    const auto c = cbcr + plane_x(1, x) * planes[1].stride;
+                    if (wide) {
+                        ycbcr_to_bgra(read_word(src + x * 2) / 256.0f,
+                                      read_word(c) / 256.0f,
+                                      read_word(c + 2) / 256.0f,
+                                      255,
+                                      is_hd,
+                                      dst);
+                    } else {
+                        ycbcr_to_bgra(src[x], c[0], c[1], 255, is_hd, dst);
+                    }
+                }
+                break;
+            }
+            case core::pixel_format::uyvy:
+                for (auto x = 0; x < width; ++x, dst += 4) {
+                    const auto texel = src + x / 2 * 4;
+                    ycbcr_to_bgra(texel[x % 2 == 0 ? 1 : 3], texel[0], texel[2], 255, is_hd, dst);
+                }
+                break;
+            case core::pixel_format::v210:
+                // Every four words hold six pixels: Cb0 Y0 Cr0, Y1 Cb2 Y2, Cr2 Y3 Cb4, Y4 Cr4 Y5.
+                for (auto x = 0; x < width; ++x, dst += 4) {
+                    const auto group = src + x / 6 * 16;
+
+                    std::array<std::uint32_t, 12> c;
+                    for (auto n = 0; n < 4; ++n) {
+                        const auto word =
+                            static_cast<std::uint32_t>(read_word(group + n * 4)) | read_word(group + n * 4 + 2) << 16;
+                        c[n * 3]     = word & 0x3FF;
+                        c[n * 3 + 1] = (word >> 10) & 0x3FF;
+                        c[n * 3 + 2] = (word >> 20) & 0x3FF;
+                    }
+
+                    static const std::array<int, 6> luma   = {1, 3, 5, 7, 9, 11};
+                    static const std::array<int, 6> chroma = {0, 0, 4, 4, 8, 8};
+                    const auto                      i      = x % 6;
+                    const auto                      cb     = chroma[i];
+                    const auto                      cr     = i < 2 ? 2 : i < 4 ? 6 : 10;
+                    ycbcr_to_bgra(c[luma[i]] / 4.0f, c[cb] / 4.0f, c[cr] / 4.0f, 255, is_hd, dst);
+                }
+                break;
+            case core::pixel_format::bc3: {
+                const auto blocks = frame.image_data(0).data() + static_cast<std::size_t>(y / 4) * first.linesize;
+                for (auto x = 0; x < width; x += 4) {
+                    bc3_to_bgra(blocks + x / 4 * 16, y % 4, std::min(4, width - x), dst + x * 4);
+                }
+                break;
+            }
+            default:
+                std::memset(dst, 0, static_cast<std::size_t>(width) * 4);
+                break;
+        }
+    };
+
+    switch (desc.format) {
+        case core::pixel_format::gray:
+        case core::pixel_format::luma:
+        case core::pixel_format::rgba:
+        case core::pixel_format::argb:
+        case core::pixel_format::abgr:
+        case core::pixel_format::bgr:
+        case core::pixel_format::rgb:
+        case core::pixel_format::ycbcr:
+        case core::pixel_format::ycbcra:
+        case core::pixel_format::ycbcr10:
+        case core::pixel_format::nv12:
+        case core::pixel_format::p010:
+        case core::pixel_format::uyvy:
+        case core::pixel_format::v210:
+        case core::pixel_format::bc3:
+            for_rows(0, height, [&](int y) {
+                convert_row(y, result.data() + static_cast<std::size_t>(y) * width * 4);
+            });
+            return image{std::move(result), width, height};
+        default:
+            return image();
+    }
+}
+
+// Bgra frame images are drawn as they are, other formats are converted once per frame and the result is kept on the
+// frame, so that frames which are shown for several ticks or on several channels are only converted once.
+image get_image(const core::const_frame& frame)
+{
+    static const int key = 0;
+
+    if (frame.pixel_format_desc().format == core::pixel_format::bgra) {
+        return to_bgra(frame);
+    }
+    return boost::any_cast<image>(frame.cached(&key, [&] { return boost::any(to_bgra(frame)); }));
+}
+
+std::uint16_t div255(std::uint32_t value)
+{
+    return static_cast<std::uint16_t>((value + 128 + ((value + 128) >> 8)) >> 8);
+}
+
+__m128i div255(__m128i value)
+{
+    const auto t = _mm_add_epi16(value, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// Draws count premultiplied source pixels, scaled by factor, over the destination, four pixels at a time.
+void over_row(std::uint8_t* dst, const std::uint8_t* src, int count, int factor)
+{
+    const auto zero  = _mm_setzero_si128();
+    const auto scale = _mm_set1_epi16(static_cast<short>(factor));
+    const auto full  = _mm_set1_epi16(255);
+
+    auto n = 0;
+    for (; n + 4 <= count; n += 4) {
+        auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n * 4));
+        auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + n * 4));
+
+        auto s_lo = _mm_unpacklo_epi8(s, zero);
+        auto s_hi = _mm_unpackhi_epi8(s, zero);
+        if (factor != 255) {
+            s_lo = div255(_mm_mullo_epi16(s_lo, scale));
+            s_hi = div255(_mm_mullo_epi16(s_hi, scale));
+        }
+
+        const auto a_lo = _mm_sub_epi16(full, _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xFF), 0xFF));
+        const auto a_hi = _mm_sub_epi16(full, _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xFF), 0xFF));
+
+        const auto d_lo = div255(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), a_lo));
+        const auto d_hi = div255(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), a_hi));
+
+        const auto result = _mm_packus_epi16(_mm_add_epi16(s_lo, d_lo), _mm_add_epi16(s_hi, d_hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n * 4), result);
+    }
+
+    for (; n < count; ++n) {
+        const auto s = src + n * 4;
+        const auto d = dst + n * 4;
+        const auto a = 255 - (factor != 255 ? div255(s[3] * factor) : s[3]);
+        for (auto c = 0; c < 4; ++c) {
+            const auto value = (factor != 255 ? div255(s[c] * factor) : s[c]) + div255(d[c] * a);
+            d[c]             = static_cast<std::uint8_t>(std::min(255, value));
+        }
+    }
+}
+
+// Adds count premultiplied source pixels, scaled by factor, to the destination.
+void add_row(std::uint8_t* dst, const std::uint8_t* src, int count, int factor)
+{
+    for (auto n = 0; n < count * 4; ++n) {
+        dst[n] = static_cast<std::uint8_t>(std::min(255, dst[n] + div255(src[n] * factor)));
+    }
+}
+
+// Draws the red channel of count premultiplied source pixels over a key.
+void key_row(std::uint8_t* dst, const std::uint8_t* src, int count)
+{
+    for (auto n = 0; n < count; ++n) {
+        dst[n] = static_cast<std::uint8_t>(std::min(255, src[n * 4 + 2] + div255(dst[n] * (255 - src[n * 4 + 3]))));
+    }
+}
+
+// Scales count premultiplied pixels by a key.
+void mask_row(std::uint8_t* pixels, const std::uint8_t* key, int count)
+{
+    for (auto n = 0; n < count * 4; ++n) {
+        pixels[n] = static_cast<std::uint8_t>(div255(pixels[n] * key[n / 4]));
+    }
+}
+
+float blend_channel(core::blend_mode mode, float back, float fore)
+{
+    auto color_dodge = [](float b, float f) { return f >= 1.0f ? f : std::min(b / (1.0f - f), 1.0f); };
+    auto color_burn  = [](float b, float f) { return f <= 0.0f ? f : std::max(1.0f - (1.0f - b) / f, 0.0f); };
+    auto vivid_light = [&](float b, float f) {
+        return f < 0.5f ? color_burn(b, 2.0f * f) : color_dodge(b, 2.0f * (f - 0.5f));
+    };
+    auto overlay = [](float b, float f) { return b < 0.5f ? 2.0f * b * f : 1.0f - 2.0f * (1.0f - b) * (1.0f - f); };
+    auto reflect = [](float b, float f) { return f >= 1.0f ? f : std::min(b * b / (1.0f - f), 1.0f); };
+
+    switch (mode) {
+        case core::blend_mode::lighten:
+            return std::max(fore, back);
+        case core::blend_mode::darken:
+            return std::min(fore, back);
+        case core::blend_mode::multiply:
+            return back * fore;
+        case core::blend_mode::average:
+            return (back + fore) / 2.0f;
+        case core::blend_mode::add:
+        case core::blend_mode::linear_dodge:
+            return std::min(back + fore, 1.0f);
+        case core::blend_mode::subtract:
+        case core::blend_mode::linear_burn:
+            return std::max(back + fore - 1.0f, 0.0f);
+        case core::blend_mode::difference:
+            return std::abs(back - fore);
+        case core::blend_mode::negation:
+            return 1.0f - std::abs(1.0f - back - fore);
+        case core::blend_mode::exclusion:
+            return back + fore - 2.0f * back * fore;
+        case core::blend_mode::screen:
+            return 1.0f - (1.0f - back) * (1.0f - fore);
+        case core::blend_mode::overlay:
+            return overlay(back, fore);
+        case core::blend_mode::soft_light:
+            return fore < 0.5f ? 2.0f * back * fore + back * back * (1.0f - 2.0f * fore)
+                               : std::sqrt(back) * (2.0f * fore - 1.0f) + 2.0f * back * (1.0f - fore);
+        case core::blend_mode::hard_light:
+            return overlay(fore, back);
+        case core::blend_mode::color_dodge:
+            return color_dodge(back, fore);
+        case core::blend_mode::color_burn:
+            return color_burn(back, fore);
+        case core::blend_mode::linear_light:
+            return fore < 0.5f ? std::max(back + 2.0f * fore - 1.0f, 0.0f)
+                               : std::min(back + 2.0f * (fore - 0.5f), 1.0f);
+        case core::blend_mode::vivid_light:
+            return vivid_light(back, fore);
+        case core::blend_mode::pin_light:
+            return fore < 0.5f ? std::min(back, 2.0f * fore) : std::max(back, 2.0f * (fore - 0.5f));
+        case core::blend_mode::hard_mix:
+            return vivid_light(back, fore) < 0.5f ? 0.0f : 1.0f;
+        case core::blend_mode::reflect:
+            return reflect(back, fore);
+        case core::blend_mode::glow:
+            return reflect(fore, back);
+        case core::blend_mode::phoenix:
+            return std::min(back, fore) - std::max(back, fore) + 1.0f;
+        default:
+            return fore;
+    }
+}
+
+// Draws count premultiplied source pixels over the destination with mode, which is applied to their colors without
+// alpha, as the blend shaders of the gpu mixer do.
+void blend_row(std::uint8_t* dst, const std::uint8_t* src, int count, core::blend_mode mode)
+{
+    for (auto n = 0; n < count; ++n, dst += 4, src += 4) {
+        if (src[3] == 0) {
+            continue;
+        }
+
+        const auto fore_a = src[3] / 255.0f;
+        const auto back_a = dst[3] / 255.0f;
+        for (auto c = 0; c < 3; ++c) {
+            const auto back  = dst[c] / 255.0f / (back_a + 0.0000001f);
+            const auto fore  = src[c] / 255.0f / (fore_a + 0.0000001f);
+            const auto value = blend_channel(mode, back, fore) * fore_a + (1.0f - fore_a) * dst[c] / 255.0f;
+            dst[c]           = clamp_byte(value * 255.0f);
+        }
+        dst[3] = clamp_byte((fore_a + (1.0f - fore_a) * back_a) * 255.0f);
+    }
+}
+
+// Premultiplied bgra, or one channel keys, of the size of the frame. Buffers are only allocated once drawn into.
+struct buffer
+{
+    std::vector<std::uint8_t> data;
+
+    explicit operator bool() const { return !data.empty(); }
+
+    void allocate(std::size_t size)
+    {
+        if (data.empty()) {
+            data.resize(size, 0);
+        }
+    }
+};
+
+struct item
+{
+    core::const_frame     frame;
+    core::image_transform transform;
+    core::frame_geometry  geometry = core::frame_geometry::get_default();
+};
+
+struct layer
+{
+    std::vector<layer> sublayers;
+    std::vector<item>  items;
+    core::blend_mode   blend_mode;
+
+    layer(core::blend_mode blend_mode)
+        : blend_mode(blend_mode)
+    {
+    }
+};
+
+// The affine mapping of target pixels onto the source pixels of an item, and the rows and columns it covers.
+struct placement
+{
+    // Source pixel coordinates of the target pixel x, y are sx + x * dsx_dx + y * dsx_dy and so on, the covered
+    // area of the source is [min_x, max_x) by [min_y, max_y) in pixels.
+    double sx = 0.0, dsx_dx = 0.0, dsx_dy = 0.0;
+    double sy = 0.0, dsy_dx = 0.0, dsy_dy = 0.0;
+    double min_x = 0.0, max_x = 0.0, min_y = 0.0, max_y = 0.0;
+
+    int left = 0, top = 0, right = 0, bottom = 0;
+
+    // Whether the source is drawn pixel for pixel at a whole pixel offset, which needs no filtering.
+    bool aligned = false;
+
+    bool empty() const { return left >= right || top >= bottom; }
+};
+
+placement place(const item& item, const image& source, const core::video_format_desc& format_desc)
+{
+    const auto& transform = item.transform;
+    const auto& coords    = item.geometry.data();
+
+    placement result;
+
+    const auto width  = format_desc.width;
+    const auto height = format_desc.height;
+    const auto aspect = static_cast<double>(format_desc.square_width) / static_cast<double>(format_desc.square_height);
+    const auto f_p    = transform.fill_translation;
+    const auto f_s    = transform.fill_scale;
+    const auto anchor = transform.anchor;
+    const auto angle  = transform.angle;
+
+    if (coords.size() != 4 || std::abs(f_s[0]) < 1e-9 || std::abs(f_s[1]) < 1e-9) {
+        return result;
+    }
+
+    // NOTE: Quads are drawn as the rectangle between their upper left and lower right corners. Crop only applies to
+    // the default geometry, as on the gpu.
+    std::array<double, 4> vertex  = {coords[0].vertex_x, coords[0].vertex_y, coords[2].vertex_x, coords[2].vertex_y};
+    std::array<double, 4> texture = {
+        coords[0].texture_x, coords[0].texture_y, coords[2].texture_x, coords[2].texture_y};
+    if (vertex[2] - vertex[0] < 1e-9 || vertex[3] - vertex[1] < 1e-9) {
+        return result;
+    }
+
+    std::array<double, 4> area = vertex;
+    if (coords == core::frame_geometry::get_default().data()) {
+        area = {std::max(vertex[0], transform.crop.ul[0]),
+                std::max(vertex[1], transform.crop.ul[1]),
+                std::min(vertex[2], transform.crop.lr[0]),
+                std::min(vertex[3], transform.crop.lr[1])};
+    }
+
+    // Target pixel to the vertex coordinates of the item, the inverse of the fill, anchor and rotation of the gpu.
+    const auto cos = std::cos(angle);
+    const auto sin = std::sin(angle);
+    auto       to_vertex = [&](double x, double y) {
+        const auto dx = (x + 0.5) / width - f_p[0];
+        const auto dy = ((y + 0.5) / height - f_p[1]) / aspect;
+        const auto ox = dx * cos + dy * sin;
+        const auto oy = -dx * sin + dy * cos;
+        return std::array<double, 2>{ox / f_s[0] + anchor[0], oy * aspect / f_s[1] + anchor[1]};
+    };
+    auto to_source = [&](double x, double y) {
+        const auto v  = to_vertex(x, y);
+        const auto tx = texture[0] + (v[0] - vertex[0]) * (texture[2] - texture[0]) / (vertex[2] - vertex[0]);
+        const auto ty = texture[1] + (v[1] - vertex[1]) * (texture[3] - texture[1]) / (vertex[3] - vertex[1]);
+        return std::array<double, 2>{tx * source.width, ty * source.height};
+    };
+
+    const auto origin = to_source(0.0, 0.0);
+    const auto step_x = to_source(1.0, 0.0);
+    const auto step_y = to_source(0.0, 1.0);
+
+    result.sx     = origin[0];
+    result.sy     = origin[1];
+    result.dsx_dx = step_x[0] - origin[0];
+    result.dsy_dx = step_x[1] - origin[1];
+    result.dsx_dy = step_y[0] - origin[0];
+    result.dsy_dy = step_y[1] - origin[1];
+
+    auto area_to_source = [&](double vx, double vy) {
+        return std::array<double, 2>{
+            (texture[0] + (vx - vertex[0]) * (texture[2] - texture[0]) / (vertex[2] - vertex[0])) * source.width,
+            (texture[1] + (vy - vertex[1]) * (texture[3] - texture[1]) / (vertex[3] - vertex[1])) * source.height};
+    };
+    const auto source_ul = area_to_source(area[0], area[1]);
+    const auto source_lr = area_to_source(area[2], area[3]);
+    result.min_x         = std::min(source_ul[0], source_lr[0]);
+    result.max_x         = std::max(source_ul[0], source_lr[0]);
+    result.min_y         = std::min(source_ul[1], source_lr[1]);
+    result.max_y         = std::max(source_ul[1], source_lr[1]);
+
+    // The bounds of the rotated area on the target, within the clip rectangle and the frame.
+    auto to_target = [&](double vx, double vy) {
+        const auto ox = (vx - anchor[0]) * f_s[0];
+        const auto oy = (vy - anchor[1]) * f_s[1] / aspect;
+        return std::array<double, 2>{(ox * cos - oy * sin + f_p[0]) * width,
+                                     ((ox * sin + oy * cos) * aspect + f_p[1]) * height};
+    };
+    std::array<std::array<double, 2>, 4> corners = {to_target(area[0], area[1]),
+                                                    to_target(area[2], area[1]),
+                                                    to_target(area[2], area[3]),
+                                                    to_target(area[0], area[3])};
+
+    auto left   = corners[0][0];
+    auto top    = corners[0][1];
+    auto right  = corners[0][0];
+    auto bottom = corners[0][1];
+    for (auto& corner : corners) {
+        left   = std::min(left, corner[0]);
+        top    = std::min(top, corner[1]);
+        right  = std::max(right, corner[0]);
+        bottom = std::max(bottom, corner[1]);
+    }
+
+    const auto& m_p = transform.clip_translation;
+    const auto& m_s = transform.clip_scale;
+    left            = std::max({left, m_p[0] * width, 0.0});
+    top             = std::max({top, m_p[1] * height, 0.0});
+    right           = std::min({right, (m_p[0] + m_s[0]) * width, static_cast<double>(width)});
+    bottom          = std::min({bottom, (m_p[1] + m_s[1]) * height, static_cast<double>(height)});
+
+    result.left   = static_cast<int>(std::floor(left + 0.5));
+    result.top    = static_cast<int>(std::floor(top + 0.5));
+    result.right  = static_cast<int>(std::floor(right + 0.5));
+    result.bottom = static_cast<int>(std::floor(bottom + 0.5));
+
+    auto whole = [](double value) { return std::abs(value - std::round(value)) < 1e-6; };
+    result.aligned = whole(result.dsx_dx - 1.0) && whole(result.dsy_dy - 1.0) && std::abs(result.dsx_dy) < 1e-6 &&
+                     std::abs(result.dsy_dx) < 1e-6 && whole(result.sx) && whole(result.sy);
+
+    return result;
+}
+
+// Samples the pixels x0 to x1 of target row y of an item into dst, transparent where the item does not cover them.
+void sample_row(const image& source, const placement& p, int y, int x0, int x1, std::uint8_t* dst)
+{
+    const auto width  = source.width;
+    const auto height = source.height;
+    const auto data   = source.data.data();
+
+    for (auto x = x0; x < x1; ++x, dst += 4) {
+        const auto sx = p.sx + x * p.dsx_dx + y * p.dsx_dy;
+        const auto sy = p.sy + x * p.dsy_dx + y * p.dsy_dy;
+
+        if (sx < p.min_x || sx >= p.max_x || sy < p.min_y || sy >= p.max_y) {
+            std::memset(dst, 0, 4);
+            continue;
+        }
+
+        // Bilinear filtering between the centers of the four nearest pixels, with 8 bit weights.
+        const auto fx = sx - 0.5;
+        const auto fy = sy - 0.5;
+        const auto ix = static_cast<int>(std::floor(fx));
+        const auto iy = static_cast<int>(std::floor(fy));
+        const auto wx = static_cast<int>((fx - ix) * 256.0);
+        const auto wy = static_cast<int>((fy - iy) * 256.0);
+
+        const auto x_0 = std::max(0, std::min(ix, width - 1));
+        const auto x_1 = std::max(0, std::min(ix + 1, width - 1));
+        const auto y_0 = std::max(0, std::min(iy, height - 1));
+        const auto y_1 = std::max(0, std::min(iy + 1, height - 1));
+
+        const auto p00 = data + (static_cast<std::size_t>(y_0) * width + x_0) * 4;
+        const auto p01 = data + (static_cast<std::size_t>(y_0) * width + x_1) * 4;
+        const auto p10 = data + (static_cast<std::size_t>(y_1) * width + x_0) * 4;
+        const auto p11 = data + (static_cast<std::size_t>(y_1) * width + x_1) * 4;
+
+        for (auto c = 0; c < 4; ++c) {
+            const auto top    = p00[c] * (256 - wx) + p01[c] * wx;
+            const auto bottom = p10[c] * (256 - wx) + p11[c] * wx;
+            dst[c]            = static_cast<std::uint8_t>((top * (256 - wy) + bottom * wy + 32768) >> 16);
+        }
+    }
+}
+
+enum class target_kind
+{
+    normal,
+    additive,
+    key,
+};
+
+class image_renderer
+{
+    std::shared_ptr<image> last_frame_;
+
+  public:
+    std::vector<array<const std::uint8_t>> operator()(std::vector<layer>                      layers,
+                                                       const core::video_format_desc&          format_desc,
+                                                       const std::vector<core::output_format>& formats,
+                                                       const std::vector<core::output_size>&   sizes)
+    {
+        caspar::diagnostics::trace::scope traced("cpu::image_mixer::render");
+
+        // NOTE: Nothing is rendered for empty frames, the mixer outputs blank frames of black images it keeps.
+        if (layers.empty()) {
+            last_frame_.reset();
+            return {};
+        }
+
+        const auto size = static_cast<std::size_t>(format_desc.width) * format_desc.height * 4;
+
+        array<std::uint8_t> target(size);
+        std::memset(target.data(), 0, size);
+
+        draw(target.data(), std::move(layers), format_desc);
+
+        auto frame = std::make_shared<image>(image{std::move(target), format_desc.width, format_desc.height});
+
+        // NOTE: Interlaced channels run at field rate. Their converted images are woven of the previous frame as the
+        // first field and this frame as the second, as on the gpu.
+        image first_field;
+        if (format_desc.field_count == 2) {
+            first_field = last_frame_ && last_frame_->width == frame->width && last_frame_->height == frame->height
+                              ? *last_frame_
+                              : *frame;
+            last_frame_ = frame;
+        } else {
+            last_frame_.reset();
+        }
+        const auto upper_field_first =
+            format_desc.format != core::video_format::pal && format_desc.format != core::video_format::ntsc;
+
+        std::vector<array<const std::uint8_t>> images;
+        images.push_back(frame->data);
+        for (auto format : formats) {
+            images.push_back(convert(*frame, format, format_desc.height > 700, first_field, upper_field_first));
+        }
+        for (auto& output_size : sizes) {
+            images.push_back(scale(*frame, output_size.width, output_size.height));
+        }
+        return images;
+    }
+
+  private:
+    void draw(std::uint8_t* target, std::vector<layer> layers, const core::video_format_desc& format_desc)
+    {
+        buffer layer_key;
+
+        for (auto& layer : layers) {
+            draw(target, std::move(layer.sublayers), format_desc);
+            draw(target, std::move(layer), layer_key, format_desc);
+        }
+    }
+
+    void draw(std::uint8_t* target, layer layer, buffer& layer_key, const core::video_format_desc& format_desc)
+    {
+        if (layer.items.empty()) {
+            return;
+        }
+
+        const auto pixels = static_cast<std::size_t>(format_desc.width) * format_desc.height;
+
+        buffer local_key;
+        buffer local_mix;
+
+        if (layer.blend_mode != core::blend_mode::normal) {
+            buffer layer_buffer;
+            layer_buffer.allocate(pixels * 4);
+
+            for (auto& item : layer.items) {
+                draw(layer_buffer.data.data(), std::move(item), layer_key, local_key, local_mix, format_desc);
+            }
+
+            composite(layer_buffer.data.data(), local_mix, core::blend_mode::normal, format_desc);
+            composite(target, layer_buffer, layer.blend_mode, format_desc);
+        } else {
+            for (auto& item : layer.items) {
+                draw(target, std::move(item), layer_key, local_key, local_mix, format_desc);
+            }
+
+            composite(target, local_mix, core::blend_mode::normal, format_desc);
+        }
+
+        layer_key = std::move(local_key);
+    }
+
+    void draw(std::uint8_t*                  target,
+              item                           item,
+              buffer&                        layer_key,
+              buffer&                        local_key,
+              buffer&                        local_mix,
+              const core::video_format_desc& format_desc)
+    {
+        const auto pixels = static_cast<std::size_t>(format_desc.width) * format_desc.height;
+
+        if (item.transform.is_key) {
+            local_key.allocate(pixels);
+            draw(local_key.data.data(), item, nullptr, nullptr, target_kind::key, format_desc);
+        } else if (item.transform.is_mix) {
+            local_mix.allocate(pixels * 4);
+            draw(local_mix.data.data(), item, &local_key, &layer_key, target_kind::additive, format_desc);
+            local_key = buffer();
+        } else {
+            composite(target, local_mix, core::blend_mode::normal, format_desc);
+            local_mix = buffer();
+
+            draw(target, item, &local_key, &layer_key, target_kind::normal, format_desc);
+            local_key = buffer();
+        }
+    }
+
+    void draw(std::uint8_t*                  target,
+              const item&                    item,
+              const buffer*                  local_key,
+              const buffer*                  layer_key,
+              target_kind                    kind,
+              const core::video_format_desc& format_desc)
+    {
+        const auto opacity = kind == target_kind::key ? 1.0 : item.transform.opacity;
+        if (opacity < 0.001) {
+            return;
+        }
+
+        const auto source = get_image(item.frame);
+        if (!source.data) {
+            return;
+        }
+
+        const auto p = place(item, source, format_desc);
+        if (p.empty()) {
+            return;
+        }
+
+        const auto width  = format_desc.width;
+        const auto factor = static_cast<int>(std::round(std::min(1.0, opacity) * 255.0));
+        const auto keys   = (local_key && *local_key) || (layer_key && *layer_key);
+
+        for_rows(p.top, p.bottom, [&](int y) {
+            const auto count = p.right - p.left;
+
+            std::vector<std::uint8_t> row;
+            const std::uint8_t*       pixels = nullptr;
+
+            // Rows of aligned items which lie within the source are drawn straight from it.
+            const auto sx = static_cast<int>(std::round(p.sx)) + p.left;
+            const auto sy = static_cast<int>(std::round(p.sy)) + y;
+            if (p.aligned && !keys && sx >= p.min_x && sx + count <= p.max_x && sy >= p.min_y && sy < p.max_y) {
+                pixels = source.data.data() + (static_cast<std::size_t>(sy) * source.width + sx) * 4;
+            } else {
+                row.resize(static_cast<std::size_t>(count) * 4);
+                sample_row(source, p, y, p.left, p.right, row.data());
+                if (local_key && *local_key) {
+                    mask_row(row.data(), local_key->data.data() + static_cast<std::size_t>(y) * width + p.left, count);
+                }
+                if (layer_key && *layer_key) {
+                    mask_row(row.data(), layer_key->data.data() + static_cast<std::size_t>(y) * width + p.left, count);
+                }
+                pixels = row.data();
+            }
+
+            switch (kind) {
+                case target_kind::key:
+                    key_row(target + static_cast<std::size_t>(y) * width + p.left, pixels, count);
+                    break;
+                case target_kind::additive:
+                    add_row(target + (static_cast<std::size_t>(y) * width + p.left) * 4, pixels, count, factor);
+                    break;
+                default:
+                    over_row(target + (static_cast<std::size_t>(y) * width + p.left) * 4, pixels, count, factor);
+                    break;
+            }
+        });
+    }
+
+    void composite(std::uint8_t*                  target,
+                   const buffer&                  source,
+                   core::blend_mode               blend_mode,
+                   const core::video_format_desc& format_desc)
+    {
+        if (!source) {
+            return;
+        }
+
+        const auto width = format_desc.width;
+        for_rows(0, format_desc.height, [&](int y) {
+            const auto offset = static_cast<std::size_t>(y) * width * 4;
+            if (blend_mode == core::blend_mode::normal) {
+                over_row(target + offset, source.data.data() + offset, width, 255);
+            } else {
+                blend_row(target + offset, source.data.data() + offset, width, blend_mode);
+            }
+        });
+    }
+};
+
+} // namespace
+
+struct image_mixer::impl : public core::frame_factory
+{
+    image_renderer                     renderer_;
+    std::vector<core::image_transform> transform_stack_;
+    std::vector<layer>                 layers_; // layer/stream/items
+    std::vector<layer*>                layer_stack_;
+    executor                           executor_{L"cpu image mixer"};
+
+  public:
+    impl(int channel_id)
+        : transform_stack_(1)
+    {
+        CASPAR_LOG(info) << L"Initialized CPU Image Mixer for channel " << channel_id;
+    }
+
+    void push(const core::frame_transform& transform)
+    {
+        auto previous_layer_depth = transform_stack_.back().layer_depth;
+        transform_stack_.push_back(transform_stack_.back() * transform.image_transform);
+        auto new_layer_depth = transform_stack_.back().layer_depth;
+
+        if (previous_layer_depth < new_layer_depth) {
+            layer new_layer(transform_stack_.back().blend_mode);
+
+            if (layer_stack_.empty()) {
+                layers_.push_back(std::move(new_layer));
+                layer_stack_.push_back(&layers_.back());
+            } else {
+                layer_stack_.back()->sublayers.push_back(std::move(new_layer));
+                layer_stack_.push_back(&layer_stack_.back()->sublayers.back());
+            }
+        }
+    }
+
+    void visit(const core::const_frame& frame)
+    {
+        if (frame.pixel_format_desc().format == core::pixel_format::invalid) {
+            return;
+        }
+
+        if (frame.pixel_format_desc().planes.empty()) {
+            return;
+        }
+
+        item item;
+        item.frame     = frame;
+        item.transform = transform_stack_.back();
+        item.geometry  = frame.geometry();
+
+        layer_stack_.back()->items.push_back(std::move(item));
+    }
+
+    void pop()
+    {
+        transform_stack_.pop_back();
+        layer_stack_.resize(transform_stack_.back().layer_depth);
+    }
+
+    std::future<std::vector<array<const std::uint8_t>>> render(const core::video_format_desc&          format_desc,
+                                                               const std::vector<core::output_format>& formats,
+                                                               const std::vector<core::output_size>&   sizes)
+    {
+        auto trace_frame = caspar::diagnostics::trace::current_frame();
+        return executor_.begin_invoke([this, layers = std::move(layers_), format_desc, formats, sizes, trace_frame] {
+            caspar::diagnostics::trace::frame_scope frame_scope(trace_frame);
+            return renderer_(std::move(layers), format_desc, formats, sizes);
+        });
+    }
+
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
+    {
+        std::vector<array<std::uint8_t>> image_data;
+        for (auto& plane : desc.planes) {
+            image_data.emplace_back(static_cast<std::size_t>(plane.size));
+        }
+        return core::mutable_frame(tag, std::move(image_data), array<int32_t>{}, desc);
+    }
+
+    core::mutable_frame update_frame(const void*                            tag,
+                                     const core::pixel_format_desc&         desc,
+                                     const core::const_frame&               previous,
+                                     const std::vector<core::frame_region>& regions) override
+    {
+        // NOTE: The whole image is written either way, and there is nothing to copy it from on the cpu.
+        return create_frame(tag, desc);
+    }
+
+    core::mutable_frame import_frame(const void* tag, void* shared_handle, int width, int height) override
+    {
+        CASPAR_THROW_EXCEPTION(not_supported() << msg_info("The cpu image mixer cannot import shared textures."));
+    }
+};
+
+image_mixer::image_mixer(int channel_id)
+    : impl_(std::make_unique<impl>(channel_id))
+{
+}
+image_mixer::~image_mixer() {}
+void image_mixer::push(const core::frame_transform& transform) { impl_->push(transform); }
+void image_mixer::visit(const core::const_frame& frame) { impl_->visit(frame); }
+void image_mixer::pop() { impl_->pop(); }
+std::future<std::vector<array<const std::uint8_t>>>
+image_mixer::operator()(const core::video_format_desc&          format_desc,
+                        const std::vector<core::output_format>& formats,
+                        const std::vector<core::output_size>&   sizes,
+                        bool)
+{
+    return impl_->render(format_desc, formats, sizes);
+}
+core::mutable_frame image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc)
+{
+    return impl_->create_frame(tag, desc);
+}
+core::mutable_frame image_mixer::update_frame(const void*                            tag,
+                                              const core::pixel_format_desc&         desc,
+                                              const core::const_frame&               previous,
+                                              const std::vector<core::frame_region>& regions)
+{
+    return impl_->update_frame(tag, desc, previous, regions);
+}
+core::mutable_frame image_mixer::import_frame(const void* tag, void* shared_handle, int width, int height)
+{
+    return impl_->import_frame(tag, shared_handle, width, height);
+}
+
+}}} // namespace caspar::accelerator::cpu
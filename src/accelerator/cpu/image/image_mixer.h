@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/array.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/video_format.h>
+
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+// Composites frames on the cpu, for channels on hosts without a usable gpu. Frames are drawn with their fill, anchor,
+// rotation, crop and clip, opacity, keys, mixes and the separable blend modes. Perspective, chroma keys, levels and
+// contrast, saturation and brightness are ignored.
+class image_mixer final : public core::image_mixer
+{
+  public:
+    explicit image_mixer(int channel_id);
+    image_mixer(const image_mixer&) = delete;
+
+    ~image_mixer();
+
+    image_mixer& operator=(const image_mixer&) = delete;
+
+    std::future<std::vector<array<const std::uint8_t>>>
+    operator()(const core::video_format_desc&          format_desc,
+               const std::vector<core::output_format>& formats,
+               const std::vector<core::output_size>&   sizes,
+               bool                                    read_back) override;
+
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+    core::mutable_frame update_frame(const void*                            tag,
+                                     const core::pixel_format_desc&         desc,
+                                     const core::const_frame&               previous,
+                                     const std::vector<core::frame_region>& regions) override;
+    core::mutable_frame import_frame(const void* tag, void* shared_handle, int width, int height) override;
+
+    // core::image_mixer
+
+    void push(const core::frame_transform& frame) override;
+    void visit(const core::const_frame& frame) override;
+    void pop() override;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::cpu
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "output_converter.h"
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+namespace {
+
+template <typename Func>
+void for_rows(int height, Func&& func)
+{
+    tbb::parallel_for(tbb::blocked_range<int>(0, height, 16), [&](const tbb::blocked_range<int>& rows) {
+        for (auto y = rows.begin(); y != rows.end(); ++y) {
+            func(y);
+        }
+    });
+}
+
+// The pixels of a rendered frame, which are clamped to the frame. Woven frames take the rows of the first field from
+// first_field and the rows of the second field from source.
+struct reader
+{
+    const image& source;
+    const image& first_field;
+    bool         upper_field_first;
+
+    const std::uint8_t* fetch(int x, int y) const
+    {
+        x = std::max(0, std::min(x, source.width - 1));
+        y = std::max(0, std::min(y, source.height - 1));
+
+        const auto& image = first_field.data && (y % 2 == 0) == upper_field_first ? first_field : source;
+        return image.data.data() + (static_cast<std::size_t>(y) * image.width + x) * 4;
+    }
+};
+
+// Studio range 8 bit Y, Cb and Cr of a bgra pixel.
+std::array<float, 3> get_ycbcr(const std::uint8_t* pixel, bool is_hd)
+{
+    const auto b  = pixel[0] / 255.0f;
+    const auto g  = pixel[1] / 255.0f;
+    const auto r  = pixel[2] / 255.0f;
+    const auto kr = is_hd ? 0.2126f : 0.299f;
+    const auto kb = is_hd ? 0.0722f : 0.114f;
+    const auto y  = kr * r + (1.0f - kr - kb) * g + kb * b;
+    return {16.0f + 219.0f * y, 128.0f + 112.0f * (b - y) / (1.0f - kb), 128.0f + 112.0f * (r - y) / (1.0f - kr)};
+}
+
+std::uint8_t to_byte(float value)
+{
+    return static_cast<std::uint8_t>(std::max(0.0f, std::min(255.0f, std::round(value))));
+}
+
+std::uint32_t to_10bit(float value)
+{
+    return static_cast<std::uint32_t>(std::max(4.0f, std::min(1019.0f, std::round(value * 4.0f))));
+}
+
+void write_word(std::uint8_t* dst, float c0, float c1, float c2)
+{
+    const auto word = to_10bit(c0) | to_10bit(c1) << 10 | to_10bit(c2) << 20;
+    dst[0]          = static_cast<std::uint8_t>(word);
+    dst[1]          = static_cast<std::uint8_t>(word >> 8);
+    dst[2]          = static_cast<std::uint8_t>(word >> 16);
+    dst[3]          = static_cast<std::uint8_t>(word >> 24);
+}
+
+} // namespace
+
+array<const std::uint8_t> convert(const image&        source,
+                                  core::output_format format,
+                                  bool                is_hd,
+                                  const image&        first_field,
+                                  bool                upper_field_first)
+{
+    const auto width  = source.width;
+    const auto height = source.height;
+    const auto in     = reader{source, first_field, upper_field_first};
+
+    // Cb and Cr of the pixel pair starting at x, y.
+    auto get_chroma = [&](int x, int y) {
+        const auto c0 = get_ycbcr(in.fetch(x, y), is_hd);
+        const auto c1 = get_ycbcr(in.fetch(x + 1, y), is_hd);
+        return std::array<float, 2>{(c0[1] + c1[1]) * 0.5f, (c0[2] + c1[2]) * 0.5f};
+    };
+
+    switch (format) {
+        case core::output_format::bgra: {
+            if (!first_field.data) {
+                return source.data;
+            }
+            array<std::uint8_t> result(static_cast<std::size_t>(width) * height * 4);
+            for_rows(height, [&](int y) { std::copy_n(in.fetch(0, y), width * 4, result.data() + y * width * 4); });
+            return std::move(result);
+        }
+        case core::output_format::uyvy: {
+            const auto          texels = (width + 1) / 2;
+            array<std::uint8_t> result(static_cast<std::size_t>(texels) * height * 4);
+            for_rows(height, [&](int y) {
+                auto dst = result.data() + static_cast<std::size_t>(y) * texels * 4;
+                for (auto x = 0; x < texels; ++x, dst += 4) {
+                    const auto c0 = get_ycbcr(in.fetch(x * 2, y), is_hd);
+                    const auto c1 = get_ycbcr(in.fetch(x * 2 + 1, y), is_hd);
+                    dst[0]        = to_byte((c0[1] + c1[1]) * 0.5f);
+                    dst[1]        = to_byte(c0[0]);
+                    dst[2]        = to_byte((c0[2] + c1[2]) * 0.5f);
+                    dst[3]        = to_byte(c1[0]);
+                }
+            });
+            return std::move(result);
+        }
+        case core::output_format::v210: {
+            // Every four words hold six pixels: Cb0 Y0 Cr0, Y1 Cb2 Y2, Cr2 Y3 Cb4, Y4 Cr4 Y5.
+            const auto          words = (width + 47) / 48 * 32;
+            array<std::uint8_t> result(static_cast<std::size_t>(words) * height * 4);
+            for_rows(height, [&](int y) {
+                auto dst = result.data() + static_cast<std::size_t>(y) * words * 4;
+                for (auto x = 0; x < words / 4; ++x, dst += 16) {
+                    const auto p  = x * 6;
+                    const auto c0 = get_chroma(p, y);
+                    const auto c2 = get_chroma(p + 2, y);
+                    const auto c4 = get_chroma(p + 4, y);
+                    write_word(dst, c0[0], get_ycbcr(in.fetch(p, y), is_hd)[0], c0[1]);
+                    write_word(dst + 4,
+                               get_ycbcr(in.fetch(p + 1, y), is_hd)[0],
+                               c2[0],
+                               get_ycbcr(in.fetch(p + 2, y), is_hd)[0]);
+                    write_word(dst + 8, c2[1], get_ycbcr(in.fetch(p + 3, y), is_hd)[0], c4[0]);
+                    write_word(dst + 12,
+                               get_ycbcr(in.fetch(p + 4, y), is_hd)[0],
+                               c4[1],
+                               get_ycbcr(in.fetch(p + 5, y), is_hd)[0]);
+                }
+            });
+            return std::move(result);
+        }
+        case core::output_format::nv12: {
+            // The luma rows are followed by half as many rows of interleaved Cb and Cr.
+            const auto          chroma_height = (height + 1) / 2;
+            array<std::uint8_t> result(static_cast<std::size_t>(width) * (height + chroma_height));
+            for_rows(height + chroma_height, [&](int y) {
+                auto dst = result.data() + static_cast<std::size_t>(y) * width;
+                if (y < height) {
+                    for (auto x = 0; x < width; ++x) {
+                        dst[x] = to_byte(get_ycbcr(in.fetch(x, y), is_hd)[0]);
+                    }
+                    return;
+                }
+                const auto py = (y - height) * 2;
+                for (auto x = 0; x < width; x += 2) {
+                    const auto c0 = get_chroma(x, py);
+                    const auto c1 = get_chroma(x, py + 1);
+                    dst[x]        = to_byte((c0[0] + c1[0]) * 0.5f);
+                    if (x + 1 < width) {
+                        dst[x + 1] = to_byte((c0[1] + c1[1]) * 0.5f);
+                    }
+                }
+            });
+            return std::move(result);
+        }
+        case core::output_format::key: {
+            array<std::uint8_t> result(static_cast<std::size_t>(width) * height * 4);
+            for_rows(height, [&](int y) {
+                auto dst = result.data() + static_cast<std::size_t>(y) * width * 4;
+                for (auto x = 0; x < width; ++x, dst += 4) {
+                    std::fill_n(dst, 4, in.fetch(x, y)[3]);
+                }
+            });
+            return std::move(result);
+        }
+        case core::output_format::quarter: {
+            const auto          quarter_width  = (width + 3) / 4;
+            const auto          quarter_height = (height + 3) / 4;
+            array<std::uint8_t> result(static_cast<std::size_t>(quarter_width) * quarter_height * 4);
+            for_rows(quarter_height, [&](int y) {
+                auto dst = result.data() + static_cast<std::size_t>(y) * quarter_width * 4;
+                for (auto x = 0; x < quarter_width; ++x, dst += 4) {
+                    std::array<int, 4> sum{};
+                    for (auto n = 0; n < 16; ++n) {
+                        const auto pixel = in.fetch(x * 4 + n % 4, y * 4 + n / 4);
+                        for (auto c = 0; c < 4; ++c) {
+                            sum[c] += pixel[c];
+                        }
+                    }
+                    for (auto c = 0; c < 4; ++c) {
+                        dst[c] = static_cast<std::uint8_t>((sum[c] + 8) / 16);
+                    }
+                }
+            });
+            return std::move(result);
+        }
+        case core::output_format::rfc4175: {
+            // Every two pixels are a group of five big endian bytes: Cb Y0 Cr Y1, ten bits each.
+            const auto          groups = (width + 1) / 2;
+            const auto          stride = (groups * 5 + 3) / 4 * 4;
+            array<std::uint8_t> result(static_cast<std::size_t>(stride) * height);
+            for_rows(height, [&](int y) {
+                auto dst = result.data() + static_cast<std::size_t>(y) * stride;
+                std::fill_n(dst + groups * 5, stride - groups * 5, 0);
+                for (auto x = 0; x < groups; ++x, dst += 5) {
+                    const auto c    = get_chroma(x * 2, y);
+                    const auto y0   = to_10bit(get_ycbcr(in.fetch(x * 2, y), is_hd)[0]);
+                    const auto y1   = to_10bit(get_ycbcr(in.fetch(x * 2 + 1, y), is_hd)[0]);
+                    const auto bits = static_cast<std::uint64_t>(to_10bit(c[0])) << 30 |
+                                      static_cast<std::uint64_t>(y0) << 20 |
+                                      static_cast<std::uint64_t>(to_10bit(c[1])) << 10 | y1;
+                    for (auto n = 0; n < 5; ++n) {
+                        dst[n] = static_cast<std::uint8_t>(bits >> (32 - n * 8));
+                    }
+                }
+            });
+            return std::move(result);
+        }
+        default:
+            return source.data;
+    }
+}
+
+array<const std::uint8_t> scale(const image& source, int width, int height)
+{
+    array<std::uint8_t> result(static_cast<std::size_t>(width) * height * 4);
+
+    for_rows(height, [&](int y) {
+        const auto y0 = y * source.height / height;
+        const auto y1 = std::max(y0 + 1, (y + 1) * source.height / height);
+
+        auto dst = result.data() + static_cast<std::size_t>(y) * width * 4;
+        for (auto x = 0; x < width; ++x, dst += 4) {
+            const auto x0 = x * source.width / width;
+            const auto x1 = std::max(x0 + 1, (x + 1) * source.width / width);
+
+            std::array<int, 4> sum{};
+            for (auto sy = y0; sy < y1; ++sy) {
+                auto src = source.data.data() + (static_cast<std::size_t>(sy) * source.width + x0) * 4;
+                for (auto sx = x0; sx < x1; ++sx, src += 4) {
+                    for (auto c = 0; c < 4; ++c) {
+                        sum[c] += src[c];
+                    }
+                }
+            }
+
+            const auto count = (x1 - x0) * (y1 - y0);
+            for (auto c = 0; c < 4; ++c) {
+                dst[c] = static_cast<std::uint8_t>((sum[c] + count / 2) / count);
+            }
+        }
+    });
+
+    return std::move(result);
+}
+
+}}} // namespace caspar::accelerator::cpu
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/array.h>
+
+#include <core/frame/pixel_format.h>
+
+#include <cstdint>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+// A bgra image of the cpu mixer.
+struct image
+{
+    array<const std::uint8_t> data;
+    int                       width  = 0;
+    int                       height = 0;
+};
+
+// Converts a rendered frame into the bytes of format, row by row, as the gpu mixer does. If first_field has data, the
+// frame is first woven of the first field of first_field and the second field of source.
+array<const std::uint8_t> convert(const image&        source,
+                                  core::output_format format,
+                                  bool                is_hd,
+                                  const image&        first_field       = image(),
+                                  bool                upper_field_first = true);
+
+// Scales source down to a bgra image of width by height, each pixel the average of the source pixels under it.
+array<const std::uint8_t> scale(const image& source, int width, int height);
+
+}}} // namespace caspar::accelerator::cpu
@@ -24,6 +24,7 @@
 #include "image_shader.h"
 
 #include "../util/device.h"
+#include "../util/gpu_profiler.h"
 #include "../util/shader.h"
 #include "../util/texture.h"
 
@@ -41,8 +42,13 @@
 
 #include <GL/glew.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cmath>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
@@ -112,18 +118,42 @@ bool is_outside_screen(const std::vector<core::frame_geometry::coord>& coords)
 
 struct image_kernel::impl
 {
+    static const int vertex_count = 6;
+
     spl::shared_ptr<device> ogl_;
-    spl::shared_ptr<shader> shader_;
     GLuint                  vao_;
     GLuint                  vbo_;
+    GLuint                  ubo_;
+
+    // Shader specializations used by this kernel, only used on the device thread.
+    std::unordered_map<image_shader_key, std::shared_ptr<shader>> shaders_;
+
+    mutable std::mutex                       draws_mutex_;
+    std::map<image_shader_key, std::int64_t> draws_;
+    std::atomic<std::int64_t>                clears_{0};
 
     impl(const spl::shared_ptr<device>& ogl)
         : ogl_(ogl)
-        , shader_(ogl_->dispatch_sync([&] { return get_image_shader(ogl); }))
     {
         ogl_->dispatch_sync([&] {
-            GL(glGenVertexArrays(1, &vao_));
-            GL(glGenBuffers(1, &vbo_));
+            // The vertex layout and attribute locations are fixed, so the vertex array is set up once and each draw
+            // only updates the vertices and the uniform block.
+            auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+
+            GL(glCreateBuffers(1, &vbo_));
+            GL(glNamedBufferStorage(vbo_, stride * vertex_count, nullptr, GL_DYNAMIC_STORAGE_BIT));
+
+            GL(glCreateVertexArrays(1, &vao_));
+            GL(glVertexArrayVertexBuffer(vao_, 0, vbo_, 0, stride));
+            GL(glEnableVertexArrayAttrib(vao_, 0));
+            GL(glEnableVertexArrayAttrib(vao_, 1));
+            GL(glVertexArrayAttribFormat(vao_, 0, 2, GL_DOUBLE, GL_FALSE, 0));
+            GL(glVertexArrayAttribFormat(vao_, 1, 4, GL_DOUBLE, GL_FALSE, 2 * sizeof(GLdouble)));
+            GL(glVertexArrayAttribBinding(vao_, 0, 0));
+            GL(glVertexArrayAttribBinding(vao_, 1, 0));
+
+            GL(glCreateBuffers(1, &ubo_));
+            GL(glNamedBufferStorage(ubo_, sizeof(image_uniforms), nullptr, GL_DYNAMIC_STORAGE_BIT));
         });
     }
 
@@ -132,28 +162,65 @@ struct image_kernel::impl
         ogl_->dispatch_sync([&] {
             GL(glDeleteVertexArrays(1, &vao_));
             GL(glDeleteBuffers(1, &vbo_));
+            GL(glDeleteBuffers(1, &ubo_));
         });
     }
 
-    void draw(draw_params params)
+    core::monitor::state state() const
+    {
+        std::lock_guard<std::mutex> lock(draws_mutex_);
+
+        core::monitor::state state;
+        for (auto& draws : draws_) {
+            state["shader"][get_image_shader_name(draws.first)]["draws"] = draws.second;
+        }
+        state["clears"] = static_cast<std::int64_t>(clears_);
+        return state;
+    }
+
+    // Whether params draws an unclipped, unrotated and unadjusted rectangle over the whole target with normal blending.
+    static bool covers_target(const draw_params& params, const std::vector<core::frame_geometry::coord>& coords)
     {
         static const double epsilon = 0.001;
 
-        CASPAR_ASSERT(params.pix_desc.planes.size() == params.textures.size());
+        const auto& transform = params.transform;
+        const auto& levels    = transform.levels;
+        const auto& pers      = transform.perspective;
+        const auto  identity  = core::corners{};
 
-        if (params.textures.empty() || !params.background) {
-            return;
+        if (pers.ul != identity.ul || pers.ur != identity.ur || pers.lr != identity.lr || pers.ll != identity.ll) {
+            return false;
         }
 
-        if (params.transform.opacity < epsilon) {
-            return;
+        if (params.local_key || params.layer_key || params.keyer != keyer::linear || transform.is_key ||
+            params.blend_mode != core::blend_mode::normal || transform.opacity < 1.0 - epsilon ||
+            transform.angle != 0.0 || transform.chroma.enable ||
+            std::abs(transform.brightness - 1.0) > epsilon || std::abs(transform.saturation - 1.0) > epsilon ||
+            std::abs(transform.contrast - 1.0) > epsilon || levels.min_input > epsilon ||
+            levels.max_input < 1.0 - epsilon || levels.min_output > epsilon || levels.max_output < 1.0 - epsilon ||
+            std::abs(levels.gamma - 1.0) > epsilon || transform.clip_translation[0] > epsilon ||
+            transform.clip_translation[1] > epsilon || transform.clip_scale[0] < 1.0 - epsilon ||
+            transform.clip_scale[1] < 1.0 - epsilon ||
+            params.geometry.type() != core::frame_geometry::geometry_type::quad ||
+            !boost::equal(params.geometry.data(), core::frame_geometry::get_default().data())) {
+            return false;
         }
 
-        auto coords = params.geometry.data();
+        // NOTE: Without rotation, perspective or custom geometry the vertices are the corners of a rectangle.
+        auto x = std::minmax_element(coords.begin(), coords.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.vertex_x < rhs.vertex_x;
+        });
+        auto y = std::minmax_element(coords.begin(), coords.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.vertex_y < rhs.vertex_y;
+        });
+        return x.first->vertex_x <= 0.0 && x.second->vertex_x >= 1.0 && y.first->vertex_y <= 0.0 &&
+               y.second->vertex_y >= 1.0;
+    }
 
-        if (coords.empty()) {
-            return;
-        }
+    // Applies the fill, crop, perspective and rotation of params to its vertices.
+    static std::vector<core::frame_geometry::coord> transform_coords(const draw_params& params)
+    {
+        auto coords = params.geometry.data();
 
         // Calculate transforms
         auto f_p = params.transform.fill_translation;
@@ -219,11 +286,85 @@ struct image_kernel::impl
             }
         }
 
+        return coords;
+    }
+
+    draw_bounds bounds(const draw_params& params) const
+    {
+        auto coords = transform_coords(params);
+
+        if (coords.empty() || is_outside_screen(coords)) {
+            return draw_bounds{0.0, 0.0, 0.0, 0.0};
+        }
+
+        draw_bounds result{1.0, 1.0, 0.0, 0.0};
+        for (auto& coord : coords) {
+            result.left   = std::min(result.left, coord.vertex_x);
+            result.top    = std::min(result.top, coord.vertex_y);
+            result.right  = std::max(result.right, coord.vertex_x);
+            result.bottom = std::max(result.bottom, coord.vertex_y);
+        }
+
+        auto m_p = params.transform.clip_translation;
+        auto m_s = params.transform.clip_scale;
+
+        result.left   = std::max({result.left, m_p[0], 0.0});
+        result.top    = std::max({result.top, m_p[1], 0.0});
+        result.right  = std::min({result.right, m_p[0] + m_s[0], 1.0});
+        result.bottom = std::min({result.bottom, m_p[1] + m_s[1], 1.0});
+
+        return result;
+    }
+
+    void draw(draw_params params)
+    {
+        static const double epsilon = 0.001;
+
+        CASPAR_ASSERT(params.pix_desc.planes.size() == params.textures.size());
+
+        if (params.textures.empty() || !params.background) {
+            return;
+        }
+
+        if (params.transform.opacity < epsilon) {
+            return;
+        }
+
+        auto coords = transform_coords(params);
+
+        if (coords.empty()) {
+            return;
+        }
+
+        bool is_default_geometry = boost::equal(params.geometry.data(), core::frame_geometry::get_default().data());
+        auto crop                = params.transform.crop;
+        auto pers                = params.transform.perspective;
+        pers.ur[0] -= 1.0;
+        pers.lr[0] -= 1.0;
+        pers.lr[1] -= 1.0;
+        pers.ll[1] -= 1.0;
+
         // Skip drawing if all the coordinates will be outside the screen.
         if (is_outside_screen(coords)) {
             return;
         }
 
+        // NOTE: An opaque color covering the whole target, with nothing to blend, key or adjust, replaces what is
+        // below it, so the target is just cleared to the color.
+        if (params.solid && params.solid_color[3] == 255 && covers_target(params, coords)) {
+            auto bounds = to_pixels(params.bounds, params.background->width(), params.background->height());
+            params.background->clear(bounds[0], bounds[1], bounds[2], bounds[3], params.solid_color.data());
+            ++clears_;
+            return;
+        }
+
+        // NOTE: An opaque rectangle over the whole target replaces what is below it, so discarded contents of the
+        // target need not be cleared first.
+        const auto opaque = params.solid ? params.solid_color[3] == 255 : core::is_opaque(params.pix_desc.format);
+        if (opaque && params.bounds.full() && covers_target(params, coords)) {
+            params.background->overwrite();
+        }
+
         // Bind textures
 
         for (int n = 0; n < params.textures.size(); ++n) {
@@ -238,34 +379,31 @@ struct image_kernel::impl
             params.layer_key->bind(static_cast<int>(texture_id::layer_key));
         }
 
-        // Setup shader
-
-        shader_->use();
-
-        shader_->set("plane[0]", texture_id::plane0);
-        shader_->set("plane[1]", texture_id::plane1);
-        shader_->set("plane[2]", texture_id::plane2);
-        shader_->set("plane[3]", texture_id::plane3);
-        shader_->set("local_key", texture_id::local_key);
-        shader_->set("layer_key", texture_id::layer_key);
-        shader_->set("is_hd", params.pix_desc.planes.at(0).height > 700 ? 1 : 0);
-        shader_->set("has_local_key", static_cast<bool>(params.local_key));
-        shader_->set("has_layer_key", static_cast<bool>(params.layer_key));
-        shader_->set("pixel_format", params.pix_desc.format);
-        shader_->set("opacity", params.transform.is_key ? 1.0 : params.transform.opacity);
-
-        if (params.transform.chroma.enable) {
-            shader_->set("chroma", true);
-            shader_->set("chroma_show_mask", params.transform.chroma.show_mask);
-            shader_->set("chroma_target_hue", params.transform.chroma.target_hue / 360.0);
-            shader_->set("chroma_hue_width", params.transform.chroma.hue_width);
-            shader_->set("chroma_min_saturation", params.transform.chroma.min_saturation);
-            shader_->set("chroma_min_brightness", params.transform.chroma.min_brightness);
-            shader_->set("chroma_softness", 1.0 + params.transform.chroma.softness);
-            shader_->set("chroma_spill_suppress", params.transform.chroma.spill_suppress / 360.0);
-            shader_->set("chroma_spill_suppress_saturation", params.transform.chroma.spill_suppress_saturation);
-        } else {
-            shader_->set("chroma", false);
+        // Setup shader uniforms, the samplers are bound to their texture units in the shader itself.
+
+        image_uniforms uniforms;
+        uniforms.is_hd      = params.pix_desc.planes.at(0).height > 700 ? 1 : 0;
+        uniforms.opacity    = static_cast<float>(params.transform.is_key ? 1.0 : params.transform.opacity);
+        uniforms.field_mode = static_cast<std::int32_t>(params.transform.field_mode);
+
+        if (params.solid) {
+            uniforms.solid_b = params.solid_color[0] / 255.0f;
+            uniforms.solid_g = params.solid_color[1] / 255.0f;
+            uniforms.solid_r = params.solid_color[2] / 255.0f;
+            uniforms.solid_a = params.solid_color[3] / 255.0f;
+        }
+
+        const auto chroma_enabled = params.transform.chroma.enable;
+        if (chroma_enabled) {
+            const auto& chroma                        = params.transform.chroma;
+            uniforms.chroma_show_mask                 = chroma.show_mask ? 1 : 0;
+            uniforms.chroma_target_hue                = static_cast<float>(chroma.target_hue / 360.0);
+            uniforms.chroma_hue_width                 = static_cast<float>(chroma.hue_width);
+            uniforms.chroma_min_saturation            = static_cast<float>(chroma.min_saturation);
+            uniforms.chroma_min_brightness            = static_cast<float>(chroma.min_brightness);
+            uniforms.chroma_softness                  = static_cast<float>(1.0 + chroma.softness);
+            uniforms.chroma_spill_suppress            = static_cast<float>(chroma.spill_suppress / 360.0);
+            uniforms.chroma_spill_suppress_saturation = static_cast<float>(chroma.spill_suppress_saturation);
         }
 
         // Setup blend_func
@@ -275,37 +413,57 @@ struct image_kernel::impl
         }
 
         params.background->bind(static_cast<int>(texture_id::background));
-        shader_->set("background", texture_id::background);
-        shader_->set("blend_mode", params.blend_mode);
-        shader_->set("keyer", params.keyer);
 
         // Setup image-adjustements
 
-        if (params.transform.levels.min_input > epsilon || params.transform.levels.max_input < 1.0 - epsilon ||
+        const auto levels_enabled =
+            params.transform.levels.min_input > epsilon || params.transform.levels.max_input < 1.0 - epsilon ||
             params.transform.levels.min_output > epsilon || params.transform.levels.max_output < 1.0 - epsilon ||
-            std::abs(params.transform.levels.gamma - 1.0) > epsilon) {
-            shader_->set("levels", true);
-            shader_->set("min_input", params.transform.levels.min_input);
-            shader_->set("max_input", params.transform.levels.max_input);
-            shader_->set("min_output", params.transform.levels.min_output);
-            shader_->set("max_output", params.transform.levels.max_output);
-            shader_->set("gamma", params.transform.levels.gamma);
-        } else {
-            shader_->set("levels", false);
+            std::abs(params.transform.levels.gamma - 1.0) > epsilon;
+        if (levels_enabled) {
+            uniforms.min_input  = static_cast<float>(params.transform.levels.min_input);
+            uniforms.max_input  = static_cast<float>(params.transform.levels.max_input);
+            uniforms.min_output = static_cast<float>(params.transform.levels.min_output);
+            uniforms.max_output = static_cast<float>(params.transform.levels.max_output);
+            uniforms.gamma      = static_cast<float>(params.transform.levels.gamma);
+        }
+
+        const auto csb_enabled = std::abs(params.transform.brightness - 1.0) > epsilon ||
+                                 std::abs(params.transform.saturation - 1.0) > epsilon ||
+                                 std::abs(params.transform.contrast - 1.0) > epsilon;
+        if (csb_enabled) {
+            uniforms.brt = static_cast<float>(params.transform.brightness);
+            uniforms.sat = static_cast<float>(params.transform.saturation);
+            uniforms.con = static_cast<float>(params.transform.contrast);
         }
 
-        if (std::abs(params.transform.brightness - 1.0) > epsilon ||
-            std::abs(params.transform.saturation - 1.0) > epsilon ||
-            std::abs(params.transform.contrast - 1.0) > epsilon) {
-            shader_->set("csb", true);
+        // Features are compiled into the shader, so that the common case runs without any branches.
+        auto key = make_image_shader_key(params.pix_desc.format,
+                                         params.blend_mode,
+                                         params.keyer == keyer::additive,
+                                         chroma_enabled,
+                                         levels_enabled,
+                                         csb_enabled,
+                                         static_cast<bool>(params.local_key),
+                                         static_cast<bool>(params.layer_key),
+                                         params.solid);
+
+        auto& shader = shaders_[key];
+        if (!shader) {
+            shader = get_image_shader(ogl_, key);
+        }
+        shader->use();
 
-            shader_->set("brt", params.transform.brightness);
-            shader_->set("sat", params.transform.saturation);
-            shader_->set("con", params.transform.contrast);
-        } else {
-            shader_->set("csb", false);
+        {
+            std::lock_guard<std::mutex> lock(draws_mutex_);
+            ++draws_[key];
         }
 
+        auto timed = ogl_->profiler().time("draw/" + get_image_shader_name(key));
+
+        GL(glNamedBufferSubData(ubo_, 0, sizeof(uniforms), &uniforms));
+        GL(glBindBufferBase(GL_UNIFORM_BUFFER, 0, ubo_));
+
         // Setup drawing area
 
         GL(glViewport(0, 0, params.background->width(), params.background->height()));
@@ -319,15 +477,23 @@ struct image_kernel::impl
                        m_s[0] < (1.0 - std::numeric_limits<double>::epsilon()) ||
                        m_s[1] < (1.0 - std::numeric_limits<double>::epsilon());
 
-        if (scissor) {
+        if (scissor || !params.bounds.full()) {
             double w = static_cast<double>(params.background->width());
             double h = static_cast<double>(params.background->height());
 
+            auto x0 = static_cast<int>(m_p[0] * w);
+            auto y0 = static_cast<int>(m_p[1] * h);
+            auto x1 = x0 + std::max(0, static_cast<int>(m_s[0] * w));
+            auto y1 = y0 + std::max(0, static_cast<int>(m_s[1] * h));
+
+            auto bounds = to_pixels(params.bounds, params.background->width(), params.background->height());
+            x0          = std::max(x0, bounds[0]);
+            y0          = std::max(y0, bounds[1]);
+            x1          = std::min(x1, bounds[0] + bounds[2]);
+            y1          = std::min(y1, bounds[1] + bounds[3]);
+
             GL(glEnable(GL_SCISSOR_TEST));
-            GL(glScissor(static_cast<int>(m_p[0] * w),
-                         static_cast<int>(m_p[1] * h),
-                         std::max(0, static_cast<int>(m_s[0] * w)),
-                         std::max(0, static_cast<int>(m_s[1] * h))));
+            GL(glScissor(x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0)));
         }
 
         // Set render target
@@ -365,7 +531,7 @@ struct image_kernel::impl
 
             std::vector<double> q_values = {ulq, urq, lrq, llq};
 
-            corner = 0;
+            int corner = 0;
             for (auto& coord : coords) {
                 coord.texture_q = q_values[corner];
                 coord.texture_x *= q_values[corner];
@@ -379,36 +545,15 @@ struct image_kernel::impl
         // Draw
         switch (params.geometry.type()) {
             case core::frame_geometry::geometry_type::quad: {
-                GL(glBindVertexArray(vao_));
-                GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
-
-                std::vector<core::frame_geometry::coord> coords_triangles{
-                    coords[0], coords[1], coords[2], coords[0], coords[2], coords[3]};
+                std::array<core::frame_geometry::coord, vertex_count> coords_triangles{
+                    {coords[0], coords[1], coords[2], coords[0], coords[2], coords[3]}};
 
-                GL(glBufferData(GL_ARRAY_BUFFER,
-                                static_cast<GLsizei>(sizeof(core::frame_geometry::coord)) * coords_triangles.size(),
-                                coords_triangles.data(),
-                                GL_STATIC_DRAW));
+                GL(glNamedBufferSubData(vbo_, 0, sizeof(coords_triangles), coords_triangles.data()));
 
-                auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
-
-                auto vtx_loc = shader_->get_attrib_location("Position");
-                auto tex_loc = shader_->get_attrib_location("TexCoordIn");
-
-                GL(glEnableVertexAttribArray(vtx_loc));
-                GL(glEnableVertexAttribArray(tex_loc));
-
-                GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
-                GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
-
-                GL(glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(coords_triangles.size())));
+                GL(glBindVertexArray(vao_));
+                GL(glDrawArrays(GL_TRIANGLES, 0, vertex_count));
                 GL(glTextureBarrier());
-
-                GL(glDisableVertexAttribArray(vtx_loc));
-                GL(glDisableVertexAttribArray(tex_loc));
-
                 GL(glBindVertexArray(0));
-                GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
 
                 break;
             }
@@ -422,11 +567,42 @@ struct image_kernel::impl
     }
 };
 
+draw_bounds united(const draw_bounds& lhs, const draw_bounds& rhs)
+{
+    if (lhs.empty()) {
+        return rhs;
+    }
+    if (rhs.empty()) {
+        return lhs;
+    }
+    return draw_bounds{std::min(lhs.left, rhs.left),
+                       std::min(lhs.top, rhs.top),
+                       std::max(lhs.right, rhs.right),
+                       std::max(lhs.bottom, rhs.bottom)};
+}
+
+std::array<int, 4> to_pixels(const draw_bounds& bounds, int width, int height)
+{
+    auto x0 = std::max(0, static_cast<int>(std::floor(bounds.left * width)));
+    auto y0 = std::max(0, static_cast<int>(std::floor(bounds.top * height)));
+    auto x1 = std::min(width, static_cast<int>(std::ceil(bounds.right * width)));
+    auto y1 = std::min(height, static_cast<int>(std::ceil(bounds.bottom * height)));
+    return {{x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0)}};
+}
+
 image_kernel::image_kernel(const spl::shared_ptr<device>& ogl)
     : impl_(new impl(ogl))
 {
 }
 image_kernel::~image_kernel() {}
-void image_kernel::draw(const draw_params& params) { impl_->draw(params); }
+void                 image_kernel::draw(const draw_params& params) { impl_->draw(params); }
+draw_bounds          image_kernel::bounds(const draw_params& params) const { return impl_->bounds(params); }
+core::monitor::state image_kernel::state() const { return impl_->state(); }
+
+bool image_kernel::is_visible(const draw_params& params)
+{
+    auto coords = impl::transform_coords(params);
+    return !coords.empty() && !is_outside_screen(coords);
+}
 
 }}} // namespace caspar::accelerator::ogl
@@ -28,6 +28,10 @@
 #include <core/frame/frame_transform.h>
 #include <core/frame/geometry.h>
 #include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+
+#include <array>
+#include <cstdint>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
@@ -37,6 +41,23 @@ enum class keyer
     additive,
 };
 
+// A normalized area of a render target, the whole target being [0, 0] to [1, 1].
+struct draw_bounds final
+{
+    double left   = 0.0;
+    double top    = 0.0;
+    double right  = 1.0;
+    double bottom = 1.0;
+
+    bool empty() const { return right <= left || bottom <= top; }
+    bool full() const { return left <= 0.0 && top <= 0.0 && right >= 1.0 && bottom >= 1.0; }
+};
+
+draw_bounds united(const draw_bounds& lhs, const draw_bounds& rhs);
+
+// Whole pixels of a width x height target covering bounds, as x, y, width and height.
+std::array<int, 4> to_pixels(const draw_bounds& bounds, int width, int height);
+
 struct draw_params final
 {
     core::pixel_format_desc                     pix_desc = core::pixel_format::invalid;
@@ -49,6 +70,11 @@ struct draw_params final
     std::shared_ptr<class texture>              local_key;
     std::shared_ptr<class texture>              layer_key;
     double                                      aspect_ratio = 1.0;
+    draw_bounds                                 bounds; // Pixels outside of the bounds are left untouched.
+
+    // Frames of one constant color are drawn with their bgra color instead of sampling textures.
+    bool                        solid = false;
+    std::array<std::uint8_t, 4> solid_color{};
 };
 
 class image_kernel final
@@ -62,6 +88,15 @@ class image_kernel final
 
     void draw(const draw_params& params);
 
+    // The area of the target which drawing params can touch, empty if nothing would be drawn.
+    draw_bounds bounds(const draw_params& params) const;
+
+    // Whether drawing params touches the target at all. Only the transform, geometry and aspect ratio are used.
+    static bool is_visible(const draw_params& params);
+
+    // Number of draws of each shader specialization.
+    core::monitor::state state() const;
+
   private:
     struct impl;
     spl::unique_ptr<impl> impl_;
@@ -21,12 +21,16 @@
 #include "image_mixer.h"
 
 #include "image_kernel.h"
+#include "output_converter.h"
+#include "video_scopes.h"
 
 #include "../util/buffer.h"
 #include "../util/device.h"
+#include "../util/gpu_profiler.h"
 #include "../util/texture.h"
 
 #include <common/array.h>
+#include <common/diagnostics/trace.h>
 #include <common/future.h>
 #include <common/gl/gl_check.h>
 #include <common/scope_exit.h>
@@ -42,20 +46,48 @@
 #include <boost/any.hpp>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <mutex>
 #include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
 typedef std::shared_future<std::shared_ptr<texture>> future_texture;
 
+// Textures uploaded when a frame is committed, along with the device they live on.
+struct uploaded_textures
+{
+    const void*                 owner;
+    std::vector<future_texture> textures;
+};
+
 struct item
 {
     core::pixel_format_desc     pix_desc = core::pixel_format::invalid;
     std::vector<future_texture> textures;
     core::image_transform       transform;
     core::frame_geometry        geometry = core::frame_geometry::get_default();
+    std::shared_ptr<const void> source; // Identity of already uploaded textures, if any.
+    bool                        solid = false;
+    std::array<std::uint8_t, 4> solid_color{};
 };
 
+bool operator==(const item& lhs, const item& rhs)
+{
+    return lhs.source && lhs.source == rhs.source && lhs.transform == rhs.transform &&
+           lhs.geometry.type() == rhs.geometry.type() && lhs.geometry.data() == rhs.geometry.data();
+}
+
+// Frames of a single bgra pixel, such as those of color producers, are one constant color. They are never uploaded,
+// the mixer draws their color instead.
+bool is_solid(const core::pixel_format_desc& desc)
+{
+    return desc.format == core::pixel_format::bgra && desc.planes.size() == 1 && desc.planes[0].width == 1 &&
+           desc.planes[0].height == 1;
+}
+
 struct layer
 {
     std::vector<layer> sublayers;
@@ -68,36 +100,332 @@ struct layer
     }
 };
 
+bool operator==(const layer& lhs, const layer& rhs)
+{
+    return lhs.blend_mode == rhs.blend_mode && lhs.items == rhs.items && lhs.sublayers == rhs.sublayers;
+}
+
+bool is_uploaded(const layer& layer)
+{
+    return std::all_of(layer.items.begin(), layer.items.end(), [](const item& item) { return item.source; }) &&
+           std::all_of(layer.sublayers.begin(), layer.sublayers.end(), is_uploaded);
+}
+
+// A layer can be composited on its own if it only uses already uploaded textures and does not key the next layer.
+bool is_cacheable(const layer& layer)
+{
+    return is_uploaded(layer) && std::none_of(layer.items.begin(), layer.items.end(), [](const item& item) {
+               return item.transform.is_key;
+           });
+}
+
+bool is_opaque(const item& item)
+{
+    return item.solid ? item.solid_color[3] == 255 : core::is_opaque(item.pix_desc.format);
+}
+
+// An item covers the whole frame if it is opaque and drawn over all of it as it is. Color adjustments are allowed,
+// as they leave the alpha alone.
+bool covers_frame(const item& item)
+{
+    const auto& transform = item.transform;
+
+    core::image_transform placement;
+    placement.contrast    = transform.contrast;
+    placement.brightness  = transform.brightness;
+    placement.saturation  = transform.saturation;
+    placement.levels      = transform.levels;
+    placement.layer_depth = transform.layer_depth;
+    placement.field_mode  = transform.field_mode;
+
+    const auto& geometry = core::frame_geometry::get_default();
+    return transform == placement && item.geometry.type() == geometry.type() &&
+           item.geometry.data() == geometry.data() && is_opaque(item);
+}
+
+bool has_key(const layer& layer)
+{
+    return std::any_of(
+        layer.items.begin(), layer.items.end(), [](const item& item) { return item.transform.is_key; });
+}
+
+// Drops everything below the topmost item which covers the whole frame, since none of it would be seen. The
+// textures of dropped items are released without waiting for their uploads.
+void cull(std::vector<layer>& layers)
+{
+    for (auto n = layers.size(); n-- > 0;) {
+        auto& layer = layers[n];
+
+        // Keys of the layer below mask this layer, and keys within it mask the item after them.
+        if (layer.blend_mode != core::blend_mode::normal || (n > 0 && has_key(layers[n - 1]))) {
+            continue;
+        }
+
+        auto cover = layer.items.end();
+        for (auto it = layer.items.begin(); it != layer.items.end() && !it->transform.is_key; ++it) {
+            if (covers_frame(*it)) {
+                cover = it;
+            }
+        }
+
+        if (cover != layer.items.end()) {
+            layer.items.erase(layer.items.begin(), cover);
+            layer.sublayers.clear();
+            layers.erase(layers.begin(), layers.begin() + n);
+            return;
+        }
+    }
+}
+
 class image_renderer
 {
-    spl::shared_ptr<device> ogl_;
-    image_kernel            kernel_;
+    struct cached_layer
+    {
+        std::shared_ptr<layer>   source;
+        std::shared_ptr<texture> result;
+    };
+
+    spl::shared_ptr<device>   ogl_;
+    image_kernel              kernel_;
+    output_converter          converter_;
+    video_scopes              scopes_;
+    std::vector<cached_layer> cache_; // Top level layers of the previous frame, only used on the device thread.
+    std::shared_ptr<texture>  last_frame_; // Previous frame of an interlaced channel, only used on the device thread.
+    std::atomic<bool>         blank_{false}; // Whether a blank frame has been returned since the last render.
+    const bool                ten_bit_; // Whether frames are composited in RGB10_A2 targets.
+
+    // GL_TIME_ELAPSED queries of each top level layer, per frame in flight, only used on the device thread.
+    std::deque<std::vector<GLuint>> pending_queries_;
+    std::vector<GLuint>             free_queries_;
+
+    mutable std::mutex  draw_times_mutex_;
+    std::vector<double> draw_times_;
 
   public:
-    image_renderer(const spl::shared_ptr<device>& ogl)
+    image_renderer(const spl::shared_ptr<device>& ogl, bool ten_bit)
         : ogl_(ogl)
         , kernel_(ogl_)
+        , converter_(ogl_)
+        , scopes_(ogl_)
+        , ten_bit_(ten_bit)
+    {
+    }
+
+    ~image_renderer()
+    {
+        auto queries = std::move(free_queries_);
+        for (auto& frame : pending_queries_) {
+            queries.insert(queries.end(), frame.begin(), frame.end());
+        }
+        if (!queries.empty()) {
+            ogl_->dispatch_async([queries] { glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data()); });
+        }
+    }
+
+    core::monitor::state state() const
+    {
+        auto state = kernel_.state();
+        state.apply(scopes_.state());
+        return state;
+    }
+
+    std::vector<double> draw_times() const
     {
+        std::lock_guard<std::mutex> lock(draw_times_mutex_);
+        return draw_times_;
     }
 
-    std::future<array<const std::uint8_t>> operator()(std::vector<layer>             layers,
-                                                      const core::video_format_desc& format_desc)
+    std::future<std::vector<array<const std::uint8_t>>> operator()(std::vector<layer>                      layers,
+                                                                   const core::video_format_desc&          format_desc,
+                                                                   const std::vector<core::output_format>& formats,
+                                                                   const std::vector<core::output_size>&   sizes,
+                                                                   bool                                    read_back)
     {
-        if (layers.empty()) { // Bypass GPU with empty frame.
-            static const std::vector<uint8_t> buffer(4096 * 4096 * 4, 0);
-            return make_ready_future(array<const std::uint8_t>(buffer.data(), format_desc.size, true));
+        cull(layers);
+
+        // NOTE: Nothing is rendered for empty frames, the mixer outputs blank frames of black images it keeps.
+        if (layers.empty()) {
+            blank_ = true;
+            scopes_.blank(format_desc);
+            return make_ready_future(std::vector<array<const std::uint8_t>>{});
         }
 
-        return flatten(ogl_->dispatch_async([=]() mutable -> std::shared_future<array<const std::uint8_t>> {
-            auto target_texture = ogl_->create_texture(format_desc.width, format_desc.height, 4);
+        auto trace_frame = caspar::diagnostics::trace::current_frame();
+        auto readbacks   = ogl_->dispatch_async([=]() mutable {
+            caspar::diagnostics::trace::frame_scope frame_scope(trace_frame);
+            caspar::diagnostics::trace::scope       traced("image_mixer::render");
+
+            // NOTE: Only the target is ten bit. Layers which are composited apart keep 8 bit textures, since their
+            // alpha is blended onto the target, and the 2 bits of alpha of RGB10_A2 would band soft edges.
+            auto target_texture =
+                ogl_->create_texture(format_desc.width, format_desc.height, 4, true, 1, false, ten_bit_);
+
+            // Frames after blank frames have no previous frame to weave with, so they are woven with themselves.
+            if (blank_.exchange(false)) {
+                last_frame_.reset();
+            }
+
+            draw_cached(target_texture, std::move(layers), format_desc);
 
-            draw(target_texture, std::move(layers), format_desc);
+            {
+                auto timed = ogl_->profiler().time("scopes");
+                scopes_(target_texture, format_desc);
+            }
 
-            return ogl_->copy_async(target_texture);
-        }));
+            // NOTE: Interlaced channels run at field rate. Their converted images are woven of the previous frame as
+            // the first field and this frame as the second, so consumers can output any pair of frames as one.
+            std::shared_ptr<texture> first_field;
+            if (format_desc.field_count == 2) {
+                first_field = last_frame_ && last_frame_->width() == target_texture->width() &&
+                                      last_frame_->height() == target_texture->height()
+                                  ? last_frame_
+                                  : target_texture;
+                last_frame_ = target_texture;
+            } else {
+                last_frame_.reset();
+            }
+            const auto upper_field_first =
+                format_desc.format != core::video_format::pal && format_desc.format != core::video_format::ntsc;
+
+            // Converted images are drawn from the rendered frame, so only their own bytes are read back. The frame
+            // itself is only read back once a consumer reads it, unless some consumer always does.
+            std::vector<std::shared_future<array<const std::uint8_t>>> readbacks;
+            readbacks.emplace_back(read_back ? ogl_->copy_async(target_texture).share()
+                                             : make_ready_future(ogl_->copy_deferred(target_texture)).share());
+            for (auto format : formats) {
+                std::shared_ptr<texture> converted;
+                {
+                    auto timed = ogl_->profiler().time("convert");
+                    converted =
+                        converter_(target_texture, format, format_desc.height > 700, first_field, upper_field_first);
+                }
+                readbacks.emplace_back(ogl_->copy_async(converted));
+            }
+            for (auto& size : sizes) {
+                std::shared_ptr<texture> scaled;
+                {
+                    auto timed = ogl_->profiler().time("convert");
+                    scaled     = converter_.scale(target_texture, size.width, size.height);
+                }
+                readbacks.emplace_back(ogl_->copy_async(scaled));
+            }
+
+            // NOTE: Readbacks which are issued once this task has returned are counted in the next frame.
+            ogl_->profiler().end_frame();
+            return readbacks;
+        });
+
+        return std::async(std::launch::deferred, [readbacks = std::move(readbacks)]() mutable {
+            std::vector<array<const std::uint8_t>> images;
+            for (auto& readback : readbacks.get()) {
+                images.push_back(readback.get());
+            }
+            return images;
+        });
     }
 
   private:
+    // Layers which are unchanged since the previous frame are composited once into a texture of their own, which is
+    // then reused for as long as they stay unchanged. Changing layers are drawn directly, as usual.
+    void draw_cached(std::shared_ptr<texture>&      target_texture,
+                     std::vector<layer>             layers,
+                     const core::video_format_desc& format_desc)
+    {
+        std::shared_ptr<texture>  layer_key_texture;
+        std::vector<cached_layer> cache(layers.size());
+        std::vector<GLuint>       queries;
+
+        for (std::size_t n = 0; n < layers.size(); ++n) {
+            queries.push_back(create_query());
+            GL(glBeginQuery(GL_TIME_ELAPSED, queries.back()));
+            CASPAR_SCOPE_EXIT { GL(glEndQuery(GL_TIME_ELAPSED)); };
+
+            auto& layer = layers[n];
+
+            if (layer_key_texture || !is_cacheable(layer)) {
+                draw(target_texture, layer.sublayers, format_desc);
+                draw(target_texture, std::move(layer), layer_key_texture, format_desc);
+                continue;
+            }
+
+            auto&      entry     = cache[n];
+            const auto unchanged = n < cache_.size() && cache_[n].source && *cache_[n].source == layer;
+            if (unchanged) {
+                entry = std::move(cache_[n]);
+            } else {
+                entry.source = std::make_shared<ogl::layer>(layer);
+            }
+
+            if (entry.result && (entry.result->width() != target_texture->width() ||
+                                 entry.result->height() != target_texture->height())) {
+                entry.result.reset();
+            }
+
+            const auto blend_mode = layer.blend_mode;
+
+            if (unchanged && !entry.result) {
+                entry.result = ogl_->create_texture(target_texture->width(), target_texture->height(), 4);
+
+                layer.blend_mode = core::blend_mode::normal;
+                draw(entry.result, layer.sublayers, format_desc);
+                draw(entry.result, std::move(layer), layer_key_texture, format_desc);
+            }
+
+            if (entry.result) {
+                draw(target_texture, std::shared_ptr<texture>(entry.result), blend_mode);
+            } else {
+                draw(target_texture, layer.sublayers, format_desc);
+                draw(target_texture, std::move(layer), layer_key_texture, format_desc);
+            }
+        }
+
+        cache_ = std::move(cache);
+
+        pending_queries_.push_back(std::move(queries));
+        read_queries();
+    }
+
+    GLuint create_query()
+    {
+        GLuint query = 0;
+        if (free_queries_.empty()) {
+            GL(glGenQueries(1, &query));
+        } else {
+            query = free_queries_.back();
+            free_queries_.pop_back();
+        }
+        return query;
+    }
+
+    // Collects the results of finished frames without stalling on the GPU.
+    void read_queries()
+    {
+        while (!pending_queries_.empty()) {
+            auto& queries = pending_queries_.front();
+
+            if (!queries.empty() && pending_queries_.size() < 4) {
+                GLint available = 0;
+                GL(glGetQueryObjectiv(queries.back(), GL_QUERY_RESULT_AVAILABLE, &available));
+                if (!available) {
+                    return;
+                }
+            }
+
+            std::vector<double> draw_times;
+            for (auto query : queries) {
+                GLuint64 elapsed = 0;
+                GL(glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed));
+                draw_times.push_back(static_cast<double>(elapsed) / 1000000.0);
+            }
+
+            free_queries_.insert(free_queries_.end(), queries.begin(), queries.end());
+            pending_queries_.pop_front();
+
+            std::lock_guard<std::mutex> lock(draw_times_mutex_);
+            draw_times_ = std::move(draw_times);
+        }
+    }
+
     void draw(std::shared_ptr<texture>&      target_texture,
               std::vector<layer>             layers,
               const core::video_format_desc& format_desc)
@@ -121,8 +449,34 @@ class image_renderer
         std::shared_ptr<texture> local_key_texture;
         std::shared_ptr<texture> local_mix_texture;
 
-        if (layer.blend_mode != core::blend_mode::normal) {
-            auto layer_texture = ogl_->create_texture(target_texture->width(), target_texture->height(), 4);
+        // Intermediate layer and mix textures are only cleared and composited within the area the items can touch,
+        // which for overlays such as bugs and lower thirds is a small part of the frame.
+        draw_bounds              bounds{0.0, 0.0, 0.0, 0.0};
+        std::vector<draw_bounds> item_bounds;
+        for (auto& item : layer.items) {
+            draw_params params;
+            params.transform    = item.transform;
+            params.geometry     = item.geometry;
+            params.aspect_ratio = aspect_ratio(format_desc);
+            item_bounds.push_back(kernel_.bounds(params));
+            bounds = united(bounds, item_bounds.back());
+        }
+
+        // NOTE: Blending a layer of items which neither key, mix nor overlap each other is the same as blending each
+        // item by itself, which the kernel does by reading the target behind a texture barrier. Other layers are
+        // composited into an intermediate texture first, which is then blended.
+        if (layer.blend_mode != core::blend_mode::normal && blends_items(layer, item_bounds)) {
+            for (auto& item : layer.items)
+                draw(target_texture,
+                     std::move(item),
+                     layer_key_texture,
+                     local_key_texture,
+                     local_mix_texture,
+                     bounds,
+                     format_desc,
+                     layer.blend_mode);
+        } else if (layer.blend_mode != core::blend_mode::normal) {
+            auto layer_texture = create_texture(target_texture, 4, bounds);
 
             for (auto& item : layer.items)
                 draw(layer_texture,
@@ -130,10 +484,11 @@ class image_renderer
                      layer_key_texture,
                      local_key_texture,
                      local_mix_texture,
+                     bounds,
                      format_desc);
 
-            draw(layer_texture, std::move(local_mix_texture), core::blend_mode::normal);
-            draw(target_texture, std::move(layer_texture), layer.blend_mode);
+            draw(layer_texture, std::move(local_mix_texture), core::blend_mode::normal, bounds);
+            draw(target_texture, std::move(layer_texture), layer.blend_mode, bounds);
         } else // fast path
         {
             for (auto& item : layer.items)
@@ -142,27 +497,57 @@ class image_renderer
                      layer_key_texture,
                      local_key_texture,
                      local_mix_texture,
+                     bounds,
                      format_desc);
 
-            draw(target_texture, std::move(local_mix_texture), core::blend_mode::normal);
+            draw(target_texture, std::move(local_mix_texture), core::blend_mode::normal, bounds);
         }
 
         layer_key_texture = std::move(local_key_texture);
     }
 
+    static bool blends_items(const layer& layer, const std::vector<draw_bounds>& item_bounds)
+    {
+        static const std::size_t max_items = 16;
+
+        if (layer.items.size() > max_items) {
+            return false;
+        }
+
+        for (std::size_t n = 0; n < layer.items.size(); ++n) {
+            const auto& transform = layer.items[n].transform;
+            if (transform.is_key || transform.is_mix) {
+                return false;
+            }
+
+            for (std::size_t m = 0; m < n; ++m) {
+                const auto& lhs = item_bounds[n];
+                const auto& rhs = item_bounds[m];
+                if (std::max(lhs.left, rhs.left) < std::min(lhs.right, rhs.right) &&
+                    std::max(lhs.top, rhs.top) < std::min(lhs.bottom, rhs.bottom)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
     void draw(std::shared_ptr<texture>&      target_texture,
               item                           item,
               std::shared_ptr<texture>&      layer_key_texture,
               std::shared_ptr<texture>&      local_key_texture,
               std::shared_ptr<texture>&      local_mix_texture,
-              const core::video_format_desc& format_desc)
+              const draw_bounds&             bounds,
+              const core::video_format_desc& format_desc,
+              core::blend_mode               blend_mode = core::blend_mode::normal)
     {
         draw_params draw_params;
-        draw_params.pix_desc  = std::move(item.pix_desc);
-        draw_params.transform = std::move(item.transform);
-        draw_params.geometry  = item.geometry;
-        draw_params.aspect_ratio =
-            static_cast<double>(format_desc.square_width) / static_cast<double>(format_desc.square_height);
+        draw_params.pix_desc     = std::move(item.pix_desc);
+        draw_params.transform    = std::move(item.transform);
+        draw_params.geometry     = item.geometry;
+        draw_params.aspect_ratio = aspect_ratio(format_desc);
+        draw_params.solid        = item.solid;
+        draw_params.solid_color  = item.solid_color;
 
         for (auto& future_texture : item.textures) {
             draw_params.textures.push_back(spl::make_shared_ptr(future_texture.get()));
@@ -179,9 +564,7 @@ class image_renderer
 
             kernel_.draw(std::move(draw_params));
         } else if (item.transform.is_mix) {
-            local_mix_texture = local_mix_texture
-                                    ? local_mix_texture
-                                    : ogl_->create_texture(target_texture->width(), target_texture->height(), 4);
+            local_mix_texture = local_mix_texture ? local_mix_texture : create_texture(target_texture, 4, bounds);
 
             draw_params.background = local_mix_texture;
             draw_params.local_key  = std::move(local_key_texture);
@@ -191,19 +574,42 @@ class image_renderer
 
             kernel_.draw(std::move(draw_params));
         } else {
-            draw(target_texture, std::move(local_mix_texture), core::blend_mode::normal);
+            draw(target_texture, std::move(local_mix_texture), core::blend_mode::normal, bounds);
 
             draw_params.background = target_texture;
             draw_params.local_key  = std::move(local_key_texture);
             draw_params.layer_key  = layer_key_texture;
+            draw_params.blend_mode = blend_mode;
 
             kernel_.draw(std::move(draw_params));
         }
     }
 
+    static double aspect_ratio(const core::video_format_desc& format_desc)
+    {
+        return static_cast<double>(format_desc.square_width) / static_cast<double>(format_desc.square_height);
+    }
+
+    // Creates a texture the size of target of which only bounds is cleared.
+    std::shared_ptr<texture>
+    create_texture(const std::shared_ptr<texture>& target, int stride, const draw_bounds& bounds)
+    {
+        if (bounds.full()) {
+            return ogl_->create_texture(target->width(), target->height(), stride);
+        }
+
+        auto tex  = ogl_->create_texture(target->width(), target->height(), stride, false);
+        auto area = to_pixels(bounds, target->width(), target->height());
+        if (area[2] > 0 && area[3] > 0) {
+            tex->clear(area[0], area[1], area[2], area[3]);
+        }
+        return tex;
+    }
+
     void draw(std::shared_ptr<texture>&  target_texture,
               std::shared_ptr<texture>&& source_buffer,
-              core::blend_mode           blend_mode = core::blend_mode::normal)
+              core::blend_mode           blend_mode = core::blend_mode::normal,
+              const draw_bounds&         bounds     = draw_bounds())
     {
         if (!source_buffer)
             return;
@@ -217,6 +623,7 @@ class image_renderer
         draw_params.blend_mode = blend_mode;
         draw_params.background = target_texture;
         draw_params.geometry   = core::frame_geometry::get_default();
+        draw_params.bounds     = bounds;
 
         kernel_.draw(std::move(draw_params));
     }
@@ -231,14 +638,17 @@ struct image_mixer::impl
     std::vector<core::image_transform> transform_stack_;
     std::vector<layer>                 layers_; // layer/stream/items
     std::vector<layer*>                layer_stack_;
+    const bool                         ten_bit_;
 
   public:
-    impl(const spl::shared_ptr<device>& ogl, int channel_id)
+    impl(const spl::shared_ptr<device>& ogl, int channel_id, bool ten_bit)
         : ogl_(ogl)
-        , renderer_(ogl)
+        , renderer_(ogl, ten_bit)
         , transform_stack_(1)
+        , ten_bit_(ten_bit)
     {
-        CASPAR_LOG(info) << L"Initialized OpenGL Accelerated GPU Image Mixer for channel " << channel_id;
+        CASPAR_LOG(info) << L"Initialized OpenGL Accelerated GPU Image Mixer for channel " << channel_id
+                         << (ten_bit ? L", compositing in 10 bit" : L"");
     }
 
     void push(const core::frame_transform& transform)
@@ -273,19 +683,55 @@ struct image_mixer::impl
         item.transform = transform_stack_.back();
         item.geometry  = frame.geometry();
 
-        auto textures_ptr = boost::any_cast<std::shared_ptr<std::vector<future_texture>>>(frame.opaque());
+        // NOTE: Items entirely outside of the screen or transparent are never drawn, so they are dropped before any
+        // upload, e.g. tiles of a large still are only uploaded once they are scrolled into view. Keys and the items
+        // after keys and mixes are kept, as they decide what the keys and mixes apply to. Rotated items are kept too,
+        // as the aspect ratio of the channel is not known here.
+        const auto& items = layer_stack_.back()->items;
+        if (!item.transform.is_key && item.transform.angle == 0.0 &&
+            (items.empty() || !(items.back().transform.is_key || items.back().transform.is_mix))) {
+            draw_params params;
+            params.transform = item.transform;
+            params.geometry  = item.geometry;
+            if (item.transform.opacity < 0.001 || !image_kernel::is_visible(params)) {
+                return;
+            }
+        }
 
-        if (textures_ptr) {
-            item.textures = *textures_ptr;
-        } else {
-            for (int n = 0; n < static_cast<int>(item.pix_desc.planes.size()); ++n) {
-                item.textures.emplace_back(ogl_->copy_async(frame.image_data(n),
-                                                            item.pix_desc.planes[n].width,
-                                                            item.pix_desc.planes[n].height,
-                                                            item.pix_desc.planes[n].stride));
+        auto opaque       = boost::any_cast<std::shared_ptr<uploaded_textures>>(&frame.opaque());
+        auto textures_ptr = opaque ? *opaque : nullptr;
+
+        if (is_solid(item.pix_desc) && frame.image_data(0).size() >= 4) {
+            item.solid = true;
+            std::copy_n(frame.image_data(0).begin(), 4, item.solid_color.begin());
+            if (textures_ptr && textures_ptr->owner == ogl_->id()) {
+                item.source = textures_ptr;
             }
+            layer_stack_.back()->items.push_back(item);
+            return;
         }
 
+        // Frames created elsewhere, e.g. by a mixer on another device through a route, are uploaded from host memory
+        // once per device and the textures are kept on the frame, so that later visits skip the upload.
+        if (!textures_ptr || textures_ptr->owner != ogl_->id()) {
+            textures_ptr = boost::any_cast<std::shared_ptr<uploaded_textures>>(frame.cached(ogl_->id(), [&] {
+                std::vector<future_texture> textures;
+                for (int n = 0; n < static_cast<int>(item.pix_desc.planes.size()); ++n) {
+                    textures.emplace_back(ogl_->copy_async(frame.image_data(n),
+                                                           item.pix_desc.planes[n].width,
+                                                           item.pix_desc.planes[n].height,
+                                                           item.pix_desc.planes[n].stride,
+                                                           item.pix_desc.planes[n].depth,
+                                                           item.pix_desc.format == core::pixel_format::bc3));
+                }
+                auto uploaded = uploaded_textures{ogl_->id(), std::move(textures)};
+                return boost::any(std::make_shared<uploaded_textures>(std::move(uploaded)));
+            }));
+        }
+
+        item.textures = textures_ptr->textures;
+        item.source   = textures_ptr;
+
         layer_stack_.back()->items.push_back(item);
     }
 
@@ -295,9 +741,12 @@ struct image_mixer::impl
         layer_stack_.resize(transform_stack_.back().layer_depth);
     }
 
-    std::future<array<const std::uint8_t>> render(const core::video_format_desc& format_desc)
+    std::future<std::vector<array<const std::uint8_t>>> render(const core::video_format_desc&          format_desc,
+                                                               const std::vector<core::output_format>& formats,
+                                                               const std::vector<core::output_size>&   sizes,
+                                                               bool                                    read_back)
     {
-        return renderer_(std::move(layers_), format_desc);
+        return renderer_(std::move(layers_), format_desc, formats, sizes, read_back);
     }
 
     core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
@@ -319,30 +768,123 @@ struct image_mixer::impl
                     return boost::any{};
                 }
                 std::vector<future_texture> textures;
-                for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
-                    textures.emplace_back(self->ogl_->copy_async(
-                        image_data[n], desc.planes[n].width, desc.planes[n].height, desc.planes[n].stride));
+                for (int n = 0; !is_solid(desc) && n < static_cast<int>(desc.planes.size()); ++n) {
+                    textures.emplace_back(self->ogl_->copy_async(image_data[n],
+                                                                 desc.planes[n].width,
+                                                                 desc.planes[n].height,
+                                                                 desc.planes[n].stride,
+                                                                 desc.planes[n].depth,
+                                                                 desc.format == core::pixel_format::bc3));
+                }
+                return std::make_shared<uploaded_textures>(uploaded_textures{self->ogl_->id(), std::move(textures)});
+            });
+    }
+
+    core::mutable_frame update_frame(const void*                            tag,
+                                     const core::pixel_format_desc&         desc,
+                                     const core::const_frame&               previous,
+                                     const std::vector<core::frame_region>& regions) override
+    {
+        if (!previous) {
+            return create_frame(tag, desc);
+        }
+
+        auto opaque   = boost::any_cast<std::shared_ptr<uploaded_textures>>(&previous.opaque());
+        auto uploaded = opaque ? *opaque : nullptr;
+
+        const auto& prev_desc = previous.pixel_format_desc();
+        if (!uploaded || uploaded->owner != ogl_->id() || uploaded->textures.empty() || desc.planes.size() != 1 ||
+            prev_desc.planes.size() != 1 || prev_desc.planes[0].width != desc.planes[0].width ||
+            prev_desc.planes[0].height != desc.planes[0].height ||
+            prev_desc.planes[0].stride != desc.planes[0].stride || prev_desc.planes[0].depth != desc.planes[0].depth) {
+            return create_frame(tag, desc);
+        }
+
+        std::vector<array<std::uint8_t>> image_data;
+        image_data.push_back(ogl_->create_array(desc.planes[0].size));
+
+        auto base = uploaded->textures[0];
+
+        std::weak_ptr<image_mixer::impl> weak_self = shared_from_this();
+        return core::mutable_frame(
+            tag,
+            std::move(image_data),
+            array<int32_t>{},
+            desc,
+            [weak_self, base, regions](std::vector<array<const std::uint8_t>> image_data) -> boost::any {
+                auto self = weak_self.lock();
+                if (!self) {
+                    return boost::any{};
                 }
-                return std::make_shared<decltype(textures)>(std::move(textures));
+                std::vector<future_texture> textures;
+                textures.emplace_back(self->ogl_->copy_async(image_data[0], base, regions));
+                return std::make_shared<uploaded_textures>(uploaded_textures{self->ogl_->id(), std::move(textures)});
+            });
+    }
+
+    core::mutable_frame import_frame(const void* tag, void* shared_handle, int width, int height) override
+    {
+        auto desc = core::pixel_format_desc(core::pixel_format::bgra);
+        desc.planes.push_back(core::pixel_format_desc::plane(width, height, 4));
+
+        // NOTE: The owner may draw into the shared texture once this returns, so it is copied right away.
+        std::vector<future_texture> textures;
+        textures.emplace_back(make_ready_future(ogl_->import_texture(shared_handle, width, height)).share());
+
+        auto uploaded = std::make_shared<uploaded_textures>(uploaded_textures{ogl_->id(), std::move(textures)});
+
+        std::vector<array<std::uint8_t>> image_data;
+        image_data.emplace_back();
+
+        return core::mutable_frame(
+            tag, std::move(image_data), array<int32_t>{}, desc, [uploaded](std::vector<array<const std::uint8_t>>) {
+                return boost::any(uploaded);
             });
     }
 };
 
-image_mixer::image_mixer(const spl::shared_ptr<device>& ogl, int channel_id)
-    : impl_(std::make_unique<impl>(ogl, channel_id))
+image_mixer::image_mixer(const spl::shared_ptr<device>& ogl, int channel_id, bool ten_bit)
+    : impl_(std::make_unique<impl>(ogl, channel_id, ten_bit))
 {
 }
 image_mixer::~image_mixer() {}
 void image_mixer::push(const core::frame_transform& transform) { impl_->push(transform); }
 void image_mixer::visit(const core::const_frame& frame) { impl_->visit(frame); }
 void image_mixer::pop() { impl_->pop(); }
-std::future<array<const std::uint8_t>> image_mixer::operator()(const core::video_format_desc& format_desc)
+std::future<std::vector<array<const std::uint8_t>>>
+image_mixer::operator()(const core::video_format_desc&          format_desc,
+                        const std::vector<core::output_format>& formats,
+                        const std::vector<core::output_size>&   sizes,
+                        bool                                    read_back)
 {
-    return impl_->render(format_desc);
+    return impl_->render(format_desc, formats, sizes, read_back);
 }
 core::mutable_frame image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc)
 {
     return impl_->create_frame(tag, desc);
 }
+core::mutable_frame image_mixer::update_frame(const void*                            tag,
+                                              const core::pixel_format_desc&         desc,
+                                              const core::const_frame&               previous,
+                                              const std::vector<core::frame_region>& regions)
+{
+    return impl_->update_frame(tag, desc, previous, regions);
+}
+core::mutable_frame image_mixer::import_frame(const void* tag, void* shared_handle, int width, int height)
+{
+    return impl_->import_frame(tag, shared_handle, width, height);
+}
+std::future<void> image_mixer::prepare(const core::video_format_desc& format_desc)
+{
+    return impl_->ogl_->prepare(format_desc.width, format_desc.height, impl_->ten_bit_);
+}
+std::vector<double>  image_mixer::layer_draw_times() const { return impl_->renderer_.draw_times(); }
+core::monitor::state image_mixer::state() const
+{
+    auto state = impl_->ogl_->state();
+    state.apply(impl_->renderer_.state());
+    state.apply(impl_->ogl_->profiler().state());
+    return state;
+}
 
 }}} // namespace caspar::accelerator::ogl
@@ -32,21 +32,37 @@
 #include <core/video_format.h>
 
 #include <future>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
 class image_mixer final : public core::image_mixer
 {
   public:
-    image_mixer(const spl::shared_ptr<class device>& ogl, int channel_id);
+    // Ten bit mixers composite into RGB10_A2 targets, which the v210 and rfc4175 output formats are converted from
+    // at 10 bits. Images read back as bgra are still 8 bit.
+    image_mixer(const spl::shared_ptr<class device>& ogl, int channel_id, bool ten_bit = false);
     image_mixer(const image_mixer&) = delete;
 
     ~image_mixer();
 
     image_mixer& operator=(const image_mixer&) = delete;
 
-    std::future<array<const std::uint8_t>> operator()(const core::video_format_desc& format_desc) override;
-    core::mutable_frame                    create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+    std::future<std::vector<array<const std::uint8_t>>>
+    operator()(const core::video_format_desc&          format_desc,
+               const std::vector<core::output_format>& formats,
+               const std::vector<core::output_size>&   sizes,
+               bool                                    read_back) override;
+
+    core::mutable_frame  create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+    core::mutable_frame  update_frame(const void*                            tag,
+                                      const core::pixel_format_desc&         desc,
+                                      const core::const_frame&               previous,
+                                      const std::vector<core::frame_region>& regions) override;
+    core::mutable_frame  import_frame(const void* tag, void* shared_handle, int width, int height) override;
+    std::future<void>    prepare(const core::video_format_desc& format_desc) override;
+    std::vector<double>  layer_draw_times() const override;
+    core::monitor::state state() const override;
 
     // core::image_mixer
 
@@ -29,11 +29,93 @@
 
 #include <common/env.h>
 #include <common/gl/gl_check.h>
+#include <common/utf.h>
+
+#include <map>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
-std::weak_ptr<shader> g_shader;
-std::mutex            g_shader_mutex;
+std::map<image_shader_key, std::weak_ptr<shader>> g_shaders;
+std::mutex                                         g_shader_mutex;
+
+image_shader_key make_image_shader_key(core::pixel_format format,
+                                       core::blend_mode   blend_mode,
+                                       bool               additive,
+                                       bool               chroma,
+                                       bool               levels,
+                                       bool               csb,
+                                       bool               local_key,
+                                       bool               layer_key,
+                                       bool               solid)
+{
+    // NOTE: Compressed textures are decoded to rgba by the gpu, so that they are sampled like bgra uploads.
+    if (format == core::pixel_format::bc3) {
+        format = core::pixel_format::bgra;
+    }
+
+    return (static_cast<image_shader_key>(format) & 0xF) | (static_cast<image_shader_key>(blend_mode) & 0x1F) << 4 |
+           (additive ? 1 << 9 : 0) | (chroma ? 1 << 10 : 0) | (levels ? 1 << 11 : 0) | (csb ? 1 << 12 : 0) |
+           (local_key ? 1 << 13 : 0) | (layer_key ? 1 << 14 : 0) | (solid ? 1 << 15 : 0);
+}
+
+std::string get_image_shader_name(image_shader_key key)
+{
+    static const char* formats[] = {"gray",
+                                    "bgra",
+                                    "rgba",
+                                    "argb",
+                                    "abgr",
+                                    "ycbcr",
+                                    "ycbcra",
+                                    "luma",
+                                    "bgr",
+                                    "rgb",
+                                    "v210",
+                                    "uyvy",
+                                    "nv12",
+                                    "p010",
+                                    "ycbcr10"};
+
+    std::string name = (key & 0xF) < 15 ? formats[key & 0xF] : "invalid";
+    name += "-" + u8(core::get_blend_mode(static_cast<core::blend_mode>((key >> 4) & 0x1F)));
+
+    static const std::pair<image_shader_key, const char*> flags[] = {{1 << 9, "additive"},
+                                                                     {1 << 10, "chroma"},
+                                                                     {1 << 11, "levels"},
+                                                                     {1 << 12, "csb"},
+                                                                     {1 << 13, "local-key"},
+                                                                     {1 << 14, "layer-key"},
+                                                                     {1 << 15, "solid"}};
+    for (auto& flag : flags) {
+        if (key & flag.first) {
+            name += std::string("-") + flag.second;
+        }
+    }
+
+    return name;
+}
+
+std::string get_defines(image_shader_key key)
+{
+    std::string defines;
+    defines += "#define PIXEL_FORMAT " + std::to_string(key & 0xF) + "\n";
+    defines += "#define BLEND_MODE " + std::to_string((key >> 4) & 0x1F) + "\n";
+    defines += "#define KEYER " + std::to_string(key & 1 << 9 ? 1 : 0) + "\n";
+
+    static const std::pair<image_shader_key, const char*> flags[] = {{1 << 10, "CHROMA"},
+                                                                     {1 << 11, "LEVELS"},
+                                                                     {1 << 12, "CSB"},
+                                                                     {1 << 13, "LOCAL_KEY"},
+                                                                     {1 << 14, "LAYER_KEY"},
+                                                                     {1 << 15, "SOLID"}};
+    for (auto& flag : flags) {
+        if (key & flag.first) {
+            defines += std::string("#define ") + flag.second + "\n";
+        }
+    }
+
+    return defines;
+}
 
 std::string get_blend_color_func()
 {
@@ -50,7 +132,7 @@ std::string get_blend_color_func()
         R"shader(
 				vec3 get_blend_color(vec3 back, vec3 fore)
 				{
-					switch(blend_mode)
+					switch(BLEND_MODE)
 					{
 					case  0: return BlendNormal(back, fore);
 					case  1: return BlendLighten(back, fore);
@@ -88,13 +170,14 @@ std::string get_blend_color_func()
 				vec4 blend(vec4 fore)
 				{
 				   vec4 back = texture(background, TexCoord2.st).bgra;
-				   if(blend_mode != 0)
-						fore.rgb = get_blend_color(back.rgb/(back.a+0.0000001), fore.rgb/(fore.a+0.0000001))*fore.a;
-					switch(keyer)
-					{
-						case 1:  return fore + back; // additive
-						default: return fore + (1.0-fore.a)*back; // linear
-					}
+				#if BLEND_MODE != 0
+					fore.rgb = get_blend_color(back.rgb/(back.a+0.0000001), fore.rgb/(fore.a+0.0000001))*fore.a;
+				#endif
+				#if KEYER == 1
+					return fore + back; // additive
+				#else
+					return fore + (1.0-fore.a)*back; // linear
+				#endif
 				}
 		)shader";
 }
@@ -120,8 +203,8 @@ std::string get_vertex()
     return R"shader(
 
 			#version 450
-            in vec4 TexCoordIn;
-            in vec2 Position;
+            layout(location = 0) in vec2 Position;
+            layout(location = 1) in vec4 TexCoordIn;
 
             out vec4 TexCoord;
             out vec4 TexCoord2;
@@ -138,49 +221,61 @@ std::string get_vertex()
 	)shader";
 }
 
-std::string get_fragment()
+std::string get_fragment(const std::string& defines)
 {
     return R"shader(
 
 			#version 450
+	)shader"
+
+           +
+
+           defines
+
+           +
+
+           R"shader(
             in vec4 TexCoord;
             in vec4 TexCoord2;
             out vec4 fragColor;
 
-			uniform sampler2D	background;
-			uniform sampler2D	plane[4];
-			uniform sampler2D	local_key;
-			uniform sampler2D	layer_key;
-
-			uniform bool		is_hd;
-			uniform bool		has_local_key;
-			uniform bool		has_layer_key;
-			uniform int			blend_mode;
-			uniform int			keyer;
-			uniform int			pixel_format;
-
-			uniform float		opacity;
-			uniform bool		levels;
-			uniform float		min_input;
-			uniform float		max_input;
-			uniform float		gamma;
-			uniform float		min_output;
-			uniform float		max_output;
-
-			uniform bool		csb;
-			uniform float		brt;
-			uniform float		sat;
-			uniform float		con;
-
-			uniform bool		chroma;
-			uniform bool		chroma_show_mask;
-			uniform float		chroma_target_hue;
-			uniform float		chroma_hue_width;
-			uniform float		chroma_min_saturation;
-			uniform float		chroma_min_brightness;
-			uniform float		chroma_softness;
-			uniform float		chroma_spill_suppress;
-			uniform float		chroma_spill_suppress_saturation;
+			layout(binding = 0) uniform sampler2D	plane[4];
+			layout(binding = 4) uniform sampler2D	local_key;
+			layout(binding = 5) uniform sampler2D	layer_key;
+			layout(binding = 6) uniform sampler2D	background;
+
+			// Must match image_uniforms in image_shader.h.
+			layout(std140, binding = 0) uniform image_params
+			{
+				bool		is_hd;
+				float		opacity;
+
+				float		min_input;
+				float		max_input;
+				float		gamma;
+				float		min_output;
+				float		max_output;
+
+				float		brt;
+				float		sat;
+				float		con;
+
+				bool		chroma_show_mask;
+				float		chroma_target_hue;
+				float		chroma_hue_width;
+				float		chroma_min_saturation;
+				float		chroma_min_brightness;
+				float		chroma_softness;
+				float		chroma_spill_suppress;
+				float		chroma_spill_suppress_saturation;
+
+				int			field_mode;
+
+				float		solid_b;
+				float		solid_g;
+				float		solid_r;
+				float		solid_a;
+			};
 	)shader"
 
            +
@@ -227,73 +322,200 @@ std::string get_fragment()
 				return texture2D(sampler, coords);
 			}
 
-			vec4 get_rgba_color()
+			// The Y, Cb and Cr components of a v210 word, which is stored in the b, g, r and a bytes of a texel.
+			uvec3 get_v210_word(int x, int y)
 			{
-				switch(pixel_format)
+				uvec4 bytes = uvec4(round(texelFetch(plane[0], ivec2(x, y), 0) * 255.0));
+				uint  word  = bytes.b | bytes.g << 8 | bytes.r << 16 | bytes.a << 24;
+				return uvec3(word & 0x3FFu, (word >> 10) & 0x3FFu, (word >> 20) & 0x3FFu);
+			}
+
+			// Every four words hold six pixels: Cb0 Y0 Cr0, Y1 Cb2 Y2, Cr2 Y3 Cb4, Y4 Cr4 Y5.
+			vec4 get_v210_pixel(ivec2 pos)
+			{
+				int x = pos.x / 6 * 4;
+
+				uvec3 w0 = get_v210_word(x + 0, pos.y);
+				uvec3 w1 = get_v210_word(x + 1, pos.y);
+				uvec3 w2 = get_v210_word(x + 2, pos.y);
+				uvec3 w3 = get_v210_word(x + 3, pos.y);
+
+				uint y;
+				switch (pos.x % 6)
+				{
+				case 0: y = w0.y; break;
+				case 1: y = w1.x; break;
+				case 2: y = w1.z; break;
+				case 3: y = w2.y; break;
+				case 4: y = w3.x; break;
+				default: y = w3.z; break;
+				}
+
+				uvec2 c;
+				switch (pos.x % 6 / 2)
+				{
+				case 0: c = w0.xz; break;
+				case 1: c = uvec2(w1.y, w2.x); break;
+				default: c = uvec2(w2.z, w3.y); break;
+				}
+
+				// Scaled to 8 bit levels, which ycbcra_to_rgba expects.
+				return ycbcra_to_rgba(y / 1020.0, c.x / 1020.0, c.y / 1020.0, 1.0);
+			}
+
+			// Every texel holds two pixels, its b g r a bytes are Cb Y0 Cr Y1.
+			vec4 get_uyvy_pixel(ivec2 pos)
+			{
+				vec4 texel = texelFetch(plane[0], ivec2(pos.x / 2, pos.y), 0);
+				return ycbcra_to_rgba(pos.x % 2 == 0 ? texel.g : texel.a, texel.b, texel.r, 1.0);
+			}
+
+			vec4 get_packed_pixel(ivec2 pos)
+			{
+				return PIXEL_FORMAT == 10 ? get_v210_pixel(pos) : get_uyvy_pixel(pos);
+			}
+
+			// Rows of the other field are woven in where they match the rows of the shown field around them, and
+			// interpolated from those where they differ, which is where there is motion between the fields.
+			vec4 weave(vec4 color, vec4 above, vec4 below)
+			{
+				vec4  interpolated = (above + below) * 0.5;
+				float difference   = dot(abs(color.rgb - interpolated.rgb), vec3(1.0 / 3.0));
+				float edge         = dot(abs(above.rgb - below.rgb), vec3(1.0 / 3.0)) * 0.5;
+				return mix(color, interpolated, smoothstep(0.02, 0.08, difference - edge));
+			}
+
+			// Pixels of packed capture formats are fetched as they are. v210 rows are padded to whole groups of 48
+			// pixels, which the producer scales out of view.
+			vec4 get_packed_color(vec2 coords)
+			{
+				ivec2 size = textureSize(plane[0], 0);
+				ivec2 dims = PIXEL_FORMAT == 10 ? ivec2(size.x * 3 / 2, size.y) : ivec2(size.x * 2, size.y);
+				ivec2 pos  = clamp(ivec2(coords * vec2(dims)), ivec2(0), dims - 1);
+
+				vec4 color = get_packed_pixel(pos);
+				if (field_mode == 0 || (pos.y % 2 == 0) == (field_mode == 1))
+					return color;
+
+				vec4 above = get_packed_pixel(ivec2(pos.x, pos.y > 0 ? pos.y - 1 : pos.y + 1));
+				vec4 below = get_packed_pixel(ivec2(pos.x, pos.y < dims.y - 1 ? pos.y + 1 : pos.y - 1));
+				return weave(color, above, below);
+			}
+
+			vec4 get_color(vec2 coords)
+			{
+				switch(PIXEL_FORMAT)
 				{
 				case 0:		//gray
-					return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).rrr, 1.0);
+					return vec4(get_sample(plane[0], coords).rrr, 1.0);
 				case 1:		//bgra,
-					return get_sample(plane[0], TexCoord.st / TexCoord.q).bgra;
+					return get_sample(plane[0], coords).bgra;
 				case 2:		//rgba,
-					return get_sample(plane[0], TexCoord.st / TexCoord.q).rgba;
+					return get_sample(plane[0], coords).rgba;
 				case 3:		//argb,
-					return get_sample(plane[0], TexCoord.st / TexCoord.q).argb;
+					return get_sample(plane[0], coords).argb;
 				case 4:		//abgr,
-					return get_sample(plane[0], TexCoord.st / TexCoord.q).gbar;
+					return get_sample(plane[0], coords).gbar;
 				case 5:		//ycbcr,
 					{
-						float y  = get_sample(plane[0], TexCoord.st / TexCoord.q).r;
-						float cb = get_sample(plane[1], TexCoord.st / TexCoord.q).r;
-						float cr = get_sample(plane[2], TexCoord.st / TexCoord.q).r;
+						float y  = get_sample(plane[0], coords).r;
+						float cb = get_sample(plane[1], coords).r;
+						float cr = get_sample(plane[2], coords).r;
 						return ycbcra_to_rgba(y, cb, cr, 1.0);
 					}
 				case 6:		//ycbcra
 					{
-						float y  = get_sample(plane[0], TexCoord.st / TexCoord.q).r;
-						float cb = get_sample(plane[1], TexCoord.st / TexCoord.q).r;
-						float cr = get_sample(plane[2], TexCoord.st / TexCoord.q).r;
-						float a  = get_sample(plane[3], TexCoord.st / TexCoord.q).r;
+						float y  = get_sample(plane[0], coords).r;
+						float cb = get_sample(plane[1], coords).r;
+						float cr = get_sample(plane[2], coords).r;
+						float a  = get_sample(plane[3], coords).r;
 						return ycbcra_to_rgba(y, cb, cr, a);
 					}
 				case 7:		//luma
 					{
-						vec3 y3 = get_sample(plane[0], TexCoord.st / TexCoord.q).rrr;
+						vec3 y3 = get_sample(plane[0], coords).rrr;
 						return vec4((y3-0.065)/0.859, 1.0);
 					}
 				case 8:		//bgr,
-					return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).bgr, 1.0);
+					return vec4(get_sample(plane[0], coords).bgr, 1.0);
 				case 9:		//rgb,
-					return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).rgb, 1.0);
+					return vec4(get_sample(plane[0], coords).rgb, 1.0);
+				case 10:	//v210
+				case 11:	//uyvy
+					return get_packed_color(coords);
+				case 12:	//nv12
+				case 13:	//p010
+					{
+						// 16 bit samples are scaled such that their high byte is at 8 bit levels.
+						float scale = PIXEL_FORMAT == 13 ? 65535.0 / 65280.0 : 1.0;
+						float y     = get_sample(plane[0], coords).r * scale;
+						vec2  cbcr  = get_sample(plane[1], coords).rg * scale;
+						return ycbcra_to_rgba(y, cbcr.x, cbcr.y, 1.0);
+					}
+				case 14:	//ycbcr10
+					{
+						// 10 bit samples in 16 bit words, scaled to 8 bit levels like v210.
+						float scale = 65535.0 / 1020.0;
+						float y     = get_sample(plane[0], coords).r * scale;
+						float cb    = get_sample(plane[1], coords).r * scale;
+						float cr    = get_sample(plane[2], coords).r * scale;
+						return ycbcra_to_rgba(y, cb, cr, 1.0);
+					}
 				}
 				return vec4(0.0, 0.0, 0.0, 0.0);
 			}
 
+			vec4 get_rgba_color()
+			{
+			#ifdef SOLID
+				return vec4(solid_b, solid_g, solid_r, solid_a);
+			#endif
+				vec2 coords = TexCoord.st / TexCoord.q;
+				if (field_mode == 0 || PIXEL_FORMAT == 10 || PIXEL_FORMAT == 11)
+					return get_color(coords);
+
+				// Fields of other formats are sampled one row above and below, in rows of the first plane.
+				int  height = textureSize(plane[0], 0).y;
+				int  row    = clamp(int(coords.y * float(height)), 0, height - 1);
+				vec4 color  = get_color(coords);
+				if ((row % 2 == 0) == (field_mode == 1))
+					return color;
+
+				vec2 dy    = vec2(0.0, 1.0 / float(height));
+				vec4 above = get_color(row > 0 ? coords - dy : coords + dy);
+				vec4 below = get_color(row < height - 1 ? coords + dy : coords - dy);
+				return weave(color, above, below);
+			}
+
 			void main()
 			{
 					vec4 color = get_rgba_color();
-					if (chroma)
-						color = chroma_key(color);
-					if(levels)
-						color.rgb = LevelsControl(color.rgb, min_input, gamma, max_input, min_output, max_output);
-					if(csb)
-						color.rgb = ContrastSaturationBrightness(color, brt, sat, con);
-					if(has_local_key)
-						color *= texture(local_key, TexCoord2.st).r;
-					if(has_layer_key)
-						color *= texture(layer_key, TexCoord2.st).r;
+				#ifdef CHROMA
+					color = chroma_key(color);
+				#endif
+				#ifdef LEVELS
+					color.rgb = LevelsControl(color.rgb, min_input, gamma, max_input, min_output, max_output);
+				#endif
+				#ifdef CSB
+					color.rgb = ContrastSaturationBrightness(color, brt, sat, con);
+				#endif
+				#ifdef LOCAL_KEY
+					color *= texture(local_key, TexCoord2.st).r;
+				#endif
+				#ifdef LAYER_KEY
+					color *= texture(layer_key, TexCoord2.st).r;
+				#endif
 					color *= opacity;
-                    if (blend_mode >= 0)
-					    color = blend(color);
+					color = blend(color);
 					fragColor = color.bgra;
 			}
 	)shader";
 }
 
-std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl)
+std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl, image_shader_key key)
 {
     std::lock_guard<std::mutex> lock(g_shader_mutex);
-    auto                        existing_shader = g_shader.lock();
+    auto                        existing_shader = g_shaders[key].lock();
 
     if (existing_shader) {
         return existing_shader;
@@ -311,9 +533,9 @@ std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl)
         }
     };
 
-    existing_shader.reset(new shader(get_vertex(), get_fragment()), deleter);
+    existing_shader.reset(new shader(get_vertex(), get_fragment(get_defines(key))), deleter);
 
-    g_shader = existing_shader;
+    g_shaders[key] = existing_shader;
 
     return existing_shader;
 }
@@ -23,6 +23,12 @@
 
 #include <common/memory.h>
 
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/blend_modes.h>
+
+#include <cstdint>
+#include <string>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
 class shader;
@@ -39,6 +45,55 @@ enum class texture_id
     background
 };
 
-std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl);
+// The std140 image_params uniform block of the image shader. Every member is a 4 byte scalar, so the members are
+// tightly packed in declaration order and booleans are 32 bit integers.
+struct image_uniforms final
+{
+    std::int32_t is_hd   = 0;
+    float        opacity = 1.0f;
+
+    float min_input  = 0.0f;
+    float max_input  = 1.0f;
+    float gamma      = 1.0f;
+    float min_output = 0.0f;
+    float max_output = 1.0f;
+
+    float brt = 1.0f;
+    float sat = 1.0f;
+    float con = 1.0f;
+
+    std::int32_t chroma_show_mask                 = 0;
+    float        chroma_target_hue                = 0.0f;
+    float        chroma_hue_width                 = 0.0f;
+    float        chroma_min_saturation            = 0.0f;
+    float        chroma_min_brightness            = 0.0f;
+    float        chroma_softness                  = 0.0f;
+    float        chroma_spill_suppress            = 0.0f;
+    float        chroma_spill_suppress_saturation = 0.0f;
+
+    std::int32_t field_mode = 0;
+
+    float solid_b = 0.0f;
+    float solid_g = 0.0f;
+    float solid_r = 0.0f;
+    float solid_a = 0.0f;
+};
+
+// Selects a specialization of the image shader, features which are not used are compiled out.
+typedef std::uint32_t image_shader_key;
+
+image_shader_key make_image_shader_key(core::pixel_format format,
+                                       core::blend_mode   blend_mode,
+                                       bool               additive,
+                                       bool               chroma,
+                                       bool               levels,
+                                       bool               csb,
+                                       bool               local_key,
+                                       bool               layer_key,
+                                       bool               solid = false);
+std::string      get_image_shader_name(image_shader_key key);
+
+// Specializations are compiled on first use and shared for as long as any kernel uses them.
+std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl, image_shader_key key);
 
 }}} // namespace caspar::accelerator::ogl
@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "output_converter.h"
+
+#include "../util/device.h"
+#include "../util/shader.h"
+#include "../util/texture.h"
+
+#include <common/gl/gl_check.h>
+
+#include <GL/glew.h>
+
+#include <string>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+namespace {
+
+std::string get_vertex()
+{
+    return R"shader(
+			#version 450
+
+			void main()
+			{
+				// One triangle covering the whole target.
+				vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+				gl_Position   = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+			}
+	)shader";
+}
+
+std::string get_fragment()
+{
+    return R"shader(
+			#version 450
+
+			layout(binding = 0) uniform sampler2D source;
+			layout(binding = 1) uniform sampler2D first_field;
+
+			// Must match core::output_format. A negative format scales the source down to target_size.
+			uniform int  format;
+			uniform vec2 target_size;
+			uniform bool is_hd;
+			uniform bool weave;
+			uniform bool upper_field_first;
+
+			out vec4 fragColor;
+
+			// The pixel at pos, which is clamped to the frame. Woven frames take the rows of the first field from
+			// first_field and the rows of the second field from source.
+			vec4 fetch(ivec2 pos)
+			{
+				ivec2 size = textureSize(source, 0);
+				pos        = clamp(pos, ivec2(0), size - 1);
+				if (weave && (pos.y % 2 == 0) == upper_field_first)
+					return texelFetch(first_field, pos, 0);
+				return texelFetch(source, pos, 0);
+			}
+
+			// Studio range 8 bit Y, Cb and Cr of the pixel at pos.
+			vec3 get_ycbcr(ivec2 pos)
+			{
+				vec3  rgb  = fetch(pos).rgb;
+				float kr   = is_hd ? 0.2126 : 0.299;
+				float kb   = is_hd ? 0.0722 : 0.114;
+				float y    = kr * rgb.r + (1.0 - kr - kb) * rgb.g + kb * rgb.b;
+				return vec3(16.0 + 219.0 * y,
+				            128.0 + 112.0 * (rgb.b - y) / (1.0 - kb),
+				            128.0 + 112.0 * (rgb.r - y) / (1.0 - kr));
+			}
+
+			// Cb and Cr of the pixel pair starting at pos.
+			vec2 get_chroma(ivec2 pos)
+			{
+				return (get_ycbcr(pos).yz + get_ycbcr(pos + ivec2(1, 0)).yz) * 0.5;
+			}
+
+			// The target is read back as bgra, so bytes b0 b1 b2 b3 of a texel are written from its b g r a.
+			vec4 pack_bytes(vec4 bytes)
+			{
+				return bytes.zyxw / 255.0;
+			}
+
+			uint to_10bit(float value)
+			{
+				return uint(clamp(round(value * 4.0), 4.0, 1019.0));
+			}
+
+			vec4 pack_word(float c0, float c1, float c2)
+			{
+				uint word = to_10bit(c0) | to_10bit(c1) << 10 | to_10bit(c2) << 20;
+				return pack_bytes(vec4(uvec4(word, word >> 8, word >> 16, word >> 24) & 0xFFu));
+			}
+
+			vec4 uyvy(ivec2 pos)
+			{
+				ivec2 p  = ivec2(pos.x * 2, pos.y);
+				vec3  c0 = get_ycbcr(p);
+				vec3  c1 = get_ycbcr(p + ivec2(1, 0));
+				vec2  c  = (c0.yz + c1.yz) * 0.5;
+				return pack_bytes(vec4(c.x, c0.x, c.y, c1.x));
+			}
+
+			vec4 v210(ivec2 pos)
+			{
+				// Every four words hold six pixels: Cb0 Y0 Cr0, Y1 Cb2 Y2, Cr2 Y3 Cb4, Y4 Cr4 Y5.
+				ivec2 p = ivec2(pos.x / 4 * 6, pos.y);
+				switch (pos.x % 4)
+				{
+				case 0:
+					{
+						vec2 c = get_chroma(p);
+						return pack_word(c.x, get_ycbcr(p).x, c.y);
+					}
+				case 1:
+					{
+						vec2 c = get_chroma(p + ivec2(2, 0));
+						return pack_word(get_ycbcr(p + ivec2(1, 0)).x, c.x, get_ycbcr(p + ivec2(2, 0)).x);
+					}
+				case 2:
+					{
+						vec2 c2 = get_chroma(p + ivec2(2, 0));
+						vec2 c4 = get_chroma(p + ivec2(4, 0));
+						return pack_word(c2.y, get_ycbcr(p + ivec2(3, 0)).x, c4.x);
+					}
+				default:
+					{
+						vec2 c = get_chroma(p + ivec2(4, 0));
+						return pack_word(get_ycbcr(p + ivec2(4, 0)).x, c.y, get_ycbcr(p + ivec2(5, 0)).x);
+					}
+				}
+			}
+
+			// The 10 bit sample n of the pixel group starting at pixel p: Cb, Y0, Cr, Y1.
+			uint get_sample(ivec2 p, int n)
+			{
+				if (n == 1 || n == 3)
+					return to_10bit(get_ycbcr(p + ivec2(n / 2, 0)).x);
+				vec2 c = get_chroma(p);
+				return to_10bit(n == 0 ? c.x : c.y);
+			}
+
+			// Byte n of the five big endian bytes of the pixel group starting at pixel p.
+			uint get_group_byte(ivec2 p, int n)
+			{
+				int  bit  = n * 8;
+				int  end  = bit + 8;
+				uint byte = 0u;
+				for (int s = bit / 10; s * 10 < end; ++s)
+				{
+					uint sample = get_sample(p, s);
+					int  shift  = end - (s + 1) * 10;
+					byte |= shift >= 0 ? sample << shift : sample >> -shift;
+				}
+				return byte & 0xFFu;
+			}
+
+			vec4 rfc4175(ivec2 pos)
+			{
+				// Every two pixels are a group of five bytes, so a texel holds bytes of one or two groups.
+				int  width = textureSize(source, 0).x;
+				uint bytes[4];
+				for (int n = 0; n < 4; ++n)
+				{
+					int offset = pos.x * 4 + n;
+					int group  = offset / 5;
+					bytes[n]   = group * 2 < width ? get_group_byte(ivec2(group * 2, pos.y), offset % 5) : 0u;
+				}
+				return pack_bytes(vec4(bytes[0], bytes[1], bytes[2], bytes[3]));
+			}
+
+			vec4 quarter(ivec2 pos)
+			{
+				vec4 sum = vec4(0.0);
+				for (int y = 0; y < 4; ++y)
+					for (int x = 0; x < 4; ++x)
+						sum += fetch(pos * 4 + ivec2(x, y));
+				return sum / 16.0;
+			}
+
+			vec4 scaled(ivec2 pos)
+			{
+				// Averages the source pixels under the target pixel, with up to 8x8 bilinear taps.
+				vec2  size  = vec2(textureSize(source, 0));
+				vec2  ratio = size / target_size;
+				ivec2 taps  = clamp(ivec2(ceil(ratio)), ivec2(1), ivec2(8));
+				vec4  sum   = vec4(0.0);
+				for (int y = 0; y < taps.y; ++y)
+					for (int x = 0; x < taps.x; ++x)
+						sum += texture(source, (vec2(pos) + (vec2(x, y) + 0.5) / vec2(taps)) * ratio / size);
+				return sum / float(taps.x * taps.y);
+			}
+
+			vec4 nv12(ivec2 pos)
+			{
+				// The luma rows are followed by half as many rows of interleaved Cb and Cr.
+				int height = textureSize(source, 0).y;
+				if (pos.y < height)
+					return vec4(get_ycbcr(pos).x / 255.0);
+
+				ivec2 p = ivec2(pos.x / 2 * 2, (pos.y - height) * 2);
+				vec2  c = (get_chroma(p) + get_chroma(p + ivec2(0, 1))) * 0.5;
+				return vec4((pos.x % 2 == 0 ? c.x : c.y) / 255.0);
+			}
+
+			void main()
+			{
+				ivec2 pos = ivec2(gl_FragCoord.xy);
+				if (format < 0)
+				{
+					fragColor = scaled(pos);
+					return;
+				}
+				switch (format)
+				{
+				case 0:
+					fragColor = fetch(pos);
+					break;
+				case 1:
+					fragColor = uyvy(pos);
+					break;
+				case 2:
+					fragColor = v210(pos);
+					break;
+				case 3:
+					fragColor = nv12(pos);
+					break;
+				case 5:
+					fragColor = quarter(pos);
+					break;
+				case 6:
+					fragColor = rfc4175(pos);
+					break;
+				default:
+					fragColor = fetch(pos).aaaa;
+					break;
+				}
+			}
+	)shader";
+}
+
+} // namespace
+
+struct output_converter::impl
+{
+    spl::shared_ptr<device> ogl_;
+    std::unique_ptr<shader> shader_;
+    GLuint                  vao_ = 0;
+
+    impl(const spl::shared_ptr<device>& ogl)
+        : ogl_(ogl)
+    {
+        ogl_->dispatch_sync([&] {
+            shader_.reset(new shader(get_vertex(), get_fragment()));
+
+            // The vertices are generated by the vertex shader, but drawing still needs a vertex array.
+            GL(glCreateVertexArrays(1, &vao_));
+        });
+    }
+
+    ~impl()
+    {
+        ogl_->dispatch_sync([&] {
+            GL(glDeleteVertexArrays(1, &vao_));
+            shader_.reset();
+        });
+    }
+
+    std::shared_ptr<texture> operator()(const std::shared_ptr<texture>& source,
+                                        core::output_format             format,
+                                        bool                            is_hd,
+                                        const std::shared_ptr<texture>& first_field,
+                                        bool                            upper_field_first)
+    {
+        const auto width  = source->width();
+        const auto height = source->height();
+
+        std::shared_ptr<texture> target;
+        switch (format) {
+            case core::output_format::bgra:
+                if (!first_field) {
+                    return source;
+                }
+                target = ogl_->create_texture(width, height, 4, false);
+                break;
+            case core::output_format::uyvy:
+                target = ogl_->create_texture((width + 1) / 2, height, 4, false);
+                break;
+            case core::output_format::v210:
+                target = ogl_->create_texture((width + 47) / 48 * 32, height, 4, false);
+                break;
+            case core::output_format::nv12:
+                target = ogl_->create_texture(width, height + (height + 1) / 2, 1, false);
+                break;
+            case core::output_format::key:
+                target = ogl_->create_texture(width, height, 4, false);
+                break;
+            case core::output_format::quarter:
+                target = ogl_->create_texture((width + 3) / 4, (height + 3) / 4, 4, false);
+                break;
+            case core::output_format::rfc4175:
+                target = ogl_->create_texture(((width + 1) / 2 * 5 + 3) / 4, height, 4, false);
+                break;
+            default:
+                return source;
+        }
+
+        shader_->use();
+        shader_->set("format", format);
+        shader_->set("is_hd", is_hd);
+        shader_->set("weave", first_field != nullptr);
+        shader_->set("upper_field_first", upper_field_first);
+
+        // NOTE: Unit 0 is bound last, so that it is the active unit which unbind() releases.
+        if (first_field) {
+            first_field->bind(1);
+        }
+        draw(source, target);
+
+        return target;
+    }
+
+    std::shared_ptr<texture> scale(const std::shared_ptr<texture>& source, int width, int height)
+    {
+        auto target = ogl_->create_texture(width, height, 4, false);
+
+        shader_->use();
+        shader_->set("format", -1);
+        shader_->set("target_size", static_cast<double>(width), static_cast<double>(height));
+        shader_->set("weave", false);
+
+        draw(source, target);
+
+        return target;
+    }
+
+  private:
+    void draw(const std::shared_ptr<texture>& source, const std::shared_ptr<texture>& target)
+    {
+        source->bind(0);
+        target->attach();
+
+        GL(glViewport(0, 0, target->width(), target->height()));
+        GL(glBindVertexArray(vao_));
+        GL(glDrawArrays(GL_TRIANGLES, 0, 3));
+        GL(glBindVertexArray(0));
+
+        source->unbind();
+    }
+};
+
+output_converter::output_converter(const spl::shared_ptr<device>& ogl)
+    : impl_(new impl(ogl))
+{
+}
+output_converter::~output_converter() {}
+std::shared_ptr<texture> output_converter::operator()(const std::shared_ptr<texture>& source,
+                                                      core::output_format             format,
+                                                      bool                            is_hd,
+                                                      const std::shared_ptr<texture>& first_field,
+                                                      bool                            upper_field_first)
+{
+    return (*impl_)(source, format, is_hd, first_field, upper_field_first);
+}
+std::shared_ptr<texture> output_converter::scale(const std::shared_ptr<texture>& source, int width, int height)
+{
+    return impl_->scale(source, width, height);
+}
+
+}}} // namespace caspar::accelerator::ogl
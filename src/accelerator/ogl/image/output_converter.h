@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/frame/pixel_format.h>
+
+#include <memory>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Converts rendered frames into the packed formats of core::output_format, so that consumers can be fed without a
+// conversion on the cpu and only the bytes of the packed format are read back.
+class output_converter final
+{
+  public:
+    explicit output_converter(const spl::shared_ptr<class device>& ogl);
+    output_converter(const output_converter&) = delete;
+
+    ~output_converter();
+
+    output_converter& operator=(const output_converter&) = delete;
+
+    // Draws source into a texture holding the bytes of format, row by row. If first_field is set, the frame is first
+    // woven of the first field of first_field and the second field of source. Must be called on the device thread.
+    std::shared_ptr<class texture> operator()(const std::shared_ptr<class texture>& source,
+                                              core::output_format                   format,
+                                              bool                                  is_hd,
+                                              const std::shared_ptr<class texture>& first_field       = nullptr,
+                                              bool                                  upper_field_first = true);
+
+    // Draws source into a bgra texture of width by height, each pixel the average of the source pixels under it.
+    // Must be called on the device thread.
+    std::shared_ptr<class texture> scale(const std::shared_ptr<class texture>& source, int width, int height);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "video_scopes.h"
+
+#include "../util/device.h"
+#include "../util/shader.h"
+#include "../util/texture.h"
+
+#include <common/env.h>
+#include <common/gl/gl_check.h>
+
+#include <GL/glew.h>
+
+#include <boost/optional.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+namespace {
+
+// NOTE: Every second pixel of every second row is sampled, which is plenty for levels and a quarter of the work.
+const int SAMPLE_STEP = 2;
+
+// Pictures are black once this share of the samples is at most 10% above black, and frozen once they have not
+// changed by more than a tenth of a code per sample on average for this long, as in ffmpeg blackdetect and
+// freezedetect.
+const double                   BLACK_RATIO  = 0.98;
+const std::uint32_t            BLACK_LEVEL  = 16 + 22;
+const double                   FREEZE_NOISE = 0.1;
+const std::chrono::seconds     FREEZE_TIME{2};
+
+// Must match the results buffer of the compute shader.
+struct results
+{
+    std::uint32_t luma_min;
+    std::uint32_t luma_max;
+    std::uint32_t cb_min;
+    std::uint32_t cb_max;
+    std::uint32_t cr_min;
+    std::uint32_t cr_max;
+    std::uint32_t samples;
+    std::uint32_t out_of_gamut;
+    std::uint32_t histogram[256];
+    std::uint32_t grid[256];
+};
+
+std::string get_compute()
+{
+    return R"shader(
+			#version 450
+
+			layout(local_size_x = 16, local_size_y = 16) in;
+
+			layout(binding = 0) uniform sampler2D source;
+
+			layout(std430, binding = 0) buffer results
+			{
+				uint luma_min;
+				uint luma_max;
+				uint cb_min;
+				uint cb_max;
+				uint cr_min;
+				uint cr_max;
+				uint samples;
+				uint out_of_gamut;
+				uint histogram[256];
+				uint grid[256]; // Signatures of 16 x 16 cells of the picture.
+			};
+
+			uniform bool is_hd;
+			uniform int  sample_step;
+
+			// Each group sums up its samples here, so that only one thread per group touches the results.
+			shared uint local_histogram[256];
+			shared uint local_min[3];
+			shared uint local_max[3];
+			shared uint local_samples;
+			shared uint local_out_of_gamut;
+			shared uint local_signature;
+
+			void main()
+			{
+				uint index = gl_LocalInvocationIndex;
+
+				local_histogram[index] = 0u;
+				if (index < 3u)
+				{
+					local_min[index] = 255u;
+					local_max[index] = 0u;
+				}
+				if (index == 0u)
+				{
+					local_samples      = 0u;
+					local_out_of_gamut = 0u;
+					local_signature    = 0u;
+				}
+				barrier();
+
+				ivec2 size = textureSize(source, 0);
+				ivec2 pos  = ivec2(gl_GlobalInvocationID.xy) * sample_step;
+				if (pos.x < size.x && pos.y < size.y)
+				{
+					// Studio range 8 bit Y, Cb and Cr, as the output converter packs them.
+					vec3  rgb   = texelFetch(source, pos, 0).rgb;
+					float kr    = is_hd ? 0.2126 : 0.299;
+					float kb    = is_hd ? 0.0722 : 0.114;
+					float y     = kr * rgb.r + (1.0 - kr - kb) * rgb.g + kb * rgb.b;
+					uvec3 ycbcr = uvec3(round(vec3(16.0 + 219.0 * y,
+					                               128.0 + 112.0 * (rgb.b - y) / (1.0 - kb),
+					                               128.0 + 112.0 * (rgb.r - y) / (1.0 - kr))));
+
+					for (int n = 0; n < 3; ++n)
+					{
+						atomicMin(local_min[n], ycbcr[n]);
+						atomicMax(local_max[n], ycbcr[n]);
+					}
+					atomicAdd(local_histogram[ycbcr.x], 1u);
+					atomicAdd(local_samples, 1u);
+
+					// Each position of the group has a weight of its own, so that the signature also changes when
+					// the picture moves within the group.
+					atomicAdd(local_signature, ycbcr.x * ((index * 2654435761u) >> 28 | 1u));
+
+					// The composite gamut of -20 to 120 IRE, of the 601 encoding.
+					float y601 = dot(rgb, vec3(0.299, 0.587, 0.114));
+					float c    = length(vec2(0.492 * (rgb.b - y601), 0.877 * (rgb.r - y601)));
+					if (y601 + c > 1.2 || y601 - c < -0.2)
+						atomicAdd(local_out_of_gamut, 1u);
+				}
+				barrier();
+
+				if (local_histogram[index] > 0u)
+					atomicAdd(histogram[index], local_histogram[index]);
+
+				if (index == 0u && local_samples > 0u)
+				{
+					atomicMin(luma_min, local_min[0]);
+					atomicMax(luma_max, local_max[0]);
+					atomicMin(cb_min, local_min[1]);
+					atomicMax(cb_max, local_max[1]);
+					atomicMin(cr_min, local_min[2]);
+					atomicMax(cr_max, local_max[2]);
+					atomicAdd(samples, local_samples);
+					atomicAdd(out_of_gamut, local_out_of_gamut);
+
+					ivec2 origin = ivec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy) * sample_step;
+					ivec2 cell   = clamp(origin * 16 / size, ivec2(0), ivec2(15));
+					atomicAdd(grid[cell.y * 16 + cell.x], local_signature);
+				}
+			}
+	)shader";
+}
+
+} // namespace
+
+struct video_scopes::impl
+{
+    struct slot
+    {
+        GLuint buffer = 0;
+        GLsync fence  = nullptr;
+    };
+
+    spl::shared_ptr<device>  ogl_;
+    const int                interval_;
+    std::unique_ptr<shader>  shader_;
+    std::array<slot, 3>      slots_;
+    std::size_t              next_slot_ = 0;
+    std::deque<std::size_t>  pending_;
+    std::atomic<std::int64_t> frame_{0};
+
+    mutable std::mutex                                     state_mutex_;
+    core::monitor::state                                   state_;
+    std::vector<std::uint32_t>                             last_grid_;
+    boost::optional<std::chrono::steady_clock::time_point> unchanged_since_;
+
+    explicit impl(const spl::shared_ptr<device>& ogl)
+        : ogl_(ogl)
+        , interval_(std::max(0, env::properties().get(L"configuration.ogl.scopes", 0)))
+    {
+        if (interval_ == 0) {
+            return;
+        }
+
+        ogl_->dispatch_sync([&] {
+            shader_.reset(new shader(get_compute()));
+            for (auto& slot : slots_) {
+                GL(glCreateBuffers(1, &slot.buffer));
+                GL(glNamedBufferStorage(slot.buffer, sizeof(results), nullptr, GL_DYNAMIC_STORAGE_BIT));
+            }
+        });
+    }
+
+    ~impl()
+    {
+        if (!shader_) {
+            return;
+        }
+
+        ogl_->dispatch_sync([&] {
+            for (auto& slot : slots_) {
+                if (slot.fence) {
+                    glDeleteSync(slot.fence);
+                }
+                GL(glDeleteBuffers(1, &slot.buffer));
+            }
+            shader_.reset();
+        });
+    }
+
+    bool due() { return interval_ > 0 && frame_++ % interval_ == 0; }
+
+    void measure(const std::shared_ptr<texture>& source, const core::video_format_desc& format_desc)
+    {
+        if (!shader_) {
+            return;
+        }
+
+        read();
+
+        // NOTE: Frames are skipped rather than waited for while the results of earlier ones are still pending.
+        auto& slot = slots_[next_slot_];
+        if (!due() || slot.fence) {
+            return;
+        }
+
+        results initial = {};
+        initial.luma_min = initial.cb_min = initial.cr_min = 0xFFFFFFFF;
+        GL(glNamedBufferSubData(slot.buffer, 0, sizeof(initial), &initial));
+
+        shader_->use();
+        shader_->set("is_hd", format_desc.height > 700);
+        shader_->set("sample_step", SAMPLE_STEP);
+
+        GL(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, slot.buffer));
+        source->bind(0);
+
+        const auto span = 16 * SAMPLE_STEP;
+        GL(glDispatchCompute((source->width() + span - 1) / span, (source->height() + span - 1) / span, 1));
+        GL(glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT));
+
+        source->unbind();
+        GL(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0));
+
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        pending_.push_back(next_slot_);
+        next_slot_ = (next_slot_ + 1) % slots_.size();
+    }
+
+    void blank(const core::video_format_desc& format_desc)
+    {
+        if (!due()) {
+            return;
+        }
+
+        results black    = {};
+        black.luma_min   = black.luma_max = 16;
+        black.cb_min     = black.cb_max   = 128;
+        black.cr_min     = black.cr_max   = 128;
+        black.samples    = static_cast<std::uint32_t>(format_desc.size / (4 * SAMPLE_STEP * SAMPLE_STEP));
+        black.histogram[16] = black.samples;
+        publish(black);
+    }
+
+    // Publishes the results whose fences have been passed, in order.
+    void read()
+    {
+        while (!pending_.empty()) {
+            auto& slot = slots_[pending_.front()];
+            if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                return;
+            }
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+            pending_.pop_front();
+
+            results result;
+            GL(glGetNamedBufferSubData(slot.buffer, 0, sizeof(result), &result));
+            publish(result);
+        }
+    }
+
+    void publish(const results& result)
+    {
+        if (result.samples == 0) {
+            return;
+        }
+
+        const auto samples = static_cast<double>(result.samples);
+
+        double              luma_sum = 0.0;
+        std::uint64_t       dark     = 0;
+        std::vector<double> bins(32);
+        for (std::uint32_t n = 0; n < 256; ++n) {
+            luma_sum += static_cast<double>(n) * result.histogram[n];
+            dark += n <= BLACK_LEVEL ? result.histogram[n] : 0;
+            bins[n / 8] += result.histogram[n] * 100.0 / samples;
+        }
+
+        core::monitor::state state;
+        state["scopes/luma/min"]      = static_cast<std::int32_t>(result.luma_min);
+        state["scopes/luma/max"]      = static_cast<std::int32_t>(result.luma_max);
+        state["scopes/luma/average"]  = luma_sum / samples;
+        state["scopes/cb/min"]        = static_cast<std::int32_t>(result.cb_min);
+        state["scopes/cb/max"]        = static_cast<std::int32_t>(result.cb_max);
+        state["scopes/cr/min"]        = static_cast<std::int32_t>(result.cr_min);
+        state["scopes/cr/max"]        = static_cast<std::int32_t>(result.cr_max);
+        state["scopes/out-of-gamut"]  = result.out_of_gamut * 100.0 / samples;
+        state["scopes/histogram"]     = bins;
+        state["scopes/black"]         = dark >= BLACK_RATIO * samples;
+
+        std::lock_guard<std::mutex> lock(state_mutex_);
+
+        const auto now = std::chrono::steady_clock::now();
+
+        auto unchanged = last_grid_.size() == 256;
+        if (unchanged) {
+            double change = 0.0;
+            for (std::size_t n = 0; n < 256; ++n) {
+                change += std::abs(static_cast<double>(result.grid[n]) - static_cast<double>(last_grid_[n]));
+            }
+            unchanged = change <= FREEZE_NOISE * samples;
+        }
+        last_grid_.assign(std::begin(result.grid), std::end(result.grid));
+
+        if (!unchanged) {
+            unchanged_since_.reset();
+        } else if (!unchanged_since_) {
+            unchanged_since_ = now;
+        }
+
+        auto frozen = unchanged_since_ ? std::chrono::duration<double>(now - *unchanged_since_).count() : 0.0;
+        state["scopes/frozen"] = frozen;
+        state["scopes/freeze"] = frozen >= std::chrono::duration<double>(FREEZE_TIME).count();
+
+        state_ = std::move(state);
+    }
+
+    core::monitor::state state() const
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+};
+
+video_scopes::video_scopes(const spl::shared_ptr<device>& ogl)
+    : impl_(new impl(ogl))
+{
+}
+video_scopes::~video_scopes() {}
+void video_scopes::operator()(const std::shared_ptr<texture>& source, const core::video_format_desc& format_desc)
+{
+    impl_->measure(source, format_desc);
+}
+void                 video_scopes::blank(const core::video_format_desc& format_desc) { impl_->blank(format_desc); }
+core::monitor::state video_scopes::state() const { return impl_->state(); }
+
+}}} // namespace caspar::accelerator::ogl
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <memory>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Measures the levels of the mixed frames of a channel on the gpu every configuration.ogl.scopes frames: the ranges
+// of luma and chroma, a luma histogram, the share of samples outside the composite gamut, and whether the picture is
+// black or frozen. The results are read a few frames later, so that nothing waits for the gpu.
+class video_scopes final
+{
+  public:
+    explicit video_scopes(const spl::shared_ptr<class device>& ogl);
+    video_scopes(const video_scopes&) = delete;
+
+    ~video_scopes();
+
+    video_scopes& operator=(const video_scopes&) = delete;
+
+    // Measures the rendered frame if it is due. Must be called on the device thread.
+    void operator()(const std::shared_ptr<class texture>& source, const core::video_format_desc& format_desc);
+
+    // Measures a frame which was not rendered as the mixer outputs a blank frame for it.
+    void blank(const core::video_format_desc& format_desc);
+
+    // The last results, under scopes.
+    core::monitor::state state() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
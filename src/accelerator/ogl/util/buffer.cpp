@@ -28,12 +28,14 @@ namespace caspar { namespace accelerator { namespace ogl {
 
 struct buffer::impl : boost::noncopyable
 {
-    GLuint     id_     = 0;
-    GLsizei    size_   = 0;
-    void*      data_   = nullptr;
-    bool       write_  = false;
-    GLenum     target_ = 0;
-    GLbitfield flags_  = 0;
+    GLuint                  id_     = 0;
+    GLsizei                 size_   = 0;
+    GLsizei                 offset_ = 0;
+    void*                   data_   = nullptr;
+    bool                    write_  = false;
+    GLenum                  target_ = 0;
+    GLbitfield              flags_  = 0;
+    std::shared_ptr<buffer> parent_;
 
   public:
     impl(int size, bool write)
@@ -47,8 +49,23 @@ struct buffer::impl : boost::noncopyable
         data_ = GL2(glMapNamedBufferRange(id_, 0, size_, flags_));
     }
 
+    impl(std::shared_ptr<buffer> parent, int offset, int size)
+        : id_(parent->id())
+        , size_(size)
+        , offset_(parent->offset() + offset)
+        , data_(reinterpret_cast<char*>(parent->data()) + offset)
+        , write_(parent->write())
+        , target_(!write_ ? GL_PIXEL_PACK_BUFFER : GL_PIXEL_UNPACK_BUFFER)
+        , parent_(std::move(parent))
+    {
+    }
+
     ~impl()
     {
+        if (parent_) {
+            return;
+        }
+
         GL(glUnmapNamedBuffer(id_));
         glDeleteBuffers(1, &id_);
     }
@@ -62,6 +79,10 @@ buffer::buffer(int size, bool write)
     : impl_(new impl(size, write))
 {
 }
+buffer::buffer(std::shared_ptr<buffer> parent, int offset, int size)
+    : impl_(new impl(std::move(parent), offset, size))
+{
+}
 buffer::buffer(buffer&& other)
     : impl_(std::move(other.impl_))
 {
@@ -73,6 +94,7 @@ buffer& buffer::operator=(buffer&& other)
     return *this;
 }
 void* buffer::data() { return impl_->data_; }
+int   buffer::offset() const { return impl_->offset_; }
 bool  buffer::write() const { return impl_->write_; }
 int   buffer::size() const { return impl_->size_; }
 void  buffer::bind() { return impl_->bind(); }
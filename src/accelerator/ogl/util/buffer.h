@@ -29,6 +29,9 @@ class buffer final
 {
   public:
     buffer(int size, bool write);
+
+    // Size bytes of parent from offset on. The slice shares the GL object of parent and keeps it alive.
+    buffer(std::shared_ptr<buffer> parent, int offset, int size);
     buffer(const buffer&) = delete;
     buffer(buffer&& other);
     ~buffer();
@@ -41,6 +44,7 @@ class buffer final
 
     int   id() const;
     void* data();
+    int   offset() const; // of the data within the GL object
     int   size() const;
     bool  write() const;
 
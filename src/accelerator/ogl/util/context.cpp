@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "context.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/gl/gl_check.h>
+#include <common/log.h>
+
+#include <GL/glew.h>
+
+#include <SFML/Window/Context.hpp>
+
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <dlfcn.h>
+#endif
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+namespace {
+
+bool use_egl()
+{
+    static const bool egl = [] {
+        auto backend = env::properties().get(L"configuration.ogl.backend", L"sfml");
+#ifdef _WIN32
+        if (boost::iequals(backend, L"egl")) {
+            CASPAR_LOG(warning) << L"[ogl-context] The egl backend is only available on Linux, using sfml.";
+        }
+        return false;
+#else
+        return boost::iequals(backend, L"egl");
+#endif
+    }();
+    return egl;
+}
+
+#ifndef _WIN32
+// NOTE: libEGL is loaded at runtime, so that the server does not link against it and the libEGL.so staged for CEF
+// is not picked up instead of the system one.
+struct egl_api
+{
+    decltype(&eglGetProcAddress)    GetProcAddress    = nullptr;
+    decltype(&eglGetError)          GetError          = nullptr;
+    decltype(&eglInitialize)        Initialize        = nullptr;
+    decltype(&eglQueryString)       QueryString       = nullptr;
+    decltype(&eglBindAPI)           BindAPI           = nullptr;
+    decltype(&eglChooseConfig)      ChooseConfig      = nullptr;
+    decltype(&eglCreateContext)     CreateContext     = nullptr;
+    decltype(&eglDestroyContext)    DestroyContext    = nullptr;
+    decltype(&eglMakeCurrent)       MakeCurrent       = nullptr;
+    decltype(&eglGetCurrentContext) GetCurrentContext = nullptr;
+
+    PFNEGLQUERYDEVICESEXTPROC       QueryDevicesEXT       = nullptr;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC GetPlatformDisplayEXT = nullptr;
+
+    egl_api()
+    {
+        auto lib = dlopen("libEGL.so.1", RTLD_NOW | RTLD_LOCAL);
+        if (!lib) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to load libEGL.so.1."));
+        }
+
+        load(lib, GetProcAddress, "eglGetProcAddress");
+        load(lib, GetError, "eglGetError");
+        load(lib, Initialize, "eglInitialize");
+        load(lib, QueryString, "eglQueryString");
+        load(lib, BindAPI, "eglBindAPI");
+        load(lib, ChooseConfig, "eglChooseConfig");
+        load(lib, CreateContext, "eglCreateContext");
+        load(lib, DestroyContext, "eglDestroyContext");
+        load(lib, MakeCurrent, "eglMakeCurrent");
+        load(lib, GetCurrentContext, "eglGetCurrentContext");
+
+        QueryDevicesEXT = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(GetProcAddress("eglQueryDevicesEXT"));
+        GetPlatformDisplayEXT =
+            reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(GetProcAddress("eglGetPlatformDisplayEXT"));
+    }
+
+    template <typename T>
+    static void load(void* lib, T& func, const char* name)
+    {
+        func = reinterpret_cast<T>(dlsym(lib, name));
+        if (!func) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info(std::string("Failed to load ") + name + "."));
+        }
+    }
+
+    void check(bool result, const std::string& what) const
+    {
+        if (!result) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to " + what + " (EGL error " +
+                                                                   std::to_string(GetError()) + ")."));
+        }
+    }
+};
+
+const egl_api& egl()
+{
+    static const egl_api api;
+    return api;
+}
+
+// The display of EGL device index, which is initialized once and kept for the lifetime of the process.
+EGLDisplay egl_display(int index)
+{
+    static std::mutex                mutex;
+    static std::map<int, EGLDisplay> displays;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = displays.find(index);
+    if (it != displays.end()) {
+        return it->second;
+    }
+
+    auto& api = egl();
+
+    EGLint count = 0;
+    if (!api.QueryDevicesEXT || !api.GetPlatformDisplayEXT || !api.QueryDevicesEXT(0, nullptr, &count)) {
+        CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("EGL_EXT_platform_device is not supported."));
+    }
+
+    std::vector<EGLDeviceEXT> devices(count);
+    api.check(api.QueryDevicesEXT(count, devices.data(), &count) == EGL_TRUE, "query EGL devices");
+    if (index < 0 || index >= count) {
+        CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("There is no EGL device " + std::to_string(index) +
+                                                               " of " + std::to_string(count) + "."));
+    }
+
+    auto display = api.GetPlatformDisplayEXT(EGL_PLATFORM_DEVICE_EXT, devices[index], nullptr);
+    api.check(display != EGL_NO_DISPLAY, "get the display of EGL device " + std::to_string(index));
+
+    EGLint major = 0;
+    EGLint minor = 0;
+    api.check(api.Initialize(display, &major, &minor) == EGL_TRUE, "initialize EGL");
+
+    const auto extensions = api.QueryString(display, EGL_EXTENSIONS);
+    if (!extensions || !std::strstr(extensions, "EGL_KHR_surfaceless_context")) {
+        CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("EGL_KHR_surfaceless_context is not supported."));
+    }
+
+    CASPAR_LOG(info) << L"[ogl-context] Initialized EGL " << major << L"." << minor << L" on device " << index
+                     << L".";
+
+    displays[index] = display;
+    return display;
+}
+#endif
+
+} // namespace
+
+struct context::impl
+{
+    std::unique_ptr<sf::Context> sf_context_;
+#ifndef _WIN32
+    EGLDisplay display_ = EGL_NO_DISPLAY;
+    EGLContext context_ = EGL_NO_CONTEXT;
+#endif
+
+    impl(int index, const impl* share)
+    {
+#ifndef _WIN32
+        if (use_egl()) {
+            auto& api = egl();
+
+            display_ = egl_display(index);
+
+            const EGLint config_attribs[] = {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+            EGLConfig config = nullptr;
+            EGLint    count  = 0;
+            api.check(api.ChooseConfig(display_, config_attribs, &config, 1, &count) == EGL_TRUE && count > 0,
+                      "choose an EGL config");
+
+            // NOTE: The bound API is per thread, so it is bound before every call which depends on it.
+            api.check(api.BindAPI(EGL_OPENGL_API) == EGL_TRUE, "bind the OpenGL API");
+
+            const EGLint context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                              4,
+                                              EGL_CONTEXT_MINOR_VERSION,
+                                              5,
+                                              EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                              EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                              EGL_NONE};
+            context_ =
+                api.CreateContext(display_, config, share ? share->context_ : EGL_NO_CONTEXT, context_attribs);
+            api.check(context_ != EGL_NO_CONTEXT, "create an EGL context");
+            return;
+        }
+#endif
+        sf_context_ = std::make_unique<sf::Context>(
+            sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core), 1, 1);
+    }
+
+    ~impl()
+    {
+#ifndef _WIN32
+        if (context_ != EGL_NO_CONTEXT) {
+            auto& api = egl();
+            if (api.GetCurrentContext() == context_) {
+                api.MakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            }
+            api.DestroyContext(display_, context_);
+        }
+#endif
+    }
+
+    void set_active(bool active)
+    {
+#ifndef _WIN32
+        if (context_ != EGL_NO_CONTEXT) {
+            auto& api = egl();
+            api.check(api.BindAPI(EGL_OPENGL_API) == EGL_TRUE, "bind the OpenGL API");
+            const auto context = active ? context_ : EGL_NO_CONTEXT;
+            api.check(api.MakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context) == EGL_TRUE,
+                      active ? "make the EGL context current" : "release the EGL context");
+            return;
+        }
+#endif
+        sf_context_->setActive(active);
+    }
+
+    void init_glew()
+    {
+#ifndef _WIN32
+        // NOTE: glewInit() also initializes GLX, which fails without a display. The GL functions themselves are
+        // resolved by the GL dispatch library whichever API created the context.
+        if (context_ != EGL_NO_CONTEXT) {
+            if (glewContextInit() != GLEW_OK) {
+                CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize GLEW."));
+            }
+            return;
+        }
+#endif
+        if (glewInit() != GLEW_OK) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize GLEW."));
+        }
+    }
+};
+
+context::context(int index, const context* share)
+    : impl_(new impl(index, share ? share->impl_.get() : nullptr))
+{
+}
+context::~context() {}
+void context::set_active(bool active) { impl_->set_active(active); }
+void context::init_glew() { impl_->init_glew(); }
+
+}}} // namespace caspar::accelerator::ogl
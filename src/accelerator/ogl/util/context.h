@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// An OpenGL 4.5 core context of a device. Contexts are created through SFML, which needs a display, or with
+// configuration.ogl.backend set to egl, as surfaceless contexts on the EGL device of the same index, which need none.
+class context final
+{
+  public:
+    // Creates a context of device index which shares objects with share, if set.
+    context(int index, const context* share);
+    context(const context&) = delete;
+
+    ~context();
+
+    context& operator=(const context&) = delete;
+
+    // Makes the context current on, or releases it from, the calling thread.
+    void set_active(bool active);
+
+    // Loads the GL functions through GLEW. Must be called with the context active.
+    void init_glew();
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
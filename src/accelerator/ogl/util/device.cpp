@@ -21,73 +21,539 @@
 #include "device.h"
 
 #include "buffer.h"
+#include "context.h"
+#include "gpu_profiler.h"
 #include "shader.h"
 #include "texture.h"
 
 #include <common/array.h>
 #include <common/assert.h>
+#include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
+#include <common/env.h>
 #include <common/except.h>
 #include <common/future.h>
 #include <common/gl/gl_check.h>
+#include <common/memcpy.h>
 #include <common/os/thread.h>
+#include <common/scope_exit.h>
+
+#include <core/frame/frame.h>
 
 #include <GL/glew.h>
 
-#include <SFML/Window/Context.hpp>
+#ifdef _WIN32
+#include <GL/wglew.h>
+#include <d3d11.h>
+
+#pragma comment(lib, "d3d11.lib")
+#endif
+
 
 #include <boost/asio/deadline_timer.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/property_tree/ptree.hpp>
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/asio/spawn.hpp>
 
 #include <tbb/concurrent_queue.h>
-#include <tbb/concurrent_unordered_map.h>
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <functional>
 #include <future>
+#include <map>
+#include <mutex>
+#include <numeric>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
 using namespace boost::asio;
 
+// Idle resources shared by every channel on the device. Released resources are stacked per key so that the most
+// recently used one is reused first, which lets the least recently used ones age out and be trimmed.
+template <typename T>
+class resource_pool
+{
+    struct entry
+    {
+        std::shared_ptr<T>                    item;
+        std::chrono::steady_clock::time_point released;
+    };
+
+    mutable std::mutex                                  mutex_;
+    std::unordered_map<std::size_t, std::vector<entry>> free_;
+    std::size_t                                         resident_  = 0;
+    std::size_t                                         pooled_    = 0;
+    std::uint64_t                                       hits_      = 0;
+    std::uint64_t                                       misses_    = 0;
+    std::uint64_t                                       evictions_ = 0;
+
+    // Resources in use and the most which have been in use at once, per key.
+    std::unordered_map<std::size_t, std::size_t> used_;
+    std::unordered_map<std::size_t, std::size_t> high_water_;
+
+    void use(std::size_t key)
+    {
+        auto& used       = ++used_[key];
+        auto& high_water = high_water_[key];
+        high_water       = std::max(high_water, used);
+    }
+
+  public:
+    std::shared_ptr<T> pop(std::size_t key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = free_.find(key);
+        if (it == free_.end() || it->second.empty()) {
+            ++misses_;
+            return nullptr;
+        }
+
+        auto item = std::move(it->second.back().item);
+        it->second.pop_back();
+        pooled_ -= item->size();
+        ++hits_;
+        use(key);
+        return item;
+    }
+
+    // Adds a resource which was allocated to be used.
+    void add(std::size_t key, const std::shared_ptr<T>& item)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        resident_ += item->size();
+        use(key);
+    }
+
+    void push(std::size_t key, std::shared_ptr<T> item)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pooled_ += item->size();
+        --used_[key];
+        free_[key].push_back(entry{std::move(item), std::chrono::steady_clock::now()});
+    }
+
+    // Adds a resource which was allocated ahead of time. It is not trimmed as idle before released.
+    void warm(std::size_t key, std::shared_ptr<T> item, std::chrono::steady_clock::time_point released)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        resident_ += item->size();
+        pooled_ += item->size();
+        free_[key].push_back(entry{std::move(item), released});
+    }
+
+    // Evicts resources which have been idle for longer than max_idle and then, oldest first, until no more than
+    // ceiling bytes are resident. The evicted resources are returned so that the caller can release them on the
+    // device thread.
+    std::vector<std::shared_ptr<T>> trim(std::size_t ceiling, std::chrono::steady_clock::duration max_idle)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::vector<std::shared_ptr<T>> evicted;
+
+        auto evict = [&](entry& e) {
+            resident_ -= e.item->size();
+            pooled_ -= e.item->size();
+            ++evictions_;
+            evicted.push_back(std::move(e.item));
+        };
+
+        auto now = std::chrono::steady_clock::now();
+        for (auto& p : free_) {
+            auto& entries = p.second;
+            auto  end     = std::find_if(
+                entries.begin(), entries.end(), [&](const entry& e) { return now - e.released < max_idle; });
+            std::for_each(entries.begin(), end, evict);
+            entries.erase(entries.begin(), end);
+        }
+
+        while (ceiling > 0 && resident_ > ceiling && pooled_ > 0) {
+            std::vector<entry>* oldest = nullptr;
+            for (auto& p : free_) {
+                if (!p.second.empty() && (!oldest || p.second.front().released < oldest->front().released)) {
+                    oldest = &p.second;
+                }
+            }
+            evict(oldest->front());
+            oldest->erase(oldest->begin());
+        }
+
+        for (auto it = free_.begin(); it != free_.end();) {
+            it = it->second.empty() ? free_.erase(it) : std::next(it);
+        }
+
+        return evicted;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.clear();
+    }
+
+    std::size_t resident() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return resident_;
+    }
+
+    std::unordered_map<std::size_t, std::size_t> high_water() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return high_water_;
+    }
+
+    void stats(core::monitor::state& state, const std::string& name) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        state["pool"][name]["hits"]      = static_cast<std::int64_t>(hits_);
+        state["pool"][name]["misses"]    = static_cast<std::int64_t>(misses_);
+        state["pool"][name]["evictions"] = static_cast<std::int64_t>(evictions_);
+        state["pool"][name]["resident"]  = static_cast<std::int64_t>(resident_);
+        state["pool"][name]["pooled"]    = static_cast<std::int64_t>(pooled_);
+    }
+};
+
+// Buffers are pooled by size class rather than by exact size, so that producers of slightly different sizes share
+// buffers. Classes are spaced an eighth of a power of two apart, which bounds the waste to 12.5%.
+std::size_t buffer_size_class(std::size_t size)
+{
+    std::size_t step = 4096;
+    while (step * 16 <= size) {
+        step *= 2;
+    }
+    return (size + step - 1) / step * step;
+}
+
+// Uploads are written to slices of one large persistent mapped buffer instead of to buffers of their own, so that
+// images of any size share the same GL object. Released slices are returned once the next readback fence has passed,
+// like pooled buffers. Slices are taken from the first free range at or after the end of the previous one, which
+// reuses the oldest released ranges first and leaves the gpu the most time to finish reading them.
+class upload_ring
+{
+    // Slices start at offsets which are valid for any pixel type, and for the row alignment of every upload.
+    static const std::size_t alignment = 256;
+
+    std::shared_ptr<buffer>            buffer_;
+    mutable std::mutex                 mutex_;
+    std::map<std::size_t, std::size_t> free_; // size by offset
+    std::size_t                        cursor_ = 0;
+    std::size_t                        used_   = 0;
+    std::uint64_t                      hits_   = 0;
+    std::uint64_t                      misses_ = 0;
+
+  public:
+    explicit upload_ring(std::shared_ptr<buffer> buffer)
+        : buffer_(std::move(buffer))
+    {
+        free_[0] = static_cast<std::size_t>(buffer_->size());
+    }
+
+    // A slice of size bytes, or null when no free range is large enough.
+    std::shared_ptr<buffer> allocate(std::size_t size)
+    {
+        auto aligned = (size + alignment - 1) / alignment * alignment;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto fits = [&](const std::pair<const std::size_t, std::size_t>& range) { return range.second >= aligned; };
+
+        auto start = free_.lower_bound(cursor_);
+        auto it    = std::find_if(start, free_.end(), fits);
+        if (it == free_.end()) {
+            it = std::find_if(free_.begin(), start, fits);
+            if (it == start) {
+                ++misses_;
+                return nullptr;
+            }
+        }
+
+        auto offset = it->first;
+        auto rest   = it->second - aligned;
+        free_.erase(it);
+        if (rest > 0) {
+            free_[offset + aligned] = rest;
+        }
+
+        cursor_ = offset + aligned;
+        used_ += aligned;
+        ++hits_;
+
+        return std::make_shared<buffer>(buffer_, static_cast<int>(offset), static_cast<int>(aligned));
+    }
+
+    bool owns(const buffer& slice) const { return slice.id() == buffer_->id(); }
+
+    void release(const buffer& slice)
+    {
+        auto offset = static_cast<std::size_t>(slice.offset());
+        auto size   = static_cast<std::size_t>(slice.size());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        used_ -= size;
+
+        auto it = free_.emplace(offset, size).first;
+
+        auto next = std::next(it);
+        if (next != free_.end() && it->first + it->second == next->first) {
+            it->second += next->second;
+            free_.erase(next);
+        }
+
+        if (it != free_.begin()) {
+            auto prev = std::prev(it);
+            if (prev->first + prev->second == it->first) {
+                prev->second += it->second;
+                free_.erase(it);
+            }
+        }
+    }
+
+    void stats(core::monitor::state& state) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        state["pool"]["upload-ring"]["hits"]     = static_cast<std::int64_t>(hits_);
+        state["pool"]["upload-ring"]["misses"]   = static_cast<std::int64_t>(misses_);
+        state["pool"]["upload-ring"]["resident"] = static_cast<std::int64_t>(buffer_->size());
+        state["pool"]["upload-ring"]["used"]     = static_cast<std::int64_t>(used_);
+        state["pool"]["upload-ring"]["ranges"]   = static_cast<std::int64_t>(free_.size());
+    }
+};
+
+// Storage of arrays created by a device, identifying the device so that other devices do not use its buffers.
+struct device_buffer
+{
+    std::shared_ptr<buffer> buf;
+    const void*             owner;
+};
+
+// Storage of arrays read back by a device, which keeps the source texture so that it can be drawn directly.
+struct readback_buffer
+{
+    std::shared_ptr<buffer>  buf;
+    std::shared_ptr<texture> source;
+    const void*              owner;
+};
+
+// Storage of arrays which have not been read back yet, see device::copy_deferred. The fence is signaled once the
+// source texture has been drawn, so that other contexts can wait for it before drawing the texture themselves.
+struct deferred_readback final : public core::deferred_image
+{
+    std::shared_ptr<device>  ogl;
+    std::shared_ptr<texture> source;
+    GLsync                   fence = nullptr;
+
+    ~deferred_readback() override
+    {
+        ogl->dispatch_async([fence = fence] { glDeleteSync(fence); });
+    }
+
+    array<const uint8_t> read_back() override { return ogl->copy_async(source).get(); }
+};
+
+#ifdef _WIN32
+// Opens Direct3D 11 textures shared by other apis, e.g. CEF, and registers them with the GL context of a worker through
+// WGL_NV_DX_interop2. Registrations are kept, since producers cycle through a few shared textures.
+class d3d_interop
+{
+    struct object
+    {
+        ID3D11Texture2D* texture = nullptr;
+        GLuint           name    = 0;
+        HANDLE           handle  = nullptr;
+    };
+
+    ID3D11Device*                     device_    = nullptr;
+    HANDLE                            gl_device_ = nullptr;
+    std::unordered_map<void*, object> objects_;
+
+  public:
+    d3d_interop()
+    {
+        if (!WGLEW_NV_DX_interop2) {
+            CASPAR_THROW_EXCEPTION(not_supported() << msg_info("WGL_NV_DX_interop2 is not supported."));
+        }
+
+        auto result = D3D11CreateDevice(
+            nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION, &device_, nullptr, nullptr);
+        if (FAILED(result)) {
+            CASPAR_THROW_EXCEPTION(not_supported() << msg_info("Failed to create Direct3D 11 device."));
+        }
+
+        gl_device_ = wglDXOpenDeviceNV(device_);
+        if (!gl_device_) {
+            device_->Release();
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to open Direct3D 11 device for interop."));
+        }
+    }
+
+    ~d3d_interop()
+    {
+        for (auto& p : objects_) {
+            release(p.second);
+        }
+        wglDXCloseDeviceNV(gl_device_);
+        device_->Release();
+    }
+
+    d3d_interop(const d3d_interop&) = delete;
+    d3d_interop& operator=(const d3d_interop&) = delete;
+
+    void copy(void* shared_handle, texture& dest)
+    {
+        auto& obj = open(shared_handle);
+
+        if (!wglDXLockObjectsNV(gl_device_, 1, &obj.handle)) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to lock shared texture."));
+        }
+        GL(glCopyImageSubData(
+            obj.name, GL_TEXTURE_2D, 0, 0, 0, 0, dest.id(), GL_TEXTURE_2D, 0, 0, 0, 0, dest.width(), dest.height(), 1));
+        wglDXUnlockObjectsNV(gl_device_, 1, &obj.handle);
+    }
+
+  private:
+    object& open(void* shared_handle)
+    {
+        auto it = objects_.find(shared_handle);
+        if (it != objects_.end()) {
+            return it->second;
+        }
+
+        // NOTE: Handles of textures which have been released by their owner are not reported, so the registrations of
+        // producers which resized or closed are dropped once there are more than any producer uses at once.
+        if (objects_.size() > 16) {
+            for (auto& p : objects_) {
+                release(p.second);
+            }
+            objects_.clear();
+        }
+
+        object obj;
+        if (FAILED(device_->OpenSharedResource(static_cast<HANDLE>(shared_handle),
+                                               __uuidof(ID3D11Texture2D),
+                                               reinterpret_cast<void**>(&obj.texture)))) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to open shared texture."));
+        }
+
+        GL(glGenTextures(1, &obj.name));
+        obj.handle = wglDXRegisterObjectNV(gl_device_, obj.texture, obj.name, GL_TEXTURE_2D, WGL_ACCESS_READ_ONLY_NV);
+        if (!obj.handle) {
+            release(obj);
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to register shared texture."));
+        }
+
+        return objects_.emplace(shared_handle, obj).first->second;
+    }
+
+    void release(object& obj)
+    {
+        if (obj.handle) {
+            wglDXUnregisterObjectNV(gl_device_, obj.handle);
+        }
+        glDeleteTextures(1, &obj.name);
+        obj.texture->Release();
+    }
+};
+#endif
+
 struct device::impl : public std::enable_shared_from_this<impl>
 {
-    typedef tbb::concurrent_bounded_queue<std::shared_ptr<texture>> texture_queue_t;
-    typedef tbb::concurrent_bounded_queue<std::shared_ptr<buffer>>  buffer_queue_t;
+    // A GL command thread with its own context, sharing objects with the contexts of the other workers. Container
+    // objects such as framebuffers and vertex arrays are not shared, so work which uses them has to stay on one worker.
+    struct worker
+    {
+        io_context                         service;
+        decltype(make_work_guard(service)) work;
+        ogl::context                       context;
+        GLuint                             fbo = 0;
+        std::atomic<int>                   pending{0};
+        std::thread                        thread;
+#ifdef _WIN32
+        std::unique_ptr<d3d_interop> interop;
+#endif
 
-    sf::Context device_;
+        worker(int index, const ogl::context& share)
+            : work(make_work_guard(service))
+            , context(index, &share)
+        {
+        }
+    };
+
+    const int index_;
+
+    std::vector<std::unique_ptr<worker>> workers_;
+    std::vector<std::string>             queue_names_;
+    context                              fence_context_;
 
-    std::array<tbb::concurrent_unordered_map<size_t, texture_queue_t>, 4> device_pools_;
-    std::array<tbb::concurrent_unordered_map<size_t, buffer_queue_t>, 2>  host_pools_;
+    resource_pool<texture>                device_pool_;
+    std::array<resource_pool<buffer>, 2> host_pools_;
+    std::unique_ptr<upload_ring>         upload_ring_;
 
     typedef tbb::concurrent_bounded_queue<std::shared_ptr<buffer>> sync_queue_t;
 
     sync_queue_t sync_queue_;
 
-    GLuint fbo_;
-
     std::wstring version_;
 
-    io_context                          service_;
-    decltype(make_work_guard(service_)) work_;
-    std::thread                         thread_;
+    const std::size_t                         pool_ceiling_;
+    const std::chrono::steady_clock::duration pool_max_idle_;
+    std::unique_ptr<deadline_timer>           trim_timer_;
+    int                                       trim_count_ = 0; // Only used by the trim timer.
 
-    impl()
-        : work_(make_work_guard(service_))
-        , device_(sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core), 1, 1)
-    {
-        CASPAR_LOG(info) << L"Initializing OpenGL Device.";
+    // High-water marks of the pools are saved and allocated ahead of time on the next start, see warm.
+    typedef std::map<std::pair<std::string, std::size_t>, std::size_t> levels_t;
 
-        device_.setActive(true);
+    const std::chrono::minutes                  pool_warmup_;
+    const std::chrono::steady_clock::time_point started_ = std::chrono::steady_clock::now();
+    levels_t                                    saved_levels_;
+    std::atomic<int>                            warming_{0};
 
-        if (glewInit() != GLEW_OK) {
-            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize GLEW."));
+    typedef std::pair<GLsync, std::function<void()>> fence_request_t;
+
+    tbb::concurrent_bounded_queue<fence_request_t> fence_queue_;
+    std::thread                                    fence_thread_;
+
+    spl::shared_ptr<diagnostics::graph> graph_;
+    const bool                          gpu_profile_;
+    std::mutex                          readback_mutex_;
+    std::vector<double>                 readback_times_;
+    std::size_t                         readback_count_ = 0;
+
+    impl(int index)
+        : index_(index)
+        , fence_context_(index, nullptr)
+        , pool_ceiling_(env::properties().get(L"configuration.ogl.pool-size", 0) * std::size_t(1024 * 1024))
+        , pool_max_idle_(std::chrono::seconds(env::properties().get(L"configuration.ogl.pool-idle", 30)))
+        , pool_warmup_(std::max(0, env::properties().get(L"configuration.ogl.pool-warmup", 0)))
+        , gpu_profile_(env::properties().get(L"configuration.ogl.gpu-profile", false))
+    {
+        CASPAR_LOG(info) << L"Initializing OpenGL Device " << index_ << L".";
+
+        auto threads  = std::max(1, env::properties().get(L"configuration.ogl.threads", 1));
+        auto affinity = env::properties().get(L"configuration.ogl.affinity", L"");
+        auto realtime = env::properties().get(L"configuration.ogl.realtime", false);
+        for (int n = 0; n < threads; ++n) {
+            workers_.push_back(std::make_unique<worker>(index, fence_context_));
+            queue_names_.push_back("queue-" + std::to_string(n));
         }
 
+        workers_[0]->context.set_active(true);
+        workers_[0]->context.init_glew();
+
         version_ = u16(reinterpret_cast<const char*>(GL2(glGetString(GL_VERSION)))) + L" " +
                    u16(reinterpret_cast<const char*>(GL2(glGetString(GL_VENDOR))));
 
-        CASPAR_LOG(info) << L"Initialized OpenGL " << version();
+        CASPAR_LOG(info) << L"Initialized OpenGL Device " << index_ << L": " << version() << L" ("
+                         << u16(reinterpret_cast<const char*>(GL2(glGetString(GL_RENDERER)))) << L")";
 
         if (!GLEW_VERSION_4_5 && !glewIsSupported("GL_ARB_sync GL_ARB_shader_objects GL_ARB_multitexture "
                                                   "GL_ARB_direct_state_access GL_ARB_texture_barrier")) {
@@ -96,102 +562,395 @@ struct device::impl : public std::enable_shared_from_this<impl>
                                                "since it does not support OpenGL 4.5 or higher."));
         }
 
-        GL(glCreateFramebuffers(1, &fbo_));
-        GL(glBindFramebuffer(GL_FRAMEBUFFER, fbo_));
+        // NOTE: The mapping of a buffer is visible to every context which shares it, so all workers write uploads to
+        // the same ring.
+        auto ring_size = std::min(2047, env::properties().get(L"configuration.ogl.upload-ring", 256));
+        if (ring_size > 0) {
+            upload_ring_ = std::make_unique<upload_ring>(std::make_shared<buffer>(ring_size * 1024 * 1024, true));
+        }
+
+        for (int n = 0; n < threads; ++n) {
+            auto& w = *workers_[n];
+
+            w.context.set_active(true);
+            GL(glCreateFramebuffers(1, &w.fbo));
+            GL(glBindFramebuffer(GL_FRAMEBUFFER, w.fbo));
+            w.context.set_active(false);
 
-        device_.setActive(false);
+            w.thread = std::thread([&w, n, affinity, realtime] {
+                w.context.set_active(true);
+                set_thread_name(n == 0 ? L"OpenGL Device" : L"OpenGL Device " + std::to_wstring(n));
+                set_thread_affinity(affinity);
+                if (realtime) {
+                    set_thread_realtime_priority();
+                }
+                w.service.run();
+#ifdef _WIN32
+                w.interop.reset();
+#endif
+                GL(glDeleteFramebuffers(1, &w.fbo));
+                w.context.set_active(false);
+            });
+        }
 
-        thread_ = std::thread([&] {
-            device_.setActive(true);
-            set_thread_name(L"OpenGL Device");
-            service_.run();
-            device_.setActive(false);
+        // Sync objects are shared between contexts, so readback fences can be waited upon from a dedicated
+        // thread which blocks in the driver instead of having the device thread poll them.
+        fence_thread_ = std::thread([&, affinity] {
+            fence_context_.set_active(true);
+            set_thread_name(L"OpenGL Fence");
+            set_thread_affinity(affinity);
+            while (true) {
+                fence_request_t request;
+                fence_queue_.pop(request);
+                if (!request.first) {
+                    break;
+                }
+                while (true) {
+                    auto wait = glClientWaitSync(request.first, 0, 100000000);
+                    if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED) {
+                        break;
+                    }
+                    if (wait == GL_WAIT_FAILED) {
+                        CASPAR_LOG(warning) << L"[ogl-device] Failed to wait for readback fence.";
+                        break;
+                    }
+                }
+                request.second();
+            }
+            fence_context_.set_active(false);
         });
+
+        graph_->set_color("readback-avg", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("readback-p99", diagnostics::color(0.9f, 0.6f, 0.2f));
+        for (auto& name : queue_names_) {
+            graph_->set_color(name, diagnostics::color(0.6f, 0.6f, 0.9f));
+        }
+        graph_->set_text(print());
+        diagnostics::register_graph(graph_);
+
+        trim_timer_ = std::make_unique<deadline_timer>(workers_[0]->service);
+        schedule_trim();
+
+        if (pool_warmup_.count() > 0) {
+            load_levels();
+            warm();
+        }
     }
 
     ~impl()
     {
-        work_.reset();
-        thread_.join();
+        if (pool_warmup_.count() > 0) {
+            save_levels();
+        }
+
+        post(workers_[0]->service, [this] { trim_timer_->cancel(); });
+        for (auto& w : workers_) {
+            w->work.reset();
+            w->thread.join();
+        }
+
+        fence_queue_.push(fence_request_t(nullptr, nullptr));
+        fence_thread_.join();
 
-        device_.setActive(true);
+        workers_[0]->context.set_active(true);
+
+        trim_timer_.reset();
 
         for (auto& pool : host_pools_)
             pool.clear();
 
-        for (auto& pool : device_pools_)
-            pool.clear();
+        device_pool_.clear();
 
         sync_queue_.clear();
 
-        GL(glDeleteFramebuffers(1, &fbo_));
+        upload_ring_.reset();
+    }
+
+    int worker_for(int channel_id) const
+    {
+        auto count = static_cast<int>(workers_.size());
+        return ((std::max(channel_id, 1) - 1) % count + count) % count;
     }
 
     template <typename Func>
-    auto spawn_async(Func&& func)
+    auto spawn_async(int w, Func&& func)
     {
         typedef decltype(func(std::declval<yield_context>()))  result_type;
         typedef std::packaged_task<result_type(yield_context)> task_type;
 
         auto task   = task_type(std::forward<Func>(func));
         auto future = task.get_future();
-        boost::asio::spawn(service_, std::move(task));
+        boost::asio::spawn(workers_[w]->service, std::move(task));
         return future;
     }
 
     template <typename Func>
-    auto dispatch_async(Func&& func)
+    auto dispatch_async(int w, Func&& func)
     {
         typedef decltype(func())                  result_type;
         typedef std::packaged_task<result_type()> task_type;
 
         auto task   = task_type(std::forward<Func>(func));
         auto future = task.get_future();
-        boost::asio::dispatch(service_, std::move(task));
+
+        ++workers_[w]->pending;
+        boost::asio::dispatch(workers_[w]->service, [this, w, task = std::move(task)]() mutable {
+            task();
+            graph_->set_value(queue_names_[w], --workers_[w]->pending / 8.0);
+        });
         return future;
     }
 
     template <typename Func>
-    auto dispatch_sync(Func&& func) -> decltype(func())
+    auto dispatch_sync(int w, Func&& func) -> decltype(func())
+    {
+        return dispatch_async(w, std::forward<Func>(func)).get();
+    }
+
+    // The queries of a profiler are deleted on its GL thread.
+    std::shared_ptr<gpu_profiler> create_profiler(int w, const std::string& name)
     {
-        return dispatch_async(std::forward<Func>(func)).get();
+        auto deleter = [self = std::weak_ptr<impl>(shared_from_this()), w](gpu_profiler* ptr) {
+            std::unique_ptr<gpu_profiler> profiler(ptr);
+            if (auto impl = self.lock()) {
+                impl->dispatch_async(w, [profiler = std::move(profiler)] { profiler->clear(); });
+            }
+        };
+        return std::shared_ptr<gpu_profiler>(new gpu_profiler(gpu_profile_, graph_, name), std::move(deleter));
     }
 
     std::wstring version() { return version_; }
 
-    std::shared_ptr<texture> create_texture(int width, int height, int stride, bool clear)
+    std::wstring print() const { return L"ogl-device[" + std::to_wstring(index_) + L"]"; }
+
+    void schedule_trim()
+    {
+        trim_timer_->expires_from_now(boost::posix_time::seconds(1));
+        trim_timer_->async_wait([this](const boost::system::error_code& ec) {
+            if (ec) {
+                return;
+            }
+
+            // The ceiling covers all pools, so each pool is trimmed to what remains after the others. Evicted
+            // resources are released here, on the device thread.
+            auto trim = [&](auto& pool) {
+                auto others = device_pool_.resident() + host_pools_[0].resident() + host_pools_[1].resident() -
+                              pool.resident();
+                auto ceiling = pool_ceiling_ == 0 ? 0 : pool_ceiling_ > others ? pool_ceiling_ - others : 1;
+                pool.trim(ceiling, pool_max_idle_);
+            };
+            trim(host_pools_[0]);
+            trim(host_pools_[1]);
+            trim(device_pool_);
+
+            if (pool_warmup_.count() > 0 && ++trim_count_ % 60 == 0) {
+                save_levels();
+            }
+
+            schedule_trim();
+        });
+    }
+
+    boost::filesystem::path levels_path() const
+    {
+        return boost::filesystem::path(env::data_folder()) / ("ogl-device-" + std::to_string(index_) + ".pools");
+    }
+
+    void load_levels()
+    {
+        boost::filesystem::ifstream file(levels_path());
+
+        std::string name;
+        std::size_t key   = 0;
+        std::size_t count = 0;
+        while (file >> name >> key >> count) {
+            saved_levels_[std::make_pair(name, key)] = count;
+        }
+    }
+
+    // Levels of resources which this run has not used are kept until it has run for an hour, so that a restart
+    // shortly before a show does not forget what the show needs.
+    void save_levels()
+    {
+        auto levels = std::chrono::steady_clock::now() - started_ < std::chrono::hours(1) ? saved_levels_ : levels_t();
+
+        auto collect = [&](const auto& pool, const std::string& name) {
+            for (auto& p : pool.high_water()) {
+                if (p.second > 0) {
+                    levels[std::make_pair(name, p.first)] = p.second;
+                }
+            }
+        };
+        collect(device_pool_, "texture");
+        collect(host_pools_[0], "read-buffer");
+        collect(host_pools_[1], "write-buffer");
+
+        try {
+            auto path = levels_path();
+            auto temp = path;
+            temp += ".tmp";
+            {
+                boost::filesystem::ofstream file(temp);
+                for (auto& level : levels) {
+                    file << level.first.first << " " << level.first.second << " " << level.second << "\n";
+                }
+            }
+            boost::filesystem::rename(temp, path);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    // Allocates the saved levels of textures and buffers, one at a time on the first worker so that frames rendered
+    // meanwhile are not held up, until the pool ceiling is reached. They are pooled as if released pool-warmup
+    // minutes from now, so that they are not trimmed as idle before the first show has had the time to use them.
+    void warm()
+    {
+        const auto released = std::chrono::steady_clock::now() + pool_warmup_;
+
+        std::size_t total = 0;
+        for (auto& level : saved_levels_) {
+            total += level.second;
+            for (std::size_t n = 0; n < level.second; ++n) {
+                ++warming_;
+                post(workers_[0]->service, [this, name = level.first.first, key = level.first.second, released] {
+                    CASPAR_SCOPE_EXIT { --warming_; };
+
+                    auto resident = device_pool_.resident() + host_pools_[0].resident() + host_pools_[1].resident();
+                    if (pool_ceiling_ > 0 && resident >= pool_ceiling_) {
+                        return;
+                    }
+
+                    try {
+                        if (name == "texture") {
+                            // See create_texture for the layout of the key.
+                            auto tex = std::make_shared<texture>(static_cast<int>(key >> 16 & 0xFFFF),
+                                                                 static_cast<int>(key & 0xFFFF),
+                                                                 static_cast<int>((key >> 32 & 0xF) + 1),
+                                                                 static_cast<int>((key >> 36 & 0x1) + 1),
+                                                                 (key >> 37 & 0x1) != 0,
+                                                                 (key >> 38 & 0x1) != 0);
+                            device_pool_.warm(key, std::move(tex), released);
+                        } else if (name == "read-buffer" || name == "write-buffer") {
+                            auto write = name == "write-buffer";
+                            auto buf   = std::make_shared<buffer>(static_cast<int>(key), write);
+                            host_pools_[static_cast<int>(write ? 1 : 0)].warm(key, std::move(buf), released);
+                        }
+                    } catch (...) {
+                        CASPAR_LOG_CURRENT_EXCEPTION();
+                    }
+                });
+            }
+        }
+
+        if (total > 0) {
+            CASPAR_LOG(info) << print() << L" Allocating " << total << L" pooled textures and buffers ahead of time.";
+        }
+    }
+
+    core::monitor::state state() const
+    {
+        core::monitor::state state;
+        state["pool"]["warming"] = warming_.load();
+        device_pool_.stats(state, "texture");
+        host_pools_[0].stats(state, "read-buffer");
+        host_pools_[1].stats(state, "write-buffer");
+        if (upload_ring_) {
+            upload_ring_->stats(state);
+        }
+        return state;
+    }
+
+    void record_readback(double elapsed_ms)
+    {
+        static const std::size_t history = 256;
+
+        std::lock_guard<std::mutex> lock(readback_mutex_);
+
+        if (readback_times_.size() < history) {
+            readback_times_.push_back(elapsed_ms);
+        } else {
+            readback_times_[readback_count_ % history] = elapsed_ms;
+        }
+
+        if (++readback_count_ % 32 != 0) {
+            return;
+        }
+
+        auto sorted = readback_times_;
+        auto p99    = sorted.begin() + (sorted.size() * 99) / 100;
+        std::nth_element(sorted.begin(), p99, sorted.end());
+        auto avg = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+
+        // Scaled such that a full graph corresponds to 20 ms.
+        graph_->set_value("readback-avg", avg / 20.0);
+        graph_->set_value("readback-p99", *p99 / 20.0);
+        graph_->set_text(print() + L" [readback avg " + std::to_wstring(avg) + L" ms, p99 " + std::to_wstring(*p99) +
+                         L" ms]");
+    }
+
+    std::shared_ptr<texture> create_texture(
+        int width, int height, int stride, bool clear, int depth = 1, bool compressed = false, bool ten_bit = false)
     {
-        CASPAR_VERIFY(stride > 0 && stride < 5);
+        CASPAR_VERIFY(depth == 1 || depth == 2);
+        CASPAR_VERIFY(!ten_bit || (stride == 4 && depth == 1 && !compressed));
+        CASPAR_VERIFY(stride % depth == 0 && stride / depth > 0 && stride / depth < 5);
         CASPAR_VERIFY(width > 0 && height > 0);
 
-        // TODO (perf) Shared pool.
-        auto pool = &device_pools_[stride - 1][((width << 16) & 0xFFFF0000) | (height & 0x0000FFFF)];
+        // Textures are sampled and rendered at their full size, so they are only shared between identical sizes.
+        auto key = (ten_bit ? static_cast<std::size_t>(1) << 38 : 0) |
+                   (compressed ? static_cast<std::size_t>(1) << 37 : 0) | (static_cast<std::size_t>(depth - 1) << 36) |
+                   (static_cast<std::size_t>(stride - 1) << 32) | ((width << 16) & 0xFFFF0000) | (height & 0x0000FFFF);
 
-        std::shared_ptr<texture> tex;
-        if (!pool->try_pop(tex)) {
-            tex = std::make_shared<texture>(width, height, stride);
+        auto tex = device_pool_.pop(key);
+        if (!tex) {
+            tex = std::make_shared<texture>(width, height, stride, depth, compressed, ten_bit);
+            device_pool_.add(key, tex);
         }
 
+        // NOTE: Textures which are not cleared keep whatever they held, as before they were pooled.
         if (clear) {
-            tex->clear();
+            tex->invalidate();
+        } else {
+            tex->overwrite();
         }
 
         auto ptr = tex.get();
-        return std::shared_ptr<texture>(
-            ptr, [tex = std::move(tex), pool, self = shared_from_this()](texture*) mutable { pool->push(tex); });
+        return std::shared_ptr<texture>(ptr, [tex = std::move(tex), key, self = shared_from_this()](texture*) mutable {
+            self->device_pool_.push(key, std::move(tex));
+        });
     }
 
-    std::shared_ptr<buffer> create_buffer(int size, bool write)
+    std::shared_ptr<buffer> create_buffer(int w, int size, bool write)
     {
         CASPAR_VERIFY(size > 0);
 
-        // TODO (perf) Shared pool.
-        auto pool = &host_pools_[static_cast<int>(write ? 1 : 0)][size];
+        // NOTE: Uploads only fall back to pooled buffers of their own when the ring is full.
+        if (write && upload_ring_) {
+            if (auto slice = upload_ring_->allocate(size)) {
+                auto ptr = slice.get();
+                return std::shared_ptr<buffer>(
+                    ptr, [slice = std::move(slice), self = shared_from_this()](buffer*) mutable {
+                        self->sync_queue_.emplace(std::move(slice));
+                    });
+            }
+        }
 
-        std::shared_ptr<buffer> buf;
-        if (!pool->try_pop(buf)) {
-            // TODO (perf) Avoid blocking in create_array.
-            dispatch_sync([&] { buf = std::make_shared<buffer>(size, write); });
+        auto& pool       = host_pools_[static_cast<int>(write ? 1 : 0)];
+        auto  size_class = buffer_size_class(size);
+
+        auto buf = pool.pop(size_class);
+        if (!buf) {
+            dispatch_sync(w, [&] { buf = std::make_shared<buffer>(static_cast<int>(size_class), write); });
+            pool.add(size_class, buf);
+
+            // A miss usually means that more buffers of this size are about to be needed, so allocate a spare ahead
+            // of time rather than blocking the next caller as well.
+            dispatch_async(w, [=, &pool] {
+                auto spare = std::make_shared<buffer>(static_cast<int>(size_class), write);
+                pool.add(size_class, spare);
+                pool.push(size_class, std::move(spare));
+            });
         }
 
         auto ptr = buf.get();
@@ -200,95 +959,291 @@ struct device::impl : public std::enable_shared_from_this<impl>
         });
     }
 
-    array<uint8_t> create_array(int size)
+    array<uint8_t> create_array(int w, int size)
     {
-        auto buf = create_buffer(size, true);
+        auto buf = create_buffer(w, size, true);
         auto ptr = reinterpret_cast<uint8_t*>(buf->data());
-        return array<uint8_t>(ptr, buf->size(), buf);
+        return array<uint8_t>(ptr, size, device_buffer{std::move(buf), this});
     }
 
-    std::future<std::shared_ptr<texture>>
-    copy_async(const array<const uint8_t>& source, int width, int height, int stride)
+    std::future<std::shared_ptr<texture>> copy_async(int                                  w,
+                                                     const std::shared_ptr<gpu_profiler>& profiler,
+                                                     const array<const uint8_t>&          source,
+                                                     int                                  width,
+                                                     int                                  height,
+                                                     int                                  stride,
+                                                     int                                  depth,
+                                                     bool                                 compressed)
     {
-        return dispatch_async([=] {
-            std::shared_ptr<buffer> buf;
+        // NOTE: Images which this device has read back, e.g. the output of another channel, are drawn from the texture
+        // they were read from.
+        auto readback = source.template storage<readback_buffer>();
+        if (readback && readback->owner == this && readback->source->width() == width &&
+            readback->source->height() == height && readback->source->stride() == stride &&
+            readback->source->depth() == depth && !compressed) {
+            return make_ready_future(readback->source);
+        }
+
+        std::shared_ptr<buffer> buf;
 
-            auto tmp = source.template storage<std::shared_ptr<buffer>>();
-            if (tmp) {
-                buf = *tmp;
-            } else {
-                buf = create_buffer(static_cast<int>(source.size()), true);
-                // TODO (perf) Copy inside a TBB worker.
-                std::memcpy(buf->data(), source.data(), source.size());
+        // Arrays of other devices are copied through host memory, since their buffers are not shared. The copy is
+        // done by the caller and TBB workers, so that the GL thread only has to issue the upload.
+        auto tmp = source.template storage<device_buffer>();
+        if (tmp && tmp->owner == this) {
+            buf = tmp->buf;
+        } else {
+            buf = create_buffer(w, static_cast<int>(source.size()), true);
+            parallel_memcpy(buf->data(), source.data(), source.size());
+        }
+
+        return dispatch_async(w, [=, trace_frame = caspar::diagnostics::trace::current_frame()] {
+            caspar::diagnostics::trace::scope traced("device::copy_async upload", trace_frame);
+
+            auto tex = create_texture(width, height, stride, false, depth, compressed);
+            {
+                auto timed = profiler->time("upload");
+                tex->copy_from(*buf);
+            }
+
+            // Uploaded textures may be drawn by channels on other GL threads, whose contexts only see the upload
+            // once it has completed.
+            if (workers_.size() > 1) {
+                auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(fence);
             }
 
-            auto tex = create_texture(width, height, stride, false);
-            tex->copy_from(*buf);
-            // TODO (perf) save tex on source
             return tex;
         });
     }
 
-    std::future<array<const uint8_t>> copy_async(const std::shared_ptr<texture>& source)
+    std::future<std::shared_ptr<texture>> copy_async(int                                                 w,
+                                                     const std::shared_ptr<gpu_profiler>&                profiler,
+                                                     const array<const uint8_t>&                         source,
+                                                     const std::shared_future<std::shared_ptr<texture>>& base,
+                                                     const std::vector<core::frame_region>&              regions)
     {
-        return spawn_async([=](yield_context yield) {
-            auto buf = create_buffer(source->size(), false);
-            source->copy_to(*buf);
+        std::shared_ptr<buffer> buf;
 
-            sync_queue_.push(nullptr);
+        auto tmp = source.template storage<device_buffer>();
+        if (tmp && tmp->owner == this) {
+            buf = tmp->buf;
+        } else {
+            buf = create_buffer(w, static_cast<int>(source.size()), true);
+            parallel_memcpy(buf->data(), source.data(), source.size());
+        }
 
-            auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        return dispatch_async(w, [=] {
+            auto src = base.get();
+            auto tex = create_texture(src->width(), src->height(), src->stride(), false, src->depth());
+            {
+                auto timed = profiler->time("upload");
+                tex->copy_from(*src);
 
-            GL(glFlush());
+                for (auto& region : regions) {
+                    auto x0 = std::max(0, region.x);
+                    auto y0 = std::max(0, region.y);
+                    auto x1 = std::min(tex->width(), region.x + region.width);
+                    auto y1 = std::min(tex->height(), region.y + region.height);
+                    if (x1 > x0 && y1 > y0) {
+                        tex->copy_from(*buf, x0, y0, x1 - x0, y1 - y0);
+                    }
+                }
+            }
 
-            deadline_timer timer(service_);
-            for (auto n = 0; true; ++n) {
-                // TODO (perf) Smarter non-polling solution?
-                timer.expires_from_now(boost::posix_time::milliseconds(2));
-                timer.async_wait(yield);
+            if (workers_.size() > 1) {
+                auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(fence);
+            }
 
-                auto wait = glClientWaitSync(fence, 0, 1);
-                if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED) {
-                    break;
+            return tex;
+        });
+    }
+
+    std::shared_ptr<texture> import_texture(int w, void* shared_handle, int width, int height)
+    {
+#ifdef _WIN32
+        return dispatch_sync(w, [&] {
+            auto& worker = *workers_[w];
+            if (!worker.interop) {
+                worker.interop = std::make_unique<d3d_interop>();
+            }
+
+            auto tex = create_texture(width, height, 4, false);
+            worker.interop->copy(shared_handle, *tex);
+
+            if (workers_.size() > 1) {
+                auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(fence);
+            }
+
+            return tex;
+        });
+#else
+        CASPAR_THROW_EXCEPTION(not_supported() << msg_info("Shared textures are only supported on Windows."));
+#endif
+    }
+
+    std::future<void> prepare(int w, int width, int height, bool ten_bit)
+    {
+        // NOTE: Enough for the target, a layer and a key of a few frames in flight. They are held at once so that
+        // each is allocated rather than the first being reused, and are then pooled until they are needed or idle.
+        static const int frames = 3;
+
+        return dispatch_async(w, [=] {
+            std::vector<std::shared_ptr<texture>> textures;
+            std::vector<std::shared_ptr<buffer>>  buffers;
+            for (int n = 0; n < frames; ++n) {
+                textures.push_back(create_texture(width, height, 4, false, 1, false, ten_bit));
+                textures.push_back(create_texture(width, height, 4, false));
+                textures.push_back(create_texture(width, height, 1, false));
+                buffers.push_back(create_buffer(w, width * height * 4, false));
+            }
+        });
+    }
+
+    std::future<array<const uint8_t>>
+    copy_async(int w, const std::shared_ptr<gpu_profiler>& profiler, const std::shared_ptr<texture>& source)
+    {
+        return spawn_async(w, [=, trace_frame = caspar::diagnostics::trace::current_frame()](yield_context yield) {
+            // NOTE: Other coroutines run on the thread while this one waits for the fence, so the wait is marked by
+            // an instant event when it ends instead of a scope.
+            std::shared_ptr<buffer> buf;
+            {
+                caspar::diagnostics::trace::scope traced("device::copy_async readback", trace_frame);
+
+                buf = create_buffer(w, source->size(), false);
+                {
+                    auto timed = profiler->time("readback");
+                    source->copy_to(*buf);
                 }
+
+                sync_queue_.push(nullptr);
             }
 
+            auto start = std::chrono::high_resolution_clock::now();
+            auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            GL(glFlush());
+
+            // Suspend until the fence thread reports completion by cancelling the timer. The cancellation is
+            // posted, so it cannot run before this coroutine has yielded.
+            auto& service = workers_[w]->service;
+            auto  never   = boost::posix_time::ptime(boost::posix_time::pos_infin);
+            auto  timer   = std::make_shared<deadline_timer>(service, never);
+            fence_queue_.push(fence_request_t(fence, [&service, timer] { post(service, [timer] { timer->cancel(); }); }));
+
+            boost::system::error_code ec;
+            timer->async_wait(yield[ec]);
+
+            caspar::diagnostics::trace::instant("device::copy_async fence", trace_frame);
+
             glDeleteSync(fence);
 
+            record_readback(
+                std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+
             {
                 std::shared_ptr<buffer> buf2;
                 while (sync_queue_.try_pop(buf2) && buf2) {
-                    auto pool = &host_pools_[static_cast<int>(buf2->write() ? 1 : 0)][buf2->size()];
-                    pool->push(std::move(buf2));
+                    if (upload_ring_ && upload_ring_->owns(*buf2)) {
+                        upload_ring_->release(*buf2);
+                        continue;
+                    }
+                    auto& pool = host_pools_[static_cast<int>(buf2->write() ? 1 : 0)];
+                    pool.push(buf2->size(), std::move(buf2));
                 }
             }
 
             auto ptr  = reinterpret_cast<uint8_t*>(buf->data());
-            auto size = buf->size();
-            return array<const uint8_t>(ptr, size, std::move(buf));
+            auto size = source->size();
+            return array<const uint8_t>(ptr, size, readback_buffer{std::move(buf), source, this});
         });
     }
 };
 
-device::device()
-    : impl_(new impl())
+device::device(int index)
+    : impl_(new impl(index))
+    , profiler_(impl_->create_profiler(0, "gpu"))
+{
+}
+device::device(std::shared_ptr<impl> impl, int worker, std::shared_ptr<gpu_profiler> profiler)
+    : impl_(std::move(impl))
+    , worker_(worker)
+    , profiler_(std::move(profiler))
 {
 }
 device::~device() {}
-std::shared_ptr<texture> device::create_texture(int width, int height, int stride)
+std::shared_ptr<device> device::for_channel(int channel_id)
 {
-    return impl_->create_texture(width, height, stride, true);
+    auto worker = impl_->worker_for(channel_id);
+    return std::shared_ptr<device>(
+        new device(impl_, worker, impl_->create_profiler(worker, "gpu-" + std::to_string(channel_id))));
 }
-array<uint8_t> device::create_array(int size) { return impl_->create_array(size); }
-std::future<std::shared_ptr<texture>>
-device::copy_async(const array<const uint8_t>& source, int width, int height, int stride)
+std::shared_ptr<texture>
+device::create_texture(int width, int height, int stride, bool clear, int depth, bool compressed, bool ten_bit)
 {
-    return impl_->copy_async(source, width, height, stride);
+    return impl_->create_texture(width, height, stride, clear, depth, compressed, ten_bit);
+}
+array<uint8_t> device::create_array(int size) { return impl_->create_array(worker_, size); }
+std::future<std::shared_ptr<texture>> device::copy_async(
+    const array<const uint8_t>& source, int width, int height, int stride, int depth, bool compressed)
+{
+    return impl_->copy_async(worker_, profiler_, source, width, height, stride, depth, compressed);
 }
 std::future<array<const uint8_t>> device::copy_async(const std::shared_ptr<texture>& source)
 {
-    return impl_->copy_async(source);
+    return impl_->copy_async(worker_, profiler_, source);
+}
+std::future<std::shared_ptr<texture>> device::copy_async(const array<const uint8_t>&                         source,
+                                                        const std::shared_future<std::shared_ptr<texture>>& base,
+                                                        const std::vector<core::frame_region>&              regions)
+{
+    return impl_->copy_async(worker_, profiler_, source, base, regions);
+}
+array<const uint8_t> device::copy_deferred(const std::shared_ptr<texture>& source)
+{
+    auto readback    = std::make_shared<deferred_readback>();
+    readback->ogl    = std::shared_ptr<device>(new device(impl_, worker_, profiler_));
+    readback->source = source;
+    readback->fence  = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    GL(glFlush());
+
+    return array<const uint8_t>(nullptr, source->size(), std::shared_ptr<core::deferred_image>(std::move(readback)));
+}
+std::shared_ptr<texture> device::import_texture(void* shared_handle, int width, int height)
+{
+    return impl_->import_texture(worker_, shared_handle, width, height);
+}
+std::future<void> device::prepare(int width, int height, bool ten_bit)
+{
+    return impl_->prepare(worker_, width, height, ten_bit);
+}
+void device::dispatch(std::function<void()> func)
+{
+    boost::asio::dispatch(impl_->workers_[worker_]->service, std::move(func));
+}
+std::wstring         device::version() const { return impl_->version(); }
+int                  device::index() const { return impl_->index_; }
+const void*          device::id() const { return impl_.get(); }
+core::monitor::state device::state() const { return impl_->state(); }
+gpu_profiler&        device::profiler() { return *profiler_; }
+
+std::shared_ptr<texture> readback_texture(const array<const uint8_t>& image)
+{
+    auto storage = image.storage<readback_buffer>();
+    if (storage) {
+        return storage->source;
+    }
+
+    auto deferred = image.storage<std::shared_ptr<core::deferred_image>>();
+    auto readback = deferred ? dynamic_cast<deferred_readback*>(deferred->get()) : nullptr;
+    if (readback) {
+        GL(glWaitSync(readback->fence, 0, GL_TIMEOUT_IGNORED));
+        return readback->source;
+    }
+    return nullptr;
 }
-void         device::dispatch(std::function<void()> func) { boost::asio::dispatch(impl_->service_, std::move(func)); }
-std::wstring device::version() const { return impl_->version(); }
 }}} // namespace caspar::accelerator::ogl
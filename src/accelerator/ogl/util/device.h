@@ -23,28 +23,63 @@
 
 #include <common/array.h>
 
+#include <core/frame/frame_factory.h>
+#include <core/monitor/monitor.h>
+
 #include <functional>
 #include <future>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
 class device final : public std::enable_shared_from_this<device>
 {
   public:
-    device();
+    explicit device(int index = 0);
     ~device();
 
     device(const device&) = delete;
 
     device& operator=(const device&) = delete;
 
-    std::shared_ptr<class texture> create_texture(int width, int height, int stride);
-    array<uint8_t>                 create_array(int size);
+    // A handle to the same device, and so the same objects and pools, which submits its work to the GL thread
+    // assigned to the channel. Work of one channel stays on one thread, as some GL objects are per context.
+    std::shared_ptr<device> for_channel(int channel_id);
 
-    std::future<std::shared_ptr<class texture>>
-                                      copy_async(const array<const uint8_t>& source, int width, int height, int stride);
+    // Textures of stride bytes per texel, where depth is the bytes per channel, or of DXT5 blocks if compressed. See
+    // texture. Cleared textures are invalidated, and only cleared once they are read before being overwritten as a
+    // whole, see texture::invalidate. Ten bit textures are bgra textures stored as RGB10_A2.
+    std::shared_ptr<class texture> create_texture(int  width,
+                                                  int  height,
+                                                  int  stride,
+                                                  bool clear      = true,
+                                                  int  depth      = 1,
+                                                  bool compressed = false,
+                                                  bool ten_bit    = false);
+    array<uint8_t> create_array(int size);
+
+    std::future<std::shared_ptr<class texture>> copy_async(
+        const array<const uint8_t>& source, int width, int height, int stride, int depth = 1, bool compressed = false);
     std::future<array<const uint8_t>> copy_async(const std::shared_ptr<class texture>& source);
 
+    // An array of source without data, which is only read back once it is read from a frame, see
+    // core::deferred_image. Must be called on the GL thread after source has been drawn.
+    array<const uint8_t> copy_deferred(const std::shared_ptr<class texture>& source);
+
+    // Uploads only the regions of source on top of a copy of base, which holds the rest of the image.
+    std::future<std::shared_ptr<class texture>>
+    copy_async(const array<const uint8_t>&                               source,
+               const std::shared_future<std::shared_ptr<class texture>>& base,
+               const std::vector<core::frame_region>&                    regions);
+
+    // Copies a bgra texture which another api shares through shared_handle, the DXGI handle of a Direct3D 11 texture
+    // on Windows. The copy has completed when this returns, so the owner may draw into the shared texture again.
+    std::shared_ptr<class texture> import_texture(void* shared_handle, int width, int height);
+
+    // Fills the pools with the textures and read back buffers which frames of width by height are rendered with,
+    // rendering into ten bit targets if ten_bit is set.
+    std::future<void> prepare(int width, int height, bool ten_bit = false);
+
     template <typename Func>
     auto dispatch_async(Func&& func)
     {
@@ -64,11 +99,34 @@ class device final : public std::enable_shared_from_this<device>
     }
 
     std::wstring version() const;
+    int          index() const;
+
+    // Identifies the device, handles of one device share the same id.
+    const void* id() const;
+
+    // Hits, misses, evictions and resident bytes of the texture and buffer pools.
+    core::monitor::state state() const;
+
+    // Times the gpu work of this handle, e.g. of the channel it is for, see gpu_profiler. Only used on the GL thread,
+    // apart from gpu_profiler::state.
+    class gpu_profiler& profiler();
 
   private:
-    void dispatch(std::function<void()> func);
     struct impl;
-    std::shared_ptr<impl> impl_;
+
+    device(std::shared_ptr<impl> impl, int worker, std::shared_ptr<class gpu_profiler> profiler);
+
+    void dispatch(std::function<void()> func);
+
+    std::shared_ptr<impl>               impl_;
+    int                                 worker_ = 0;
+    std::shared_ptr<class gpu_profiler> profiler_;
 };
 
+// The texture which an image was read back from by a device, or null. OpenGL contexts created by SFML share objects
+// with the device, so a consumer which renders in the same process can draw it instead of uploading the image again.
+// The texture is not reused by the device while the image is alive. Images which have not been read back yet, see
+// device::copy_deferred, make the current context wait on the gpu until the texture has been drawn.
+std::shared_ptr<class texture> readback_texture(const array<const uint8_t>& image);
+
 }}} // namespace caspar::accelerator::ogl
\ No newline at end of file
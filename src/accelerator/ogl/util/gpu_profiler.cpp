@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gpu_profiler.h"
+
+#include <common/gl/gl_check.h>
+
+#include <GL/glew.h>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// NOTE: Frames are read once their queries have finished, or once this many are waiting, which then waits for the
+// oldest.
+static const std::size_t MAX_PENDING = 4;
+
+gpu_profiler::scope::scope(gpu_profiler* profiler, std::size_t sample)
+    : profiler_(profiler)
+    , sample_(sample)
+{
+}
+
+gpu_profiler::scope::scope(scope&& other)
+    : profiler_(other.profiler_)
+    , sample_(other.sample_)
+{
+    other.profiler_ = nullptr;
+}
+
+gpu_profiler::scope::~scope()
+{
+    if (profiler_) {
+        GL(glQueryCounter(profiler_->frame_[sample_].end, GL_TIMESTAMP));
+    }
+}
+
+gpu_profiler::gpu_profiler(bool enabled, spl::shared_ptr<diagnostics::graph> graph, std::string name)
+    : enabled_(enabled)
+    , graph_(std::move(graph))
+    , name_(std::move(name))
+{
+    if (enabled_) {
+        graph_->set_color(name_, diagnostics::color(0.9f, 0.3f, 0.9f));
+    }
+}
+
+gpu_profiler::~gpu_profiler() {}
+
+gpu_profiler::scope gpu_profiler::time(const std::string& category)
+{
+    if (!enabled_) {
+        return scope();
+    }
+
+    auto it = category_ids_.find(category);
+    if (it == category_ids_.end()) {
+        it = category_ids_.emplace(category, static_cast<std::uint32_t>(categories_.size())).first;
+        categories_.push_back(category);
+    }
+
+    frame_.push_back(sample{it->second, create_query(), create_query()});
+    GL(glQueryCounter(frame_.back().begin, GL_TIMESTAMP));
+    return scope(this, frame_.size() - 1);
+}
+
+void gpu_profiler::end_frame()
+{
+    if (!enabled_) {
+        return;
+    }
+
+    pending_.push_back(std::move(frame_));
+    frame_.clear();
+    read();
+}
+
+void gpu_profiler::clear()
+{
+    auto queries = std::move(free_queries_);
+    for (auto& frame : pending_) {
+        for (auto& sample : frame) {
+            queries.push_back(sample.begin);
+            queries.push_back(sample.end);
+        }
+    }
+    for (auto& sample : frame_) {
+        queries.push_back(sample.begin);
+        queries.push_back(sample.end);
+    }
+    pending_.clear();
+    frame_.clear();
+
+    if (!queries.empty()) {
+        GL(glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data()));
+    }
+}
+
+core::monitor::state gpu_profiler::state() const
+{
+    std::lock_guard<std::mutex> lock(times_mutex_);
+
+    core::monitor::state state;
+    for (auto& time : times_) {
+        state["profile"]["gpu"][time.first] = time.second;
+    }
+    return state;
+}
+
+unsigned int gpu_profiler::create_query()
+{
+    GLuint query = 0;
+    if (free_queries_.empty()) {
+        GL(glGenQueries(1, &query));
+    } else {
+        query = free_queries_.back();
+        free_queries_.pop_back();
+    }
+    return query;
+}
+
+void gpu_profiler::read()
+{
+    while (!pending_.empty()) {
+        auto& frame = pending_.front();
+
+        // NOTE: Queries finish in the order they were issued, so a frame has finished once its last query has.
+        if (!frame.empty() && pending_.size() < MAX_PENDING) {
+            GLint available = 0;
+            GL(glGetQueryObjectiv(frame.back().end, GL_QUERY_RESULT_AVAILABLE, &available));
+            if (!available) {
+                return;
+            }
+        }
+
+        std::vector<double> totals(categories_.size());
+        for (auto& sample : frame) {
+            GLuint64 begin = 0;
+            GLuint64 end   = 0;
+            GL(glGetQueryObjectui64v(sample.begin, GL_QUERY_RESULT, &begin));
+            GL(glGetQueryObjectui64v(sample.end, GL_QUERY_RESULT, &end));
+            totals[sample.category] += end > begin ? static_cast<double>(end - begin) / 1000000.0 : 0.0;
+
+            free_queries_.push_back(sample.begin);
+            free_queries_.push_back(sample.end);
+        }
+        pending_.pop_front();
+
+        std::map<std::string, double> times;
+        auto                          total = 0.0;
+        for (std::size_t n = 0; n < categories_.size(); ++n) {
+            times[categories_[n]] = totals[n];
+            total += totals[n];
+        }
+        times["total"] = total;
+
+        // Scaled such that a full graph corresponds to 20 ms.
+        graph_->set_value(name_, total / 20.0);
+
+        std::lock_guard<std::mutex> lock(times_mutex_);
+        times_ = std::move(times);
+    }
+}
+
+}}} // namespace caspar::accelerator::ogl
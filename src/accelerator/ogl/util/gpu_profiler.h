@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/diagnostics/graph.h>
+#include <common/memory.h>
+
+#include <core/monitor/monitor.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Times the work of one channel on the gpu with pairs of GL_TIMESTAMP queries, which are read a few frames later so
+// that nothing waits for the gpu. Only used on the GL thread of the channel, apart from state.
+class gpu_profiler final
+{
+  public:
+    // Times the gpu work submitted on the thread while it is alive.
+    class scope final
+    {
+        gpu_profiler* profiler_ = nullptr;
+        std::size_t   sample_   = 0;
+
+      public:
+        scope() = default;
+        scope(gpu_profiler* profiler, std::size_t sample);
+        scope(scope&& other);
+        ~scope();
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+    };
+
+    gpu_profiler(bool enabled, spl::shared_ptr<diagnostics::graph> graph, std::string name);
+    ~gpu_profiler();
+
+    gpu_profiler(const gpu_profiler&) = delete;
+    gpu_profiler& operator=(const gpu_profiler&) = delete;
+
+    // Categories are e.g. draw/<shader>, upload and readback.
+    scope time(const std::string& category);
+
+    // Ends the frame of the work timed so far. Frames whose queries have all finished are read.
+    void end_frame();
+
+    // Deletes the queries, must be called on the GL thread before the profiler is destroyed.
+    void clear();
+
+    // Milliseconds the gpu spent on each category in the last frame which has been read, under profile/gpu.
+    core::monitor::state state() const;
+
+  private:
+    struct sample
+    {
+        std::uint32_t category;
+        unsigned int  begin;
+        unsigned int  end;
+    };
+
+    unsigned int create_query();
+    void         read();
+
+    const bool                          enabled_;
+    spl::shared_ptr<diagnostics::graph> graph_;
+    const std::string                   name_;
+
+    std::vector<std::string>                       categories_;
+    std::unordered_map<std::string, std::uint32_t> category_ids_;
+    std::vector<sample>                            frame_;
+    std::deque<std::vector<sample>>                pending_;
+    std::vector<unsigned int>                      free_queries_;
+
+    mutable std::mutex            times_mutex_;
+    std::map<std::string, double> times_;
+};
+
+}}} // namespace caspar::accelerator::ogl
@@ -20,14 +20,60 @@
  */
 #include "shader.h"
 
+#include <common/env.h>
 #include <common/gl/gl_check.h>
+#include <common/log.h>
 
 #include <GL/glew.h>
 
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
+namespace {
+
+// The shaders of a program, by type and in the order they are attached.
+typedef std::vector<std::pair<GLenum, std::string>> stages_t;
+
+// Cached programs are named after a hash of the driver and the sources, so that a driver update or a changed shader
+// never loads a stale binary. The driver may still reject a binary, in which case the program is compiled again.
+boost::filesystem::path cache_path(const stages_t& stages)
+{
+    const auto& folder = env::shader_cache_folder();
+    if (folder.empty() || !GLEW_ARB_get_program_binary)
+        return boost::filesystem::path();
+
+    std::uint64_t hash   = 14695981039346656037ULL;
+    auto          append = [&](const char* str) {
+        for (; str && *str; ++str)
+            hash = (hash ^ static_cast<unsigned char>(*str)) * 1099511628211ULL;
+        hash = (hash ^ 0xFF) * 1099511628211ULL;
+    };
+
+    append(reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+    append(reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    append(reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+    for (auto& stage : stages)
+        append(stage.second.c_str());
+
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+
+    return boost::filesystem::path(folder) / name.str();
+}
+
+} // namespace
+
 struct shader::impl : boost::noncopyable
 {
     GLuint                                 program_;
@@ -35,54 +81,74 @@ struct shader::impl : boost::noncopyable
     std::unordered_map<std::string, GLint> attrib_locations_;
 
   public:
-    impl(const std::string& vertex_source_str, const std::string& fragment_source_str)
+    explicit impl(const stages_t& stages)
         : program_(0)
     {
-        GLint success;
+        auto cache_file = cache_path(stages);
 
-        const char* vertex_source = vertex_source_str.c_str();
+        if (cache_file.empty() || !load(cache_file)) {
+            compile(stages, !cache_file.empty());
 
-        auto vertex_shader = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
+            if (!cache_file.empty())
+                store(cache_file);
+        }
 
-        GL(glShaderSourceARB(vertex_shader, 1, &vertex_source, NULL));
-        GL(glCompileShaderARB(vertex_shader));
+        GL(glUseProgramObjectARB(program_));
 
-        GL(glGetObjectParameterivARB(vertex_shader, GL_OBJECT_COMPILE_STATUS_ARB, &success));
-        if (success == GL_FALSE) {
-            char info[2048];
-            GL(glGetInfoLogARB(vertex_shader, sizeof(info), 0, info));
-            GL(glDeleteObjectARB(vertex_shader));
-            std::stringstream str;
-            str << "Failed to compile vertex shader:" << std::endl << info << std::endl;
-            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(str.str()));
+        // Resolve the locations of all active uniforms once, rather than on first use while drawing.
+        GLint count = 0;
+        GL(glGetProgramiv(program_, GL_ACTIVE_UNIFORMS, &count));
+        for (GLint n = 0; n < count; ++n) {
+            char    name[256];
+            GLsizei length = 0;
+            GL(glGetActiveUniformName(program_, n, sizeof(name), &length, name));
+            auto location = glGetUniformLocation(program_, name);
+            if (location >= 0) {
+                uniform_locations_.emplace(std::string(name, length), location);
+            }
         }
+    }
 
-        const char* fragment_source = fragment_source_str.c_str();
+    void compile(const stages_t& stages, bool retrievable)
+    {
+        GLint success;
 
-        auto fragmemt_shader = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
+        std::vector<GLhandleARB> shaders;
+        auto                     delete_shaders = [&] {
+            for (auto shader : shaders)
+                GL(glDeleteObjectARB(shader));
+        };
 
-        GL(glShaderSourceARB(fragmemt_shader, 1, &fragment_source, NULL));
-        GL(glCompileShaderARB(fragmemt_shader));
+        for (auto& stage : stages) {
+            const char* source = stage.second.c_str();
 
-        GL(glGetObjectParameterivARB(fragmemt_shader, GL_OBJECT_COMPILE_STATUS_ARB, &success));
-        if (success == GL_FALSE) {
-            char info[2048];
-            GL(glGetInfoLogARB(fragmemt_shader, sizeof(info), 0, info));
-            GL(glDeleteObjectARB(fragmemt_shader));
-            std::stringstream str;
-            str << "Failed to compile fragment shader:" << std::endl << info << std::endl;
-            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(str.str()));
+            shaders.push_back(glCreateShaderObjectARB(stage.first));
+
+            GL(glShaderSourceARB(shaders.back(), 1, &source, NULL));
+            GL(glCompileShaderARB(shaders.back()));
+
+            GL(glGetObjectParameterivARB(shaders.back(), GL_OBJECT_COMPILE_STATUS_ARB, &success));
+            if (success == GL_FALSE) {
+                char info[2048];
+                GL(glGetInfoLogARB(shaders.back(), sizeof(info), 0, info));
+                delete_shaders();
+                std::stringstream str;
+                str << "Failed to compile " << stage_name(stage.first) << " shader:" << std::endl << info << std::endl;
+                CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(str.str()));
+            }
         }
 
         program_ = glCreateProgramObjectARB();
 
-        GL(glAttachObjectARB(program_, vertex_shader));
-        GL(glAttachObjectARB(program_, fragmemt_shader));
+        for (auto shader : shaders)
+            GL(glAttachObjectARB(program_, shader));
+
+        if (retrievable)
+            GL(glProgramParameteri(program_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
 
         GL(glLinkProgramARB(program_));
 
-        GL(glDeleteObjectARB(vertex_shader));
-        GL(glDeleteObjectARB(fragmemt_shader));
+        delete_shaders();
 
         GL(glGetObjectParameterivARB(program_, GL_OBJECT_LINK_STATUS_ARB, &success));
         if (success == GL_FALSE) {
@@ -93,7 +159,97 @@ struct shader::impl : boost::noncopyable
             str << "Failed to link shader program:" << std::endl << info << std::endl;
             CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(str.str()));
         }
-        GL(glUseProgramObjectARB(program_));
+    }
+
+    static const char* stage_name(GLenum type)
+    {
+        switch (type) {
+            case GL_VERTEX_SHADER:
+                return "vertex";
+            case GL_FRAGMENT_SHADER:
+                return "fragment";
+            default:
+                return "compute";
+        }
+    }
+
+    // NOTE: A rejected binary is an expected outcome, so the GL errors it raises are cleared rather than thrown.
+    bool load(const boost::filesystem::path& path)
+    {
+        std::vector<char> binary;
+        {
+            boost::filesystem::ifstream file(path, std::ios::binary);
+            if (!file)
+                return false;
+            binary.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+
+        GLint success = GL_FALSE;
+
+        if (binary.size() > sizeof(GLenum)) {
+            GLenum format;
+            std::memcpy(&format, binary.data(), sizeof(format));
+
+            program_ = glCreateProgram();
+            glProgramBinary(program_,
+                            format,
+                            binary.data() + sizeof(format),
+                            static_cast<GLsizei>(binary.size() - sizeof(format)));
+            glGetProgramiv(program_, GL_LINK_STATUS, &success);
+        }
+
+        while (glGetError() != GL_NO_ERROR) {
+        }
+
+        if (success == GL_TRUE)
+            return true;
+
+        CASPAR_LOG(info) << L"Cached shader program " << path.filename().wstring() << L" was rejected, recompiling.";
+
+        if (program_ != 0) {
+            glDeleteProgram(program_);
+            program_ = 0;
+        }
+
+        boost::system::error_code ec;
+        boost::filesystem::remove(path, ec);
+
+        return false;
+    }
+
+    // Failing to store a program only costs compiling it again next time.
+    void store(const boost::filesystem::path& path) noexcept
+    {
+        try {
+            GLint length = 0;
+            GL(glGetProgramiv(program_, GL_PROGRAM_BINARY_LENGTH, &length));
+            if (length <= 0)
+                return;
+
+            GLenum            format  = 0;
+            GLsizei           written = 0;
+            std::vector<char> binary(sizeof(format) + length);
+            GL(glGetProgramBinary(program_, length, &written, &format, binary.data() + sizeof(format)));
+            std::memcpy(binary.data(), &format, sizeof(format));
+
+            // Written next to its final name and renamed, as other channels may compile the same program meanwhile.
+            auto temp = path;
+            temp += boost::filesystem::unique_path(".%%%%%%%%.tmp");
+            {
+                boost::filesystem::ofstream file(temp, std::ios::binary);
+                file.write(binary.data(), sizeof(format) + written);
+                if (!file)
+                    CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to write " + temp.string()));
+            }
+
+            boost::system::error_code ec;
+            boost::filesystem::rename(temp, path, ec);
+            if (ec)
+                boost::filesystem::remove(temp, ec);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(warning) << L"Failed to cache shader program " << path.filename().wstring() << L".";
+        }
     }
 
     ~impl() { glDeleteProgram(program_); }
@@ -134,7 +290,11 @@ struct shader::impl : boost::noncopyable
 };
 
 shader::shader(const std::string& vertex_source_str, const std::string& fragment_source_str)
-    : impl_(new impl(vertex_source_str, fragment_source_str))
+    : impl_(new impl({{GL_VERTEX_SHADER, vertex_source_str}, {GL_FRAGMENT_SHADER, fragment_source_str}}))
+{
+}
+shader::shader(const std::string& compute_source_str)
+    : impl_(new impl({{GL_COMPUTE_SHADER, compute_source_str}}))
 {
 }
 shader::~shader() {}
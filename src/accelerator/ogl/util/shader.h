@@ -35,6 +35,8 @@ class shader final
 
   public:
     shader(const std::string& vertex_source_str, const std::string& fragment_source_str);
+    // A compute program, which is run with glDispatchCompute after use.
+    explicit shader(const std::string& compute_source_str);
     ~shader();
 
     void set(const std::string& name, bool value);
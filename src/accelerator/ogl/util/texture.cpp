@@ -26,11 +26,17 @@
 
 #include <GL/glew.h>
 
+#include <cstddef>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
-static GLenum FORMAT[]          = {0, GL_RED, GL_RG, GL_BGR, GL_BGRA};
-static GLenum INTERNAL_FORMAT[] = {0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
-static GLenum TYPE[] = {0, GL_UNSIGNED_BYTE, GL_UNSIGNED_BYTE, GL_UNSIGNED_BYTE, GL_UNSIGNED_INT_8_8_8_8_REV};
+// Indexed by the number of channels, and by the bytes per channel for the sized formats.
+static GLenum FORMAT[]             = {0, GL_RED, GL_RG, GL_BGR, GL_BGRA};
+static GLenum INTERNAL_FORMAT[][5] = {{0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8},
+                                      {0, GL_R16, GL_RG16, GL_RGB16, GL_RGBA16}};
+static GLenum TYPE[][5]            = {
+    {0, GL_UNSIGNED_BYTE, GL_UNSIGNED_BYTE, GL_UNSIGNED_BYTE, GL_UNSIGNED_INT_8_8_8_8_REV},
+    {0, GL_UNSIGNED_SHORT, GL_UNSIGNED_SHORT, GL_UNSIGNED_SHORT, GL_UNSIGNED_SHORT}};
 
 struct texture::impl : boost::noncopyable
 {
@@ -38,21 +44,41 @@ struct texture::impl : boost::noncopyable
     GLsizei width_  = 0;
     GLsizei height_ = 0;
     GLsizei stride_ = 0;
+    GLsizei depth_  = 1;
     GLsizei size_   = 0;
+    GLenum  format_ = 0;
+    GLenum  type_   = 0;
+    bool    compressed_;
+    bool    ten_bit_;
+
+    // NOTE: Invalidated contents are only cleared once they are read or partly written, as they are often
+    // overwritten as a whole first.
+    bool undefined_ = false;
 
   public:
-    impl(int width, int height, int stride)
+    impl(int width, int height, int stride, int depth, bool compressed, bool ten_bit)
         : width_(width)
         , height_(height)
         , stride_(stride)
-        , size_(width * height * stride)
+        , depth_(depth)
+        , size_(compressed ? (width + 3) / 4 * ((height + 3) / 4) * 16 : width * height * stride)
+        , format_(FORMAT[stride / depth])
+        , type_(TYPE[depth - 1][stride / depth])
+        , compressed_(compressed)
+        , ten_bit_(ten_bit)
     {
         GL(glCreateTextures(GL_TEXTURE_2D, 1, &id_));
         GL(glTextureParameteri(id_, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
         GL(glTextureParameteri(id_, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
         GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
         GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-        GL(glTextureStorage2D(id_, 1, INTERNAL_FORMAT[stride_], width_, height_));
+        GL(glTextureStorage2D(id_,
+                              1,
+                              compressed_ ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+                              : ten_bit_  ? GL_RGB10_A2
+                                          : INTERNAL_FORMAT[depth_ - 1][stride_ / depth_],
+                              width_,
+                              height_));
     }
 
     ~impl() { glDeleteTextures(1, &id_); }
@@ -61,41 +87,125 @@ struct texture::impl : boost::noncopyable
 
     void bind(int index)
     {
+        define();
         GL(glActiveTexture(GL_TEXTURE0 + index));
         bind();
     }
 
+    void invalidate()
+    {
+        GL(glInvalidateTexImage(id_, 0));
+        undefined_ = true;
+    }
+
+    void define()
+    {
+        if (undefined_) {
+            clear();
+        }
+    }
+
     void unbind() { GL(glBindTexture(GL_TEXTURE_2D, 0)); }
 
     void attach() { GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + 0, GL_TEXTURE_2D, id_, 0)); }
 
-    void clear() { GL(glClearTexImage(id_, 0, FORMAT[stride_], TYPE[stride_], nullptr)); }
+    void clear()
+    {
+        GL(glClearTexImage(id_, 0, format_, type_, nullptr));
+        undefined_ = false;
+    }
+
+    void clear(int x, int y, int width, int height, const void* value = nullptr)
+    {
+        if (x > 0 || y > 0 || width < width_ || height < height_) {
+            define();
+        }
+        GL(glClearTexSubImage(id_, 0, x, y, 0, width, height, 1, format_, type_, value));
+        undefined_ = false;
+    }
 
     void copy_from(buffer& src)
     {
         src.bind();
 
+        if (compressed_) {
+            GL(glCompressedTextureSubImage2D(id_,
+                                             0,
+                                             0,
+                                             0,
+                                             width_,
+                                             height_,
+                                             GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+                                             size_,
+                                             reinterpret_cast<const void*>(static_cast<std::size_t>(src.offset()))));
+            undefined_ = false;
+            src.unbind();
+            return;
+        }
+
         if (width_ % 16 > 0) {
             glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         } else {
             glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
         }
 
-        GL(glTextureSubImage2D(id_, 0, 0, 0, width_, height_, FORMAT[stride_], TYPE[stride_], nullptr));
+        GL(glTextureSubImage2D(id_,
+                               0,
+                               0,
+                               0,
+                               width_,
+                               height_,
+                               format_,
+                               type_,
+                               reinterpret_cast<const void*>(static_cast<std::size_t>(src.offset()))));
+        undefined_ = false;
+
+        src.unbind();
+    }
+
+    void copy_from(buffer& src, int x, int y, int width, int height)
+    {
+        define();
+        src.bind();
+
+        // NOTE: The buffer holds the whole image, the rows of the region are read at their offset within it.
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, width_);
+
+        auto offset = static_cast<std::size_t>(src.offset()) + static_cast<std::size_t>(y * width_ + x) * stride_;
+        GL(glTextureSubImage2D(
+            id_, 0, x, y, width, height, format_, type_, reinterpret_cast<const void*>(offset)));
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
         src.unbind();
     }
 
+    void copy_from(impl& src)
+    {
+        src.define();
+        undefined_ = false;
+        GL(glCopyImageSubData(src.id_, GL_TEXTURE_2D, 0, 0, 0, 0, id_, GL_TEXTURE_2D, 0, 0, 0, 0, width_, height_, 1));
+    }
+
     void copy_to(buffer& dst)
     {
+        define();
         dst.bind();
-        GL(glGetTextureImage(id_, 0, FORMAT[stride_], TYPE[stride_], size_, nullptr));
+
+        if (width_ % 16 > 0) {
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        } else {
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        }
+
+        GL(glGetTextureImage(id_, 0, format_, type_, size_, nullptr));
         dst.unbind();
     }
 };
 
-texture::texture(int width, int height, int stride)
-    : impl_(new impl(width, height, stride))
+texture::texture(int width, int height, int stride, int depth, bool compressed, bool ten_bit)
+    : impl_(new impl(width, height, stride, depth, compressed, ten_bit))
 {
 }
 texture::texture(texture&& other)
@@ -111,13 +221,28 @@ texture& texture::operator=(texture&& other)
 void texture::bind(int index) { impl_->bind(index); }
 void texture::unbind() { impl_->unbind(); }
 void texture::attach() { impl_->attach(); }
+void texture::invalidate() { impl_->invalidate(); }
+void texture::overwrite() { impl_->undefined_ = false; }
 void texture::clear() { impl_->clear(); }
+void texture::clear(int x, int y, int width, int height) { impl_->clear(x, y, width, height); }
+void texture::clear(int x, int y, int width, int height, const void* value)
+{
+    impl_->clear(x, y, width, height, value);
+}
 void texture::copy_from(buffer& source) { impl_->copy_from(source); }
+void texture::copy_from(buffer& source, int x, int y, int width, int height)
+{
+    impl_->copy_from(source, x, y, width, height);
+}
+void texture::copy_from(texture& source) { impl_->copy_from(*source.impl_); }
 void texture::copy_to(buffer& dest) { impl_->copy_to(dest); }
 int  texture::width() const { return impl_->width_; }
 int  texture::height() const { return impl_->height_; }
 int  texture::stride() const { return impl_->stride_; }
-int  texture::size() const { return impl_->width_ * impl_->height_ * impl_->stride_; }
+int  texture::depth() const { return impl_->depth_; }
+bool texture::compressed() const { return impl_->compressed_; }
+bool texture::ten_bit() const { return impl_->ten_bit_; }
+int  texture::size() const { return impl_->size_; }
 int  texture::id() const { return impl_->id_; }
 
 }}} // namespace caspar::accelerator::ogl
@@ -28,7 +28,11 @@ namespace caspar { namespace accelerator { namespace ogl {
 class texture final
 {
   public:
-    texture(int width, int height, int stride);
+    // A texture of stride bytes per texel, of 8 or 16 bit channels as given by depth, in bytes per channel. Compressed
+    // textures hold DXT5 blocks of 16 bytes per 4x4 texels, with a stride and depth of 1, and are only uploaded and
+    // sampled. Ten bit textures are stored as RGB10_A2, of stride 4 and depth 1, and are otherwise used as 8 bit bgra,
+    // which GL converts from and to on upload, clear and read back.
+    texture(int width, int height, int stride, int depth = 1, bool compressed = false, bool ten_bit = false);
     texture(const texture&) = delete;
     texture(texture&& other);
     ~texture();
@@ -37,16 +41,29 @@ class texture final
     texture& operator                  =(texture&& other);
 
     void copy_from(class buffer& source);
+    void copy_from(class buffer& source, int x, int y, int width, int height);
+    void copy_from(texture& source);
     void copy_to(class buffer& dest);
 
     void attach();
+    // Discards the contents, which are cleared once they are read or partly written, unless they are overwritten as
+    // a whole first.
+    void invalidate();
+    // Marks the contents as about to be overwritten as a whole, so that discarded contents are not cleared.
+    void overwrite();
     void clear();
+    void clear(int x, int y, int width, int height);
+    // Fills the area with value, one texel of stride bytes in the order of the uploaded images.
+    void clear(int x, int y, int width, int height, const void* value);
     void bind(int index);
     void unbind();
 
     int width() const;
     int height() const;
     int stride() const;
+    int depth() const;
+    bool compressed() const;
+    bool ten_bit() const;
     int size() const;
     int id() const;
 
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+#include "array.h"
+
+#include "os/memory.h"
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+
+namespace caspar {
+namespace detail {
+
+namespace {
+
+// Blocks are pooled in power of two size classes from 4 KiB up to 64 MiB, larger blocks are allocated directly.
+const std::size_t min_class_size = 4096;
+const int         class_count    = 15;
+
+// Free blocks kept per size class, at most 32 MiB worth but always at least one, or as many as have been reserved.
+const std::size_t max_pooled_bytes = 32 * 1024 * 1024;
+
+struct size_class
+{
+    std::mutex         mutex;
+    std::vector<void*> blocks;
+    std::size_t        reserved = 0;
+};
+
+size_class* size_classes()
+{
+    static size_class classes[class_count];
+    return classes;
+}
+
+int class_index(std::size_t capacity)
+{
+    auto index = 0;
+    for (auto size = min_class_size; size < capacity; size <<= 1) {
+        ++index;
+    }
+    return index;
+}
+
+std::size_t class_capacity(int index) { return min_class_size << index; }
+
+} // namespace
+
+pooled_array_storage* pooled_array_storage::create(std::size_t size)
+{
+    static_assert(sizeof(pooled_array_storage) <= header_size, "");
+
+    auto  capacity = header_size + size;
+    auto  index    = class_index(capacity);
+    void* block    = nullptr;
+
+    if (index < class_count) {
+        capacity    = class_capacity(index);
+        auto& entry = size_classes()[index];
+
+        std::lock_guard<std::mutex> lock(entry.mutex);
+        if (!entry.blocks.empty()) {
+            block = entry.blocks.back();
+            entry.blocks.pop_back();
+        }
+    }
+
+    if (!block) {
+        block = allocate_frame_memory(capacity);
+        if (!block) {
+            throw std::bad_alloc();
+        }
+    }
+
+    auto storage = new (block) pooled_array_storage(capacity);
+    std::memset(storage->data(), 0, size);
+    return storage;
+}
+
+void pooled_array_storage::destroy()
+{
+    auto  capacity = capacity_;
+    auto  index    = class_index(capacity);
+    void* block    = this;
+
+    this->~pooled_array_storage();
+
+    if (index < class_count) {
+        auto& entry = size_classes()[index];
+
+        std::lock_guard<std::mutex> lock(entry.mutex);
+        if (entry.blocks.size() < std::max({std::size_t{1}, max_pooled_bytes / capacity, entry.reserved})) {
+            entry.blocks.push_back(block);
+            return;
+        }
+    }
+
+    free_frame_memory(block, capacity);
+}
+
+} // namespace detail
+
+void reserve_arrays(std::size_t size, int count)
+{
+    auto index = detail::class_index(detail::pooled_array_storage::header_size + size);
+    if (index >= detail::class_count || count <= 0) {
+        return;
+    }
+
+    auto  capacity = detail::class_capacity(index);
+    auto& entry    = detail::size_classes()[index];
+
+    std::vector<void*> blocks;
+    for (auto n = 0; n < count; ++n) {
+        auto block = allocate_frame_memory(capacity);
+        if (!block) {
+            throw std::bad_alloc();
+        }
+        prefault_frame_memory(block, capacity);
+        blocks.push_back(block);
+    }
+
+    std::lock_guard<std::mutex> lock(entry.mutex);
+    entry.reserved += count;
+    entry.blocks.insert(entry.blocks.end(), blocks.begin(), blocks.end());
+}
+
+} // namespace caspar
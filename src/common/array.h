@@ -1,14 +1,156 @@
 #pragma once
 
-#include <boost/any.hpp>
-
+#include <atomic>
 #include <cstddef>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
 #include <vector>
 
 namespace caspar {
 
+namespace detail {
+
+// Intrusively reference counted owner of the memory of an array, so that sharing an array does not allocate a
+// separate control block.
+class array_storage
+{
+    std::atomic<int> refs_{1};
+
+  protected:
+    virtual ~array_storage() = default;
+
+  public:
+    array_storage()                     = default;
+    array_storage(const array_storage&) = delete;
+    array_storage& operator=(const array_storage&) = delete;
+
+    virtual const std::type_info& type() const = 0;
+    virtual void*                 value()      = 0;
+
+    void add_ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+
+    void release()
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            destroy();
+        }
+    }
+
+  private:
+    virtual void destroy() { delete this; }
+};
+
+template <typename S>
+class typed_array_storage final : public array_storage
+{
+    S value_;
+
+  public:
+    template <typename Arg>
+    explicit typed_array_storage(Arg&& value)
+        : value_(std::forward<Arg>(value))
+    {
+    }
+
+    const std::type_info& type() const override { return typeid(S); }
+    void*                 value() override { return &value_; }
+};
+
+// Zeroed memory placed in the same block as its storage, which is returned to a pool of blocks of the same size class
+// once released. See array.cpp.
+class pooled_array_storage final : public array_storage
+{
+    std::size_t capacity_;
+
+    explicit pooled_array_storage(std::size_t capacity)
+        : capacity_(capacity)
+    {
+    }
+
+  public:
+    static const std::size_t header_size = 64;
+
+    static pooled_array_storage* create(std::size_t size);
+
+    void* data() { return reinterpret_cast<char*>(this) + header_size; }
+
+    const std::type_info& type() const override { return typeid(pooled_array_storage); }
+    void*                 value() override { return this; }
+
+  private:
+    void destroy() override;
+};
+
+class storage_ptr final
+{
+    array_storage* ptr_ = nullptr;
+
+  public:
+    storage_ptr() = default;
+
+    explicit storage_ptr(array_storage* ptr)
+        : ptr_(ptr)
+    {
+    }
+
+    storage_ptr(const storage_ptr& other)
+        : ptr_(other.ptr_)
+    {
+        if (ptr_) {
+            ptr_->add_ref();
+        }
+    }
+
+    storage_ptr(storage_ptr&& other) noexcept
+        : ptr_(other.ptr_)
+    {
+        other.ptr_ = nullptr;
+    }
+
+    ~storage_ptr()
+    {
+        if (ptr_) {
+            ptr_->release();
+        }
+    }
+
+    storage_ptr& operator=(storage_ptr other) noexcept
+    {
+        std::swap(ptr_, other.ptr_);
+        return *this;
+    }
+
+    template <typename S>
+    S* get() const
+    {
+        return ptr_ && ptr_->type() == typeid(S) ? static_cast<S*>(ptr_->value()) : nullptr;
+    }
+};
+
+template <typename S>
+storage_ptr make_storage(S&& value)
+{
+    return storage_ptr(new typed_array_storage<std::decay_t<S>>(std::forward<S>(value)));
+}
+
+template <typename T>
+T* make_pooled_storage(std::size_t size, storage_ptr& storage)
+{
+    auto pooled = pooled_array_storage::create(size * sizeof(T));
+    storage     = storage_ptr(pooled);
+    return reinterpret_cast<T*>(pooled->data());
+}
+
+} // namespace detail
+
+// Allocates and pre-faults count pooled blocks large enough for arrays of size bytes, and keeps at least that many
+// pooled from then on, so that frames of that size are served from memory that is already mapped. See os/memory.h.
+void reserve_arrays(std::size_t size, int count);
+
 template <typename T>
 class array final
 {
@@ -25,26 +167,22 @@ class array final
         : size_(size)
     {
         if (size_ > 0) {
-            auto storage = std::shared_ptr<void>(std::malloc(size), std::free);
-            ptr_         = reinterpret_cast<T*>(storage.get());
-            std::memset(ptr_, 0, size_);
-            storage_ = std::make_shared<boost::any>(std::move(storage));
+            ptr_ = detail::make_pooled_storage<T>(size_, storage_);
         }
     }
 
     array(std::vector<T> other)
+        : size_(other.size())
+        , storage_(detail::make_storage(std::move(other)))
     {
-        auto storage = std::make_shared<std::vector<T>>(std::move(other));
-        ptr_         = storage->data();
-        size_        = storage->size();
-        storage_     = std::make_shared<boost::any>(std::move(storage));
+        ptr_ = storage_.get<std::vector<T>>()->data();
     }
 
     template <typename S>
     explicit array(T* ptr, std::size_t size, S&& storage)
         : ptr_(ptr)
         , size_(size)
-        , storage_(std::make_shared<boost::any>(std::forward<S>(storage)))
+        , storage_(detail::make_storage(std::forward<S>(storage)))
     {
     }
 
@@ -80,13 +218,13 @@ class array final
     template <typename S>
     S* storage() const
     {
-        return boost::any_cast<S>(storage_.get());
+        return storage_.get<S>();
     }
 
   private:
-    T*                          ptr_  = nullptr;
-    std::size_t                 size_ = 0;
-    std::shared_ptr<boost::any> storage_;
+    T*                  ptr_  = nullptr;
+    std::size_t         size_ = 0;
+    detail::storage_ptr storage_;
 };
 
 template <typename T>
@@ -102,26 +240,22 @@ class array<const T> final
         : size_(size)
     {
         if (size_ > 0) {
-            auto storage = std::shared_ptr<void>(std::malloc(size), std::free);
-            ptr_         = reinterpret_cast<T*>(storage.get());
-            std::memset(ptr_, 0, size_);
-            storage_ = std::make_shared<boost::any>(storage);
+            ptr_ = detail::make_pooled_storage<T>(size_, storage_);
         }
     }
 
     array(const std::vector<T>& other)
+        : size_(other.size())
+        , storage_(detail::make_storage(other))
     {
-        auto storage = std::make_shared<std::vector<T>>(std::move(other));
-        ptr_         = storage->data();
-        size_        = storage->size();
-        storage_     = std::make_shared<boost::any>(std::move(storage));
+        ptr_ = storage_.get<std::vector<T>>()->data();
     }
 
     template <typename S>
     explicit array(const T* ptr, std::size_t size, S&& storage)
         : ptr_(ptr)
         , size_(size)
-        , storage_(std::make_shared<boost::any>(std::forward<S>(storage)))
+        , storage_(detail::make_storage(std::forward<S>(storage)))
     {
     }
 
@@ -135,11 +269,10 @@ class array<const T> final
     array(array<T>&& other)
         : ptr_(other.ptr_)
         , size_(other.size_)
-        , storage_(other.storage_)
+        , storage_(std::move(other.storage_))
     {
-        other.ptr_     = nullptr;
-        other.size_    = 0;
-        other.storage_ = nullptr;
+        other.ptr_  = nullptr;
+        other.size_ = 0;
     }
 
     array& operator=(const array& other)
@@ -160,13 +293,13 @@ class array<const T> final
     template <typename S>
     S* storage() const
     {
-        return boost::any_cast<S>(storage_.get());
+        return storage_.get<S>();
     }
 
   private:
-    const T*                    ptr_  = nullptr;
-    std::size_t                 size_ = 0;
-    std::shared_ptr<boost::any> storage_;
+    const T*            ptr_  = nullptr;
+    std::size_t         size_ = 0;
+    detail::storage_ptr storage_;
 };
 
 } // namespace caspar
@@ -20,6 +20,9 @@
  */
 #include "graph.h"
 
+#include <tbb/concurrent_unordered_map.h>
+
+#include <atomic>
 #include <mutex>
 #include <vector>
 
@@ -59,56 +62,85 @@ std::vector<spl::shared_ptr<spi::graph_sink>> create_sinks()
     return result;
 }
 
-struct graph::impl
+struct graph::impl : public spi::graph_state
 {
-    std::vector<spl::shared_ptr<spi::graph_sink>> sinks_ = create_sinks();
+    tbb::concurrent_unordered_map<std::string, std::shared_ptr<spi::graph_series>> series_;
+
+    mutable std::mutex text_mutex_;
+    std::wstring       text_;
+    std::atomic<bool>  auto_reset_{false};
+    std::atomic<bool>  active_{false};
+
+    std::vector<spl::shared_ptr<spi::graph_sink>> sinks_;
 
   public:
     impl() {}
 
-    void activate()
+    void activate(const spl::shared_ptr<impl>& self)
     {
+        if (active_.exchange(true)) {
+            return;
+        }
+
+        sinks_ = create_sinks();
         for (auto& sink : sinks_)
-            sink->activate();
+            sink->activate(self);
     }
 
     void set_text(const std::wstring& value)
     {
-        for (auto& sink : sinks_)
-            sink->set_text(value);
+        std::lock_guard<std::mutex> lock(text_mutex_);
+        text_ = value;
     }
 
     void set_value(const std::string& name, double value)
     {
-        for (auto& sink : sinks_)
-            sink->set_value(name, value);
+        auto& series = get_series(name);
+        series.value.store(value, std::memory_order_relaxed);
+        series.values.fetch_add(1, std::memory_order_release);
     }
 
     void set_tag(tag_severity severity, const std::string& name)
     {
-        for (auto& sink : sinks_)
-            sink->set_tag(severity, name);
+        auto& series = get_series(name);
+        series.severity.store(severity, std::memory_order_relaxed);
+        series.tags.fetch_add(1, std::memory_order_release);
     }
 
-    void set_color(const std::string& name, int color)
+    void set_color(const std::string& name, int color) { get_series(name).color = color; }
+
+    void set_auto_reset() { auto_reset_ = true; }
+
+    std::wstring text() const override
     {
-        for (auto& sink : sinks_)
-            sink->set_color(name, color);
+        std::lock_guard<std::mutex> lock(text_mutex_);
+        return text_;
     }
 
-    void auto_reset()
+    bool auto_reset() const override { return auto_reset_; }
+
+    void for_each(const std::function<void(const std::string&, const spi::graph_series&)>& func) const override
     {
-        for (auto& sink : sinks_)
-            sink->auto_reset();
+        for (auto& series : series_)
+            func(series.first, *series.second);
     }
 
   private:
+    spi::graph_series& get_series(const std::string& name)
+    {
+        auto it = series_.find(name);
+        if (it == series_.end()) {
+            it = series_.insert(std::make_pair(name, std::make_shared<spi::graph_series>())).first;
+        }
+        return *it->second;
+    }
+
     impl(impl&);
     impl& operator=(impl&);
 };
 
 graph::graph()
-    : impl_(new impl)
+    : impl_(spl::make_shared<impl>())
 {
 }
 
@@ -116,9 +148,9 @@ void graph::set_text(const std::wstring& value) { impl_->set_text(value); }
 void graph::set_value(const std::string& name, double value) { impl_->set_value(name, value); }
 void graph::set_color(const std::string& name, int color) { impl_->set_color(name, color); }
 void graph::set_tag(tag_severity severity, const std::string& name) { impl_->set_tag(severity, name); }
-void graph::auto_reset() { impl_->auto_reset(); }
+void graph::auto_reset() { impl_->set_auto_reset(); }
 
-void register_graph(const spl::shared_ptr<graph>& graph) { graph->impl_->activate(); }
+void register_graph(const spl::shared_ptr<graph>& graph) { graph->impl_->activate(graph->impl_); }
 
 namespace spi {
 
@@ -23,6 +23,8 @@
 
 #include "../memory.h"
 
+#include <atomic>
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <tuple>
@@ -48,6 +50,8 @@ class graph : boost::noncopyable
   public:
     graph();
     void set_text(const std::wstring& value);
+    // NOTE: Values and tags are stored without locking or allocating, once a series has been named by set_color or
+    // by its first value or tag.
     void set_value(const std::string& name, double value);
     void set_color(const std::string& name, int color);
     void set_tag(tag_severity severity, const std::string& name);
@@ -55,23 +59,40 @@ class graph : boost::noncopyable
 
   private:
     struct impl;
-    std::shared_ptr<impl> impl_;
+    spl::shared_ptr<impl> impl_;
 };
 
 void register_graph(const spl::shared_ptr<graph>& graph);
 
 namespace spi {
 
+// The latest value of a named series of a graph.
+struct graph_series
+{
+    std::atomic<double>       value{0.0};
+    std::atomic<int>          color{static_cast<int>(0xFFFFFFFF)};
+    std::atomic<tag_severity> severity{tag_severity::SILENT};
+
+    // Counts of values and tags set, by which sinks tell new values and tags from the ones they have already seen.
+    std::atomic<std::uint32_t> values{0};
+    std::atomic<std::uint32_t> tags{0};
+};
+
+// What a graph has recorded, which sinks sample at their own rate.
+class graph_state : boost::noncopyable
+{
+  public:
+    virtual ~graph_state() {}
+    virtual std::wstring text() const                                                                     = 0;
+    virtual bool         auto_reset() const                                                               = 0;
+    virtual void for_each(const std::function<void(const std::string&, const graph_series&)>& func) const = 0;
+};
+
 class graph_sink : boost::noncopyable
 {
   public:
     virtual ~graph_sink() {}
-    virtual void activate()                                              = 0;
-    virtual void set_text(const std::wstring& value)                     = 0;
-    virtual void set_value(const std::string& name, double value)        = 0;
-    virtual void set_color(const std::string& name, int color)           = 0;
-    virtual void set_tag(tag_severity severity, const std::string& name) = 0;
-    virtual void auto_reset()                                            = 0;
+    virtual void activate(const spl::shared_ptr<const graph_state>& state) = 0;
 };
 
 typedef std::function<spl::shared_ptr<graph_sink>()> sink_factory_t;
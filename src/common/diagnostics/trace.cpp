@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+#include "../except.h"
+#include "../utf.h"
+
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace caspar { namespace diagnostics { namespace trace {
+
+namespace {
+
+struct event
+{
+    const char*  name;
+    std::int64_t frame;
+    std::int64_t begin;    // Nanoseconds since the epoch of the trace.
+    std::int64_t duration; // -1 for instant events.
+};
+
+// NOTE: Only the owning thread writes to a ring. A dump reads it concurrently and leaves out the events which may
+// have been overwritten while they were copied.
+struct ring
+{
+    static const std::size_t capacity = 8192;
+
+    std::vector<event>         events = std::vector<event>(capacity);
+    std::atomic<std::uint64_t> head{0};
+    int                        tid;
+    std::string                name; // Guarded by g_mutex.
+
+    void push(const event& e)
+    {
+        auto n               = head.load(std::memory_order_relaxed);
+        events[n % capacity] = e;
+        head.store(n + 1, std::memory_order_release);
+    }
+};
+
+std::atomic<bool>                  g_enabled{false};
+std::mutex                         g_mutex;
+std::vector<std::shared_ptr<ring>> g_rings;
+const auto                         g_epoch = std::chrono::steady_clock::now();
+
+thread_local std::shared_ptr<ring> t_ring;
+thread_local std::string           t_name;
+thread_local std::int64_t          t_frame = -1;
+
+std::int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_epoch).count();
+}
+
+ring& thread_ring()
+{
+    if (!t_ring) {
+        auto r = std::make_shared<ring>();
+
+        std::lock_guard<std::mutex> lock(g_mutex);
+        r->tid  = static_cast<int>(g_rings.size() + 1);
+        r->name = t_name;
+        g_rings.push_back(r);
+        t_ring = std::move(r);
+    }
+    return *t_ring;
+}
+
+std::string escape(const std::string& str)
+{
+    std::string result;
+    for (auto c : str) {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20)
+            result += c;
+    }
+    return result;
+}
+
+} // namespace
+
+void enable(bool value) { g_enabled = value; }
+bool enabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+void name_thread(const std::wstring& name)
+{
+    t_name = u8(name);
+    if (t_ring) {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        t_ring->name = t_name;
+    }
+}
+
+std::int64_t current_frame() { return t_frame; }
+
+frame_scope::frame_scope(std::int64_t frame)
+    : saved_(t_frame)
+{
+    t_frame = frame;
+}
+
+frame_scope::~frame_scope() { t_frame = saved_; }
+
+scope::scope(const char* name, std::int64_t frame)
+    : name_(name)
+    , frame_(frame)
+{
+    if (enabled())
+        begin_ = now();
+}
+
+scope::~scope()
+{
+    if (begin_ >= 0 && enabled())
+        thread_ring().push(event{name_, frame_, begin_, now() - begin_});
+}
+
+void instant(const char* name, std::int64_t frame)
+{
+    if (enabled())
+        thread_ring().push(event{name, frame, now(), -1});
+}
+
+void dump(const std::wstring& path)
+{
+    std::vector<std::shared_ptr<ring>> rings;
+    std::vector<std::string>           names;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        rings = g_rings;
+        for (auto& r : rings)
+            names.push_back(r->name);
+    }
+
+    boost::filesystem::ofstream file(boost::filesystem::path(path), std::ios::binary);
+    if (!file)
+        CASPAR_THROW_EXCEPTION(io_error() << msg_info(L"Failed to open " + path));
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    auto first = true;
+    auto write = [&](const std::string& line) {
+        file << (first ? "" : ",\n") << line;
+        first = false;
+    };
+
+    for (std::size_t n = 0; n < rings.size(); ++n) {
+        auto& r   = *rings[n];
+        auto  tid = std::to_string(r.tid);
+
+        if (!names[n].empty()) {
+            write("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":\"" +
+                  escape(names[n]) + "\"}}");
+        }
+
+        auto head  = r.head.load(std::memory_order_acquire);
+        auto begin = head > ring::capacity ? head - ring::capacity : 0;
+
+        std::vector<event> events;
+        for (auto i = begin; i < head; ++i)
+            events.push_back(r.events[i % ring::capacity]);
+
+        // Events up to the head after copying may have been overwritten by the thread in the meantime.
+        auto after   = r.head.load(std::memory_order_acquire);
+        auto skipped = std::uint64_t(0);
+        if (after > begin + ring::capacity)
+            skipped = std::min<std::uint64_t>(after - begin - ring::capacity, events.size());
+
+        for (auto i = static_cast<std::size_t>(skipped); i < events.size(); ++i) {
+            auto& e    = events[i];
+            auto  line = "{\"name\":\"" + escape(e.name) + "\",\"pid\":1,\"tid\":" + tid +
+                        ",\"ts\":" + std::to_string(e.begin / 1000.0);
+            if (e.duration < 0)
+                line += ",\"ph\":\"i\",\"s\":\"t\"";
+            else
+                line += ",\"ph\":\"X\",\"dur\":" + std::to_string(e.duration / 1000.0);
+            if (e.frame >= 0)
+                line += ",\"args\":{\"frame\":" + std::to_string(e.frame) + "}";
+            write(line + "}");
+        }
+    }
+
+    file << "\n]}\n";
+}
+
+}}} // namespace caspar::diagnostics::trace
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace diagnostics { namespace trace {
+
+// Scoped trace events, recorded to a ring per thread and dumped as a Chrome trace, which Perfetto and
+// chrome://tracing load. Events carry the number of the channel frame they belong to, so the work of one frame can be
+// followed across threads. Nothing is recorded until tracing is enabled, until then an event costs a relaxed load.
+
+void enable(bool value);
+bool enabled();
+
+// Names the calling thread in dumps, called by set_thread_name.
+void name_thread(const std::wstring& name);
+
+// The frame which events of the calling thread belong to, -1 for none.
+std::int64_t current_frame();
+
+class frame_scope
+{
+    std::int64_t saved_;
+
+  public:
+    explicit frame_scope(std::int64_t frame);
+    ~frame_scope();
+
+    frame_scope(const frame_scope&) = delete;
+    frame_scope& operator=(const frame_scope&) = delete;
+};
+
+// Records a complete event from construction to destruction. name must outlive the process, e.g. a string literal.
+class scope
+{
+    const char*  name_;
+    std::int64_t frame_;
+    std::int64_t begin_ = -1;
+
+  public:
+    explicit scope(const char* name, std::int64_t frame = current_frame());
+    ~scope();
+
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+};
+
+void instant(const char* name, std::int64_t frame = current_frame());
+
+// Writes what the rings hold as Chrome trace JSON to path.
+void dump(const std::wstring& path);
+
+}}} // namespace caspar::diagnostics::trace
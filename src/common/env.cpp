@@ -45,6 +45,9 @@ std::wstring                 log;
 std::wstring                 ftemplate;
 std::wstring                 data;
 std::wstring                 font;
+std::wstring                 thumbnail;
+std::wstring                 shader_cache;
+std::wstring                 texture_cache;
 boost::property_tree::wptree pt;
 
 void check_is_configured()
@@ -120,8 +123,11 @@ void configure(const std::wstring& filename)
         log        = clean_path(paths.get(L"log-path", initial + L"/log/"));
         ftemplate =
             clean_path(boost::filesystem::complete(paths.get(L"template-path", initial + L"/template/")).wstring());
-        data = clean_path(paths.get(L"data-path", initial + L"/data/"));
-        font = clean_path(paths.get(L"font-path", initial + L"/font/"));
+        data          = clean_path(paths.get(L"data-path", initial + L"/data/"));
+        font          = clean_path(paths.get(L"font-path", initial + L"/font/"));
+        thumbnail     = clean_path(paths.get(L"thumbnail-path", initial + L"/thumbnail/"));
+        shader_cache  = clean_path(paths.get(L"shader-cache-path", L""));
+        texture_cache = clean_path(paths.get(L"texture-cache-path", L""));
     } catch (...) {
         CASPAR_LOG(error) << L" ### Invalid configuration file. ###";
         throw;
@@ -132,6 +138,17 @@ void configure(const std::wstring& filename)
     ftemplate = ensure_trailing_slash(resolve_or_create(ftemplate));
     data      = ensure_trailing_slash(resolve_or_create(data));
     font      = ensure_trailing_slash(resolve_or_create(font));
+    thumbnail = ensure_trailing_slash(resolve_or_create(thumbnail));
+
+    if (!shader_cache.empty()) {
+        shader_cache = ensure_trailing_slash(resolve_or_create(shader_cache));
+        ensure_writable(shader_cache);
+    }
+
+    if (!texture_cache.empty()) {
+        texture_cache = ensure_trailing_slash(resolve_or_create(texture_cache));
+        ensure_writable(texture_cache);
+    }
 
     ensure_writable(log);
     ensure_writable(ftemplate);
@@ -174,6 +191,24 @@ const std::wstring& font_folder()
     return font;
 }
 
+const std::wstring& thumbnail_folder()
+{
+    check_is_configured();
+    return thumbnail;
+}
+
+const std::wstring& shader_cache_folder()
+{
+    check_is_configured();
+    return shader_cache;
+}
+
+const std::wstring& texture_cache_folder()
+{
+    check_is_configured();
+    return texture_cache;
+}
+
 #define QUOTE(str) #str
 #define EXPAND_AND_QUOTE(str) QUOTE(str)
 
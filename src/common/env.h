@@ -35,6 +35,9 @@ const std::wstring& log_folder();
 const std::wstring& template_folder();
 const std::wstring& data_folder();
 const std::wstring& font_folder();
+const std::wstring& thumbnail_folder();
+const std::wstring& shader_cache_folder();  // empty when the shader cache is disabled
+const std::wstring& texture_cache_folder(); // empty when the texture cache is disabled
 const std::wstring& version();
 
 const boost::property_tree::wptree& properties();
@@ -21,46 +21,167 @@
 
 #pragma once
 
+#include "env.h"
 #include "except.h"
 #include "log.h"
 #include "os/thread.h"
 
+#include <boost/property_tree/ptree.hpp>
+
 #include <tbb/concurrent_queue.h>
+#include <tbb/task_arena.h>
 
 #include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <future>
+#include <memory>
+#include <type_traits>
 
 namespace caspar {
 
+enum class task_priority
+{
+    normal,
+    high, // Runs before any queued normal task, e.g. the frame ticks of a channel.
+};
+
+enum class executor_mode
+{
+    dedicated, // Runs tasks on a thread of its own, for real-time paths and tasks which block.
+    strand,    // Runs tasks one at a time on the threads of a pool shared by all strands.
+};
+
 class executor final
 {
     executor(const executor&);
     executor& operator=(const executor&);
 
-    typedef std::function<void()>                 task_t;
+    // A move only task which stores small functions inline, so that queuing them does not allocate.
+    class task_t
+    {
+        struct ops_t
+        {
+            void (*invoke)(void*);
+            void (*move)(void*, void*);
+            void (*destroy)(void*);
+        };
+
+        template <typename F>
+        static const ops_t* ops()
+        {
+            static const ops_t result{[](void* p) { (*static_cast<F*>(p))(); },
+                                      [](void* dst, void* src) {
+                                          new (dst) F(std::move(*static_cast<F*>(src)));
+                                          static_cast<F*>(src)->~F();
+                                      },
+                                      [](void* p) { static_cast<F*>(p)->~F(); }};
+            return &result;
+        }
+
+        typename std::aligned_storage<64, alignof(std::max_align_t)>::type storage_;
+        const ops_t*                                                      ops_ = nullptr;
+
+      public:
+        task_t() = default;
+
+        template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, task_t>::value>>
+        task_t(F&& func)
+        {
+            typedef std::decay_t<F> func_t;
+
+            emplace<func_t>(std::forward<F>(func), std::integral_constant<bool, sizeof(func_t) <= sizeof(storage_)>{});
+        }
+
+        task_t(task_t&& other) { *this = std::move(other); }
+
+        task_t& operator=(task_t&& other)
+        {
+            if (this != &other) {
+                reset();
+                if (other.ops_) {
+                    other.ops_->move(&storage_, &other.storage_);
+                    ops_       = other.ops_;
+                    other.ops_ = nullptr;
+                }
+            }
+            return *this;
+        }
+
+        ~task_t() { reset(); }
+
+        void operator()() { ops_->invoke(&storage_); }
+
+        explicit operator bool() const { return ops_ != nullptr; }
+
+      private:
+        template <typename F, typename Arg>
+        void emplace(Arg&& func, std::true_type)
+        {
+            new (&storage_) F(std::forward<Arg>(func));
+            ops_ = ops<F>();
+        }
+
+        template <typename F, typename Arg>
+        void emplace(Arg&& func, std::false_type)
+        {
+            auto heap = [ptr = std::make_unique<F>(std::forward<Arg>(func))] { (*ptr)(); };
+            emplace<decltype(heap)>(std::move(heap), std::true_type{});
+        }
+
+        void reset()
+        {
+            if (ops_) {
+                ops_->destroy(&storage_);
+                ops_ = nullptr;
+            }
+        }
+    };
+
     typedef tbb::concurrent_bounded_queue<task_t> queue_t;
 
-    std::wstring      name_;
-    std::atomic<bool> is_running_{true};
-    queue_t           queue_;
-    std::thread       thread_;
+    // NOTE: Strands keep the serial semantics of a dedicated thread. Tasks queued while the strand is idle make it
+    // run on the pool, where it runs what has been queued, a batch at a time so that other strands get their turn.
+    static const int strand_batch = 16;
+
+    std::wstring                  name_;
+    std::atomic<bool>             is_running_{true};
+    queue_t                       queue_;
+    tbb::concurrent_queue<task_t> high_queue_;
+    const executor_mode           mode_;
+    std::thread                   thread_;
+
+    std::atomic<std::int64_t> pending_{0}; // Tasks queued on the strand and not yet run.
+    std::atomic<std::int64_t> scheduled_{0};
+    std::atomic<double>       strand_latency_{0.0};
+    std::promise<void>        stopped_;
 
   public:
-    executor(const std::wstring& name)
+    // Strands run on dedicated threads when the pool has no threads.
+    executor(const std::wstring& name, executor_mode mode = executor_mode::dedicated)
         : name_(name)
-        , thread_(std::thread([this] { run(); }))
+        , mode_(mode == executor_mode::strand && pool_threads() > 0 ? executor_mode::strand : executor_mode::dedicated)
     {
+        if (mode_ == executor_mode::dedicated) {
+            thread_ = std::thread([this] { run(); });
+        }
     }
 
     ~executor()
     {
+        auto stopped = stopped_.get_future();
         stop();
-        thread_.join();
+        if (mode_ == executor_mode::dedicated) {
+            thread_.join();
+        } else {
+            stopped.wait();
+        }
     }
 
     template <typename Func>
-    auto begin_invoke(Func&& func)
+    auto begin_invoke(Func&& func, task_priority priority = task_priority::normal)
     {
         if (!is_running_) {
             CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info("executor not running."));
@@ -68,11 +189,30 @@ class executor final
 
         typedef decltype(func()) result_type;
 
-        auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Func>(func));
+        std::promise<result_type> promise;
+        auto                      future = promise.get_future();
 
-        queue_.push([=]() mutable { (*task)(); });
+        task_t task([promise = std::move(promise), func = std::forward<Func>(func)]() mutable {
+            try {
+                fulfil(promise, func);
+            } catch (...) {
+                promise.set_exception(std::current_exception());
+            }
+        });
+
+        if (priority == task_priority::high) {
+            high_queue_.push(std::move(task));
+            // NOTE: Wakes the executor, which runs high priority tasks before the next normal one. A full queue means
+            // that it is busy and does not need waking.
+            if (mode_ == executor_mode::dedicated) {
+                queue_.try_push(task_t([] {}));
+            }
+        } else {
+            queue_.push(std::move(task));
+        }
+        schedule();
 
-        return task->get_future();
+        return future;
     }
 
     template <typename Func>
@@ -101,7 +241,11 @@ class executor final
 
     queue_t::size_type capacity() const { return queue_.capacity(); }
 
-    void clear() { queue_.clear(); }
+    void clear()
+    {
+        queue_.clear();
+        high_queue_.clear();
+    }
 
     void stop()
     {
@@ -109,7 +253,8 @@ class executor final
             return;
         }
         is_running_ = false;
-        queue_.push(nullptr);
+        queue_.push(task_t{});
+        schedule();
     }
 
     void wait()
@@ -121,11 +266,89 @@ class executor final
 
     bool is_running() const { return is_running_; }
 
-    bool is_current() const { return std::this_thread::get_id() == thread_.get_id(); }
+    bool is_current() const
+    {
+        return mode_ == executor_mode::strand ? current_strand() == this
+                                               : std::this_thread::get_id() == thread_.get_id();
+    }
 
     const std::wstring& name() const { return name_; }
 
+    executor_mode mode() const { return mode_; }
+
+    // Seconds the strand last waited for a thread of the pool before running, always 0 on a dedicated thread.
+    double strand_latency() const { return strand_latency_; }
+
   private:
+    // NOTE: Strands must not wait for other strands, as every thread of the pool could be taken by a waiting one.
+    static int pool_threads()
+    {
+        static const int threads = env::properties().get(L"configuration.executor.pool-threads", 4);
+        return threads;
+    }
+
+    static tbb::task_arena& pool()
+    {
+        static tbb::task_arena arena(pool_threads(), 0);
+        return arena;
+    }
+
+    static const executor*& current_strand()
+    {
+        static thread_local const executor* current = nullptr;
+        return current;
+    }
+
+    static std::int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    // Counts a queued task, and puts the strand on the pool if it was idle.
+    void schedule()
+    {
+        if (mode_ == executor_mode::strand && pending_++ == 0) {
+            scheduled_ = now();
+            pool().enqueue([this] { run_strand(); });
+        }
+    }
+
+    void run_strand()
+    {
+        strand_latency_ = (now() - scheduled_) / 1e9;
+
+        auto previous    = current_strand();
+        current_strand() = this;
+
+        for (int n = 0; n < strand_batch; ++n) {
+            task_t task;
+            if (high_queue_.try_pop(task) || queue_.try_pop(task)) {
+                if (!task) {
+                    // NOTE: The executor may be destroyed as soon as it is told, nothing of it is touched after.
+                    current_strand() = previous;
+                    auto stopped     = std::move(stopped_);
+                    stopped.set_value();
+                    return;
+                }
+                try {
+                    task();
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+            if (--pending_ == 0) {
+                current_strand() = previous;
+                return;
+            }
+        }
+
+        current_strand() = previous;
+        scheduled_       = now();
+        pool().enqueue([this] { run_strand(); });
+    }
+
     void run()
     {
         set_thread_name(name_);
@@ -136,7 +359,9 @@ class executor final
             try {
                 queue_.pop(task);
                 do {
+                    run_high();
                     if (!task) {
+                        stopped_.set_value();
                         return;
                     }
                     task();
@@ -146,6 +371,31 @@ class executor final
             }
         }
     }
+
+    void run_high()
+    {
+        task_t task;
+        while (high_queue_.try_pop(task)) {
+            try {
+                task();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    template <typename R, typename Func>
+    static void fulfil(std::promise<R>& promise, Func& func)
+    {
+        promise.set_value(func());
+    }
+
+    template <typename Func>
+    static void fulfil(std::promise<void>& promise, Func& func)
+    {
+        func();
+        promise.set_value();
+    }
 };
 
 } // namespace caspar
\ No newline at end of file
@@ -20,12 +20,143 @@
  */
 #include "filesystem.h"
 #include "except.h"
+#include "log.h"
+#include "os/thread.h"
 
+#include <boost/algorithm/string/case_conv.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
 
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
 namespace caspar {
 
+namespace {
+
+// The names in a directory by themselves and by their lower case form, and the modification time of the directory when
+// they were read. Names equal to the lower case form of another name take precedence over it.
+struct directory_listing
+{
+    std::time_t                                    write_time = 0;
+    std::time_t                                    read_time  = 0;
+    std::unordered_map<std::wstring, std::wstring> names;
+
+    const std::wstring* find(const std::wstring& name) const
+    {
+        auto it = names.find(name);
+        if (it == names.end()) {
+            it = names.find(boost::algorithm::to_lower_copy(name));
+        }
+        return it != names.end() ? &it->second : nullptr;
+    }
+};
+
+class path_index
+{
+    std::mutex                                                                 mutex_;
+    std::unordered_map<std::wstring, std::shared_ptr<const directory_listing>> listings_;
+
+  public:
+    std::shared_ptr<const directory_listing> read(const boost::filesystem::path& directory)
+    {
+        boost::system::error_code ec;
+
+        auto listing        = std::make_shared<directory_listing>();
+        listing->write_time = boost::filesystem::last_write_time(directory, ec);
+        listing->read_time  = std::time(nullptr);
+        if (ec) {
+            return nullptr;
+        }
+
+        for (auto it = boost::filesystem::directory_iterator(directory, ec);
+             !ec && it != boost::filesystem::directory_iterator();
+             it.increment(ec)) {
+            auto name            = it->path().filename().wstring();
+            listing->names[name] = name;
+            listing->names.emplace(boost::algorithm::to_lower_copy(name), std::move(name));
+        }
+        if (ec) {
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        listings_[directory.wstring()] = listing;
+        return listing;
+    }
+
+    std::shared_ptr<const directory_listing> get(const boost::filesystem::path& directory)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = listings_.find(directory.wstring());
+            if (it != listings_.end()) {
+                return it->second;
+            }
+        }
+        return read(directory);
+    }
+
+    // NOTE: Modification times have a resolution of a second, so a listing read in the same second as the directory
+    // was modified may miss the last changes and is read again on the next miss.
+    static bool is_stale(const directory_listing& listing, const boost::filesystem::path& directory)
+    {
+        boost::system::error_code ec;
+        const auto                write_time = boost::filesystem::last_write_time(directory, ec);
+        return ec || write_time != listing.write_time || listing.write_time >= listing.read_time;
+    }
+
+    void erase(const boost::filesystem::path& directory)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listings_.erase(directory.wstring());
+    }
+
+    boost::optional<boost::filesystem::path> find(const boost::filesystem::path& path)
+    {
+        boost::filesystem::path result;
+
+        for (auto& part : path) {
+            if (!result.has_root_directory() || part == L"." || part == L"..") {
+                result /= part;
+                continue;
+            }
+
+            auto listing = get(result);
+            if (!listing) {
+                return boost::none;
+            }
+
+            auto found = listing->find(part.wstring());
+            if (!found && is_stale(*listing, result)) {
+                listing = read(result);
+                found   = listing ? listing->find(part.wstring()) : nullptr;
+            }
+            if (!found) {
+                return boost::none;
+            }
+
+            result /= *found;
+        }
+
+        return result;
+    }
+};
+
+std::shared_ptr<path_index> get_path_index()
+{
+    // NOTE: Shared with the thread warming the index, which may outlive static destruction.
+    static auto index = std::make_shared<path_index>();
+    return index;
+}
+
+} // namespace
+
 boost::filesystem::path get_relative(const boost::filesystem::path& file, const boost::filesystem::path& relative_to)
 {
     auto result       = file.filename();
@@ -56,4 +187,47 @@ boost::filesystem::path get_relative_without_extension(const boost::filesystem::
     return get_relative(file.parent_path() / file.stem(), relative_to);
 }
 
+boost::optional<boost::filesystem::path> find_in_path_index(const boost::filesystem::path& path)
+{
+    auto index  = get_path_index();
+    auto result = index->find(path);
+
+    // NOTE: Entries renamed or removed since their directory was read are found in the index but not on disk, in
+    // which case the directories along the path are read again.
+    if (result && !boost::filesystem::exists(*result)) {
+        for (auto parent = result->parent_path(); !parent.empty(); parent = parent.parent_path()) {
+            index->erase(parent);
+        }
+        result = index->find(path);
+    }
+
+    return result;
+}
+
+void warm_path_index(std::vector<boost::filesystem::path> folders)
+{
+    auto index = get_path_index();
+
+    std::thread([index, folders = std::move(folders)] {
+        set_thread_name(L"path_index");
+
+        std::size_t count = 0;
+        for (auto& folder : folders) {
+            boost::system::error_code ec;
+
+            index->read(folder);
+            for (auto it = boost::filesystem::recursive_directory_iterator(folder, ec);
+                 !ec && it != boost::filesystem::recursive_directory_iterator();
+                 it.increment(ec)) {
+                if (boost::filesystem::is_directory(it->status())) {
+                    index->read(it->path());
+                    count += 1;
+                }
+            }
+        }
+
+        CASPAR_LOG(debug) << L"[filesystem] Indexed " << count << L" folders.";
+    }).detach();
+}
+
 } // namespace caspar
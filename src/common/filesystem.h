@@ -23,7 +23,10 @@
 
 #include <boost/filesystem/path.hpp>
 
+#include <boost/optional.hpp>
+
 #include <string>
+#include <vector>
 
 namespace caspar {
 
@@ -31,4 +34,12 @@ boost::filesystem::path get_relative(const boost::filesystem::path& file, const
 boost::filesystem::path get_relative_without_extension(const boost::filesystem::path& file,
                                                        const boost::filesystem::path& relative_to);
 
+// Resolves an absolute path whose components may differ in case from the names on disk, using a process wide index
+// of directory listings. A listing is read once and only read again when a lookup misses in a directory which has
+// been modified since, so resolving a path costs one lookup per component. Used by find_case_insensitive.
+boost::optional<boost::filesystem::path> find_in_path_index(const boost::filesystem::path& path);
+
+// Reads the listings of the folders and everything below them into the path index on a background thread.
+void warm_path_index(std::vector<boost::filesystem::path> folders);
+
 } // namespace caspar
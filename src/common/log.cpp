@@ -29,6 +29,8 @@
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/bounded_fifo_queue.hpp>
+#include <boost/log/sinks/drop_on_overflow.hpp>
 #include <boost/log/sinks/sync_frontend.hpp>
 #include <boost/log/sinks/text_file_backend.hpp>
 #include <boost/log/sinks/text_ostream_backend.hpp>
@@ -52,6 +54,10 @@ namespace keywords = boost::log::keywords;
 
 namespace caspar { namespace log {
 
+// NOTE: Records are written by the sinks' own threads. A full queue drops new records rather than blocking the
+// logging thread, e.g. a channel thread while the log file's disk stalls.
+typedef sinks::bounded_fifo_queue<4096, sinks::drop_on_overflow> sink_queue;
+
 std::string current_exception_diagnostic_information()
 {
     {
@@ -159,7 +165,7 @@ void my_formatter(bool print_all_characters, const boost::log::record_view& rec,
 
 void add_file_sink(const std::wstring& file)
 {
-    typedef boost::log::sinks::synchronous_sink<boost::log::sinks::text_file_backend> file_sink_type;
+    typedef boost::log::sinks::asynchronous_sink<boost::log::sinks::text_file_backend, sink_queue> file_sink_type;
 
     try {
         if (!boost::filesystem::is_directory(boost::filesystem::path(file).parent_path())) {
@@ -189,7 +195,7 @@ void add_cout_sink()
                                                       return boost::posix_time::microsec_clock::local_time();
                                                   }));
 
-    typedef sinks::asynchronous_sink<sinks::wtext_ostream_backend> stream_sink_type;
+    typedef sinks::asynchronous_sink<sinks::wtext_ostream_backend, sink_queue> stream_sink_type;
 
     auto stream_backend = boost::make_shared<boost::log::sinks::wtext_ostream_backend>();
     stream_backend->add_stream(boost::shared_ptr<std::wostream>(&std::wcout, boost::null_deleter()));
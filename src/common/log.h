@@ -32,6 +32,9 @@
 #define WIN32_LEAN_AND_MEAN
 #include <boost/stacktrace.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <string>
 
 namespace caspar { namespace log {
@@ -62,6 +65,66 @@ typedef boost::log::sources::wseverity_logger_mt<boost::log::trivial::severity_l
 BOOST_LOG_INLINE_GLOBAL_LOGGER_DEFAULT(logger, caspar_logger)
 #define CASPAR_LOG(lvl) BOOST_LOG_SEV(::caspar::log::logger::get(), boost::log::trivial::severity_level::lvl)
 
+// Whether a rate limited message is logged, and how many messages of its call site were dropped before it.
+struct rate_limit_pass
+{
+    bool passed     = false;
+    int  suppressed = 0;
+
+    explicit operator bool() const { return passed; }
+};
+
+template <typename Stream>
+Stream& operator<<(Stream& stream, const rate_limit_pass& pass)
+{
+    if (pass.suppressed > 0) {
+        stream << L"(" << pass.suppressed << L" similar messages suppressed) ";
+    }
+    return stream;
+}
+
+// Lets through at most one message per interval, without locking.
+class rate_limit
+{
+    const std::int64_t        interval_;
+    std::atomic<std::int64_t> next_{0};
+    std::atomic<int>          suppressed_{0};
+
+  public:
+    explicit rate_limit(double per_second)
+        : interval_(static_cast<std::int64_t>(1e9 / per_second))
+    {
+    }
+
+    rate_limit_pass pass()
+    {
+        using namespace std::chrono;
+
+        auto now  = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        auto next = next_.load(std::memory_order_relaxed);
+
+        rate_limit_pass result;
+        if (now < next || !next_.compare_exchange_strong(next, now + interval_)) {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return result;
+        }
+        result.passed     = true;
+        result.suppressed = suppressed_.exchange(0);
+        return result;
+    }
+};
+
+// Logs at most per_second messages of the call site, e.g. warnings from per frame paths, and notes how many were
+// dropped in the next one which passes.
+#define CASPAR_LOG_LIMITED(lvl, per_second)                                                                            \
+    for (auto caspar_log_pass_ = [] {                                                                                  \
+             static ::caspar::log::rate_limit limit(per_second);                                                       \
+             return limit.pass();                                                                                      \
+         }();                                                                                                          \
+         caspar_log_pass_;                                                                                             \
+         caspar_log_pass_ = ::caspar::log::rate_limit_pass{})                                                          \
+    CASPAR_LOG(lvl) << caspar_log_pass_
+
 void          add_file_sink(const std::wstring& file);
 void          add_cout_sink();
 bool          set_log_level(const std::wstring& lvl);
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace caspar {
+
+// Copies using non-temporal stores, which bypass the cache. Suited for write combined memory, such as persistently
+// mapped GL buffers, which is not read back by the CPU.
+static void* stream_memcpy(void* dest, const void* source, size_t count)
+{
+    auto dest8   = reinterpret_cast<std::uint8_t*>(dest);
+    auto source8 = reinterpret_cast<const std::uint8_t*>(source);
+
+    auto head = std::min(count, (16 - reinterpret_cast<std::uintptr_t>(dest8) % 16) % 16);
+    std::memcpy(dest8, source8, head);
+    dest8 += head;
+    source8 += head;
+    count -= head;
+
+    __m128i*       dest128   = reinterpret_cast<__m128i*>(dest8);
+    const __m128i* source128 = reinterpret_cast<const __m128i*>(source8);
+
+    __m128i xmm0, xmm1, xmm2, xmm3;
+
+    for (size_t n = 0; n < count / 64; ++n) {
+        xmm0 = _mm_loadu_si128(source128++);
+        xmm1 = _mm_loadu_si128(source128++);
+        xmm2 = _mm_loadu_si128(source128++);
+        xmm3 = _mm_loadu_si128(source128++);
+
+        _mm_stream_si128(dest128++, xmm0);
+        _mm_stream_si128(dest128++, xmm1);
+        _mm_stream_si128(dest128++, xmm2);
+        _mm_stream_si128(dest128++, xmm3);
+    }
+    _mm_sfence();
+
+    auto tail = count % 64;
+    std::memcpy(dest8 + count - tail, source8 + count - tail, tail);
+
+    return dest;
+}
+
+// Splits large copies into chunks which are streamed in parallel on TBB workers.
+static void* parallel_memcpy(void* dest, const void* source, size_t count)
+{
+    static const size_t chunk = 1 << 20;
+
+    if (count < 2 * chunk) {
+        return stream_memcpy(dest, source, count);
+    }
+
+    auto dest8   = reinterpret_cast<std::uint8_t*>(dest);
+    auto source8 = reinterpret_cast<const std::uint8_t*>(source);
+
+    tbb::parallel_for(size_t(0), (count + chunk - 1) / chunk, [&](size_t n) {
+        auto offset = n * chunk;
+        stream_memcpy(dest8 + offset, source8 + offset, std::min(chunk, count - offset));
+    });
+
+    return dest;
+}
+
+} // namespace caspar
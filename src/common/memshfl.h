@@ -24,32 +24,132 @@
 #ifdef _MSC_VER
 #include <intrin.h>
 #else
-#include <tmmintrin.h>
+#include <immintrin.h>
+#endif
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _MSC_VER
+#define CASPAR_TARGET_AVX2
+#else
+#define CASPAR_TARGET_AVX2 __attribute__((target("avx2")))
 #endif
 
 namespace caspar {
 
-static void* aligned_memshfl(void* dest, const void* source, size_t count, int m1, int m2, int m3, int m4)
+namespace detail {
+
+static bool has_avx2()
 {
-    __m128i*       dest128   = reinterpret_cast<__m128i*>(dest);
-    const __m128i* source128 = reinterpret_cast<const __m128i*>(source);
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    // NOTE: The OS must also save the ymm registers on context switches.
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
 
-    count /= 16; // 128 bit
+// Shuffles whole 16 byte blocks, returns the number of bytes done.
+static size_t memshfl_ssse3(std::uint8_t* dest, const std::uint8_t* source, size_t count, __m128i mask)
+{
+    auto       dest128   = reinterpret_cast<__m128i*>(dest);
+    auto       source128 = reinterpret_cast<const __m128i*>(source);
+    const auto aligned   = reinterpret_cast<std::uintptr_t>(dest) % 16 == 0;
 
-    __m128i xmm0, xmm1, xmm2, xmm3;
+    for (size_t n = 0; n < count / 16; ++n) {
+        auto xmm0 = _mm_shuffle_epi8(_mm_loadu_si128(source128++), mask);
+        if (aligned) {
+            _mm_stream_si128(dest128++, xmm0);
+        } else {
+            _mm_storeu_si128(dest128++, xmm0);
+        }
+    }
 
-    const __m128i mask128 = _mm_set_epi32(m1, m2, m3, m4);
-    for (size_t n = 0; n < count / 4; ++n) {
-        xmm0 = _mm_load_si128(source128++);
-        xmm1 = _mm_load_si128(source128++);
-        xmm2 = _mm_load_si128(source128++);
-        xmm3 = _mm_load_si128(source128++);
+    return count / 16 * 16;
+}
+
+// Shuffles whole 32 byte blocks, returns the number of bytes done. The shuffle of each 32 byte block stays within its
+// two 16 byte halves, as in memshfl_ssse3.
+CASPAR_TARGET_AVX2 static size_t
+memshfl_avx2(std::uint8_t* dest, const std::uint8_t* source, size_t count, __m128i mask)
+{
+    auto       dest256   = reinterpret_cast<__m256i*>(dest);
+    auto       source256 = reinterpret_cast<const __m256i*>(source);
+    const auto mask256   = _mm256_broadcastsi128_si256(mask);
+    const auto aligned   = reinterpret_cast<std::uintptr_t>(dest) % 32 == 0;
 
-        _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm0, mask128));
-        _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm1, mask128));
-        _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm2, mask128));
-        _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm3, mask128));
+    for (size_t n = 0; n < count / 32; ++n) {
+        auto ymm0 = _mm256_shuffle_epi8(_mm256_loadu_si256(source256++), mask256);
+        if (aligned) {
+            _mm256_stream_si256(dest256++, ymm0);
+        } else {
+            _mm256_storeu_si256(dest256++, ymm0);
+        }
     }
+
+    return count / 32 * 32;
+}
+
+} // namespace detail
+
+// Shuffles the bytes of every 16 byte block of source into dest, as _mm_shuffle_epi8 with the mask
+// _mm_set_epi32(m1, m2, m3, m4) does. Neither pointer needs to be aligned and count needs not be a multiple of 16, a
+// trailing partial block is shuffled as if it was padded with zeros. Uses avx2 when the cpu supports it.
+static void* memshfl(void* dest, const void* source, size_t count, int m1, int m2, int m3, int m4)
+{
+    static const bool avx2 = detail::has_avx2();
+
+    auto       dest8   = reinterpret_cast<std::uint8_t*>(dest);
+    auto       source8 = reinterpret_cast<const std::uint8_t*>(source);
+    const auto mask128 = _mm_set_epi32(m1, m2, m3, m4);
+
+    size_t done = avx2 ? detail::memshfl_avx2(dest8, source8, count, mask128) : 0;
+    done += detail::memshfl_ssse3(dest8 + done, source8 + done, count - done, mask128);
+    _mm_sfence();
+
+    if (done < count) {
+        std::uint8_t block[16] = {};
+        std::memcpy(block, source8 + done, count - done);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(block),
+                         _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block)), mask128));
+        std::memcpy(dest8 + done, block, count - done);
+    }
+
+    return dest;
+}
+
+// Splits large shuffles into chunks which are shuffled in parallel on TBB workers.
+static void* parallel_memshfl(void* dest, const void* source, size_t count, int m1, int m2, int m3, int m4)
+{
+    static const size_t chunk = 1 << 20;
+
+    if (count < 2 * chunk) {
+        return memshfl(dest, source, count, m1, m2, m3, m4);
+    }
+
+    auto dest8   = reinterpret_cast<std::uint8_t*>(dest);
+    auto source8 = reinterpret_cast<const std::uint8_t*>(source);
+
+    tbb::parallel_for(size_t(0), (count + chunk - 1) / chunk, [&](size_t n) {
+        auto offset = n * chunk;
+        memshfl(dest8 + offset, source8 + offset, std::min(chunk, count - offset), m1, m2, m3, m4);
+    });
+
     return dest;
 }
 
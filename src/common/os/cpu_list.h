@@ -0,0 +1,36 @@
+#pragma once
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <string>
+#include <vector>
+
+namespace caspar {
+
+// The cpus of a list like "0-3,8,10-11", the format of Linux cpulist files. Throws boost::bad_lexical_cast on a
+// malformed list.
+template <typename Char>
+std::vector<int> parse_cpu_list(const std::basic_string<Char>& list)
+{
+    std::vector<std::basic_string<Char>> ranges;
+    boost::split(ranges, list, boost::is_any_of(","));
+
+    std::vector<int> result;
+    for (auto& range : ranges) {
+        boost::trim(range);
+        if (range.empty()) {
+            continue;
+        }
+
+        auto dash  = range.find('-');
+        auto first = boost::lexical_cast<int>(range.substr(0, dash));
+        auto last  = dash == std::basic_string<Char>::npos ? first : boost::lexical_cast<int>(range.substr(dash + 1));
+        for (auto cpu = first; cpu <= last; ++cpu) {
+            result.push_back(cpu);
+        }
+    }
+    return result;
+}
+
+} // namespace caspar
@@ -23,9 +23,8 @@
 
 #include "../filesystem.h"
 
-#include <list>
+#include "../../filesystem.h"
 
-#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 
 using namespace boost::filesystem;
@@ -39,33 +38,11 @@ boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_ins
     if (exists(p))
         return case_insensitive;
 
-    p = absolute(p);
-    path result;
+    auto result = find_in_path_index(absolute(p));
+    if (!result)
+        return boost::none;
 
-    for (auto part : p) {
-        auto concatenated = result / part;
-
-        if (exists(concatenated)) {
-            result = concatenated;
-        } else {
-            bool found = false;
-
-            for (auto it = directory_iterator(absolute(result)); it != directory_iterator(); ++it) {
-                auto leaf = it->path().leaf();
-
-                if (boost::algorithm::iequals(part.wstring(), leaf.wstring())) {
-                    result = result / leaf;
-                    found  = true;
-                    break;
-                }
-            }
-
-            if (!found)
-                return boost::none;
-        }
-    }
-
-    return result.wstring();
+    return result->wstring();
 }
 
 } // namespace caspar
@@ -0,0 +1,85 @@
+#include "../memory.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace caspar {
+
+namespace {
+
+const std::size_t huge_page_size = 2 * 1024 * 1024;
+
+std::atomic<bool> huge_pages_{true};
+std::atomic<bool> lock_{false};
+
+std::size_t page_size()
+{
+    static const auto size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+std::size_t round_up(std::size_t size, std::size_t alignment) { return (size + alignment - 1) / alignment * alignment; }
+
+} // namespace
+
+void configure_frame_memory(bool huge_pages, bool lock)
+{
+    huge_pages_ = huge_pages;
+    lock_       = lock;
+}
+
+// NOTE: Blocks of at least a huge page are mapped on a huge page boundary, as transparent huge pages only back
+// aligned ranges. The surplus of the larger mapping is unmapped again.
+void* allocate_frame_memory(std::size_t size)
+{
+    if (size < huge_page_size || !huge_pages_) {
+        void* ptr = nullptr;
+        return posix_memalign(&ptr, page_size(), round_up(size, page_size())) == 0 ? ptr : nullptr;
+    }
+
+    const auto length = round_up(size, huge_page_size);
+    auto       mapped = mmap(nullptr, length + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto begin   = reinterpret_cast<std::uintptr_t>(mapped);
+    auto aligned = round_up(begin, huge_page_size);
+    if (aligned > begin) {
+        munmap(mapped, aligned - begin);
+    }
+    munmap(reinterpret_cast<void*>(aligned + length), begin + huge_page_size - aligned);
+
+    auto ptr = reinterpret_cast<void*>(aligned);
+    madvise(ptr, length, MADV_HUGEPAGE);
+    return ptr;
+}
+
+void free_frame_memory(void* ptr, std::size_t size)
+{
+    if (!ptr) {
+        return;
+    }
+    if (size < huge_page_size || !huge_pages_) {
+        if (lock_) {
+            munlock(ptr, size);
+        }
+        std::free(ptr);
+    } else {
+        munmap(ptr, round_up(size, huge_page_size));
+    }
+}
+
+bool prefault_frame_memory(void* ptr, std::size_t size)
+{
+    auto bytes = static_cast<volatile char*>(ptr);
+    for (std::size_t offset = 0; offset < size; offset += page_size()) {
+        bytes[offset] = bytes[offset];
+    }
+    return !lock_ || mlock(ptr, size) == 0;
+}
+
+} // namespace caspar
@@ -1,7 +1,86 @@
 #include "../thread.h"
 
+#include "../../diagnostics/trace.h"
+#include "../../log.h"
+#include "../../utf.h"
+#include "../cpu_list.h"
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 namespace caspar {
 
-void set_thread_name(std::wstring name) {}
+void set_thread_name(std::wstring name) { diagnostics::trace::name_thread(name); }
+
+bool set_thread_affinity(const std::wstring& cpus)
+{
+    if (cpus.empty()) {
+        return true;
+    }
+
+    try {
+        std::vector<int> list;
+        if (boost::istarts_with(cpus, L"node:")) {
+            std::ifstream file("/sys/devices/system/node/node" + u8(cpus.substr(5)) + "/cpulist");
+            std::string   line;
+            if (!std::getline(file, line)) {
+                CASPAR_LOG(warning) << L"Unknown NUMA node in affinity " << cpus << L".";
+                return false;
+            }
+            list = parse_cpu_list(line);
+        } else {
+            list = parse_cpu_list(cpus);
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu : list) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+
+        if (CPU_COUNT(&set) == 0 || pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            CASPAR_LOG(warning) << L"Failed to set thread affinity " << cpus << L".";
+            return false;
+        }
+    } catch (boost::bad_lexical_cast&) {
+        CASPAR_LOG(warning) << L"Invalid thread affinity " << cpus << L".";
+        return false;
+    }
+
+    return true;
+}
+
+bool set_thread_realtime_priority()
+{
+    // NOTE: Below the priorities of kernel interrupt threads, which run at 50, so that capture and network interrupts
+    // are still served.
+    sched_param param    = {};
+    param.sched_priority = std::min(40, sched_get_priority_max(SCHED_FIFO));
+
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+        CASPAR_LOG(warning) << L"Failed to set real-time thread priority, CAP_SYS_NICE or an rtprio limit is needed.";
+        return false;
+    }
+    return true;
+}
+
+bool set_thread_low_priority()
+{
+    // NOTE: On Linux the nice value of a thread id only applies to that thread.
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10) != 0) {
+        CASPAR_LOG(warning) << L"Failed to set low thread priority.";
+        return false;
+    }
+    return true;
+}
 
-} // namespace caspar
\ No newline at end of file
+} // namespace caspar
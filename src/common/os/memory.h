@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+namespace caspar {
+
+// Whether frame memory is backed by huge pages where the system allows it, and whether the frame memory reserved
+// with prefault_frame_memory is locked in physical memory. Set once at startup, before any frame is allocated.
+void configure_frame_memory(bool huge_pages, bool lock);
+
+// Page aligned memory for frames. Blocks of at least a huge page are backed by huge pages if configured, transparent
+// huge pages on Linux and large pages on Windows, which needs the lock pages in memory privilege. Returns nullptr if
+// the memory could not be allocated. Blocks must be freed with the size they were allocated with.
+void* allocate_frame_memory(std::size_t size);
+void  free_frame_memory(void* ptr, std::size_t size);
+
+// Touches every page of the block so that it is mapped before playout needs it, and locks it if configured. Returns
+// false if the system refused to lock the block, which is then only pre-faulted.
+bool prefault_frame_memory(void* ptr, std::size_t size);
+
+} // namespace caspar
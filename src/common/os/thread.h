@@ -5,4 +5,16 @@
 namespace caspar {
 
 void set_thread_name(std::wstring name);
-}
\ No newline at end of file
+
+// Restricts the calling thread to a set of cpus, listed as "0-3,8" or given as "node:1" for the cpus of a NUMA node.
+// An empty set leaves the thread as it is. Returns false if the set was invalid or refused by the system.
+bool set_thread_affinity(const std::wstring& cpus);
+
+// Schedules the calling thread in real-time, with SCHED_FIFO on Linux and MMCSS on Windows. Returns false if the
+// system refused, usually for lack of privileges.
+bool set_thread_realtime_priority();
+
+// Schedules the calling thread below normal priority, for background work which must not delay playout.
+bool set_thread_low_priority();
+
+} // namespace caspar
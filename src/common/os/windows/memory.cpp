@@ -0,0 +1,63 @@
+#include "../memory.h"
+
+#include <atomic>
+
+#include <windows.h>
+
+namespace caspar {
+
+namespace {
+
+std::atomic<bool> huge_pages_{true};
+std::atomic<bool> lock_{false};
+
+std::size_t page_size()
+{
+    static const auto size = [] {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return static_cast<std::size_t>(info.dwPageSize);
+    }();
+    return size;
+}
+
+} // namespace
+
+void configure_frame_memory(bool huge_pages, bool lock)
+{
+    huge_pages_ = huge_pages;
+    lock_       = lock;
+}
+
+// NOTE: Large pages are only granted to processes holding SeLockMemoryPrivilege, and are always resident. Without
+// the privilege the allocation falls back to regular pages.
+void* allocate_frame_memory(std::size_t size)
+{
+    const auto large_page_size = GetLargePageMinimum();
+    if (huge_pages_ && large_page_size > 0 && size >= large_page_size) {
+        auto length = (size + large_page_size - 1) / large_page_size * large_page_size;
+        auto ptr    = VirtualAlloc(nullptr, length, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (ptr) {
+            return ptr;
+        }
+    }
+    return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void free_frame_memory(void* ptr, std::size_t)
+{
+    if (ptr) {
+        VirtualFree(ptr, 0, MEM_RELEASE);
+    }
+}
+
+bool prefault_frame_memory(void* ptr, std::size_t size)
+{
+    auto bytes = static_cast<volatile char*>(ptr);
+    for (std::size_t offset = 0; offset < size; offset += page_size()) {
+        bytes[offset] = bytes[offset];
+    }
+    return !lock_ || VirtualLock(ptr, size) != 0;
+}
+
+} // namespace caspar
@@ -5,7 +5,12 @@
 
 #include <windows.h>
 
+#include "../../diagnostics/trace.h"
+#include "../../log.h"
 #include "../../utf.h"
+#include "../cpu_list.h"
+
+#include <boost/algorithm/string/predicate.hpp>
 
 namespace caspar {
 
@@ -32,6 +37,76 @@ inline void SetThreadName(DWORD dwThreadID, LPCSTR szThreadName)
     }
 }
 
-void set_thread_name(std::wstring name) { SetThreadName(GetCurrentThreadId(), u8(name).c_str()); }
+void set_thread_name(std::wstring name)
+{
+    SetThreadName(GetCurrentThreadId(), u8(name).c_str());
+    diagnostics::trace::name_thread(name);
+}
+
+bool set_thread_affinity(const std::wstring& cpus)
+{
+    if (cpus.empty()) {
+        return true;
+    }
+
+    GROUP_AFFINITY affinity = {};
+    try {
+        if (boost::istarts_with(cpus, L"node:")) {
+            if (!GetNumaNodeProcessorMaskEx(boost::lexical_cast<USHORT>(cpus.substr(5)), &affinity)) {
+                CASPAR_LOG(warning) << L"Unknown NUMA node in affinity " << cpus << L".";
+                return false;
+            }
+        } else {
+            // NOTE: Cpus are numbered within the first processor group, which holds all cpus of machines with up to
+            // 64 of them.
+            for (auto cpu : parse_cpu_list(cpus)) {
+                if (cpu >= 0 && cpu < 64) {
+                    affinity.Mask |= KAFFINITY(1) << cpu;
+                }
+            }
+        }
+    } catch (boost::bad_lexical_cast&) {
+        CASPAR_LOG(warning) << L"Invalid thread affinity " << cpus << L".";
+        return false;
+    }
+
+    if (affinity.Mask == 0 || !SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr)) {
+        CASPAR_LOG(warning) << L"Failed to set thread affinity " << cpus << L".";
+        return false;
+    }
+    return true;
+}
+
+bool set_thread_realtime_priority()
+{
+    // NOTE: avrt.dll is loaded on demand, so that it is not a link dependency of every module.
+    typedef HANDLE(WINAPI * set_characteristics_t)(LPCWSTR, LPDWORD);
+
+    static auto set_characteristics = [] {
+        auto avrt = LoadLibraryW(L"avrt.dll");
+        return avrt ? reinterpret_cast<set_characteristics_t>(GetProcAddress(avrt, "AvSetMmThreadCharacteristicsW"))
+                    : nullptr;
+    }();
+
+    DWORD task_index = 0;
+    if (set_characteristics && set_characteristics(L"Pro Audio", &task_index)) {
+        return true;
+    }
+
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+        CASPAR_LOG(warning) << L"Failed to set real-time thread priority.";
+        return false;
+    }
+    return true;
+}
+
+bool set_thread_low_priority()
+{
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL)) {
+        CASPAR_LOG(warning) << L"Failed to set low thread priority.";
+        return false;
+    }
+    return true;
+}
 
-} // namespace caspar
\ No newline at end of file
+} // namespace caspar
@@ -21,7 +21,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 
 namespace caspar {
 
@@ -45,4 +47,27 @@ class timer
     }
 };
 
+// Adds the nanoseconds spent in its scope to total, for counters of the time taken by a stage of work.
+class scoped_timer
+{
+    std::atomic<std::int64_t>&            total_;
+    std::chrono::steady_clock::time_point started_ = std::chrono::steady_clock::now();
+
+  public:
+    explicit scoped_timer(std::atomic<std::int64_t>& total)
+        : total_(total)
+    {
+    }
+
+    ~scoped_timer()
+    {
+        using namespace std::chrono;
+
+        total_ += duration_cast<nanoseconds>(steady_clock::now() - started_).count();
+    }
+
+    scoped_timer(const scoped_timer&) = delete;
+    scoped_timer& operator=(const scoped_timer&) = delete;
+};
+
 } // namespace caspar
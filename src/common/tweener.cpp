@@ -51,6 +51,7 @@
 
 #include "except.h"
 
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
 
@@ -468,11 +469,14 @@ tweener_t get_tweener(std::wstring name)
 tweener::tweener(const std::wstring& name)
     : func_(get_tweener(name))
     , name_(name)
+    , affine_(!boost::icontains(name, L"elastic") || std::count(name.begin(), name.end(), L':') < 2)
 {
 }
 
 double tweener::operator()(double t, double b, double c, double d) const { return func_(t, b, c, d); }
 
+bool tweener::is_affine() const { return affine_; }
+
 bool tweener::operator==(const tweener& other) const { return name_ == other.name_; }
 
 bool tweener::operator!=(const tweener& other) const { return !(*this == other); }
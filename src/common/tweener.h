@@ -71,12 +71,21 @@ class tweener
      */
     double operator()(double t, double b, double c, double d) const;
 
+    /**
+     * @return Whether the tweened value is always b + c * f(t, d), so that the
+     *         value tweened from 0 to 1 can be used to tween any other values
+     *         at the same timepoint. Only elastic tweens with an explicit
+     *         amplitude are not.
+     */
+    bool is_affine() const;
+
     bool operator==(const tweener& other) const;
     bool operator!=(const tweener& other) const;
 
   private:
     std::function<double(double, double, double, double)> func_;
     std::wstring                                          name_;
+    bool                                                  affine_;
 };
 
 } // namespace caspar
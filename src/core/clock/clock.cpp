@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "clock.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifndef _MSC_VER
+#include <time.h>
+#endif
+
+namespace caspar { namespace core {
+
+struct system_clock final : public reference_clock
+{
+    std::chrono::nanoseconds now() const override
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch());
+    }
+
+    std::wstring print() const override { return L"system-clock"; }
+};
+
+// Frame boundaries aligned to the PTP (TAI) epoch, so that machines whose system time is disciplined by a PTP daemon,
+// e.g. ptp4l and phc2sys, tick in phase. Falls back to the UTC wall clock where CLOCK_TAI is not available.
+struct ptp_clock final : public reference_clock
+{
+    std::chrono::nanoseconds now() const override
+    {
+#if !defined(_MSC_VER) && defined(CLOCK_TAI)
+        timespec ts;
+        if (clock_gettime(CLOCK_TAI, &ts) == 0) {
+            return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+        }
+#endif
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch());
+    }
+
+    std::wstring print() const override { return L"ptp-clock"; }
+};
+
+struct reference_clock_registry::impl
+{
+    std::map<std::wstring, reference_clock_factory_t> factories;
+};
+
+reference_clock_registry::reference_clock_registry()
+    : impl_(new impl())
+{
+    register_clock_factory(L"system", [](const std::vector<std::wstring>&, const video_format_desc&) {
+        return spl::make_shared<system_clock>();
+    });
+    register_clock_factory(L"ptp", [](const std::vector<std::wstring>&, const video_format_desc&) {
+        return spl::make_shared<ptp_clock>();
+    });
+}
+
+void reference_clock_registry::register_clock_factory(const std::wstring&              name,
+                                                      const reference_clock_factory_t& factory)
+{
+    impl_->factories[boost::to_lower_copy(name)] = factory;
+}
+
+spl::shared_ptr<reference_clock> reference_clock_registry::create_clock(const std::vector<std::wstring>& params,
+                                                                        const video_format_desc& format_desc) const
+{
+    if (params.empty())
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("params cannot be empty"));
+
+    auto found = impl_->factories.find(boost::to_lower_copy(params.at(0)));
+
+    if (found == impl_->factories.end())
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No clock registered with name " + params.at(0)));
+
+    return found->second(params, format_desc);
+}
+
+struct clock_scheduler::impl
+{
+    struct waiter
+    {
+        std::int64_t             frame;
+        std::promise<clock_tick> promise;
+    };
+
+    const spl::shared_ptr<reference_clock> clock_;
+
+    std::mutex                                      mutex_;
+    std::condition_variable                         cond_;
+    std::multimap<std::chrono::nanoseconds, waiter> waiters_;
+    bool                                            abort_request_ = false;
+    std::thread                                     thread_;
+
+    impl(spl::shared_ptr<reference_clock> clock)
+        : clock_(std::move(clock))
+    {
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_request_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    void run()
+    {
+        set_thread_name(L"[clock_scheduler]");
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!abort_request_) {
+            if (waiters_.empty()) {
+                cond_.wait(lock);
+                continue;
+            }
+
+            auto now      = clock_->now();
+            auto deadline = waiters_.begin()->first;
+
+            // The reference may drift against the steady clock, so it is read again after every wake up.
+            if (deadline > now) {
+                cond_.wait_until(lock, std::chrono::steady_clock::now() + (deadline - now));
+                continue;
+            }
+
+            while (!waiters_.empty() && waiters_.begin()->first <= now) {
+                auto it = waiters_.begin();
+                it->second.promise.set_value(clock_tick{it->second.frame, now - it->first});
+                waiters_.erase(it);
+            }
+        }
+    }
+
+    clock_tick wait(std::chrono::nanoseconds duration)
+    {
+        if (duration.count() <= 0)
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("duration must be positive"));
+
+        const auto frame = clock_->now() / duration + 1;
+
+        std::future<clock_tick> future;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = waiters_.emplace(frame * duration, waiter{frame, std::promise<clock_tick>()});
+            future  = it->second.promise.get_future();
+        }
+        cond_.notify_all();
+
+        return future.get();
+    }
+};
+
+clock_scheduler::clock_scheduler(spl::shared_ptr<reference_clock> clock)
+    : impl_(new impl(std::move(clock)))
+{
+}
+clock_scheduler::~clock_scheduler() {}
+clock_tick   clock_scheduler::wait(std::chrono::nanoseconds duration) { return impl_->wait(duration); }
+std::wstring clock_scheduler::print() const { return impl_->clock_->print(); }
+
+}} // namespace caspar::core
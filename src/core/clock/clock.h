@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../fwd.h"
+
+#include <common/memory.h>
+
+#include <boost/core/noncopyable.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+
+class reference_clock
+{
+  public:
+    reference_clock()                       = default;
+    reference_clock(const reference_clock&) = delete;
+    virtual ~reference_clock() {}
+
+    reference_clock& operator=(const reference_clock&) = delete;
+
+    // Time elapsed since the epoch of the reference. Frame boundaries are multiples of the frame duration.
+    virtual std::chrono::nanoseconds now() const   = 0;
+    virtual std::wstring             print() const = 0;
+};
+
+typedef std::function<spl::shared_ptr<reference_clock>(const std::vector<std::wstring>& params,
+                                                       const video_format_desc&         format_desc)>
+    reference_clock_factory_t;
+
+class reference_clock_registry : boost::noncopyable
+{
+  public:
+    reference_clock_registry();
+    void register_clock_factory(const std::wstring& name, const reference_clock_factory_t& factory);
+
+    // params[0] is the name of the clock, e.g. "system", "ptp" or "decklink 1".
+    spl::shared_ptr<reference_clock> create_clock(const std::vector<std::wstring>& params,
+                                                  const video_format_desc&         format_desc) const;
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+};
+
+struct clock_tick final
+{
+    std::int64_t             frame = 0; // Frame boundary number on the reference.
+    std::chrono::nanoseconds phase_error{0};
+};
+
+// Wakes every channel sharing a reference clock on the same frame boundaries, from a single deadline driven thread.
+class clock_scheduler final
+{
+    clock_scheduler(const clock_scheduler&);
+    clock_scheduler& operator=(const clock_scheduler&);
+
+  public:
+    explicit clock_scheduler(spl::shared_ptr<reference_clock> clock);
+    ~clock_scheduler();
+
+    // Blocks until the next frame boundary of duration on the reference.
+    clock_tick wait(std::chrono::nanoseconds duration);
+
+    std::wstring print() const;
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::core
@@ -124,6 +124,11 @@ class destroy_consumer_proxy : public frame_consumer
     bool                  has_synchronization_clock() const override { return consumer_->has_synchronization_clock(); }
     int                   index() const override { return consumer_->index(); }
     core::monitor::state state() const override { return consumer_->state(); }
+    core::output_format   output_format() const override { return consumer_->output_format(); }
+    bool                  interlaced() const override { return consumer_->interlaced(); }
+    bool                  keyed() const override { return consumer_->keyed(); }
+    core::output_size     output_size() const override { return consumer_->output_size(); }
+    bool                  host_image() const override { return consumer_->host_image(); }
 };
 
 class print_consumer_proxy : public frame_consumer
@@ -155,6 +160,11 @@ class print_consumer_proxy : public frame_consumer
     bool                  has_synchronization_clock() const override { return consumer_->has_synchronization_clock(); }
     int                   index() const override { return consumer_->index(); }
     core::monitor::state state() const override { return consumer_->state(); }
+    core::output_format   output_format() const override { return consumer_->output_format(); }
+    bool                  interlaced() const override { return consumer_->interlaced(); }
+    bool                  keyed() const override { return consumer_->keyed(); }
+    core::output_size     output_size() const override { return consumer_->output_size(); }
+    bool                  host_image() const override { return consumer_->host_image(); }
 };
 
 spl::shared_ptr<core::frame_consumer>
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include "../frame/pixel_format.h"
 #include "../fwd.h"
 #include "../monitor/monitor.h"
 
@@ -60,6 +61,27 @@ class frame_consumer
     virtual std::wstring name() const  = 0;
     virtual bool         has_synchronization_clock() const { return false; }
     virtual int          index() const = 0;
+
+    // The format the consumer reads frames in. Formats other than bgra are converted by the mixer and read with
+    // const_frame::image_data(output_format).
+    virtual core::output_format output_format() const { return core::output_format::bgra; }
+
+    // Whether the consumer outputs each pair of frames of an interlaced channel as the two fields of one frame. The
+    // mixer then weaves every frame with the one before it on the gpu, and the woven frame is read with
+    // const_frame::image_data(output_format) of the second frame of the pair.
+    virtual bool interlaced() const { return false; }
+
+    // Whether the consumer outputs the key of frames besides their fill. The mixer then renders the key as well, which
+    // is read with const_frame::image_data(output_format::key).
+    virtual bool keyed() const { return false; }
+
+    // The size the consumer outputs images in, if it is smaller than the channel. The mixer then scales frames down
+    // on the gpu before they are read back, and the bgra image is read with const_frame::image_data(output_size).
+    virtual core::output_size output_size() const { return {}; }
+
+    // Whether the consumer reads the bgra image of every frame in host memory, with const_frame::image_data(0). The
+    // mixer only reads it back on channels with such a consumer, otherwise it stays on the gpu until it is first read.
+    virtual bool host_image() const { return output_format() == core::output_format::bgra; }
 };
 
 typedef std::function<spl::shared_ptr<frame_consumer>(const std::vector<std::wstring>&,
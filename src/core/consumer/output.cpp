@@ -27,19 +27,266 @@
 #include "../video_format.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
 #include <common/except.h>
 #include <common/memory.h>
+#include <common/os/thread.h>
 
+#include <boost/lexical_cast.hpp>
 #include <boost/optional.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <limits>
 #include <map>
+#include <mutex>
 #include <thread>
 
 namespace caspar { namespace core {
 
 typedef decltype(std::chrono::high_resolution_clock::now()) time_point_t;
 
+class port final
+{
+    const int                       index_;
+    spl::shared_ptr<frame_consumer> consumer_;
+    const port_settings             settings_;
+
+    std::mutex                consumer_mutex_;
+    std::mutex                queue_mutex_;
+    std::condition_variable   queue_cond_;
+    std::deque<const_frame>   queue_;
+    std::deque<std::int64_t>  trace_frames_; // Parallel to queue_.
+    std::deque<const_frame>   delayed_; // Frames held back for settings_.delay, guarded by queue_mutex_.
+    std::chrono::microseconds deadline_;
+
+    // The format the consumer is to be initialized for by the port thread, guarded by queue_mutex_. Frames are only
+    // queued once it has been initialized.
+    boost::optional<std::pair<video_format_desc, int>> pending_format_;
+    std::atomic<bool>                                  ready_{false};
+
+    std::atomic<std::int64_t> dropped_{0};
+    std::atomic<std::int64_t> late_{0};
+    std::atomic<double>       send_time_{0.0};
+    std::atomic<double>       initialize_time_{0.0};
+    std::atomic<bool>         failed_{false};
+    std::atomic<bool>         shed_{false};
+    std::int64_t              shed_count_    = 0; // Only used by send.
+    bool                      abort_request_ = false;
+
+    std::thread thread_;
+
+  public:
+    port(int index, spl::shared_ptr<frame_consumer> consumer, const port_settings& settings)
+        : index_(index)
+        , consumer_(std::move(consumer))
+        , settings_(settings)
+        , deadline_(settings.deadline)
+    {
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~port()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            abort_request_ = true;
+        }
+        queue_cond_.notify_all();
+        thread_.join();
+    }
+
+    port(const port&) = delete;
+    port& operator=(const port&) = delete;
+
+    // Initializes the consumer on the port thread, e.g. opening a device or joining the threads of a previous
+    // format, which may take long. Frames sent meanwhile are skipped, and a consumer which fails to initialize fails
+    // the port.
+    void initialize(const video_format_desc& format_desc, int channel_index)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            queue_.clear();
+            trace_frames_.clear();
+            delayed_.clear();
+            if (settings_.deadline.count() == 0) {
+                deadline_ = std::chrono::microseconds(static_cast<std::int64_t>(1e6 / format_desc.fps));
+            }
+            pending_format_ = std::make_pair(format_desc, channel_index);
+            ready_          = false;
+        }
+        queue_cond_.notify_all();
+    }
+
+    void send(const_frame frame)
+    {
+        if (!ready_) {
+            return;
+        }
+
+        if (shed_ && ++shed_count_ % 2 == 0) {
+            ++dropped_;
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+
+        // NOTE: Delayed frames only hold on to the images the mixer rendered for every consumer, i.e. textures whose
+        // readback is deferred until a consumer reads them and pooled host buffers of converted images, so a delay
+        // costs neither copies nor readbacks of its own.
+        if (settings_.delay > 0) {
+            delayed_.push_back(std::move(frame));
+            if (delayed_.size() <= static_cast<std::size_t>(settings_.delay)) {
+                return;
+            }
+            frame = std::move(delayed_.front());
+            delayed_.pop_front();
+        }
+
+        const auto capacity = static_cast<std::size_t>(std::max(1, settings_.capacity));
+
+        if (queue_.size() >= capacity) {
+            switch (settings_.overflow) {
+                case overflow_policy::drop_newest:
+                    ++dropped_;
+                    return;
+                case overflow_policy::drop_oldest:
+                    queue_.pop_front();
+                    trace_frames_.pop_front();
+                    ++dropped_;
+                    break;
+                case overflow_policy::block:
+                    queue_cond_.wait(lock, [&] { return queue_.size() < capacity || abort_request_ || failed_; });
+                    break;
+            }
+        }
+
+        queue_.push_back(std::move(frame));
+        trace_frames_.push_back(caspar::diagnostics::trace::current_frame());
+        lock.unlock();
+        queue_cond_.notify_all();
+    }
+
+    core::monitor::state state() const
+    {
+        auto state       = consumer_->state();
+        state["dropped"] = dropped_.load();
+        state["late"]    = late_.load();
+        state["shed"]    = shed_.load();
+        state["delay"]   = settings_.delay;
+
+        state["initializing"]               = !ready_;
+        state["profile"]["send-time"]       = send_time_.load();
+        state["profile"]["initialize-time"] = initialize_time_.load();
+        return state;
+    }
+
+    bool failed() const { return failed_; }
+
+    bool ready() const { return ready_; }
+
+    // Sheds the port unless its consumer paces the channel. Returns whether it is shed.
+    bool shed(int priority)
+    {
+        shed_ = settings_.priority < priority && !consumer_->has_synchronization_clock();
+        return shed_;
+    }
+
+    int priority() const { return settings_.priority; }
+
+    int index() const { return index_; }
+
+    const spl::shared_ptr<frame_consumer>& consumer() const { return consumer_; }
+
+  private:
+    void do_initialize(const video_format_desc& format_desc, int channel_index)
+    {
+        try {
+            std::lock_guard<std::mutex>       lock(consumer_mutex_);
+            caspar::diagnostics::trace::scope traced("output::initialize");
+
+            auto start = std::chrono::high_resolution_clock::now();
+            consumer_->initialize(format_desc, channel_index);
+            auto elapsed     = std::chrono::high_resolution_clock::now() - start;
+            initialize_time_ = std::chrono::duration<double, std::milli>(elapsed).count();
+
+            CASPAR_LOG(info) << consumer_->print() << L" Initialized in " << initialize_time_.load() << L" ms.";
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            failed_ = true;
+            return;
+        }
+
+        // NOTE: A format which is requested meanwhile is initialized before the port is ready again.
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        ready_ = !pending_format_;
+    }
+
+    void run()
+    {
+        set_thread_name(L"output port " + boost::lexical_cast<std::wstring>(index_));
+
+        while (true) {
+            const_frame               frame;
+            std::int64_t              trace_frame;
+            std::chrono::microseconds deadline;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex_);
+                queue_cond_.wait(lock, [&] { return !queue_.empty() || pending_format_ || abort_request_; });
+                if (abort_request_) {
+                    return;
+                }
+                if (pending_format_) {
+                    auto format = std::move(*pending_format_);
+                    pending_format_.reset();
+                    lock.unlock();
+
+                    do_initialize(format.first, format.second);
+                    if (failed_) {
+                        queue_cond_.notify_all();
+                        return;
+                    }
+                    continue;
+                }
+                frame = std::move(queue_.front());
+                queue_.pop_front();
+                trace_frame = trace_frames_.front();
+                trace_frames_.pop_front();
+                deadline = deadline_;
+            }
+            queue_cond_.notify_all();
+
+            try {
+                std::lock_guard<std::mutex>             lock(consumer_mutex_);
+                caspar::diagnostics::trace::frame_scope frame_scope(trace_frame);
+                caspar::diagnostics::trace::scope       traced("output::send");
+
+                auto start  = std::chrono::high_resolution_clock::now();
+                auto future = consumer_->send(std::move(frame));
+                if (future.wait_for(deadline) == std::future_status::timeout) {
+                    ++late_;
+                }
+                if (!future.get()) {
+                    failed_ = true;
+                }
+                auto elapsed = std::chrono::high_resolution_clock::now() - start;
+                send_time_   = std::chrono::duration<double, std::milli>(elapsed).count();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                failed_ = true;
+            }
+
+            if (failed_) {
+                queue_cond_.notify_all();
+                return;
+            }
+        }
+    }
+};
+
 struct output::impl
 {
     monitor::state                      state_;
@@ -47,10 +294,12 @@ struct output::impl
     const int                           channel_index_;
     video_format_desc                   format_desc_;
 
-    std::mutex                                     consumers_mutex_;
-    std::map<int, spl::shared_ptr<frame_consumer>> consumers_;
+    std::mutex                           consumers_mutex_;
+    std::map<int, spl::shared_ptr<port>> consumers_;
+    int                                  shed_priority_ = std::numeric_limits<int>::min();
 
     boost::optional<time_point_t> time_;
+    std::atomic<bool>             externally_clocked_{false};
 
   public:
     impl(spl::shared_ptr<diagnostics::graph> graph, const video_format_desc& format_desc, int channel_index)
@@ -60,29 +309,121 @@ struct output::impl
     {
     }
 
-    void add(int index, spl::shared_ptr<frame_consumer> consumer)
+    // NOTE: Consumers are initialized by their ports, so that neither the caller nor the other consumers wait for
+    // them. They get frames once they are initialized.
+    void add(int index, spl::shared_ptr<frame_consumer> consumer, const port_settings& settings)
     {
         remove(index);
 
-        consumer->initialize(format_desc_, channel_index_);
+        auto p = spl::make_shared<port>(index, std::move(consumer), settings);
 
         std::lock_guard<std::mutex> lock(consumers_mutex_);
-        consumers_.emplace(index, std::move(consumer));
+        p->initialize(format_desc_, channel_index_);
+        p->shed(shed_priority_);
+        consumers_.emplace(index, std::move(p));
     }
 
-    void add(const spl::shared_ptr<frame_consumer>& consumer) { add(consumer->index(), consumer); }
+    void add(const spl::shared_ptr<frame_consumer>& consumer, const port_settings& settings)
+    {
+        add(consumer->index(), consumer, settings);
+    }
 
     void remove(int index)
     {
-        std::lock_guard<std::mutex> lock(consumers_mutex_);
-        auto                        it = consumers_.find(index);
-        if (it != consumers_.end()) {
-            consumers_.erase(it);
+        std::shared_ptr<port> removed;
+        {
+            std::lock_guard<std::mutex> lock(consumers_mutex_);
+            auto                        it = consumers_.find(index);
+            if (it != consumers_.end()) {
+                removed = std::move(it->second);
+                consumers_.erase(it);
+            }
         }
+        // Join the port thread outside of the lock.
+        removed.reset();
     }
 
     void remove(const spl::shared_ptr<frame_consumer>& consumer) { remove(consumer->index()); }
 
+    std::vector<output_format> formats()
+    {
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+
+        // NOTE: Converted images are woven on interlaced channels, so bgra is converted as well for consumers which
+        // output fields.
+        const auto interlaced = format_desc_.field_count == 2;
+
+        std::vector<output_format> formats;
+        for (auto& p : consumers_) {
+            auto format = p.second->consumer()->output_format();
+            auto weave  = interlaced && p.second->consumer()->interlaced();
+            if ((format != output_format::bgra || weave) &&
+                std::find(formats.begin(), formats.end(), format) == formats.end()) {
+                formats.push_back(format);
+            }
+            if (p.second->consumer()->keyed() &&
+                std::find(formats.begin(), formats.end(), output_format::key) == formats.end()) {
+                formats.push_back(output_format::key);
+            }
+        }
+        return formats;
+    }
+
+    std::vector<output_size> sizes()
+    {
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+
+        std::vector<output_size> sizes;
+        for (auto& p : consumers_) {
+            auto size = p.second->consumer()->output_size();
+            if (is_scaled(size, format_desc_.width, format_desc_.height) &&
+                std::find(sizes.begin(), sizes.end(), size) == sizes.end()) {
+                sizes.push_back(size);
+            }
+        }
+        return sizes;
+    }
+
+    std::vector<int> shed_priorities()
+    {
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+
+        std::vector<int> priorities;
+        for (auto& p : consumers_) {
+            auto priority = p.second->priority();
+            if (priority < 0 && std::find(priorities.begin(), priorities.end(), priority) == priorities.end()) {
+                priorities.push_back(priority);
+            }
+        }
+        std::sort(priorities.begin(), priorities.end());
+        return priorities;
+    }
+
+    int shed(int priority)
+    {
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+
+        shed_priority_ = priority;
+
+        int count = 0;
+        for (auto& p : consumers_) {
+            count += p.second->shed(priority) ? 1 : 0;
+        }
+        return count;
+    }
+
+    bool host_image()
+    {
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+
+        for (auto& p : consumers_) {
+            if (p.second->consumer()->host_image()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     void operator()(const_frame input_frame, const core::video_format_desc& format_desc)
     {
         if (!input_frame) {
@@ -96,59 +437,45 @@ struct output::impl
 
         auto time = std::move(time_);
 
+        decltype(consumers_) consumers;
+        {
+            std::lock_guard<std::mutex> lock(consumers_mutex_);
+            consumers = consumers_;
+        }
+
         if (format_desc_ != format_desc) {
             std::lock_guard<std::mutex> lock(consumers_mutex_);
-            for (auto it = consumers_.begin(); it != consumers_.end();) {
-                try {
-                    it->second->initialize(format_desc, it->first);
-                    ++it;
-                } catch (...) {
-                    CASPAR_LOG_CURRENT_EXCEPTION();
-                    it = consumers_.erase(it);
-                }
+            for (auto& p : consumers_) {
+                p.second->initialize(format_desc, channel_index_);
             }
             format_desc_ = format_desc;
             time_        = boost::none;
             return;
         }
 
-        decltype(consumers_) consumers;
-        {
-            std::lock_guard<std::mutex> lock(consumers_mutex_);
-            consumers = consumers_;
-        }
-
-        std::map<int, std::future<bool>> futures;
-
-        for (auto it = consumers_.begin(); it != consumers_.end();) {
-            try {
-                futures.emplace(it->first, it->second->send(input_frame));
-                ++it;
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-                it = consumers_.erase(it);
+        for (auto& p : consumers) {
+            if (p.second->failed()) {
+                remove(p.first);
+            } else {
+                p.second->send(input_frame);
             }
         }
 
-        for (auto& p : futures) {
-            try {
-                if (!p.second.get()) {
-                    consumers_.erase(p.first);
-                }
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-                consumers_.erase(p.first);
-            }
+        {
+            std::lock_guard<std::mutex> lock(consumers_mutex_);
+            consumers = consumers_;
         }
 
         monitor::state state;
-        for (auto& p : consumers_) {
+        for (auto& p : consumers) {
             state["port"][p.first] = p.second->state();
         }
         state_ = std::move(state);
 
-        const auto needs_sync = std::all_of(
-            consumers_.begin(), consumers_.end(), [](auto& p) { return !p.second->has_synchronization_clock(); });
+        const auto needs_sync =
+            !externally_clocked_ && std::all_of(consumers.begin(), consumers.end(), [](auto& p) {
+                return !p.second->ready() || !p.second->consumer()->has_synchronization_clock();
+            });
 
         if (needs_sync) {
             if (!time) {
@@ -170,10 +497,22 @@ output::output(spl::shared_ptr<diagnostics::graph> graph, const video_format_des
 {
 }
 output::~output() {}
-void output::add(int index, const spl::shared_ptr<frame_consumer>& consumer) { impl_->add(index, consumer); }
-void output::add(const spl::shared_ptr<frame_consumer>& consumer) { impl_->add(consumer); }
-void output::remove(int index) { impl_->remove(index); }
-void output::remove(const spl::shared_ptr<frame_consumer>& consumer) { impl_->remove(consumer); }
+void output::add(int index, const spl::shared_ptr<frame_consumer>& consumer, const port_settings& settings)
+{
+    impl_->add(index, consumer, settings);
+}
+void output::add(const spl::shared_ptr<frame_consumer>& consumer, const port_settings& settings)
+{
+    impl_->add(consumer, settings);
+}
+void                       output::remove(int index) { impl_->remove(index); }
+void                       output::remove(const spl::shared_ptr<frame_consumer>& consumer) { impl_->remove(consumer); }
+std::vector<output_format> output::formats() const { return impl_->formats(); }
+std::vector<output_size>   output::sizes() const { return impl_->sizes(); }
+bool                       output::host_image() const { return impl_->host_image(); }
+std::vector<int>           output::shed_priorities() const { return impl_->shed_priorities(); }
+int                        output::shed(int priority) { return impl_->shed(priority); }
+void                       output::externally_clocked(bool value) { impl_->externally_clocked_ = value; }
 void output::operator()(const_frame frame, const video_format_desc& format_desc)
 {
     return (*impl_)(std::move(frame), format_desc);
@@ -22,18 +22,37 @@
 #pragma once
 
 #include "../fwd.h"
+#include "../frame/pixel_format.h"
 #include "../monitor/monitor.h"
 
 #include <common/forward.h>
 #include <common/memory.h>
 
+#include <chrono>
 #include <future>
 #include <memory>
+#include <vector>
 
 FORWARD2(caspar, diagnostics, class graph);
 
 namespace caspar { namespace core {
 
+enum class overflow_policy
+{
+    block,
+    drop_oldest,
+    drop_newest,
+};
+
+struct port_settings final
+{
+    int                       capacity = 1;
+    overflow_policy           overflow = overflow_policy::block;
+    std::chrono::microseconds deadline{0}; // 0 = one frame duration.
+    int                       priority = 0; // Negative priorities are shed while the channel is overloaded.
+    int                       delay    = 0; // Frames the consumer gets its frames later than the channel mixes them.
+};
+
 class output final
 {
   public:
@@ -45,11 +64,32 @@ class output final
 
     void operator()(const_frame frame, const video_format_desc& format_desc);
 
-    void add(const spl::shared_ptr<frame_consumer>& consumer);
-    void add(int index, const spl::shared_ptr<frame_consumer>& consumer);
+    void add(const spl::shared_ptr<frame_consumer>& consumer, const port_settings& settings = port_settings());
+    void add(int                                    index,
+             const spl::shared_ptr<frame_consumer>& consumer,
+             const port_settings&                   settings = port_settings());
     void remove(const spl::shared_ptr<frame_consumer>& consumer);
     void remove(int index);
 
+    // The formats, besides bgra, which the current consumers read frames in.
+    std::vector<output_format> formats() const;
+
+    // The sizes, smaller than the channel, which the current consumers output images in.
+    std::vector<output_size> sizes() const;
+
+    // Whether any of the current consumers reads the bgra image in host memory, see frame_consumer::host_image.
+    bool host_image() const;
+
+    // The distinct negative priorities of the current consumers, lowest first, see port_settings::priority.
+    std::vector<int> shed_priorities() const;
+
+    // Consumers of a lower priority than priority only get every other frame, except for consumers which pace the
+    // channel. Returns the number of consumers which are shed.
+    int shed(int priority);
+
+    // Disables the output's own frame pacing, for channels which are paced by a reference clock.
+    void externally_clocked(bool value);
+
     core::monitor::state state() const;
 
   private:
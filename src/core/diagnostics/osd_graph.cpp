@@ -37,12 +37,12 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/optional.hpp>
 
-#include <tbb/concurrent_unordered_map.h>
-
 #include <GL/glew.h>
 
 #include <atomic>
+#include <cstdint>
 #include <list>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <numeric>
@@ -251,9 +251,11 @@ class line : public drawable
     boost::circular_buffer<sf::Vertex>                       line_data_{res_};
     boost::circular_buffer<boost::optional<sf::VertexArray>> line_tags_{res_};
 
-    std::atomic<float> tick_data_;
-    std::atomic<bool>  tick_tag_;
-    std::atomic<int>   color_;
+    float         tick_data_   = -1.0f;
+    bool          tick_tag_    = false;
+    int           color_       = static_cast<int>(0xFFFFFFFF);
+    std::uint32_t values_seen_ = 0;
+    std::uint32_t tags_seen_   = 0;
 
     double x_delta_ = 1.0 / (res_ - 1);
 
@@ -261,27 +263,26 @@ class line : public drawable
     line()
         : res_(1024)
     {
-        tick_data_ = -1.0f;
-        color_     = 0xFFFFFFFF;
-        tick_tag_  = false;
     }
 
-    line(const line& other)
-        : res_(other.res_)
-        , line_data_(other.line_data_)
-        , line_tags_(other.line_tags_)
-        , tick_data_(other.tick_data_.load())
-        , tick_tag_(other.tick_tag_.load())
-        , color_(other.color_.load())
-        , x_delta_(other.x_delta_)
+    // Takes the latest value of the series, or zero if an auto reset graph has not set one since the last sample. A
+    // series without values only draws its tags.
+    void sample(const caspar::diagnostics::spi::graph_series& series, bool auto_reset)
     {
-    }
-
-    void set_value(float value) { tick_data_ = value; }
+        auto values = series.values.load(std::memory_order_acquire);
+        if (values != values_seen_) {
+            tick_data_   = static_cast<float>(series.value.load(std::memory_order_relaxed));
+            values_seen_ = values;
+        } else if (auto_reset && values_seen_ != 0) {
+            tick_data_ = 0.0f;
+        }
 
-    void set_tag() { tick_tag_ = true; }
+        auto tags  = series.tags.load(std::memory_order_acquire);
+        tick_tag_  = tags != tags_seen_;
+        tags_seen_ = tags;
 
-    void set_color(int color) { color_ = color; }
+        color_ = series.color.load(std::memory_order_relaxed);
+    }
 
     int get_color() { return color_; }
 
@@ -357,40 +358,18 @@ struct graph
     , public caspar::diagnostics::spi::graph_sink
     , public std::enable_shared_from_this<graph>
 {
-    call_context                                     context_ = call_context::for_thread();
-    tbb::concurrent_unordered_map<std::string, line> lines_;
+    call_context                                                 context_ = call_context::for_thread();
+    std::shared_ptr<const caspar::diagnostics::spi::graph_state> state_;
 
-    std::mutex   mutex_;
-    std::wstring text_;
-    bool         auto_reset_ = false;
+    // NOTE: Only used by the diagnostics thread, which samples the graph each time it renders.
+    std::map<std::string, line> lines_;
 
     graph() {}
 
-    void activate() override { context::register_drawable(shared_from_this()); }
-
-    void set_text(const std::wstring& value) override
-    {
-        auto                        temp = value;
-        std::lock_guard<std::mutex> lock(mutex_);
-        text_ = std::move(temp);
-    }
-
-    void set_value(const std::string& name, double value) override
+    void activate(const spl::shared_ptr<const caspar::diagnostics::spi::graph_state>& state) override
     {
-        lines_[name].set_value(static_cast<float>(value));
-    }
-
-    void set_tag(caspar::diagnostics::tag_severity /*severity*/, const std::string& name) override
-    {
-        lines_[name].set_tag();
-    }
-
-    void set_color(const std::string& name, int color) override { lines_[name].set_color(color); }
-
-    void auto_reset() override
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto_reset_ = true;
+        state_ = state;
+        context::register_drawable(shared_from_this());
     }
 
   private:
@@ -400,14 +379,12 @@ struct graph
         const size_t text_margin = 2;
         const size_t text_offset = (text_size + text_margin * 2) * 2;
 
-        std::wstring text_str;
-        bool         auto_reset;
+        auto text_str   = state_->text();
+        auto auto_reset = state_->auto_reset();
 
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            text_str   = text_;
-            auto_reset = auto_reset_;
-        }
+        state_->for_each([&](const std::string& name, const caspar::diagnostics::spi::graph_series& series) {
+            lines_[name].sample(series, auto_reset);
+        });
 
         sf::Text text(text_str.c_str(), get_default_font(), text_size);
         text.setStyle(sf::Text::Italic);
@@ -483,8 +460,6 @@ struct graph
 
         for (auto it = lines_.begin(); it != lines_.end(); ++it) {
             target.draw(it->second, states);
-            if (auto_reset)
-                it->second.set_value(0.0f);
         }
     }
 };
@@ -26,14 +26,18 @@
 
 #include <boost/variant.hpp>
 
+#include <memory>
+
 namespace caspar { namespace core {
 
 typedef boost::variant<boost::blank, const_frame, std::vector<draw_frame>> frame_t;
 
 struct draw_frame::impl
 {
-    frame_t         frame_;
-    frame_transform transform_;
+    frame_t frame_;
+
+    // Shared by copies of the frame until one of them changes it, null while it is the identity.
+    std::shared_ptr<frame_transform> transform_;
 
   public:
     impl() {}
@@ -65,12 +69,34 @@ struct draw_frame::impl
                 }
             }
         };
-        visitor.push(transform_);
+        // NOTE: Composing with the identity transform changes nothing in the mixers, so it is skipped.
+        if (!transform_) {
+            boost::apply_visitor(accept_visitor{visitor}, frame_);
+            return;
+        }
+
+        visitor.push(*transform_);
         boost::apply_visitor(accept_visitor{visitor}, frame_);
         visitor.pop();
     }
 
-    bool operator==(const impl& other) { return frame_ == other.frame_ && transform_ == other.transform_; }
+    const frame_transform& transform() const
+    {
+        static const frame_transform identity;
+        return transform_ ? *transform_ : identity;
+    }
+
+    frame_transform& transform()
+    {
+        if (!transform_) {
+            transform_ = std::make_shared<frame_transform>();
+        } else if (transform_.use_count() > 1) {
+            transform_ = std::make_shared<frame_transform>(*transform_);
+        }
+        return *transform_;
+    }
+
+    bool operator==(const impl& other) { return frame_ == other.frame_ && transform() == other.transform(); }
 };
 
 draw_frame::draw_frame()
@@ -107,8 +133,8 @@ draw_frame& draw_frame::operator=(draw_frame other)
     return *this;
 }
 void                   draw_frame::swap(draw_frame& other) { impl_.swap(other.impl_); }
-const frame_transform& draw_frame::transform() const { return impl_->transform_; }
-frame_transform&       draw_frame::transform() { return impl_->transform_; }
+const frame_transform& draw_frame::transform() const { return static_cast<const impl&>(*impl_).transform(); }
+frame_transform&       draw_frame::transform() { return impl_->transform(); }
 void                   draw_frame::accept(frame_visitor& visitor) const { impl_->accept(visitor); }
 bool draw_frame::operator==(const draw_frame& other) const { return impl_ && *impl_ == *other.impl_; }
 bool draw_frame::operator!=(const draw_frame& other) const { return !(*this == other); }
@@ -149,8 +175,10 @@ draw_frame draw_frame::push(draw_frame frame, const frame_transform& transform)
 {
     std::vector<draw_frame> frames;
     frames.push_back(std::move(frame));
-    auto result        = draw_frame(std::move(frames));
-    result.transform() = std::move(transform);
+    auto result = draw_frame(std::move(frames));
+    if (transform != frame_transform{}) {
+        result.transform() = transform;
+    }
     return result;
 }
 
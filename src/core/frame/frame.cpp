@@ -35,6 +35,7 @@
 
 #include <cstdint>
 #include <functional>
+#include <mutex>
 #include <vector>
 
 #include <boost/lexical_cast.hpp>
@@ -101,16 +102,39 @@ struct const_frame::impl
     frame_geometry                         geometry_ = frame_geometry::get_default();
     boost::any                             opaque_;
 
-    impl(std::vector<array<const std::uint8_t>> image_data,
-         array<const std::int32_t>              audio_data,
-         const core::pixel_format_desc&         desc)
+    std::map<output_format, array<const std::uint8_t>> converted_;
+    std::map<output_size, array<const std::uint8_t>>   scaled_;
+    bool                                               blank_ = false;
+
+    std::shared_ptr<deferred_image> deferred_; // The first image, if it was not read back by the mixer.
+    std::once_flag                  read_back_flag_;
+    array<const std::uint8_t>       read_back_;
+
+    std::mutex                                      cache_mutex_;
+    std::vector<std::pair<const void*, boost::any>> cache_;
+
+    impl(std::vector<array<const std::uint8_t>>             image_data,
+         array<const std::int32_t>                          audio_data,
+         const core::pixel_format_desc&                     desc,
+         std::map<output_format, array<const std::uint8_t>> converted,
+         std::map<output_size, array<const std::uint8_t>>   scaled,
+         bool                                               blank)
         : image_data_(std::move(image_data))
         , audio_data_(std::move(audio_data))
         , desc_(desc)
+        , converted_(std::move(converted))
+        , scaled_(std::move(scaled))
+        , blank_(blank)
     {
         if (desc_.planes.size() != image_data_.size()) {
             CASPAR_THROW_EXCEPTION(invalid_argument());
         }
+        if (!image_data_.empty()) {
+            auto deferred = image_data_[0].storage<std::shared_ptr<deferred_image>>();
+            if (deferred) {
+                deferred_ = *deferred;
+            }
+        }
     }
 
     impl(std::vector<array<std::uint8_t>>&& image_data,
@@ -140,20 +164,64 @@ struct const_frame::impl
         }
     }
 
-    const array<const std::uint8_t>& image_data(std::size_t index) const { return image_data_.at(index); }
+    // NOTE: The read back image is kept apart, so that device_image_data can be read concurrently.
+    const array<const std::uint8_t>& image_data(std::size_t index)
+    {
+        if (index != 0 || !deferred_) {
+            return image_data_.at(index);
+        }
+        std::call_once(read_back_flag_, [this] { read_back_ = deferred_->read_back(); });
+        return read_back_;
+    }
+
+    const array<const std::uint8_t>& device_image_data(std::size_t index) const { return image_data_.at(index); }
+
+    const array<const std::uint8_t>& image_data(output_format format) const
+    {
+        static const array<const std::uint8_t> empty;
+
+        auto it = converted_.find(format);
+        return it != converted_.end() ? it->second : empty;
+    }
+
+    const array<const std::uint8_t>& image_data(const output_size& size) const
+    {
+        static const array<const std::uint8_t> empty;
+
+        auto it = scaled_.find(size);
+        return it != scaled_.end() ? it->second : empty;
+    }
 
     std::size_t width() const { return desc_.planes.at(0).width; }
 
     std::size_t height() const { return desc_.planes.at(0).height; }
 
     std::size_t size() const { return desc_.planes.at(0).size; }
+
+    boost::any cached(const void* key, const std::function<boost::any()>& factory)
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+
+        for (auto& entry : cache_) {
+            if (entry.first == key) {
+                return entry.second;
+            }
+        }
+
+        cache_.emplace_back(key, factory());
+        return cache_.back().second;
+    }
 };
 
 const_frame::const_frame() {}
-const_frame::const_frame(std::vector<array<const std::uint8_t>> image_data,
-                         array<const std::int32_t>              audio_data,
-                         const core::pixel_format_desc&         desc)
-    : impl_(new impl(std::move(image_data), std::move(audio_data), desc))
+const_frame::const_frame(std::vector<array<const std::uint8_t>>             image_data,
+                         array<const std::int32_t>                          audio_data,
+                         const core::pixel_format_desc&                     desc,
+                         std::map<output_format, array<const std::uint8_t>> converted,
+                         std::map<output_size, array<const std::uint8_t>>   scaled,
+                         bool                                               blank)
+    : impl_(new impl(
+          std::move(image_data), std::move(audio_data), desc, std::move(converted), std::move(scaled), blank))
 {
 }
 const_frame::const_frame(mutable_frame&& other)
@@ -176,11 +244,28 @@ bool const_frame::operator<(const const_frame& other) const { return impl_ < oth
 bool const_frame::               operator>(const const_frame& other) const { return impl_ > other.impl_; }
 const pixel_format_desc&         const_frame::pixel_format_desc() const { return impl_->desc_; }
 const array<const std::uint8_t>& const_frame::image_data(std::size_t index) const { return impl_->image_data(index); }
+const array<const std::uint8_t>& const_frame::device_image_data(std::size_t index) const
+{
+    return impl_->device_image_data(index);
+}
+const array<const std::uint8_t>& const_frame::image_data(output_format format) const
+{
+    return impl_->image_data(format);
+}
+const array<const std::uint8_t>& const_frame::image_data(const output_size& size) const
+{
+    return impl_->image_data(size);
+}
 const array<const std::int32_t>& const_frame::audio_data() const { return impl_->audio_data_; }
+bool                             const_frame::blank() const { return impl_ && impl_->blank_; }
 std::size_t                      const_frame::width() const { return impl_->width(); }
 std::size_t                      const_frame::height() const { return impl_->height(); }
 std::size_t                      const_frame::size() const { return impl_->size(); }
 const frame_geometry&            const_frame::geometry() const { return impl_->geometry_; }
 const boost::any&                const_frame::opaque() const { return impl_->opaque_; }
+boost::any const_frame::cached(const void* key, const std::function<boost::any()>& factory) const
+{
+    return impl_ ? impl_->cached(key, factory) : factory();
+}
 const_frame::operator bool() const { return impl_ != nullptr && impl_->desc_.format != core::pixel_format::invalid; }
 }} // namespace caspar::core
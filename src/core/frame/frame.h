@@ -7,11 +7,26 @@
 #include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <map>
 #include <memory>
 #include <vector>
 
 namespace caspar { namespace core {
 
+enum class output_format;
+struct output_size;
+
+// An image which is still on the device that rendered it. It is held as the storage of an array without data, of
+// type std::shared_ptr<deferred_image>, and const_frame::image_data reads it back on first access.
+class deferred_image
+{
+  public:
+    virtual ~deferred_image() {}
+
+    // Blocks until the image has been read back. Must not be called from the thread of the device.
+    virtual array<const std::uint8_t> read_back() = 0;
+};
+
 class mutable_frame final
 {
     friend class const_frame;
@@ -58,9 +73,12 @@ class const_frame final
 {
   public:
     const_frame();
-    explicit const_frame(std::vector<array<const std::uint8_t>> image_data,
-                         array<const std::int32_t>              audio_data,
-                         const struct pixel_format_desc&        desc);
+    explicit const_frame(std::vector<array<const std::uint8_t>>             image_data,
+                         array<const std::int32_t>                          audio_data,
+                         const struct pixel_format_desc&                    desc,
+                         std::map<output_format, array<const std::uint8_t>> converted = {},
+                         std::map<output_size, array<const std::uint8_t>>   scaled    = {},
+                         bool                                               blank     = false);
     const_frame(const const_frame& other);
     const_frame(mutable_frame&& other);
 
@@ -70,10 +88,25 @@ class const_frame final
 
     const struct pixel_format_desc& pixel_format_desc() const;
 
+    // Images which the mixer has not read back, see deferred_image, are read back on first access.
     const array<const std::uint8_t>& image_data(std::size_t index) const;
 
+    // The image as it was given to the frame. Unlike image_data(index) it is not read back if it is deferred, so a
+    // consumer which draws on the rendering device can use the texture instead, see ogl::readback_texture.
+    const array<const std::uint8_t>& device_image_data(std::size_t index) const;
+
+    // The image converted into format by the mixer, or an empty array if it was not requested for this frame.
+    const array<const std::uint8_t>& image_data(output_format format) const;
+
+    // The bgra image scaled to size by the mixer, or an empty array if it was not requested for this frame.
+    const array<const std::uint8_t>& image_data(const output_size& size) const;
+
     const array<const std::int32_t>& audio_data() const;
 
+    // Whether the mixer had nothing to draw, so every image of the frame is black. Blank frames share their images,
+    // consumers may output a black frame of their own instead of reading them.
+    bool blank() const;
+
     std::size_t width() const;
 
     std::size_t height() const;
@@ -82,6 +115,11 @@ class const_frame final
 
     const boost::any& opaque() const;
 
+    // Returns the value cached on the frame under key, e.g. a device, creating it with factory on first use. Copies
+    // of the frame share the cache, so repeated and concurrent uses of a frame can reuse derived data such as
+    // uploaded textures. Cached values are released with the frame.
+    boost::any cached(const void* key, const std::function<boost::any()>& factory) const;
+
     const class frame_geometry& geometry() const;
 
     bool operator==(const const_frame& other) const;
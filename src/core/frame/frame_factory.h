@@ -21,8 +21,18 @@
 
 #pragma once
 
+#include <vector>
+
 namespace caspar { namespace core {
 
+struct frame_region
+{
+    int x      = 0;
+    int y      = 0;
+    int width  = 0;
+    int height = 0;
+};
+
 class frame_factory
 {
   public:
@@ -33,6 +43,20 @@ class frame_factory
     frame_factory(const frame_factory&) = delete;
 
     virtual class mutable_frame create_frame(const void* video_stream_tag, const struct pixel_format_desc& desc) = 0;
+
+    // Creates a frame whose image only differs from previous within regions. The whole image is still written, but
+    // where previous was created by the same factory only regions are uploaded and the rest is copied from previous
+    // on the gpu.
+    virtual class mutable_frame update_frame(const void*                      video_stream_tag,
+                                             const struct pixel_format_desc&  desc,
+                                             const class const_frame&         previous,
+                                             const std::vector<frame_region>& regions) = 0;
+
+    // Creates a bgra frame from a texture which another api shares through shared_handle, e.g. the DXGI handle of a
+    // Direct3D 11 texture on Windows. The texture is copied on the gpu, the frame has no image in host memory, so only
+    // its own device can draw it. Throws not_supported where textures cannot be shared.
+    virtual class mutable_frame
+    import_frame(const void* video_stream_tag, void* shared_handle, int width, int height) = 0;
 };
 
 }} // namespace caspar::core
\ No newline at end of file
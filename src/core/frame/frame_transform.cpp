@@ -100,6 +100,7 @@ image_transform& image_transform::operator*=(const image_transform& other)
     is_mix |= other.is_mix;
     blend_mode = std::max(blend_mode, other.blend_mode);
     layer_depth += other.layer_depth;
+    field_mode = other.field_mode != field_mode::progressive ? other.field_mode : field_mode;
 
     return *this;
 }
@@ -109,38 +110,48 @@ image_transform image_transform::operator*(const image_transform& other) const
     return image_transform(*this) *= other;
 }
 
-double do_tween(double time, double source, double dest, double duration, const tweener& tween)
+// Tweens values from source to dest at one point in time. The tweener is evaluated once for all values when it is
+// affine, rather than through its function object for every value.
+class tween_step
 {
-    return tween(time, source, dest - source, duration);
+    double         time_;
+    double         duration_;
+    const tweener& tween_;
+    double         fraction_;
+
+  public:
+    tween_step(double time, double duration, const tweener& tween)
+        : time_(time)
+        , duration_(duration)
+        , tween_(tween)
+        , fraction_(tween.is_affine() ? tween(time, 0.0, 1.0, duration) : 0.0)
+    {
+    }
+
+    double operator()(double source, double dest) const
+    {
+        return tween_.is_affine() ? source + (dest - source) * fraction_
+                                  : tween_(time_, source, dest - source, duration_);
+    }
 };
 
 template <typename Rect>
-void do_tween_rectangle(const Rect&    source,
-                        const Rect&    dest,
-                        Rect&          out,
-                        double         time,
-                        double         duration,
-                        const tweener& tweener)
+void do_tween_rectangle(const Rect& source, const Rect& dest, Rect& out, const tween_step& step)
 {
-    out.ul[0] = do_tween(time, source.ul[0], dest.ul[0], duration, tweener);
-    out.ul[1] = do_tween(time, source.ul[1], dest.ul[1], duration, tweener);
-    out.lr[0] = do_tween(time, source.lr[0], dest.lr[0], duration, tweener);
-    out.lr[1] = do_tween(time, source.lr[1], dest.lr[1], duration, tweener);
+    out.ul[0] = step(source.ul[0], dest.ul[0]);
+    out.ul[1] = step(source.ul[1], dest.ul[1]);
+    out.lr[0] = step(source.lr[0], dest.lr[0]);
+    out.lr[1] = step(source.lr[1], dest.lr[1]);
 }
 
-void do_tween_corners(const corners& source,
-                      const corners& dest,
-                      corners&       out,
-                      double         time,
-                      double         duration,
-                      const tweener& tweener)
+void do_tween_corners(const corners& source, const corners& dest, corners& out, const tween_step& step)
 {
-    do_tween_rectangle(source, dest, out, time, duration, tweener);
+    do_tween_rectangle(source, dest, out, step);
 
-    out.ur[0] = do_tween(time, source.ur[0], dest.ur[0], duration, tweener);
-    out.ur[1] = do_tween(time, source.ur[1], dest.ur[1], duration, tweener);
-    out.ll[0] = do_tween(time, source.ll[0], dest.ll[0], duration, tweener);
-    out.ll[1] = do_tween(time, source.ll[1], dest.ll[1], duration, tweener);
+    out.ur[0] = step(source.ur[0], dest.ur[0]);
+    out.ur[1] = step(source.ur[1], dest.ur[1]);
+    out.ll[0] = step(source.ll[0], dest.ll[0]);
+    out.ll[1] = step(source.ll[1], dest.ll[1]);
 };
 
 image_transform image_transform::tween(double                 time,
@@ -149,48 +160,48 @@ image_transform image_transform::tween(double                 time,
                                        double                 duration,
                                        const tweener&         tween)
 {
+    const tween_step step(time, duration, tween);
+
     image_transform result;
 
-    result.brightness          = do_tween(time, source.brightness, dest.brightness, duration, tween);
-    result.contrast            = do_tween(time, source.contrast, dest.contrast, duration, tween);
-    result.saturation          = do_tween(time, source.saturation, dest.saturation, duration, tween);
-    result.opacity             = do_tween(time, source.opacity, dest.opacity, duration, tween);
-    result.anchor[0]           = do_tween(time, source.anchor[0], dest.anchor[0], duration, tween);
-    result.anchor[1]           = do_tween(time, source.anchor[1], dest.anchor[1], duration, tween);
-    result.fill_translation[0] = do_tween(time, source.fill_translation[0], dest.fill_translation[0], duration, tween);
-    result.fill_translation[1] = do_tween(time, source.fill_translation[1], dest.fill_translation[1], duration, tween);
-    result.fill_scale[0]       = do_tween(time, source.fill_scale[0], dest.fill_scale[0], duration, tween);
-    result.fill_scale[1]       = do_tween(time, source.fill_scale[1], dest.fill_scale[1], duration, tween);
-    result.clip_translation[0] = do_tween(time, source.clip_translation[0], dest.clip_translation[0], duration, tween);
-    result.clip_translation[1] = do_tween(time, source.clip_translation[1], dest.clip_translation[1], duration, tween);
-    result.clip_scale[0]       = do_tween(time, source.clip_scale[0], dest.clip_scale[0], duration, tween);
-    result.clip_scale[1]       = do_tween(time, source.clip_scale[1], dest.clip_scale[1], duration, tween);
-    result.angle               = do_tween(time, source.angle, dest.angle, duration, tween);
-    result.levels.max_input    = do_tween(time, source.levels.max_input, dest.levels.max_input, duration, tween);
-    result.levels.min_input    = do_tween(time, source.levels.min_input, dest.levels.min_input, duration, tween);
-    result.levels.max_output   = do_tween(time, source.levels.max_output, dest.levels.max_output, duration, tween);
-    result.levels.min_output   = do_tween(time, source.levels.min_output, dest.levels.min_output, duration, tween);
-    result.levels.gamma        = do_tween(time, source.levels.gamma, dest.levels.gamma, duration, tween);
-    result.chroma.target_hue   = do_tween(time, source.chroma.target_hue, dest.chroma.target_hue, duration, tween);
-    result.chroma.hue_width    = do_tween(time, source.chroma.hue_width, dest.chroma.hue_width, duration, tween);
-    result.chroma.min_saturation =
-        do_tween(time, source.chroma.min_saturation, dest.chroma.min_saturation, duration, tween);
-    result.chroma.min_brightness =
-        do_tween(time, source.chroma.min_brightness, dest.chroma.min_brightness, duration, tween);
-    result.chroma.softness = do_tween(time, source.chroma.softness, dest.chroma.softness, duration, tween);
-    result.chroma.spill_suppress =
-        do_tween(time, source.chroma.spill_suppress, dest.chroma.spill_suppress, duration, tween);
+    result.brightness            = step(source.brightness, dest.brightness);
+    result.contrast              = step(source.contrast, dest.contrast);
+    result.saturation            = step(source.saturation, dest.saturation);
+    result.opacity               = step(source.opacity, dest.opacity);
+    result.anchor[0]             = step(source.anchor[0], dest.anchor[0]);
+    result.anchor[1]             = step(source.anchor[1], dest.anchor[1]);
+    result.fill_translation[0]   = step(source.fill_translation[0], dest.fill_translation[0]);
+    result.fill_translation[1]   = step(source.fill_translation[1], dest.fill_translation[1]);
+    result.fill_scale[0]         = step(source.fill_scale[0], dest.fill_scale[0]);
+    result.fill_scale[1]         = step(source.fill_scale[1], dest.fill_scale[1]);
+    result.clip_translation[0]   = step(source.clip_translation[0], dest.clip_translation[0]);
+    result.clip_translation[1]   = step(source.clip_translation[1], dest.clip_translation[1]);
+    result.clip_scale[0]         = step(source.clip_scale[0], dest.clip_scale[0]);
+    result.clip_scale[1]         = step(source.clip_scale[1], dest.clip_scale[1]);
+    result.angle                 = step(source.angle, dest.angle);
+    result.levels.max_input      = step(source.levels.max_input, dest.levels.max_input);
+    result.levels.min_input      = step(source.levels.min_input, dest.levels.min_input);
+    result.levels.max_output     = step(source.levels.max_output, dest.levels.max_output);
+    result.levels.min_output     = step(source.levels.min_output, dest.levels.min_output);
+    result.levels.gamma          = step(source.levels.gamma, dest.levels.gamma);
+    result.chroma.target_hue     = step(source.chroma.target_hue, dest.chroma.target_hue);
+    result.chroma.hue_width      = step(source.chroma.hue_width, dest.chroma.hue_width);
+    result.chroma.min_saturation = step(source.chroma.min_saturation, dest.chroma.min_saturation);
+    result.chroma.min_brightness = step(source.chroma.min_brightness, dest.chroma.min_brightness);
+    result.chroma.softness       = step(source.chroma.softness, dest.chroma.softness);
+    result.chroma.spill_suppress = step(source.chroma.spill_suppress, dest.chroma.spill_suppress);
     result.chroma.spill_suppress_saturation =
-        do_tween(time, source.chroma.spill_suppress_saturation, dest.chroma.spill_suppress_saturation, duration, tween);
+        step(source.chroma.spill_suppress_saturation, dest.chroma.spill_suppress_saturation);
     result.chroma.enable    = dest.chroma.enable;
     result.chroma.show_mask = dest.chroma.show_mask;
     result.is_key           = source.is_key | dest.is_key;
     result.is_mix           = source.is_mix | dest.is_mix;
     result.blend_mode       = std::max(source.blend_mode, dest.blend_mode);
     result.layer_depth      = dest.layer_depth;
+    result.field_mode       = dest.field_mode;
 
-    do_tween_rectangle(source.crop, dest.crop, result.crop, time, duration, tween);
-    do_tween_corners(source.perspective, dest.perspective, result.perspective, time, duration, tween);
+    do_tween_rectangle(source.crop, dest.crop, result.crop, step);
+    do_tween_corners(source.perspective, dest.perspective, result.perspective, step);
 
     return result;
 }
@@ -217,7 +228,8 @@ bool operator==(const image_transform& lhs, const image_transform& rhs)
            boost::range::equal(lhs.clip_translation, rhs.clip_translation, eq) &&
            boost::range::equal(lhs.clip_scale, rhs.clip_scale, eq) && eq(lhs.angle, rhs.angle) &&
            lhs.is_key == rhs.is_key && lhs.is_mix == rhs.is_mix && lhs.blend_mode == rhs.blend_mode &&
-           lhs.layer_depth == rhs.layer_depth && lhs.chroma.enable == rhs.chroma.enable &&
+           lhs.layer_depth == rhs.layer_depth && lhs.field_mode == rhs.field_mode &&
+           lhs.chroma.enable == rhs.chroma.enable &&
            lhs.chroma.show_mask == rhs.chroma.show_mask && eq(lhs.chroma.target_hue, rhs.chroma.target_hue) &&
            eq(lhs.chroma.hue_width, rhs.chroma.hue_width) && eq(lhs.chroma.min_saturation, rhs.chroma.min_saturation) &&
            eq(lhs.chroma.min_brightness, rhs.chroma.min_brightness) && eq(lhs.chroma.softness, rhs.chroma.softness) &&
@@ -248,7 +260,7 @@ audio_transform audio_transform::tween(double                 time,
                                        const tweener&         tween)
 {
     audio_transform result;
-    result.volume = do_tween(time, source.volume, dest.volume, duration, tween);
+    result.volume = tween_step(time, duration, tween)(source.volume, dest.volume);
 
     return result;
 }
@@ -304,7 +316,15 @@ tweened_transform::tweened_transform(const frame_transform& source,
 {
 }
 
-const frame_transform& tweened_transform::dest() const { return dest_; }
+const frame_transform& tweened_transform::dest() const
+{
+    return keyframes_.empty() ? dest_ : keyframes_.back().transform;
+}
+
+void tweened_transform::append(const frame_transform& dest, int duration, const tweener& tween)
+{
+    keyframes_.push_back(keyframe{dest, duration, tween});
+}
 
 frame_transform tweened_transform::fetch()
 {
@@ -314,7 +334,28 @@ frame_transform tweened_transform::fetch()
                      static_cast<double>(time_), source_, dest_, static_cast<double>(duration_), tweener_);
 }
 
-void tweened_transform::tick(int num) { time_ = std::min(time_ + num, duration_); }
+void tweened_transform::tick(int num)
+{
+    while (num > 0) {
+        if (time_ == duration_) {
+            if (keyframes_.empty()) {
+                break;
+            }
+
+            source_   = dest_;
+            dest_     = keyframes_.front().transform;
+            duration_ = keyframes_.front().duration;
+            tweener_  = keyframes_.front().tween;
+            time_     = 0;
+            keyframes_.pop_front();
+            continue;
+        }
+
+        const auto step = std::min(num, duration_ - time_);
+        time_ += step;
+        num -= step;
+    }
+}
 
 boost::optional<chroma::legacy_type> get_chroma_mode(const std::wstring& str)
 {
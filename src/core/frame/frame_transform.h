@@ -30,6 +30,7 @@
 #include <boost/optional.hpp>
 
 #include <array>
+#include <deque>
 
 namespace caspar { namespace core {
 
@@ -62,6 +63,15 @@ struct levels final
     double max_output = 1.0;
 };
 
+// The field of an interlaced frame which is shown. Rows of the other field are only woven in where the two fields
+// match, elsewhere they are interpolated. Only the ogl image mixer applies it.
+enum class field_mode
+{
+    progressive = 0,
+    upper,
+    lower,
+};
+
 struct corners final
 {
     std::array<double, 2> ul = {0.0, 0.0};
@@ -98,6 +108,7 @@ struct image_transform final
     bool             is_mix      = false;
     core::blend_mode blend_mode  = blend_mode::normal;
     int              layer_depth = 0;
+    core::field_mode field_mode  = field_mode::progressive;
 
     image_transform& operator*=(const image_transform& other);
     image_transform  operator*(const image_transform& other) const;
@@ -152,19 +163,31 @@ bool operator!=(const frame_transform& lhs, const frame_transform& rhs);
 
 class tweened_transform
 {
-    frame_transform source_;
-    frame_transform dest_;
-    int             duration_ = 0;
-    int             time_     = 0;
-    tweener         tweener_;
+    struct keyframe
+    {
+        frame_transform transform;
+        int             duration;
+        tweener         tween;
+    };
+
+    frame_transform      source_;
+    frame_transform      dest_;
+    int                  duration_ = 0;
+    int                  time_     = 0;
+    tweener              tweener_;
+    std::deque<keyframe> keyframes_; // Tweened to one after another once dest_ is reached.
 
   public:
     tweened_transform() = default;
 
     tweened_transform(const frame_transform& source, const frame_transform& dest, int duration, const tweener& tween);
 
+    // The last keyframe, which the transform ends at.
     const frame_transform& dest() const;
 
+    // Appends a keyframe which is tweened to over duration ticks once the keyframes before it are reached.
+    void append(const frame_transform& dest, int duration, const tweener& tween);
+
     frame_transform fetch();
     void            tick(int num);
 };
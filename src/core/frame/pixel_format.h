@@ -37,10 +37,84 @@ enum class pixel_format
     luma,
     bgr,
     rgb,
+    v210,    // 10 bit 4:2:2 as captured, one plane of little endian words which is unpacked by the mixer.
+    uyvy,    // 8 bit 4:2:2 as captured, one plane of Cb Y0 Cr Y1 texels which is unpacked by the mixer.
+    nv12,    // 8 bit semi planar, a luma plane followed by an interleaved CbCr plane of any subsampling, e.g. NV16.
+    p010,    // 16 bit semi planar like nv12, with the samples in the high bits of each word, e.g. P016 and P216.
+    ycbcr10, // Planar like ycbcr, with 10 bit samples in the low bits of 16 bit little endian words.
+    bc3,     // DXT5 compressed premultiplied rgba, one plane of 16 byte blocks of 4x4 pixels, see bc3_plane.
     count,
     invalid,
 };
 
+// Packed formats which a rendered frame can be converted into before it leaves the mixer, for consumers which would
+// otherwise convert bgra themselves.
+enum class output_format
+{
+    bgra = 0,
+    uyvy,    // 8 bit 4:2:2, Cb Y0 Cr Y1.
+    v210,    // 10 bit 4:2:2, six pixels in four little endian words, rows padded to 128 bytes.
+    nv12,    // 8 bit 4:2:0, a luma plane followed by an interleaved CbCr plane.
+    key,     // bgra with every channel set to the alpha of the frame, for the key signal of external keyers.
+    quarter, // bgra of a quarter of the width and height, each pixel the average of a 4x4 block, for thumbnails.
+    rfc4175, // 10 bit 4:2:2 pixel groups of SMPTE ST 2110-20, Cb Y0 Cr Y1 in five big endian bytes, rows padded to 4.
+    count,
+};
+
+// A size which rendered frames are scaled down to before they leave the mixer, for consumers which output smaller
+// images than the channel. Scaled images are bgra.
+struct output_size final
+{
+    int width  = 0;
+    int height = 0;
+
+    output_size() = default;
+
+    output_size(int width, int height)
+        : width(width)
+        , height(height)
+    {
+    }
+
+    explicit operator bool() const { return width > 0 && height > 0; }
+};
+
+inline bool operator==(const output_size& lhs, const output_size& rhs)
+{
+    return lhs.width == rhs.width && lhs.height == rhs.height;
+}
+
+inline bool operator<(const output_size& lhs, const output_size& rhs)
+{
+    return lhs.width < rhs.width || (lhs.width == rhs.width && lhs.height < rhs.height);
+}
+
+// Whether frames of width by height are scaled down to size. Frames are never scaled up.
+inline bool is_scaled(const output_size& size, int width, int height)
+{
+    return size && size.width <= width && size.height <= height && !(size == output_size(width, height));
+}
+
+// Whether images of the format are opaque, as they have no alpha.
+inline bool is_opaque(pixel_format format)
+{
+    switch (format) {
+        case pixel_format::gray:
+        case pixel_format::ycbcr:
+        case pixel_format::luma:
+        case pixel_format::bgr:
+        case pixel_format::rgb:
+        case pixel_format::v210:
+        case pixel_format::uyvy:
+        case pixel_format::nv12:
+        case pixel_format::p010:
+        case pixel_format::ycbcr10:
+            return true;
+        default:
+            return false;
+    }
+}
+
 struct pixel_format_desc final
 {
     struct plane
@@ -49,16 +123,18 @@ struct pixel_format_desc final
         int width    = 0;
         int height   = 0;
         int size     = 0;
-        int stride   = 0;
+        int stride   = 0; // Bytes per pixel.
+        int depth    = 1; // Bytes per channel, 1 or 2, so a plane has stride / depth channels.
 
         plane() = default;
 
-        plane(int width, int height, int stride)
+        plane(int width, int height, int stride, int depth = 1)
             : linesize(width * stride)
             , width(width)
             , height(height)
             , size(width * height * stride)
             , stride(stride)
+            , depth(depth)
         {
         }
     };
@@ -74,4 +150,14 @@ struct pixel_format_desc final
     std::vector<plane> planes;
 };
 
+// The plane of a bc3 image of width by height pixels. Its linesize is a row of blocks, and the blocks at the right
+// and bottom edges are only partly used when the size is not a multiple of 4.
+inline pixel_format_desc::plane bc3_plane(int width, int height)
+{
+    pixel_format_desc::plane plane(width, height, 1);
+    plane.linesize = (width + 3) / 4 * 16;
+    plane.size     = plane.linesize * ((height + 3) / 4);
+    return plane;
+}
+
 }} // namespace caspar::core
\ No newline at end of file
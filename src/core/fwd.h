@@ -44,3 +44,8 @@ FORWARD2(caspar, core, struct write_frame_consumer);
 FORWARD2(caspar, core, struct frame_producer_dependencies);
 FORWARD2(caspar, core, struct module_dependencies);
 FORWARD2(caspar, core, class frame_producer_registry);
+FORWARD2(caspar, core, class frame_consumer_registry);
+FORWARD2(caspar, core, class thumbnail_generator);
+FORWARD2(caspar, core, class reference_clock);
+FORWARD2(caspar, core, class reference_clock_registry);
+FORWARD2(caspar, core, class clock_scheduler);
@@ -22,6 +22,7 @@
 #include "../../StdAfx.h"
 
 #include "audio_mixer.h"
+#include "loudness_meter.h"
 
 #include <core/frame/frame.h>
 #include <core/frame/frame_transform.h>
@@ -34,7 +35,15 @@
 #include <boost/range/adaptors.hpp>
 #include <boost/range/algorithm.hpp>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <map>
 #include <stack>
 #include <vector>
@@ -49,7 +58,81 @@ struct audio_item
     array<const int32_t> samples;
 };
 
-typedef std::vector<double> audio_buffer_ps;
+// The largest float which converts to an int32_t without overflow.
+static const float max_sample = 2147483520.0f;
+static const float min_sample = -2147483648.0f;
+
+// Channels of which the peaks are tracked four at a time, larger layouts are metered one sample at a time.
+static const int max_vector_channels = 64;
+
+// The gains of four consecutive samples of a ramp starting at gain + step.
+static __m128 ramp(float gain, float step)
+{
+    return _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(_mm_set_ps(4.0f, 3.0f, 2.0f, 1.0f), _mm_set1_ps(step)));
+}
+
+// Adds count samples to bus, scaled by a gain which starts at gain + step and grows by step with every sample.
+static void accumulate(float* bus, const int32_t* samples, std::size_t count, float gain, float step)
+{
+    auto gains      = ramp(gain, step);
+    auto gains_step = _mm_set1_ps(step * 4.0f);
+
+    std::size_t n = 0;
+    for (; n + 4 <= count; n += 4) {
+        auto values = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + n)));
+        _mm_storeu_ps(bus + n, _mm_add_ps(_mm_loadu_ps(bus + n), _mm_mul_ps(values, gains)));
+        gains = _mm_add_ps(gains, gains_step);
+    }
+    for (; n < count; ++n) {
+        bus[n] += static_cast<float>(samples[n]) * (gain + step * static_cast<float>(n + 1));
+    }
+}
+
+// Applies the ramped master gain to bus, saturates it into result and returns the peak of each channel, in one pass.
+static std::vector<float>
+master(const float* bus, int32_t* result, std::size_t count, int channels, float gain, float step)
+{
+    std::vector<float> peaks(channels, 0.0f);
+
+    std::size_t n = 0;
+    if (channels % 4 == 0 && channels <= max_vector_channels) {
+        auto gains      = ramp(gain, step);
+        auto gains_step = _mm_set1_ps(step * 4.0f);
+        auto max        = _mm_set1_ps(max_sample);
+        auto min        = _mm_set1_ps(min_sample);
+        auto abs_mask   = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+        __m128 vector_peaks[max_vector_channels / 4];
+        for (auto& peak : vector_peaks) {
+            peak = _mm_setzero_ps();
+        }
+
+        const auto groups = static_cast<std::size_t>(channels / 4);
+        for (std::size_t group = 0; n + 4 <= count; n += 4) {
+            auto values = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(bus + n), gains), min), max);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(result + n), _mm_cvttps_epi32(values));
+
+            vector_peaks[group] = _mm_max_ps(vector_peaks[group], _mm_and_ps(values, abs_mask));
+            if (++group == groups) {
+                group = 0;
+            }
+            gains = _mm_add_ps(gains, gains_step);
+        }
+
+        for (std::size_t group = 0; group < groups; ++group) {
+            _mm_storeu_ps(peaks.data() + group * 4, vector_peaks[group]);
+        }
+    }
+    for (; n < count; ++n) {
+        auto value = std::min(std::max(bus[n] * (gain + step * static_cast<float>(n + 1)), min_sample), max_sample);
+        result[n]  = static_cast<int32_t>(value);
+
+        auto& peak = peaks[n % channels];
+        peak       = std::max(peak, std::abs(value));
+    }
+
+    return peaks;
+}
 
 struct audio_mixer::impl : boost::noncopyable
 {
@@ -59,6 +142,14 @@ struct audio_mixer::impl : boost::noncopyable
     std::atomic<float>                  master_volume_{1.0f};
     spl::shared_ptr<diagnostics::graph> graph_;
 
+    // Volumes of the previous frame, which the volumes of the current frame are ramped from.
+    std::vector<float> volumes_;
+    float              previous_master_volume_ = 1.0f;
+
+    std::vector<float> bus_;
+
+    std::unique_ptr<loudness_meter> loudness_;
+
   public:
     impl(spl::shared_ptr<diagnostics::graph> graph)
         : graph_(std::move(graph))
@@ -95,52 +186,78 @@ struct audio_mixer::impl : boost::noncopyable
     {
         auto channels = format_desc.audio_channels;
         auto items    = std::move(items_);
-        auto result   = std::vector<int32_t>(nb_samples * channels, 0);
+        auto size     = static_cast<std::size_t>(nb_samples * channels);
+        auto result   = array<int32_t>(size);
 
-        if (items.empty()) {
-            return result;
+        std::vector<float> volumes;
+        for (auto& item : items) {
+            volumes.push_back(static_cast<float>(item.transform.volume));
         }
 
-        auto mixed = std::vector<double>(nb_samples * channels, 0.0f);
+        // Items are only known by their order, so volumes are only ramped while the number of items is unchanged.
+        // Ramps run over the interleaved samples of the frame, which keeps MIXER VOLUME tweens free of steps.
+        const auto ramped = volumes.size() == volumes_.size();
+        volumes_.swap(volumes);
 
-        for (auto& item : items) {
-            auto ptr  = item.samples.data();
-            auto size = std::min(item.samples.size(), result.size());
-            for (auto n = 0; n < size; ++n) {
-                mixed[n] = static_cast<double>(ptr[n]) * item.transform.volume + mixed[n];
-            }
+        auto master_volume      = master_volume_.load();
+        auto from_master_volume = previous_master_volume_;
+        previous_master_volume_ = master_volume;
+
+        if (items.empty() || size == 0) {
+            measure(result, format_desc);
+            return std::move(result);
         }
 
-        auto master_volume = master_volume_.load();
-        for (auto n = 0; n < mixed.size(); ++n) {
-            auto sample = mixed[n] * master_volume;
-            if (sample > std::numeric_limits<int32_t>::max()) {
-                result[n] = std::numeric_limits<int32_t>::max();
-            } else if (sample < std::numeric_limits<int32_t>::min()) {
-                result[n] = std::numeric_limits<int32_t>::min();
-            } else {
-                result[n] = static_cast<int32_t>(sample);
-            }
+        bus_.assign(size, 0.0f);
+
+        for (std::size_t n = 0; n < items.size(); ++n) {
+            auto to   = volumes_[n];
+            auto from = ramped ? volumes[n] : to;
+            auto step = (to - from) / static_cast<float>(size);
+
+            accumulate(bus_.data(), items[n].samples.data(), std::min(items[n].samples.size(), size), from, step);
         }
 
-        auto max = std::vector<int32_t>(channels, std::numeric_limits<int32_t>::min());
-        for (size_t n = 0; n < result.size(); n += channels) {
-            for (int ch = 0; ch < channels; ++ch) {
-                max[ch] = std::max(max[ch], std::abs(result[n + ch]));
-            }
+        auto peaks = master(bus_.data(),
+                            result.data(),
+                            size,
+                            channels,
+                            from_master_volume,
+                            (master_volume - from_master_volume) / static_cast<float>(size));
+
+        auto max = std::vector<int32_t>(channels);
+        for (int ch = 0; ch < channels; ++ch) {
+            max[ch] = static_cast<int32_t>(peaks[ch]);
         }
 
-        if (boost::range::count_if(max, [](auto val) { return val >= std::numeric_limits<int32_t>::max(); }) > 0) {
+        if (boost::range::count_if(peaks, [](auto val) { return val >= max_sample; }) > 0) {
             graph_->set_tag(diagnostics::tag_severity::WARNING, "audio-clipping");
         }
 
-        state_["volume"] = std::move(max);
-
         graph_->set_value("volume",
                           static_cast<double>(*boost::max_element(max)) / std::numeric_limits<int32_t>::max());
 
+        state_["volume"] = std::move(max);
+
+        measure(result, format_desc);
+
         return std::move(result);
     }
+
+    void measure(const array<int32_t>& samples, const video_format_desc& format_desc)
+    {
+        if (!loudness_ || loudness_->channels() != format_desc.audio_channels ||
+            loudness_->sample_rate() != format_desc.audio_sample_rate) {
+            loudness_.reset(new loudness_meter(format_desc.audio_channels, format_desc.audio_sample_rate));
+        }
+
+        loudness_->update(samples.data(), samples.size());
+
+        state_["loudness"]["momentary"]  = loudness_->momentary();
+        state_["loudness"]["short-term"] = loudness_->short_term();
+        state_["loudness"]["integrated"] = loudness_->integrated();
+        state_["loudness"]["true-peak"]  = loudness_->true_peak();
+    }
 };
 
 audio_mixer::audio_mixer(spl::shared_ptr<diagnostics::graph> graph)
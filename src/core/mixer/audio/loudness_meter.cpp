@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../StdAfx.h"
+
+#include "loudness_meter.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+#include <boost/circular_buffer.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+namespace caspar { namespace core {
+
+namespace {
+
+// Loudness reported for silence, and the absolute gate of integrated loudness.
+const double silence       = -120.0;
+const double absolute_gate = -70.0;
+
+// Gating blocks are binned in 0.1 LU steps from the absolute gate up to +5 LUFS.
+const int    histogram_bins = 750;
+const double histogram_step = 0.1;
+
+const double sample_scale = 1.0 / 2147483648.0;
+const double pi           = 3.14159265358979323846;
+
+struct biquad
+{
+    double b0, b1, b2, a1, a2;
+};
+
+// The two stages of the K-weighting filter, for any sample rate.
+biquad shelf_filter(int sample_rate)
+{
+    const double f0 = 1681.974450955533;
+    const double g  = 3.999843853973347;
+    const double q  = 0.7071752369554196;
+
+    const double k  = std::tan(pi * f0 / sample_rate);
+    const double vh = std::pow(10.0, g / 20.0);
+    const double vb = std::pow(vh, 0.4996667741545416);
+    const double a0 = 1.0 + k / q + k * k;
+
+    return {(vh + vb * k / q + k * k) / a0,
+            2.0 * (k * k - vh) / a0,
+            (vh - vb * k / q + k * k) / a0,
+            2.0 * (k * k - 1.0) / a0,
+            (1.0 - k / q + k * k) / a0};
+}
+
+biquad highpass_filter(int sample_rate)
+{
+    const double f0 = 38.13547087602444;
+    const double q  = 0.5003270373238773;
+
+    const double k  = std::tan(pi * f0 / sample_rate);
+    const double a0 = 1.0 + k / q + k * k;
+
+    return {1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+}
+
+// The four phase, 4x oversampling interpolator of BS.1770-4 annex 2, by tap and phase.
+const float true_peak_taps[12][4] = {{0.0017089843750f, -0.0291748046875f, -0.0189208984375f, -0.0083007812500f},
+                                     {0.0109863281250f, 0.0292968750000f, 0.0330810546875f, 0.0148925781250f},
+                                     {-0.0196533203125f, -0.0517578125000f, -0.0582275390625f, -0.0266113281250f},
+                                     {0.0332031250000f, 0.0891113281250f, 0.1015625000000f, 0.0476074218750f},
+                                     {-0.0594482421875f, -0.1665039062500f, -0.2003173828125f, -0.1022949218750f},
+                                     {0.1373291015625f, 0.4650878906250f, 0.7797851562500f, 0.9721679687500f},
+                                     {0.9721679687500f, 0.7797851562500f, 0.4650878906250f, 0.1373291015625f},
+                                     {-0.1022949218750f, -0.2003173828125f, -0.1665039062500f, -0.0594482421875f},
+                                     {0.0476074218750f, 0.1015625000000f, 0.0891113281250f, 0.0332031250000f},
+                                     {-0.0266113281250f, -0.0582275390625f, -0.0517578125000f, -0.0196533203125f},
+                                     {0.0148925781250f, 0.0330810546875f, 0.0292968750000f, 0.0109863281250f},
+                                     {-0.0083007812500f, -0.0189208984375f, -0.0291748046875f, 0.0017089843750f}};
+
+const int true_peak_length = 12;
+
+double to_loudness(double energy)
+{
+    return energy > 0.0 ? std::max(silence, -0.691 + 10.0 * std::log10(energy)) : silence;
+}
+
+double to_energy(double loudness) { return std::pow(10.0, (loudness + 0.691) / 10.0); }
+
+} // namespace
+
+struct loudness_meter::impl
+{
+    const int         channels_;
+    const int         sample_rate_;
+    const std::size_t block_size_; // Samples per channel of the 100 ms steps gating blocks advance by.
+
+    const biquad shelf_;
+    const biquad highpass_;
+
+    std::vector<double> weights_;
+    std::vector<double> filter_state_; // Eight values per pair of channels, the state of both stages for each.
+
+    std::size_t                    block_samples_ = 0;
+    double                         block_energy_  = 0.0;
+    boost::circular_buffer<double> blocks_{30}; // Mean square of the last 3 s, in 100 ms steps.
+
+    std::vector<std::uint64_t> histogram_;
+    std::vector<double>        histogram_energies_;
+
+    std::vector<float> true_peak_history_; // Two copies of the last samples of every channel, so each is contiguous.
+    int                true_peak_position_ = 0;
+    float              true_peak_          = 0.0f;
+
+    impl(int channels, int sample_rate)
+        : channels_(channels)
+        , sample_rate_(sample_rate)
+        , block_size_(static_cast<std::size_t>(std::max(1, sample_rate / 10)))
+        , shelf_(shelf_filter(sample_rate))
+        , highpass_(highpass_filter(sample_rate))
+        , weights_((channels + 1) / 2 * 2, 0.0)
+        , filter_state_((channels + 1) / 2 * 8, 0.0)
+        , histogram_(histogram_bins, 0)
+        , true_peak_history_(channels * true_peak_length * 2, 0.0f)
+    {
+        for (int ch = 0; ch < channels_; ++ch) {
+            if (channels_ == 6 || channels_ == 8) {
+                weights_[ch] = ch == 3 ? 0.0 : (ch < 3 ? 1.0 : 1.41);
+            } else {
+                weights_[ch] = 1.0;
+            }
+        }
+
+        for (int bin = 0; bin < histogram_bins; ++bin) {
+            histogram_energies_.push_back(to_energy(absolute_gate + (bin + 0.5) * histogram_step));
+        }
+    }
+
+    void update(const std::int32_t* samples, std::size_t count)
+    {
+        auto frames = count / channels_;
+        while (frames > 0) {
+            auto chunk = std::min(frames, block_size_ - block_samples_);
+
+            filter(samples, chunk);
+            detect_true_peak(samples, chunk);
+
+            samples += chunk * channels_;
+            frames -= chunk;
+            block_samples_ += chunk;
+
+            if (block_samples_ == block_size_) {
+                end_block();
+            }
+        }
+    }
+
+    // K-weights two channels at a time and adds their weighted energy to the current block.
+    void filter(const std::int32_t* samples, std::size_t frames)
+    {
+        const auto scale = _mm_set1_pd(sample_scale);
+        const auto sb0   = _mm_set1_pd(shelf_.b0);
+        const auto sb1   = _mm_set1_pd(shelf_.b1);
+        const auto sb2   = _mm_set1_pd(shelf_.b2);
+        const auto sa1   = _mm_set1_pd(shelf_.a1);
+        const auto sa2   = _mm_set1_pd(shelf_.a2);
+        const auto hb0   = _mm_set1_pd(highpass_.b0);
+        const auto hb1   = _mm_set1_pd(highpass_.b1);
+        const auto hb2   = _mm_set1_pd(highpass_.b2);
+        const auto ha1   = _mm_set1_pd(highpass_.a1);
+        const auto ha2   = _mm_set1_pd(highpass_.a2);
+
+        for (int ch = 0; ch < channels_; ch += 2) {
+            const auto pair  = ch + 1 < channels_;
+            const auto state = filter_state_.data() + ch / 2 * 8;
+
+            auto z1 = _mm_loadu_pd(state + 0);
+            auto z2 = _mm_loadu_pd(state + 2);
+            auto z3 = _mm_loadu_pd(state + 4);
+            auto z4 = _mm_loadu_pd(state + 6);
+
+            auto energy = _mm_setzero_pd();
+            for (std::size_t n = 0; n < frames; ++n) {
+                const auto sample = samples + n * channels_ + ch;
+
+                auto x = _mm_mul_pd(_mm_set_pd(pair ? sample[1] : 0.0, sample[0]), scale);
+
+                // Both stages are transposed direct form II.
+                auto y = _mm_add_pd(_mm_mul_pd(sb0, x), z1);
+                z1     = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(sb1, x), _mm_mul_pd(sa1, y)), z2);
+                z2     = _mm_sub_pd(_mm_mul_pd(sb2, x), _mm_mul_pd(sa2, y));
+
+                auto k = _mm_add_pd(_mm_mul_pd(hb0, y), z3);
+                z3     = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(hb1, y), _mm_mul_pd(ha1, k)), z4);
+                z4     = _mm_sub_pd(_mm_mul_pd(hb2, y), _mm_mul_pd(ha2, k));
+
+                energy = _mm_add_pd(energy, _mm_mul_pd(k, k));
+            }
+
+            _mm_storeu_pd(state + 0, z1);
+            _mm_storeu_pd(state + 2, z2);
+            _mm_storeu_pd(state + 4, z3);
+            _mm_storeu_pd(state + 6, z4);
+
+            double energies[2];
+            _mm_storeu_pd(energies, _mm_mul_pd(energy, _mm_loadu_pd(weights_.data() + ch)));
+            block_energy_ += energies[0] + energies[1];
+        }
+    }
+
+    // Interpolates every channel 4x and keeps the largest absolute value, all four phases at a time.
+    void detect_true_peak(const std::int32_t* samples, std::size_t frames)
+    {
+        const auto abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+        __m128 taps[true_peak_length];
+        for (int k = 0; k < true_peak_length; ++k) {
+            taps[k] = _mm_loadu_ps(true_peak_taps[k]);
+        }
+
+        auto position = true_peak_position_;
+        auto peak     = _mm_setzero_ps();
+
+        for (int ch = 0; ch < channels_; ++ch) {
+            const auto history = true_peak_history_.data() + ch * true_peak_length * 2;
+
+            position = true_peak_position_;
+            for (std::size_t n = 0; n < frames; ++n) {
+                auto x = static_cast<float>(samples[n * channels_ + ch] * sample_scale);
+
+                position                              = (position + 1) % true_peak_length;
+                history[position]                     = x;
+                history[position + true_peak_length] = x;
+
+                // The window runs from the oldest sample to x, which meets the last tap.
+                const auto window = history + position + 1;
+
+                auto value = _mm_setzero_ps();
+                for (int k = 0; k < true_peak_length; ++k) {
+                    value = _mm_add_ps(value, _mm_mul_ps(taps[true_peak_length - 1 - k], _mm_set1_ps(window[k])));
+                }
+                peak = _mm_max_ps(peak, _mm_and_ps(value, abs_mask));
+            }
+        }
+
+        true_peak_position_ = position;
+
+        float peaks[4];
+        _mm_storeu_ps(peaks, peak);
+        true_peak_ = std::max(true_peak_, *std::max_element(peaks, peaks + 4));
+    }
+
+    void end_block()
+    {
+        blocks_.push_back(block_energy_ / static_cast<double>(block_size_));
+        block_energy_  = 0.0;
+        block_samples_ = 0;
+
+        // Gating blocks are 400 ms long and overlap by 75%.
+        if (blocks_.size() >= 4) {
+            auto loudness = to_loudness(mean(4));
+            if (loudness >= absolute_gate) {
+                auto bin = static_cast<int>((loudness - absolute_gate) / histogram_step);
+                ++histogram_[std::min(bin, histogram_bins - 1)];
+            }
+        }
+    }
+
+    double mean(std::size_t count) const
+    {
+        count = std::min(count, blocks_.size());
+        if (count == 0) {
+            return 0.0;
+        }
+        return std::accumulate(blocks_.end() - count, blocks_.end(), 0.0) / static_cast<double>(count);
+    }
+
+    double integrated() const
+    {
+        // Blocks above the absolute gate set a relative gate 10 LU below their loudness.
+        auto gated_mean = [&](int first_bin) {
+            double        energy = 0.0;
+            std::uint64_t count  = 0;
+            for (int bin = std::max(0, first_bin); bin < histogram_bins; ++bin) {
+                energy += histogram_energies_[bin] * static_cast<double>(histogram_[bin]);
+                count += histogram_[bin];
+            }
+            return count > 0 ? energy / static_cast<double>(count) : 0.0;
+        };
+
+        auto absolute = gated_mean(0);
+        if (absolute <= 0.0) {
+            return silence;
+        }
+
+        auto relative_gate = to_loudness(absolute) - 10.0;
+        auto first_bin     = static_cast<int>(std::ceil((relative_gate - absolute_gate) / histogram_step - 0.5));
+        return to_loudness(gated_mean(first_bin));
+    }
+
+    double true_peak()
+    {
+        auto peak  = true_peak_;
+        true_peak_ = 0.0f;
+        return peak > 0.0f ? std::max(silence, 20.0 * std::log10(peak)) : silence;
+    }
+};
+
+loudness_meter::loudness_meter(int channels, int sample_rate)
+    : impl_(new impl(channels, sample_rate))
+{
+}
+loudness_meter::~loudness_meter() {}
+void   loudness_meter::update(const std::int32_t* samples, std::size_t count) { impl_->update(samples, count); }
+double loudness_meter::momentary() const { return to_loudness(impl_->mean(4)); }
+double loudness_meter::short_term() const { return to_loudness(impl_->mean(30)); }
+double loudness_meter::integrated() const { return impl_->integrated(); }
+double loudness_meter::true_peak() { return impl_->true_peak(); }
+int    loudness_meter::channels() const { return impl_->channels_; }
+int    loudness_meter::sample_rate() const { return impl_->sample_rate_; }
+
+}} // namespace caspar::core
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace caspar { namespace core {
+
+// Measures the loudness and true peak of interleaved audio as specified by ITU-R BS.1770-4 and EBU R128. Channels
+// are weighted as 5.1 or 7.1 when there are six or eight of them, otherwise every channel counts fully.
+class loudness_meter final
+{
+  public:
+    loudness_meter(int channels, int sample_rate);
+    loudness_meter(const loudness_meter&) = delete;
+
+    ~loudness_meter();
+
+    loudness_meter& operator=(const loudness_meter&) = delete;
+
+    void update(const std::int32_t* samples, std::size_t count);
+
+    // LUFS over the last 400 ms, the last 3 s and the gated program so far.
+    double momentary() const;
+    double short_term() const;
+    double integrated() const;
+
+    // dBTP since the previous call.
+    double true_peak();
+
+    int channels() const;
+    int sample_rate() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::core
@@ -21,12 +21,17 @@
 
 #pragma once
 
+#include <common/future.h>
+
 #include <core/frame/frame.h>
 #include <core/frame/frame_factory.h>
 #include <core/frame/frame_visitor.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
 
 #include <cstdint>
 #include <future>
+#include <vector>
 
 namespace caspar { namespace core {
 
@@ -45,9 +50,25 @@ class image_mixer
     virtual void visit(const class const_frame& frame)     = 0;
     virtual void pop()                                     = 0;
 
-    virtual std::future<array<const uint8_t>> operator()(const struct video_format_desc& format_desc) = 0;
+    // Renders the visited frames. The result holds the bgra image followed by the image converted into each of
+    // formats and then the bgra image scaled to each of sizes, in the same order. It is empty if nothing was visited,
+    // in which case the mixer outputs a blank frame. Without read_back the bgra image may be a deferred_image, which
+    // is only read back once a consumer reads it.
+    virtual std::future<std::vector<array<const uint8_t>>> operator()(const struct video_format_desc&   format_desc,
+                                                                      const std::vector<output_format>& formats,
+                                                                      const std::vector<output_size>&   sizes,
+                                                                      bool                              read_back) = 0;
 
     virtual class mutable_frame create_frame(const void* tag, const struct pixel_format_desc& desc) = 0;
+
+    // Allocates the resources which frames of format_desc are rendered with ahead of a switch to it.
+    virtual std::future<void> prepare(const struct video_format_desc& format_desc) { return make_ready_future(); }
+
+    // Milliseconds spent drawing each top level layer of a recently rendered frame, if measured.
+    virtual std::vector<double> layer_draw_times() const { return {}; }
+
+    // Implementation specific state, such as resource pool statistics.
+    virtual monitor::state state() const { return {}; }
 };
 
 }} // namespace caspar::core
\ No newline at end of file
@@ -46,12 +46,74 @@
 #include <tbb/concurrent_queue.h>
 
 #include <atomic>
+#include <cstring>
+#include <map>
 #include <mutex>
 #include <unordered_map>
 #include <vector>
 
 namespace caspar { namespace core {
 
+namespace {
+
+// Fills size bytes with a pattern of one or two 32 bit words.
+void fill_words(std::uint8_t* dest, std::size_t size, std::uint32_t first, std::uint32_t second)
+{
+    const std::uint32_t pattern[] = {first, second};
+    for (std::size_t n = 0; n + 4 <= size; n += 4) {
+        std::memcpy(dest + n, &pattern[n / 4 % 2], 4);
+    }
+}
+
+// A black image of the size which the image mixers convert a width x height frame into format, see
+// core::output_format.
+array<const std::uint8_t> make_black_image(output_format format, int width, int height)
+{
+    const auto w = static_cast<std::size_t>(width);
+    const auto h = static_cast<std::size_t>(height);
+
+    switch (format) {
+        case output_format::bgra:
+        case output_format::key:
+            return array<std::uint8_t>(w * h * 4);
+        case output_format::quarter:
+            return array<std::uint8_t>((w + 3) / 4 * ((h + 3) / 4) * 4);
+        case output_format::uyvy: {
+            array<std::uint8_t> image((w + 1) / 2 * 4 * h);
+            fill_words(image.data(), image.size(), 0x10801080, 0x10801080);
+            return image;
+        }
+        case output_format::v210: {
+            // NOTE: Rows are padded to 128 bytes, an even number of words, so the pattern runs on across rows.
+            array<std::uint8_t> image((w + 47) / 48 * 128 * h);
+            fill_words(image.data(), image.size(), 0x20010200, 0x04080040);
+            return image;
+        }
+        case output_format::nv12: {
+            array<std::uint8_t> image(w * h + w * ((h + 1) / 2));
+            std::memset(image.data(), 16, w * h);
+            std::memset(image.data() + w * h, 128, w * ((h + 1) / 2));
+            return image;
+        }
+        case output_format::rfc4175: {
+            // NOTE: Cb 512, Y 64, Cr 512, Y 64 in ten bits each, rows padded to 4 bytes.
+            const std::uint8_t  group[] = {0x80, 0x04, 0x08, 0x00, 0x40};
+            const auto          stride  = ((w + 1) / 2 * 5 + 3) / 4 * 4;
+            array<std::uint8_t> image(stride * h);
+            for (std::size_t y = 0; y < h; ++y) {
+                for (std::size_t x = 0; x < (w + 1) / 2; ++x) {
+                    std::memcpy(image.data() + y * stride + x * 5, group, 5);
+                }
+            }
+            return image;
+        }
+        default:
+            return array<const std::uint8_t>{};
+    }
+}
+
+} // namespace
+
 struct mixer::impl : boost::noncopyable
 {
     monitor::state                       state_;
@@ -60,6 +122,31 @@ struct mixer::impl : boost::noncopyable
     audio_mixer                          audio_mixer_{graph_};
     spl::shared_ptr<image_mixer>         image_mixer_;
     std::queue<std::future<const_frame>> buffer_;
+    std::atomic<int>                     buffer_depth_{1};
+
+    // The images of the last rendered frame, which frames that are not rendered repeat.
+    struct rendered
+    {
+        std::shared_future<std::vector<array<const std::uint8_t>>> image;
+        int                                                        width  = 0;
+        int                                                        height = 0;
+        std::vector<output_format>                                 formats;
+        std::vector<output_size>                                   sizes;
+        bool                                                       read_back = true;
+    };
+    rendered last_;
+
+    // The images of blank frames, which the image mixer does not render. They are kept for as long as the channel
+    // format and the requested formats and sizes stay the same.
+    struct blank
+    {
+        int                                                width  = 0;
+        int                                                height = 0;
+        array<const std::uint8_t>                          image;
+        std::map<output_format, array<const std::uint8_t>> converted;
+        std::map<output_size, array<const std::uint8_t>>   scaled;
+    };
+    blank blank_;
 
   public:
     impl(int channel_index, spl::shared_ptr<diagnostics::graph> graph, spl::shared_ptr<image_mixer> image_mixer)
@@ -69,38 +156,148 @@ struct mixer::impl : boost::noncopyable
     {
     }
 
-    const_frame operator()(std::map<int, draw_frame> frames, const video_format_desc& format_desc, int nb_samples)
+    const_frame operator()(const boost::container::flat_map<int, draw_frame>& frames,
+                           const video_format_desc&                           format_desc,
+                           int                                                nb_samples,
+                           const std::vector<output_format>&                  formats,
+                           const std::vector<output_size>&                    sizes,
+                           bool                                               render,
+                           bool                                               read_back)
     {
-        for (auto& frame : frames) {
-            frame.second.accept(audio_mixer_);
-            frame.second.transform().image_transform.layer_depth = 1;
-            frame.second.accept(*image_mixer_);
+        // NOTE: Repeated images are only reused if they were read back whenever this frame needs them to be.
+        render = render || !last_.image.valid() || last_.width != format_desc.width ||
+                 last_.height != format_desc.height || last_.formats != formats || last_.sizes != sizes ||
+                 (read_back && !last_.read_back);
+
+        for (auto& p : frames) {
+            p.second.accept(audio_mixer_);
+            if (render) {
+                auto frame                                    = p.second;
+                frame.transform().image_transform.layer_depth = 1;
+                frame.accept(*image_mixer_);
+            }
         }
 
-        auto image = (*image_mixer_)(format_desc);
+        if (render) {
+            last_ = rendered{(*image_mixer_)(format_desc, formats, sizes, read_back).share(),
+                             format_desc.width,
+                             format_desc.height,
+                             formats,
+                             sizes,
+                             read_back};
+        }
+        auto image = last_.image;
         auto audio = audio_mixer_(format_desc, nb_samples);
 
-        state_["audio"] = audio_mixer_.state();
+        monitor::state state;
+        state["audio"]    = audio_mixer_.state();
+        state["image"]    = image_mixer_->state();
+        state["rendered"] = render;
+
+        // Every stage layer is one top level layer of the image mixer, in the same order.
+        auto draw_times = image_mixer_->layer_draw_times();
+        auto it         = frames.begin();
+        for (std::size_t n = 0; render && n < draw_times.size() && it != frames.end(); ++n, ++it) {
+            state["profile"]["layer"][it->first]["draw-time"] = draw_times[n];
+        }
 
         buffer_.push(std::async(
             std::launch::deferred,
-            [image = std::move(image), audio = std::move(audio), graph = graph_, format_desc, tag = this]() mutable {
+            [this,
+             image = std::move(image),
+             audio = std::move(audio),
+             graph = graph_,
+             format_desc,
+             formats,
+             sizes]() mutable {
                 auto desc = pixel_format_desc(pixel_format::bgra);
                 desc.planes.push_back(pixel_format_desc::plane(format_desc.width, format_desc.height, 4));
+
+                auto images = image.get();
+                if (images.empty()) {
+                    return blank_frame(std::move(audio), desc, format_desc, formats, sizes);
+                }
+
+                std::map<output_format, array<const uint8_t>> converted;
+                for (std::size_t n = 0; n < formats.size() && n + 1 < images.size(); ++n) {
+                    converted[formats[n]] = std::move(images[n + 1]);
+                }
+
+                std::map<output_size, array<const uint8_t>> scaled;
+                for (std::size_t n = 0; n < sizes.size() && n + formats.size() + 1 < images.size(); ++n) {
+                    scaled[sizes[n]] = std::move(images[n + formats.size() + 1]);
+                }
+
                 std::vector<array<const uint8_t>> image_data;
-                image_data.emplace_back(std::move(image.get()));
-                return const_frame(std::move(image_data), std::move(audio), desc);
+                image_data.emplace_back(std::move(images.at(0)));
+                return const_frame(
+                    std::move(image_data), std::move(audio), desc, std::move(converted), std::move(scaled));
             }));
 
-        if (buffer_.size() < 2) {
+        const auto depth = static_cast<std::size_t>(buffer_depth_.load());
+
+        // Drop frames which are no longer needed after the buffer depth has been reduced.
+        while (buffer_.size() > depth + 1) {
+            buffer_.pop();
+        }
+
+        state["buffer-depth"] = static_cast<int>(depth);
+
+        if (buffer_.size() <= depth) {
+            state["latency"] = 0;
+            state_           = std::move(state);
             return const_frame{};
         }
 
         auto frame = std::move(buffer_.front().get());
         buffer_.pop();
+
+        state["latency"] = static_cast<int>(buffer_.size());
+        state_           = std::move(state);
+
         return frame;
     }
 
+    // NOTE: Runs on the mixer thread, where the deferred frames of buffer_ are taken.
+    const_frame blank_frame(array<const std::int32_t>         audio,
+                            const pixel_format_desc&          desc,
+                            const video_format_desc&          format_desc,
+                            const std::vector<output_format>& formats,
+                            const std::vector<output_size>&   sizes)
+    {
+        if (blank_.width != format_desc.width || blank_.height != format_desc.height) {
+            blank_        = blank{};
+            blank_.width  = format_desc.width;
+            blank_.height = format_desc.height;
+            blank_.image  = make_black_image(output_format::bgra, format_desc.width, format_desc.height);
+        }
+
+        std::map<output_format, array<const std::uint8_t>> converted;
+        for (auto format : formats) {
+            auto it = blank_.converted.find(format);
+            if (it == blank_.converted.end()) {
+                it = blank_.converted.emplace(format, make_black_image(format, format_desc.width, format_desc.height))
+                         .first;
+            }
+            converted[format] = it->second;
+        }
+
+        std::map<output_size, array<const std::uint8_t>> scaled;
+        for (auto& size : sizes) {
+            auto it = blank_.scaled.find(size);
+            if (it == blank_.scaled.end()) {
+                it = blank_.scaled.emplace(size, make_black_image(output_format::bgra, size.width, size.height)).first;
+            }
+            scaled[size] = it->second;
+        }
+
+        return const_frame({blank_.image}, std::move(audio), desc, std::move(converted), std::move(scaled), true);
+    }
+
+    void set_buffer_depth(int depth) { buffer_depth_ = std::max(0, depth); }
+
+    int get_buffer_depth() const { return buffer_depth_; }
+
     void set_master_volume(float volume) { audio_mixer_.set_master_volume(volume); }
 
     float get_master_volume() { return audio_mixer_.get_master_volume(); }
@@ -110,11 +307,19 @@ mixer::mixer(int channel_index, spl::shared_ptr<diagnostics::graph> graph, spl::
     : impl_(new impl(channel_index, std::move(graph), std::move(image_mixer)))
 {
 }
+void        mixer::set_buffer_depth(int depth) { impl_->set_buffer_depth(depth); }
+int         mixer::get_buffer_depth() const { return impl_->get_buffer_depth(); }
 void        mixer::set_master_volume(float volume) { impl_->set_master_volume(volume); }
 float       mixer::get_master_volume() { return impl_->get_master_volume(); }
-const_frame mixer::operator()(std::map<int, draw_frame> frames, const video_format_desc& format_desc, int nb_samples)
+const_frame mixer::operator()(const boost::container::flat_map<int, draw_frame>& frames,
+                              const video_format_desc&                           format_desc,
+                              int                                                nb_samples,
+                              const std::vector<output_format>&                  formats,
+                              const std::vector<output_size>&                    sizes,
+                              bool                                               render,
+                              bool                                               read_back)
 {
-    return (*impl_)(std::move(frames), format_desc, nb_samples);
+    return (*impl_)(frames, format_desc, nb_samples, formats, sizes, render, read_back);
 }
 mutable_frame mixer::create_frame(const void* tag, const pixel_format_desc& desc)
 {
@@ -26,13 +26,15 @@
 #include <common/forward.h>
 #include <common/memory.h>
 
+#include <core/frame/pixel_format.h>
 #include <core/fwd.h>
 #include <core/monitor/monitor.h>
 
+#include <boost/container/flat_map.hpp>
 #include <boost/property_tree/ptree_fwd.hpp>
 
 #include <future>
-#include <map>
+#include <vector>
 
 FORWARD2(caspar, diagnostics, class graph);
 
@@ -48,7 +50,20 @@ class mixer final
                    spl::shared_ptr<caspar::diagnostics::graph> graph,
                    spl::shared_ptr<image_mixer>                image_mixer);
 
-    const_frame operator()(std::map<int, draw_frame> frames, const video_format_desc& format_desc, int nb_samples);
+    // Mixes one frame. formats are the packed formats, besides bgra, and sizes the scaled sizes which the consumers of
+    // the frame have requested. Without render only the audio is mixed, and the images of the last rendered frame are
+    // repeated if they were rendered for the same formats and sizes. Without read_back no consumer reads the bgra
+    // image in host memory, so it is only read back on first access, see deferred_image.
+    const_frame operator()(const boost::container::flat_map<int, draw_frame>& frames,
+                           const video_format_desc&                           format_desc,
+                           int                                                nb_samples,
+                           const std::vector<output_format>&                  formats   = {},
+                           const std::vector<output_size>&                    sizes     = {},
+                           bool                                               render    = true,
+                           bool                                               read_back = true);
+
+    void set_buffer_depth(int depth);
+    int  get_buffer_depth() const;
 
     void  set_master_volume(float volume);
     float get_master_volume();
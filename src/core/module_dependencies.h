@@ -23,6 +23,7 @@
 
 #include <common/memory.h>
 
+#include "clock/clock.h"
 #include "consumer/frame_consumer.h"
 #include "producer/cg_proxy.h"
 #include "producer/frame_producer.h"
@@ -31,16 +32,19 @@ namespace caspar { namespace core {
 
 struct module_dependencies
 {
-    const spl::shared_ptr<cg_producer_registry>    cg_registry;
-    const spl::shared_ptr<frame_producer_registry> producer_registry;
-    const spl::shared_ptr<frame_consumer_registry> consumer_registry;
+    const spl::shared_ptr<cg_producer_registry>     cg_registry;
+    const spl::shared_ptr<frame_producer_registry>  producer_registry;
+    const spl::shared_ptr<frame_consumer_registry>  consumer_registry;
+    const spl::shared_ptr<reference_clock_registry> clock_registry;
 
-    module_dependencies(spl::shared_ptr<cg_producer_registry>    cg_registry,
-                        spl::shared_ptr<frame_producer_registry> producer_registry,
-                        spl::shared_ptr<frame_consumer_registry> consumer_registry)
+    module_dependencies(spl::shared_ptr<cg_producer_registry>     cg_registry,
+                        spl::shared_ptr<frame_producer_registry>  producer_registry,
+                        spl::shared_ptr<frame_consumer_registry>  consumer_registry,
+                        spl::shared_ptr<reference_clock_registry> clock_registry)
         : cg_registry(std::move(cg_registry))
         , producer_registry(std::move(producer_registry))
         , consumer_registry(std::move(consumer_registry))
+        , clock_registry(std::move(clock_registry))
     {
     }
 };
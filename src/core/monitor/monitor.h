@@ -36,84 +36,204 @@ typedef boost::variant<bool, std::int32_t, std::int64_t, float, double, std::str
 typedef boost::container::small_vector<data_t, 2>                                                  vector_t;
 typedef boost::container::flat_map<std::string, vector_t>                                          data_map_t;
 
+// Every entry carries the revision it was last changed at. A state which is kept alive and refreshed through update()
+// or apply() can hand out delta(since) to consumers, containing only what changed after a given revision. Removed
+// entries are reported in a delta as entries with an empty value.
 class state
 {
-    data_map_t data_;
+    data_map_t                                             data_;
+    std::vector<std::uint64_t>                             revisions_; // Parallel to data_.
+    boost::container::flat_map<std::string, std::uint64_t> removed_;
+    std::uint64_t                                          revision_ = 0;
 
     class state_proxy
     {
         std::string key_;
-        data_map_t& data_;
+        state&      state_;
 
-    public:
-        state_proxy(const std::string& key, data_map_t& data)
-            : key_(key)
-            , data_(data)
+        static void append(std::string& key, const std::string& value) { key += value; }
+        static void append(std::string& key, const char* value) { key += value; }
+        template <typename T>
+        static void append(std::string& key, const T& value)
+        {
+            key += boost::lexical_cast<std::string>(value);
+        }
+
+      public:
+        state_proxy(std::string key, state& state)
+            : key_(std::move(key))
+            , state_(state)
         {
         }
 
         state_proxy& operator=(data_t data)
         {
-            data_[key_] = { std::move(data) };
+            state_.set(key_, { std::move(data) });
             return *this;
         }
 
         state_proxy& operator=(vector_t data)
         {
-            data_[key_] = std::move(data);
+            state_.set(key_, std::move(data));
             return *this;
         }
 
         template<typename T>
         state_proxy operator[](const T& key)
         {
-            return state_proxy(key_ + "/" + boost::lexical_cast<std::string>(key), data_);
+            std::string path;
+            path.reserve(key_.size() + 16);
+            path += key_;
+            path += '/';
+            append(path, key);
+            return state_proxy(std::move(path), state_);
         }
 
         template <typename T>
         state_proxy& operator=(const std::vector<T>& data)
         {
-            data_[key_] = vector_t(data.begin(), data.end());
+            state_.set(key_, vector_t(data.begin(), data.end()));
             return *this;
         }
 
         state_proxy& operator=(std::initializer_list<data_t> data)
         {
-            data_[key_] = vector_t(std::move(data));
+            state_.set(key_, vector_t(std::move(data)));
             return *this;
         }
 
         state_proxy& operator=(const state& other)
         {
             for (auto& p : other) {
-                data_[key_ + "/" + p.first] = std::move(p.second);
+                state_.set(key_ + "/" + p.first, p.second);
             }
             return *this;
         }
     };
 
-  public:
-    state() = default;
-    state(const state& other)
-        : data_(other.data_)
+    void set(const std::string& key, vector_t value)
     {
+        auto it = data_.lower_bound(key);
+        if (it != data_.end() && it->first == key) {
+            if (it->second == value) {
+                return;
+            }
+            it->second                      = std::move(value);
+            revisions_[data_.index_of(it)] = ++revision_;
+        } else {
+            auto index = data_.index_of(it);
+            data_.emplace_hint(it, key, std::move(value));
+            revisions_.insert(revisions_.begin() + index, ++revision_);
+            removed_.erase(key);
+        }
     }
-    state(data_map_t data)
-        : data_(std::move(data))
+
+    void erase(const std::string& key)
     {
+        auto it = data_.find(key);
+        if (it == data_.end()) {
+            return;
+        }
+        revisions_.erase(revisions_.begin() + data_.index_of(it));
+        data_.erase(it);
+        removed_[key] = ++revision_;
     }
-    state& operator=(const state& other)
+
+  public:
+    state() = default;
+    state(const state& other) = default;
+    state(state&& other) = default;
+    state(data_map_t data)
+        : data_(std::move(data))
+        , revisions_(data_.size(), data_.empty() ? 0 : 1)
+        , revision_(data_.empty() ? 0 : 1)
     {
-        data_ = other.data_;
-        return *this;
     }
+    state& operator=(const state& other) = default;
+    state& operator=(state&& other) = default;
 
     template<typename T>
     state_proxy operator[](const T& key)
     {
-        return state_proxy(boost::lexical_cast<std::string>(key), data_);
+        return state_proxy(boost::lexical_cast<std::string>(key), *this);
+    }
+
+    // Replaces the content with next, bumping the revision only of entries which were added, changed or removed.
+    void update(state next)
+    {
+        auto incoming = std::move(next.data_).extract_sequence();
+        auto current  = std::move(data_).extract_sequence();
+
+        std::vector<std::uint64_t> revisions;
+        revisions.reserve(incoming.size());
+
+        const auto revision = revision_ + 1;
+        auto       changed  = false;
+
+        std::size_t i = 0;
+        std::size_t j = 0;
+        while (i < current.size() || j < incoming.size()) {
+            if (j == incoming.size() || (i < current.size() && current[i].first < incoming[j].first)) {
+                removed_[std::move(current[i].first)] = revision;
+                changed                               = true;
+                ++i;
+            } else if (i == current.size() || incoming[j].first < current[i].first) {
+                removed_.erase(incoming[j].first);
+                revisions.push_back(revision);
+                changed = true;
+                ++j;
+            } else {
+                if (current[i].second == incoming[j].second) {
+                    revisions.push_back(revisions_[i]);
+                } else {
+                    revisions.push_back(revision);
+                    changed = true;
+                }
+                ++i;
+                ++j;
+            }
+        }
+
+        data_.adopt_sequence(boost::container::ordered_unique_range, std::move(incoming));
+        revisions_ = std::move(revisions);
+
+        if (changed) {
+            revision_ = revision;
+        }
     }
 
+    // Merges a delta, as returned by delta(), into this state.
+    void apply(const state& delta)
+    {
+        for (auto& p : delta) {
+            if (p.second.empty()) {
+                erase(p.first);
+            } else {
+                set(p.first, p.second);
+            }
+        }
+    }
+
+    // Returns the entries changed after revision since, including removed entries with an empty value.
+    state delta(std::uint64_t since) const
+    {
+        state result;
+        for (std::size_t n = 0; n < data_.size(); ++n) {
+            if (revisions_[n] > since) {
+                auto& p = *data_.nth(n);
+                result.set(p.first, p.second);
+            }
+        }
+        for (auto& p : removed_) {
+            if (p.second > since) {
+                result.set(p.first, vector_t());
+            }
+        }
+        return result;
+    }
+
+    std::uint64_t revision() const { return revision_; }
+
     data_map_t::const_iterator begin() const
     {
         return data_.begin();
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cached_producer.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_visitor.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace caspar { namespace core {
+
+namespace {
+
+// The frames of a decoded clip and the bytes of their images and audio.
+struct clip
+{
+    std::vector<draw_frame> frames;
+    std::size_t             size = 0;
+};
+
+class size_visitor : public frame_visitor
+{
+  public:
+    std::size_t size = 0;
+
+    void push(const frame_transform&) override {}
+
+    void visit(const const_frame& frame) override
+    {
+        for (std::size_t n = 0; n < frame.pixel_format_desc().planes.size(); ++n) {
+            size += frame.image_data(n).size();
+        }
+        size += frame.audio_data().size() * sizeof(std::int32_t);
+    }
+
+    void pop() override {}
+};
+
+// The least recently played clips, up to clip-cache.size megabytes. Clips which are evicted while they are played
+// are released once their last producer is.
+class clip_cache
+{
+    const std::size_t capacity_ =
+        static_cast<std::size_t>(std::max(0, env::properties().get(L"configuration.clip-cache.size", 1024))) * 1024 *
+        1024;
+
+    std::mutex                                                       mutex_;
+    std::list<std::pair<std::wstring, std::shared_ptr<const clip>>> clips_;
+    std::size_t                                                      size_ = 0;
+
+  public:
+    std::shared_ptr<const clip> find(const std::wstring& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = std::find_if(clips_.begin(), clips_.end(), [&](const auto& entry) { return entry.first == key; });
+        if (it == clips_.end()) {
+            return nullptr;
+        }
+        clips_.splice(clips_.begin(), clips_, it);
+        return it->second;
+    }
+
+    void insert(const std::wstring& key, std::shared_ptr<const clip> clip)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (clip->size > capacity_) {
+            CASPAR_LOG(warning) << L"[clip-cache] " << key << L" is larger than the cache, it is not kept.";
+            return;
+        }
+
+        // NOTE: Another channel may have decoded the same clip meanwhile, the older copy is replaced.
+        auto it = std::find_if(clips_.begin(), clips_.end(), [&](const auto& entry) { return entry.first == key; });
+        if (it != clips_.end()) {
+            size_ -= it->second->size;
+            clips_.erase(it);
+        }
+
+        clips_.emplace_front(key, clip);
+        size_ += clip->size;
+
+        while (size_ > capacity_) {
+            CASPAR_LOG(debug) << L"[clip-cache] Evicted " << clips_.back().first;
+            size_ -= clips_.back().second->size;
+            clips_.pop_back();
+        }
+    }
+};
+
+clip_cache& get_cache()
+{
+    static clip_cache cache;
+    return cache;
+}
+
+std::shared_ptr<const clip> decode(frame_producer& producer, const video_format_desc& format_desc, std::size_t count)
+{
+    auto result = std::make_shared<clip>();
+
+    // NOTE: Producers which stop delivering frames for two seconds are cut where they stopped.
+    auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (result->frames.size() < count && std::chrono::steady_clock::now() < timeout) {
+        const auto& cadence = format_desc.audio_cadence;
+        auto        frame   = producer.receive(cadence[result->frames.size() % cadence.size()]);
+        if (frame) {
+            size_visitor size;
+            frame.accept(size);
+            result->size += size.size;
+            result->frames.push_back(std::move(frame));
+            timeout = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    return result;
+}
+
+} // namespace
+
+class cached_producer : public frame_producer
+{
+    const std::wstring                name_;
+    const std::shared_ptr<const clip> clip_;
+
+    mutable std::mutex   mutex_;
+    std::size_t          index_ = 0;
+    std::size_t          last_  = 0;
+    bool                 loop_;
+    core::monitor::state state_;
+
+  public:
+    cached_producer(std::wstring name, std::shared_ptr<const clip> clip, bool loop, std::size_t seek)
+        : name_(std::move(name))
+        , clip_(std::move(clip))
+        , loop_(loop)
+    {
+        this->seek(seek);
+
+        CASPAR_LOG(debug) << print() << L" Initialized";
+    }
+
+    draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto& frames = clip_->frames;
+        if (index_ >= frames.size()) {
+            if (!loop_) {
+                return draw_frame{};
+            }
+            index_ = 0;
+        }
+
+        last_ = index_++;
+
+        state_["file/name"] = u8(name_);
+        state_["file/time"] = {static_cast<std::int64_t>(last_), static_cast<std::int64_t>(frames.size())};
+        state_["loop"]      = loop_;
+
+        return frames[last_];
+    }
+
+    draw_frame last_frame() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return draw_frame::still(clip_->frames[last_]);
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto& cmd   = params.at(0);
+        const auto  value = params.size() > 1 ? params.at(1) : L"";
+
+        std::wstring result;
+        if (boost::iequals(cmd, L"loop")) {
+            if (!value.empty()) {
+                loop_ = boost::lexical_cast<bool>(value);
+            }
+            result = boost::lexical_cast<std::wstring>(loop_);
+        } else if (boost::iequals(cmd, L"seek") && !value.empty()) {
+            seek(boost::lexical_cast<std::size_t>(value));
+            result = boost::lexical_cast<std::wstring>(index_);
+        } else {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info(L"Unknown cached producer command " + cmd));
+        }
+
+        return make_ready_future(std::move(result));
+    }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+
+    uint32_t frame_number() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<uint32_t>(index_);
+    }
+
+    uint32_t nb_frames() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return loop_ ? std::numeric_limits<uint32_t>::max() : static_cast<uint32_t>(clip_->frames.size());
+    }
+
+    std::wstring print() const override { return L"cached[" + name_ + L"]"; }
+
+    std::wstring name() const override { return L"cached"; }
+
+  private:
+    void seek(std::size_t frame)
+    {
+        index_ = std::min(frame, clip_->frames.size() - 1);
+        last_  = index_;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_cached_producer(const core::frame_producer_dependencies& dependencies,
+                                                             const std::vector<std::wstring>&         params)
+{
+    static const std::wstring prefix = L"cached://";
+
+    if (params.empty() || !boost::istarts_with(params.at(0), prefix)) {
+        return core::frame_producer::empty();
+    }
+
+    auto name = params.at(0).substr(prefix.size());
+    if (name.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Missing clip of cached producer."));
+    }
+
+    // LOOP and SEEK are applied when playing from memory, the remaining params select what is decoded.
+    auto loop = false;
+    auto seek = std::size_t(0);
+
+    std::vector<std::wstring> producer_params{name};
+    for (std::size_t n = 1; n < params.size(); ++n) {
+        if (boost::iequals(params[n], L"LOOP")) {
+            loop = true;
+        } else if (boost::iequals(params[n], L"SEEK") && n + 1 < params.size()) {
+            seek = boost::lexical_cast<std::size_t>(params[++n]);
+        } else {
+            producer_params.push_back(params[n]);
+        }
+    }
+
+    auto key = dependencies.format_desc.name;
+    for (auto& param : producer_params) {
+        key += L" " + boost::to_lower_copy(param);
+    }
+
+    auto& cache = get_cache();
+
+    auto clip = cache.find(key);
+    if (!clip) {
+        auto producer = dependencies.producer_registry->create_producer(dependencies, producer_params);
+        if (producer == core::frame_producer::empty()) {
+            return producer;
+        }
+
+        static const auto max_length = env::properties().get(L"configuration.clip-cache.max-length", 30.0);
+
+        const auto max_frames = static_cast<std::uint32_t>(max_length * dependencies.format_desc.fps);
+        if (producer->nb_frames() > max_frames) {
+            CASPAR_LOG(info) << L"[clip-cache] " << name << L" is longer than " << max_length
+                             << L" seconds, playing it uncached.";
+            return producer;
+        }
+
+        clip = decode(*producer, dependencies.format_desc, producer->nb_frames());
+        if (clip->frames.empty()) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not decode " + name));
+        }
+
+        CASPAR_LOG(info) << L"[clip-cache] Decoded " << clip->frames.size() << L" frames of " << name << L" ("
+                         << clip->size / (1024 * 1024) << L" MB).";
+
+        cache.insert(key, clip);
+    }
+
+    return spl::make_shared<cached_producer>(name, std::move(clip), loop, seek);
+}
+
+}} // namespace caspar::core
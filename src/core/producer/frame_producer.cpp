@@ -27,8 +27,13 @@
 #include "../frame/draw_frame.h"
 #include "../frame/frame_transform.h"
 
+#include "cached/cached_producer.h"
 #include "color/color_producer.h"
+#include "multiview/multiview_producer.h"
+#include "playlist/playlist_producer.h"
 #include "route/route_producer.h"
+#include "shared/shared_producer.h"
+#include "text/text_producer.h"
 #include "separated/separated_producer.h"
 
 #include <common/assert.h>
@@ -166,6 +171,10 @@ class destroy_producer_proxy : public frame_producer
     }
 
     draw_frame                receive_impl(int nb_samples) override { return producer_->receive_impl(nb_samples); }
+    std::future<draw_frame>   receive_async_impl(int nb_samples) override
+    {
+        return producer_->receive_async_impl(nb_samples);
+    }
     std::wstring              print() const override { return producer_->print(); }
     std::wstring              name() const override { return producer_->name(); }
     std::future<std::wstring> call(const std::vector<std::wstring>& params) override { return producer_->call(params); }
@@ -173,6 +182,7 @@ class destroy_producer_proxy : public frame_producer
     {
         return producer_->leading_producer(producer);
     }
+    void                  visible(bool visible) override { producer_->visible(visible); }
     uint32_t              frame_number() const override { return producer_->frame_number(); }
     uint32_t              nb_frames() const override { return producer_->nb_frames(); }
     draw_frame            last_frame() { return producer_->last_frame(); }
@@ -211,6 +221,46 @@ spl::shared_ptr<core::frame_producer> do_create_producer(const frame_producer_de
         return producer;
     }
 
+    if (producer == frame_producer::empty()) {
+        producer = create_shared_producer(dependencies, params);
+    }
+
+    if (producer != frame_producer::empty()) {
+        return producer;
+    }
+
+    if (producer == frame_producer::empty()) {
+        producer = create_cached_producer(dependencies, params);
+    }
+
+    if (producer != frame_producer::empty()) {
+        return producer;
+    }
+
+    if (producer == frame_producer::empty()) {
+        producer = create_playlist_producer(dependencies, params);
+    }
+
+    if (producer != frame_producer::empty()) {
+        return producer;
+    }
+
+    if (producer == frame_producer::empty()) {
+        producer = create_multiview_producer(dependencies, params);
+    }
+
+    if (producer != frame_producer::empty()) {
+        return producer;
+    }
+
+    if (producer == frame_producer::empty()) {
+        producer = create_text_producer(dependencies, params);
+    }
+
+    if (producer != frame_producer::empty()) {
+        return producer;
+    }
+
     std::any_of(factories.begin(), factories.end(), [&](const producer_factory_t& factory) -> bool {
         try {
             producer = factory(dependencies, params);
@@ -239,7 +289,9 @@ frame_producer_registry::create_producer(const frame_producer_dependencies& depe
     if (!params.empty() && !boost::contains(params.at(0), L"://")) {
         try // to find a key file.
         {
+            // NOTE: KEY tells producers that only the luma of the key is used, so that they can decode it alone.
             auto params_copy = params;
+            params_copy.push_back(L"KEY");
             if (params_copy.size() > 0) {
                 params_copy[0] += L"_A";
                 key_producer = do_create_producer(dependencies, params_copy, producer_factories);
@@ -55,10 +55,14 @@ class frame_producer
     frame_producer() {}
     virtual ~frame_producer() {}
 
-    draw_frame receive(int nb_samples)
-    {
-        auto frame = receive_impl(nb_samples);
+    draw_frame receive(int nb_samples) { return received(receive_impl(nb_samples)); }
+
+    // Starts receiving the next frame without waiting for it. Once the future is ready its frame is passed to
+    // received, which counts it like receive does.
+    std::future<draw_frame> receive_async(int nb_samples) { return receive_async_impl(nb_samples); }
 
+    draw_frame received(draw_frame frame)
+    {
         if (frame) {
             frame_number_ += 1;
             frame_ = frame;
@@ -67,7 +71,16 @@ class frame_producer
         return frame;
     }
 
-    virtual draw_frame                receive_impl(int nb_samples) = 0;
+    virtual draw_frame receive_impl(int nb_samples) = 0;
+
+    // Producers whose frames are made on threads of their own return a future which those threads complete, so that
+    // nobody has to wait for them. Otherwise receive_impl is deferred until the future is waited for, and runs on the
+    // thread which waits.
+    virtual std::future<draw_frame> receive_async_impl(int nb_samples)
+    {
+        return std::async(std::launch::deferred, [this, nb_samples] { return receive_impl(nb_samples); });
+    }
+
     virtual std::future<std::wstring> call(const std::vector<std::wstring>& params)
     {
         CASPAR_THROW_EXCEPTION(not_implemented());
@@ -90,6 +103,9 @@ class frame_producer
         return frame_;
     }
     virtual void                            leading_producer(const spl::shared_ptr<frame_producer>&) {}
+    // Tells the producer whether the image of its layer is seen, before each receive. Producers of hidden layers may
+    // skip producing images while keeping time and audio, as long as they resume with a current image immediately.
+    virtual void visible(bool) {}
     virtual spl::shared_ptr<frame_producer> following_producer() const { return core::frame_producer::empty(); }
 };
 
@@ -29,6 +29,8 @@
 #include "../frame/frame_transform.h"
 #include "../video_format.h"
 
+#include <common/diagnostics/trace.h>
+#include <common/future.h>
 #include <common/timer.h>
 
 #include <boost/lexical_cast.hpp>
@@ -85,42 +87,92 @@ struct layer::impl
         auto_play_delta_.reset();
     }
 
-    draw_frame receive(const video_format_desc& format_desc, int nb_samples)
+    bool unload(const std::shared_ptr<frame_producer>& producer)
     {
-        try {
-            if (foreground_->following_producer() != core::frame_producer::empty()) {
-                foreground_ = foreground_->following_producer();
-            }
+        if (background_.get() != producer.get()) {
+            return false;
+        }
+        background_ = frame_producer::empty();
+        auto_play_delta_.reset();
+        return true;
+    }
 
-            if (auto_play_delta_) {
-                auto time        = static_cast<std::int64_t>(foreground_->frame_number());
-                auto duration    = static_cast<std::int64_t>(foreground_->nb_frames());
-                auto frames_left = duration - time - static_cast<std::int64_t>(*auto_play_delta_);
-                if (frames_left < 1) {
-                    play();
-                }
-            }
+    draw_frame receive(const video_format_desc& format_desc, int nb_samples, bool visible)
+    {
+        caspar::diagnostics::trace::scope traced("layer::receive");
 
-            auto frame = paused_ ? core::draw_frame{} : foreground_->receive(nb_samples);
-            if (!frame) {
-                frame = foreground_->last_frame();
-            }
+        try {
+            prepare(visible);
+            return finish(paused_ ? core::draw_frame{} : foreground_->receive(nb_samples));
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            stop();
+            return draw_frame{};
+        }
+    }
 
-            state_ = {};
-            state_["foreground"] = foreground_->state();
-            state_["foreground"]["producer"] = foreground_->name();
-            state_["foreground"]["paused"] = paused_;
+    // receive in two halves, the producer makes its frame between them, see frame_producer::receive_async.
+    std::future<draw_frame> begin_receive(int nb_samples, bool visible)
+    {
+        try {
+            prepare(visible);
+            if (!paused_) {
+                return foreground_->receive_async(nb_samples);
+            }
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            stop();
+        }
+        return make_ready_future(draw_frame{});
+    }
 
-            state_["background"] = background_->state();
-            state_["background"]["producer"] = background_->name();
+    draw_frame end_receive(const std::shared_future<draw_frame>& pending)
+    {
+        caspar::diagnostics::trace::scope traced("layer::receive");
 
-            return frame;
+        try {
+            return finish(foreground_->received(pending.get()));
         } catch (...) {
             CASPAR_LOG_CURRENT_EXCEPTION();
             stop();
             return draw_frame{};
         }
     }
+
+    void prepare(bool visible)
+    {
+        if (foreground_->following_producer() != core::frame_producer::empty()) {
+            foreground_ = foreground_->following_producer();
+        }
+
+        if (auto_play_delta_) {
+            auto time        = static_cast<std::int64_t>(foreground_->frame_number());
+            auto duration    = static_cast<std::int64_t>(foreground_->nb_frames());
+            auto frames_left = duration - time - static_cast<std::int64_t>(*auto_play_delta_);
+            if (frames_left < 1) {
+                play();
+            }
+        }
+
+        foreground_->visible(visible);
+    }
+
+    draw_frame finish(draw_frame frame)
+    {
+        if (!frame) {
+            frame = foreground_->last_frame();
+        }
+
+        state_ = {};
+        state_["foreground"] = foreground_->state();
+        state_["foreground"]["producer"] = foreground_->name();
+        state_["foreground"]["paused"] = paused_;
+
+        state_["background"] = background_->state();
+        state_["background"]["producer"] = background_->name();
+
+        return frame;
+    }
 };
 
 layer::layer()
@@ -147,9 +199,23 @@ void       layer::play() { impl_->play(); }
 void       layer::pause() { impl_->pause(); }
 void       layer::resume() { impl_->resume(); }
 void       layer::stop() { impl_->stop(); }
-draw_frame layer::receive(const video_format_desc& format_desc, int nb_samples)
+bool       layer::unload(const std::shared_ptr<frame_producer>& producer) { return impl_->unload(producer); }
+draw_frame layer::receive(const video_format_desc& format_desc, int nb_samples, bool visible)
+{
+    return impl_->receive(format_desc, nb_samples, visible);
+}
+std::function<draw_frame()>
+layer::receiver(const video_format_desc& format_desc, int nb_samples, bool visible) const
+{
+    return [impl = impl_, format_desc, nb_samples, visible] { return impl->receive(format_desc, nb_samples, visible); };
+}
+std::function<draw_frame()> layer::begin_receive(const video_format_desc&        format_desc,
+                                                 int                             nb_samples,
+                                                 bool                            visible,
+                                                 std::shared_future<draw_frame>& pending) const
 {
-    return impl_->receive(format_desc, nb_samples);
+    pending = impl_->begin_receive(nb_samples, visible).share();
+    return [impl = impl_, pending] { return impl->end_receive(pending); };
 }
 spl::shared_ptr<frame_producer> layer::foreground() const { return impl_->foreground_; }
 spl::shared_ptr<frame_producer> layer::background() const { return impl_->background_; }
@@ -31,6 +31,8 @@
 
 #include <boost/optional.hpp>
 
+#include <functional>
+#include <future>
 #include <string>
 
 namespace caspar { namespace core {
@@ -56,7 +58,23 @@ class layer final
     void resume();
     void stop();
 
-    draw_frame receive(const video_format_desc& format_desc, int nb_samples);
+    // Drops the background producer if it is producer. Returns whether it was.
+    bool unload(const std::shared_ptr<frame_producer>& producer);
+
+    // See frame_producer::visible.
+    draw_frame receive(const video_format_desc& format_desc, int nb_samples, bool visible = true);
+
+    // A call of receive for another thread, which keeps the state of the layer alive until it has returned, even if
+    // the layer is destroyed meanwhile.
+    std::function<draw_frame()> receiver(const video_format_desc& format_desc, int nb_samples, bool visible) const;
+
+    // Starts a receive on this thread without waiting for the producer, see frame_producer::receive_async. Once
+    // pending is ready, the returned call finishes the receive like receiver does. pending is deferred when the
+    // producer makes its frame on the thread which waits for it, the call then makes it.
+    std::function<draw_frame()> begin_receive(const video_format_desc&        format_desc,
+                                              int                             nb_samples,
+                                              bool                            visible,
+                                              std::shared_future<draw_frame>& pending) const;
 
     core::monitor::state state() const;
 
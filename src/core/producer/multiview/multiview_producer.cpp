@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "multiview_producer.h"
+
+#include <common/except.h>
+#include <common/future.h>
+#include <common/param.h>
+#include <common/utf.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/consumer/output.h>
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/color/color_producer.h>
+#include <core/video_channel.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/range/algorithm/find_if.hpp>
+#include <boost/regex.hpp>
+#include <boost/signals2.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+
+namespace caspar { namespace core {
+
+namespace {
+
+const double   TILE_MARGIN  = 0.02;
+const double   METER_WIDTH  = 0.015;
+const uint32_t TALLY_COLOR  = 0xFFFF0000;
+const uint32_t METER_COLOR  = 0xFF00FF00;
+const int      INDEX_OFFSET = 100000;
+
+const monitor::vector_t* find(const monitor::state& state, const std::string& key)
+{
+    auto it = std::lower_bound(
+        state.begin(), state.end(), key, [](const auto& p, const std::string& k) { return p.first < k; });
+    return it != state.end() && it->first == key ? &it->second : nullptr;
+}
+
+draw_frame place(draw_frame frame, double x, double y, double width, double height)
+{
+    frame_transform transform;
+    transform.image_transform.fill_translation = {x, y};
+    transform.image_transform.fill_scale       = {width, height};
+    transform.audio_transform.volume           = 0.0;
+    return draw_frame::push(std::move(frame), transform);
+}
+
+// Receives the mixed output of a channel, the frames are read back by the mixer anyway and are drawn from their
+// textures when the channels share a device.
+class multiview_consumer : public frame_consumer
+{
+    const int                        index_;
+    std::function<void(const_frame)> on_frame_;
+
+  public:
+    multiview_consumer(int index, std::function<void(const_frame)> on_frame)
+        : index_(index)
+        , on_frame_(std::move(on_frame))
+    {
+    }
+
+    std::future<bool> send(const_frame frame) override
+    {
+        on_frame_(std::move(frame));
+        return make_ready_future(true);
+    }
+
+    void initialize(const video_format_desc& format_desc, int channel_index) override {}
+
+    std::wstring print() const override { return L"multiview[" + boost::lexical_cast<std::wstring>(index_) + L"]"; }
+
+    std::wstring name() const override { return L"multiview"; }
+
+    int index() const override { return index_; }
+};
+
+struct tile
+{
+    int                          channel = 0;
+    int                          layer   = -1;
+    int                          rate    = 1;
+    std::weak_ptr<video_channel> source;
+
+    spl::shared_ptr<frame_consumer>    consumer = frame_consumer::empty();
+    std::shared_ptr<core::route>       layer_route;
+    boost::signals2::scoped_connection connection;
+
+    std::mutex mutex;
+    draw_frame received;
+    draw_frame shown;
+
+    ~tile()
+    {
+        auto channel = source.lock();
+        if (channel && consumer != frame_consumer::empty()) {
+            channel->output().remove(consumer);
+        }
+    }
+
+    std::wstring name() const
+    {
+        auto name = boost::lexical_cast<std::wstring>(channel);
+        if (layer >= 0) {
+            name += L"-" + boost::lexical_cast<std::wstring>(layer);
+        }
+        if (rate > 1) {
+            name += L"@" + boost::lexical_cast<std::wstring>(rate);
+        }
+        return name;
+    }
+};
+
+bool is_playing(const monitor::state& state, int layer)
+{
+    auto prefix   = "stage/layer/" + boost::lexical_cast<std::string>(layer) + "/foreground/";
+    auto producer = find(state, prefix + "producer");
+    auto paused   = find(state, prefix + "paused");
+
+    auto name  = producer && !producer->empty() ? boost::get<std::wstring>(&producer->front()) : nullptr;
+    auto pause = paused && !paused->empty() ? boost::get<bool>(&paused->front()) : nullptr;
+    return name && *name != L"empty" && !(pause && *pause);
+}
+
+} // namespace
+
+class multiview_producer : public frame_producer
+{
+    std::vector<std::unique_ptr<tile>> tiles_;
+    const int                          columns_;
+    const int                          rows_;
+
+    draw_frame tally_frame_;
+    draw_frame meter_frame_;
+
+    std::uint64_t  tick_ = 0;
+    monitor::state state_;
+
+  public:
+    multiview_producer(const frame_producer_dependencies& dependencies,
+                       std::vector<std::unique_ptr<tile>> tiles,
+                       int                                columns)
+        : tiles_(std::move(tiles))
+        , columns_(std::max(1, columns))
+        , rows_(std::max(1, (static_cast<int>(tiles_.size()) + columns_ - 1) / columns_))
+        , tally_frame_(create_color_frame(this, dependencies.frame_factory, TALLY_COLOR))
+        , meter_frame_(create_color_frame(this, dependencies.frame_factory, METER_COLOR))
+    {
+        static std::atomic<int> next_index{0};
+
+        for (std::size_t n = 0; n < tiles_.size(); ++n) {
+            auto& t       = tiles_[n];
+            auto  channel = t->source.lock();
+            auto* target  = t.get();
+
+            if (t->layer < 0) {
+                t->consumer = spl::make_shared<multiview_consumer>(
+                    INDEX_OFFSET + next_index++, [target](const_frame frame) {
+                        std::lock_guard<std::mutex> lock(target->mutex);
+                        target->received = draw_frame(std::move(frame));
+                    });
+
+                // NOTE: The tile only keeps the latest frame, the source channel must never wait for the multiview.
+                port_settings settings;
+                settings.overflow = overflow_policy::drop_oldest;
+                channel->output().add(t->consumer, settings);
+            } else {
+                t->layer_route = channel->route(t->layer);
+                t->connection  = t->layer_route->signal.connect([target](const draw_frame& frame) {
+                    std::lock_guard<std::mutex> lock(target->mutex);
+                    target->received = frame;
+                });
+            }
+
+            state_["tile"][n]["source"] = u8(t->name());
+        }
+        state_["tiles"] = static_cast<int>(tiles_.size());
+    }
+
+    draw_frame receive_impl(int nb_samples) override
+    {
+        const auto width  = 1.0 / columns_;
+        const auto height = 1.0 / rows_;
+
+        std::map<int, monitor::state> states;
+        std::vector<draw_frame>       frames;
+
+        for (std::size_t n = 0; n < tiles_.size(); ++n) {
+            auto& t = *tiles_[n];
+
+            if (tick_ % t.rate == 0) {
+                std::lock_guard<std::mutex> lock(t.mutex);
+                t.shown = t.received;
+            }
+
+            const auto x = static_cast<double>(n % columns_) * width;
+            const auto y = static_cast<double>(n / columns_) * height;
+
+            auto channel = t.source.lock();
+            if (channel && states.find(t.channel) == states.end()) {
+                states[t.channel] = channel->state();
+            }
+            const auto& state = states[t.channel];
+
+            if (t.layer >= 0 && is_playing(state, t.layer)) {
+                frames.push_back(place(tally_frame_, x, y, width, height));
+            }
+
+            if (t.shown) {
+                frames.push_back(place(t.shown,
+                                       x + width * TILE_MARGIN,
+                                       y + height * TILE_MARGIN,
+                                       width * (1.0 - 2.0 * TILE_MARGIN),
+                                       height * (1.0 - 2.0 * TILE_MARGIN)));
+            }
+
+            if (auto volume = find(state, "mixer/audio/volume")) {
+                for (std::size_t c = 0; c < volume->size(); ++c) {
+                    auto peak  = boost::get<std::int32_t>(&(*volume)[c]);
+                    auto level = peak ? std::min(1.0,
+                                                 static_cast<double>(*peak) / std::numeric_limits<std::int32_t>::max())
+                                      : 0.0;
+                    if (level <= 0.0) {
+                        continue;
+                    }
+                    auto meter_height = height * (1.0 - 2.0 * TILE_MARGIN) * level;
+                    frames.push_back(place(meter_frame_,
+                                           x + width * (TILE_MARGIN + METER_WIDTH * c),
+                                           y + height * (1.0 - TILE_MARGIN) - meter_height,
+                                           width * METER_WIDTH * 0.8,
+                                           meter_height));
+                }
+            }
+        }
+
+        ++tick_;
+
+        return draw_frame(std::move(frames));
+    }
+
+    monitor::state state() const override { return state_; }
+
+    std::wstring print() const override
+    {
+        std::wstring sources;
+        for (auto& t : tiles_) {
+            sources += (sources.empty() ? L"" : L" ") + t->name();
+        }
+        return L"multiview[" + sources + L"]";
+    }
+
+    std::wstring name() const override { return L"multiview"; }
+};
+
+spl::shared_ptr<core::frame_producer> create_multiview_producer(const core::frame_producer_dependencies& dependencies,
+                                                                const std::vector<std::wstring>&         params)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"MULTIVIEW")) {
+        return core::frame_producer::empty();
+    }
+
+    static boost::wregex expr(L"(?<CHANNEL>\\d+)(-(?<LAYER>\\d+))?(@(?<RATE>\\d+))?");
+
+    std::vector<std::unique_ptr<tile>> tiles;
+    for (std::size_t n = 1; n < params.size(); ++n) {
+        boost::wsmatch what;
+        if (boost::iequals(params.at(n), L"GRID")) {
+            ++n;
+            continue;
+        }
+        if (!boost::regex_match(params.at(n), what, expr)) {
+            continue;
+        }
+
+        auto t     = std::make_unique<tile>();
+        t->channel = boost::lexical_cast<int>(what["CHANNEL"].str());
+        t->layer   = what["LAYER"].matched ? boost::lexical_cast<int>(what["LAYER"].str()) : -1;
+        t->rate    = what["RATE"].matched ? std::max(1, boost::lexical_cast<int>(what["RATE"].str())) : 1;
+
+        auto channel_it = boost::find_if(dependencies.channels, [&](spl::shared_ptr<core::video_channel> ch) {
+            return ch->index() == t->channel;
+        });
+
+        if (channel_it == dependencies.channels.end()) {
+            CASPAR_THROW_EXCEPTION(user_error()
+                                   << msg_info(L"No channel with id " + boost::lexical_cast<std::wstring>(t->channel)));
+        }
+
+        // NOTE: A weak reference, so that a multiview of its own channel does not keep the channel alive.
+        t->source = *channel_it;
+        tiles.push_back(std::move(t));
+    }
+
+    if (tiles.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"MULTIVIEW requires at least one channel or layer."));
+    }
+
+    auto columns = get_param(L"GRID", params, 0);
+    if (columns <= 0) {
+        columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(tiles.size()))));
+    }
+
+    return spl::make_shared<multiview_producer>(dependencies, std::move(tiles), columns);
+}
+
+}} // namespace caspar::core
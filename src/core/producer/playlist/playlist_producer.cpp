@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "playlist_producer.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace caspar { namespace core {
+
+namespace {
+
+// An item which has been opened, and the frames which were decoded ahead before it started playing.
+struct item
+{
+    std::wstring                    params;
+    spl::shared_ptr<frame_producer> producer = frame_producer::empty();
+    std::deque<draw_frame>          frames;
+
+    std::int64_t frames_left() const
+    {
+        return static_cast<std::int64_t>(producer->nb_frames()) - static_cast<std::int64_t>(producer->frame_number()) +
+               static_cast<std::int64_t>(frames.size());
+    }
+};
+
+std::shared_ptr<item>
+open(const frame_producer_dependencies& dependencies, const std::wstring& params, std::size_t preroll)
+{
+    auto result      = std::make_shared<item>();
+    result->params   = params;
+    result->producer = dependencies.producer_registry->create_producer(dependencies, params);
+
+    // NOTE: Producers which deliver no frame for two seconds start with the frames they have delivered.
+    const auto& cadence = dependencies.format_desc.audio_cadence;
+    auto        timeout = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (result->frames.size() < preroll && result->frames_left() > 0 &&
+           std::chrono::steady_clock::now() < timeout) {
+        auto frame = result->producer->receive(cadence[result->frames.size() % cadence.size()]);
+        if (frame) {
+            result->frames.push_back(std::move(frame));
+            timeout = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    return result;
+}
+
+} // namespace
+
+class playlist_producer : public frame_producer
+{
+    const frame_producer_dependencies dependencies_;
+    const std::int64_t                window_;
+    const std::size_t                 preroll_;
+
+    mutable std::mutex                 mutex_;
+    std::deque<std::wstring>           queue_;
+    bool                               loop_;
+    bool                               skip_ = false;
+    std::shared_ptr<item>              current_;
+    std::future<std::shared_ptr<item>> next_;
+    draw_frame                         last_frame_;
+    core::monitor::state               state_;
+
+    // NOTE: Items are opened one at a time, the executor is declared last so that it is joined first.
+    executor executor_{L"playlist_producer"};
+
+  public:
+    playlist_producer(const frame_producer_dependencies& dependencies,
+                      std::deque<std::wstring>           items,
+                      double                             window,
+                      std::size_t                        preroll,
+                      bool                               loop)
+        : dependencies_(dependencies)
+        , window_(static_cast<std::int64_t>(window * dependencies.format_desc.fps + 0.5))
+        , preroll_(std::max<std::size_t>(1, preroll))
+        , queue_(std::move(items))
+        , loop_(loop)
+    {
+        // NOTE: The first item is opened at once, so that the command fails if it can not be.
+        current_ = open(dependencies_, pop(), preroll_);
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (skip_ || current_->frames_left() <= 0) {
+            splice();
+        }
+
+        if (!next_.valid() && !queue_.empty() && current_->frames_left() <= window_) {
+            open_next();
+        }
+
+        auto frame = draw_frame{};
+        if (!current_->frames.empty()) {
+            frame = std::move(current_->frames.front());
+            current_->frames.pop_front();
+        } else if (current_->frames_left() > 0) {
+            frame = current_->producer->receive(nb_samples);
+        }
+
+        if (frame) {
+            last_frame_ = frame;
+        }
+
+        state_                       = current_->producer->state();
+        state_["playlist/item"]      = u8(current_->params);
+        state_["playlist/remaining"] = static_cast<std::int64_t>(queue_.size() + (next_.valid() ? 1 : 0));
+        state_["playlist/loop"]      = loop_;
+
+        return frame;
+    }
+
+    draw_frame last_frame() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return draw_frame::still(last_frame_);
+    }
+
+    void visible(bool visible) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        current_->producer->visible(visible);
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto& cmd = params.at(0);
+
+        std::wstring result;
+        if (boost::iequals(cmd, L"add") && params.size() > 1) {
+            queue_.push_back(boost::join(std::vector<std::wstring>(params.begin() + 1, params.end()), L" "));
+            result = boost::lexical_cast<std::wstring>(queue_.size());
+        } else if (boost::iequals(cmd, L"clear")) {
+            queue_.clear();
+            next_ = {};
+        } else if (boost::iequals(cmd, L"next")) {
+            skip_ = true;
+        } else if (boost::iequals(cmd, L"loop")) {
+            if (params.size() > 1) {
+                loop_ = boost::lexical_cast<bool>(params.at(1));
+            }
+            result = boost::lexical_cast<std::wstring>(loop_);
+        } else {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info(L"Unknown playlist producer command " + cmd));
+        }
+
+        return make_ready_future(std::move(result));
+    }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+
+    std::wstring print() const override { return L"playlist[" + current_->params + L"]"; }
+
+    std::wstring name() const override { return L"playlist"; }
+
+  private:
+    std::wstring pop()
+    {
+        auto params = std::move(queue_.front());
+        queue_.pop_front();
+        if (loop_) {
+            queue_.push_back(params);
+        }
+        return params;
+    }
+
+    void open_next()
+    {
+        next_ = executor_.begin_invoke([dependencies = dependencies_, params = pop(), preroll = preroll_] {
+            return open(dependencies, params, preroll);
+        });
+    }
+
+    // Replaces the current item with the next one, opening it now if it has not been. The current item keeps playing
+    // while the next one is being opened, which only happens if it ended within the window of opening it.
+    void splice()
+    {
+        if (!next_.valid()) {
+            if (queue_.empty()) {
+                skip_ = false;
+                return;
+            }
+            open_next();
+        }
+
+        if (next_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            CASPAR_LOG(warning) << print() << L" The next item is not ready yet.";
+            return;
+        }
+
+        skip_ = false;
+        try {
+            current_ = next_.get();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+        next_ = {};
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_playlist_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"PLAYLIST")) {
+        return core::frame_producer::empty();
+    }
+
+    static const auto default_window  = env::properties().get(L"configuration.playlist.window", 2.0);
+    static const auto default_preroll = env::properties().get(L"configuration.playlist.preroll", 4);
+
+    auto loop   = false;
+    auto window = default_window;
+
+    std::deque<std::wstring> items;
+    for (std::size_t n = 1; n < params.size(); ++n) {
+        if (boost::iequals(params[n], L"LOOP")) {
+            loop = true;
+        } else if (boost::iequals(params[n], L"WINDOW") && n + 1 < params.size()) {
+            window = boost::lexical_cast<double>(params[++n]);
+        } else {
+            items.push_back(params[n]);
+        }
+    }
+
+    if (items.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"A playlist needs at least one item."));
+    }
+
+    return spl::make_shared<playlist_producer>(
+        dependencies, std::move(items), window, static_cast<std::size_t>(std::max(1, default_preroll)), loop);
+}
+
+}} // namespace caspar::core
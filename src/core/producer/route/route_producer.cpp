@@ -26,18 +26,69 @@
 #include <common/timer.h>
 
 #include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/frame_visitor.h>
+#include <core/frame/pixel_format.h>
 #include <core/monitor/monitor.h>
 #include <core/producer/frame_producer.h>
 #include <core/video_channel.h>
 
+#include <boost/optional.hpp>
 #include <boost/range/algorithm/find_if.hpp>
 #include <boost/regex.hpp>
 #include <boost/signals2.hpp>
 
 #include <tbb/concurrent_queue.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <vector>
+
 namespace caspar { namespace core {
 
+// Appends the audio of a routed frame, mixed with the volumes of its transforms, to interleaved samples.
+class audio_collector : public frame_visitor
+{
+    std::vector<double> volumes_{1.0};
+    std::vector<float>  bus_;
+
+  public:
+    void push(const frame_transform& transform) override
+    {
+        volumes_.push_back(volumes_.back() * transform.audio_transform.volume);
+    }
+
+    void visit(const const_frame& frame) override
+    {
+        const auto& samples = frame.audio_data();
+        const auto  volume  = static_cast<float>(volumes_.back());
+        if (!samples || volume < 0.002f) {
+            return;
+        }
+
+        bus_.resize(std::max(bus_.size(), samples.size()), 0.0f);
+        for (std::size_t n = 0; n < samples.size(); ++n) {
+            bus_[n] += static_cast<float>(samples.data()[n]) * volume;
+        }
+    }
+
+    void pop() override { volumes_.pop_back(); }
+
+    void append_to(std::vector<std::int32_t>& samples) const
+    {
+        for (auto value : bus_) {
+            samples.push_back(static_cast<std::int32_t>(std::min(std::max(value, -2147483648.0f), 2147483520.0f)));
+        }
+    }
+};
+
 class route_producer : public frame_producer
 {
     spl::shared_ptr<diagnostics::graph> graph_;
@@ -47,16 +98,58 @@ class route_producer : public frame_producer
     caspar::timer produce_timer_;
     caspar::timer consume_timer_;
 
+    // Synchronous mode hands over exactly one frame per tick, without buffering.
+    const bool              sync_;
+    std::mutex              sync_mutex_;
+    std::condition_variable sync_cond_;
+    core::draw_frame        sync_frame_;
+
+    // The receive waiting for the next tick of the source channel, guarded by sync_mutex_.
+    boost::optional<std::promise<core::draw_frame>> sync_promise_;
+
     std::shared_ptr<route>             route_;
     boost::signals2::scoped_connection connection_;
 
     core::draw_frame frame_;
 
+    // NOTE: Routes between channels of different frame rates are converted. Every tick advances phase_ by rate_
+    // source frames, the image lies between previous_frame_ and frame_ at phase_ and is either the nearest of them
+    // or, with blend, their mix. The audio of every source frame is played once, in chunks of the channel cadence.
+    spl::shared_ptr<core::frame_factory> frame_factory_;
+    const double                         rate_;
+    const bool                           blend_;
+    double                               phase_ = 0.0;
+    core::draw_frame                     previous_frame_;
+    std::vector<std::int32_t>            samples_;
+
   public:
-    route_producer(std::shared_ptr<route> route, int buffer)
-        : route_(route)
+    route_producer(std::shared_ptr<route>               route,
+                   spl::shared_ptr<core::frame_factory> frame_factory,
+                   const video_format_desc&             format_desc,
+                   int                                  buffer,
+                   bool                                 sync,
+                   bool                                 blend)
+        : sync_(sync)
+        , route_(route)
+        , frame_factory_(std::move(frame_factory))
+        , rate_(std::abs(route->format_desc.fps - format_desc.fps) > 0.001 ? route->format_desc.fps / format_desc.fps
+                                                                            : 0.0)
+        , blend_(blend)
         , connection_(route_->signal.connect([this](const core::draw_frame& frame) {
-            if (!buffer_.try_push(frame)) {
+            if (sync_) {
+                {
+                    std::lock_guard<std::mutex> lock(sync_mutex_);
+                    if (sync_promise_) {
+                        hand_over(frame);
+                    } else {
+                        if (sync_frame_) {
+                            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                        }
+                        sync_frame_ = frame;
+                    }
+                }
+                sync_cond_.notify_one();
+            } else if (!buffer_.try_push(frame)) {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
             }
             graph_->set_value("produce-time", produce_timer_.elapsed() * route_->format_desc.fps * 0.5);
@@ -78,15 +171,70 @@ class route_producer : public frame_producer
     draw_frame last_frame() override
     {
         if (!frame_) {
-            buffer_.try_pop(frame_);
+            if (sync_) {
+                std::lock_guard<std::mutex> lock(sync_mutex_);
+                frame_      = std::move(sync_frame_);
+                sync_frame_ = core::draw_frame{};
+            } else {
+                buffer_.try_pop(frame_);
+            }
         }
         return core::draw_frame::still(frame_);
     }
 
+    // Waits up to one frame duration for the source channel to finish its tick.
+    bool sync_pop(core::draw_frame& frame)
+    {
+        auto timeout = std::chrono::microseconds(static_cast<int>(1e6 / route_->format_desc.fps));
+
+        std::unique_lock<std::mutex> lock(sync_mutex_);
+        if (!sync_cond_.wait_for(lock, timeout, [&] { return static_cast<bool>(sync_frame_); })) {
+            return false;
+        }
+        frame       = std::move(sync_frame_);
+        sync_frame_ = core::draw_frame{};
+        return true;
+    }
+
+    // Completes the pending receive with a frame of the source channel, under sync_mutex_.
+    void hand_over(const core::draw_frame& frame)
+    {
+        if (frame) {
+            frame_ = frame;
+        }
+        graph_->set_value("consume-time", consume_timer_.elapsed() * route_->format_desc.fps * 0.5);
+        consume_timer_.restart();
+
+        sync_promise_->set_value(frame);
+        sync_promise_.reset();
+    }
+
+    // NOTE: In synchronous mode the frame is handed over by the tick of the source channel itself, so the stage does
+    // not keep a worker waiting for it. A source which has not ticked by the deadline of the layer makes it late.
+    std::future<draw_frame> receive_async_impl(int nb_samples) override
+    {
+        if (!sync_ || rate_ > 0.0) {
+            return frame_producer::receive_async_impl(nb_samples);
+        }
+
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        sync_promise_.emplace();
+        auto future = sync_promise_->get_future();
+        if (sync_frame_) {
+            hand_over(sync_frame_);
+            sync_frame_ = core::draw_frame{};
+        }
+        return future;
+    }
+
     draw_frame receive_impl(int nb_samples) override
     {
+        if (rate_ > 0.0) {
+            return convert(nb_samples);
+        }
+
         core::draw_frame frame;
-        if (!buffer_.try_pop(frame)) {
+        if (!(sync_ ? sync_pop(frame) : buffer_.try_pop(frame))) {
             graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
         } else {
             frame_ = frame;
@@ -97,7 +245,73 @@ class route_producer : public frame_producer
         return frame;
     }
 
-    std::wstring print() const override { return L"route[" + route_->name + L"]"; }
+    draw_frame convert(int nb_samples)
+    {
+        phase_ += rate_;
+        while (phase_ >= 1.0) {
+            core::draw_frame frame;
+            if (!(sync_ ? sync_pop(frame) : buffer_.try_pop(frame))) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+                phase_ = 1.0;
+                break;
+            }
+            previous_frame_ = std::move(frame_);
+            frame_          = std::move(frame);
+            phase_ -= 1.0;
+
+            audio_collector audio;
+            frame_.accept(audio);
+            audio.append_to(samples_);
+        }
+
+        graph_->set_value("consume-time", consume_timer_.elapsed() * route_->format_desc.fps * 0.5);
+        consume_timer_.restart();
+
+        if (!frame_) {
+            return core::draw_frame{};
+        }
+
+        core::draw_frame image;
+        if (!previous_frame_ || phase_ >= 1.0) {
+            image = frame_;
+        } else if (blend_) {
+            auto next                                = core::draw_frame::push(frame_);
+            next.transform().image_transform.opacity = phase_;
+            image = core::draw_frame({core::draw_frame::push(previous_frame_), std::move(next)});
+        } else {
+            image = phase_ < 0.5 ? previous_frame_ : frame_;
+        }
+
+        // The audio is played from samples_, not from the frames which may be repeated or skipped.
+        auto result                               = core::draw_frame::push(std::move(image));
+        result.transform().audio_transform.volume = 0.0;
+
+        const auto channels = route_->format_desc.audio_channels;
+        const auto count    = std::min(samples_.size(), static_cast<std::size_t>(nb_samples * channels));
+        if (count == 0) {
+            return result;
+        }
+
+        auto audio_frame = frame_factory_->create_frame(this, core::pixel_format_desc(core::pixel_format::invalid));
+        auto samples     = array<std::int32_t>(count);
+        std::copy_n(samples_.begin(), count, samples.begin());
+        audio_frame.audio_data() = std::move(samples);
+        samples_.erase(samples_.begin(), samples_.begin() + count);
+
+        // Samples which are more than a second behind, after the source channel ran faster for a while, are dropped.
+        const auto max_samples = static_cast<std::size_t>(route_->format_desc.audio_sample_rate * channels);
+        if (samples_.size() > max_samples) {
+            samples_.erase(samples_.begin(), samples_.end() - max_samples);
+        }
+
+        return core::draw_frame({std::move(result), core::draw_frame(std::move(audio_frame))});
+    }
+
+    std::wstring print() const override
+    {
+        const auto mode = rate_ > 0.0 ? (blend_ ? L"|blend" : L"|rate") : L"";
+        return L"route[" + route_->name + (sync_ ? L"|sync" : L"") + mode + L"]";
+    }
 
     std::wstring name() const override { return L"route"; }
 };
@@ -124,8 +338,11 @@ spl::shared_ptr<core::frame_producer> create_route_producer(const core::frame_pr
     }
 
     auto buffer = get_param(L"BUFFER", params, 0);
+    auto sync   = contains_param(L"SYNC", params);
+    auto blend  = contains_param(L"BLEND", params);
 
-    return spl::make_shared<route_producer>((*channel_it)->route(layer), buffer);
+    return spl::make_shared<route_producer>(
+        (*channel_it)->route(layer), dependencies.frame_factory, dependencies.format_desc, buffer, sync, blend);
 }
 
 }} // namespace caspar::core
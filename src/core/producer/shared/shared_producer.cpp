@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shared_producer.h"
+
+#include <common/except.h>
+#include <common/log.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/monitor/monitor.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/circular_buffer.hpp>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace caspar { namespace core {
+
+class shared_source
+{
+    const std::wstring                    name_;
+    const spl::shared_ptr<frame_producer> producer_;
+
+    mutable std::mutex                 mutex_;
+    std::int64_t                       produced_ = 0;
+    boost::circular_buffer<draw_frame> frames_;
+
+  public:
+    shared_source(std::wstring name, spl::shared_ptr<frame_producer> producer)
+        : name_(std::move(name))
+        , producer_(std::move(producer))
+        , frames_(4)
+    {
+    }
+
+    // Index of the first frame a new subscriber receives, the latest one if any were produced.
+    std::int64_t join() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::max<std::int64_t>(produced_, 1);
+    }
+
+    // Returns frame number index, producing it if no other subscriber has done so yet. Subscribers which fall
+    // behind by more than the history are moved forward to the latest frame.
+    draw_frame receive(std::int64_t& index, int nb_samples)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        while (produced_ < index) {
+            frames_.push_back(producer_->receive(nb_samples));
+            produced_ += 1;
+        }
+
+        auto offset = produced_ - index;
+        if (offset >= static_cast<std::int64_t>(frames_.size())) {
+            index  = produced_;
+            offset = 0;
+        }
+
+        return frames_[frames_.size() - 1 - static_cast<std::size_t>(offset)];
+    }
+
+    draw_frame last_frame()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return frames_.empty() ? producer_->last_frame() : frames_.back();
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return producer_->call(params);
+    }
+
+    core::monitor::state state() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return producer_->state();
+    }
+
+    uint32_t nb_frames() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return producer_->nb_frames();
+    }
+
+    uint32_t frame_number() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return producer_->frame_number();
+    }
+
+    std::wstring print() const { return name_ + L"|" + producer_->print(); }
+};
+
+class shared_producer : public frame_producer
+{
+    const std::shared_ptr<shared_source> source_;
+    std::int64_t                         index_;
+
+  public:
+    explicit shared_producer(std::shared_ptr<shared_source> source)
+        : source_(std::move(source))
+        , index_(source_->join())
+    {
+        CASPAR_LOG(debug) << print() << L" Initialized";
+    }
+
+    draw_frame receive_impl(int nb_samples) override
+    {
+        auto frame = source_->receive(index_, nb_samples);
+        index_ += 1;
+        return frame;
+    }
+
+    draw_frame last_frame() override { return core::draw_frame::still(source_->last_frame()); }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override { return source_->call(params); }
+
+    core::monitor::state state() const override { return source_->state(); }
+
+    uint32_t nb_frames() const override { return source_->nb_frames(); }
+
+    uint32_t frame_number() const override { return source_->frame_number(); }
+
+    std::wstring print() const override { return L"shared[" + source_->print() + L"]"; }
+
+    std::wstring name() const override { return L"shared"; }
+};
+
+spl::shared_ptr<core::frame_producer> create_shared_producer(const core::frame_producer_dependencies& dependencies,
+                                                             const std::vector<std::wstring>&         params)
+{
+    static const std::wstring prefix = L"shared://";
+
+    if (params.empty() || !boost::istarts_with(params.at(0), prefix)) {
+        return core::frame_producer::empty();
+    }
+
+    auto name = boost::to_lower_copy(params.at(0).substr(prefix.size()));
+    if (name.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Missing name of shared producer."));
+    }
+
+    static std::mutex                                           mutex;
+    static std::map<std::wstring, std::weak_ptr<shared_source>> sources;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto it = sources.begin(); it != sources.end();) {
+        it = it->second.expired() ? sources.erase(it) : std::next(it);
+    }
+
+    auto source = sources[name].lock();
+    if (!source) {
+        if (params.size() < 2) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No shared producer named " + name));
+        }
+
+        auto producer = dependencies.producer_registry->create_producer(
+            dependencies, std::vector<std::wstring>(params.begin() + 1, params.end()));
+
+        if (producer == core::frame_producer::empty()) {
+            return producer;
+        }
+
+        source        = std::make_shared<shared_source>(name, std::move(producer));
+        sources[name] = source;
+    } else if (params.size() > 1) {
+        CASPAR_LOG(warning) << L"shared[" << name << L"] Already exists, ignoring producer parameters.";
+    }
+
+    return spl::make_shared<shared_producer>(std::move(source));
+}
+
+}} // namespace caspar::core
@@ -29,30 +29,171 @@
 #include "../frame/frame_factory.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
+#include <common/env.h>
 #include <common/executor.h>
 #include <common/future.h>
+#include <common/os/thread.h>
 #include <common/timer.h>
 
 #include <core/frame/frame_transform.h>
 
+#include <boost/container/flat_map.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/range/adaptors.hpp>
+#include <boost/property_tree/ptree.hpp>
 #include <boost/range/algorithm.hpp>
 
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <functional>
 #include <future>
 #include <map>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <vector>
 
 namespace caspar { namespace core {
 
+// NOTE: Layers and transforms are kept sorted in contiguous storage, as they are walked in order every tick and
+// only inserted or erased by commands.
+template <typename T>
+using layer_table = boost::container::flat_map<int, T>;
+
+// Whether anything of the image of a layer can be seen, judged by its own transform. Layers are hidden by a zero
+// opacity, scale, crop or clip, or by being moved off screen without rotation or perspective. Keys are always seen.
+bool is_visible(const frame_transform& transform)
+{
+    static const double epsilon = 0.001;
+
+    const auto& image = transform.image_transform;
+    if (image.is_key) {
+        return true;
+    }
+
+    if (image.opacity < epsilon || std::abs(image.fill_scale[0]) < epsilon || std::abs(image.fill_scale[1]) < epsilon ||
+        image.clip_scale[0] < epsilon || image.clip_scale[1] < epsilon ||
+        image.crop.lr[0] - image.crop.ul[0] < epsilon || image.crop.lr[1] - image.crop.ul[1] < epsilon) {
+        return false;
+    }
+
+    const corners identity;
+    const auto&   pers = image.perspective;
+    if (image.angle != 0.0 || pers.ul != identity.ul || pers.ur != identity.ur || pers.lr != identity.lr ||
+        pers.ll != identity.ll) {
+        return true;
+    }
+
+    for (int n = 0; n < 2; ++n) {
+        auto first  = image.fill_translation[n] - image.anchor[n] * image.fill_scale[n];
+        auto second = first + image.fill_scale[n];
+        if (std::max(first, second) <= 0.0 || std::min(first, second) >= 1.0 ||
+            image.clip_translation[n] + image.clip_scale[n] <= 0.0 || image.clip_translation[n] >= 1.0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 struct stage::impl : public std::enable_shared_from_this<impl>
 {
+    struct received
+    {
+        draw_frame frame;
+        double     receive_time = 0.0;
+    };
+
+    // The receive of a layer in a tick. Producers which make their frames on threads of their own are waited for
+    // through pending, without a worker, the others receive on the arena into result.
+    struct layer_job
+    {
+        int                                   index;
+        std::shared_future<draw_frame>        pending;
+        std::function<draw_frame()>           finish;
+        std::shared_future<received>          result;
+        std::chrono::steady_clock::time_point start;
+
+        bool ready() const { return result.valid() ? is_ready(result) : is_ready(pending); }
+
+        bool wait_until(std::chrono::steady_clock::time_point deadline) const
+        {
+            return (result.valid() ? result.wait_until(deadline) : pending.wait_until(deadline)) ==
+                   std::future_status::ready;
+        }
+
+        void wait() const { result.valid() ? result.wait() : pending.wait(); }
+
+        // The time of a producer on a thread of its own is counted until its frame is collected.
+        received get() const
+        {
+            if (result.valid()) {
+                return result.get();
+            }
+            auto frame = finish();
+            auto end   = std::chrono::steady_clock::now();
+            return received{std::move(frame), std::chrono::duration<double, std::milli>(end - start).count()};
+        }
+    };
+
+    // A layer whose receive missed the deadline of a tick. It is taken out of layers_ until its receive has
+    // returned, meanwhile its last frame is repeated and the commands sent to it wait for it.
+    struct late_layer
+    {
+        core::layer                        source;
+        layer_job                          job;
+        std::vector<std::function<void()>> commands;
+    };
+
     int                                 channel_index_;
     spl::shared_ptr<diagnostics::graph> graph_;
     monitor::state                      state_;
-    std::map<int, layer>                layers_;
-    std::map<int, tweened_transform>    tweens_;
+    layer_table<layer>                  layers_;
+    layer_table<tweened_transform>      tweens_;
+    std::atomic<int64_t>                frame_number_{0};
+
+    // Late layers, the last frame received from each layer before its transform, and how many ticks each layer
+    // has been late, only used on the executor thread.
+    std::map<int, late_layer>   late_;
+    layer_table<draw_frame>     last_frames_;
+    std::map<int, std::int64_t> late_counts_;
+
+    // Milliseconds each layer may take to receive its frame, 0 is one frame duration and negative values wait for
+    // as long as layers take.
+    const int layer_deadline_ = env::properties().get(L"configuration.stage.layer-deadline", 0);
+
+    // Layers whose frames are routed elsewhere, which are rendered even while they are hidden on this channel, only
+    // used on the executor thread.
+    std::set<int> routed_;
+
+    // Transforms waiting for the tick they were committed to, and whether they are appended as keyframes, only used
+    // on the executor thread.
+    std::multimap<int64_t, std::pair<bool, std::vector<stage::transform_tuple_t>>> pending_transforms_;
+
+    typedef std::vector<std::function<void()>> batch_t;
+
+    // Commands collected by the batches open on other threads, keyed by the thread which opened them.
+    std::mutex                         batches_mutex_;
+    std::map<std::thread::id, batch_t> batches_;
+
+    // Committed batches waiting for the tick they were committed to, only used on the executor thread.
+    std::multimap<int64_t, batch_t> pending_batches_;
+
+    tbb::task_arena arena_{[] {
+        auto max_concurrency = env::properties().get(L"configuration.stage.max-concurrency", 0);
+        return max_concurrency > 0 ? max_concurrency : static_cast<int>(tbb::task_arena::automatic);
+    }()};
+
+    std::vector<layer_job> jobs_; // Reused by every tick, only used on the executor thread.
+
+    // The longest time in seconds which a command waited for the executor since the last tick, only used on the
+    // executor thread.
+    double control_latency_ = 0.0;
 
     executor executor_{L"stage " + boost::lexical_cast<std::wstring>(channel_index_)};
 
@@ -61,28 +202,157 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         : channel_index_(channel_index)
         , graph_(std::move(graph))
     {
+        graph_->set_color("control-latency", caspar::diagnostics::color(0.5f, 0.5f, 1.0f, 0.8f));
     }
 
-    std::map<int, draw_frame> operator()(const video_format_desc& format_desc, int nb_samples)
+    std::future<stage::frames_t> operator()(const video_format_desc&               format_desc,
+                                            int                                    nb_samples,
+                                            bool                                   render,
+                                            const boost::container::flat_set<int>& shed)
     {
-        return executor_.invoke([=] {
-            std::map<int, draw_frame> frames;
+        auto tick = [=, trace_frame = caspar::diagnostics::trace::current_frame()] {
+            caspar::diagnostics::trace::frame_scope frame_scope(trace_frame);
+            caspar::diagnostics::trace::scope       traced("stage");
+
+            stage::frames_t frames;
 
             try {
+                const auto frame_number = frame_number_++;
+                while (!pending_batches_.empty() && pending_batches_.begin()->first <= frame_number) {
+                    run_batch(pending_batches_.begin()->second);
+                    pending_batches_.erase(pending_batches_.begin());
+                }
+                while (!pending_transforms_.empty() && pending_transforms_.begin()->first <= frame_number) {
+                    auto& pending = pending_transforms_.begin()->second;
+                    do_apply_transforms(pending.second, pending.first);
+                    pending_transforms_.erase(pending_transforms_.begin());
+                }
+
                 for (auto& t : tweens_)
                     t.second.tick(1);
 
-                // TODO (perf) parallel_for
+                auto deadline = std::chrono::steady_clock::now() +
+                                std::chrono::microseconds(static_cast<std::int64_t>(
+                                    layer_deadline_ > 0 ? layer_deadline_ * 1000.0 : 1e6 / format_desc.fps));
+
+                // tweens_ is not thread-safe, fetch all transforms before receiving in parallel.
+                std::map<int, std::pair<frame_transform, bool>> transforms;
+                auto transform_of = [&](int index) -> std::pair<frame_transform, bool>& {
+                    auto it = transforms.find(index);
+                    if (it != transforms.end()) {
+                        return it->second;
+                    }
+
+                    auto transform = tweens_[index].fetch();
+                    auto visible   = routed_.count(index) > 0 || (render && is_visible(transform));
+
+                    // NOTE: Shed layers are hidden by their opacity, so the mixer drops their images before any upload
+                    // while their audio is still mixed. Routed layers are never shed.
+                    if (shed.count(index) > 0 && routed_.count(index) == 0) {
+                        transform.image_transform.opacity = 0.0;
+                        visible                           = false;
+                    }
+                    return transforms.emplace(index, std::make_pair(transform, visible)).first->second;
+                };
+
+                // Late layers whose receive has returned are back, their late frame is used for this tick.
+                std::map<int, received> returned;
+                for (auto it = late_.begin(); it != late_.end();) {
+                    if (!it->second.job.ready()) {
+                        ++it;
+                        continue;
+                    }
+                    auto index = it->first;
+                    auto late  = std::move(it->second);
+                    it         = late_.erase(it);
+
+                    returned[index] = late.job.get();
+                    if (layers_.find(index) == layers_.end()) {
+                        layers_.emplace(index, std::move(late.source));
+                    }
+                    run_batch(late.commands);
+                }
+
+                auto& jobs = jobs_;
+                jobs.clear();
                 for (auto& p : layers_) {
-                    auto& layer     = p.second;
-                    auto& tween     = tweens_[p.first];
-                    frames[p.first] = draw_frame::push(layer.receive(format_desc, nb_samples), tween.fetch());
+                    if (returned.count(p.first) > 0) {
+                        continue;
+                    }
+
+                    auto& transform = transform_of(p.first);
+
+                    layer_job job;
+                    job.index  = p.first;
+                    job.start  = std::chrono::steady_clock::now();
+                    job.finish = p.second.begin_receive(format_desc, nb_samples, transform.second, job.pending);
+
+                    // NOTE: Every layer has started its receive before the stage waits for any of them, only the
+                    // producers which make their frames on the thread which waits take a worker of the arena.
+                    if (job.pending.wait_for(std::chrono::seconds(0)) == std::future_status::deferred) {
+                        auto task =
+                            std::make_shared<std::packaged_task<received()>>([finish = job.finish, trace_frame] {
+                                caspar::diagnostics::trace::frame_scope frame_scope(trace_frame);
+
+                                auto start = std::chrono::high_resolution_clock::now();
+                                auto frame = finish();
+                                auto end   = std::chrono::high_resolution_clock::now();
+
+                                return received{std::move(frame),
+                                                std::chrono::duration<double, std::milli>(end - start).count()};
+                            });
+                        job.result = task->get_future().share();
+                        arena_.enqueue([task] { (*task)(); });
+                    }
+                    jobs.push_back(std::move(job));
+                }
+
+                // NOTE: A layer which misses the deadline does not hold up the channel. It is taken out of the tick
+                // with its receive still running, and its last frame is repeated until the receive has returned.
+                for (auto& job : jobs) {
+                    if (layer_deadline_ < 0) {
+                        job.wait();
+                    } else if (!job.wait_until(deadline)) {
+                        CASPAR_LOG(warning) << L"stage[" << channel_index_ << L"] Layer " << job.index
+                                            << L" missed its deadline, repeating its last frame.";
+                        auto it = layers_.find(job.index);
+                        late_.emplace(job.index, late_layer{std::move(it->second), job, {}});
+                        layers_.erase(it);
+                        continue;
+                    }
+                    returned[job.index] = job.get();
                 }
+                jobs.clear();
 
                 monitor::state state;
-                for (auto& p : layers_) {
-                    state["layer"][p.first] = p.second.state();
+                frames.reserve(returned.size() + late_.size());
+                for (auto& p : returned) {
+                    auto layer = layers_.find(p.first);
+                    if (layer != layers_.end()) {
+                        state["layer"][p.first] = layer->second.state();
+                    }
+                    state["layer"][p.first]["profile"]["receive-time"] = p.second.receive_time;
+
+                    last_frames_[p.first] = p.second.frame;
+                    frames.emplace(p.first, draw_frame::push(std::move(p.second.frame), transform_of(p.first).first));
+                }
+                for (auto& p : late_) {
+                    ++late_counts_[p.first];
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "late-layer");
+
+                    auto last = last_frames_.find(p.first);
+                    if (last != last_frames_.end()) {
+                        frames.emplace(p.first,
+                                       draw_frame::push(draw_frame::still(last->second), transform_of(p.first).first));
+                    }
+                }
+                for (auto& p : late_counts_) {
+                    state["layer"][p.first]["late"] = p.second;
                 }
+                state["control"]["latency"] = control_latency_ * 1000.0;
+                graph_->set_value("control-latency", control_latency_ * format_desc.fps * 0.5);
+                control_latency_ = 0.0;
+
                 state_ = std::move(state);
             } catch (...) {
                 layers_.clear();
@@ -90,9 +360,116 @@ struct stage::impl : public std::enable_shared_from_this<impl>
             }
 
             return frames;
+        };
+
+        // NOTE: Ticks run before any queued command, so that commands only delay a tick while one is running.
+        return executor_.begin_invoke(std::move(tick), task_priority::high);
+    }
+
+    // Runs a command, e.g. a load or a transform, on the executor after the ticks queued before it. Commands sent
+    // from a thread with an open batch are held back until the batch is committed.
+    template <typename Func>
+    auto control(Func&& func)
+    {
+        typedef decltype(std::declval<std::decay_t<Func>&>()()) result_type;
+
+        auto task = [this, func = std::forward<Func>(func), queued = std::chrono::steady_clock::now()]() mutable {
+            const auto latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - queued).count();
+            control_latency_   = std::max(control_latency_, latency);
+            return func();
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(batches_mutex_);
+            auto                        batch = batches_.find(std::this_thread::get_id());
+            if (batch != batches_.end()) {
+                auto packaged = std::make_shared<std::packaged_task<result_type()>>(std::move(task));
+                batch->second.push_back([packaged] { (*packaged)(); });
+                return packaged->get_future();
+            }
+        }
+
+        return executor_.begin_invoke(std::move(task));
+    }
+
+    void begin_batch()
+    {
+        std::lock_guard<std::mutex> lock(batches_mutex_);
+        batches_[std::this_thread::get_id()].clear();
+    }
+
+    std::future<void> commit_batch(int64_t frame_number)
+    {
+        auto batch = std::make_shared<batch_t>();
+        {
+            std::lock_guard<std::mutex> lock(batches_mutex_);
+            auto                        it = batches_.find(std::this_thread::get_id());
+            if (it != batches_.end()) {
+                *batch = std::move(it->second);
+                batches_.erase(it);
+            }
+        }
+
+        return executor_.begin_invoke([=] {
+            if (frame_number < frame_number_) {
+                run_batch(*batch);
+            } else {
+                pending_batches_.emplace(frame_number, std::move(*batch));
+            }
         });
     }
 
+    void abort_batch()
+    {
+        // NOTE: Destroying the held back commands breaks the promises of their futures.
+        std::lock_guard<std::mutex> lock(batches_mutex_);
+        batches_.erase(std::this_thread::get_id());
+    }
+
+    void run_batch(batch_t& batch)
+    {
+        // NOTE: The packaged commands store their own exceptions, so that they all run.
+        for (auto& command : batch) {
+            command();
+        }
+    }
+
+    // Runs a command on layers, after the receive of the first late one of them has returned.
+    template <typename Func>
+    auto layer_control(std::vector<int> indices, Func&& func)
+    {
+        typedef decltype(std::declval<std::decay_t<Func>&>()()) result_type;
+
+        return flatten(control([this, indices, func = std::forward<Func>(func)]() mutable {
+            auto task   = std::make_shared<std::packaged_task<result_type()>>(std::move(func));
+            auto future = task->get_future();
+
+            for (auto index : indices) {
+                auto late = late_.find(index);
+                if (late != late_.end()) {
+                    late->second.commands.push_back([task] { (*task)(); });
+                    return future;
+                }
+            }
+            (*task)();
+            return future;
+        }));
+    }
+
+    template <typename Func>
+    auto layer_control(int index, Func&& func)
+    {
+        return layer_control(std::vector<int>{index}, std::forward<Func>(func));
+    }
+
+    void erase_layer(int index)
+    {
+        layers_.erase(index);
+        late_.erase(index);
+        last_frames_.erase(index);
+        late_counts_.erase(index);
+    }
+
     layer& get_layer(int index)
     {
         auto it = layers_.find(index);
@@ -102,16 +479,29 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         return it->second;
     }
 
+    void do_apply_transforms(const std::vector<stage::transform_tuple_t>& transforms, bool append)
+    {
+        for (auto& transform : transforms) {
+            auto& tween = tweens_[std::get<0>(transform)];
+            auto  dst   = std::get<1>(transform)(tween.dest());
+            if (append) {
+                tween.append(dst, std::get<2>(transform), std::get<3>(transform));
+            } else {
+                tween = tweened_transform(tween.fetch(), dst, std::get<2>(transform), std::get<3>(transform));
+            }
+        }
+    }
+
     std::future<void>
-    apply_transforms(const std::vector<std::tuple<int, stage::transform_func_t, unsigned int, tweener>>& transforms)
+    apply_transforms(std::vector<stage::transform_tuple_t> transforms, bool append, int64_t frame_number = -1)
     {
-        return executor_.begin_invoke([=] {
-            for (auto& transform : transforms) {
-                auto& tween = tweens_[std::get<0>(transform)];
-                auto  src   = tween.fetch();
-                auto  dst   = std::get<1>(transform)(tween.dest());
-                tweens_[std::get<0>(transform)] =
-                    tweened_transform(src, dst, std::get<2>(transform), std::get<3>(transform));
+        // NOTE: The transforms are moved into the task, rather than copying every function object again.
+        auto ptr = std::make_shared<std::vector<stage::transform_tuple_t>>(std::move(transforms));
+        return control([=] {
+            if (frame_number < frame_number_) {
+                do_apply_transforms(*ptr, append);
+            } else {
+                pending_transforms_.emplace(frame_number, std::make_pair(append, std::move(*ptr)));
             }
         });
     }
@@ -121,7 +511,7 @@ struct stage::impl : public std::enable_shared_from_this<impl>
                                       unsigned int                   mix_duration,
                                       const tweener&                 tween)
     {
-        return executor_.begin_invoke([=] {
+        return control([=] {
             auto src       = tweens_[index].fetch();
             auto dst       = transform(src);
             tweens_[index] = tweened_transform(src, dst, mix_duration, tween);
@@ -130,17 +520,17 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
     std::future<void> clear_transforms(int index)
     {
-        return executor_.begin_invoke([=] { tweens_.erase(index); });
+        return control([=] { tweens_.erase(index); });
     }
 
     std::future<void> clear_transforms()
     {
-        return executor_.begin_invoke([=] { tweens_.clear(); });
+        return control([=] { tweens_.clear(); });
     }
 
     std::future<frame_transform> get_current_transform(int index)
     {
-        return executor_.begin_invoke([=] { return tweens_[index].fetch(); });
+        return control([=] { return tweens_[index].fetch(); });
     }
 
     std::future<void> load(int                                    index,
@@ -148,37 +538,52 @@ struct stage::impl : public std::enable_shared_from_this<impl>
                            bool                                   preview,
                            const boost::optional<int32_t>&        auto_play_delta)
     {
-        return executor_.begin_invoke([=] { get_layer(index).load(producer, preview, auto_play_delta); });
+        return layer_control(index, [=] { get_layer(index).load(producer, preview, auto_play_delta); });
     }
 
     std::future<void> pause(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).pause(); });
+        return layer_control(index, [=] { get_layer(index).pause(); });
     }
 
     std::future<void> resume(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).resume(); });
+        return layer_control(index, [=] { get_layer(index).resume(); });
     }
 
     std::future<void> play(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).play(); });
+        return layer_control(index, [=] { get_layer(index).play(); });
     }
 
     std::future<void> stop(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).stop(); });
+        return layer_control(index, [=] { get_layer(index).stop(); });
+    }
+
+    std::future<bool> unload(int index, const std::shared_ptr<frame_producer>& producer)
+    {
+        return layer_control(index, [=] { return get_layer(index).unload(producer); });
     }
 
     std::future<void> clear(int index)
     {
-        return executor_.begin_invoke([=] { layers_.erase(index); });
+        return control([=] { erase_layer(index); });
     }
 
     std::future<void> clear()
     {
-        return executor_.begin_invoke([=] { layers_.clear(); });
+        return control([=] {
+            layers_.clear();
+            late_.clear();
+            last_frames_.clear();
+            late_counts_.clear();
+        });
+    }
+
+    std::future<void> keep_rendering(int index)
+    {
+        return control([=] { routed_.insert(index); });
     }
 
     std::future<void> swap_layers(stage& other, bool swap_transforms)
@@ -194,6 +599,9 @@ struct stage::impl : public std::enable_shared_from_this<impl>
             auto other_layers = other_impl->layers_ | boost::adaptors::map_values;
 
             std::swap(layers_, other_impl->layers_);
+            std::swap(late_, other_impl->late_);
+            std::swap(last_frames_, other_impl->last_frames_);
+            std::swap(late_counts_, other_impl->late_counts_);
 
             if (swap_transforms)
                 std::swap(tweens_, other_impl->tweens_);
@@ -204,11 +612,17 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
     std::future<void> swap_layer(int index, int other_index, bool swap_transforms)
     {
-        return executor_.begin_invoke([=] {
+        return layer_control({index, other_index}, [=] {
+            // NOTE: Inserting into the layer tables moves their elements, so both entries are created first.
+            get_layer(index);
+            get_layer(other_index);
             std::swap(get_layer(index), get_layer(other_index));
 
-            if (swap_transforms)
+            if (swap_transforms) {
+                tweens_[index];
+                tweens_[other_index];
                 std::swap(tweens_[index], tweens_[other_index]);
+            }
         });
     }
 
@@ -241,27 +655,37 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         auto other_impl = other.impl_;
 
         if (other_impl->channel_index_ < channel_index_) {
-            return other_impl->executor_.begin_invoke([=] { executor_.invoke(func); });
+            return other_impl->control([=] { executor_.invoke(func); });
         }
 
-        return executor_.begin_invoke([=] { other_impl->executor_.invoke(func); });
+        return control([=] { other_impl->executor_.invoke(func); });
     }
 
     std::future<std::shared_ptr<frame_producer>> foreground(int index)
     {
-        return executor_.begin_invoke(
-            [=]() -> std::shared_ptr<frame_producer> { return get_layer(index).foreground(); });
+        return layer_control(
+            index, [=]() -> std::shared_ptr<frame_producer> { return get_layer(index).foreground(); });
     }
 
     std::future<std::shared_ptr<frame_producer>> background(int index)
     {
-        return executor_.begin_invoke(
-            [=]() -> std::shared_ptr<frame_producer> { return get_layer(index).background(); });
+        return layer_control(
+            index, [=]() -> std::shared_ptr<frame_producer> { return get_layer(index).background(); });
     }
 
     std::future<std::wstring> call(int index, const std::vector<std::wstring>& params)
     {
-        return flatten(executor_.begin_invoke([=] { return get_layer(index).foreground()->call(params).share(); }));
+        return flatten(layer_control(index, [=] { return get_layer(index).foreground()->call(params).share(); }));
+    }
+
+    std::future<void> thread_placement(const std::wstring& affinity, bool realtime)
+    {
+        return executor_.begin_invoke([=] {
+            set_thread_affinity(affinity);
+            if (realtime) {
+                set_thread_realtime_priority();
+            }
+        });
     }
 };
 
@@ -273,9 +697,21 @@ std::future<std::wstring> stage::call(int index, const std::vector<std::wstring>
 {
     return impl_->call(index, params);
 }
-std::future<void> stage::apply_transforms(const std::vector<stage::transform_tuple_t>& transforms)
+std::future<void> stage::apply_transforms(std::vector<stage::transform_tuple_t> transforms)
+{
+    return impl_->apply_transforms(std::move(transforms), false);
+}
+std::future<void> stage::apply_transforms(std::vector<stage::transform_tuple_t> transforms, int64_t frame_number)
 {
-    return impl_->apply_transforms(transforms);
+    return impl_->apply_transforms(std::move(transforms), false, frame_number);
+}
+std::future<void> stage::append_transforms(std::vector<stage::transform_tuple_t> transforms)
+{
+    return impl_->apply_transforms(std::move(transforms), true);
+}
+std::future<void> stage::append_transforms(std::vector<stage::transform_tuple_t> transforms, int64_t frame_number)
+{
+    return impl_->apply_transforms(std::move(transforms), true, frame_number);
 }
 std::future<void> stage::apply_transform(int                                                                index,
                                          const std::function<core::frame_transform(core::frame_transform)>& transform,
@@ -298,8 +734,13 @@ std::future<void> stage::pause(int index) { return impl_->pause(index); }
 std::future<void> stage::resume(int index) { return impl_->resume(index); }
 std::future<void> stage::play(int index) { return impl_->play(index); }
 std::future<void> stage::stop(int index) { return impl_->stop(index); }
+std::future<bool> stage::unload(int index, const std::shared_ptr<frame_producer>& producer)
+{
+    return impl_->unload(index, producer);
+}
 std::future<void> stage::clear(int index) { return impl_->clear(index); }
 std::future<void> stage::clear() { return impl_->clear(); }
+std::future<void> stage::keep_rendering(int index) { return impl_->keep_rendering(index); }
 std::future<void> stage::swap_layers(stage& other, bool swap_transforms)
 {
     return impl_->swap_layers(other, swap_transforms);
@@ -314,9 +755,20 @@ std::future<void> stage::swap_layer(int index, int other_index, stage& other, bo
 }
 std::future<std::shared_ptr<frame_producer>> stage::foreground(int index) { return impl_->foreground(index); }
 std::future<std::shared_ptr<frame_producer>> stage::background(int index) { return impl_->background(index); }
-std::map<int, draw_frame> stage::operator()(const video_format_desc& format_desc, int nb_samples)
+std::future<void> stage::thread_placement(const std::wstring& affinity, bool realtime)
+{
+    return impl_->thread_placement(affinity, realtime);
+}
+std::future<stage::frames_t> stage::operator()(const video_format_desc&               format_desc,
+                                               int                                    nb_samples,
+                                               bool                                   render,
+                                               const boost::container::flat_set<int>& shed)
 {
-    return (*impl_)(format_desc, nb_samples);
+    return (*impl_)(format_desc, nb_samples, render, shed);
 }
 core::monitor::state stage::state() const { return impl_->state_; }
+int64_t              stage::frame_number() const { return impl_->frame_number_; }
+void                 stage::begin_batch() { impl_->begin_batch(); }
+std::future<void>    stage::commit_batch(int64_t frame_number) { return impl_->commit_batch(frame_number); }
+void                 stage::abort_batch() { impl_->abort_batch(); }
 }} // namespace caspar::core
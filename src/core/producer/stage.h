@@ -28,8 +28,11 @@
 #include <common/memory.h>
 #include <common/tweener.h>
 
+#include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
 #include <boost/optional.hpp>
 
+#include <cstdint>
 #include <functional>
 #include <future>
 #include <map>
@@ -51,9 +54,26 @@ class stage final
 
     explicit stage(int channel_index, spl::shared_ptr<caspar::diagnostics::graph> graph);
 
-    std::map<int, draw_frame> operator()(const video_format_desc& format_desc, int nb_samples);
-
-    std::future<void> apply_transforms(const std::vector<transform_tuple_t>& transforms);
+    // The frames of the layers, sorted by layer index.
+    typedef boost::container::flat_map<int, draw_frame> frames_t;
+
+    // Receives the frames of the next tick. Without render, only routed layers are asked for images, the others are
+    // treated as hidden since their images are not drawn, see frame_producer::visible. The images of the shed layers
+    // are skipped while the channel is overloaded, those layers still tick and play their audio. Layers which miss
+    // the deadline of configuration.stage.layer-deadline repeat their last frame until their receive has returned.
+    std::future<frames_t> operator()(const video_format_desc&               format_desc,
+                                     int                                    nb_samples,
+                                     bool                                   render = true,
+                                     const boost::container::flat_set<int>& shed   = {});
+
+    std::future<void> apply_transforms(std::vector<transform_tuple_t> transforms);
+    // Applies the transforms at the start of tick frame_number, or of the next tick once it has passed, so that
+    // transforms committed to several channels in phase land on the same frame.
+    std::future<void> apply_transforms(std::vector<transform_tuple_t> transforms, int64_t frame_number);
+    // Appends the transforms as keyframes to the animations of their layers, each tweened to from the keyframe
+    // before it over its duration, so that a move of several segments is sent to the stage once.
+    std::future<void> append_transforms(std::vector<transform_tuple_t> transforms);
+    std::future<void> append_transforms(std::vector<transform_tuple_t> transforms, int64_t frame_number);
     std::future<void>
                                  apply_transform(int index, const transform_func_t& transform, unsigned int mix_duration, const tweener& tween);
     std::future<void>            clear_transforms(int index);
@@ -67,18 +87,36 @@ class stage final
     std::future<void>            resume(int index);
     std::future<void>            play(int index);
     std::future<void>            stop(int index);
+    // Drops the background of the layer if it is still producer, e.g. to evict a preload.
+    std::future<bool>            unload(int index, const std::shared_ptr<frame_producer>& producer);
     std::future<std::wstring>    call(int index, const std::vector<std::wstring>& params);
     std::future<void>            clear(int index);
     std::future<void>            clear();
+    // Keeps rendering the layer while it is hidden on this channel, as its frames are routed elsewhere.
+    std::future<void>            keep_rendering(int index);
     std::future<void>            swap_layers(stage& other, bool swap_transforms);
     std::future<void>            swap_layer(int index, int other_index, bool swap_transforms);
     std::future<void>            swap_layer(int index, int other_index, stage& other, bool swap_transforms);
 
     core::monitor::state state() const;
 
+    // The number of the next tick.
+    int64_t frame_number() const;
+
+    // Holds back the commands sent to the stage from the calling thread, until the batch is committed or aborted.
+    void begin_batch();
+    // Runs the held back commands of the calling thread in order at the start of tick frame_number, or in one
+    // executor task once it has passed, so that they all take effect on the same frame.
+    std::future<void> commit_batch(int64_t frame_number = -1);
+    // Drops the held back commands of the calling thread, whose futures are broken.
+    void abort_batch();
+
     std::future<std::shared_ptr<frame_producer>> foreground(int index);
     std::future<std::shared_ptr<frame_producer>> background(int index);
 
+    // Pins the thread which ticks the layers, see set_thread_affinity.
+    std::future<void> thread_placement(const std::wstring& affinity, bool realtime);
+
   private:
     struct impl;
     spl::shared_ptr<impl> impl_;
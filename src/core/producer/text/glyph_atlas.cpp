@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "glyph_atlas.h"
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+
+#include <common/except.h>
+#include <common/utf.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <vector>
+
+namespace caspar { namespace core {
+
+// NOTE: Large enough for a few hundred glyphs at lower third sizes, and for a single glyph at any size that fits in a
+// HD frame.
+static const int PAGE_SIZE = 1024;
+
+// Glyphs are one pixel apart so that sampling between pixels at the edge of one does not pick up its neighbour.
+static const int PADDING = 1;
+
+struct glyph_atlas::impl
+{
+    struct page_data
+    {
+        std::vector<std::uint8_t> pixels = std::vector<std::uint8_t>(PAGE_SIZE * PAGE_SIZE * 4, 0);
+        const_frame               frame;
+        std::vector<frame_region> dirty;
+        int                       shelf_x      = 0;
+        int                       shelf_y      = 0;
+        int                       shelf_height = 0;
+    };
+
+    spl::shared_ptr<frame_factory> frame_factory_;
+    const std::uint32_t            color_;
+    FT_Library                     library_ = nullptr;
+    FT_Face                        face_    = nullptr;
+    std::map<wchar_t, glyph>       glyphs_;
+    std::vector<page_data>         pages_;
+
+    impl(const spl::shared_ptr<frame_factory>& frame_factory,
+         const std::wstring&                   font,
+         int                                   size,
+         std::uint32_t                         color)
+        : frame_factory_(frame_factory)
+        , color_(color)
+    {
+        if (FT_Init_FreeType(&library_) != 0) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to initialize FreeType."));
+        }
+
+        if (FT_New_Face(library_, u8(font).c_str(), 0, &face_) != 0) {
+            FT_Done_FreeType(library_);
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Failed to open font " + font));
+        }
+
+        if (FT_Set_Pixel_Sizes(face_, 0, static_cast<FT_UInt>(size)) != 0) {
+            FT_Done_Face(face_);
+            FT_Done_FreeType(library_);
+            CASPAR_THROW_EXCEPTION(user_error()
+                                   << msg_info(L"Font " + font + L" has no size " + std::to_wstring(size)));
+        }
+
+        for (wchar_t code = 0x20; code < 0x7F; ++code) {
+            get(code);
+        }
+    }
+
+    ~impl()
+    {
+        FT_Done_Face(face_);
+        FT_Done_FreeType(library_);
+    }
+
+    // Finds room for a bitmap of width by height on the last page, on a new shelf or on a new page.
+    page_data& allocate(int width, int height, glyph& result)
+    {
+        if (width + PADDING > PAGE_SIZE || height + PADDING > PAGE_SIZE) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Glyph does not fit in a text atlas page."));
+        }
+
+        if (pages_.empty()) {
+            pages_.emplace_back();
+        }
+
+        auto page = &pages_.back();
+        if (page->shelf_x + width + PADDING > PAGE_SIZE) {
+            page->shelf_y += page->shelf_height;
+            page->shelf_x      = 0;
+            page->shelf_height = 0;
+        }
+        if (page->shelf_y + height + PADDING > PAGE_SIZE) {
+            pages_.emplace_back();
+            page = &pages_.back();
+        }
+
+        result.page = static_cast<int>(pages_.size()) - 1;
+        result.x    = page->shelf_x;
+        result.y    = page->shelf_y;
+
+        page->shelf_x += width + PADDING;
+        page->shelf_height = std::max(page->shelf_height, height + PADDING);
+
+        return *page;
+    }
+
+    const glyph& get(wchar_t code)
+    {
+        auto it = glyphs_.find(code);
+        if (it != glyphs_.end()) {
+            return it->second;
+        }
+
+        glyph result;
+
+        // NOTE: Characters the font does not map are drawn as its missing glyph, FreeType loads glyph 0 for them. Glyphs
+        // which fail to load take no space.
+        if (FT_Load_Char(face_, static_cast<FT_ULong>(code), FT_LOAD_RENDER) != 0) {
+            return glyphs_[code] = result;
+        }
+
+        const auto& slot   = face_->glyph;
+        const auto& bitmap = slot->bitmap;
+
+        result.width   = static_cast<int>(bitmap.width);
+        result.height  = static_cast<int>(bitmap.rows);
+        result.left    = slot->bitmap_left;
+        result.top     = slot->bitmap_top;
+        result.advance = slot->advance.x / 64.0;
+        result.index   = FT_Get_Char_Index(face_, static_cast<FT_ULong>(code));
+
+        if (result.width > 0 && result.height > 0 && bitmap.pixel_mode == FT_PIXEL_MODE_GRAY) {
+            auto& page = allocate(result.width, result.height, result);
+
+            // NOTE: The coverage of each pixel scales every channel of the color, which gives premultiplied bgra.
+            for (int y = 0; y < result.height; ++y) {
+                auto src = bitmap.buffer + y * bitmap.pitch;
+                auto dst = page.pixels.data() + ((result.y + y) * PAGE_SIZE + result.x) * 4;
+                for (int x = 0; x < result.width; ++x) {
+                    for (int n = 0; n < 4; ++n) {
+                        dst[x * 4 + n] = static_cast<std::uint8_t>(((color_ >> (n * 8)) & 0xFF) * src[x] / 255);
+                    }
+                }
+            }
+
+            page.dirty.push_back(frame_region{result.x, result.y, result.width, result.height});
+        } else {
+            result.width  = 0;
+            result.height = 0;
+        }
+
+        return glyphs_[code] = result;
+    }
+
+    draw_frame page(int index)
+    {
+        auto& page = pages_.at(index);
+
+        if (!page.dirty.empty()) {
+            pixel_format_desc desc(pixel_format::bgra);
+            desc.planes.push_back(pixel_format_desc::plane(PAGE_SIZE, PAGE_SIZE, 4));
+
+            // NOTE: Only the glyphs added since the last upload are uploaded, on top of the texture of the page.
+            auto frame = frame_factory_->update_frame(this, desc, page.frame, page.dirty);
+            std::memcpy(frame.image_data(0).begin(), page.pixels.data(), page.pixels.size());
+
+            page.frame = const_frame(std::move(frame));
+            page.dirty.clear();
+        }
+
+        return draw_frame(page.frame);
+    }
+
+    double kerning(const glyph& left, const glyph& right) const
+    {
+        if (!FT_HAS_KERNING(face_)) {
+            return 0.0;
+        }
+
+        FT_Vector delta;
+        if (FT_Get_Kerning(face_, left.index, right.index, FT_KERNING_DEFAULT, &delta) != 0) {
+            return 0.0;
+        }
+
+        return delta.x / 64.0;
+    }
+};
+
+glyph_atlas::glyph_atlas(const spl::shared_ptr<frame_factory>& frame_factory,
+                         const std::wstring&                   font,
+                         int                                   size,
+                         std::uint32_t                         color)
+    : impl_(new impl(frame_factory, font, size, color))
+{
+}
+glyph_atlas::~glyph_atlas() {}
+const glyph& glyph_atlas::get(wchar_t code) { return impl_->get(code); }
+double       glyph_atlas::kerning(const glyph& left, const glyph& right) const { return impl_->kerning(left, right); }
+draw_frame   glyph_atlas::page(int index) { return impl_->page(index); }
+int          glyph_atlas::page_size() const { return PAGE_SIZE; }
+double       glyph_atlas::ascender() const { return impl_->face_->size->metrics.ascender / 64.0; }
+double       glyph_atlas::line_height() const { return impl_->face_->size->metrics.height / 64.0; }
+int          glyph_atlas::size() const { return static_cast<int>(impl_->glyphs_.size()); }
+
+}} // namespace caspar::core
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace core {
+
+// A glyph rasterized into a page of a glyph_atlas. Positions and sizes are in pixels.
+struct glyph final
+{
+    int           page    = 0;
+    int           x       = 0;
+    int           y       = 0;
+    int           width   = 0;
+    int           height  = 0;
+    int           left    = 0; // from the pen to the left edge of the bitmap
+    int           top     = 0; // from the baseline up to the top edge of the bitmap
+    double        advance = 0.0;
+    std::uint32_t index   = 0; // of the glyph in the font, for kerning
+};
+
+// Glyphs of one font at one pixel size and color, rasterized with FreeType into square bgra pages the first time they
+// are used. A page is uploaded again only when glyphs have been added to it, printable ascii is rasterized up front.
+class glyph_atlas final
+{
+  public:
+    glyph_atlas(const spl::shared_ptr<frame_factory>& frame_factory,
+                const std::wstring&                   font,
+                int                                   size,
+                std::uint32_t                         color);
+    ~glyph_atlas();
+
+    glyph_atlas(const glyph_atlas&) = delete;
+    glyph_atlas& operator=(const glyph_atlas&) = delete;
+
+    const glyph& get(wchar_t code);
+    double       kerning(const glyph& left, const glyph& right) const;
+
+    // The page as a frame at its own size, uploading it first if glyphs have been added to it.
+    draw_frame page(int index);
+    int        page_size() const;
+
+    double ascender() const;
+    double line_height() const;
+    int    size() const; // glyphs rasterized so far
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::core
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "text_producer.h"
+
+#include "glyph_atlas.h"
+
+#include "../color/color_producer.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/os/filesystem.h>
+#include <common/param.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+
+namespace caspar { namespace core {
+
+// Draws every glyph of the text as a quad of the atlas page it is on, cropped to the glyph. The pages are textures
+// which stay on the gpu between frames, so a frame costs the mixer one quad for each glyph and nothing is uploaded
+// unless the text has characters which have not been drawn before.
+class text_producer : public frame_producer
+{
+    monitor::state          state_;
+    const std::wstring      font_;
+    const video_format_desc format_desc_;
+    glyph_atlas             atlas_;
+
+    mutable std::mutex mutex_;
+    std::wstring       text_;
+    draw_frame         text_frame_;
+    double             text_width_ = 0.0;
+    double             x_;
+    double             y_;
+    double             speed_;
+    double             offset_;
+
+  public:
+    text_producer(const spl::shared_ptr<frame_factory>& frame_factory,
+                  const video_format_desc&              format_desc,
+                  const std::wstring&                   font,
+                  const std::wstring&                   text,
+                  int                                   size,
+                  std::uint32_t                         color,
+                  double                                x,
+                  double                                y,
+                  double                                speed)
+        : font_(font)
+        , format_desc_(format_desc)
+        , atlas_(frame_factory, font, size, color)
+        , x_(x)
+        , y_(y)
+        , speed_(speed)
+        , offset_(format_desc.width)
+    {
+        set_text(text);
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    void set_text(const std::wstring& text)
+    {
+        const auto width     = static_cast<double>(format_desc_.width);
+        const auto height    = static_cast<double>(format_desc_.height);
+        const auto page_size = static_cast<double>(atlas_.page_size());
+
+        std::vector<draw_frame> glyphs;
+
+        auto         pen_x    = 0.0;
+        auto         pen_y    = std::round(atlas_.ascender());
+        const glyph* previous = nullptr;
+
+        text_width_ = 0.0;
+
+        for (auto code : text) {
+            if (code == L'\n') {
+                pen_x = 0.0;
+                pen_y += std::round(atlas_.line_height());
+                previous = nullptr;
+                continue;
+            }
+
+            const auto& current = atlas_.get(code);
+            if (previous) {
+                pen_x += atlas_.kerning(*previous, current);
+            }
+
+            if (current.width > 0) {
+                // NOTE: Bitmaps are placed on whole pixels so that they are sampled as they were rasterized.
+                const auto left = std::round(pen_x) + current.left;
+                const auto top  = pen_y - current.top;
+
+                // NOTE: The page is drawn at its own size and cropped to the glyph, the crop moves the quad to where
+                // the glyph is on the page, so the page is offset by that position.
+                frame_transform transform;
+                transform.image_transform.fill_translation = {(left - current.x) / width, (top - current.y) / height};
+                transform.image_transform.fill_scale       = {page_size / width, page_size / height};
+                transform.image_transform.crop.ul          = {current.x / page_size, current.y / page_size};
+                transform.image_transform.crop.lr          = {(current.x + current.width) / page_size,
+                                                              (current.y + current.height) / page_size};
+
+                glyphs.push_back(draw_frame::push(atlas_.page(current.page), transform));
+            }
+
+            pen_x += current.advance;
+            text_width_ = std::max(text_width_, pen_x);
+            previous    = &current;
+        }
+
+        text_       = text;
+        text_frame_ = draw_frame(std::move(glyphs));
+    }
+
+    // frame_producer
+
+    draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        state_["text/value"]  = text_;
+        state_["text/font"]   = font_;
+        state_["text/glyphs"] = atlas_.size();
+
+        frame_transform transform;
+        if (speed_ != 0.0) {
+            transform.image_transform.fill_translation = {offset_ / format_desc_.width, y_ / format_desc_.height};
+
+            offset_ -= speed_;
+            if (offset_ + text_width_ < 0.0) {
+                offset_ = format_desc_.width;
+            } else if (offset_ > format_desc_.width) {
+                offset_ = -text_width_;
+            }
+        } else {
+            transform.image_transform.fill_translation = {x_ / format_desc_.width, y_ / format_desc_.height};
+        }
+
+        return draw_frame::push(text_frame_, transform);
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (params.size() < 2) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info(L"Text producer commands take a value."));
+        }
+
+        const auto& cmd = params.at(0);
+
+        if (boost::iequals(cmd, L"TEXT")) {
+            set_text(boost::join(std::vector<std::wstring>(params.begin() + 1, params.end()), L" "));
+        } else if (boost::iequals(cmd, L"SPEED")) {
+            speed_ = boost::lexical_cast<double>(params.at(1));
+        } else if (boost::iequals(cmd, L"X")) {
+            x_ = boost::lexical_cast<double>(params.at(1));
+        } else if (boost::iequals(cmd, L"Y")) {
+            y_ = boost::lexical_cast<double>(params.at(1));
+        } else {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info(L"Unknown text producer command " + cmd));
+        }
+
+        return make_ready_future(std::wstring());
+    }
+
+    std::wstring print() const override { return L"text[" + font_ + L"]"; }
+
+    std::wstring name() const override { return L"text"; }
+
+    monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+};
+
+static boost::optional<std::wstring> find_font(const std::wstring& name)
+{
+    for (const auto& folder : {env::font_folder(), env::initial_folder() + L"/"}) {
+        for (const auto& extension : {L"", L".ttf", L".otf", L".ttc"}) {
+            if (auto file = find_case_insensitive(folder + name + extension)) {
+                return file;
+            }
+        }
+    }
+    return boost::none;
+}
+
+spl::shared_ptr<frame_producer> create_text_producer(const frame_producer_dependencies& dependencies,
+                                                     const std::vector<std::wstring>&   params)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"TEXT")) {
+        return frame_producer::empty();
+    }
+
+    static const auto default_font =
+        env::properties().get(L"configuration.text.font", std::wstring(L"LiberationMono-Regular"));
+    static const auto default_size = env::properties().get(L"configuration.text.size", 48);
+
+    const std::vector<std::wstring> options(params.begin() + 2, params.end());
+
+    const auto font_name = get_param(L"FONT", options, default_font);
+    const auto font      = find_font(font_name);
+    if (!font) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Font " + font_name + L" not found."));
+    }
+
+    std::uint32_t color = 0xFFFFFFFF;
+    if (contains_param(L"COLOR", options) && !try_get_color(get_param(L"COLOR", options), color)) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid color: " + get_param(L"COLOR", options)));
+    }
+
+    return spl::make_shared<text_producer>(dependencies.frame_factory,
+                                           dependencies.format_desc,
+                                           *font,
+                                           params.at(1),
+                                           get_param(L"SIZE", options, default_size),
+                                           color,
+                                           get_param(L"X", options, 0.0),
+                                           get_param(L"Y", options, 0.0),
+                                           get_param(L"SPEED", options, 0.0));
+}
+
+}} // namespace caspar::core
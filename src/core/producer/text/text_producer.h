@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../frame_producer.h"
+
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+
+// TEXT <text> [FONT <name>] [SIZE <pixels>] [COLOR <color>] [X <pixels>] [Y <pixels>] [SPEED <pixels>] draws text
+// from a font in the font folder, with its top left corner at X and Y. With a SPEED the text runs from the right edge
+// to the left one by that many pixels every frame and starts over, like a ticker. CALL TEXT <text>, SPEED, X and Y
+// change it while it plays, without rasterizing glyphs which have been drawn before.
+spl::shared_ptr<frame_producer> create_text_producer(const frame_producer_dependencies& dependencies,
+                                                     const std::vector<std::wstring>&   params);
+
+}} // namespace caspar::core
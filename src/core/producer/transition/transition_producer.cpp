@@ -28,11 +28,21 @@
 #include "../../monitor/monitor.h"
 #include "../frame_producer.h"
 
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
 #include <common/scope_exit.h>
 
+#include <boost/property_tree/ptree.hpp>
+
 #include <tbb/parallel_invoke.h>
 
+#include <algorithm>
+#include <chrono>
 #include <future>
+#include <list>
+#include <mutex>
+#include <thread>
 
 namespace caspar { namespace core {
 
@@ -43,6 +53,7 @@ class transition_producer : public frame_producer
 
     core::draw_frame dst_;
     core::draw_frame src_;
+    core::draw_frame matte_;
 
     const transition_info info_;
 
@@ -68,6 +79,12 @@ class transition_producer : public frame_producer
 
     void leading_producer(const spl::shared_ptr<frame_producer>& producer) override { src_producer_ = producer; }
 
+    void visible(bool visible) override
+    {
+        src_producer_->visible(visible);
+        dst_producer_->visible(visible);
+    }
+
     spl::shared_ptr<frame_producer> following_producer() const override
     {
         return dst_ && current_frame_ >= info_.duration ? dst_producer_ : core::frame_producer::empty();
@@ -91,6 +108,10 @@ class transition_producer : public frame_producer
                         return "push";
                     case transition_type::cut:
                         return "cut";
+                    case transition_type::luma:
+                        return "luma";
+                    case transition_type::sting:
+                        return "sting";
                     default:
                         return "n/a";
                 }
@@ -109,6 +130,14 @@ class transition_producer : public frame_producer
                 if (!src_) {
                     src_ = src_producer_->last_frame();
                 }
+            },
+            [&] {
+                if (info_.matte && current_frame_ < info_.duration) {
+                    matte_ = info_.matte->receive(nb_samples);
+                    if (!matte_) {
+                        matte_ = info_.matte->last_frame();
+                    }
+                }
             });
 
         if (!dst_) {
@@ -150,29 +179,138 @@ class transition_producer : public frame_producer
 
         const double dir = info_.direction == transition_direction::from_left ? 1.0 : -1.0;
 
+        if (info_.type == transition_type::sting && info_.stinger) {
+            return sting(dst_frame, src_frame, delta);
+        }
+
+        // NOTE: Luma transitions mix until the matte is loaded.
+        const auto type = info_.type == transition_type::luma && !matte_ ? transition_type::mix : info_.type;
+
         src_frame.transform().audio_transform.volume = 1.0 - delta;
         dst_frame.transform().audio_transform.volume = delta;
 
-        if (info_.type == transition_type::mix) {
+        if (type == transition_type::luma) {
+            // NOTE: The key of the destination is the matte mapped through inverted levels, so that the threshold
+            // is applied by the kernel while drawing the key, without another pass over the frames.
+            const auto softness = std::max(0.001, info_.softness);
+            auto       matte    = matte_;
+            auto&      levels   = matte.transform().image_transform.levels;
+
+            levels.max_input  = delta * (1.0 + softness);
+            levels.min_input  = levels.max_input - softness;
+            levels.min_output = 1.0;
+            levels.max_output = 0.0;
+
+            matte.transform().audio_transform.volume = 0.0;
+
+            return draw_frame::over(src_frame, draw_frame::mask(dst_frame, matte));
+        }
+
+        if (type == transition_type::mix) {
             dst_frame.transform().image_transform.opacity = delta;
             dst_frame.transform().image_transform.is_mix  = true;
             src_frame.transform().image_transform.opacity = 1.0 - delta;
             src_frame.transform().image_transform.is_mix  = true;
-        } else if (info_.type == transition_type::slide) {
+        } else if (type == transition_type::slide) {
             dst_frame.transform().image_transform.fill_translation[0] = (-1.0 + delta) * dir;
-        } else if (info_.type == transition_type::push) {
+        } else if (type == transition_type::push) {
             dst_frame.transform().image_transform.fill_translation[0] = (-1.0 + delta) * dir;
             src_frame.transform().image_transform.fill_translation[0] = (0.0 + delta) * dir;
-        } else if (info_.type == transition_type::wipe) {
+        } else if (type == transition_type::wipe) {
             dst_frame.transform().image_transform.clip_scale[0] = delta;
         }
 
         return draw_frame::over(src_frame, dst_frame);
     }
 
+    draw_frame sting(draw_frame dst_frame, draw_frame src_frame, double delta) const
+    {
+        // NOTE: current_frame_ is already advanced past the frame being composed.
+        const auto index   = current_frame_ - 1;
+        const bool swapped = index >= info_.trigger;
+
+        if (!info_.audio_fade) {
+            delta = swapped ? 1.0 : 0.0;
+        }
+
+        src_frame.transform().audio_transform.volume = 1.0 - delta;
+        dst_frame.transform().audio_transform.volume = delta;
+
+        // NOTE: The hidden frame is kept for its audio, the kernel skips transparent items.
+        (swapped ? src_frame : dst_frame).transform().image_transform.opacity = 0.0;
+
+        auto frame = swapped ? draw_frame::over(src_frame, dst_frame) : draw_frame::over(dst_frame, src_frame);
+
+        const auto& stinger = *info_.stinger;
+        if (index < static_cast<int>(stinger.size())) {
+            frame = draw_frame::over(frame, stinger[index]);
+        }
+
+        return frame;
+    }
+
     core::monitor::state state() { return state_; }
 };
 
+std::shared_ptr<const std::vector<draw_frame>>
+load_stinger(const std::wstring&                                     name,
+             const video_format_desc&                                format_desc,
+             const std::function<spl::shared_ptr<frame_producer>()>& factory)
+{
+    typedef std::shared_ptr<const std::vector<draw_frame>> frames_t;
+
+    static std::mutex                                   mutex;
+    static std::list<std::pair<std::wstring, frames_t>> cache;
+    static const auto capacity = env::properties().get(L"configuration.transition.stinger-cache", 4);
+
+    const auto key = name + L"@" + format_desc.name;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = std::find_if(cache.begin(), cache.end(), [&](const auto& entry) { return entry.first == key; });
+        if (it != cache.end()) {
+            cache.splice(cache.begin(), cache, it);
+            return it->second;
+        }
+    }
+
+    auto producer = factory();
+    if (producer == frame_producer::empty()) {
+        return nullptr;
+    }
+
+    // NOTE: Looping clips are cut after ten seconds, as are clips which stop delivering frames for two seconds.
+    const auto max_frames = static_cast<std::size_t>(std::min<double>(producer->nb_frames(), format_desc.fps * 10.0));
+
+    auto frames  = std::make_shared<std::vector<draw_frame>>();
+    auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (frames->size() < max_frames && std::chrono::steady_clock::now() < timeout) {
+        const auto& cadence = format_desc.audio_cadence;
+        auto        frame   = producer->receive(cadence[frames->size() % cadence.size()]);
+        if (frame) {
+            frames->push_back(std::move(frame));
+            timeout = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    if (frames->empty()) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not decode stinger " + name));
+    }
+
+    CASPAR_LOG(info) << L"[transition] Decoded " << frames->size() << L" frames of stinger " << name;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    cache.emplace_front(key, frames);
+    while (cache.size() > static_cast<std::size_t>(std::max(1, capacity))) {
+        cache.pop_back();
+    }
+
+    return frames;
+}
+
 spl::shared_ptr<frame_producer> create_transition_producer(const spl::shared_ptr<frame_producer>& destination,
                                                            const transition_info&                 info)
 {
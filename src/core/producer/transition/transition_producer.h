@@ -27,7 +27,10 @@
 #include <common/memory.h>
 #include <common/tweener.h>
 
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace caspar { namespace core {
 
@@ -38,6 +41,8 @@ enum class transition_type
     push,
     slide,
     wipe,
+    luma,
+    sting,
     count
 };
 
@@ -54,8 +59,27 @@ struct transition_info
     transition_direction direction = transition_direction::from_left;
     transition_type      type      = transition_type::cut;
     caspar::tweener      tweener{L"linear"};
+
+    // The luma transition reveals the destination where the luma of the frames of matte is below its progress, with
+    // a soft edge of softness.
+    std::shared_ptr<frame_producer> matte;
+    double                          softness = 0.1;
+
+    // The sting transition draws the frames of stinger over the source, and over the destination from frame trigger
+    // on. The audio of the source and the destination is crossfaded across the stinger, or cut at trigger.
+    std::shared_ptr<const std::vector<draw_frame>> stinger;
+    int                                            trigger    = 0;
+    bool                                           audio_fade = true;
 };
 
+// The frames of the producer created by factory, decoded once for each name and video format and kept in memory,
+// so that later stingers of the same clip start without any decoding. The last transition.stinger-cache stingers
+// are kept.
+std::shared_ptr<const std::vector<draw_frame>>
+load_stinger(const std::wstring&                                     name,
+             const video_format_desc&                                format_desc,
+             const std::function<spl::shared_ptr<frame_producer>()>& factory);
+
 spl::shared_ptr<frame_producer> create_transition_producer(const spl::shared_ptr<frame_producer>& destination,
                                                            const transition_info&                 info);
 
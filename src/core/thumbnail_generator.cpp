@@ -0,0 +1,472 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StdAfx.h"
+
+#include "thumbnail_generator.h"
+
+#include "consumer/frame_consumer.h"
+#include "frame/draw_frame.h"
+#include "frame/frame.h"
+#include "frame/frame_transform.h"
+#include "frame/pixel_format.h"
+#include "mixer/image/image_mixer.h"
+#include "producer/cg_proxy.h"
+#include "producer/frame_producer.h"
+#include "video_format.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/filesystem.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace caspar { namespace core {
+
+namespace {
+
+// NOTE: Hashing whole files would read the library once more, so the hash covers the size and both ends of a file,
+// which are where containers keep their headers and indexes.
+const std::streamsize hashed_bytes = 64 * 1024;
+
+std::wstring content_hash(const boost::filesystem::path& path)
+{
+    std::uint64_t hash = 14695981039346656037ULL;
+
+    auto add = [&](const char* data, std::size_t size) {
+        for (std::size_t n = 0; n < size; ++n) {
+            hash = (hash ^ static_cast<unsigned char>(data[n])) * 1099511628211ULL;
+        }
+    };
+
+    auto size = boost::filesystem::file_size(path);
+    add(reinterpret_cast<const char*>(&size), sizeof(size));
+
+    boost::filesystem::ifstream file(path, std::ios::binary);
+    std::vector<char>           buffer(hashed_bytes);
+
+    file.read(buffer.data(), hashed_bytes);
+    add(buffer.data(), static_cast<std::size_t>(file.gcount()));
+
+    if (size > static_cast<std::uintmax_t>(2 * hashed_bytes)) {
+        file.clear();
+        file.seekg(-hashed_bytes, std::ios::end);
+        file.read(buffer.data(), hashed_bytes);
+        add(buffer.data(), static_cast<std::size_t>(file.gcount()));
+    }
+
+    if (!file && !file.eof()) {
+        CASPAR_THROW_EXCEPTION(io_error() << msg_info(L"Failed to read " + path.wstring()));
+    }
+
+    static const wchar_t digits[] = L"0123456789abcdef";
+
+    std::wstring result;
+    for (int shift = 60; shift >= 0; shift -= 4) {
+        result += digits[(hash >> shift) & 0xF];
+    }
+    return result;
+}
+
+std::wstring media_name(const boost::filesystem::path& path)
+{
+    auto name = get_relative_without_extension(path, env::media_folder()).generic_wstring();
+
+    if (!name.empty() && (name[0] == L'\\' || name[0] == L'/'))
+        name = name.substr(1);
+
+    return boost::to_upper_copy(name);
+}
+
+} // namespace
+
+struct thumbnail_generator::impl
+{
+    struct media_entry
+    {
+        std::uintmax_t size     = 0;
+        std::time_t    modified = 0;
+        std::wstring   hash;
+    };
+
+    spl::shared_ptr<image_mixer>                   image_mixer_;
+    const video_format_desc                        format_desc_;
+    spl::shared_ptr<const frame_producer_registry> producer_registry_;
+    spl::shared_ptr<const frame_consumer_registry> consumer_registry_;
+    spl::shared_ptr<const cg_producer_registry>    cg_registry_;
+    const std::size_t                              max_queue_;
+
+    std::mutex image_mixer_mutex_;
+
+    mutable std::mutex                  index_mutex_;
+    std::map<std::wstring, media_entry> index_;
+    std::set<std::wstring>              failed_;
+
+    std::mutex                        queue_mutex_;
+    std::condition_variable           queue_cond_;
+    std::deque<std::function<void()>> queue_;
+    std::set<std::wstring>            queued_;
+    bool                              running_ = true;
+    std::vector<std::thread>          threads_;
+
+    std::atomic<bool> scanning_{false};
+    executor          scanner_{L"thumbnail scan"};
+
+    impl(std::unique_ptr<image_mixer>                          image_mixer,
+         const video_format_desc&                              format_desc,
+         const spl::shared_ptr<const frame_producer_registry>& producer_registry,
+         const spl::shared_ptr<const frame_consumer_registry>& consumer_registry,
+         const spl::shared_ptr<const cg_producer_registry>&    cg_registry,
+         int                                                   threads,
+         int                                                   max_queue)
+        : image_mixer_(std::move(image_mixer))
+        , format_desc_(format_desc)
+        , producer_registry_(producer_registry)
+        , consumer_registry_(consumer_registry)
+        , cg_registry_(cg_registry)
+        , max_queue_(static_cast<std::size_t>(std::max(1, max_queue)))
+    {
+        for (int n = 0; n < std::max(1, threads); ++n) {
+            threads_.emplace_back([this, n] {
+                set_thread_name(L"thumbnail " + std::to_wstring(n));
+                set_thread_low_priority();
+                run();
+            });
+        }
+    }
+
+    ~impl()
+    {
+        scanner_.stop();
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            running_ = false;
+            queue_.clear();
+        }
+        queue_cond_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void run()
+    {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex_);
+                queue_cond_.wait(lock, [&] { return !running_ || !queue_.empty(); });
+                if (!running_) {
+                    return;
+                }
+                job = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            queue_cond_.notify_all();
+            job();
+        }
+    }
+
+    boost::filesystem::path find_media(const std::wstring& name) const
+    {
+        auto path   = boost::filesystem::path(env::media_folder() + name);
+        auto parent = path.parent_path();
+
+        if (boost::filesystem::is_directory(parent)) {
+            for (boost::filesystem::directory_iterator it(parent), end; it != end; ++it) {
+                if (boost::filesystem::is_regular_file(it->path()) &&
+                    boost::iequals(it->path().stem().wstring(), path.filename().wstring())) {
+                    return it->path();
+                }
+            }
+        }
+
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"No media named " + name));
+    }
+
+    // The hash of a file is kept until its size or modification time change.
+    std::wstring hash_of(const boost::filesystem::path& path)
+    {
+        auto name     = media_name(path);
+        auto size     = boost::filesystem::file_size(path);
+        auto modified = boost::filesystem::last_write_time(path);
+
+        {
+            std::lock_guard<std::mutex> lock(index_mutex_);
+            auto                        it = index_.find(name);
+            if (it != index_.end() && it->second.size == size && it->second.modified == modified) {
+                return it->second.hash;
+            }
+        }
+
+        media_entry entry;
+        entry.size     = size;
+        entry.modified = modified;
+        entry.hash     = content_hash(path);
+
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        index_[name] = entry;
+        return entry.hash;
+    }
+
+    static std::wstring thumbnail_path(const std::wstring& hash) { return env::thumbnail_folder() + hash + L".png"; }
+
+    bool needs_thumbnail(const std::wstring& hash) const
+    {
+        {
+            std::lock_guard<std::mutex> lock(index_mutex_);
+            if (failed_.count(hash)) {
+                return false;
+            }
+        }
+        return !boost::filesystem::exists(thumbnail_path(hash));
+    }
+
+    // Queues the rendering of a thumbnail, waiting for room if wait is set. Returns an invalid future if the queue is
+    // full, and a ready one if the thumbnail is already queued.
+    std::future<void> enqueue(const std::wstring& name, const std::wstring& hash, bool wait)
+    {
+        auto task   = std::make_shared<std::packaged_task<void()>>([=] { render(name, hash); });
+        auto future = task->get_future();
+
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+
+            if (queued_.count(hash)) {
+                std::promise<void> promise;
+                promise.set_value();
+                return promise.get_future();
+            }
+
+            if (wait) {
+                queue_cond_.wait(lock, [&] { return !running_ || queue_.size() < max_queue_; });
+            }
+
+            if (!running_ || queue_.size() >= max_queue_) {
+                return {};
+            }
+
+            queued_.insert(hash);
+            queue_.emplace_back([=] {
+                (*task)();
+                std::lock_guard<std::mutex> lock(queue_mutex_);
+                queued_.erase(hash);
+            });
+        }
+        queue_cond_.notify_one();
+
+        return future;
+    }
+
+    draw_frame receive(frame_producer& producer)
+    {
+        // NOTE: Producers decode asynchronously, so their first frames may still be on their way.
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+        while (true) {
+            auto frame = producer.receive(0);
+            if (frame) {
+                return frame;
+            }
+            if (std::chrono::steady_clock::now() > deadline) {
+                CASPAR_THROW_EXCEPTION(timed_out() << msg_info(L"No frame from " + producer.print()));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    void render(const std::wstring& name, const std::wstring& hash)
+    {
+        try {
+            frame_producer_dependencies dependencies(image_mixer_, {}, format_desc_, producer_registry_, cg_registry_);
+
+            auto producer = producer_registry_->create_producer(dependencies, std::vector<std::wstring>{name});
+            if (producer == frame_producer::empty()) {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No producer for " + name));
+            }
+
+            // NOTE: The very first frames are often black, so clips are seeked a tenth into their duration.
+            auto nb_frames = producer->nb_frames();
+            if (nb_frames > 1 && nb_frames < std::numeric_limits<std::uint32_t>::max()) {
+                try {
+                    producer->call({L"SEEK", std::to_wstring(nb_frames / 10)}).get();
+                } catch (...) {
+                }
+            }
+
+            auto frame                                    = receive(*producer);
+            frame.transform().image_transform.layer_depth = 1;
+
+            std::future<std::vector<array<const std::uint8_t>>> images_future;
+            {
+                std::lock_guard<std::mutex> lock(image_mixer_mutex_);
+                frame.accept(*image_mixer_);
+                images_future = (*image_mixer_)(format_desc_, {output_format::quarter}, {});
+            }
+            auto images = images_future.get();
+
+            auto desc = pixel_format_desc(pixel_format::bgra);
+            desc.planes.push_back(pixel_format_desc::plane(format_desc_.width, format_desc_.height, 4));
+
+            std::map<output_format, array<const std::uint8_t>> converted;
+            converted[output_format::quarter] = std::move(images.at(1));
+
+            std::vector<array<const std::uint8_t>> image_data;
+            image_data.emplace_back(std::move(images.at(0)));
+
+            auto consumer =
+                consumer_registry_->create_consumer({L"IMAGE", env::thumbnail_folder() + hash, L"THUMBNAIL"}, {});
+            consumer->initialize(format_desc_, 0);
+            consumer
+                ->send(const_frame(std::move(image_data), array<const std::int32_t>(), desc, std::move(converted)))
+                .get();
+
+            CASPAR_LOG(debug) << L"[thumbnail_generator] Rendered " << name;
+        } catch (...) {
+            CASPAR_LOG(warning) << L"[thumbnail_generator] Failed to render " << name;
+
+            // NOTE: Files which cannot be rendered, e.g. audio or data files, are not tried again until they change.
+            {
+                std::lock_guard<std::mutex> lock(index_mutex_);
+                failed_.insert(hash);
+            }
+            throw;
+        }
+    }
+
+    std::future<void> generate(const std::wstring& media_name)
+    {
+        auto path = find_media(media_name);
+        auto hash = hash_of(path);
+
+        if (!needs_thumbnail(hash)) {
+            std::promise<void> promise;
+            promise.set_value();
+            return promise.get_future();
+        }
+
+        auto future = enqueue(boost::to_upper_copy(media_name), hash, false);
+        if (!future.valid()) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Too many thumbnails waiting to be rendered."));
+        }
+        return future;
+    }
+
+    void generate_all()
+    {
+        // NOTE: A scan which is still walking the media folder will also find the files of this request.
+        if (scanning_.exchange(true)) {
+            return;
+        }
+
+        scanner_.begin_invoke([this] {
+            set_thread_low_priority();
+
+            try {
+                for (boost::filesystem::recursive_directory_iterator it(env::media_folder()), end; it != end; ++it) {
+                    if (!scanner_.is_running()) {
+                        break;
+                    }
+                    if (!boost::filesystem::is_regular_file(it->path())) {
+                        continue;
+                    }
+                    try {
+                        auto hash = hash_of(it->path());
+                        if (needs_thumbnail(hash)) {
+                            enqueue(media_name(it->path()), hash, true);
+                        }
+                    } catch (...) {
+                        CASPAR_LOG_CURRENT_EXCEPTION();
+                    }
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            scanning_ = false;
+        });
+    }
+
+    std::wstring find(const std::wstring& media_name)
+    {
+        auto path = thumbnail_path(hash_of(find_media(media_name)));
+        return boost::filesystem::exists(path) ? path : L"";
+    }
+
+    std::vector<thumbnail_info> list()
+    {
+        std::vector<thumbnail_info> result;
+
+        for (boost::filesystem::recursive_directory_iterator it(env::media_folder()), end; it != end; ++it) {
+            if (!boost::filesystem::is_regular_file(it->path())) {
+                continue;
+            }
+            try {
+                auto path = thumbnail_path(hash_of(it->path()));
+                if (boost::filesystem::exists(path)) {
+                    result.push_back(thumbnail_info{media_name(it->path()), path});
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+
+        return result;
+    }
+};
+
+thumbnail_generator::thumbnail_generator(std::unique_ptr<image_mixer>                          image_mixer,
+                                         const video_format_desc&                              format_desc,
+                                         const spl::shared_ptr<const frame_producer_registry>& producer_registry,
+                                         const spl::shared_ptr<const frame_consumer_registry>& consumer_registry,
+                                         const spl::shared_ptr<const cg_producer_registry>&    cg_registry,
+                                         int                                                   threads,
+                                         int                                                   max_queue)
+    : impl_(new impl(
+          std::move(image_mixer), format_desc, producer_registry, consumer_registry, cg_registry, threads, max_queue))
+{
+}
+thumbnail_generator::~thumbnail_generator() {}
+std::future<void> thumbnail_generator::generate(const std::wstring& media_name)
+{
+    return impl_->generate(media_name);
+}
+void         thumbnail_generator::generate_all() { impl_->generate_all(); }
+std::wstring thumbnail_generator::find(const std::wstring& media_name) const { return impl_->find(media_name); }
+std::vector<thumbnail_info> thumbnail_generator::list() const { return impl_->list(); }
+
+}} // namespace caspar::core
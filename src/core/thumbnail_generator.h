@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "fwd.h"
+
+#include <common/memory.h>
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+
+struct thumbnail_info
+{
+    std::wstring name; // Upper case media name, as listed by CLS.
+    std::wstring path; // The png of the thumbnail.
+};
+
+// Renders thumbnails of the media folder with a producer and an image mixer of its own. Thumbnails are named by a hash
+// of the contents of the media file, so renamed and copied files keep theirs, and are rendered by threads below normal
+// priority from a bounded queue.
+class thumbnail_generator final
+{
+    thumbnail_generator(const thumbnail_generator&);
+    thumbnail_generator& operator=(const thumbnail_generator&);
+
+  public:
+    thumbnail_generator(std::unique_ptr<image_mixer>                          image_mixer,
+                        const video_format_desc&                              format_desc,
+                        const spl::shared_ptr<const frame_producer_registry>& producer_registry,
+                        const spl::shared_ptr<const frame_consumer_registry>& consumer_registry,
+                        const spl::shared_ptr<const cg_producer_registry>&    cg_registry,
+                        int                                                   threads,
+                        int                                                   max_queue);
+    ~thumbnail_generator();
+
+    // Renders the thumbnail of a media file unless its contents already have one. Throws user_error if the queue is
+    // full and file_not_found if there is no such media.
+    std::future<void> generate(const std::wstring& media_name);
+
+    // Queues every media file without a thumbnail, returns at once.
+    void generate_all();
+
+    // The thumbnail of a media file, empty if it has none.
+    std::wstring find(const std::wstring& media_name) const;
+
+    std::vector<thumbnail_info> list() const;
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+};
+
+}} // namespace caspar::core
@@ -25,6 +25,7 @@
 
 #include "video_format.h"
 
+#include "clock/clock.h"
 #include "consumer/output.h"
 #include "frame/draw_frame.h"
 #include "frame/frame.h"
@@ -33,18 +34,30 @@
 #include "mixer/mixer.h"
 #include "producer/stage.h"
 
+#include <common/array.h>
 #include <common/diagnostics/graph.h>
 #include <common/env.h>
 #include <common/executor.h>
 #include <common/future.h>
+#include <common/os/thread.h>
+#include <common/diagnostics/trace.h>
 #include <common/timer.h>
 
 #include <core/diagnostics/call_context.h>
 #include <core/mixer/image/image_mixer.h>
 
+#include <boost/circular_buffer.hpp>
+#include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/optional.hpp>
+#include <boost/property_tree/ptree.hpp>
 
+#include <chrono>
+#include <cstdlib>
+#include <limits>
 #include <mutex>
+#include <queue>
 #include <string>
 #include <unordered_map>
 
@@ -52,13 +65,20 @@ namespace caspar { namespace core {
 
 struct video_channel::impl final
 {
-    monitor::state state_;
+    mutable std::mutex state_mutex_;
+    monitor::state     state_;
 
     const int index_;
 
     mutable std::mutex      format_desc_mutex_;
     core::video_format_desc format_desc_;
 
+    // Video mode changes, see video_format_desc. The last switch is reported under format-switch.
+    const bool          keep_layers_ = env::properties().get(L"configuration.stage.keep-layers", false);
+    std::atomic<double> switch_prepare_time_{0.0};
+    double              switch_tick_time_ = 0.0;
+    std::int64_t        switch_frame_     = -1;
+
     const spl::shared_ptr<caspar::diagnostics::graph> graph_ = [](int index) {
         core::diagnostics::scoped_call_context save;
         core::diagnostics::call_context::for_thread().video_channel = index;
@@ -72,19 +92,87 @@ struct video_channel::impl final
 
     std::vector<int> audio_cadence_ = format_desc_.audio_cadence;
 
-    std::function<void(core::monitor::state)> tick_;
+    std::function<void(const core::monitor::state&)> tick_;
 
     std::map<int, std::weak_ptr<core::route>> routes_;
     std::mutex                                routes_mutex_;
 
+    struct produce_tick
+    {
+        core::video_format_desc            format_desc;
+        std::future<core::stage::frames_t> frames;
+        bool                               render;
+    };
+
+    // Counts of samples up to 100us, 250us, 500us, 1ms, 2ms, 5ms and above.
+    struct clock_histogram
+    {
+        std::vector<std::int64_t> counts = std::vector<std::int64_t>(7);
+
+        void add(std::chrono::nanoseconds value)
+        {
+            static const std::int64_t bounds[] = {100, 250, 500, 1000, 2000, 5000};
+
+            auto us = std::abs(std::chrono::duration_cast<std::chrono::microseconds>(value).count());
+            auto n  = std::size_t(0);
+            while (n < 6 && us > bounds[n]) {
+                ++n;
+            }
+            ++counts[n];
+        }
+    };
+
+    mutable std::mutex                     clock_mutex_;
+    std::shared_ptr<core::clock_scheduler> clock_;
+    boost::optional<clock_tick>            last_clock_tick_;
+    std::chrono::steady_clock::time_point  last_clock_time_;
+    clock_histogram                        phase_histogram_;
+    clock_histogram                        jitter_histogram_;
+
+    static constexpr std::int64_t no_reference = std::numeric_limits<std::int64_t>::min();
+    std::atomic<std::int64_t>     reference_offset_{no_reference};
+
+    // Timings of the last seconds of ticks, the "profile" entries of state_ interned by key.
+    typedef std::vector<std::pair<std::uint32_t, double>> profile_sample;
+
+    boost::container::flat_map<std::string, std::uint32_t> profile_keys_;
+    boost::circular_buffer<profile_sample>                 profile_;
+
+    std::atomic<int> pipeline_depth_{0};
+    std::atomic<int> frame_divisor_{1};
+
+    mutable std::mutex priorities_mutex_;
+    std::map<int, int> layer_priorities_;
+
+    // Load shedding, only used by the channel thread, see update_shedding.
+    struct shedding
+    {
+        int level    = 0;
+        int priority = std::numeric_limits<int>::min(); // Lower priorities are shed.
+        int over     = 0;                               // Consecutive overloaded ticks.
+        int under    = 0;                               // Consecutive ticks well within their time.
+        int hold     = 0; // Ticks before the next level is shed, to let the last one take effect.
+
+        boost::container::flat_set<int> layers;
+        int                              consumers = 0;
+    };
+    shedding shedding_;
+
+    executor consume_executor_{L"video_channel consume " + boost::lexical_cast<std::wstring>(index_)};
+
+    std::mutex        placement_mutex_;
+    std::wstring      affinity_;
+    bool              realtime_ = false;
+    std::atomic<bool> placement_changed_{false};
+
     std::atomic<bool> abort_request_{false};
     std::thread       thread_;
 
   public:
-    impl(int                                        index,
-         const core::video_format_desc&             format_desc,
-         std::unique_ptr<image_mixer>               image_mixer,
-         std::function<void(core::monitor::state)> tick)
+    impl(int                                               index,
+         const core::video_format_desc&                    format_desc,
+         std::unique_ptr<image_mixer>                      image_mixer,
+         std::function<void(const core::monitor::state&)> tick)
         : index_(index)
         , format_desc_(format_desc)
         , output_(graph_, format_desc, index)
@@ -97,71 +185,130 @@ struct video_channel::impl final
         graph_->set_color("mix-time", caspar::diagnostics::color(1.0f, 0.0f, 0.9f, 0.8f));
         graph_->set_color("consume-time", caspar::diagnostics::color(1.0f, 0.4f, 0.0f, 0.8f));
         graph_->set_color("osc-time", caspar::diagnostics::color(0.3f, 0.4f, 0.0f, 0.8f));
+        graph_->set_color("phase-error", caspar::diagnostics::color(0.6f, 0.3f, 0.9f));
+        graph_->set_color("tick-jitter", caspar::diagnostics::color(0.9f, 0.9f, 0.3f));
         graph_->set_text(print());
         caspar::diagnostics::register_graph(graph_);
 
+        auto history = env::properties().get(L"configuration.profiler.history", 10.0);
+        profile_.set_capacity(std::max<std::size_t>(1, static_cast<std::size_t>(history * format_desc_.fps)));
+
+        // Frames of the channel format are served from blocks which are mapped, and locked if configured, up front.
+        reserve_arrays(format_desc_.size, env::properties().get(L"configuration.memory.frames", 4));
+
         CASPAR_LOG(info) << print() << " Successfully Initialized.";
 
         thread_ = std::thread([=] {
+            boost::optional<produce_tick> produced;
+            std::queue<std::future<void>> consumed;
+            std::int64_t                  frame_number = 0;
+            auto                          last_format  = video_format_desc();
+
             while (!abort_request_) {
+                const auto                              frame = frame_number++;
+                caspar::diagnostics::trace::frame_scope trace_frame(frame);
+
                 try {
-                    core::video_format_desc format_desc;
-                    int                     nb_samples;
-                    {
-                        std::lock_guard<std::mutex> lock(format_desc_mutex_);
-                        format_desc = format_desc_;
-                        boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
-                        nb_samples = audio_cadence_.front();
+                    if (placement_changed_.exchange(false)) {
+                        place_thread();
                     }
 
+                    const auto depth = pipeline_depth_.load();
+
+                    wait_for_clock();
+
+                    // NOTE: Channel frames are produced in order, one stage tick each, so they are also the tick
+                    // numbers of the stage.
+                    reference_offset_ = last_clock_tick_ ? last_clock_tick_->frame - frame : no_reference;
+
                     // Produce
+                    if (!produced) {
+                        produced = produce(next_tick(), frame);
+                    }
+                    auto tick = std::move(*produced);
+                    produced.reset();
+
                     caspar::timer produce_timer;
-                    auto          stage_frames = stage_(format_desc, nb_samples);
-                    graph_->set_value("produce-time", produce_timer.elapsed() * format_desc.fps * 0.5);
+                    auto          stage_frames = [&] {
+                        caspar::diagnostics::trace::scope traced("video_channel::produce");
+                        return tick.frames.get();
+                    }();
+                    graph_->set_value("produce-time", produce_timer.elapsed() * tick.format_desc.fps * 0.5);
+
+                    // Pipelined mode starts producing the next tick while this one is mixed and consumed.
+                    if (depth > 0) {
+                        caspar::diagnostics::trace::frame_scope trace_next(frame + 1);
+                        produced = produce(next_tick(), frame + 1);
+                    }
 
                     // Mix
                     caspar::timer mix_timer;
-                    auto          mixed_frame = mixer_(stage_frames, format_desc, format_desc.audio_cadence[0]);
-                    graph_->set_value("mix-time", mix_timer.elapsed() * format_desc.fps * 0.5);
+                    auto          mixed_frame = [&] {
+                        caspar::diagnostics::trace::scope traced("video_channel::mix");
+                        return mixer_(stage_frames,
+                                      tick.format_desc,
+                                      tick.format_desc.audio_cadence[0],
+                                      output_.formats(),
+                                      output_.sizes(),
+                                      tick.render,
+                                      output_.host_image());
+                    }();
+                    graph_->set_value("mix-time", mix_timer.elapsed() * tick.format_desc.fps * 0.5);
+
+                    // NOTE: The first tick of a new video mode is the glitch of the switch, as anything which
+                    // was not prepared ahead of it is allocated and initialized while it is produced and mixed.
+                    if (tick.format_desc != last_format) {
+                        last_format       = tick.format_desc;
+                        switch_frame_     = frame;
+                        switch_tick_time_ = (produce_timer.elapsed() + mix_timer.elapsed()) * 1000.0;
+                        CASPAR_LOG(info) << print() << L" Switched video mode in " << switch_tick_time_ << L" ms.";
+                    }
+
+                    monitor::state state;
+                    update_shedding((produce_timer.elapsed() + mix_timer.elapsed()) * tick.format_desc.fps,
+                                    state);
+                    state["profile"]["produce-time"] = produce_timer.elapsed() * 1000.0;
+                    state["profile"]["mix-time"]     = mix_timer.elapsed() * 1000.0;
+                    state["stage"]               = stage_.state();
+                    state["mixer"]               = mixer_.state();
+                    state["pipeline"]["depth"]   = depth;
+                    state["pipeline"]["latency"] = depth > 0 ? depth + 1 : 0;
+                    if (last_clock_tick_) {
+                        state["clock"]["frame"]                 = last_clock_tick_->frame;
+                        state["clock"]["phase-error-histogram"] = phase_histogram_.counts;
+                        state["clock"]["tick-jitter-histogram"] = jitter_histogram_.counts;
+                    }
+                    if (switch_frame_ >= 0) {
+                        state["format-switch"]["frame"]        = switch_frame_;
+                        state["format-switch"]["prepare-time"] = switch_prepare_time_.load();
+                        state["format-switch"]["tick-time"]    = switch_tick_time_;
+                    }
+
+                    auto consume = [this,
+                                    frame,
+                                    mixed_frame  = std::move(mixed_frame),
+                                    stage_frames = std::move(stage_frames),
+                                    format_desc  = tick.format_desc,
+                                    state        = std::move(state)]() mutable {
+                        caspar::diagnostics::trace::frame_scope trace_frame(frame);
+                        caspar::diagnostics::trace::scope       traced("video_channel::consume");
+                        this->consume(std::move(mixed_frame), stage_frames, format_desc, std::move(state));
+                    };
 
                     // Consume
-                    caspar::timer consume_timer;
-                    output_(std::move(mixed_frame), format_desc);
-                    graph_->set_value("consume-time", consume_timer.elapsed() * format_desc.fps * 0.5);
-
-                    {
-                        std::vector<core::draw_frame> frames;
-
-                        std::lock_guard<std::mutex> lock(routes_mutex_);
-
-                        for (auto& p : stage_frames) {
-                            frames.push_back(p.second);
-
-                            auto it = routes_.find(p.first);
-                            if (it != routes_.end()) {
-                                auto route = it->second.lock();
-                                if (route) {
-                                    route->signal(draw_frame::pop(p.second));
-                                }
-                            }
-                        }
-
-                        auto it = routes_.find(-1);
-                        if (it != routes_.end()) {
-                            auto route = it->second.lock();
-                            if (route) {
-                                route->signal(core::draw_frame(std::move(frames)));
-                            }
-                        }
+                    if (depth > 0) {
+                        consumed.push(consume_executor_.begin_invoke(std::move(consume)));
+                    }
+
+                    while (consumed.size() > static_cast<std::size_t>(depth)) {
+                        auto future = std::move(consumed.front());
+                        consumed.pop();
+                        future.get();
+                    }
+
+                    if (depth == 0) {
+                        consume();
                     }
-                    state_           = {};
-                    state_["stage"] = stage_.state();
-                    state_["mixer"] = mixer_.state();
-                    state_["output"] = output_.state();
-
-                    caspar::timer osc_timer;
-                    tick_(state_);
-                    graph_->set_value("osc-time", osc_timer.elapsed() * format_desc.fps * 0.5);
                 } catch (...) {
                     CASPAR_LOG_CURRENT_EXCEPTION();
                 }
@@ -174,6 +321,240 @@ struct video_channel::impl final
         CASPAR_LOG(info) << print() << " Uninitializing.";
         abort_request_ = true;
         thread_.join();
+        consume_executor_.wait();
+    }
+
+    void wait_for_clock()
+    {
+        auto clock = this->clock();
+        if (!clock) {
+            last_clock_tick_.reset();
+            return;
+        }
+
+        const auto fps      = video_format_desc().fps;
+        const auto duration = std::chrono::nanoseconds(static_cast<std::int64_t>(1e9 / fps));
+
+        auto tick = clock->wait(duration);
+        auto now  = std::chrono::steady_clock::now();
+
+        phase_histogram_.add(tick.phase_error);
+        graph_->set_value("phase-error", std::abs(tick.phase_error.count()) * fps * 1e-9);
+
+        if (last_clock_tick_) {
+            const auto frames = tick.frame - last_clock_tick_->frame;
+            if (frames > 1) {
+                graph_->set_tag(caspar::diagnostics::tag_severity::WARNING, "dropped-tick");
+            }
+
+            // Deviation of the wake up interval from the boundaries which actually passed.
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_clock_time_);
+            auto jitter  = elapsed - duration * frames;
+            jitter_histogram_.add(jitter);
+            graph_->set_value("tick-jitter", std::abs(jitter.count()) * fps * 1e-9);
+        }
+
+        last_clock_tick_ = tick;
+        last_clock_time_ = now;
+    }
+
+    // Called with state_mutex_ held.
+    void record_profile()
+    {
+        profile_sample sample;
+        for (auto& p : state_) {
+            auto value = p.second.size() == 1 ? boost::get<double>(&p.second[0]) : nullptr;
+            if (!value || p.first.find("profile/") == std::string::npos) {
+                continue;
+            }
+
+            auto it = profile_keys_.find(p.first);
+            if (it == profile_keys_.end()) {
+                it = profile_keys_.emplace(p.first, static_cast<std::uint32_t>(profile_keys_.size())).first;
+            }
+            sample.emplace_back(it->second, *value);
+        }
+        profile_.push_back(std::move(sample));
+    }
+
+    // Last, average and maximum of every timing in the profile history.
+    monitor::state profile() const
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+
+        std::vector<double>      last(profile_keys_.size());
+        std::vector<double>      sum(profile_keys_.size());
+        std::vector<double>      max(profile_keys_.size());
+        std::vector<std::size_t> count(profile_keys_.size());
+
+        for (auto& sample : profile_) {
+            for (auto& value : sample) {
+                last[value.first] = value.second;
+                sum[value.first] += value.second;
+                max[value.first] = std::max(max[value.first], value.second);
+                count[value.first] += 1;
+            }
+        }
+
+        monitor::state result;
+        result["ticks"] = static_cast<std::int64_t>(profile_.size());
+        for (auto& key : profile_keys_) {
+            auto n = key.second;
+            if (count[n] > 0) {
+                result[key.first] = {last[n], sum[n] / static_cast<double>(count[n]), max[n]};
+            }
+        }
+        return result;
+    }
+
+    std::shared_ptr<core::clock_scheduler> clock() const
+    {
+        std::lock_guard<std::mutex> lock(clock_mutex_);
+        return clock_;
+    }
+
+    void clock(std::shared_ptr<core::clock_scheduler> clock)
+    {
+        {
+            std::lock_guard<std::mutex> lock(clock_mutex_);
+            clock_ = std::move(clock);
+        }
+        output_.externally_clocked(this->clock() != nullptr);
+    }
+
+    // NOTE: With a frame divisor of n, only every nth frame is rendered. The frames between still tick the stage and
+    // mix audio at the full rate, and repeat the last image.
+    produce_tick produce(std::pair<core::video_format_desc, int> tick, std::int64_t frame)
+    {
+        const auto divisor = frame_divisor_.load();
+        const auto render  = divisor <= 1 || frame % divisor == 0;
+        return produce_tick{tick.first, stage_(tick.first, tick.second, render, shedding_.layers), render};
+    }
+
+    // NOTE: Load is the produce and mix time of a tick as a share of the frame time. Consume time is left out, as it
+    // includes the pacing of the output. Once ticks stay overloaded, the next lowest negative priority is shed, and a
+    // level is only dropped again after two seconds of ticks well within their time.
+    void update_shedding(double load, monitor::state& state)
+    {
+        const auto fps = video_format_desc().fps;
+
+        auto& shed = shedding_;
+        shed.over  = load > 0.9 ? shed.over + 1 : 0;
+        shed.under = load < 0.6 ? shed.under + 1 : 0;
+        shed.hold  = std::max(0, shed.hold - 1);
+
+        std::map<int, int> layer_priorities;
+        {
+            std::lock_guard<std::mutex> lock(priorities_mutex_);
+            layer_priorities = layer_priorities_;
+        }
+
+        auto priorities = output_.shed_priorities();
+        for (auto& p : layer_priorities) {
+            if (p.second < 0) {
+                priorities.push_back(p.second);
+            }
+        }
+        std::sort(priorities.begin(), priorities.end());
+        priorities.erase(std::unique(priorities.begin(), priorities.end()), priorities.end());
+
+        auto level = std::min(shed.level, static_cast<int>(priorities.size()));
+        if (shed.over >= 3 && shed.hold == 0 && level < static_cast<int>(priorities.size())) {
+            level += 1;
+            shed.over = 0;
+            shed.hold = static_cast<int>(fps / 2);
+        } else if (shed.under >= static_cast<int>(fps * 2) && level > 0) {
+            level -= 1;
+            shed.under = 0;
+        }
+
+        const auto priority = level > 0 ? priorities[level - 1] + 1 : std::numeric_limits<int>::min();
+
+        shed.layers.clear();
+        for (auto& p : layer_priorities) {
+            if (p.second < priority) {
+                shed.layers.insert(p.first);
+            }
+        }
+
+        if (priority != shed.priority) {
+            shed.consumers = output_.shed(priority);
+            if (level == 0) {
+                CASPAR_LOG(info) << print() << L" Load recovered, nothing is shed.";
+            } else if (level > shed.level) {
+                CASPAR_LOG(warning) << print() << L" Overloaded at " << static_cast<int>(load * 100.0)
+                                    << L"% of the frame time, shedding priorities below " << priority << L": "
+                                    << shed.layers.size() << L" layers and " << shed.consumers << L" consumers.";
+            } else {
+                CASPAR_LOG(info) << print() << L" Shedding priorities below " << priority << L": "
+                                 << shed.layers.size() << L" layers and " << shed.consumers << L" consumers.";
+            }
+        }
+        shed.level    = level;
+        shed.priority = priority;
+
+        state["shedding"]["level"]     = level;
+        state["shedding"]["load"]      = load;
+        state["shedding"]["layers"]    = static_cast<int>(shed.layers.size());
+        state["shedding"]["consumers"] = shed.consumers;
+        if (level > 0) {
+            state["shedding"]["priority"] = priority;
+        }
+    }
+
+    std::pair<core::video_format_desc, int> next_tick()
+    {
+        std::lock_guard<std::mutex> lock(format_desc_mutex_);
+        boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
+        return std::make_pair(format_desc_, audio_cadence_.front());
+    }
+
+    void consume(core::const_frame              mixed_frame,
+                 const core::stage::frames_t&   stage_frames,
+                 const core::video_format_desc& format_desc,
+                 monitor::state                 state)
+    {
+        caspar::timer consume_timer;
+        output_(std::move(mixed_frame), format_desc);
+        graph_->set_value("consume-time", consume_timer.elapsed() * format_desc.fps * 0.5);
+        state["profile"]["consume-time"] = consume_timer.elapsed() * 1000.0;
+
+        {
+            std::vector<core::draw_frame> frames;
+
+            std::lock_guard<std::mutex> lock(routes_mutex_);
+
+            for (auto& p : stage_frames) {
+                frames.push_back(p.second);
+
+                auto it = routes_.find(p.first);
+                if (it != routes_.end()) {
+                    auto route = it->second.lock();
+                    if (route) {
+                        route->signal(draw_frame::pop(p.second));
+                    }
+                }
+            }
+
+            auto it = routes_.find(-1);
+            if (it != routes_.end()) {
+                auto route = it->second.lock();
+                if (route) {
+                    route->signal(core::draw_frame(std::move(frames)));
+                }
+            }
+        }
+
+        state["output"] = output_.state();
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_.update(std::move(state));
+            record_profile();
+        }
+
+        caspar::timer osc_timer;
+        tick_(state_);
+        graph_->set_value("osc-time", osc_timer.elapsed() * format_desc.fps * 0.5);
     }
 
     std::shared_ptr<core::route> route(int index = -1)
@@ -187,6 +568,7 @@ struct video_channel::impl final
             route->name        = boost::lexical_cast<std::wstring>(index_);
             if (index != -1) {
                 route->name += L"/" + boost::lexical_cast<std::wstring>(index);
+                stage_.keep_rendering(index);
             }
             routes_[index] = route;
         }
@@ -200,12 +582,29 @@ struct video_channel::impl final
         return format_desc_;
     }
 
+    // NOTE: The textures and buffers of the new mode are allocated while the channel keeps running in the old one,
+    // which then switches at the start of the next tick. Layers are cleared unless keep-layers is configured, in which
+    // case their frames are scaled to the new mode, but producers keep the frame rate they were created for.
     void video_format_desc(const core::video_format_desc& format_desc)
     {
+        caspar::timer prepare_timer;
+        try {
+            image_mixer_->prepare(format_desc).get();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+        switch_prepare_time_ = prepare_timer.elapsed() * 1000.0;
+
         std::lock_guard<std::mutex> lock(format_desc_mutex_);
-        format_desc_   = format_desc;
-        audio_cadence_ = format_desc_.audio_cadence;
-        stage_.clear();
+
+        // The audio layout is a property of the channel, which is kept across video modes.
+        auto audio_channels         = format_desc_.audio_channels;
+        format_desc_                = format_desc;
+        format_desc_.audio_channels = audio_channels;
+        audio_cadence_              = format_desc_.audio_cadence;
+        if (!keep_layers_) {
+            stage_.clear();
+        }
     }
 
     std::wstring print() const
@@ -214,12 +613,59 @@ struct video_channel::impl final
     }
 
     int index() const { return index_; }
+
+    int pipeline_depth() const { return pipeline_depth_; }
+
+    void pipeline_depth(int depth) { pipeline_depth_ = std::max(0, depth); }
+
+    int frame_divisor() const { return frame_divisor_; }
+
+    void frame_divisor(int divisor) { frame_divisor_ = std::max(1, divisor); }
+
+    int layer_priority(int layer) const
+    {
+        std::lock_guard<std::mutex> lock(priorities_mutex_);
+        auto                        it = layer_priorities_.find(layer);
+        return it != layer_priorities_.end() ? it->second : 0;
+    }
+
+    void layer_priority(int layer, int priority)
+    {
+        std::lock_guard<std::mutex> lock(priorities_mutex_);
+        if (priority == 0) {
+            layer_priorities_.erase(layer);
+        } else {
+            layer_priorities_[layer] = priority;
+        }
+    }
+
+    void thread_placement(const std::wstring& affinity, bool realtime)
+    {
+        {
+            std::lock_guard<std::mutex> lock(placement_mutex_);
+            affinity_ = affinity;
+            realtime_ = realtime;
+        }
+        placement_changed_ = true;
+
+        consume_executor_.begin_invoke([this] { place_thread(); });
+        stage_.thread_placement(affinity, realtime);
+    }
+
+    void place_thread()
+    {
+        std::lock_guard<std::mutex> lock(placement_mutex_);
+        set_thread_affinity(affinity_);
+        if (realtime_) {
+            set_thread_realtime_priority();
+        }
+    }
 };
 
-video_channel::video_channel(int                                        index,
-                             const core::video_format_desc&             format_desc,
-                             std::unique_ptr<image_mixer>               image_mixer,
-                             std::function<void(core::monitor::state)> tick)
+video_channel::video_channel(int                                               index,
+                             const core::video_format_desc&                    format_desc,
+                             std::unique_ptr<image_mixer>                      image_mixer,
+                             std::function<void(const core::monitor::state&)> tick)
     : impl_(new impl(index, format_desc, std::move(image_mixer), tick))
 {
 }
@@ -237,7 +683,36 @@ void                           core::video_channel::video_format_desc(const core
     impl_->video_format_desc(format_desc);
 }
 int                   video_channel::index() const { return impl_->index(); }
-core::monitor::state video_channel::state() const { return impl_->state_; }
+int                   video_channel::pipeline_depth() const { return impl_->pipeline_depth(); }
+void                  video_channel::pipeline_depth(int depth) { impl_->pipeline_depth(depth); }
+int                   video_channel::frame_divisor() const { return impl_->frame_divisor(); }
+void                  video_channel::frame_divisor(int divisor) { impl_->frame_divisor(divisor); }
+int                   video_channel::layer_priority(int layer) const { return impl_->layer_priority(layer); }
+void video_channel::layer_priority(int layer, int priority) { impl_->layer_priority(layer, priority); }
+void video_channel::thread_placement(const std::wstring& affinity, bool realtime)
+{
+    impl_->thread_placement(affinity, realtime);
+}
+core::monitor::state video_channel::state() const
+{
+    std::lock_guard<std::mutex> lock(impl_->state_mutex_);
+    return impl_->state_;
+}
+std::uint64_t video_channel::state_revision() const
+{
+    std::lock_guard<std::mutex> lock(impl_->state_mutex_);
+    return impl_->state_.revision();
+}
+core::monitor::state video_channel::profile() const { return impl_->profile(); }
+
+std::shared_ptr<clock_scheduler> video_channel::clock() const { return impl_->clock(); }
+void video_channel::clock(std::shared_ptr<clock_scheduler> clock) { impl_->clock(std::move(clock)); }
+
+boost::optional<std::int64_t> video_channel::reference_offset() const
+{
+    auto offset = impl_->reference_offset_.load();
+    return offset == impl::no_reference ? boost::none : boost::make_optional(offset);
+}
 
 std::shared_ptr<route> video_channel::route(int index) { return impl_->route(index); }
 
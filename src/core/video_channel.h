@@ -29,8 +29,10 @@
 #include <common/forward.h>
 #include <common/memory.h>
 
+#include <boost/optional.hpp>
 #include <boost/signals2.hpp>
 
+#include <cstdint>
 #include <functional>
 
 namespace caspar { namespace core {
@@ -55,14 +57,21 @@ class video_channel final
     video_channel& operator=(const video_channel&);
 
   public:
-    explicit video_channel(int                                        index,
-                           const video_format_desc&                   format_desc,
-                           std::unique_ptr<image_mixer>               image_mixer,
-                           std::function<void(core::monitor::state)> on_tick);
+    explicit video_channel(int                                               index,
+                           const video_format_desc&                          format_desc,
+                           std::unique_ptr<image_mixer>                      image_mixer,
+                           std::function<void(const core::monitor::state&)> on_tick);
     ~video_channel();
 
     core::monitor::state state() const;
 
+    // The revision of state(), which changes with every tick that changes an entry of it.
+    std::uint64_t state_revision() const;
+
+    // Last, average and maximum in milliseconds of the per tick timings in the channel state, over the last
+    // configuration.profiler.history seconds.
+    core::monitor::state profile() const;
+
     const core::stage&  stage() const;
     core::stage&        stage();
     const core::mixer&  mixer() const;
@@ -77,6 +86,30 @@ class video_channel final
 
     int index() const;
 
+    int  pipeline_depth() const;
+    void pipeline_depth(int depth);
+
+    // Renders only every nth frame, the frames between repeat the last image while audio is still mixed every frame.
+    int  frame_divisor() const;
+    void frame_divisor(int divisor);
+
+    // Layers of negative priority, like consumers of negative priority, see port_settings::priority, are shed in
+    // priority order, lowest first, while the produce and mix time of the channel's ticks overruns the frame time.
+    int  layer_priority(int layer) const;
+    void layer_priority(int layer, int priority);
+
+    // Pins the tick, stage and consume threads of the channel to a set of cpus, see set_thread_affinity, and
+    // optionally schedules them in real-time.
+    void thread_placement(const std::wstring& affinity, bool realtime);
+
+    // Paces the channel on the frame boundaries of a reference clock instead of its consumers or the output.
+    std::shared_ptr<core::clock_scheduler> clock() const;
+    void                                   clock(std::shared_ptr<core::clock_scheduler> clock);
+
+    // The frame boundary number on the reference clock less the tick number of the stage, as of the last tick, or
+    // none if the channel is not paced by a clock. Servers sharing a reference act on the same frame through it.
+    boost::optional<std::int64_t> reference_offset() const;
+
     std::shared_ptr<core::route> route(int index = -1);
 
   private:
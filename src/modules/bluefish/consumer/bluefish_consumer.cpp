@@ -32,20 +32,22 @@
 #include <common/diagnostics/graph.h>
 #include <common/executor.h>
 #include <common/param.h>
+#include <common/scope_exit.h>
 #include <common/timer.h>
 
 #include <boost/property_tree/ptree.hpp>
 #include <boost/range/algorithm.hpp>
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
 #include <future>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 namespace caspar { namespace bluefish {
 
-#define BLUEFISH_MAX_SOFTWARE_BUFFERS 4
 #define SIZE_TEMP_AUDIO_BUFFER                                                                                         \
     (2048 * 16) // max 2002 samples across 16 channels, use 2048 for safety cos sometimes caspar gives us too many...
 
@@ -79,6 +81,7 @@ struct configuration
     hardware_downstream_keyer_audio_source keyer_audio_source =
         hardware_downstream_keyer_audio_source::VideoOutputChannel;
     unsigned int watchdog_timeout = 2;
+    unsigned int buffer_depth     = 4;
 };
 
 bool get_videooutput_channel_routing_info_from_streamid(bluefish_hardware_output_channel streamid,
@@ -149,12 +152,23 @@ struct bluefish_consumer : boost::noncopyable
     unsigned int mode_; // ie bf video mode / format
     bool         interlaced_ = false;
 
-    std::array<blue_dma_buffer_ptr, BLUEFISH_MAX_SOFTWARE_BUFFERS> all_frames_;
-    tbb::concurrent_bounded_queue<blue_dma_buffer_ptr>             reserved_frames_;
-    tbb::concurrent_bounded_queue<blue_dma_buffer_ptr>             live_frames_;
+    // A buffer that is ready to be transferred to the card.
+    struct live_frame
+    {
+        blue_dma_buffer_ptr buffer;
+        // NOTE: The image is transferred straight from the frame's read back buffer when the mixer has produced one
+        // of the right size, the frame holds it until the transfer has completed.
+        core::const_frame frame;
+        const uint8_t*    image = nullptr;
+    };
+
+    std::vector<blue_dma_buffer_ptr>                   all_frames_;
+    tbb::concurrent_bounded_queue<blue_dma_buffer_ptr> reserved_frames_;
+    tbb::concurrent_bounded_queue<live_frame>          live_frames_;
 
     std::atomic<int64_t> audio_frames_filled_{0};
     blue_dma_buffer_ptr  last_field_buf_ = nullptr;
+    core::const_frame    first_field_;
 
     std::vector<uint32_t> tmp_audio_buf_;
     unsigned int          tmp_audio_buf_contains_samples = 0;
@@ -182,12 +196,14 @@ struct bluefish_consumer : boost::noncopyable
         graph_->set_color("flushed-frame", diagnostics::color(0.4f, 0.3f, 0.8f));
         graph_->set_color("buffered-audio", diagnostics::color(0.9f, 0.9f, 0.5f));
         graph_->set_color("buffered-video", diagnostics::color(0.2f, 0.9f, 0.9f));
+        graph_->set_color("dma-wait", diagnostics::color(0.9f, 0.4f, 0.0f));
 
         graph_->set_text(print());
         diagnostics::register_graph(graph_);
 
-        reserved_frames_.set_capacity(BLUEFISH_MAX_SOFTWARE_BUFFERS);
-        live_frames_.set_capacity(BLUEFISH_MAX_SOFTWARE_BUFFERS);
+        const auto buffer_depth = static_cast<int>(std::max(config_.buffer_depth, 2u));
+        reserved_frames_.set_capacity(buffer_depth);
+        live_frames_.set_capacity(buffer_depth);
 
         // get BF video mode
         mode_ = get_bluefish_video_format(format_desc_.format);
@@ -258,12 +274,10 @@ struct bluefish_consumer : boost::noncopyable
 
         // ok here we create a bunch of Bluefish buffers, that contain video and encoded hanc....
         // this is the software Q. / software buffers
-        int n = 0;
-        boost::range::generate(
-            all_frames_, [&] { return std::make_shared<blue_dma_buffer>(static_cast<int>(format_desc_.size), n++); });
-
-        for (size_t i = 0; i < all_frames_.size(); i++)
-            reserved_frames_.push(all_frames_[i]);
+        for (int n = 0; n < buffer_depth; ++n) {
+            all_frames_.push_back(std::make_shared<blue_dma_buffer>(static_cast<int>(format_desc_.size), n));
+            reserved_frames_.push(all_frames_.back());
+        }
 
         tmp_audio_buf_.reserve(SIZE_TEMP_AUDIO_BUFFER);
 
@@ -588,6 +602,8 @@ struct bluefish_consumer : boost::noncopyable
         return !abort_request_;
     }
 
+    // Transfers are started before waiting for the next sync and presented after it, so the card copies a frame
+    // while this thread waits. The time presenting still waits for a transfer after the sync is shown as dma-wait.
     void dma_present_thread_actual()
     {
         bvc_wrapper wait_b;
@@ -598,36 +614,53 @@ struct bluefish_consumer : boost::noncopyable
         unsigned long buffer_id        = 0;
         unsigned long underrun         = 0;
 
+        OVERLAPPED image_overlap = {};
+        OVERLAPPED hanc_overlap  = {};
+        image_overlap.hEvent     = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+        hanc_overlap.hEvent      = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+        CASPAR_SCOPE_EXIT
+        {
+            CloseHandle(image_overlap.hEvent);
+            CloseHandle(hanc_overlap.hEvent);
+        };
+
+        live_frame    pending;
+        unsigned long pending_id = 0;
+
+        auto wait_for_transfer = [&] {
+            HANDLE events[] = {image_overlap.hEvent, hanc_overlap.hEvent};
+            WaitForMultipleObjects(config_.embedded_audio ? 2 : 1, events, TRUE, 1000);
+        };
+
         while (!abort_request_) {
-            blue_dma_buffer_ptr buf = nullptr;
-            if (live_frames_.try_pop(buf) && BLUE_OK(blue_->video_playback_allocate(buffer_id, underrun))) {
-                // Send and display
-                if (config_.embedded_audio) {
-                    // Do video first, then do hanc DMA...
-                    blue_->system_buffer_write(const_cast<uint8_t*>(buf->image_data()),
-                                               static_cast<unsigned long>(buf->image_size()),
-                                               BlueImage_HANC_DMABuffer(buffer_id, BLUE_DATA_IMAGE),
-                                               0);
-
-                    blue_->system_buffer_write(buf->hanc_data(),
-                                               static_cast<unsigned long>(buf->hanc_size()),
-                                               BlueImage_HANC_DMABuffer(buffer_id, BLUE_DATA_HANC),
-                                               0);
-
-                    if (BLUE_FAIL(blue_->video_playback_present(BlueBuffer_Image_HANC(buffer_id), 1, 0, 0)))
-                        CASPAR_LOG(warning) << print() << TEXT(" video_playback_present failed.");
-                } else {
-                    blue_->system_buffer_write(const_cast<uint8_t*>(buf->image_data()),
-                                               static_cast<unsigned long>(buf->image_size()),
-                                               BlueImage_DMABuffer(buffer_id, BLUE_DATA_IMAGE),
-                                               0);
+            live_frame next;
+            if (live_frames_.try_pop(next)) {
+                if (BLUE_OK(blue_->video_playback_allocate(buffer_id, underrun))) {
+                    ResetEvent(image_overlap.hEvent);
+                    ResetEvent(hanc_overlap.hEvent);
+
+                    auto image = const_cast<uint8_t*>(next.image);
+                    auto size  = static_cast<unsigned long>(next.buffer->image_size());
+                    if (config_.embedded_audio) {
+                        // Do video first, then do hanc DMA...
+                        blue_->system_buffer_write_async(
+                            image, size, &image_overlap, BlueImage_HANC_DMABuffer(buffer_id, BLUE_DATA_IMAGE), 0);
+
+                        blue_->system_buffer_write_async(next.buffer->hanc_data(),
+                                                         static_cast<unsigned long>(next.buffer->hanc_size()),
+                                                         &hanc_overlap,
+                                                         BlueImage_HANC_DMABuffer(buffer_id, BLUE_DATA_HANC),
+                                                         0);
+                    } else {
+                        blue_->system_buffer_write_async(
+                            image, size, &image_overlap, BlueImage_DMABuffer(buffer_id, BLUE_DATA_IMAGE), 0);
+                    }
 
-                    if (BLUE_FAIL(blue_->video_playback_present(BlueBuffer_Image(buffer_id), 1, 0, 0)))
-                        CASPAR_LOG(warning) << print() << TEXT(" video_playback_present failed.");
+                    pending    = std::move(next);
+                    pending_id = buffer_id;
+                } else {
+                    reserved_frames_.push(next.buffer);
                 }
-
-                scheduled_frames_completed_++;
-                reserved_frames_.push(buf);
             }
 
             {
@@ -638,6 +671,23 @@ struct bluefish_consumer : boost::noncopyable
                 sync_timer_.restart();
             }
 
+            if (pending.buffer) {
+                caspar::timer dma_timer;
+                wait_for_transfer();
+                graph_->set_value("dma-wait", dma_timer.elapsed() * format_desc_.fps * 0.5);
+
+                auto id = config_.embedded_audio ? BlueBuffer_Image_HANC(pending_id) : BlueBuffer_Image(pending_id);
+                if (BLUE_FAIL(blue_->video_playback_present(id, 1, 0, 0)))
+                    CASPAR_LOG(warning) << print() << TEXT(" video_playback_present failed.");
+
+                scheduled_frames_completed_++;
+                reserved_frames_.push(pending.buffer);
+                pending = live_frame{};
+            }
+
+            graph_->set_value("buffered-video",
+                              static_cast<double>(live_frames_.size()) / static_cast<double>(live_frames_.capacity()));
+
             if (frames_to_buffer > 0) {
                 frames_to_buffer--;
                 if (frames_to_buffer == 0) {
@@ -646,6 +696,12 @@ struct bluefish_consumer : boost::noncopyable
                 }
             }
         }
+
+        // NOTE: The memory of a transfer in flight must outlive it.
+        if (pending.buffer) {
+            wait_for_transfer();
+        }
+
         wait_b.detach();
         blue_->video_playback_stop(0, 0);
     }
@@ -659,12 +715,8 @@ struct bluefish_consumer : boost::noncopyable
             if (!last_field_buf_) // field 1
             {
                 if (reserved_frames_.try_pop(last_field_buf_)) {
-                    // copy video data into holding buf
-                    void* dest = last_field_buf_->image_data();
-                    if (frame.image_data(0).size()) {
-                        std::memcpy(dest, frame.image_data(0).begin(), frame.image_data(0).size());
-                    } else
-                        std::memset(dest, 0, last_field_buf_->image_size());
+                    // the video is copied with the second field
+                    first_field_ = frame;
 
                     // now copy Some of the Audio bytes that we need
                     if (config_.embedded_audio) {
@@ -677,7 +729,21 @@ struct bluefish_consumer : boost::noncopyable
                 }
             } else // field 2
             {
-                // we have already done the video... just grab the last bit of audio, encode and push to Q.
+                // NOTE: The mixer weaves every frame of an interlaced channel with the one before it, so this frame
+                // holds both fields. Frames mixed before the consumer was added only hold the first field's frame.
+                live_frame  live{last_field_buf_, {}, last_field_buf_->image_data()};
+                void*       dest  = last_field_buf_->image_data();
+                const auto& woven = frame.image_data(core::output_format::bgra);
+                if (woven.size() >= last_field_buf_->image_size()) {
+                    live.frame = frame;
+                    live.image = woven.begin();
+                } else if (first_field_.image_data(0).size()) {
+                    std::memcpy(dest, first_field_.image_data(0).begin(), first_field_.image_data(0).size());
+                } else
+                    std::memset(dest, 0, last_field_buf_->image_size());
+                first_field_ = core::const_frame{};
+
+                // just grab the last bit of audio, encode and push to Q.
                 if (config_.embedded_audio) {
                     auto audio_size = frame.audio_data().size() * 4;
                     if (audio_size) {
@@ -692,7 +758,7 @@ struct bluefish_consumer : boost::noncopyable
                     }
                 }
                 // push to in use Q.
-                live_frames_.push(last_field_buf_);
+                live_frames_.push(std::move(live));
                 last_field_buf_ = nullptr;
                 tmp_audio_buf_.clear();
             }
@@ -700,11 +766,14 @@ struct bluefish_consumer : boost::noncopyable
             blue_dma_buffer_ptr buf = nullptr;
             // Copy to local buffers
             if (reserved_frames_.try_pop(buf)) {
-                void* dest = buf->image_data();
-                if (frame.image_data(0).size())
-                    std::memcpy(dest, frame.image_data(0).begin(), frame.image_data(0).size());
-                else
-                    std::memset(dest, 0, buf->image_size());
+                live_frame live{buf, {}, buf->image_data()};
+                if (frame.image_data(0).size() >= buf->image_size()) {
+                    live.frame = frame;
+                    live.image = frame.image_data(0).begin();
+                } else if (frame.image_data(0).size()) {
+                    std::memcpy(buf->image_data(), frame.image_data(0).begin(), frame.image_data(0).size());
+                } else
+                    std::memset(buf->image_data(), 0, buf->image_size());
 
                 // encode and copy hanc data
                 if (config_.embedded_audio) {
@@ -717,7 +786,7 @@ struct bluefish_consumer : boost::noncopyable
                     }
                 }
                 // push to in use Q.
-                live_frames_.push(buf);
+                live_frames_.push(std::move(live));
             }
         }
 
@@ -810,6 +879,8 @@ struct bluefish_consumer_proxy : public core::frame_consumer
     int index() const override { return 400 + config_.device_index; }
 
     bool has_synchronization_clock() const override { return true; }
+
+    bool interlaced() const override { return true; }
 };
 
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                  params,
@@ -894,6 +965,7 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
 
     auto watchdog_timeout   = ptree.get(L"watchdog", 2);
     config.watchdog_timeout = watchdog_timeout;
+    config.buffer_depth     = ptree.get(L"buffer-depth", config.buffer_depth);
 
     return spl::make_shared<bluefish_consumer_proxy>(config);
 }
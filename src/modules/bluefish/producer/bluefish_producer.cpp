@@ -44,6 +44,7 @@
 #include <core/frame/frame.h>
 #include <core/frame/frame_factory.h>
 #include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
 #include <core/mixer/audio/audio_mixer.h>
 #include <core/monitor/monitor.h>
 #include <core/producer/frame_producer.h>
@@ -147,7 +148,7 @@ struct bluefish_producer : boost::noncopyable
     const int                    stream_index_;
     spl::shared_ptr<bvc_wrapper> blue_;
 
-    core::monitor::state                state_;
+    core::monitor::state                state_;
     mutable std::mutex                  state_mutex_;
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
@@ -174,7 +175,11 @@ struct bluefish_producer : boost::noncopyable
 
     struct hanc_decode_struct hanc_decode_struct_;
     std::vector<uint32_t>     decoded_audio_bytes_;
+    const core::pixel_format  pixel_format_;
     unsigned int              memory_format_on_card_;
+
+    // NOTE: Video is transferred from the card straight into a frame, and converted by the mixer.
+    std::unique_ptr<core::mutable_frame> captured_frame_;
     int                       frames_captured = 0;
     uint64_t                  capture_ts      = 0;
 
@@ -182,13 +187,15 @@ struct bluefish_producer : boost::noncopyable
     bluefish_producer(const core::video_format_desc&              format_desc,
                       int                                         device_index,
                       int                                         stream_index,
-                      const spl::shared_ptr<core::frame_factory>& frame_factory)
+                      const spl::shared_ptr<core::frame_factory>& frame_factory,
+                      core::pixel_format                          pixel_format)
         : blue_(create_blue(device_index))
         , device_index_(device_index)
         , stream_index_(stream_index)
         , frame_factory_(frame_factory)
         , model_name_(get_card_desc(*blue_, device_index))
-        , memory_format_on_card_(MEM_FMT_RGB)
+        , pixel_format_(pixel_format)
+        , memory_format_on_card_(get_memory_format(pixel_format))
     {
         mode_ = static_cast<unsigned int>(VID_FMT_INVALID);
         frame_buffer_.set_capacity(2);
@@ -240,11 +247,9 @@ struct bluefish_producer : boost::noncopyable
                 *blue_, static_cast<EVideoMode>(mode_), static_cast<EMemoryFormat>(memory_format_on_card_));
             audio_cadence_ = format_desc_.audio_cadence;
 
-            // Generate dma buffers
+            // Generate dma buffers, the video is transferred into frames.
             int n = 0;
-            boost::range::generate(reserved_frames_, [&] {
-                return std::make_shared<blue_dma_buffer>(static_cast<int>(format_desc_.size), n++);
-            });
+            boost::range::generate(reserved_frames_, [&] { return std::make_shared<blue_dma_buffer>(0, n++); });
 
             // Set Video Engine
             if (BLUE_FAIL(blue_->set_card_property32(VIDEO_INPUT_ENGINE, VIDEO_ENGINE_FRAMESTORE)))
@@ -254,6 +259,36 @@ struct bluefish_producer : boost::noncopyable
         }
     }
 
+    static unsigned int get_memory_format(core::pixel_format pixel_format)
+    {
+        switch (pixel_format) {
+            case core::pixel_format::uyvy:
+                return MEM_FMT_2VUY;
+            case core::pixel_format::v210:
+                return MEM_FMT_V210;
+            default:
+                return MEM_FMT_RGB;
+        }
+    }
+
+    // The layout of a captured frame, with rows as long as the card transfers them.
+    core::pixel_format_desc get_pixel_format_desc() const
+    {
+        unsigned int width = 0, height = 0, rate = 0, is_1001 = 0, is_progressive = 0, image_size = 0;
+        blue_->get_frame_info_for_video_mode(mode_, width, height, rate, is_1001, is_progressive);
+        blue_->get_bytes_per_frame(static_cast<EVideoMode>(mode_),
+                                   static_cast<EMemoryFormat>(memory_format_on_card_),
+                                   UPD_FMT_FRAME,
+                                   image_size);
+
+        const auto stride    = pixel_format_ == core::pixel_format::rgb ? 3 : 4;
+        const auto row_bytes = height > 0 ? static_cast<int>(image_size / height) : 0;
+
+        auto desc = core::pixel_format_desc(pixel_format_);
+        desc.planes.push_back(core::pixel_format_desc::plane(row_bytes / stride, static_cast<int>(height), stride));
+        return desc;
+    }
+
     int configure_input_routing(const unsigned int bf_channel, bool dual_link)
     {
         unsigned int routing_value   = 0;
@@ -339,8 +374,8 @@ struct bluefish_producer : boost::noncopyable
             fps = (rate * 1000) / 1001;
 
         CASPAR_SCOPE_EXIT
-        {
-            {
+        {
+            {
                 std::lock_guard<std::mutex> lock(state_mutex_);
                 state_["file/name"]              = model_name_;
                 state_["file/path"]              = device_index_;
@@ -362,24 +397,22 @@ struct bluefish_producer : boost::noncopyable
             graph_->set_value("tick-time", tick_timer_.elapsed() * fps * 0.5);
             tick_timer_.restart();
             {
-                auto src_video = alloc_frame();
                 auto src_audio = alloc_frame();
 
                 // video
-                src_video->format                 = AV_PIX_FMT_RGB24;
-                src_video->width                  = width;
-                src_video->height                 = height;
-                src_video->interlaced_frame       = !is_progressive;
-                src_video->top_field_first        = (height != 486);
-                src_video->key_frame              = 1;
-                src_video->display_picture_number = frames_captured;
-                src_video->pts                    = capture_ts;
-
-                void* video_bytes = nullptr;
-                video_bytes       = reserved_frames_.front()->image_data();
-                if (reserved_frames_.front() && video_bytes) {
-                    src_video->data[0]     = reinterpret_cast<uint8_t*>(reserved_frames_.front()->image_data());
-                    src_video->linesize[0] = static_cast<int>(image_size / height);
+                auto video = core::draw_frame{};
+                if (captured_frame_) {
+                    const auto image = core::const_frame(std::move(*captured_frame_));
+                    captured_frame_.reset();
+                    video = core::draw_frame(image);
+
+                    // NOTE: v210 rows are padded to whole groups of 48 pixels, the padding is scaled out of view.
+                    const auto padded_width = pixel_format_ == core::pixel_format::v210
+                                                  ? static_cast<int>(image.width()) * 3 / 2
+                                                  : static_cast<int>(width);
+                    if (padded_width != static_cast<int>(width) && width > 0) {
+                        video.transform().image_transform.fill_scale[0] = static_cast<double>(padded_width) / width;
+                    }
                 }
 
                 // Audio
@@ -410,7 +443,8 @@ struct bluefish_producer : boost::noncopyable
                 }
 
                 // pass to caspar
-                auto frame = core::draw_frame(make_frame(this, *frame_factory_, src_video, src_audio));
+                auto frame = core::draw_frame::over(
+                    std::move(video), core::draw_frame(make_frame(this, *frame_factory_, nullptr, src_audio)));
                 if (!frame_buffer_.try_push(frame)) {
                     core::draw_frame dummy;
                     frame_buffer_.try_pop(dummy);
@@ -430,9 +464,11 @@ struct bluefish_producer : boost::noncopyable
     void grab_frame_from_bluefishcard()
     {
         try {
-            if (reserved_frames_.front()->image_data()) {
-                blue_->system_buffer_read(const_cast<uint8_t*>(reserved_frames_.front()->image_data()),
-                                          static_cast<unsigned long>(reserved_frames_.front()->image_size()),
+            const auto desc = get_pixel_format_desc();
+            if (desc.planes[0].size > 0) {
+                captured_frame_.reset(new core::mutable_frame(frame_factory_->create_frame(this, desc)));
+                blue_->system_buffer_read(captured_frame_->image_data(0).begin(),
+                                          static_cast<unsigned long>(desc.planes[0].size),
                                           BlueImage_DMABuffer(dma_ready_captured_frame_id_, BLUE_DATA_IMAGE),
                                           0);
             }
@@ -523,10 +559,10 @@ struct bluefish_producer : boost::noncopyable
         return model_name_ + L" [" + boost::lexical_cast<std::wstring>(device_index_) + L"|" + format_desc_.name + L"]";
     }
 
-    core::monitor::state state() const
-    {
-        std::lock_guard<std::mutex> lock(state_mutex_);
-        return state_;
+    core::monitor::state state() const
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
     }
 
     boost::rational<int> get_out_framerate() const { return format_desc_.framerate; }
@@ -543,6 +579,7 @@ class bluefish_producer_proxy : public core::frame_producer
                                      const spl::shared_ptr<core::frame_factory>& frame_factory,
                                      int                                         device_index,
                                      int                                         stream_index,
+                                     core::pixel_format                          pixel_format,
                                      uint32_t                                    length)
         : executor_(L"bluefish_producer[" + boost::lexical_cast<std::wstring>(device_index) + L"]")
         , length_(length)
@@ -550,7 +587,8 @@ class bluefish_producer_proxy : public core::frame_producer
         auto ctx = core::diagnostics::call_context::for_thread();
         executor_.invoke([=] {
             core::diagnostics::call_context::for_thread() = ctx;
-            producer_.reset(new bluefish_producer(format_desc, device_index, stream_index, frame_factory));
+            producer_.reset(
+                new bluefish_producer(format_desc, device_index, stream_index, frame_factory, pixel_format));
         });
     }
 
@@ -591,8 +629,16 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     auto length         = get_param(L"LENGTH", params, std::numeric_limits<uint32_t>::max());
     auto in_format_desc = core::video_format_desc(get_param(L"FORMAT", params, L"INVALID"));
 
+    auto pixel_format       = core::pixel_format::rgb;
+    auto pixel_format_param = get_param(L"PIXEL_FORMAT", params, L"RGB");
+    if (boost::iequals(pixel_format_param, L"UYVY")) {
+        pixel_format = core::pixel_format::uyvy;
+    } else if (boost::iequals(pixel_format_param, L"V210")) {
+        pixel_format = core::pixel_format::v210;
+    }
+
     auto producer = spl::make_shared<bluefish_producer_proxy>(
-        dependencies.format_desc, dependencies.frame_factory, device_index, stream_index, length);
+        dependencies.format_desc, dependencies.frame_factory, device_index, stream_index, pixel_format, length);
 
     return create_destroy_proxy(producer);
 }
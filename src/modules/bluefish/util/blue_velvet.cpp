@@ -183,6 +183,15 @@ BLUE_UINT32 bvc_wrapper::system_buffer_write(unsigned char* pPixels,
     return bfcSystemBufferWriteAsync(bvc_.get(), pPixels, ulSize, nullptr, ulBufferID, ulOffset);
 }
 
+BLUE_UINT32 bvc_wrapper::system_buffer_write_async(unsigned char* pPixels,
+                                                   unsigned long  ulSize,
+                                                   OVERLAPPED*    pOverlap,
+                                                   unsigned long  ulBufferID,
+                                                   unsigned long  ulOffset)
+{
+    return bfcSystemBufferWriteAsync(bvc_.get(), pPixels, ulSize, pOverlap, ulBufferID, ulOffset);
+}
+
 BLUE_UINT32 bvc_wrapper::system_buffer_read(unsigned char* pPixels,
                                             unsigned long  ulSize,
                                             unsigned long  ulBufferID,
@@ -225,6 +225,13 @@ class bvc_wrapper
     BLUE_UINT32
     system_buffer_read(unsigned char* pPixels, unsigned long ulSize, unsigned long ulBufferID, unsigned long ulOffset);
 
+    // Starts a transfer to the card, which has completed when the event of pOverlap is signaled.
+    BLUE_UINT32 system_buffer_write_async(unsigned char* pPixels,
+                                          unsigned long  ulSize,
+                                          OVERLAPPED*    pOverlap,
+                                          unsigned long  ulBufferID,
+                                          unsigned long  ulOffset);
+
     BLUE_UINT32 video_playback_stop(int iWait, int iFlush);
     BLUE_UINT32 video_playback_start(int wait, int loop);
     BLUE_UINT32 video_playback_allocate(unsigned long& buffer_id, unsigned long& underrun);
@@ -23,40 +23,75 @@
 #pragma once
 
 #include <Windows.h>
-#include <boost/align.hpp>
-#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <memory>
+#include <new>
 
 namespace caspar { namespace bluefish {
 
 static const size_t MAX_HANC_BUFFER_SIZE = 256 * 1024;
 static const size_t MAX_VBI_BUFFER_SIZE  = 36 * 1920 * 4;
 
-struct blue_dma_buffer
+// A buffer for transfers to and from the card, allocated once and locked into physical memory so that the driver does
+// not have to pin its pages for every transfer.
+struct blue_dma_buffer : boost::noncopyable
 {
   public:
     blue_dma_buffer(int image_size, int id)
         : id_(id)
         , image_size_(image_size)
         , hanc_size_(MAX_HANC_BUFFER_SIZE)
-        , image_buffer_(image_size_)
-        , hanc_buffer_(hanc_size_)
+        , image_buffer_(alloc(image_size_))
+        , hanc_buffer_(alloc(hanc_size_))
     {
     }
 
     int id() const { return id_; }
 
-    PBYTE image_data() { return image_buffer_.data(); }
-    PBYTE hanc_data() { return hanc_buffer_.data(); }
+    PBYTE image_data() { return image_buffer_.get(); }
+    PBYTE hanc_data() { return hanc_buffer_.get(); }
 
     size_t image_size() const { return image_size_; }
     size_t hanc_size() const { return hanc_size_; }
 
   private:
-    int                                                              id_;
-    size_t                                                           image_size_;
-    size_t                                                           hanc_size_;
-    std::vector<BYTE, boost::alignment::aligned_allocator<BYTE, 64>> image_buffer_;
-    std::vector<BYTE, boost::alignment::aligned_allocator<BYTE, 64>> hanc_buffer_;
+    struct deleter
+    {
+        size_t size;
+        bool   locked;
+
+        void operator()(BYTE* ptr) const
+        {
+            if (locked) {
+                VirtualUnlock(ptr, size);
+            }
+            VirtualFree(ptr, 0, MEM_RELEASE);
+        }
+    };
+    typedef std::unique_ptr<BYTE, deleter> buffer_t;
+
+    static buffer_t alloc(size_t size)
+    {
+        if (size == 0) {
+            return buffer_t(nullptr, deleter{0, false});
+        }
+
+        auto ptr = static_cast<BYTE*>(VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+
+        // NOTE: Locking fails once the working set is exhausted, the driver then pins the pages for each transfer.
+        return buffer_t(ptr, deleter{size, VirtualLock(ptr, size) != FALSE});
+    }
+
+    int      id_;
+    size_t   image_size_;
+    size_t   hanc_size_;
+    buffer_t image_buffer_;
+    buffer_t hanc_buffer_;
 };
 typedef std::shared_ptr<blue_dma_buffer> blue_dma_buffer_ptr;
 
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "decklink_clock.h"
+
+#include "../util/util.h"
+
+#include <common/except.h>
+#include <common/log.h>
+
+#include <core/clock/clock.h>
+#include <core/video_format.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <chrono>
+
+namespace caspar { namespace decklink {
+
+class decklink_clock final : public core::reference_clock
+{
+    const int                     device_index_;
+    const std::int64_t            duration_;
+    com_ptr<IDeckLink>            decklink_   = get_device(device_index_);
+    com_iface_ptr<IDeckLinkInput> input_      = iface_cast<IDeckLinkInput>(decklink_);
+    const std::wstring            model_name_ = get_model_name(decklink_);
+
+  public:
+    decklink_clock(int device_index, const core::video_format_desc& format_desc)
+        : device_index_(device_index)
+        , duration_(static_cast<std::int64_t>(1e9 / format_desc.fps))
+    {
+        auto mode = get_display_mode(input_, format_desc.format, bmdFormat8BitYUV, bmdVideoOutputFlagDefault);
+
+        if (FAILED(input_->EnableVideoInput(mode->GetDisplayMode(), bmdFormat8BitYUV, 0))) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Could not enable video input.")
+                                                      << boost::errinfo_api_function("EnableVideoInput"));
+        }
+
+        if (FAILED(input_->StartStreams())) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Failed to start input stream.")
+                                                      << boost::errinfo_api_function("StartStreams"));
+        }
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    ~decklink_clock()
+    {
+        if (input_ != nullptr) {
+            input_->StopStreams();
+            input_->DisableVideoInput();
+        }
+    }
+
+    std::chrono::nanoseconds now() const override
+    {
+        BMDTimeValue hardware_time   = 0;
+        BMDTimeValue time_in_frame   = 0;
+        BMDTimeValue ticks_per_frame = 0;
+
+        if (FAILED(input_->GetHardwareReferenceClock(1000000000, &hardware_time, &time_in_frame, &ticks_per_frame)) ||
+            ticks_per_frame <= 0) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Could not read hardware clock.")
+                                                      << boost::errinfo_api_function("GetHardwareReferenceClock"));
+        }
+
+        // Moves the frame boundaries of the input onto multiples of the channel frame duration.
+        auto frames = (hardware_time - time_in_frame) / ticks_per_frame;
+        return std::chrono::nanoseconds(frames * duration_ + time_in_frame * duration_ / ticks_per_frame);
+    }
+
+    std::wstring print() const override
+    {
+        return model_name_ + L" [" + boost::lexical_cast<std::wstring>(device_index_) + L"|clock]";
+    }
+};
+
+spl::shared_ptr<core::reference_clock> create_clock(const std::vector<std::wstring>& params,
+                                                    const core::video_format_desc&   format_desc)
+{
+    auto device_index = params.size() > 1 ? boost::lexical_cast<int>(params.at(1)) : 1;
+
+    return spl::make_shared<decklink_clock>(device_index, format_desc);
+}
+
+}} // namespace caspar::decklink
@@ -31,29 +31,37 @@
 #include <core/consumer/frame_consumer.h>
 #include <core/diagnostics/call_context.h>
 #include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
 #include <core/mixer/audio/audio_mixer.h>
+#include <core/monitor/monitor.h>
 
 #include <common/array.h>
 #include <common/assert.h>
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
 #include <common/except.h>
 #include <common/executor.h>
 #include <common/future.h>
 #include <common/memshfl.h>
+#include <common/os/memory.h>
+#include <common/os/thread.h>
 #include <common/param.h>
 #include <common/timer.h>
 
-#include <tbb/scalable_allocator.h>
+#include <tbb/concurrent_queue.h>
 
 #include <boost/circular_buffer.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include <algorithm>
 #include <atomic>
-#include <condition_variable>
+#include <chrono>
 #include <future>
+#include <map>
 #include <mutex>
-#include <queue>
+#include <new>
+#include <thread>
 
 namespace caspar { namespace decklink {
 
@@ -81,6 +89,18 @@ struct configuration
     latency_t latency           = latency_t::default_latency;
     bool      key_only          = false;
     int       base_buffer_depth = 3;
+    bool      adaptive_buffer   = false;
+    int       max_buffer_depth  = 0;
+
+    // Pins the driver's callback threads, see set_thread_affinity.
+    std::wstring affinity;
+    bool         realtime = false;
+
+    // Formats other than bgra are converted by the mixer, but carry no alpha for the keyer.
+    core::output_format pixel_format = core::output_format::bgra;
+
+    // Outputs of a channel which name the same group are started and scheduled together, see output_group.
+    std::wstring group;
 
     int buffer_depth() const
     {
@@ -88,6 +108,15 @@ struct configuration
                (embedded_audio ? 1 : 0); // TODO: Do we need this?
     }
 
+    // The most frames an adaptive buffer grows to, twice the minimum depth unless configured.
+    int max_buffer() const
+    {
+        if (!adaptive_buffer) {
+            return buffer_depth();
+        }
+        return std::max(buffer_depth(), max_buffer_depth > 0 ? max_buffer_depth : buffer_depth() * 2);
+    }
+
     int key_device_index() const { return key_device_idx == 0 ? device_index + 1 : key_device_idx; }
 };
 
@@ -133,17 +162,125 @@ void set_keyer(const com_iface_ptr<IDeckLinkAttributes>& attributes,
     }
 }
 
+BMDPixelFormat get_pixel_format(core::output_format format)
+{
+    switch (format) {
+        case core::output_format::uyvy:
+            return bmdFormat8BitYUV;
+        case core::output_format::v210:
+            return bmdFormat10BitYUV;
+        default:
+            return bmdFormat8BitBGRA;
+    }
+}
+
+int get_row_bytes(core::output_format format, int width)
+{
+    switch (format) {
+        case core::output_format::uyvy:
+            return width * 2;
+        case core::output_format::v210:
+            return (width + 47) / 48 * 128;
+        default:
+            return width * 4;
+    }
+}
+
+// Fills an image of size bytes in format with black.
+void fill_black(void* dest, core::output_format format, int size)
+{
+    std::uint32_t pattern[2];
+    switch (format) {
+        case core::output_format::uyvy:
+            pattern[0] = pattern[1] = 0x10801080;
+            break;
+        case core::output_format::v210:
+            pattern[0] = 0x20010200;
+            pattern[1] = 0x04080040;
+            break;
+        default:
+            std::memset(dest, 0, size);
+            return;
+    }
+
+    auto words = static_cast<std::uint32_t*>(dest);
+    for (int n = 0; n < size / 4; ++n) {
+        words[n] = pattern[n % 2];
+    }
+}
+
+void* allocate_buffer(std::size_t size)
+{
+    auto ptr = allocate_frame_memory(size);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+// A page aligned image of size bytes in format, filled with black.
+std::shared_ptr<void> make_black_buffer(int size, core::output_format format)
+{
+    auto buffer = std::shared_ptr<void>(allocate_buffer(size), [size](void* ptr) { free_frame_memory(ptr, size); });
+    fill_black(buffer.get(), format, size);
+    return buffer;
+}
+
+// Recycles page aligned frame buffers, so that the DeckLink callback does not allocate them. The initial buffers are
+// pre-faulted, and locked if configured. Buffers which are still scheduled when the pool is destroyed are freed once
+// the driver releases them.
+class buffer_pool
+{
+    typedef tbb::concurrent_queue<void*> queue_t;
+
+    std::size_t              size_;
+    std::shared_ptr<queue_t> free_;
+
+  public:
+    buffer_pool(std::size_t size, int count)
+        : size_(size)
+        , free_(new queue_t, [size](queue_t* queue) {
+            void* ptr;
+            while (queue->try_pop(ptr)) {
+                free_frame_memory(ptr, size);
+            }
+            delete queue;
+        })
+    {
+        for (int n = 0; n < count; ++n) {
+            auto ptr = allocate_buffer(size_);
+            prefault_frame_memory(ptr, size_);
+            free_->push(ptr);
+        }
+    }
+
+    std::shared_ptr<void> get()
+    {
+        void* ptr;
+        if (!free_->try_pop(ptr)) {
+            ptr = allocate_buffer(size_);
+        }
+        auto free = free_;
+        return std::shared_ptr<void>(ptr, [free](void* p) { free->push(p); });
+    }
+};
+
 class decklink_frame : public IDeckLinkVideoFrame
 {
     core::video_format_desc format_desc_;
+    core::output_format     format_;
     std::shared_ptr<void>   data_;
     std::atomic<int>        ref_count_{0};
     int                     nb_samples_;
 
   public:
-    decklink_frame(std::shared_ptr<void> data, const core::video_format_desc& format_desc, int nb_samples)
+    decklink_frame(std::shared_ptr<void>          data,
+                   const core::video_format_desc& format_desc,
+                   core::output_format            format,
+                   int                            nb_samples)
         : data_(data)
         , format_desc_(format_desc)
+        , format_(format)
         , nb_samples_(nb_samples)
     {
     }
@@ -169,8 +306,8 @@ class decklink_frame : public IDeckLinkVideoFrame
 
     virtual long STDMETHODCALLTYPE GetWidth() { return static_cast<long>(format_desc_.width); }
     virtual long STDMETHODCALLTYPE GetHeight() { return static_cast<long>(format_desc_.height); }
-    virtual long STDMETHODCALLTYPE GetRowBytes() { return static_cast<long>(format_desc_.width * 4); }
-    virtual BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat() { return bmdFormat8BitBGRA; }
+    virtual long STDMETHODCALLTYPE GetRowBytes() { return get_row_bytes(format_, format_desc_.width); }
+    virtual BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat() { return get_pixel_format(format_); }
     virtual BMDFrameFlags STDMETHODCALLTYPE GetFlags() { return bmdFrameFlagDefault; }
 
     virtual HRESULT STDMETHODCALLTYPE GetBytes(void** buffer)
@@ -249,6 +386,32 @@ struct key_video_context : public IDeckLinkVideoOutputCallback
     }
 };
 
+struct decklink_consumer;
+
+// The outputs of a channel which are started against the same frame of the hardware clock and scheduled with identical
+// stream times. The first member is the leader, its completion callback schedules the frames of every member while the
+// callbacks of the others only report.
+struct output_group
+{
+    std::mutex                      mutex;
+    std::vector<decklink_consumer*> members;
+};
+
+std::shared_ptr<output_group> get_output_group(int channel_index, const std::wstring& name)
+{
+    static std::mutex                                                          mutex;
+    static std::map<std::pair<int, std::wstring>, std::weak_ptr<output_group>> groups;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto group = groups[std::make_pair(channel_index, name)].lock();
+    if (!group) {
+        group                                       = std::make_shared<output_group>();
+        groups[std::make_pair(channel_index, name)] = group;
+    }
+    return group;
+}
+
 struct decklink_consumer : public IDeckLinkVideoOutputCallback
 {
     const int           channel_index_;
@@ -265,31 +428,59 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
 
     const std::wstring            model_name_ = get_model_name(decklink_);
     const core::video_format_desc format_desc_;
+    const int                     row_bytes_  = get_row_bytes(config_.pixel_format, format_desc_.width);
+    const int                     frame_size_ = row_bytes_ * format_desc_.height;
+
+    tbb::concurrent_bounded_queue<core::const_frame> buffer_;
+    int                                              buffer_capacity_ = 1;
 
-    std::mutex                    buffer_mutex_;
-    std::condition_variable       buffer_cond_;
-    std::queue<core::const_frame> buffer_;
-    int                           buffer_capacity_ = 1;
+    const int buffer_size_     = config_.buffer_depth(); // Minimum buffer-size 3.
+    const int max_buffer_size_ = config_.max_buffer();
 
-    const int buffer_size_ = config_.buffer_depth(); // Minimum buffer-size 3.
+    // NOTE: Every scheduled frame holds a buffer until it has been displayed.
+    buffer_pool fill_pool_{static_cast<std::size_t>(frame_size_), max_buffer_size_ + 2};
+    buffer_pool key_pool_{format_desc_.size, max_buffer_size_ + 2};
+
+    // NOTE: Blank frames of the mixer are scheduled as these images, which are filled once.
+    const std::shared_ptr<void> black_fill_ = make_black_buffer(frame_size_, config_.pixel_format);
+    const std::shared_ptr<void> black_key_  = make_black_buffer(format_desc_.size, core::output_format::bgra);
 
     long long video_scheduled_ = 0;
     long long audio_scheduled_ = 0;
 
-    boost::circular_buffer<std::vector<int32_t>> audio_container_{static_cast<unsigned long>(buffer_size_ + 1)};
+    // NOTE: Only used by the completion callback. An adaptive buffer grows by a frame for every late or dropped
+    // frame, and shrinks by a frame after a minute without either.
+    int          buffer_depth_   = buffer_size_;
+    int          on_time_frames_ = 0;
+    std::int64_t late_frames_    = 0;
+    std::int64_t dropped_frames_ = 0;
+
+    core::monitor::state state_;
+    mutable std::mutex   state_mutex_;
+
+    boost::circular_buffer<array<const int32_t>> audio_container_{static_cast<unsigned long>(max_buffer_size_ + 1)};
 
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
     reference_signal_detector           reference_signal_detector_{output_};
     std::atomic<int64_t>                scheduled_frames_completed_{0};
     std::unique_ptr<key_video_context>  key_context_;
+    std::thread::id                     callback_thread_;
 
-    com_ptr<IDeckLinkDisplayMode> mode_ =
-        get_display_mode(output_, format_desc_.format, bmdFormat8BitBGRA, bmdVideoOutputFlagDefault);
+    com_ptr<IDeckLinkDisplayMode> mode_ = get_display_mode(output_,
+                                                           format_desc_.format,
+                                                           get_pixel_format(config_.pixel_format),
+                                                           bmdVideoOutputFlagDefault);
     int field_count_ = mode_->GetFieldDominance() != bmdProgressiveFrame ? 2 : 1;
 
     std::atomic<bool> abort_request_{false};
 
+    const std::shared_ptr<output_group> group_ =
+        config_.group.empty() ? nullptr : get_output_group(channel_index_, config_.group);
+
+    // NOTE: Only the leader of a group buffers the frames of the channel, the others drop them in send.
+    std::atomic<bool> leader_{true};
+
   public:
     decklink_consumer(const configuration& config, const core::video_format_desc& format_desc, int channel_index)
         : channel_index_(channel_index)
@@ -300,6 +491,8 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
             key_context_.reset(new key_video_context(config, print()));
         }
 
+        buffer_.set_capacity(buffer_capacity_);
+
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
@@ -323,31 +516,29 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
         set_latency(configuration_, config.latency, print());
         set_keyer(attributes_, keyer_, config.keyer, print());
 
-        if (config.embedded_audio) {
-            output_->BeginAudioPreroll();
-        }
-
-        for (int n = 0; n < buffer_size_; ++n) {
-            auto nb_samples = format_desc_.audio_cadence[n % format_desc_.audio_cadence.size()] * field_count_;
-            if (config.embedded_audio) {
-                schedule_next_audio(std::vector<int32_t>(nb_samples * format_desc_.audio_channels), nb_samples);
-            }
-
-            std::shared_ptr<void> image_data(scalable_aligned_malloc(format_desc_.size, 64), scalable_aligned_free);
-            schedule_next_video(image_data, nb_samples);
-        }
-
-        if (config.embedded_audio) {
-            output_->EndAudioPreroll();
+        if (group_) {
+            std::lock_guard<std::mutex> lock(group_->mutex);
+            group_->members.push_back(this);
+            restart_group();
+        } else {
+            preroll(buffer_size_);
+            start_playback();
         }
-
-        start_playback();
     }
 
     ~decklink_consumer()
     {
         abort_request_ = true;
-        buffer_cond_.notify_all();
+        buffer_.abort();
+
+        if (group_) {
+            std::lock_guard<std::mutex> lock(group_->mutex);
+            group_->members.erase(std::remove(group_->members.begin(), group_->members.end(), this),
+                                  group_->members.end());
+            if (!group_->members.empty()) {
+                restart_group();
+            }
+        }
 
         if (output_ != nullptr) {
             output_->StopScheduledPlayback(0, nullptr, 0);
@@ -387,6 +578,79 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
         }
     }
 
+    void preroll(int depth)
+    {
+        video_scheduled_ = 0;
+        audio_scheduled_ = 0;
+
+        if (audio_container_.capacity() < static_cast<std::size_t>(depth + 1)) {
+            audio_container_.set_capacity(depth + 1);
+        }
+
+        if (config_.embedded_audio) {
+            output_->FlushBufferedAudioSamples();
+            output_->BeginAudioPreroll();
+        }
+
+        for (int n = 0; n < depth; ++n) {
+            auto nb_samples = format_desc_.audio_cadence[n % format_desc_.audio_cadence.size()] * field_count_;
+            if (config_.embedded_audio) {
+                schedule_next_audio(array<int32_t>(nb_samples * format_desc_.audio_channels), nb_samples);
+            }
+
+            schedule_next_video(black_fill_, black_key_, nb_samples);
+        }
+
+        if (config_.embedded_audio) {
+            output_->EndAudioPreroll();
+        }
+    }
+
+    void stop_playback()
+    {
+        output_->StopScheduledPlayback(0, nullptr, 0);
+
+        if (key_context_) {
+            key_context_->output_->StopScheduledPlayback(0, nullptr, 0);
+        }
+    }
+
+    // Stops every member of the group, prerolls them from stream time zero and starts them together. Called with the
+    // group locked whenever a member joins or leaves.
+    void restart_group()
+    {
+        auto& members = group_->members;
+
+        for (auto member : members) {
+            member->leader_ = member == members.front();
+            member->stop_playback();
+        }
+
+        // NOTE: Every member is prerolled as deep as the leader, whose callback keeps the pace of all of them.
+        for (auto member : members) {
+            member->preroll(members.front()->buffer_size_);
+        }
+
+        // NOTE: Playback starts on the frame after the call. Starting every member early in a frame of the leader's
+        // hardware clock has them all start on the same frame, which outputs locked to one reference share.
+        BMDTimeValue hardware_time   = 0;
+        BMDTimeValue time_in_frame   = 0;
+        BMDTimeValue ticks_per_frame = 0;
+        if (SUCCEEDED(members.front()->output_->GetHardwareReferenceClock(
+                format_desc_.time_scale, &hardware_time, &time_in_frame, &ticks_per_frame)) &&
+            ticks_per_frame > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds((ticks_per_frame - time_in_frame) * 1000000 /
+                                                                  format_desc_.time_scale));
+        }
+
+        for (auto member : members) {
+            member->start_playback();
+        }
+
+        CASPAR_LOG(info) << print() << L" Started output group " << config_.group << L" with " << members.size()
+                         << L" outputs.";
+    }
+
     void start_playback()
     {
         if (FAILED(output_->StartScheduledPlayback(0, format_desc_.time_scale, 1.0))) {
@@ -412,6 +676,17 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
                                                               BMDOutputFrameCompletionResult result)
     {
         try {
+            // NOTE: The driver owns its callback threads, so they are placed the first time they call back.
+            if (callback_thread_ != std::this_thread::get_id()) {
+                callback_thread_ = std::this_thread::get_id();
+                set_thread_affinity(config_.affinity);
+                if (config_.realtime) {
+                    set_thread_realtime_priority();
+                }
+            }
+
+            caspar::diagnostics::trace::instant("decklink::ScheduledFrameCompleted");
+
             auto tick_time = tick_timer_.elapsed() * format_desc_.fps / field_count_ * 0.5;
             graph_->set_value("tick-time", tick_time);
             tick_timer_.restart();
@@ -430,104 +705,237 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
 
             if (result == bmdOutputFrameDisplayedLate) {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
-                video_scheduled_ += format_desc_.duration * field_count_;
-                audio_scheduled_ += dframe->nb_samples();
+                ++late_frames_;
             } else if (result == bmdOutputFrameDropped) {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                ++dropped_frames_;
             } else if (result == bmdOutputFrameFlushed) {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "flushed-frame");
             }
 
+            auto frames_to_schedule = 1;
+            if (config_.adaptive_buffer && !group_) {
+                const auto underrun = result == bmdOutputFrameDisplayedLate || result == bmdOutputFrameDropped;
+                if (underrun) {
+                    on_time_frames_ = 0;
+                    if (buffer_depth_ < max_buffer_size_) {
+                        frames_to_schedule = 2;
+                    }
+                } else if (result == bmdOutputFrameCompleted && buffer_depth_ > buffer_size_ &&
+                           ++on_time_frames_ >= static_cast<int>(format_desc_.fps / field_count_ * 60.0)) {
+                    on_time_frames_    = 0;
+                    frames_to_schedule = 0;
+                }
+
+                if (frames_to_schedule != 1) {
+                    buffer_depth_ += frames_to_schedule - 1;
+                    CASPAR_LOG(info) << print() << L" Buffer depth changed to " << buffer_depth_ << L" frames.";
+                }
+            }
+
             {
                 UINT32 buffered;
                 output_->GetBufferedVideoFrameCount(&buffered);
-                graph_->set_value("buffered-video", static_cast<double>(buffered) / (config_.buffer_depth()));
+                graph_->set_value("buffered-video", static_cast<double>(buffered) / buffer_depth_);
+
+                std::lock_guard<std::mutex> lock(state_mutex_);
+                state_["buffer/depth"]          = buffer_depth_;
+                state_["buffer/video"]          = static_cast<std::int32_t>(buffered);
+                state_["frames/late"]           = late_frames_;
+                state_["frames/dropped"]        = dropped_frames_;
+                state_["frames/last-completed"] = static_cast<std::int32_t>(result);
 
                 if (config_.embedded_audio) {
                     output_->GetBufferedAudioSampleFrameCount(&buffered);
                     graph_->set_value("buffered-audio",
                                       static_cast<double>(buffered) /
-                                          (format_desc_.audio_cadence[0] * field_count_ * config_.buffer_depth()));
+                                          (format_desc_.audio_cadence[0] * field_count_ * buffer_depth_));
+                    state_["buffer/audio"] = static_cast<std::int32_t>(buffered);
                 }
             }
 
-            std::shared_ptr<void>     image_data(scalable_aligned_malloc(format_desc_.size, 64), scalable_aligned_free);
-            std::vector<std::int32_t> audio_data;
+            // NOTE: Skipping a frame lets the device play one frame out of its buffer. The channel waits for the
+            // consumer, so no frame is lost.
+            if (frames_to_schedule == 0) {
+                return S_OK;
+            }
+
+            // NOTE: Members of a group other than the leader only report, the leader keeps the pace of all of them.
+            if (!leader_ || (group_ && result == bmdOutputFrameFlushed)) {
+                return S_OK;
+            }
 
             std::vector<core::const_frame> frames{pop()};
             if (mode_->GetFieldDominance() != bmdProgressiveFrame) {
-                std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int>(1e6 / format_desc_.fps)));
-
                 frames.push_back(pop());
+            }
 
-                if (abort_request_) {
-                    return E_FAIL;
-                }
+            if (abort_request_) {
+                return E_FAIL;
+            }
 
-                if (mode_->GetFieldDominance() != bmdUpperFieldFirst) {
-                    std::swap(frames[0], frames[1]);
+            if (!group_) {
+                if (result == bmdOutputFrameDisplayedLate) {
+                    skip(dframe->nb_samples());
                 }
+                schedule(frames, frames_to_schedule);
+                return S_OK;
+            }
+
+            // NOTE: A group which cannot be locked is being restarted, which prerolls every member anew.
+            std::unique_lock<std::mutex> lock(group_->mutex, std::try_to_lock);
+            if (!lock || group_->members.empty() || group_->members.front() != this) {
+                return S_OK;
+            }
 
-                for (auto y = 0; y < format_desc_.height; ++y) {
-                    std::memcpy(reinterpret_cast<char*>(image_data.get()) + y * format_desc_.width * 4,
-                                frames[y % 2].image_data(0).data() + y * format_desc_.width * 4,
-                                format_desc_.width * 4);
+            for (auto member : group_->members) {
+                if (result == bmdOutputFrameDisplayedLate) {
+                    member->skip(dframe->nb_samples());
                 }
+                member->schedule(frames, frames_to_schedule);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(exception_mutex_);
+            exception_ = std::current_exception();
+            return E_FAIL;
+        }
+
+        return S_OK;
+    }
+
+    // Moves the stream time past a frame which was displayed late.
+    void skip(int nb_samples)
+    {
+        video_scheduled_ += format_desc_.duration * field_count_;
+        audio_scheduled_ += nb_samples;
+    }
 
-                audio_data.insert(audio_data.end(), frames[0].audio_data().begin(), frames[0].audio_data().end());
-                audio_data.insert(audio_data.end(), frames[1].audio_data().begin(), frames[1].audio_data().end());
+    // Schedules the image and audio of frames, a field pair for interlaced modes, in the configured format.
+    void schedule(const std::vector<core::const_frame>& frames, int frames_to_schedule)
+    {
+        std::shared_ptr<void>     image_data;
+        std::shared_ptr<void>     key_data;
+        array<const std::int32_t> audio_data;
+
+        if (mode_->GetFieldDominance() != bmdProgressiveFrame) {
+            // NOTE: The mixer weaves every frame of an interlaced channel with the one before it, so the second
+            // frame of the pair already holds both fields. Rows are only interleaved here for frames which were
+            // mixed before the consumer was added.
+            if (frames[1].blank()) {
+                image_data = black_fill_;
+                key_data   = black_key_;
+            } else if (auto image = get_woven_image(frames[1])) {
+                auto frame = frames[1];
+                image_data = std::shared_ptr<void>(const_cast<std::uint8_t*>(image), [frame](void*) {});
+                key_data   = get_key(frames[1]);
             } else {
-                if (abort_request_) {
-                    return E_FAIL;
-                }
+                image_data = fill_pool_.get();
 
-                for (auto y = 0; y < format_desc_.height; ++y) {
-                    std::memcpy(reinterpret_cast<char*>(image_data.get()) + y * format_desc_.width * 4,
-                                frames[0].image_data(0).data() + y * format_desc_.width * 4,
-                                format_desc_.width * 4);
+                const std::uint8_t* fields[] = {get_image(frames[0]), get_image(frames[1])};
+                if (mode_->GetFieldDominance() != bmdUpperFieldFirst) {
+                    std::swap(fields[0], fields[1]);
                 }
+                if (fields[0] && fields[1]) {
+                    for (auto y = 0; y < format_desc_.height; ++y) {
+                        std::memcpy(reinterpret_cast<char*>(image_data.get()) + y * row_bytes_,
+                                    fields[y % 2] + y * row_bytes_,
+                                    row_bytes_);
+                    }
+                } else {
+                    fill_black(image_data.get(), config_.pixel_format, frame_size_);
+                }
+            }
+
+            const auto& first  = frames[0].audio_data();
+            const auto& second = frames[1].audio_data();
 
-                audio_data.insert(audio_data.end(), frames[0].audio_data().begin(), frames[0].audio_data().end());
+            auto field_pair = array<std::int32_t>(first.size() + second.size());
+            std::copy(first.begin(), first.end(), field_pair.begin());
+            std::copy(second.begin(), second.end(), field_pair.begin() + first.size());
+            audio_data = std::move(field_pair);
+        } else {
+            // NOTE: The mixer's read back buffer is scheduled as it is, the frame holds it until the driver
+            // releases the DeckLink frame.
+            if (frames[0].blank()) {
+                image_data = black_fill_;
+                key_data   = black_key_;
+            } else if (auto image = get_image(frames[0])) {
+                auto frame = frames[0];
+                image_data = std::shared_ptr<void>(const_cast<std::uint8_t*>(image), [frame](void*) {});
+                key_data   = get_key(frames[0]);
+            } else {
+                image_data = fill_pool_.get();
+                fill_black(image_data.get(), config_.pixel_format, frame_size_);
             }
 
-            const auto nb_samples = static_cast<int>(audio_data.size()) / format_desc_.audio_channels;
+            // NOTE: The samples are scheduled from the frame's own buffer, which stays alive in the audio container
+            // until they have been played.
+            audio_data = frames[0].audio_data();
+        }
+
+        const auto nb_samples = static_cast<int>(audio_data.size()) / format_desc_.audio_channels;
+
+        schedule_next_video(image_data, key_data, nb_samples);
+
+        if (config_.embedded_audio) {
+            schedule_next_audio(std::move(audio_data), nb_samples);
+        }
 
-            schedule_next_video(image_data, nb_samples);
+        // NOTE: The buffer grows by repeating the frame, with silence.
+        if (frames_to_schedule == 2) {
+            schedule_next_video(image_data, key_data, nb_samples);
 
             if (config_.embedded_audio) {
-                schedule_next_audio(std::move(audio_data), nb_samples);
+                schedule_next_audio(array<int32_t>(nb_samples * format_desc_.audio_channels), nb_samples);
             }
-        } catch (...) {
-            std::lock_guard<std::mutex> lock(exception_mutex_);
-            exception_ = std::current_exception();
-            return E_FAIL;
         }
+    }
 
-        return S_OK;
+    // The image of frame in the configured pixel format, or nullptr if the mixer has not converted it.
+    const std::uint8_t* get_image(const core::const_frame& frame) const
+    {
+        if (config_.pixel_format == core::output_format::bgra) {
+            return frame.image_data(0).data();
+        }
+
+        const auto& image = frame.image_data(config_.pixel_format);
+        return static_cast<int>(image.size()) >= frame_size_ ? image.data() : nullptr;
+    }
+
+    // The image of the second frame of a pair woven by the mixer, or nullptr if the mixer has not woven it.
+    const std::uint8_t* get_woven_image(const core::const_frame& frame) const
+    {
+        const auto& image = frame.image_data(config_.pixel_format);
+        return static_cast<int>(image.size()) >= frame_size_ ? image.data() : nullptr;
+    }
+
+    // The key of frame rendered by the mixer, held by the frame, or nullptr if the mixer has not rendered it.
+    std::shared_ptr<void> get_key(const core::const_frame& frame) const
+    {
+        const auto& key = frame.image_data(core::output_format::key);
+        if (static_cast<int>(key.size()) < format_desc_.size) {
+            return nullptr;
+        }
+        return std::shared_ptr<void>(const_cast<std::uint8_t*>(key.data()), [frame](void*) {});
     }
 
     core::const_frame pop()
     {
         core::const_frame frame;
-        {
-            std::unique_lock<std::mutex> lock(buffer_mutex_);
-            buffer_cond_.wait(lock, [&] { return !buffer_.empty() || abort_request_; });
-            if (!abort_request_) {
-                frame = std::move(buffer_.front());
-                buffer_.pop();
-            }
+        try {
+            buffer_.pop(frame);
+        } catch (tbb::user_abort&) {
         }
-        buffer_cond_.notify_all();
         return frame;
     }
 
-    void schedule_next_audio(std::vector<std::int32_t> audio, int nb_samples)
+    void schedule_next_audio(array<const std::int32_t> audio, int nb_samples)
     {
         // TODO (refactor) does ScheduleAudioSamples copy data?
 
         audio_container_.push_back(std::move(audio));
 
-        if (FAILED(output_->ScheduleAudioSamples(audio_container_.back().data(),
+        if (FAILED(output_->ScheduleAudioSamples(const_cast<std::int32_t*>(audio_container_.back().data()),
                                                  nb_samples,
                                                  audio_scheduled_,
                                                  format_desc_.audio_sample_rate,
@@ -538,14 +946,15 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
         audio_scheduled_ += nb_samples;
     }
 
-    void schedule_next_video(std::shared_ptr<void> fill, int nb_samples)
+    void schedule_next_video(std::shared_ptr<void> fill, std::shared_ptr<void> key, int nb_samples)
     {
-        std::shared_ptr<void> key;
-
         if (key_context_ || config_.key_only) {
-            key = std::shared_ptr<void>(scalable_aligned_malloc(format_desc_.size, 64), scalable_aligned_free);
-
-            aligned_memshfl(key.get(), fill.get(), format_desc_.size, 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+            // NOTE: The key is normally rendered by the mixer and read back together with the fill.
+            if (!key) {
+                key = key_pool_.get();
+                parallel_memshfl(
+                    key.get(), fill.get(), format_desc_.size, 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+            }
 
             if (config_.key_only) {
                 fill = key;
@@ -553,7 +962,7 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
         }
 
         if (key_context_) {
-            auto key_frame = wrap_raw<com_ptr, IDeckLinkVideoFrame>(new decklink_frame(key, format_desc_, nb_samples));
+            auto key_frame = wrap_raw<com_ptr, IDeckLinkVideoFrame>(new decklink_frame(key, format_desc_, core::output_format::bgra, nb_samples));
             if (FAILED(key_context_->output_->ScheduleVideoFrame(get_raw(key_frame),
                                                                  video_scheduled_,
                                                                  format_desc_.duration * field_count_,
@@ -562,7 +971,7 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
             }
         }
 
-        auto fill_frame = wrap_raw<com_ptr, IDeckLinkVideoFrame>(new decklink_frame(fill, format_desc_, nb_samples));
+        auto fill_frame = wrap_raw<com_ptr, IDeckLinkVideoFrame>(new decklink_frame(fill, format_desc_, config_.pixel_format, nb_samples));
         if (FAILED(output_->ScheduleVideoFrame(get_raw(fill_frame),
                                                video_scheduled_,
                                                format_desc_.duration * field_count_,
@@ -582,20 +991,24 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
             }
         }
 
-        if (!frame) {
+        if (!frame || !leader_) {
             return !abort_request_;
         }
 
-        {
-            std::unique_lock<std::mutex> lock(buffer_mutex_);
-            buffer_cond_.wait(lock, [&] { return buffer_.size() < buffer_capacity_ || abort_request_; });
+        try {
             buffer_.push(std::move(frame));
+        } catch (tbb::user_abort&) {
         }
-        buffer_cond_.notify_all();
 
         return !abort_request_;
     }
 
+    core::monitor::state state() const
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+
     std::wstring print() const
     {
         if (config_.keyer == configuration::keyer_t::external_separate_device_keyer) {
@@ -648,11 +1061,26 @@ struct decklink_consumer_proxy : public core::frame_consumer
 
     std::wstring print() const override { return consumer_ ? consumer_->print() : L"[decklink_consumer]"; }
 
+    core::monitor::state state() const override
+    {
+        static const core::monitor::state empty;
+        return consumer_ ? consumer_->state() : empty;
+    }
+
     std::wstring name() const override { return L"decklink"; }
 
     int index() const override { return 300 + config_.device_index; }
 
     bool has_synchronization_clock() const override { return true; }
+
+    core::output_format output_format() const override { return config_.pixel_format; }
+
+    bool interlaced() const override { return true; }
+
+    bool keyed() const override
+    {
+        return config_.key_only || config_.keyer == configuration::keyer_t::external_separate_device_keyer;
+    }
 };
 
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                  params,
@@ -683,6 +1111,7 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
 
     config.embedded_audio = contains_param(L"EMBEDDED_AUDIO", params);
     config.key_only       = contains_param(L"KEY_ONLY", params);
+    config.group          = get_param(L"GROUP", params, config.group);
 
     return spl::make_shared<decklink_consumer_proxy>(config);
 }
@@ -714,6 +1143,24 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
     config.key_device_idx    = ptree.get(L"key-device", config.key_device_idx);
     config.embedded_audio    = ptree.get(L"embedded-audio", config.embedded_audio);
     config.base_buffer_depth = ptree.get(L"buffer-depth", config.base_buffer_depth);
+    config.adaptive_buffer   = ptree.get(L"adaptive-buffer-depth", config.adaptive_buffer);
+    config.max_buffer_depth  = ptree.get(L"max-buffer-depth", config.max_buffer_depth);
+    config.affinity          = ptree.get(L"affinity", config.affinity);
+    config.realtime          = ptree.get(L"realtime", config.realtime);
+    config.group             = ptree.get(L"group", config.group);
+
+    auto pixel_format = ptree.get(L"pixel-format", L"bgra");
+    if (pixel_format == L"uyvy") {
+        config.pixel_format = core::output_format::uyvy;
+    } else if (pixel_format == L"v210") {
+        config.pixel_format = core::output_format::v210;
+    }
+
+    if (config.pixel_format != core::output_format::bgra &&
+        (config.key_only || config.keyer == configuration::keyer_t::external_separate_device_keyer)) {
+        CASPAR_LOG(warning) << L"[decklink_consumer] A separate key needs bgra, ignoring pixel-format.";
+        config.pixel_format = core::output_format::bgra;
+    }
 
     return spl::make_shared<decklink_consumer_proxy>(config);
 }
@@ -24,6 +24,7 @@
 #include "decklink.h"
 #include "util/util.h"
 
+#include "clock/decklink_clock.h"
 #include "consumer/decklink_consumer.h"
 #include "producer/decklink_producer.h"
 
@@ -81,6 +82,7 @@ void init(core::module_dependencies dependencies)
     dependencies.consumer_registry->register_consumer_factory(L"Decklink Consumer", create_consumer);
     dependencies.consumer_registry->register_preconfigured_consumer_factory(L"decklink", create_preconfigured_consumer);
     dependencies.producer_registry->register_producer_factory(L"Decklink Producer", create_producer);
+    dependencies.clock_registry->register_clock_factory(L"decklink", create_clock);
 }
 
 }} // namespace caspar::decklink
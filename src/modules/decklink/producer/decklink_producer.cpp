@@ -29,6 +29,7 @@
 #include <common/except.h>
 #include <common/executor.h>
 #include <common/log.h>
+#include <common/memcpy.h>
 #include <common/param.h>
 #include <common/scope_exit.h>
 #include <common/timer.h>
@@ -50,6 +51,7 @@
 
 #include <boost/algorithm/string.hpp>
 #include <boost/circular_buffer.hpp>
+#include <boost/optional.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 
@@ -76,7 +78,12 @@ extern "C" {
 
 #include "../decklink_api.h"
 
+#include <cstdlib>
+#include <deque>
 #include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
 
 using namespace caspar::ffmpeg;
 
@@ -96,6 +103,8 @@ struct Filter
     AVFilterContext*               video_source = nullptr;
     AVFilterContext*               audio_source = nullptr;
 
+    Filter() = default;
+
     Filter(std::string                    filter_spec,
            AVMediaType                    type,
            const core::video_format_desc& format_desc,
@@ -281,6 +290,121 @@ struct Filter
     }
 };
 
+// Allocates the capture buffers of the card from the frame factory, so that video is captured straight into memory
+// that the mixer uploads from. Buffers that do not match the captured format are allocated from the heap.
+class frame_allocator : public IDeckLinkMemoryAllocator
+{
+    struct buffer
+    {
+        array<const std::uint8_t> data;
+        core::pixel_format_desc   desc;
+    };
+
+    const void* const                    tag_;
+    spl::shared_ptr<core::frame_factory> frame_factory_;
+    const core::pixel_format             format_;
+    const int                            height_;
+
+    std::mutex              mutex_;
+    std::map<void*, buffer> buffers_;
+
+  public:
+    frame_allocator(const void*                                 tag,
+                    const spl::shared_ptr<core::frame_factory>& frame_factory,
+                    core::pixel_format                          format,
+                    int                                         height)
+        : tag_(tag)
+        , frame_factory_(frame_factory)
+        , format_(format)
+        , height_(height)
+    {
+    }
+
+    ~frame_allocator()
+    {
+        for (auto& buffer : buffers_) {
+            if (!buffer.second.data) {
+                std::free(buffer.first);
+            }
+        }
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID*) { return E_NOINTERFACE; }
+    virtual ULONG STDMETHODCALLTYPE AddRef() { return 1; }
+    virtual ULONG STDMETHODCALLTYPE Release() { return 1; }
+
+    virtual HRESULT STDMETHODCALLTYPE AllocateBuffer(unsigned int size, void** allocated)
+    {
+        if (!allocated) {
+            return E_POINTER;
+        }
+
+        try {
+            auto  buf   = buffer{{}, core::pixel_format_desc(format_)};
+            void* bytes = nullptr;
+
+            if (height_ > 0 && size > 0 && size % (height_ * 4) == 0) {
+                buf.desc.planes.push_back(core::pixel_format_desc::plane(size / height_ / 4, height_, 4));
+
+                // NOTE: Only the memory of the frame is kept, it is wrapped into a new frame for every capture.
+                auto frame = frame_factory_->create_frame(tag_, buf.desc);
+                bytes      = frame.image_data(0).begin();
+                buf.data   = std::move(frame.image_data(0));
+            } else {
+                bytes = std::malloc(size);
+            }
+
+            if (!bytes) {
+                return E_OUTOFMEMORY;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            buffers_[bytes] = std::move(buf);
+            *allocated      = bytes;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            return E_OUTOFMEMORY;
+        }
+
+        return S_OK;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE ReleaseBuffer(void* bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = buffers_.find(bytes);
+        if (it == buffers_.end()) {
+            return E_INVALIDARG;
+        }
+
+        // NOTE: Frame memory is released with the last frame that was captured into it.
+        if (!it->second.data) {
+            std::free(bytes);
+        }
+        buffers_.erase(it);
+
+        return S_OK;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE Commit() { return S_OK; }
+    virtual HRESULT STDMETHODCALLTYPE Decommit() { return S_OK; }
+
+    // Returns a frame of the image that was captured into bytes, or an empty frame if bytes was allocated from the
+    // heap. The card must not reuse the buffer while the frame is in use.
+    core::const_frame wrap(const void* bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = buffers_.find(const_cast<void*>(bytes));
+        if (it == buffers_.end() || !it->second.data) {
+            return core::const_frame{};
+        }
+
+        return core::const_frame({it->second.data}, array<const std::int32_t>{}, it->second.desc);
+    }
+};
+
 class decklink_producer : public IDeckLinkInputCallback
 {
     const int                           device_index_;
@@ -289,6 +413,9 @@ class decklink_producer : public IDeckLinkInputCallback
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
 
+    // NOTE: Declared before the device, which may release its buffers when it is destroyed.
+    frame_allocator allocator_;
+
     com_ptr<IDeckLink>                 decklink_   = get_device(device_index_);
     com_iface_ptr<IDeckLinkInput>      input_      = iface_cast<IDeckLinkInput>(decklink_);
     com_iface_ptr<IDeckLinkAttributes> attributes_ = iface_cast<IDeckLinkAttributes>(decklink_);
@@ -314,7 +441,27 @@ class decklink_producer : public IDeckLinkInputCallback
         get_display_mode(input_, format_desc_.format, bmdFormat8BitBGRA, bmdVideoOutputFlagDefault);
     int field_count_ = mode_->GetFieldDominance() != bmdProgressiveFrame ? 2 : 1;
 
+    struct captured_frame
+    {
+        core::const_frame image;
+        BMDTimeValue      pts;
+        core::field_mode  field_mode;
+    };
+
+    // NOTE: Without video filters, frames skip the filter graph. They are uploaded as captured, and converted and
+    // deinterlaced by the mixer.
+    const BMDPixelFormat       pixel_format_;
+    std::deque<captured_frame> video_frames_;
+
     Filter video_filter_;
+
+    // NOTE: Without an audio filter, captured samples skip the filter graph. They are sliced by the cadence into the
+    // frames, paired with the video of the same stream time.
+    const bool                           direct_audio_;
+    std::vector<std::int32_t>            audio_samples_;
+    std::int64_t                         audio_samples_pts_ = 0;
+    std::deque<std::shared_ptr<AVFrame>> filtered_frames_;
+
     Filter audio_filter_;
 
   public:
@@ -323,13 +470,20 @@ class decklink_producer : public IDeckLinkInputCallback
                       const spl::shared_ptr<core::frame_factory>& frame_factory,
                       const std::string&                          vfilter,
                       const std::string&                          afilter,
-                      bool                                        freeze_on_lost)
+                      bool                                        freeze_on_lost,
+                      BMDPixelFormat                              pixel_format)
         : device_index_(device_index)
+        , allocator_(this,
+                     frame_factory,
+                     pixel_format == bmdFormat10BitYUV ? core::pixel_format::v210 : core::pixel_format::uyvy,
+                     format_desc.height)
         , format_desc_(format_desc)
         , frame_factory_(frame_factory)
         , freeze_on_lost_(freeze_on_lost)
-        , video_filter_(vfilter, AVMEDIA_TYPE_VIDEO, format_desc_, mode_)
-        , audio_filter_(afilter, AVMEDIA_TYPE_AUDIO, format_desc_, mode_)
+        , pixel_format_(pixel_format)
+        , video_filter_(vfilter.empty() ? Filter() : Filter(vfilter, AVMEDIA_TYPE_VIDEO, format_desc_, mode_))
+        , direct_audio_(afilter.empty() && !video_filter_.audio_source && format_desc.audio_sample_rate == 48000)
+        , audio_filter_(direct_audio_ ? Filter() : Filter(afilter, AVMEDIA_TYPE_AUDIO, format_desc_, mode_))
     {
         boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
 
@@ -345,7 +499,12 @@ class decklink_producer : public IDeckLinkInputCallback
         graph_->set_text(print());
         diagnostics::register_graph(graph_);
 
-        if (FAILED(input_->EnableVideoInput(mode_->GetDisplayMode(), bmdFormat8BitYUV, 0))) {
+        // NOTE: Filtered video is copied into the filter graph, so only unfiltered video is captured into frames.
+        if (!video_filter_.sink && FAILED(input_->SetVideoInputFrameMemoryAllocator(&allocator_))) {
+            CASPAR_LOG(warning) << print() << L" Could not set video input allocator, captured video will be copied.";
+        }
+
+        if (FAILED(input_->EnableVideoInput(mode_->GetDisplayMode(), pixel_format_, 0))) {
             CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Could not enable video input.")
                                                       << boost::errinfo_api_function("EnableVideoInput"));
         }
@@ -441,7 +600,13 @@ class decklink_producer : public IDeckLinkInputCallback
                 src->key_frame        = 1;
 
                 void* video_bytes = nullptr;
-                if (SUCCEEDED(video->GetBytes(&video_bytes)) && video_bytes) {
+                if (!video_filter_.sink) {
+                    BMDTimeValue duration;
+                    if (SUCCEEDED(video->GetBytes(&video_bytes)) && video_bytes &&
+                        SUCCEEDED(video->GetStreamTime(&in_video_pts, &duration, AV_TIME_BASE))) {
+                        push_video(video, video_bytes, video->GetRowBytes(), video->GetHeight(), in_video_pts);
+                    }
+                } else if (SUCCEEDED(video->GetBytes(&video_bytes)) && video_bytes) {
                     video->AddRef();
                     src = std::shared_ptr<AVFrame>(src.get(), [src, video](AVFrame* ptr) { video->Release(); });
 
@@ -462,7 +627,14 @@ class decklink_producer : public IDeckLinkInputCallback
                 }
             }
 
-            if (audio) {
+            if (audio && direct_audio_) {
+                void* audio_bytes = nullptr;
+                if (SUCCEEDED(audio->GetBytes(&audio_bytes)) && audio_bytes &&
+                    SUCCEEDED(audio->GetPacketTime(&in_audio_pts, format_desc_.audio_sample_rate))) {
+                    push_audio(
+                        static_cast<const std::int32_t*>(audio_bytes), audio->GetSampleFrameCount(), in_audio_pts);
+                }
+            } else if (audio) {
                 auto src      = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
                 src->format   = AV_SAMPLE_FMT_S32;
                 src->channels = format_desc_.audio_channels;
@@ -490,6 +662,11 @@ class decklink_producer : public IDeckLinkInputCallback
                 }
             }
 
+            if (direct_audio_) {
+                push_frames(in_video_pts, in_audio_pts);
+                return S_OK;
+            }
+
             while (true) {
                 {
                     auto av_video = alloc_frame();
@@ -497,8 +674,9 @@ class decklink_producer : public IDeckLinkInputCallback
 
                     // TODO (fix) this may get stuck if the decklink sends a frame of video or audio
 
-                    if (av_buffersink_get_frame_flags(video_filter_.sink, av_video.get(), AV_BUFFERSINK_FLAG_PEEK) <
-                        0) {
+                    if (video_filter_.sink ? av_buffersink_get_frame_flags(
+                                                 video_filter_.sink, av_video.get(), AV_BUFFERSINK_FLAG_PEEK) < 0
+                                           : video_frames_.empty()) {
                         return S_OK;
                     }
 
@@ -513,10 +691,18 @@ class decklink_producer : public IDeckLinkInputCallback
 
                 // TODO (fix) auto V/A sync even if decklink is wrong.
 
-                av_buffersink_get_frame(video_filter_.sink, av_video.get());
+                boost::optional<captured_frame> captured;
+                AVRational                      video_tb = {1, AV_TIME_BASE};
+                if (video_filter_.sink) {
+                    av_buffersink_get_frame(video_filter_.sink, av_video.get());
+                    video_tb = av_buffersink_get_time_base(video_filter_.sink);
+                } else {
+                    captured      = video_frames_.front();
+                    av_video->pts = captured->pts;
+                    video_frames_.pop_front();
+                }
                 av_buffersink_get_samples(audio_filter_.sink, av_audio.get(), audio_cadence_[0]);
 
-                auto video_tb = av_buffersink_get_time_base(video_filter_.sink);
                 auto audio_tb = av_buffersink_get_time_base(audio_filter_.sink);
 
                 CASPAR_LOG(debug) << av_video->pts << " " << av_audio->pts;
@@ -526,28 +712,10 @@ class decklink_producer : public IDeckLinkInputCallback
                 auto out_sync = static_cast<double>(av_video->pts * video_tb.num) / video_tb.den -
                                 static_cast<double>(av_audio->pts * video_tb.num) / audio_tb.den;
 
-                if (std::abs(in_sync - in_sync_) > 0.01) {
-                    CASPAR_LOG(warning) << print() << " in-sync changed: " << in_sync;
-                }
-                in_sync_ = in_sync;
-
-                if (std::abs(out_sync - out_sync_) > 0.01) {
-                    CASPAR_LOG(warning) << print() << " out-sync changed: " << out_sync;
-                }
-                out_sync_ = out_sync;
+                update_sync(in_sync, out_sync);
 
-                graph_->set_value("in-sync", in_sync * 2.0 + 0.5);
-                graph_->set_value("out-sync", out_sync * 2.0 + 0.5);
-
-                auto frame = core::draw_frame(make_frame(this, *frame_factory_, av_video, av_audio));
-                if (!frame_buffer_.try_push(frame)) {
-                    core::draw_frame dummy;
-                    frame_buffer_.try_pop(dummy);
-                    frame_buffer_.try_push(frame);
-                    graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
-                }
-
-                boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
+                push_frame(captured ? make_video_frame(*captured, make_frame(this, *frame_factory_, nullptr, av_audio))
+                                    : core::draw_frame(make_frame(this, *frame_factory_, av_video, av_audio)));
             }
         } catch (...) {
             exception_ = std::current_exception();
@@ -557,6 +725,182 @@ class decklink_producer : public IDeckLinkInputCallback
         return S_OK;
     }
 
+    void push_frame(core::draw_frame frame)
+    {
+        if (!frame_buffer_.try_push(frame)) {
+            core::draw_frame dummy;
+            frame_buffer_.try_pop(dummy);
+            frame_buffer_.try_push(frame);
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+
+        boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
+    }
+
+    void push_audio(const std::int32_t* samples, int nb_samples, BMDTimeValue pts)
+    {
+        const auto channels = static_cast<int>(format_desc_.audio_channels);
+
+        // NOTE: A packet which does not follow the queued samples restarts the queue at its own stream time.
+        const auto queued = static_cast<std::int64_t>(audio_samples_.size() / channels);
+        if (audio_samples_.empty() || std::abs(audio_samples_pts_ + queued - pts) > audio_cadence_[0] / 2) {
+            audio_samples_.clear();
+            audio_samples_pts_ = pts;
+        }
+
+        audio_samples_.insert(audio_samples_.end(), samples, samples + nb_samples * channels);
+    }
+
+    // Pairs the queued video with the samples of its stream time, a cadence of samples for each frame. Video waits
+    // for its samples, unless audio has stopped arriving, when it is paired with silence.
+    void push_frames(BMDTimeValue in_video_pts, BMDTimeValue in_audio_pts)
+    {
+        const auto channels = static_cast<int>(format_desc_.audio_channels);
+
+        if (video_filter_.sink) {
+            while (true) {
+                auto av_video = alloc_frame();
+                if (av_buffersink_get_frame(video_filter_.sink, av_video.get()) < 0) {
+                    break;
+                }
+                av_video->pts =
+                    av_rescale_q(av_video->pts, av_buffersink_get_time_base(video_filter_.sink), {1, AV_TIME_BASE});
+                filtered_frames_.push_back(std::move(av_video));
+            }
+            while (filtered_frames_.size() > static_cast<std::size_t>(field_count_ * 4)) {
+                filtered_frames_.pop_front();
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            }
+        }
+
+        while (video_filter_.sink ? !filtered_frames_.empty() : !video_frames_.empty()) {
+            const auto queued_video = video_filter_.sink ? filtered_frames_.size() : video_frames_.size();
+            const auto video_pts    = video_filter_.sink ? filtered_frames_.front()->pts : video_frames_.front().pts;
+            const auto nb_samples   = audio_cadence_[0];
+
+            // NOTE: Samples are sliced continuously while they are within half a frame of the video, otherwise the
+            // queue is realigned to the stream time of the video.
+            const auto video_sample = av_rescale(video_pts, format_desc_.audio_sample_rate, AV_TIME_BASE);
+            const auto queued       = static_cast<std::int64_t>(audio_samples_.size() / channels);
+            auto       offset       = std::int64_t{0};
+            if (audio_samples_pts_ + nb_samples / 2 < video_sample) {
+                const auto stale = std::min(video_sample - audio_samples_pts_, queued);
+                audio_samples_.erase(audio_samples_.begin(), audio_samples_.begin() + stale * channels);
+                audio_samples_pts_ += stale;
+            } else if (audio_samples_pts_ > video_sample + nb_samples / 2) {
+                offset = std::min<std::int64_t>(audio_samples_pts_ - video_sample, nb_samples);
+            }
+
+            const auto available = static_cast<std::int64_t>(audio_samples_.size() / channels);
+            if (available < nb_samples - offset && queued_video <= static_cast<std::size_t>(field_count_ * 2)) {
+                return;
+            }
+
+            const auto count   = std::min<std::int64_t>(available, nb_samples - offset);
+            auto       samples = array<std::int32_t>(static_cast<std::size_t>(nb_samples * channels));
+            std::fill(samples.begin(), samples.end(), 0);
+            std::copy(audio_samples_.begin(),
+                      audio_samples_.begin() + count * channels,
+                      samples.begin() + offset * channels);
+            audio_samples_.erase(audio_samples_.begin(), audio_samples_.begin() + count * channels);
+            audio_samples_pts_ += count;
+
+            auto in_sync = static_cast<double>(in_video_pts) / AV_TIME_BASE -
+                           static_cast<double>(in_audio_pts) / format_desc_.audio_sample_rate;
+            auto out_sync = static_cast<double>(video_pts) / AV_TIME_BASE -
+                            static_cast<double>(audio_samples_pts_ - count - offset) / format_desc_.audio_sample_rate;
+            update_sync(in_sync, out_sync);
+
+            if (video_filter_.sink) {
+                auto frame         = make_frame(this, *frame_factory_, filtered_frames_.front(), nullptr);
+                frame.audio_data() = std::move(samples);
+                filtered_frames_.pop_front();
+                push_frame(core::draw_frame(std::move(frame)));
+            } else {
+                auto captured = video_frames_.front();
+                video_frames_.pop_front();
+                push_frame(make_video_frame(
+                    captured,
+                    core::mutable_frame(
+                        this, {}, std::move(samples), core::pixel_format_desc(core::pixel_format::invalid))));
+            }
+        }
+    }
+
+    void update_sync(double in_sync, double out_sync)
+    {
+        if (std::abs(in_sync - in_sync_) > 0.01) {
+            CASPAR_LOG(warning) << print() << " in-sync changed: " << in_sync;
+        }
+        in_sync_ = in_sync;
+
+        if (std::abs(out_sync - out_sync_) > 0.01) {
+            CASPAR_LOG(warning) << print() << " out-sync changed: " << out_sync;
+        }
+        out_sync_ = out_sync;
+
+        graph_->set_value("in-sync", in_sync * 2.0 + 0.5);
+        graph_->set_value("out-sync", out_sync * 2.0 + 0.5);
+    }
+
+    // The mixer runs at field rate for interlaced formats, so a captured frame is queued once for each of its fields,
+    // in the order of the field dominance. The mixer shows the field of each and deinterlaces the other field.
+    void push_video(IDeckLinkVideoInputFrame* video, const void* bytes, int row_bytes, int height, BMDTimeValue pts)
+    {
+        auto image = allocator_.wrap(bytes);
+        if (image && image.width() == static_cast<std::size_t>(row_bytes / 4) &&
+            image.height() == static_cast<std::size_t>(height)) {
+            // NOTE: The card reuses the buffer once the input frame is released, so it is held by the image.
+            video->AddRef();
+            image.cached(&allocator_, [&] {
+                return boost::any(std::shared_ptr<IDeckLinkVideoInputFrame>(
+                    video, [](IDeckLinkVideoInputFrame* ptr) { ptr->Release(); }));
+            });
+        } else {
+            auto desc = core::pixel_format_desc(pixel_format_ == bmdFormat10BitYUV ? core::pixel_format::v210
+                                                                                    : core::pixel_format::uyvy);
+            desc.planes.push_back(core::pixel_format_desc::plane(row_bytes / 4, height, 4));
+
+            auto frame = frame_factory_->create_frame(this, desc);
+            parallel_memcpy(frame.image_data(0).begin(), bytes, desc.planes[0].size);
+
+            image = core::const_frame(std::move(frame));
+        }
+
+        if (field_count_ == 2) {
+            const auto upper_first = mode_->GetFieldDominance() == bmdUpperFieldFirst;
+            const auto field_pts   = pts + static_cast<BMDTimeValue>(AV_TIME_BASE / format_desc_.fps);
+            const auto first       = upper_first ? core::field_mode::upper : core::field_mode::lower;
+            const auto second      = upper_first ? core::field_mode::lower : core::field_mode::upper;
+            video_frames_.push_back({image, pts, first});
+            video_frames_.push_back({image, field_pts, second});
+        } else {
+            video_frames_.push_back({image, pts, core::field_mode::progressive});
+        }
+
+        // NOTE: Video is paired with audio as it arrives, stale frames are only kept if audio stops arriving.
+        while (video_frames_.size() > static_cast<std::size_t>(field_count_ * 4)) {
+            video_frames_.pop_front();
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+    }
+
+    core::draw_frame make_video_frame(const captured_frame& captured, core::mutable_frame audio)
+    {
+        auto video = core::draw_frame(captured.image);
+
+        video.transform().image_transform.field_mode = captured.field_mode;
+
+        // NOTE: v210 rows are padded to whole groups of 48 pixels, the padding is scaled out of view.
+        const auto is_v210      = captured.image.pixel_format_desc().format == core::pixel_format::v210;
+        const auto padded_width = static_cast<int>(captured.image.width()) * (is_v210 ? 3 : 4) / 2;
+        if (padded_width != format_desc_.width) {
+            video.transform().image_transform.fill_scale[0] = static_cast<double>(padded_width) / format_desc_.width;
+        }
+
+        return core::draw_frame::over(std::move(video), core::draw_frame(std::move(audio)));
+    }
+
     core::draw_frame get_frame()
     {
         if (exception_ != nullptr) {
@@ -606,7 +950,8 @@ class decklink_producer_proxy : public core::frame_producer
                                      const std::string&                          vfilter,
                                      const std::string&                          afilter,
                                      uint32_t                                    length,
-                                     bool                                        freeze_on_lost)
+                                     bool                                        freeze_on_lost,
+                                     BMDPixelFormat                              pixel_format)
         : executor_(L"decklink_producer[" + boost::lexical_cast<std::wstring>(device_index) + L"]")
         , length_(length)
     {
@@ -614,8 +959,8 @@ class decklink_producer_proxy : public core::frame_producer
         executor_.invoke([=] {
             core::diagnostics::call_context::for_thread() = ctx;
             com_initialize();
-            producer_.reset(
-                new decklink_producer(format_desc, device_index, frame_factory, vfilter, afilter, freeze_on_lost));
+            producer_.reset(new decklink_producer(
+                format_desc, device_index, frame_factory, vfilter, afilter, freeze_on_lost, pixel_format));
         });
     }
 
@@ -664,13 +1009,23 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     auto vfilter = boost::to_lower_copy(get_param(L"VF", params, filter_str));
     auto afilter = boost::to_lower_copy(get_param(L"AF", params, get_param(L"FILTER", params, L"")));
 
+    auto pixel_format = bmdFormat8BitYUV;
+    if (boost::iequals(get_param(L"PIXEL_FORMAT", params, L"UYVY"), L"V210")) {
+        if (vfilter.empty()) {
+            pixel_format = bmdFormat10BitYUV;
+        } else {
+            CASPAR_LOG(warning) << L"[decklink_producer] Video filters need uyvy, ignoring PIXEL_FORMAT.";
+        }
+    }
+
     auto producer = spl::make_shared<decklink_producer_proxy>(dependencies.format_desc,
                                                               dependencies.frame_factory,
                                                               device_index,
                                                               u8(vfilter),
                                                               u8(afilter),
                                                               length,
-                                                              freeze_on_lost);
+                                                              freeze_on_lost,
+                                                              pixel_format);
     return core::create_destroy_proxy(producer);
 }
 }} // namespace caspar::decklink
@@ -21,6 +21,7 @@
 
 #include "ffmpeg_consumer.h"
 
+#include "../producer/av_io.h"
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
 
@@ -33,6 +34,7 @@
 #include <common/timer.h>
 
 #include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
 #include <core/video_format.h>
 
 #include <boost/algorithm/string.hpp>
@@ -58,7 +60,9 @@ extern "C" {
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
 #include <libavformat/avformat.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/samplefmt.h>
 #include <libavutil/timecode.h>
@@ -70,17 +74,294 @@ extern "C" {
 
 #include <tbb/concurrent_queue.h>
 #include <tbb/parallel_for.h>
-#include <tbb/parallel_invoke.h>
-
+#include <tbb/task_scheduler_init.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 namespace caspar { namespace ffmpeg {
 
-// TODO multiple output streams
 // TODO multiple output files
-// TODO run video filter, video encoder, audio filter, audio encoder in separate threads.
-// TODO realtime with smaller buffer?
+
+// Converts channel frames once for all video streams of a consumer.
+struct VideoConverter
+{
+    // NOTE: Contexts are pooled by slice size, since the last slice also takes the remaining rows.
+    std::mutex                                                              sws_mutex_;
+    std::map<std::pair<int, int>, std::vector<std::shared_ptr<SwsContext>>> sws_;
+
+    // NOTE: Blank frames of the mixer are converted once, later ones share the converted frame.
+    std::shared_ptr<AVFrame> black_;
+
+    std::shared_ptr<SwsContext> get_sws(int width, int height)
+    {
+        std::shared_ptr<SwsContext> sws;
+
+        {
+            std::lock_guard<std::mutex> lock(sws_mutex_);
+            auto&                       pool = sws_[std::make_pair(width, height)];
+            if (!pool.empty()) {
+                sws = std::move(pool.back());
+                pool.pop_back();
+            }
+        }
+
+        if (!sws) {
+            sws = create_sws(width, height, width, height);
+        }
+
+        return std::shared_ptr<SwsContext>(sws.get(), [this, sws, width, height](SwsContext*) {
+            std::lock_guard<std::mutex> lock(sws_mutex_);
+            sws_[std::make_pair(width, height)].push_back(sws);
+        });
+    }
+
+    std::shared_ptr<SwsContext> create_sws(int width, int height, int dst_width, int dst_height)
+    {
+        std::shared_ptr<SwsContext> sws;
+
+        const auto flags = width != dst_width || height != dst_height ? SWS_BILINEAR : 0;
+        sws.reset(sws_getContext(width,
+                                 height,
+                                 AV_PIX_FMT_BGRA,
+                                 dst_width,
+                                 dst_height,
+                                 AV_PIX_FMT_YUVA422P,
+                                 flags,
+                                 nullptr,
+                                 nullptr,
+                                 nullptr),
+                  [](SwsContext* ptr) { sws_freeContext(ptr); });
+
+        if (!sws) {
+            CASPAR_THROW_EXCEPTION(caspar_exception());
+        }
+
+        int        brigthness;
+        int        contrast;
+        int        saturation;
+        int        in_full;
+        int        out_full;
+        const int* inv_table;
+        const int* table;
+
+        sws_getColorspaceDetails(
+            sws.get(), (int**)&inv_table, &in_full, (int**)&table, &out_full, &brigthness, &contrast, &saturation);
+
+        inv_table = sws_getCoefficients(AVCOL_SPC_RGB);
+        table     = sws_getCoefficients(AVCOL_SPC_BT709);
+
+        in_full  = AVCOL_RANGE_JPEG;
+        out_full = AVCOL_RANGE_MPEG;
+
+        sws_setColorspaceDetails(sws.get(), inv_table, in_full, table, out_full, brigthness, contrast, saturation);
+
+        return sws;
+    }
+
+    // Converts in_frame into a frame of the size of format_desc. Frames of another size are read from the image which
+    // the mixer scaled them to, or scaled here if the mixer has not, as for frames mixed before the consumer started.
+    std::shared_ptr<AVFrame> convert(const core::const_frame& in_frame, const core::video_format_desc& format_desc)
+    {
+        if (!in_frame.blank()) {
+            return convert_image(in_frame, format_desc);
+        }
+        if (!black_ || black_->width != format_desc.width || black_->height != format_desc.height) {
+            black_ = convert_image(in_frame, format_desc);
+        }
+        return black_;
+    }
+
+    std::shared_ptr<AVFrame> convert_image(const core::const_frame&       in_frame,
+                                           const core::video_format_desc& format_desc)
+    {
+        auto source = in_frame;
+        if (static_cast<int>(in_frame.width()) != format_desc.width ||
+            static_cast<int>(in_frame.height()) != format_desc.height) {
+            const auto& scaled = in_frame.image_data(core::output_size(format_desc.width, format_desc.height));
+            if (!scaled.empty()) {
+                auto desc = core::pixel_format_desc(core::pixel_format::bgra);
+                desc.planes.push_back(core::pixel_format_desc::plane(format_desc.width, format_desc.height, 4));
+                source = core::const_frame({scaled}, in_frame.audio_data(), desc);
+            }
+        }
+
+        auto frame    = make_av_video_frame(source, format_desc);
+        frame->width  = static_cast<int>(source.width());
+        frame->height = static_cast<int>(source.height());
+
+        auto frame2                 = alloc_frame();
+        frame2->sample_aspect_ratio = frame->sample_aspect_ratio;
+        frame2->width               = format_desc.width;
+        frame2->height              = format_desc.height;
+        frame2->format              = AV_PIX_FMT_YUVA422P;
+        frame2->colorspace          = AVCOL_SPC_BT709;
+        frame2->color_primaries     = AVCOL_PRI_BT709;
+        frame2->color_range         = AVCOL_RANGE_MPEG;
+        frame2->color_trc           = AVCOL_TRC_BT709;
+        av_frame_get_buffer(frame2.get(), 64);
+
+        if (frame->width != frame2->width || frame->height != frame2->height) {
+            auto sws = create_sws(frame->width, frame->height, frame2->width, frame2->height);
+            sws_scale(sws.get(), frame->data, frame->linesize, 0, frame->height, frame2->data, frame2->linesize);
+            return frame2;
+        }
+
+        // NOTE: Slice heights are multiples of the chroma subsampling, the last slice takes the remaining rows.
+        const auto desc   = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame2->format));
+        const auto align  = 1 << desc->log2_chroma_h;
+        const auto slices = std::max(
+            1, std::min(tbb::task_scheduler_init::default_num_threads(), frame->height / (align * 16)));
+        const auto h = frame->height / slices / align * align;
+
+        tbb::parallel_for(0, slices, [&](int i) {
+            const auto y      = i * h;
+            const auto height = i < slices - 1 ? h : frame->height - y;
+
+            auto sws = get_sws(frame->width, height);
+
+            uint8_t* src[4] = {};
+            src[0]          = frame->data[0] + frame->linesize[0] * y;
+
+            uint8_t* dst[4] = {};
+            dst[0]          = frame2->data[0] + frame2->linesize[0] * y;
+            dst[1]          = frame2->data[1] + frame2->linesize[1] * (y >> desc->log2_chroma_h);
+            dst[2]          = frame2->data[2] + frame2->linesize[2] * (y >> desc->log2_chroma_h);
+            dst[3]          = frame2->data[3] + frame2->linesize[3] * y;
+
+            sws_scale(sws.get(), src, frame->linesize, 0, height, dst, frame2->linesize);
+        });
+
+        return frame2;
+    }
+};
+
+// The number of the segment of segment_length seconds which ts in time_base falls in.
+int64_t segment_index(int64_t ts, AVRational time_base, AVRational segment_length)
+{
+    return av_rescale_q_rnd(ts, time_base, segment_length, AV_ROUND_DOWN);
+}
+
+// The file of segment index of path, e.g. record_0002.mov.
+std::string segment_path(const std::string& path, int64_t index)
+{
+    const auto file = boost::filesystem::path(path);
+    const auto name = file.stem().string() + (boost::format("_%04d") % index).str() + file.extension().string();
+    return (file.parent_path() / name).string();
+}
+
+// Opens the file of oc, through a write-behind queue if direct_io is set. options are left with the unused ones.
+std::shared_ptr<WriteBehind> open_output(AVFormatContext*                    oc,
+                                         const std::string&                  path,
+                                         bool                                direct_io,
+                                         std::shared_ptr<diagnostics::graph> graph,
+                                         std::map<std::string, std::string>& options)
+{
+    if (direct_io) {
+        const auto capacity    = env::properties().get(L"configuration.ffmpeg.consumer.write-buffer", 32);
+        const auto preallocate = env::properties().get(L"configuration.ffmpeg.consumer.preallocate", 0);
+        auto       writer      = std::make_shared<WriteBehind>(path,
+                                                    std::move(graph),
+                                                    static_cast<std::size_t>(capacity) * 1024 * 1024,
+                                                    static_cast<int64_t>(preallocate) * 1024 * 1024);
+        oc->pb = writer->get();
+        oc->flags |= AVFMT_FLAG_CUSTOM_IO;
+        return writer;
+    }
+
+    auto dict = to_dict(std::move(options));
+    CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
+    FF(avio_open2(&oc->pb, path.c_str(), AVIO_FLAG_WRITE, &oc->interrupt_callback, &dict));
+    options = to_map(&dict);
+    return nullptr;
+}
+
+// A file of a segmented recording. Its streams take the parameters of the streams of the recording, whose encoders
+// are shared by all segments, and its timestamps start at the start of the segment.
+struct Segment
+{
+    const int64_t                    index;
+    const AVRational                 length;
+    const std::string                path;
+    std::shared_ptr<WriteBehind>     writer;
+    std::shared_ptr<AVFormatContext> oc;
+
+    Segment(const AVFormatContext*              recording,
+            int64_t                             index,
+            AVRational                          length,
+            const std::string&                  path,
+            bool                                direct_io,
+            std::shared_ptr<diagnostics::graph> graph,
+            std::map<std::string, std::string>& options)
+        : index(index)
+        , length(length)
+        , path(segment_path(path, index))
+    {
+        AVFormatContext* ctx = nullptr;
+        FF(avformat_alloc_output_context2(&ctx, recording->oformat, nullptr, this->path.c_str()));
+        oc = std::shared_ptr<AVFormatContext>(ctx, [](AVFormatContext* ptr) {
+            if (!(ptr->flags & AVFMT_FLAG_CUSTOM_IO)) {
+                avio_closep(&ptr->pb);
+            }
+            avformat_free_context(ptr);
+        });
+        oc->interrupt_callback = recording->interrupt_callback;
+
+        for (auto n = 0U; n < recording->nb_streams; ++n) {
+            auto st = avformat_new_stream(oc.get(), nullptr);
+            if (!st) {
+                FF_RET(AVERROR(ENOMEM), "avformat_new_stream");
+            }
+            FF(avcodec_parameters_copy(st->codecpar, recording->streams[n]->codecpar));
+            st->time_base = recording->streams[n]->time_base;
+        }
+
+        writer = open_output(oc.get(), this->path, direct_io, std::move(graph), options);
+
+        auto dict = to_dict(std::move(options));
+        CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
+        FF(avformat_write_header(oc.get(), &dict));
+        options = to_map(&dict);
+    }
+
+    // Writes pkt, whose timestamps are in time_base of the recording.
+    void write(AVPacket* pkt, AVRational time_base)
+    {
+        const auto offset = av_rescale_q(index, length, time_base);
+        if (pkt->pts != AV_NOPTS_VALUE) {
+            pkt->pts -= offset;
+        }
+        if (pkt->dts != AV_NOPTS_VALUE) {
+            pkt->dts -= offset;
+        }
+        av_packet_rescale_ts(pkt, time_base, oc->streams[pkt->stream_index]->time_base);
+        FF(av_interleaved_write_frame(oc.get(), pkt));
+    }
+
+    void close()
+    {
+        FF(av_write_trailer(oc.get()));
+        if (writer) {
+            oc->pb = nullptr;
+            writer->close();
+        } else {
+            FF(avio_closep(&oc->pb));
+        }
+    }
+};
 
 struct Stream
 {
@@ -91,10 +372,24 @@ struct Stream
     std::shared_ptr<AVCodecContext> enc = nullptr;
     AVStream*                       st  = nullptr;
 
-    tbb::concurrent_bounded_queue<std::shared_ptr<SwsContext>> sws_;
+    std::shared_ptr<AVBufferRef> hw_device = nullptr;
 
     int64_t pts = 0;
 
+    // NOTE: Segmented recordings force a key frame at the start of every segment, so that every file can be decoded
+    // on its own.
+    AVRational segment_length = {0, 1};
+    int64_t    segment        = -1;
+
+    // NOTE: Filtering and encoding run as separate pipeline stages on their own threads, so that the streams and
+    // stages of one consumer do not wait for each other.
+    tbb::concurrent_bounded_queue<std::shared_ptr<AVFrame>> frame_buffer_;
+    tbb::concurrent_bounded_queue<std::shared_ptr<AVFrame>> filter_buffer_;
+    std::thread                                             filter_thread_;
+    std::thread                                             encode_thread_;
+    std::exception_ptr                                      exception_;
+    std::mutex                                              exception_mutex_;
+
     Stream(AVFormatContext*                    oc,
            std::string                         suffix,
            AVCodecID                           codec_id,
@@ -138,6 +433,32 @@ struct Stream
             FF_RET(AVERROR(EINVAL), "avcodec_find_encoder");
         }
 
+        // NOTE: Encoders which only accept device frames, e.g. h264_vaapi and h264_qsv, are fed through hwupload.
+        // Encoders which also accept system memory frames, e.g. h264_nvenc, can be used without it.
+        std::string hwaccel = "";
+        {
+            const auto it = stream_options.find("hwaccel");
+            if (it != stream_options.end()) {
+                hwaccel = std::move(it->second);
+                stream_options.erase(it);
+            }
+        }
+
+        if (!hwaccel.empty() && codec->type == AVMEDIA_TYPE_VIDEO) {
+            const auto type = av_hwdevice_find_type_by_name(hwaccel.c_str());
+            if (type == AV_HWDEVICE_TYPE_NONE) {
+                CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
+                                                        << msg_info_t("unknown hwaccel " + hwaccel));
+            }
+
+            AVBufferRef* device = nullptr;
+            FF(av_hwdevice_ctx_create(&device, type, nullptr, nullptr, 0));
+            hw_device = std::shared_ptr<AVBufferRef>(device, [](AVBufferRef* ptr) { av_buffer_unref(&ptr); });
+
+            filter_spec = (filter_spec.empty() ? "" : filter_spec + ",") + "format=nv12," +
+                          (type == AV_HWDEVICE_TYPE_CUDA ? "hwupload_cuda" : "hwupload");
+        }
+
         AVFilterInOut* outputs = nullptr;
         AVFilterInOut* inputs  = nullptr;
 
@@ -169,6 +490,12 @@ struct Stream
 
         FF(avfilter_graph_parse2(graph.get(), filter_spec.c_str(), &inputs, &outputs));
 
+        if (hw_device) {
+            for (auto n = 0U; n < graph->nb_filters; ++n) {
+                graph->filters[n]->hw_device_ctx = av_buffer_ref(hw_device.get());
+            }
+        }
+
         {
             auto cur = inputs;
 
@@ -280,6 +607,10 @@ struct Stream
             enc->sample_aspect_ratio = av_buffersink_get_sample_aspect_ratio(sink);
             enc->time_base           = st->time_base;
             enc->pix_fmt             = static_cast<AVPixelFormat>(av_buffersink_get_format(sink));
+
+            if (av_buffersink_get_hw_frames_ctx(sink)) {
+                enc->hw_frames_ctx = av_buffer_ref(av_buffersink_get_hw_frames_ctx(sink));
+            }
         } else if (codec->type == AVMEDIA_TYPE_AUDIO) {
             st->time_base = {1, av_buffersink_get_sample_rate(sink)};
 
@@ -318,124 +649,147 @@ struct Stream
         if (oc->oformat->flags & AVFMT_GLOBALHEADER) {
             enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
         }
+
+        frame_buffer_.set_capacity(realtime ? 1 : 8);
+        filter_buffer_.set_capacity(realtime ? 1 : 8);
     }
 
-    std::shared_ptr<SwsContext> get_sws(int width, int height)
+    ~Stream()
     {
-        std::shared_ptr<SwsContext> sws;
-
-        if (sws_.try_pop(sws)) {
-            return sws;
+        frame_buffer_.abort();
+        filter_buffer_.abort();
+        if (filter_thread_.joinable()) {
+            filter_thread_.join();
         }
-
-        sws.reset(sws_getContext(
-                      width, height, AV_PIX_FMT_BGRA, width, height, AV_PIX_FMT_YUVA422P, 0, nullptr, nullptr, nullptr),
-                  [](SwsContext* ptr) { sws_freeContext(ptr); });
-
-        if (!sws) {
-            CASPAR_THROW_EXCEPTION(caspar_exception());
+        if (encode_thread_.joinable()) {
+            encode_thread_.join();
         }
+    }
 
-        int        brigthness;
-        int        contrast;
-        int        saturation;
-        int        in_full;
-        int        out_full;
-        const int* inv_table;
-        const int* table;
-
-        sws_getColorspaceDetails(
-            sws.get(), (int**)&inv_table, &in_full, (int**)&table, &out_full, &brigthness, &contrast, &saturation);
-
-        inv_table = sws_getCoefficients(AVCOL_SPC_RGB);
-        table     = sws_getCoefficients(AVCOL_SPC_BT709);
-
-        in_full  = AVCOL_RANGE_JPEG;
-        out_full = AVCOL_RANGE_MPEG;
+    void start(const std::string&                             name,
+               const core::video_format_desc&                 format_desc,
+               spl::shared_ptr<diagnostics::graph>            graph,
+               std::function<void(std::shared_ptr<AVPacket>)> cb)
+    {
+        graph->set_color(name + "-filter-time", diagnostics::color(0.1f, 1.0f, 0.1f));
+        graph->set_color(name + "-encode-time", diagnostics::color(0.1f, 0.6f, 0.1f));
 
-        sws_setColorspaceDetails(sws.get(), inv_table, in_full, table, out_full, brigthness, contrast, saturation);
+        filter_thread_ = std::thread([=] {
+            run([&] {
+                std::shared_ptr<AVFrame> frame;
+                do {
+                    frame_buffer_.pop(frame);
+                    caspar::timer timer;
+                    filter(frame);
+                    graph->set_value(name + "-filter-time", timer.elapsed() * format_desc.fps * 0.5);
+                } while (frame);
+            });
+        });
 
-        return std::shared_ptr<SwsContext>(sws.get(), [this, sws](SwsContext*) { sws_.push(sws); });
+        encode_thread_ = std::thread([=] {
+            run([&] {
+                std::shared_ptr<AVFrame> frame;
+                do {
+                    filter_buffer_.pop(frame);
+                    caspar::timer timer;
+                    encode(frame, cb);
+                    graph->set_value(name + "-encode-time", timer.elapsed() * format_desc.fps * 0.5);
+                } while (frame);
+            });
+        });
     }
 
-    void send(core::const_frame                              in_frame,
-              const core::video_format_desc&                 format_desc,
-              std::function<void(std::shared_ptr<AVPacket>)> cb)
+    // NOTE: Frames are shared by the streams of a consumer and must not be modified.
+    void push(std::shared_ptr<AVFrame> frame)
     {
-        int                       ret;
-        std::shared_ptr<AVFrame>  frame;
-        std::shared_ptr<AVPacket> pkt;
+        rethrow();
+        try {
+            frame_buffer_.push(std::move(frame));
+        } catch (...) {
+            rethrow();
+            throw;
+        }
+    }
 
-        if (in_frame) {
-            if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
-                frame = make_av_video_frame(in_frame, format_desc);
+    void join()
+    {
+        filter_thread_.join();
+        encode_thread_.join();
+        rethrow();
+    }
 
-                {
-                    auto frame2                 = alloc_frame();
-                    frame2->sample_aspect_ratio = frame->sample_aspect_ratio;
-                    frame2->width               = frame->width;
-                    frame2->height              = frame->height;
-                    frame2->format              = AV_PIX_FMT_YUVA422P;
-                    frame2->colorspace          = AVCOL_SPC_BT709;
-                    frame2->color_primaries     = AVCOL_PRI_BT709;
-                    frame2->color_range         = AVCOL_RANGE_MPEG;
-                    frame2->color_trc           = AVCOL_TRC_BT709;
-                    av_frame_get_buffer(frame2.get(), 64);
-
-                    int h = frame->height / 8;
-                    tbb::parallel_for(0, 8, [&](int i) {
-                        auto sws = get_sws(frame->width, h);
-
-                        uint8_t* src[4] = {};
-                        src[0]          = frame->data[0] + frame->linesize[0] * (i * h);
-
-                        uint8_t* dst[4] = {};
-                        dst[0]          = frame2->data[0] + frame2->linesize[0] * (i * h);
-                        dst[1]          = frame2->data[1] + frame2->linesize[1] * (i * h);
-                        dst[2]          = frame2->data[2] + frame2->linesize[2] * (i * h);
-                        dst[3]          = frame2->data[3] + frame2->linesize[3] * (i * h);
-
-                        sws_scale(sws.get(), src, frame->linesize, 0, h, dst, frame2->linesize);
-                    });
+  private:
+    void run(const std::function<void()>& func)
+    {
+        try {
+            func();
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(exception_mutex_);
+                if (!exception_) {
+                    exception_ = std::current_exception();
+                }
+            }
+            frame_buffer_.abort();
+            filter_buffer_.abort();
+        }
+    }
 
-                    int i = frame->height - h;
-                    if (i > 0) {
-                        // TODO
-                    }
+    void rethrow()
+    {
+        std::lock_guard<std::mutex> lock(exception_mutex_);
+        if (exception_) {
+            std::rethrow_exception(exception_);
+        }
+    }
 
-                    frame = frame2;
-                }
+    void filter(std::shared_ptr<AVFrame> in_frame)
+    {
+        int                      ret;
+        std::shared_ptr<AVFrame> frame;
 
-                frame->pts = pts;
-                pts += 1;
-            } else if (enc->codec_type == AVMEDIA_TYPE_AUDIO) {
-                frame      = make_av_audio_frame(in_frame, format_desc);
-                frame->pts = pts;
-                pts += frame->nb_samples;
-            } else {
-                // TODO
-            }
+        if (in_frame) {
+            frame = alloc_frame();
+            FF(av_frame_ref(frame.get(), in_frame.get()));
+            frame->pts = pts;
+            pts += enc->codec_type == AVMEDIA_TYPE_VIDEO ? 1 : frame->nb_samples;
             FF(av_buffersrc_write_frame(source, frame.get()));
         } else {
             FF(av_buffersrc_close(source, pts, 0));
         }
 
         while (true) {
-            pkt = alloc_packet();
-            ret = avcodec_receive_packet(enc.get(), pkt.get());
-
+            frame = alloc_frame();
+            ret   = av_buffersink_get_frame(sink, frame.get());
             if (ret == AVERROR(EAGAIN)) {
-                frame = alloc_frame();
-                ret   = av_buffersink_get_frame(sink, frame.get());
-                if (ret == AVERROR(EAGAIN)) {
-                    return;
-                } else if (ret == AVERROR_EOF) {
-                    FF(avcodec_send_frame(enc.get(), nullptr));
-                } else {
-                    FF_RET(ret, "av_buffersink_get_frame");
-                    FF(avcodec_send_frame(enc.get(), frame.get()));
-                }
+                return;
             } else if (ret == AVERROR_EOF) {
+                filter_buffer_.push(nullptr);
+                return;
+            } else {
+                FF_RET(ret, "av_buffersink_get_frame");
+                filter_buffer_.push(std::move(frame));
+            }
+        }
+    }
+
+    void encode(std::shared_ptr<AVFrame> frame, const std::function<void(std::shared_ptr<AVPacket>)>& cb)
+    {
+        if (frame && segment_length.num > 0 && enc->codec_type == AVMEDIA_TYPE_VIDEO && frame->pts != AV_NOPTS_VALUE) {
+            const auto index = segment_index(frame->pts, enc->time_base, segment_length);
+            if (index != segment) {
+                frame->pict_type = AV_PICTURE_TYPE_I;
+                segment          = index;
+            }
+        }
+
+        FF(avcodec_send_frame(enc.get(), frame.get()));
+
+        while (true) {
+            auto pkt = alloc_packet();
+            auto ret = avcodec_receive_packet(enc.get(), pkt.get());
+
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
                 return;
             } else {
                 FF_RET(ret, "avcodec_receive_packet");
@@ -457,8 +811,9 @@ struct ffmpeg_consumer : public core::frame_consumer
 
     spl::shared_ptr<diagnostics::graph> graph_;
 
-    std::string path_;
-    std::string args_;
+    std::string       path_;
+    std::string       args_;
+    core::output_size size_;
 
     std::exception_ptr exception_;
     std::mutex         exception_mutex_;
@@ -466,6 +821,8 @@ struct ffmpeg_consumer : public core::frame_consumer
     tbb::concurrent_bounded_queue<core::const_frame> frame_buffer_;
     std::thread                                      frame_thread_;
 
+    std::atomic<bool> abort_request_{false};
+
   public:
     ffmpeg_consumer(std::string path, std::string args, bool realtime)
         : path_(std::move(path))
@@ -479,16 +836,29 @@ struct ffmpeg_consumer : public core::frame_consumer
     {
         state_["file/path"] = u8(path_);
 
+        // NOTE: -size WxH outputs video scaled down on the gpu, e.g. for proxies of a larger channel.
+        static boost::regex size_exp("(^|\\s)-size\\s+(?<WIDTH>\\d+)x(?<HEIGHT>\\d+)");
+        boost::smatch       what;
+        if (boost::regex_search(args_, what, size_exp)) {
+            size_ = core::output_size(std::stoi(what["WIDTH"].str()), std::stoi(what["HEIGHT"].str()));
+        }
+
         frame_buffer_.set_capacity(realtime_ ? 1 : 64);
 
         diagnostics::register_graph(graph_);
-        graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
+        graph_->set_color("convert-time", diagnostics::color(0.9f, 0.9f, 0.1f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("dropped-packet", diagnostics::color(0.6f, 0.3f, 0.3f));
         graph_->set_color("input", diagnostics::color(0.7f, 0.4f, 0.4f));
+        graph_->set_color("output", diagnostics::color(0.4f, 0.4f, 0.7f));
     }
 
     ~ffmpeg_consumer()
     {
+        // NOTE: Interrupts blocking network IO of realtime outputs, so that a stalled stream does not hold up the
+        // channel.
+        abort_request_ = realtime_;
+
         if (frame_thread_.joinable()) {
             frame_buffer_.push(core::const_frame{});
             frame_thread_.join();
@@ -519,12 +889,45 @@ struct ffmpeg_consumer : public core::frame_consumer
                         options[(*it)["NAME"].str().c_str()] =
                             (*it)["VALUE"].matched ? (*it)["VALUE"].str().c_str() : "";
                     }
+                    options.erase("size");
+                }
+
+                // NOTE: -direct_io [1|0] overrides configuration.ffmpeg.consumer.direct-io for this output.
+                auto direct_io = env::properties().get(L"configuration.ffmpeg.consumer.direct-io", false);
+                {
+                    const auto direct_io_it = options.find("direct_io");
+                    if (direct_io_it != options.end()) {
+                        direct_io = direct_io_it->second != "0" && direct_io_it->second != "false";
+                        options.erase(direct_io_it);
+                    }
+                }
+
+                // NOTE: -segment <seconds> records a file numbered after the path for every segment of the recording,
+                // starting on a key frame, instead of one file.
+                AVRational segment_length = {0, 1};
+                {
+                    const auto segment_it = options.find("segment");
+                    if (segment_it != options.end()) {
+                        const auto seconds = std::stod(segment_it->second);
+                        if (seconds > 0.0) {
+                            segment_length = av_d2q(seconds, 1 << 20);
+                        }
+                        options.erase(segment_it);
+                    }
+                }
+
+                auto video_desc = format_desc;
+                if (core::is_scaled(size_, format_desc.width, format_desc.height)) {
+                    video_desc.width  = size_.width;
+                    video_desc.height = size_.height;
+                    video_desc.size   = static_cast<std::size_t>(size_.width) * size_.height * 4;
                 }
 
                 boost::filesystem::path full_path = path_;
 
                 static boost::regex prot_exp("^.+:.*");
-                if (!boost::regex_match(path_, prot_exp)) {
+                const auto          is_local = !boost::regex_match(path_, prot_exp);
+                if (is_local) {
                     if (!full_path.is_complete()) {
                         full_path = u8(env::media_folder()) + path_;
                     }
@@ -555,16 +958,69 @@ struct ffmpeg_consumer : public core::frame_consumer
 
                 CASPAR_SCOPE_EXIT { avformat_free_context(oc); };
 
-                boost::optional<Stream> video_stream;
+                if (segment_length.num > 0 && (!is_local || (oc->oformat->flags & AVFMT_NOFILE))) {
+                    CASPAR_LOG(warning) << print() << " Only local files can be segmented.";
+                    segment_length = {0, 1};
+                }
+
+                oc->interrupt_callback.callback = ffmpeg_consumer::interrupt_cb;
+                oc->interrupt_callback.opaque   = this;
+
+                std::vector<std::unique_ptr<Stream>> video_streams;
                 if (oc->oformat->video_codec != AV_CODEC_ID_NONE) {
                     if (oc->oformat->video_codec == AV_CODEC_ID_H264 && options.find("preset:v") == options.end()) {
                         options["preset:v"] = "veryfast";
                     }
-                    video_stream.emplace(oc, ":v", oc->oformat->video_codec, format_desc, realtime_, options);
+                    if (realtime_ && oc->oformat->video_codec == AV_CODEC_ID_H264 &&
+                        options.find("codec:v") == options.end() && options.find("tune:v") == options.end()) {
+                        options["tune:v"] = "zerolatency";
+                    }
+
+                    // NOTE: Options suffixed :v:<n> configure rendition n, options suffixed :v apply to all of them.
+                    auto renditions = 1;
+                    {
+                        static boost::regex rendition_exp(".+:v:(?<INDEX>\\d+)");
+                        for (auto& p : options) {
+                            boost::smatch what;
+                            if (boost::regex_match(p.first, what, rendition_exp)) {
+                                renditions = std::max(renditions, std::stoi(what["INDEX"].str()) + 1);
+                            }
+                        }
+                    }
+
+                    std::map<std::string, std::string> unused;
+                    for (auto n = 0; n < renditions; ++n) {
+                        const auto suffix = ":v:" + std::to_string(n);
+
+                        std::map<std::string, std::string> stream_options;
+                        for (auto it = options.begin(); it != options.end();) {
+                            if (boost::algorithm::ends_with(it->first, suffix)) {
+                                const auto key = it->first.substr(0, it->first.size() - suffix.size());
+                                stream_options[key + ":v"] = std::move(it->second);
+                                it = options.erase(it);
+                            } else {
+                                ++it;
+                            }
+                        }
+                        for (auto& p : options) {
+                            if (boost::algorithm::ends_with(p.first, ":v")) {
+                                stream_options.insert(p);
+                            }
+                        }
+
+                        video_streams.push_back(std::make_unique<Stream>(
+                            oc, ":v", oc->oformat->video_codec, video_desc, realtime_, stream_options));
+                        unused.insert(stream_options.begin(), stream_options.end());
+                    }
+
+                    for (auto it = options.begin(); it != options.end();) {
+                        it = boost::algorithm::ends_with(it->first, ":v") ? options.erase(it) : std::next(it);
+                    }
+                    options.insert(unused.begin(), unused.end());
 
                     {
                         std::lock_guard<std::mutex> lock(state_mutex_);
-                        state_["file/fps"] = av_q2d(av_buffersink_get_frame_rate(video_stream->sink));
+                        state_["file/fps"] = av_q2d(av_buffersink_get_frame_rate(video_streams[0]->sink));
                     }
                 }
 
@@ -573,15 +1029,33 @@ struct ffmpeg_consumer : public core::frame_consumer
                     audio_stream.emplace(oc, ":a", oc->oformat->audio_codec, format_desc, realtime_, options);
                 }
 
-                if (!(oc->oformat->flags & AVFMT_NOFILE)) {
-                    // TODO (fix) interrupt_cb
-                    auto dict = to_dict(std::move(options));
-                    CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
-                    FF(avio_open2(&oc->pb, full_path.string().c_str(), AVIO_FLAG_WRITE, nullptr, &dict));
-                    options = to_map(&dict);
+                // NOTE: Local recordings may bypass the page cache through a write-behind queue of aligned blocks,
+                // so that long recordings neither evict the cache nor stall the muxer on writeback. faststart
+                // rewrites the file through a second pass of reads, which is left to the default IO.
+                {
+                    const auto movflags_it = options.find("movflags");
+                    if (movflags_it != options.end() && movflags_it->second.find("faststart") != std::string::npos) {
+                        direct_io = false;
+                    }
                 }
+                direct_io = direct_io && is_local;
+
+                // NOTE: Segmented recordings copy the streams of oc into a muxer per segment, oc is never written.
+                std::shared_ptr<WriteBehind>       writer;
+                std::shared_ptr<Segment>           segment;
+                std::map<std::string, std::string> segment_options;
+                if (segment_length.num > 0) {
+                    for (auto& stream : video_streams) {
+                        stream->segment_length = segment_length;
+                    }
+                    segment_options = options;
+                    segment         = std::make_shared<Segment>(
+                        oc, 0, segment_length, full_path.string(), direct_io, graph_, options);
+                } else {
+                    if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+                        writer = open_output(oc, full_path.string(), direct_io, graph_, options);
+                    }
 
-                {
                     auto dict = to_dict(std::move(options));
                     CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
                     FF(avformat_write_header(oc, &dict));
@@ -594,33 +1068,165 @@ struct ffmpeg_consumer : public core::frame_consumer
                     }
                 }
 
+                // NOTE: Realtime outputs buffer about a second of packets which are paced out by their timestamps.
                 tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> packet_buffer;
-                packet_buffer.set_capacity(realtime_ ? 1 : 128);
+                packet_buffer.set_capacity(realtime_ ? std::max(8, static_cast<int>(format_desc.fps)) : 128);
+
+                // NOTE: Segments are opened one ahead and closed on a separate thread, so that the muxer never waits
+                // for a file to be created or for the trailer of the previous one, which is the whole index of mov
+                // and mp4.
+                executor segment_executor(L"ffmpeg_consumer segment");
+                auto     open_segment = [&](int64_t index) {
+                    return segment_executor.begin_invoke([=] {
+                        auto options = segment_options;
+                        return std::make_shared<Segment>(
+                            oc, index, segment_length, full_path.string(), direct_io, graph_, options);
+                    });
+                };
+
+                std::future<std::shared_ptr<Segment>> next_future;
+                if (segment) {
+                    next_future = open_segment(1);
+                }
+
                 auto packet_thread = std::thread([&] {
                     try {
                         CASPAR_SCOPE_EXIT
                         {
-                            if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+                            if (writer) {
+                                oc->pb = nullptr;
+                                writer->close();
+                            } else if (segment_length.num == 0 && !(oc->oformat->flags & AVFMT_NOFILE)) {
                                 FF(avio_closep(&oc->pb));
                             }
                         };
 
                         std::map<int, int64_t> count;
 
+                        // NOTE: Packets are written to the segment which they start in. Streams which run ahead of
+                        // the others, e.g. audio ahead of the video encoder delay, write to the next segment until
+                        // every stream has reached it, then the current one is closed.
+                        std::shared_ptr<Segment> next;
+                        std::set<int>            ahead;
+
+                        auto rotate = [&] {
+                            if (!next) {
+                                next = next_future.get();
+                            }
+                            auto previous = std::move(segment);
+                            segment       = std::move(next);
+                            ahead.clear();
+
+                            segment_executor.begin_invoke([previous] {
+                                try {
+                                    previous->close();
+                                } catch (...) {
+                                    CASPAR_LOG_CURRENT_EXCEPTION();
+                                }
+                            });
+                            next_future = open_segment(segment->index + 1);
+
+                            std::lock_guard<std::mutex> lock(state_mutex_);
+                            state_["file/segment"]      = segment->index;
+                            state_["file/segment-path"] = segment->path;
+                        };
+
+                        auto write_packet = [&](AVPacket* pkt) {
+                            if (!segment) {
+                                FF(av_interleaved_write_frame(oc, pkt));
+                                return;
+                            }
+
+                            const auto time_base = oc->streams[pkt->stream_index]->time_base;
+                            const auto ts        = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+                            const auto index =
+                                ts != AV_NOPTS_VALUE ? segment_index(ts, time_base, segment_length) : segment->index;
+
+                            while (index > segment->index + 1) {
+                                rotate();
+                            }
+
+                            if (index <= segment->index) {
+                                segment->write(pkt, time_base);
+                                return;
+                            }
+
+                            if (!next) {
+                                next = next_future.get();
+                            }
+                            next->write(pkt, time_base);
+
+                            ahead.insert(pkt->stream_index);
+                            if (ahead.size() == oc->nb_streams) {
+                                rotate();
+                            }
+                        };
+
+                        if (segment) {
+                            std::lock_guard<std::mutex> lock(state_mutex_);
+                            state_["file/segment"]      = segment->index;
+                            state_["file/segment-path"] = segment->path;
+                        }
+
+                        boost::optional<std::chrono::steady_clock::time_point> clock;
+                        caspar::timer                                          bitrate_timer;
+                        int64_t                                                bitrate_bytes = 0;
+
                         std::shared_ptr<AVPacket> pkt;
                         while (true) {
                             packet_buffer.pop(pkt);
+                            graph_->set_value("output",
+                                              (static_cast<double>(packet_buffer.size() + 0.001) /
+                                               packet_buffer.capacity()));
                             if (!pkt) {
                                 break;
                             }
+
+                            if (realtime_ && pkt->dts != AV_NOPTS_VALUE) {
+                                const auto time = std::chrono::microseconds(
+                                    av_rescale_q(pkt->dts, oc->streams[pkt->stream_index]->time_base, {1, 1000000}));
+                                if (!clock) {
+                                    clock = std::chrono::steady_clock::now() - time;
+                                }
+                                std::this_thread::sleep_until(*clock + time);
+                            }
+
                             count[pkt->stream_index] += 1;
-                            FF(av_interleaved_write_frame(oc, pkt.get()));
+                            bitrate_bytes += pkt->size;
+                            write_packet(pkt.get());
+
+                            if (bitrate_timer.elapsed() >= 1.0) {
+                                const auto bitrate = static_cast<int64_t>(bitrate_bytes * 8 / bitrate_timer.elapsed());
+
+                                std::lock_guard<std::mutex> lock(state_mutex_);
+                                state_["file/bitrate"] = bitrate;
+                                state_["file/queue"]   = static_cast<int32_t>(packet_buffer.size());
+                                if (writer) {
+                                    state_["file/write-rate"]    = writer->throughput();
+                                    state_["file/write-latency"] = writer->latency();
+                                }
+                                bitrate_bytes = 0;
+                                bitrate_timer.restart();
+                            }
                         }
 
-                        auto video_st = video_stream ? video_stream->st : nullptr;
-                        auto audio_st = audio_stream ? audio_stream->st : nullptr;
+                        auto complete = !audio_stream || count[audio_stream->st->index];
+                        for (auto& stream : video_streams) {
+                            complete = complete && count[stream->st->index];
+                        }
 
-                        if ((!video_st || count[video_st->index]) && (!audio_st || count[audio_st->index])) {
+                        if (segment) {
+                            segment->close();
+                            if (next) {
+                                next->close();
+                            } else {
+                                // NOTE: The segment opened ahead has no packets and is removed.
+                                auto empty = next_future.get();
+                                auto path  = empty->path;
+                                empty.reset();
+                                boost::filesystem::remove(path);
+                            }
+                        } else if (complete) {
                             FF(av_write_trailer(oc));
                         }
 
@@ -640,7 +1246,45 @@ struct ffmpeg_consumer : public core::frame_consumer
                     }
                 };
 
-                auto packet_cb = [&](std::shared_ptr<AVPacket>&& pkt) { packet_buffer.push(std::move(pkt)); };
+                // NOTE: Realtime outputs never block the encoders. Once a packet of a stream is dropped, the stream
+                // is dropped up to its next key frame, so that the output stays decodable.
+                std::mutex    drop_mutex;
+                std::set<int> dropping;
+                std::int64_t  dropped = 0;
+
+                auto packet_cb = [&](std::shared_ptr<AVPacket> pkt) {
+                    if (!realtime_) {
+                        packet_buffer.push(std::move(pkt));
+                        return;
+                    }
+
+                    std::lock_guard<std::mutex> lock(drop_mutex);
+
+                    const auto index = pkt->stream_index;
+                    if (dropping.count(index) && !(pkt->flags & AV_PKT_FLAG_KEY)) {
+                        dropped += 1;
+                    } else if (packet_buffer.try_push(pkt)) {
+                        dropping.erase(index);
+                        return;
+                    } else {
+                        dropping.insert(index);
+                        dropped += 1;
+                        graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-packet");
+                    }
+
+                    std::lock_guard<std::mutex> state_lock(state_mutex_);
+                    state_["file/dropped-packets"] = dropped;
+                };
+
+                for (auto n = 0; n < static_cast<int>(video_streams.size()); ++n) {
+                    const auto name = n > 0 ? "video-" + std::to_string(n) : std::string("video");
+                    video_streams[n]->start(name, video_desc, graph_, packet_cb);
+                }
+                if (audio_stream) {
+                    audio_stream->start("audio", format_desc, graph_, packet_cb);
+                }
+
+                VideoConverter converter;
 
                 std::int32_t frame_number = 0;
                 while (true) {
@@ -654,26 +1298,40 @@ struct ffmpeg_consumer : public core::frame_consumer
                     graph_->set_value("input",
                                       (static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity()));
 
-                    caspar::timer frame_timer;
-                    tbb::parallel_invoke(
-                        [&] {
-                            if (video_stream) {
-                                video_stream->send(frame, format_desc, packet_cb);
-                            }
-                        },
-                        [&] {
-                            if (audio_stream) {
-                                audio_stream->send(frame, format_desc, packet_cb);
-                            }
-                        });
-                    graph_->set_value("frame-time", frame_timer.elapsed() * format_desc.fps * 0.5);
+                    // NOTE: Frames are converted once and shared by all streams.
+                    std::shared_ptr<AVFrame> video_frame;
+                    std::shared_ptr<AVFrame> audio_frame;
+                    if (frame) {
+                        caspar::timer convert_timer;
+                        if (!video_streams.empty()) {
+                            video_frame = converter.convert(frame, video_desc);
+                        }
+                        if (audio_stream) {
+                            audio_frame = make_av_audio_frame(frame, format_desc);
+                        }
+                        graph_->set_value("convert-time", convert_timer.elapsed() * format_desc.fps * 0.5);
+                    }
+
+                    for (auto& stream : video_streams) {
+                        stream->push(video_frame);
+                    }
+                    if (audio_stream) {
+                        audio_stream->push(audio_frame);
+                    }
 
                     if (!frame) {
-                        packet_buffer.push(nullptr);
                         break;
                     }
                 }
 
+                for (auto& stream : video_streams) {
+                    stream->join();
+                }
+                if (audio_stream) {
+                    audio_stream->join();
+                }
+                packet_buffer.push(nullptr);
+
                 packet_thread.join();
             } catch (...) {
                 std::lock_guard<std::mutex> lock(exception_mutex_);
@@ -701,12 +1359,20 @@ struct ffmpeg_consumer : public core::frame_consumer
 
     std::wstring print() const override { return L"ffmpeg[" + u16(path_) + L"]"; }
 
+    static int interrupt_cb(void* ctx)
+    {
+        auto consumer = reinterpret_cast<ffmpeg_consumer*>(ctx);
+        return consumer->abort_request_ ? 1 : 0;
+    }
+
     std::wstring name() const override { return L"ffmpeg"; }
 
     bool has_synchronization_clock() const override { return false; }
 
     int index() const override { return 100000 + channel_index_; }
 
+    core::output_size output_size() const override { return size_; }
+
     core::monitor::state state() const override
     {
         std::lock_guard<std::mutex> lock(state_mutex_);
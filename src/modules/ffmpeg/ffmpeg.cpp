@@ -123,10 +123,10 @@ void log_callback(void* ptr, int level, const char* fmt, va_list vl)
             CASPAR_LOG(debug) << L"[ffmpeg] " << line;
         else if (level == AV_LOG_INFO)
             CASPAR_LOG(info) << L"[ffmpeg] " << line;
-        else if (level == AV_LOG_WARNING)
-            CASPAR_LOG(warning) << L"[ffmpeg] " << line;
+        else if (level == AV_LOG_WARNING) // NOTE: Broken streams warn for every packet.
+            CASPAR_LOG_LIMITED(warning, 10) << L"[ffmpeg] " << line;
         else if (level == AV_LOG_ERROR)
-            CASPAR_LOG(error) << L"[ffmpeg] " << line;
+            CASPAR_LOG_LIMITED(error, 10) << L"[ffmpeg] " << line;
         else if (level == AV_LOG_FATAL)
             CASPAR_LOG(fatal) << L"[ffmpeg] " << line;
         else
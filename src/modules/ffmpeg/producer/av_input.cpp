@@ -1,11 +1,16 @@
 #include "av_input.h"
+#include "av_io.h"
 
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
 
+#include <common/env.h>
 #include <common/except.h>
 #include <common/os/thread.h>
 #include <common/scope_exit.h>
+#include <common/timer.h>
+
+#include <boost/filesystem.hpp>
 
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -18,10 +23,260 @@ extern "C" {
 #pragma warning(pop)
 #endif
 
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <map>
+#include <set>
+#include <vector>
+
 namespace caspar { namespace ffmpeg {
 
-Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph)
+namespace {
+
+struct stream_info
+{
+    std::shared_ptr<AVCodecParameters> codecpar;
+    AVRational                         r_frame_rate;
+    AVRational                         avg_frame_rate;
+    int64_t                            start_time;
+    int64_t                            duration;
+};
+
+struct file_info
+{
+    std::time_t              last_write_time = 0;
+    uintmax_t                size            = 0;
+    std::vector<stream_info> streams;
+    int64_t                  start_time;
+    int64_t                  duration;
+    int64_t                  bit_rate;
+};
+
+// NOTE: Only containers which carry complete codec parameters in their header are safe to open
+// without analysing packets, everything else goes through avformat_find_stream_info every time.
+bool has_complete_header(const AVFormatContext* ic)
+{
+    for (auto name : {"mov", "mxf", "matroska"}) {
+        if (std::strstr(ic->iformat->name, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::mutex                       file_info_mutex;
+std::map<std::string, file_info>    file_info_cache;
+
+bool file_stat(const std::string& filename, std::time_t& last_write_time, uintmax_t& size)
+{
+    boost::system::error_code ec;
+    last_write_time = boost::filesystem::last_write_time(filename, ec);
+    if (ec) {
+        return false;
+    }
+    size = boost::filesystem::file_size(filename, ec);
+    return !ec;
+}
+
+bool restore_stream_info(const std::string& filename, AVFormatContext* ic)
+{
+    std::time_t last_write_time;
+    uintmax_t   size;
+    if (!has_complete_header(ic) || !file_stat(filename, last_write_time, size)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(file_info_mutex);
+
+    auto it = file_info_cache.find(filename);
+    if (it == file_info_cache.end() || it->second.last_write_time != last_write_time || it->second.size != size ||
+        it->second.streams.size() != ic->nb_streams) {
+        return false;
+    }
+
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        auto        st   = ic->streams[n];
+        const auto& info = it->second.streams[n];
+        if (st->codecpar->codec_type != info.codecpar->codec_type ||
+            st->codecpar->codec_id != info.codecpar->codec_id) {
+            return false;
+        }
+    }
+
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        auto        st   = ic->streams[n];
+        const auto& info = it->second.streams[n];
+        FF(avcodec_parameters_copy(st->codecpar, info.codecpar.get()));
+        st->r_frame_rate   = info.r_frame_rate;
+        st->avg_frame_rate = info.avg_frame_rate;
+        st->start_time     = info.start_time;
+        st->duration       = info.duration;
+    }
+    ic->start_time = it->second.start_time;
+    ic->duration   = it->second.duration;
+    ic->bit_rate   = it->second.bit_rate;
+
+    return true;
+}
+
+void store_stream_info(const std::string& filename, const AVFormatContext* ic)
+{
+    file_info info;
+    if (!has_complete_header(ic) || !file_stat(filename, info.last_write_time, info.size)) {
+        return;
+    }
+
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        auto st       = ic->streams[n];
+        auto codecpar = std::shared_ptr<AVCodecParameters>(
+            avcodec_parameters_alloc(), [](AVCodecParameters* ptr) { avcodec_parameters_free(&ptr); });
+        if (!codecpar || avcodec_parameters_copy(codecpar.get(), st->codecpar) < 0) {
+            return;
+        }
+        info.streams.push_back({codecpar, st->r_frame_rate, st->avg_frame_rate, st->start_time, st->duration});
+    }
+    info.start_time = ic->start_time;
+    info.duration   = ic->duration;
+    info.bit_rate   = ic->bit_rate;
+
+    std::lock_guard<std::mutex> lock(file_info_mutex);
+    file_info_cache[filename] = std::move(info);
+}
+
+// The key frames of the video of a file, which are found by reading it once in the background for containers which do
+// not index them in their header. Seeks then jump to the byte position of the key frame before the target.
+struct keyframe
+{
+    int64_t ts;
+    int64_t pos;
+};
+
+struct keyframe_index
+{
+    std::time_t           last_write_time = 0;
+    uintmax_t             size            = 0;
+    std::vector<keyframe> keyframes;
+};
+
+std::mutex                            keyframe_index_mutex;
+std::map<std::string, keyframe_index> keyframe_index_cache;
+std::set<std::string>                 keyframe_index_building;
+
+bool find_keyframe(const std::string& filename, int64_t ts, keyframe& result)
+{
+    std::time_t last_write_time;
+    uintmax_t   size;
+    if (!file_stat(filename, last_write_time, size)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(keyframe_index_mutex);
+
+    auto it = keyframe_index_cache.find(filename);
+    if (it == keyframe_index_cache.end() || it->second.last_write_time != last_write_time ||
+        it->second.size != size) {
+        return false;
+    }
+
+    const auto& keyframes = it->second.keyframes;
+    auto        kf        = std::upper_bound(
+        keyframes.begin(), keyframes.end(), ts, [](int64_t lhs, const keyframe& rhs) { return lhs < rhs.ts; });
+    if (kf == keyframes.begin()) {
+        return false;
+    }
+    result = *std::prev(kf);
+    return true;
+}
+
+// Whether the index of filename has to be built, in which case the caller builds it.
+bool claim_keyframe_index(const std::string& filename)
+{
+    std::time_t last_write_time;
+    uintmax_t   size;
+    if (!file_stat(filename, last_write_time, size)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(keyframe_index_mutex);
+
+    auto it = keyframe_index_cache.find(filename);
+    if (it != keyframe_index_cache.end() && it->second.last_write_time == last_write_time &&
+        it->second.size == size) {
+        return false;
+    }
+    return keyframe_index_building.insert(filename).second;
+}
+
+void build_keyframe_index(const std::string& filename, int stream_index, const AVIOInterruptCB& interrupt)
+{
+    CASPAR_SCOPE_EXIT
+    {
+        std::lock_guard<std::mutex> lock(keyframe_index_mutex);
+        keyframe_index_building.erase(filename);
+    };
+
+    keyframe_index index;
+    if (!file_stat(filename, index.last_write_time, index.size)) {
+        return;
+    }
+
+    AVFormatContext* ic = avformat_alloc_context();
+    if (!ic) {
+        return;
+    }
+    ic->interrupt_callback = interrupt;
+    if (avformat_open_input(&ic, filename.c_str(), nullptr, nullptr) < 0) {
+        return;
+    }
+    CASPAR_SCOPE_EXIT { avformat_close_input(&ic); };
+
+    if (stream_index >= static_cast<int>(ic->nb_streams) ||
+        ic->streams[stream_index]->codecpar->codec_type != AVMEDIA_TYPE_VIDEO) {
+        return;
+    }
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        ic->streams[n]->discard = static_cast<int>(n) == stream_index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+
+    const auto tb     = ic->streams[stream_index]->time_base;
+    auto       packet = alloc_packet();
+    int        ret;
+    while ((ret = av_read_frame(ic, packet.get())) >= 0) {
+        if (packet->stream_index == stream_index && (packet->flags & AV_PKT_FLAG_KEY)) {
+            const auto ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            if (ts != AV_NOPTS_VALUE && packet->pos >= 0) {
+                index.keyframes.push_back({av_rescale_q(ts, tb, {1, AV_TIME_BASE}), packet->pos});
+            }
+        }
+        av_packet_unref(packet.get());
+    }
+
+    if (ret != AVERROR_EOF || index.keyframes.empty()) {
+        return;
+    }
+
+    std::sort(index.keyframes.begin(), index.keyframes.end(), [](const keyframe& lhs, const keyframe& rhs) {
+        return lhs.ts < rhs.ts;
+    });
+
+    CASPAR_LOG(debug) << "av_input[" + filename + "]"
+                      << " Indexed " << index.keyframes.size() << " key frames.";
+
+    std::lock_guard<std::mutex> lock(keyframe_index_mutex);
+    keyframe_index_cache[filename] = std::move(index);
+}
+
+} // namespace
+
+Input::Input(const std::string&                  filename,
+             std::shared_ptr<diagnostics::graph> graph,
+             std::function<void()>               on_packet,
+             int                                 live_latency)
     : graph_(graph)
+    , on_packet_(std::move(on_packet))
+    , live_latency_(live_latency)
     , filename_(filename)
 {
     graph_->set_color("seek", diagnostics::color(1.0f, 0.5f, 0.0f));
@@ -30,6 +285,7 @@ Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> gr
     thread_ = std::thread([=] {
         try {
             set_thread_name(L"[ffmpeg::av_producer::Input]");
+            set_thread_affinity(env::properties().get(L"configuration.ffmpeg.producer.affinity", L""));
 
             while (true) {
                 {
@@ -48,7 +304,11 @@ Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> gr
                 auto packet = alloc_packet();
 
                 // TODO (perf) Non blocking av_read_frame when possible.
-                auto ret = av_read_frame(ic_.get(), packet.get());
+                int ret;
+                {
+                    scoped_timer timer(read_time_);
+                    ret = av_read_frame(ic_.get(), packet.get());
+                }
 
                 {
                     std::lock_guard<std::mutex> lock(mutex_);
@@ -66,6 +326,10 @@ Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> gr
                     graph_->set_value("input", (static_cast<double>(output_.size() + 0.001) / output_capacity_));
                 }
                 cond_.notify_all();
+
+                if (on_packet_) {
+                    on_packet_();
+                }
             }
         } catch (...) {
             CASPAR_LOG_CURRENT_EXCEPTION();
@@ -77,8 +341,14 @@ Input::~Input()
 {
     graph_         = spl::shared_ptr<diagnostics::graph>();
     abort_request_ = true;
+    if (auto io = io_) {
+        io->abort();
+    }
     cond_.notify_all();
     thread_.join();
+    if (index_thread_.joinable()) {
+        index_thread_.join();
+    }
 }
 
 int Input::interrupt_cb(void* ctx)
@@ -116,9 +386,50 @@ void Input::reset()
     // TODO (fix) timeout?
     FF(av_dict_set(&options, "rw_timeout", "60000000", 0)); // 60 second IO timeout
 
+    // NOTE: Live streams are probed briefly and not buffered by the demuxer, the jitter buffer of the producer absorbs
+    // the network jitter instead.
+    if (live_latency_ > 0) {
+        FF(av_dict_set(&options, "fflags", "nobuffer", 0));
+        FF(av_dict_set(&options, "probesize", "500000", 0));
+        FF(av_dict_set(&options, "analyzeduration", "500000", 0));
+        FF(av_dict_set(&options, "rw_timeout", "5000000", 0));
+        if (filename_.find("udp://") == 0) {
+            FF(av_dict_set(&options, "overrun_nonfatal", "1", 0));
+        } else if (filename_.find("srt://") == 0 && filename_.find("latency=") == std::string::npos) {
+            FF(av_dict_set_int(&options, "latency", static_cast<int64_t>(live_latency_) * 1000, 0));
+        }
+    }
+
     AVFormatContext* ic = nullptr;
+
+    // NOTE: Local and network share files are mapped or read ahead, protocols do their own buffering.
+    std::shared_ptr<ReadAhead>  io;
+    std::shared_ptr<MappedFile> mapping;
+    if (filename_.find("://") == std::string::npos) {
+        const auto read_ahead = env::properties().get(L"configuration.ffmpeg.producer.read-ahead", 16);
+        AVIOContext* pb       = nullptr;
+
+        if (env::properties().get(L"configuration.ffmpeg.producer.mmap", false)) {
+            mapping = std::make_shared<MappedFile>(filename_);
+            pb      = mapping->get();
+        } else if (read_ahead > 0) {
+            io = std::make_shared<ReadAhead>(filename_, static_cast<std::size_t>(read_ahead) * 1024 * 1024);
+            pb = io->get();
+        }
+
+        if (pb) {
+            ic = avformat_alloc_context();
+            if (!ic) {
+                FF_RET(AVERROR(ENOMEM), "avformat_alloc_context");
+            }
+            ic->pb = pb;
+            ic->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+    }
+
     FF(avformat_open_input(&ic, filename_.c_str(), nullptr, &options));
-    ic_ = std::shared_ptr<AVFormatContext>(ic, [](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+    ic_ = std::shared_ptr<AVFormatContext>(ic, [io, mapping](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+    io_ = io;
 
     for (auto& p : to_map(&options)) {
         CASPAR_LOG(warning) << "av_input[" + filename_ + "]"
@@ -128,7 +439,31 @@ void Input::reset()
     ic_->interrupt_callback.callback = Input::interrupt_cb;
     ic_->interrupt_callback.opaque   = this;
 
-    FF(avformat_find_stream_info(ic_.get(), nullptr));
+    // NOTE: Reopening a file which has not changed since it was last analysed reuses the stream info.
+    const auto local = filename_.find("://") == std::string::npos;
+    if (!local || !restore_stream_info(filename_, ic_.get())) {
+        FF(avformat_find_stream_info(ic_.get(), nullptr));
+        if (local) {
+            store_stream_info(filename_, ic_.get());
+        }
+    }
+
+    // NOTE: Containers which index their key frames are seeked by the demuxer, the others are indexed once per file.
+    static const auto index_keyframes = env::properties().get(L"configuration.ffmpeg.producer.keyframe-index", true);
+    if (local && index_keyframes && !has_complete_header(ic_.get()) && !index_thread_.joinable()) {
+        const auto stream_index = av_find_best_stream(ic_.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (stream_index >= 0 && claim_keyframe_index(filename_)) {
+            const auto interrupt = ic_->interrupt_callback;
+            index_thread_        = std::thread([=] {
+                try {
+                    set_thread_name(L"[ffmpeg::av_producer::Input::index]");
+                    build_keyframe_index(filename_, stream_index, interrupt);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            });
+        }
+    }
 }
 
 boost::optional<int64_t> Input::start_time() const
@@ -153,11 +488,17 @@ void Input::paused(bool value)
 
 bool Input::eof() const { return eof_; }
 
+int64_t Input::read_time() const { return read_time_; }
+
 void Input::seek(int64_t ts, bool flush)
 {
     std::lock_guard<std::mutex> lock(ic_mutex_);
 
-    if (ts != ic_->start_time && ts != AV_NOPTS_VALUE) {
+    keyframe kf;
+    if (ts != ic_->start_time && ts != AV_NOPTS_VALUE && !(ic_->iformat->flags & AVFMT_NO_BYTE_SEEK) &&
+        find_keyframe(filename_, ts, kf)) {
+        FF(avformat_seek_file(ic_.get(), -1, kf.pos, kf.pos, kf.pos, AVSEEK_FLAG_BYTE));
+    } else if (ts != ic_->start_time && ts != AV_NOPTS_VALUE) {
         FF(avformat_seek_file(ic_.get(), -1, INT64_MIN, ts, ts, 0));
     } else {
         reset();
@@ -19,10 +19,16 @@ struct AVFormatContext;
 
 namespace caspar { namespace ffmpeg {
 
+class ReadAhead;
+
 class Input
 {
   public:
-    Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph);
+    // Live inputs, which have a live_latency in milliseconds, are opened with low latency demuxer options.
+    Input(const std::string&                  filename,
+          std::shared_ptr<diagnostics::graph> graph,
+          std::function<void()>               on_packet    = nullptr,
+          int                                 live_latency = 0);
     ~Input();
 
     static int interrupt_cb(void* ctx);
@@ -43,23 +49,32 @@ class Input
 
     void seek(int64_t ts, bool flush = true);
 
+    // Nanoseconds spent reading packets.
+    int64_t read_time() const;
+
   private:
     std::string                         filename_;
     std::shared_ptr<diagnostics::graph> graph_;
+    std::function<void()>               on_packet_;
+    int                                 live_latency_;
 
     mutable std::mutex               ic_mutex_;
     std::shared_ptr<AVFormatContext> ic_;
+    std::shared_ptr<ReadAhead>       io_;
 
     mutable std::mutex                    mutex_;
     std::condition_variable               cond_;
     std::size_t                           output_capacity_ = 64;
     std::queue<std::shared_ptr<AVPacket>> output_;
 
+    std::atomic<int64_t> read_time_{0};
+
     std::atomic<bool> paused_{true};
     std::atomic<bool> eof_{false};
 
     std::atomic<bool> abort_request_{false};
     std::thread       thread_;
+    std::thread       index_thread_;
 };
 
 }} // namespace caspar::ffmpeg
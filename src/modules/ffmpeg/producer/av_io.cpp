@@ -0,0 +1,714 @@
+#include "av_io.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const int IO_BUFFER_SIZE = 64 * 1024;
+
+// NOTE: Offsets, sizes and buffers of direct writes are multiples of the page size, which covers the logical block
+// size of common storage.
+const std::size_t DIRECT_ALIGNMENT = 4096;
+
+std::shared_ptr<AVIOContext> alloc_io_context(void* opaque,
+                                              int (*read_cb)(void*, uint8_t*, int),
+                                              int64_t (*seek_cb)(void*, int64_t, int),
+                                              int (*write_cb)(void*, uint8_t*, int) = nullptr)
+{
+    auto buffer = static_cast<uint8_t*>(av_malloc(IO_BUFFER_SIZE));
+    auto ctx    = buffer ? avio_alloc_context(
+                            buffer, IO_BUFFER_SIZE, write_cb ? 1 : 0, opaque, read_cb, write_cb, seek_cb)
+                         : nullptr;
+    if (!ctx) {
+        av_free(buffer);
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info_t("avio_alloc_context failed"));
+    }
+    return std::shared_ptr<AVIOContext>(ctx, [](AVIOContext* ptr) {
+        av_freep(&ptr->buffer);
+        avio_context_free(&ptr);
+    });
+}
+
+int64_t file_seek(std::FILE* file, int64_t offset, int whence)
+{
+#ifdef _WIN32
+    return _fseeki64(file, offset, whence);
+#else
+    return fseeko(file, static_cast<off_t>(offset), whence);
+#endif
+}
+
+int64_t file_tell(std::FILE* file)
+{
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return static_cast<int64_t>(ftello(file));
+#endif
+}
+
+std::shared_ptr<uint8_t> alloc_aligned(std::size_t size)
+{
+#ifdef _WIN32
+    auto ptr = static_cast<uint8_t*>(_aligned_malloc(size, DIRECT_ALIGNMENT));
+    if (!ptr) {
+        CASPAR_THROW_EXCEPTION(bad_alloc());
+    }
+    return std::shared_ptr<uint8_t>(ptr, _aligned_free);
+#else
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, DIRECT_ALIGNMENT, size) != 0) {
+        CASPAR_THROW_EXCEPTION(bad_alloc());
+    }
+    return std::shared_ptr<uint8_t>(static_cast<uint8_t*>(ptr), std::free);
+#endif
+}
+
+std::size_t align(std::size_t size) { return (size + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT; }
+
+} // namespace
+
+ReadAhead::ReadAhead(const std::string& filename, std::size_t capacity, std::size_t block_size)
+    : block_size_(block_size)
+    , max_blocks_(std::max<std::size_t>(2, capacity / block_size))
+{
+#ifdef _WIN32
+    file_ = _wfopen(u16(filename).c_str(), L"rb");
+#else
+    file_ = std::fopen(filename.c_str(), "rb");
+#endif
+    if (!file_) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info_t("Failed to open " + filename));
+    }
+
+    // NOTE: Reads are already done in large blocks, stdio buffering would only add a copy.
+    std::setvbuf(file_, nullptr, _IONBF, 0);
+
+#ifndef _WIN32
+    posix_fadvise(fileno(file_), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    if (file_seek(file_, 0, SEEK_END) == 0) {
+        size_ = file_tell(file_);
+    }
+    file_seek(file_, 0, SEEK_SET);
+
+    try {
+        ctx_ = alloc_io_context(this, read_cb, seek_cb);
+    } catch (...) {
+        std::fclose(file_);
+        throw;
+    }
+
+    thread_ = std::thread([this] {
+        set_thread_name(L"[ffmpeg::av_producer::ReadAhead]");
+        run();
+    });
+}
+
+ReadAhead::~ReadAhead()
+{
+    abort();
+    thread_.join();
+    std::fclose(file_);
+}
+
+AVIOContext* ReadAhead::get() const { return ctx_.get(); }
+
+void ReadAhead::abort()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        abort_ = true;
+    }
+    cond_.notify_all();
+}
+
+int ReadAhead::read_cb(void* opaque, uint8_t* buf, int size)
+{
+    return static_cast<ReadAhead*>(opaque)->read(buf, size);
+}
+
+int64_t ReadAhead::seek_cb(void* opaque, int64_t offset, int whence)
+{
+    return static_cast<ReadAhead*>(opaque)->seek(offset, whence);
+}
+
+int ReadAhead::read(uint8_t* buf, int size)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    cond_.wait(lock, [&] { return abort_ || eof_ || !blocks_.empty(); });
+
+    if (abort_) {
+        return AVERROR_EXIT;
+    }
+
+    if (blocks_.empty()) {
+        return error_ != 0 ? error_ : AVERROR_EOF;
+    }
+
+    // NOTE: The front block always contains the current position.
+    auto&      block  = blocks_.front();
+    const auto offset = static_cast<std::size_t>(position_ - block.offset);
+    const auto count  = std::min(static_cast<std::size_t>(size), block.data.size() - offset);
+
+    std::memcpy(buf, block.data.data() + offset, count);
+    position_ += static_cast<int64_t>(count);
+
+    if (offset + count == block.data.size()) {
+        blocks_.pop_front();
+        lock.unlock();
+        cond_.notify_all();
+    }
+
+    return static_cast<int>(count);
+}
+
+int64_t ReadAhead::seek(int64_t offset, int whence)
+{
+    whence &= ~AVSEEK_FORCE;
+
+    if (whence == AVSEEK_SIZE) {
+        return size_ >= 0 ? size_ : AVERROR(ENOSYS);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    int64_t pos;
+    if (whence == SEEK_SET) {
+        pos = offset;
+    } else if (whence == SEEK_CUR) {
+        pos = position_ + offset;
+    } else if (whence == SEEK_END && size_ >= 0) {
+        pos = size_ + offset;
+    } else {
+        return AVERROR(EINVAL);
+    }
+
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    // NOTE: Forward seeks within the cache only drop the skipped blocks.
+    while (!blocks_.empty() && blocks_.front().offset + static_cast<int64_t>(blocks_.front().data.size()) <= pos) {
+        blocks_.pop_front();
+    }
+
+    if (!blocks_.empty() ? blocks_.front().offset > pos : pos != read_pos_) {
+        blocks_.clear();
+        read_pos_ = pos;
+        eof_      = false;
+        error_    = 0;
+        generation_ += 1;
+    }
+
+    position_ = pos;
+
+    lock.unlock();
+    cond_.notify_all();
+
+    return pos;
+}
+
+void ReadAhead::run()
+{
+    int64_t file_pos = 0;
+
+    while (true) {
+        int64_t pos;
+        int     generation;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [&] { return abort_ || (!eof_ && blocks_.size() < max_blocks_); });
+
+            if (abort_) {
+                return;
+            }
+
+            pos        = read_pos_;
+            generation = generation_;
+        }
+
+        Block block;
+        block.offset = pos;
+        block.data.resize(block_size_);
+
+        auto error = 0;
+        if (file_pos != pos && file_seek(file_, pos, SEEK_SET) != 0) {
+            error = AVERROR(EIO);
+        }
+
+        const auto count = error == 0 ? std::fread(block.data.data(), 1, block.data.size(), file_) : 0;
+        if (count < block.data.size() && std::ferror(file_)) {
+            error = AVERROR(EIO);
+            std::clearerr(file_);
+        }
+        file_pos = error == 0 ? pos + static_cast<int64_t>(count) : -1;
+        block.data.resize(count);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            // NOTE: Discard blocks read for a position that has since been seeked away from.
+            if (generation != generation_) {
+                continue;
+            }
+
+            if (count > 0) {
+                blocks_.push_back(std::move(block));
+            }
+            read_pos_ = pos + static_cast<int64_t>(count);
+
+            if (count < block_size_) {
+                eof_   = true;
+                error_ = error;
+            }
+        }
+        cond_.notify_all();
+    }
+}
+
+MappedFile::MappedFile(const std::string& filename)
+    : mapping_(filename.c_str(), boost::interprocess::read_only)
+    , region_(mapping_, boost::interprocess::read_only)
+    , data_(static_cast<const uint8_t*>(region_.get_address()))
+    , size_(static_cast<int64_t>(region_.get_size()))
+{
+    region_.advise(boost::interprocess::mapped_region::advice_sequential);
+
+    ctx_ = alloc_io_context(this, read_cb, seek_cb);
+}
+
+AVIOContext* MappedFile::get() const { return ctx_.get(); }
+
+int MappedFile::read_cb(void* opaque, uint8_t* buf, int size)
+{
+    auto self  = static_cast<MappedFile*>(opaque);
+    auto count = static_cast<int>(std::min<int64_t>(size, self->size_ - self->position_));
+    if (count <= 0) {
+        return AVERROR_EOF;
+    }
+
+    std::memcpy(buf, self->data_ + self->position_, count);
+    self->position_ += count;
+
+    return count;
+}
+
+int64_t MappedFile::seek_cb(void* opaque, int64_t offset, int whence)
+{
+    auto self = static_cast<MappedFile*>(opaque);
+
+    whence &= ~AVSEEK_FORCE;
+
+    int64_t pos;
+    if (whence == AVSEEK_SIZE) {
+        return self->size_;
+    } else if (whence == SEEK_SET) {
+        pos = offset;
+    } else if (whence == SEEK_CUR) {
+        pos = self->position_ + offset;
+    } else if (whence == SEEK_END) {
+        pos = self->size_ + offset;
+    } else {
+        return AVERROR(EINVAL);
+    }
+
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    self->position_ = pos;
+
+    return pos;
+}
+
+WriteBehind::WriteBehind(const std::string&                  filename,
+                         std::shared_ptr<diagnostics::graph> graph,
+                         std::size_t                         capacity,
+                         int64_t                             preallocate,
+                         std::size_t                         block_size)
+    : filename_(filename)
+    , graph_(std::move(graph))
+    , block_size_(align(std::max(block_size, DIRECT_ALIGNMENT)))
+    , max_blocks_(std::max<std::size_t>(2, capacity / block_size_))
+{
+#ifdef _WIN32
+    const auto path  = u16(filename);
+    const auto share = FILE_SHARE_READ | FILE_SHARE_WRITE;
+
+    file_   = CreateFileW(path.c_str(), GENERIC_WRITE, share, nullptr, CREATE_ALWAYS, FILE_FLAG_NO_BUFFERING, nullptr);
+    direct_ = file_ != INVALID_HANDLE_VALUE;
+    if (!direct_) {
+        file_ = CreateFileW(path.c_str(), GENERIC_WRITE, share, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    }
+    if (file_ == INVALID_HANDLE_VALUE) {
+        file_ = nullptr;
+        CASPAR_THROW_EXCEPTION(file_write_error() << msg_info_t("Failed to open " + filename));
+    }
+
+    patch_file_ =
+        CreateFileW(path.c_str(), GENERIC_WRITE, share, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (patch_file_ == INVALID_HANDLE_VALUE) {
+        patch_file_ = nullptr;
+        close_files();
+        CASPAR_THROW_EXCEPTION(file_write_error() << msg_info_t("Failed to open " + filename));
+    }
+
+    // NOTE: Marking the preallocated range valid saves zeroing it, which needs the manage volume privilege.
+    if (preallocate > 0) {
+        LARGE_INTEGER size;
+        size.QuadPart = preallocate;
+        if (SetFilePointerEx(patch_file_, size, nullptr, FILE_BEGIN) && SetEndOfFile(patch_file_)) {
+            SetFileValidData(patch_file_, preallocate);
+        }
+    }
+#else
+    const auto flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    fd_     = ::open(filename.c_str(), flags | O_DIRECT, 0644);
+    direct_ = fd_ >= 0;
+#endif
+    if (fd_ < 0) {
+        fd_ = ::open(filename.c_str(), flags, 0644);
+    }
+    if (fd_ < 0) {
+        CASPAR_THROW_EXCEPTION(file_write_error() << msg_info_t("Failed to open " + filename));
+    }
+
+    patch_fd_ = ::open(filename.c_str(), O_WRONLY);
+    if (patch_fd_ < 0) {
+        close_files();
+        CASPAR_THROW_EXCEPTION(file_write_error() << msg_info_t("Failed to open " + filename));
+    }
+
+#ifdef __linux__
+    // NOTE: The size is kept, preallocated space beyond the end of the recording is released when it is truncated.
+    if (preallocate > 0) {
+        fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(preallocate));
+    }
+#endif
+#endif
+
+    if (!direct_) {
+        CASPAR_LOG(warning) << "[ffmpeg] Direct IO is not supported for " << filename << ", writing it buffered.";
+    }
+
+    graph_->set_color("write-latency", diagnostics::color(0.9f, 0.6f, 0.2f));
+    graph_->set_color("write-queue", diagnostics::color(0.4f, 0.7f, 0.7f));
+
+    try {
+        ctx_   = alloc_io_context(this, nullptr, seek_cb, write_cb);
+        block_ = next_block(0);
+    } catch (...) {
+        close_files();
+        throw;
+    }
+
+    thread_ = std::thread([this] {
+        set_thread_name(L"[ffmpeg::ffmpeg_consumer::WriteBehind]");
+        run();
+    });
+}
+
+WriteBehind::~WriteBehind()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        abort_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+    close_files();
+}
+
+AVIOContext* WriteBehind::get() const { return ctx_.get(); }
+
+int64_t WriteBehind::throughput() const { return throughput_; }
+
+double WriteBehind::latency() const { return latency_ / 1000000.0; }
+
+void WriteBehind::close()
+{
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+
+    avio_flush(ctx_.get());
+
+    if (block_.size > 0) {
+        push(std::move(block_));
+    }
+    drain();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error_ != 0) {
+            CASPAR_THROW_EXCEPTION(file_write_error() << msg_info_t("Failed to write " + filename_));
+        }
+    }
+
+    // NOTE: Direct writes are padded to the alignment, the file is cut back to what the muxer wrote.
+#ifdef _WIN32
+    LARGE_INTEGER size;
+    size.QuadPart = end_;
+    const auto truncated = SetFilePointerEx(patch_file_, size, nullptr, FILE_BEGIN) && SetEndOfFile(patch_file_);
+#else
+    const auto truncated = ::ftruncate(patch_fd_, static_cast<off_t>(end_)) == 0;
+#endif
+    close_files();
+
+    if (!truncated) {
+        CASPAR_THROW_EXCEPTION(file_write_error() << msg_info_t("Failed to truncate " + filename_));
+    }
+}
+
+int WriteBehind::write_cb(void* opaque, uint8_t* buf, int size)
+{
+    return static_cast<WriteBehind*>(opaque)->write(buf, size);
+}
+
+int64_t WriteBehind::seek_cb(void* opaque, int64_t offset, int whence)
+{
+    return static_cast<WriteBehind*>(opaque)->seek(offset, whence);
+}
+
+int WriteBehind::write(const uint8_t* buf, int size)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error_ != 0) {
+            return error_;
+        }
+    }
+
+    auto done = 0;
+    while (done < size) {
+        const auto remaining = static_cast<int64_t>(size - done);
+
+        // NOTE: Data before the block being filled has been queued, it is rewritten once it has been written.
+        if (position_ < block_.offset) {
+            const auto count = std::min(remaining, block_.offset - position_);
+            drain();
+            if (!write_at(buf + done, static_cast<std::size_t>(count), position_, true)) {
+                return AVERROR(EIO);
+            }
+            position_ += count;
+            done += static_cast<int>(count);
+            continue;
+        }
+
+        // NOTE: Seeks past the end leave zeros behind.
+        const auto block_end = block_.offset + static_cast<int64_t>(block_size_);
+        if (position_ >= block_end) {
+            block_.size = block_size_;
+            end_        = std::max(end_, block_end);
+            push(std::move(block_));
+            block_ = next_block(block_end);
+            continue;
+        }
+
+        const auto offset = static_cast<std::size_t>(position_ - block_.offset);
+        const auto count  = std::min(static_cast<std::size_t>(remaining), block_size_ - offset);
+        std::memcpy(block_.data.get() + offset, buf + done, count);
+        position_ += static_cast<int64_t>(count);
+        done += static_cast<int>(count);
+        block_.size = std::max(block_.size, offset + count);
+        end_        = std::max(end_, position_);
+
+        if (block_.size == block_size_) {
+            push(std::move(block_));
+            block_ = next_block(block_end);
+        }
+    }
+
+    return size;
+}
+
+int64_t WriteBehind::seek(int64_t offset, int whence)
+{
+    whence &= ~AVSEEK_FORCE;
+
+    int64_t pos;
+    if (whence == AVSEEK_SIZE) {
+        return end_;
+    } else if (whence == SEEK_SET) {
+        pos = offset;
+    } else if (whence == SEEK_CUR) {
+        pos = position_ + offset;
+    } else if (whence == SEEK_END) {
+        pos = end_ + offset;
+    } else {
+        return AVERROR(EINVAL);
+    }
+
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    position_ = pos;
+
+    return pos;
+}
+
+WriteBehind::Block WriteBehind::next_block(int64_t offset) const
+{
+    Block block;
+    block.offset = offset;
+    block.data   = alloc_aligned(block_size_);
+    std::memset(block.data.get(), 0, block_size_);
+    return block;
+}
+
+void WriteBehind::push(Block block)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&] { return abort_ || error_ != 0 || blocks_.size() < max_blocks_; });
+        blocks_.push_back(std::move(block));
+        graph_->set_value("write-queue", (static_cast<double>(blocks_.size()) + 0.001) / max_blocks_);
+    }
+    cond_.notify_all();
+}
+
+void WriteBehind::drain()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [&] { return abort_ || error_ != 0 || (blocks_.empty() && !writing_); });
+}
+
+void WriteBehind::run()
+{
+    caspar::timer second_timer;
+    int64_t       bytes   = 0;
+    double        longest = 0.0;
+
+    while (true) {
+        Block block;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [&] { return abort_ || !blocks_.empty(); });
+
+            if (abort_) {
+                return;
+            }
+
+            block = std::move(blocks_.front());
+            blocks_.pop_front();
+            writing_ = true;
+        }
+        cond_.notify_all();
+
+        caspar::timer write_timer;
+        const auto    size    = direct_ ? align(block.size) : block.size;
+        const auto    written = write_at(block.data.get(), size, block.offset, false);
+        const auto    elapsed = write_timer.elapsed();
+
+        // NOTE: A tenth of a second is the top of the graph.
+        graph_->set_value("write-latency", elapsed * 10.0);
+
+        bytes += static_cast<int64_t>(block.size);
+        longest = std::max(longest, elapsed);
+        if (second_timer.elapsed() >= 1.0) {
+            throughput_ = static_cast<int64_t>(bytes / second_timer.elapsed());
+            latency_    = static_cast<int64_t>(longest * 1000000.0);
+            bytes       = 0;
+            longest     = 0.0;
+            second_timer.restart();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            writing_ = false;
+            if (!written) {
+                error_ = AVERROR(EIO);
+            }
+            graph_->set_value("write-queue", (static_cast<double>(blocks_.size()) + 0.001) / max_blocks_);
+        }
+        cond_.notify_all();
+    }
+}
+
+bool WriteBehind::write_at(const uint8_t* data, std::size_t size, int64_t offset, bool patch)
+{
+    while (size > 0) {
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset     = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD      count = 0;
+        const auto chunk = static_cast<DWORD>(std::min<std::size_t>(size, 1 << 30));
+        if (!WriteFile(patch ? patch_file_ : file_, data, chunk, &count, &overlapped) || count == 0) {
+            return false;
+        }
+#else
+        const auto count = ::pwrite(patch ? patch_fd_ : fd_, data, size, static_cast<off_t>(offset));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+#endif
+        data += count;
+        size -= static_cast<std::size_t>(count);
+        offset += static_cast<int64_t>(count);
+    }
+    return true;
+}
+
+void WriteBehind::close_files()
+{
+#ifdef _WIN32
+    for (auto file : {&file_, &patch_file_}) {
+        if (*file) {
+            CloseHandle(*file);
+            *file = nullptr;
+        }
+    }
+#else
+    for (auto fd : {&fd_, &patch_fd_}) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+#endif
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <common/diagnostics/graph.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct AVIOContext;
+
+namespace caspar { namespace ffmpeg {
+
+// Reads a local file ahead of the demuxer in large blocks on a separate thread,
+// so that demuxing is not stalled by the latency of network storage.
+class ReadAhead
+{
+  public:
+    ReadAhead(const std::string& filename, std::size_t capacity, std::size_t block_size = 1024 * 1024);
+    ~ReadAhead();
+
+    ReadAhead(const ReadAhead&) = delete;
+    ReadAhead& operator=(const ReadAhead&) = delete;
+
+    AVIOContext* get() const;
+
+    void abort();
+
+  private:
+    struct Block
+    {
+        int64_t              offset = 0;
+        std::vector<uint8_t> data;
+    };
+
+    static int     read_cb(void* opaque, uint8_t* buf, int size);
+    static int64_t seek_cb(void* opaque, int64_t offset, int whence);
+
+    int     read(uint8_t* buf, int size);
+    int64_t seek(int64_t offset, int whence);
+
+    void run();
+
+    std::FILE*                   file_ = nullptr;
+    int64_t                      size_ = -1;
+    std::size_t                  block_size_;
+    std::size_t                  max_blocks_;
+    std::shared_ptr<AVIOContext> ctx_;
+
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    std::deque<Block>       blocks_;
+    int64_t                 position_   = 0;
+    int64_t                 read_pos_   = 0;
+    int                     generation_ = 0;
+    bool                    eof_        = false;
+    bool                    abort_      = false;
+    int                     error_      = 0;
+
+    std::thread thread_;
+};
+
+// Serves a local file straight from a memory mapping, large demuxer reads are
+// copied from the mapped pages into the packet without going through read().
+class MappedFile
+{
+  public:
+    explicit MappedFile(const std::string& filename);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    AVIOContext* get() const;
+
+  private:
+    static int     read_cb(void* opaque, uint8_t* buf, int size);
+    static int64_t seek_cb(void* opaque, int64_t offset, int whence);
+
+    boost::interprocess::file_mapping  mapping_;
+    boost::interprocess::mapped_region region_;
+    const uint8_t*                     data_;
+    int64_t                            size_;
+    int64_t                            position_ = 0;
+    std::shared_ptr<AVIOContext>       ctx_;
+};
+
+// Writes a local file behind the muxer in large aligned blocks on a separate thread, bypassing the page cache with
+// O_DIRECT or FILE_FLAG_NO_BUFFERING, so that recordings do not evict the pages of the files being played. The muxer
+// waits once capacity bytes are queued. Muxers which seek back to rewrite their headers are served from the block
+// being filled, or by a buffered write once the blocks before it have been written.
+class WriteBehind
+{
+  public:
+    WriteBehind(const std::string&                  filename,
+                std::shared_ptr<diagnostics::graph> graph,
+                std::size_t                         capacity,
+                int64_t                             preallocate = 0,
+                std::size_t                         block_size  = 4 * 1024 * 1024);
+    ~WriteBehind();
+
+    WriteBehind(const WriteBehind&) = delete;
+    WriteBehind& operator=(const WriteBehind&) = delete;
+
+    AVIOContext* get() const;
+
+    // Writes the rest of the file and truncates it to its size, after the muxer has been flushed.
+    void close();
+
+    // Bytes written per second and the longest write of a block in seconds, over the last second.
+    int64_t throughput() const;
+    double  latency() const;
+
+  private:
+    struct Block
+    {
+        int64_t                  offset = 0;
+        std::size_t              size   = 0;
+        std::shared_ptr<uint8_t> data;
+    };
+
+    static int     write_cb(void* opaque, uint8_t* buf, int size);
+    static int64_t seek_cb(void* opaque, int64_t offset, int whence);
+
+    int     write(const uint8_t* buf, int size);
+    int64_t seek(int64_t offset, int whence);
+
+    Block next_block(int64_t offset) const;
+    void  push(Block block);
+    void  drain();
+    void  run();
+
+    bool write_at(const uint8_t* data, std::size_t size, int64_t offset, bool patch);
+    void close_files();
+
+    const std::string                   filename_;
+    std::shared_ptr<diagnostics::graph> graph_;
+    const std::size_t                   block_size_;
+    const std::size_t                   max_blocks_;
+#ifdef _WIN32
+    void* file_       = nullptr;
+    void* patch_file_ = nullptr;
+#else
+    int fd_       = -1;
+    int patch_fd_ = -1;
+#endif
+    bool                         direct_ = false;
+    std::shared_ptr<AVIOContext> ctx_;
+
+    // NOTE: Only used by the muxer thread.
+    Block   block_;
+    int64_t position_ = 0;
+    int64_t end_      = 0;
+    bool    closed_   = false;
+
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    std::deque<Block>       blocks_;
+    bool                    writing_ = false;
+    bool                    abort_   = false;
+    int                     error_   = 0;
+
+    std::atomic<int64_t> throughput_{0};
+    std::atomic<int64_t> latency_{0};
+
+    std::thread thread_;
+};
+
+}} // namespace caspar::ffmpeg
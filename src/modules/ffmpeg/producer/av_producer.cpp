@@ -15,6 +15,8 @@
 #include <boost/thread/mutex.hpp>
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
+#include <common/env.h>
 #include <common/except.h>
 #include <common/os/thread.h>
 #include <common/scope_exit.h>
@@ -23,6 +25,7 @@
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame.h>
 #include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
 #include <core/monitor/monitor.h>
 
 #ifdef _MSC_VER
@@ -37,7 +40,9 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
 #include <libavutil/error.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/samplefmt.h>
 }
@@ -47,13 +52,18 @@ extern "C" {
 
 #include <tbb/parallel_for_each.h>
 #include <tbb/parallel_invoke.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_init.h>
 
 #include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <deque>
 #include <exception>
 #include <iomanip>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <sstream>
 #include <string>
@@ -62,29 +72,109 @@ namespace caspar { namespace ffmpeg {
 
 const AVRational TIME_BASE_Q = {1, AV_TIME_BASE};
 
+// NOTE: All producers decode as tasks in a single arena, codecs share the same thread budget.
+struct Scheduler
+{
+    const int threads = [] {
+        auto threads = env::properties().get(L"configuration.ffmpeg.producer.threads", 0);
+        return threads > 0 ? threads : tbb::task_scheduler_init::default_num_threads();
+    }();
+
+    tbb::task_arena  arena{threads, 0};
+    std::atomic<int> producers{0};
+    std::atomic<int> on_air{0};
+
+    // NOTE: Decoded frames buffered by all producers, which share the budget with on air producers weighted double.
+    const int64_t memory_budget = env::properties().get(L"configuration.ffmpeg.producer.memory", 2048) * 1048576LL;
+    std::atomic<int64_t> memory{0};
+
+    int codec_threads() const { return std::max(1, std::min(16, threads / std::max(1, producers.load()))); }
+
+    int64_t memory_share(bool is_on_air) const
+    {
+        return memory_budget * (is_on_air ? 2 : 1) / std::max(1, producers.load() + on_air.load());
+    }
+};
+
+Scheduler& scheduler()
+{
+    static Scheduler instance;
+    return instance;
+}
+
 struct Frame
 {
     std::shared_ptr<AVFrame> video;
+    std::shared_ptr<AVFrame> matte; // gray key of video, from a second video stream of the same height
     std::shared_ptr<AVFrame> audio;
     int64_t                  pts      = AV_NOPTS_VALUE;
     int64_t                  duration = 0;
+    core::field_mode         field    = core::field_mode::progressive;
+    core::draw_frame         frame;
 };
 
+int64_t frame_size(const Frame& frame)
+{
+    int64_t size = 0;
+    for (auto av_frame : {frame.video.get(), frame.matte.get(), frame.audio.get()}) {
+        for (auto n = 0; av_frame && n < AV_NUM_DATA_POINTERS && av_frame->buf[n]; ++n) {
+            size += av_frame->buf[n]->size;
+        }
+    }
+    return size;
+}
+
 // TODO (fix) Handle ts discontinuities.
 // TODO (feat) Forward options.
 
+static AVPixelFormat get_hw_format(AVCodecContext* ctx, const AVPixelFormat* formats)
+{
+    const auto hw_pix_fmt = static_cast<AVPixelFormat>(reinterpret_cast<intptr_t>(ctx->opaque));
+    for (auto format = formats; *format != AV_PIX_FMT_NONE; ++format) {
+        if (*format == hw_pix_fmt) {
+            return *format;
+        }
+    }
+    // NOTE: Fall back to software decoding, e.g. for profiles the device does not support.
+    return avcodec_default_get_format(ctx, formats);
+}
+
+static AVBufferRef* get_hw_device(AVHWDeviceType type)
+{
+    // NOTE: Devices are shared by all decoders and kept open for the lifetime of the process.
+    static std::mutex                                             mutex;
+    static std::map<AVHWDeviceType, std::shared_ptr<AVBufferRef>> devices;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = devices.find(type);
+    if (it == devices.end()) {
+        AVBufferRef* device = nullptr;
+        if (av_hwdevice_ctx_create(&device, type, nullptr, nullptr, 0) < 0) {
+            return nullptr;
+        }
+        auto ptr = std::shared_ptr<AVBufferRef>(device, [](AVBufferRef* ptr) { av_buffer_unref(&ptr); });
+        it       = devices.emplace(type, std::move(ptr)).first;
+    }
+
+    return av_buffer_ref(it->second.get());
+}
+
 struct Decoder
 {
     AVStream*                             st;
     std::shared_ptr<AVCodecContext>       ctx;
     int64_t                               next_pts = AV_NOPTS_VALUE;
+    int64_t                               discard  = AV_NOPTS_VALUE;
     std::queue<std::shared_ptr<AVPacket>> input;
     std::shared_ptr<AVFrame>              frame;
-    bool                                  eof = false;
+    bool                                  eof        = false;
+    AVPixelFormat                         pix_fmt    = AV_PIX_FMT_NONE;
+    AVPixelFormat                         hw_pix_fmt = AV_PIX_FMT_NONE;
 
     Decoder() = default;
 
-    Decoder(AVStream* stream)
+    Decoder(AVStream* stream, const std::string& hwaccel)
         : st(stream)
     {
         const auto codec = avcodec_find_decoder(stream->codecpar->codec_id);
@@ -102,7 +192,6 @@ struct Decoder
         FF(avcodec_parameters_to_context(ctx.get(), stream->codecpar));
 
         FF(av_opt_set_int(ctx.get(), "refcounted_frames", 1, 0));
-        FF(av_opt_set_int(ctx.get(), "threads", 4, 0));
         // FF(av_opt_set_int(ctx.get(), "enable_er", 1, 0));
 
         ctx->pkt_timebase = stream->time_base;
@@ -110,6 +199,12 @@ struct Decoder
         if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
             ctx->framerate           = av_guess_frame_rate(nullptr, stream, nullptr);
             ctx->sample_aspect_ratio = av_guess_sample_aspect_ratio(nullptr, stream, nullptr);
+
+            pix_fmt = ctx->pix_fmt;
+
+            if (!hwaccel.empty()) {
+                open_hwaccel(codec, hwaccel);
+            }
         } else if (ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
             if (!ctx->channel_layout && ctx->channels) {
                 ctx->channel_layout = av_get_default_channel_layout(ctx->channels);
@@ -119,12 +214,50 @@ struct Decoder
             }
         }
 
+        // NOTE: The device decodes, frame threads would only hold more surfaces.
+        FF(av_opt_set_int(ctx.get(), "threads", hw_pix_fmt != AV_PIX_FMT_NONE ? 1 : scheduler().codec_threads(), 0));
+
         if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) {
             ctx->thread_type = FF_THREAD_SLICE;
         }
 
         FF(avcodec_open2(ctx.get(), codec, nullptr));
     }
+
+    void open_hwaccel(const AVCodec* codec, const std::string& hwaccel)
+    {
+        const auto type = av_hwdevice_find_type_by_name(hwaccel.c_str());
+        if (type == AV_HWDEVICE_TYPE_NONE) {
+            CASPAR_LOG(warning) << "[ffmpeg] Unknown hwaccel " << hwaccel << ", using software decoding.";
+            return;
+        }
+
+        for (auto n = 0;; ++n) {
+            const auto config = avcodec_get_hw_config(codec, n);
+            if (!config) {
+                return;
+            }
+            if ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX) && config->device_type == type) {
+                hw_pix_fmt = config->pix_fmt;
+                break;
+            }
+        }
+
+        auto device = get_hw_device(type);
+        if (!device) {
+            CASPAR_LOG(warning) << "[ffmpeg] Failed to open " << hwaccel << " device, using software decoding.";
+            hw_pix_fmt = AV_PIX_FMT_NONE;
+            return;
+        }
+
+        ctx->hw_device_ctx = device;
+        ctx->opaque        = reinterpret_cast<void*>(static_cast<intptr_t>(hw_pix_fmt));
+        ctx->get_format    = get_hw_format;
+
+        // NOTE: Surfaces are downloaded as semi planar frames, which are uploaded to the mixer as they are.
+        const auto desc = av_pix_fmt_desc_get(ctx->pix_fmt);
+        pix_fmt         = desc && desc->comp[0].depth > 8 ? AV_PIX_FMT_P010 : AV_PIX_FMT_NV12;
+    }
 };
 
 struct Filter
@@ -142,14 +275,21 @@ struct Filter
            std::map<int, Decoder>&        streams,
            int64_t                        start_time,
            AVMediaType                    media_type,
-           const core::video_format_desc& format_desc)
+           const core::video_format_desc& format_desc,
+           const std::string&             hwaccel,
+           bool                           gpu_deinterlace = false,
+           bool                           matte           = false)
     {
         if (media_type == AVMEDIA_TYPE_VIDEO) {
             if (filter_spec.empty()) {
                 filter_spec = "null";
             }
 
-            filter_spec += (boost::format(",bwdif=mode=send_field:parity=auto:deint=all")).str();
+            // NOTE: Fields are otherwise shown by the image mixer, from frames which the frame rate filter repeats
+            // without copying them.
+            if (!gpu_deinterlace) {
+                filter_spec += (boost::format(",bwdif=mode=send_field:parity=auto:deint=all")).str();
+            }
 
             filter_spec += (boost::format(",fps=fps=%d/%d:start_time=%f") % format_desc.framerate.numerator() %
                             format_desc.framerate.denominator() % (static_cast<double>(start_time) / AV_TIME_BASE))
@@ -238,12 +378,21 @@ struct Filter
                 return s->codecpar->codec_type == AVMEDIA_TYPE_VIDEO;
             });
 
+            // NOTE: A second video stream of the same height is the matte of the first. Instead of merging it into
+            // the fill as an alpha plane, it is filtered by a graph of its own into a gray image, which the image
+            // mixer draws as the key of the fill.
             // TODO (fix) Use some form of stream meta data to do this.
             // https://github.com/CasparCG/server/issues/832
-            if (video_av_streams.size() >= 2 &&
-                video_av_streams[0]->codecpar->height == video_av_streams[1]->codecpar->height) {
-                filter_spec = "alphamerge," + filter_spec;
+            const auto has_matte = video_av_streams.size() >= 2 &&
+                                   video_av_streams[0]->codecpar->height == video_av_streams[1]->codecpar->height;
+            if (matte && !has_matte) {
+                return;
+            }
+            if (matte) {
+                av_streams.erase(std::find(av_streams.begin(), av_streams.end(), video_av_streams[0]));
             }
+        } else if (matte) {
+            return;
         }
 
         graph = std::shared_ptr<AVFilterGraph>(avfilter_graph_alloc(),
@@ -286,14 +435,14 @@ struct Filter
 
                 auto it = streams.find(index);
                 if (it == streams.end()) {
-                    it = streams.emplace(index, input->streams[index]).first;
+                    it = streams.emplace(index, Decoder(input->streams[index], hwaccel)).first;
                 }
 
                 auto st = it->second.ctx;
 
                 if (st->codec_type == AVMEDIA_TYPE_VIDEO) {
                     auto args = (boost::format("video_size=%dx%d:pix_fmt=%d:time_base=%d/%d") % st->width % st->height %
-                                 st->pix_fmt % st->pkt_timebase.num % st->pkt_timebase.den)
+                                 it->second.pix_fmt % st->pkt_timebase.num % st->pkt_timebase.den)
                                     .str();
                     auto name = (boost::format("in_%d") % index).str();
 
@@ -339,7 +488,8 @@ struct Filter
 #pragma warning(push)
 #pragma warning(disable : 4245)
 #endif
-            const AVPixelFormat pix_fmts[] = {AV_PIX_FMT_RGB24,
+            const AVPixelFormat pix_fmts[] = {AV_PIX_FMT_GRAY8,
+                                              AV_PIX_FMT_RGB24,
                                               AV_PIX_FMT_BGR24,
                                               AV_PIX_FMT_BGRA,
                                               AV_PIX_FMT_ARGB,
@@ -352,8 +502,22 @@ struct Filter
                                               AV_PIX_FMT_YUVA444P,
                                               AV_PIX_FMT_YUVA422P,
                                               AV_PIX_FMT_YUVA420P,
+                                              AV_PIX_FMT_YUV444P10LE,
+                                              AV_PIX_FMT_YUV422P10LE,
+                                              AV_PIX_FMT_YUV420P10LE,
+                                              AV_PIX_FMT_NV12,
+                                              AV_PIX_FMT_NV16,
+                                              AV_PIX_FMT_P010LE,
+                                              AV_PIX_FMT_P016LE,
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 17, 100)
+                                              AV_PIX_FMT_P210LE,
+                                              AV_PIX_FMT_P216LE,
+#endif
+                                              AV_PIX_FMT_UYVY422,
                                               AV_PIX_FMT_NONE};
-            FF(av_opt_set_int_list(sink, "pix_fmts", pix_fmts, -1, AV_OPT_SEARCH_CHILDREN));
+
+            const AVPixelFormat matte_pix_fmts[] = {AV_PIX_FMT_GRAY8, AV_PIX_FMT_NONE};
+            FF(av_opt_set_int_list(sink, "pix_fmts", matte ? matte_pix_fmts : pix_fmts, -1, AV_OPT_SEARCH_CHILDREN));
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -367,7 +531,9 @@ struct Filter
             const AVSampleFormat sample_fmts[] = {AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_NONE};
             FF(av_opt_set_int_list(sink, "sample_fmts", sample_fmts, -1, AV_OPT_SEARCH_CHILDREN));
 
-            // TODO Always output 8 channels and remove hack in make_frame.
+            // Remap to the channel layout of the channel once, here, rather than for every frame.
+            const int64_t channel_layouts[] = {av_get_default_channel_layout(format_desc.audio_channels), -1};
+            FF(av_opt_set_int_list(sink, "channel_layouts", channel_layouts, -1, AV_OPT_SEARCH_CHILDREN));
 
             const int sample_rates[] = {format_desc.audio_sample_rate, -1};
             FF(av_opt_set_int_list(sink, "sample_rates", sample_rates, -1, AV_OPT_SEARCH_CHILDREN));
@@ -415,13 +581,29 @@ struct AVProducer::Impl
 
     std::vector<int> audio_cadence_ = format_desc_.audio_cadence;
 
+    // NOTE: Must outlive input_ since its thread signals new packets through it.
+    boost::mutex              event_mutex_;
+    boost::condition_variable event_cond_;
+    bool                      event_         = false;
+    bool                      ready_         = false;
+    bool                      running_       = false;
+    bool                      abort_request_ = false;
+    std::atomic<bool>         on_air_{false};
+
     Input                  input_;
     std::map<int, Decoder> decoders_;
     Filter                 video_filter_;
+    Filter                 matte_filter_;
     Filter                 audio_filter_;
 
     std::map<int, std::vector<AVFilterContext*>> sources_;
 
+    // NOTE: Graphs prepared ahead for the loop point, used if the stream parameters are unchanged.
+    std::string spare_key_;
+    Filter      spare_video_filter_;
+    Filter      spare_matte_filter_;
+    Filter      spare_audio_filter_;
+
     int64_t start_    = AV_NOPTS_VALUE;
     int64_t duration_ = AV_NOPTS_VALUE;
     int64_t seek_     = AV_NOPTS_VALUE;
@@ -429,20 +611,75 @@ struct AVProducer::Impl
 
     std::string afilter_;
     std::string vfilter_;
+    std::string hwaccel_;
+    const bool  gpu_deinterlace_;
+
+    // NOTE: Files without a video stream are decoded further ahead and in batches, without a video filter graph.
+    bool audio_only_ = false;
 
-    mutable boost::mutex      mutex_;
-    boost::condition_variable cond_;
+    mutable boost::mutex mutex_;
 
     int64_t          frame_time_  = 0;
     bool             frame_flush_ = true;
     core::draw_frame frame_;
 
+    // NOTE: Whether the layer is seen, and the last frame played while it was not, which is only converted if a
+    // still of it is needed.
+    std::atomic<bool> visible_{true};
+    Frame             hidden_frame_;
+
     std::deque<Frame> buffer_;
     std::atomic<bool> buffer_eof_{false};
+    std::atomic<bool> buffer_ready_{false};
     int               buffer_capacity_ = static_cast<int>(format_desc_.fps / 2);
+    int               preroll_         = 0;
+
+    // NOTE: The buffer capacity follows the share of the memory budget, producers which underflow get up to
+    // twice the default capacity.
+    const int            buffer_default_ = buffer_capacity_;
+    int64_t              frame_size_     = 0;
+    std::atomic<int64_t> memory_{0};
+    int                  underflows_      = 0;
+    int                  underflow_decay_ = 0;
+
+    // NOTE: Live streams play from a jitter buffer of live_target_ frames. Frames are dropped or repeated once the
+    // average fill of the buffer drifts further than live_tolerance_ from it, which keeps the latency constant against
+    // the channel clock.
+    const int live_latency_;
+    const int live_target_;
+    const int live_tolerance_;
+    bool      live_primed_   = false;
+    double    live_fill_     = 0.0;
+    int64_t   live_dropped_  = 0;
+    int64_t   live_repeated_ = 0;
 
     tbb::task_group_context task_context_;
 
+    // NOTE: Nanoseconds spent in each stage and the frames decoded, reported in the state for profiling.
+    std::atomic<int64_t> decode_time_{0};
+    std::atomic<int64_t> filter_time_{0};
+    std::atomic<int64_t> convert_time_{0};
+    std::atomic<int64_t> frames_decoded_{0};
+
+    caspar::timer frame_timer_;
+    Frame         last_frame_;
+    int           warning_debounce_ = 0;
+
+    // NOTE: Decoded and converted frames from start_, spliced in at the loop point while the input seeks.
+    std::vector<Frame> loop_head_;
+    int                loop_head_capacity_ = std::max(4, buffer_capacity_ / 2);
+    bool               loop_capture_       = false;
+    int64_t            loop_skip_          = AV_NOPTS_VALUE;
+
+    // NOTE: Frames are repeated or skipped at other speeds than 1. Reverse playback decodes the segment
+    // [segment_start_, segment_end_) forward in the background and plays it back in reverse order.
+    double             speed_            = 1.0;
+    double             speed_position_   = 1.0;
+    std::vector<Frame> segment_;
+    bool               segment_decoding_ = false;
+    int64_t            segment_start_    = AV_NOPTS_VALUE;
+    int64_t            segment_end_      = AV_NOPTS_VALUE;
+
     boost::thread thread_;
 
     Impl(std::shared_ptr<core::frame_factory> frame_factory,
@@ -453,183 +690,79 @@ struct AVProducer::Impl
          std::string                          afilter,
          boost::optional<int64_t>             start,
          boost::optional<int64_t>             duration,
-         bool                                 loop)
+         bool                                 loop,
+         int                                  preroll,
+         std::string                          hwaccel,
+         int                                  live_latency,
+         bool                                 gpu_deinterlace)
         : frame_factory_(frame_factory)
         , format_desc_(format_desc)
         , format_tb_({format_desc.duration, format_desc.time_scale})
         , path_(path)
         , name_(name)
-        , input_(path, graph_)
+        , input_(path, graph_, [this] { notify(); }, live_latency)
         , start_(start ? av_rescale_q(*start, format_tb_, TIME_BASE_Q) : AV_NOPTS_VALUE)
         , duration_(duration ? av_rescale_q(*duration, format_tb_, TIME_BASE_Q) : AV_NOPTS_VALUE)
         , loop_(loop)
         , vfilter_(vfilter)
         , afilter_(afilter)
+        , preroll_(std::max(0, preroll))
+        , live_latency_(std::max(0, live_latency))
+        , live_target_(std::max(1, static_cast<int>(live_latency_ * format_desc_.fps / 1000.0 + 0.5)))
+        , live_tolerance_(std::max(1, live_target_ / 2))
+        , hwaccel_(hwaccel)
+        , gpu_deinterlace_(gpu_deinterlace)
     {
+        buffer_capacity_ = std::max(buffer_capacity_, preroll_);
+        loop_capture_    = loop_;
+
         diagnostics::register_graph(graph_);
         graph_->set_color("underflow", diagnostics::color(0.6f, 0.3f, 0.9f));
         graph_->set_color("frame-time", caspar::diagnostics::color(0.0f, 1.0f, 0.0f));
+        if (live_latency_ > 0) {
+            graph_->set_color("live-latency", diagnostics::color(0.9f, 0.9f, 0.3f));
+            graph_->set_color("live-correction", diagnostics::color(1.0f, 0.5f, 0.0f));
+        }
 
         state_["file/name"] = u8(name_);
         state_["file/path"] = u8(path_);
         state_["loop"]      = loop;
+        state_["speed"]     = speed_;
         update_state();
 
+        scheduler().producers += 1;
+
         thread_ = boost::thread([=] {
             try {
-                input_.reset();
-
-                for (auto n = 0UL; n < input_->nb_streams; ++n) {
-                    auto st = input_->streams[n];
-                    auto framerate = av_guess_frame_rate(nullptr, st, nullptr);
-                    state_["file/streams/" + boost::lexical_cast<std::string>(n) + "/fps"] = { framerate.num,
-                        framerate.den };
-                }
-
-                if (duration_ == AV_NOPTS_VALUE && input_->duration_estimation_method != AVFMT_DURATION_FROM_BITRATE) {
-                    duration_ = input_->duration;
-                }
-
-                if (start_ != AV_NOPTS_VALUE) {
-                    input_.seek(start_);
-                    reset(start_);
-                } else {
-                    reset(input_.start_time().value_or(0));
-                }
-
-                input_.paused(false);
-
-                caspar::timer frame_timer;
-
                 set_thread_name(L"[ffmpeg::av_producer]");
-
-                boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
-
-                Frame frame;
-
-                int warning_debounce = 0;
-
-                while (!boost::this_thread::interruption_requested()) {
-                    boost::unique_lock<boost::mutex> lock(mutex_);
-
-                    cond_.wait(lock, [&] { return buffer_.size() < buffer_capacity_; });
-
-                    // NOTE: Throttle.
-                    if (buffer_.size() > buffer_capacity_ / 2) {
-                        cond_.wait_for(lock, boost::chrono::milliseconds(10));
-                    } else if (buffer_.size() > 2) {
-                        cond_.wait_for(lock, boost::chrono::milliseconds(5));
-                    }
-
-                    frame_timer.restart();
-
-                    if (seek_ != AV_NOPTS_VALUE) {
-                        seek_ = AV_NOPTS_VALUE;
-                        seek_internal(seek_);
-                        continue;
-                    }
-
-                    {
-                        // TODO (perf) seek as soon as input is past duration or eof.
-
-                        auto start = start_ != AV_NOPTS_VALUE ? start_ : 0;
-                        auto end   = duration_ != AV_NOPTS_VALUE ? start + duration_ : INT64_MAX;
-                        auto time  = frame.pts != AV_NOPTS_VALUE ? frame.pts + frame.duration : 0;
-
-                        buffer_eof_ =
-                            (video_filter_.eof && audio_filter_.eof) ||
-                            av_rescale_q(time, TIME_BASE_Q, format_tb_) >= av_rescale_q(end, TIME_BASE_Q, format_tb_);
-
-                        if (buffer_eof_) {
-                            if (loop_) {
-                                frame = Frame{};
-                                seek_internal(start_);
-                            } else {
-                                // TODO (perf) Avoid polling.
-                                cond_.wait_for(lock, boost::chrono::milliseconds(5));
-                                frame_timer.restart();
-                            }
-                            // TODO (fix) Limit live polling due to bugs.
-                            continue;
-                        }
-                    }
-
-                    std::atomic<int> progress{schedule()};
-
-                    tbb::parallel_invoke(
-                        [&] {
-                            tbb::parallel_for_each(decoders_.begin(),
-                                                   decoders_.end(),
-                                                   [&](auto& p) { progress.fetch_or(decode_frame(p.second)); },
-                                                   task_context_);
-                        },
-                        [&] { progress.fetch_or(filter_frame(video_filter_)); },
-                        [&] { progress.fetch_or(filter_frame(audio_filter_, audio_cadence_[0])); },
-                        task_context_);
-
-                    if ((!video_filter_.frame && !video_filter_.eof) || (!audio_filter_.frame && !audio_filter_.eof)) {
-                        if (!progress) {
-                            if (warning_debounce++ % 500 == 100) {
-                                if (!video_filter_.frame && !video_filter_.eof) {
-                                    CASPAR_LOG(warning) << print() << " Waiting for video frame...";
-                                } else if (!audio_filter_.frame && !audio_filter_.eof) {
-                                    CASPAR_LOG(warning) << print() << " Waiting for audio frame...";
-                                } else {
-                                    CASPAR_LOG(warning) << print() << " Waiting for frame...";
-                                }
-                            }
-                            // TODO (perf) Avoid polling.
-                            cond_.wait_for(lock, boost::chrono::milliseconds(5));
-                        }
-                        // TODO (fix) Limit live polling due to bugs.
-                        boost::this_thread::yield();
-                        continue;
-                    }
-
-                    warning_debounce = 0;
-
-                    // TODO (fix)
-                    // if (start_ != AV_NOPTS_VALUE && frame.pts < start_) {
-                    //    seek_internal(start_);
-                    //    continue;
-                    //}
-
-                    const auto start_time = input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0;
-
-                    if (video_filter_.frame) {
-                        frame.video    = std::move(video_filter_.frame);
-                        const auto tb  = av_buffersink_get_time_base(video_filter_.sink);
-                        const auto fr  = av_buffersink_get_frame_rate(video_filter_.sink);
-                        frame.pts      = av_rescale_q(frame.video->pts, tb, TIME_BASE_Q) - start_time;
-                        frame.duration = av_rescale_q(1, av_inv_q(fr), TIME_BASE_Q);
-                    }
-
-                    if (audio_filter_.frame) {
-                        frame.audio    = std::move(audio_filter_.frame);
-                        const auto tb  = av_buffersink_get_time_base(audio_filter_.sink);
-                        const auto sr  = av_buffersink_get_sample_rate(audio_filter_.sink);
-                        frame.pts      = av_rescale_q(frame.audio->pts, tb, TIME_BASE_Q) - start_time;
-                        frame.duration = av_rescale_q(frame.audio->nb_samples, {1, sr}, TIME_BASE_Q);
-                    }
-
-                    buffer_.push_back(frame);
-
-                    boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
-
-                    graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
-                }
-            } catch (boost::thread_interrupted&) {
-                // Do nothing...
+                set_thread_affinity(env::properties().get(L"configuration.ffmpeg.producer.affinity", L""));
+                open();
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
+                return;
             }
+
+            {
+                boost::lock_guard<boost::mutex> lock(event_mutex_);
+                ready_ = true;
+            }
+            notify();
         });
     }
 
     ~Impl()
     {
-        thread_.interrupt();
+        {
+            boost::unique_lock<boost::mutex> lock(event_mutex_);
+            abort_request_ = true;
+            event_cond_.wait(lock, [&] { return !running_; });
+        }
         thread_.join();
+        scheduler().producers -= 1;
+        scheduler().memory -= memory_;
+        if (on_air_) {
+            scheduler().on_air -= 1;
+        }
     }
 
     void update_state()
@@ -649,15 +782,21 @@ struct AVProducer::Impl
         std::lock_guard<boost::mutex> lock(mutex_);
 
         if (!buffer_.empty() && (frame_flush_ || !frame_)) {
-            auto frame   = core::draw_frame(make_frame(this, *frame_factory_, buffer_[0].video, buffer_[0].audio));
-            frame_       = core::draw_frame::still(frame);
-            frame_time_  = buffer_[0].pts + buffer_[0].duration;
-            frame_flush_ = false;
+            auto frame    = convert(buffer_[0]);
+            frame_        = core::draw_frame::still(frame);
+            frame_time_   = buffer_[0].pts + buffer_[0].duration;
+            frame_flush_  = false;
+            hidden_frame_ = Frame{};
+        } else if (hidden_frame_.video) {
+            frame_        = core::draw_frame::still(convert(hidden_frame_));
+            hidden_frame_ = Frame{};
         }
 
         return frame_;
     }
 
+    void visible(bool visible) { visible_ = visible; }
+
     core::draw_frame next_frame()
     {
         CASPAR_SCOPE_EXIT
@@ -665,25 +804,68 @@ struct AVProducer::Impl
             update_state();
         };
 
+        if (!on_air_.exchange(true)) {
+            scheduler().on_air += 1;
+            task_context_.set_priority(tbb::priority_high);
+        }
+
         std::lock_guard<boost::mutex> lock(mutex_);
 
-        if (buffer_.empty() || (frame_flush_ && buffer_.size() < 4)) {
+        if (live_latency_ > 0 && speed_ == 1.0 && live_hold()) {
+            return frame_;
+        }
+
+        if (buffer_.empty() || (frame_flush_ && buffer_.size() < 4 && live_latency_ == 0)) {
             if (buffer_eof_) {
                 return frame_;
             } else {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "underflow");
+                underflows_      = std::min(underflows_ + 1, 4);
+                underflow_decay_ = 0;
                 return core::draw_frame{};
             }
         }
 
-        auto frame  = core::draw_frame(make_frame(this, *frame_factory_, buffer_[0].video, buffer_[0].audio));
-        frame_      = core::draw_frame::still(frame);
+        if (underflows_ > 0 && ++underflow_decay_ >= format_desc_.fps * 10) {
+            underflows_ -= 1;
+            underflow_decay_ = 0;
+        }
+
+        if (speed_position_ < 1.0) {
+            speed_position_ += std::abs(speed_);
+            return frame_;
+        }
+
+        const auto count = std::min(static_cast<int>(speed_position_), static_cast<int>(buffer_.size()));
+        buffer_.erase(buffer_.begin(), buffer_.begin() + count - 1);
+        speed_position_ += std::abs(speed_) - std::floor(speed_position_);
+
+        // NOTE: Audio is only played at the native speed. Images of hidden layers are neither copied nor uploaded,
+        // only their audio is, and the next image is converted as usual once the layer is visible again.
+        core::draw_frame frame;
+        if (visible_ || buffer_[0].frame) {
+            frame         = convert(buffer_[0], speed_ == 1.0);
+            frame_        = core::draw_frame::still(frame);
+            hidden_frame_ = Frame{};
+        } else {
+            hidden_frame_ = buffer_[0];
+            if (speed_ == 1.0 && hidden_frame_.audio) {
+                frame = core::draw_frame(make_frame(this, *frame_factory_, nullptr, hidden_frame_.audio));
+            } else {
+                frame = frame_;
+            }
+        }
         frame_time_ = buffer_[0].pts + buffer_[0].duration;
         buffer_.pop_front();
 
         frame_flush_ = false;
 
-        cond_.notify_all();
+        update_ready();
+
+        // NOTE: Audio only files are refilled once half of their buffer has played, rather than after every frame.
+        if (!audio_only_ || static_cast<int>(buffer_.size()) <= buffer_capacity_ / 2) {
+            notify();
+        }
 
         return frame;
     }
@@ -695,7 +877,12 @@ struct AVProducer::Impl
         buffer_.clear();
         seek_ = av_rescale_q(time, format_tb_, TIME_BASE_Q);
 
-        cond_.notify_all();
+        buffer_ready_   = false;
+        speed_position_ = 1.0;
+
+        update_memory();
+
+        notify();
     }
 
     int64_t time() const
@@ -712,7 +899,12 @@ struct AVProducer::Impl
 
         loop_ = loop;
 
-        cond_.notify_all();
+        if (!loop_) {
+            loop_head_.clear();
+            loop_capture_ = false;
+        }
+
+        notify();
     }
 
     bool loop() const
@@ -728,7 +920,10 @@ struct AVProducer::Impl
 
         start_ = av_rescale_q(start, format_tb_, TIME_BASE_Q);
 
-        cond_.notify_all();
+        loop_head_.clear();
+        loop_capture_ = false;
+
+        notify();
     }
 
     boost::optional<int64_t> start() const
@@ -745,7 +940,50 @@ struct AVProducer::Impl
         duration_ = av_rescale_q(duration, format_tb_, TIME_BASE_Q);
         input_.paused(false);
 
-        cond_.notify_all();
+        loop_head_.clear();
+        loop_capture_ = false;
+
+        notify();
+    }
+
+    void speed(double speed)
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        // NOTE: Changing direction restarts decoding from the current frame.
+        if ((speed < 0) != (speed_ < 0)) {
+            const auto time = frame_time_ != AV_NOPTS_VALUE ? frame_time_ : 0;
+
+            buffer_.clear();
+            segment_.clear();
+            segment_decoding_ = false;
+            buffer_ready_     = false;
+
+            if (speed < 0) {
+                segment_end_ = time - av_rescale_q(1, format_tb_, TIME_BASE_Q);
+            } else {
+                seek_ = time;
+            }
+        }
+
+        speed_          = speed;
+        speed_position_ = 1.0;
+
+        update_memory();
+
+        {
+            boost::lock_guard<boost::mutex> state_lock(state_mutex_);
+            state_["speed"] = speed_;
+        }
+
+        notify();
+    }
+
+    double speed() const
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        return speed_;
     }
 
     boost::optional<int64_t> duration() const
@@ -764,6 +1002,454 @@ struct AVProducer::Impl
     }
 
   private:
+    // Whether the last frame is repeated instead of playing the next one, which waits for the jitter buffer to fill
+    // and lets it grow back when the source runs slower than the channel. Frames ahead of it are dropped when the
+    // source runs faster.
+    bool live_hold()
+    {
+        const auto fill = static_cast<int>(buffer_.size());
+        live_fill_ += (fill - live_fill_) / format_desc_.fps;
+
+        auto hold = false;
+        if (!live_primed_) {
+            hold         = fill < live_target_;
+            live_primed_ = !hold;
+            live_fill_   = fill;
+        } else if (fill == 0) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "underflow");
+            live_primed_ = false;
+            live_repeated_ += 1;
+            hold = true;
+        } else if (live_fill_ > live_target_ + live_tolerance_ && fill > 1) {
+            graph_->set_tag(diagnostics::tag_severity::INFO, "live-correction");
+            buffer_.pop_front();
+            live_fill_ -= 1.0;
+            live_dropped_ += 1;
+        } else if (live_fill_ < live_target_ - live_tolerance_) {
+            graph_->set_tag(diagnostics::tag_severity::INFO, "live-correction");
+            live_fill_ += 1.0;
+            live_repeated_ += 1;
+            hold = true;
+        }
+
+        graph_->set_value("live-latency", live_fill_ / (2.0 * live_target_));
+
+        boost::lock_guard<boost::mutex> state_lock(state_mutex_);
+        state_["live/latency"]  = live_fill_ * 1000.0 / format_desc_.fps;
+        state_["live/target"]   = live_latency_;
+        state_["live/dropped"]  = live_dropped_;
+        state_["live/repeated"] = live_repeated_;
+
+        return hold;
+    }
+
+    core::draw_frame convert(const Frame& frame, bool audio = true)
+    {
+        if (frame.frame && (audio || !frame.audio)) {
+            return frame.frame;
+        }
+        scoped_timer                      timer(convert_time_);
+        caspar::diagnostics::trace::scope traced("av_producer::convert");
+        auto result =
+            core::draw_frame(make_frame(this, *frame_factory_, frame.video, audio ? frame.audio : nullptr));
+        result.transform().image_transform.field_mode = frame.field;
+        if (frame.matte) {
+            auto key = core::draw_frame(make_frame(&matte_filter_, *frame_factory_, frame.matte, nullptr));
+            key.transform().image_transform.field_mode = frame.field;
+            result = core::draw_frame::mask(std::move(result), std::move(key));
+        }
+        return result;
+    }
+
+    void update_ready()
+    {
+        const auto count = static_cast<int>(buffer_.size());
+        buffer_ready_    = buffer_eof_ || count >= std::max(preroll_, frame_flush_ ? 4 : 1);
+
+        update_memory();
+    }
+
+    void update_memory()
+    {
+        if (last_frame_.video || last_frame_.audio) {
+            frame_size_ = frame_size(last_frame_);
+        }
+
+        const auto count  = buffer_.size() + loop_head_.size() + segment_.size();
+        const auto memory = static_cast<int64_t>(count) * frame_size_;
+        scheduler().memory += memory - memory_.exchange(memory);
+
+        // NOTE: Live streams keep no more than the jitter buffer, anything beyond it would only add latency.
+        if (live_latency_ > 0) {
+            buffer_capacity_ = std::max({4, preroll_, live_target_ + 2 * live_tolerance_ + 1});
+            return;
+        }
+
+        // NOTE: The capacity never drops below what preroll and the loop head splice need.
+        const auto min_capacity = std::max({4, preroll_, loop_ ? loop_head_capacity_ : 0});
+        const auto max_capacity =
+            audio_only_ ? buffer_default_ * 4 : buffer_default_ + buffer_default_ * underflows_ / 4;
+        const auto capacity     = frame_size_ > 0 ? scheduler().memory_share(on_air_) / frame_size_ : max_capacity;
+        buffer_capacity_ = static_cast<int>(std::max<int64_t>(min_capacity, std::min<int64_t>(max_capacity, capacity)));
+    }
+
+    enum class Step
+    {
+        busy,
+        yield,
+        idle
+    };
+
+    void open()
+    {
+        input_.reset();
+
+        audio_only_ = vfilter_.empty();
+        for (auto n = 0UL; n < input_->nb_streams; ++n) {
+            auto st        = input_->streams[n];
+            if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
+                (!st->disposition || st->disposition == AV_DISPOSITION_DEFAULT)) {
+                audio_only_ = false;
+            }
+
+            auto framerate = av_guess_frame_rate(nullptr, st, nullptr);
+            state_["file/streams/" + boost::lexical_cast<std::string>(n) + "/fps"] = {framerate.num, framerate.den};
+        }
+
+        if (duration_ == AV_NOPTS_VALUE && input_->duration_estimation_method != AVFMT_DURATION_FROM_BITRATE) {
+            duration_ = input_->duration;
+        }
+
+        if (start_ != AV_NOPTS_VALUE) {
+            input_.seek(start_);
+            reset(start_);
+        } else {
+            reset(input_.start_time().value_or(0));
+        }
+
+        input_.paused(false);
+
+        boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
+    }
+
+    void notify()
+    {
+        boost::lock_guard<boost::mutex> lock(event_mutex_);
+
+        event_ = true;
+
+        if (ready_ && !running_ && !abort_request_) {
+            running_ = true;
+            event_   = false;
+            enqueue();
+        }
+    }
+
+    void enqueue()
+    {
+        // NOTE: Producers which are on air are scheduled before background and preloaded ones.
+        scheduler().arena.enqueue([this] { run(); }, on_air_ ? tbb::priority_high : tbb::priority_normal);
+    }
+
+    void run()
+    {
+        try {
+            while (true) {
+                const auto result = step();
+
+                if (result == Step::busy) {
+                    continue;
+                }
+
+                boost::lock_guard<boost::mutex> lock(event_mutex_);
+
+                if (abort_request_) {
+                    break;
+                }
+
+                // NOTE: Give other producers a chance to run between frames.
+                if (result == Step::yield) {
+                    enqueue();
+                    return;
+                }
+
+                // NOTE: Sleep until a packet arrives, a buffer slot is freed or the playback state changes.
+                if (!event_) {
+                    break;
+                }
+                event_ = false;
+            }
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+
+            boost::lock_guard<boost::mutex> lock(event_mutex_);
+            abort_request_ = true;
+        }
+
+        boost::lock_guard<boost::mutex> lock(event_mutex_);
+        running_ = false;
+        event_cond_.notify_all();
+    }
+
+    Step step()
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        if (speed_ < 0) {
+            return step_reverse();
+        }
+
+        if (buffer_.size() >= buffer_capacity_) {
+            if (loop_ && spare_key_.empty()) {
+                prepare(seek_time(start_));
+            }
+            return Step::idle;
+        }
+
+        frame_timer_.restart();
+
+        if (seek_ != AV_NOPTS_VALUE) {
+            const auto seek = seek_;
+            seek_           = AV_NOPTS_VALUE;
+            loop_capture_   = false;
+            loop_skip_      = AV_NOPTS_VALUE;
+            seek_internal(seek);
+            return Step::busy;
+        }
+
+        {
+            // TODO (perf) seek as soon as input is past duration or eof.
+
+            auto start = start_ != AV_NOPTS_VALUE ? start_ : 0;
+            auto end   = duration_ != AV_NOPTS_VALUE ? start + duration_ : INT64_MAX;
+            auto time  = last_frame_.pts != AV_NOPTS_VALUE ? last_frame_.pts + last_frame_.duration : 0;
+
+            buffer_eof_ =
+                (video_filter_.eof && audio_filter_.eof) ||
+                av_rescale_q(time, TIME_BASE_Q, format_tb_) >= av_rescale_q(end, TIME_BASE_Q, format_tb_);
+
+            if (buffer_eof_) {
+                // NOTE: Clips shorter than the loop head are cached in full.
+                loop_capture_ = false;
+
+                if (loop_ && !loop_head_.empty()) {
+                    if (buffer_.size() + loop_head_.size() > buffer_capacity_) {
+                        return Step::idle;
+                    }
+
+                    for (auto& frame : loop_head_) {
+                        buffer_.push_back(frame);
+                        boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
+                    }
+
+                    // NOTE: Frames decoded again after the seek are dropped until they pass the spliced ones.
+                    last_frame_ = loop_head_.back();
+                    loop_skip_  = last_frame_.pts;
+                    seek_internal(start_, false);
+                    update_ready();
+                    return Step::yield;
+                } else if (loop_) {
+                    last_frame_   = Frame{};
+                    loop_capture_ = true;
+                    seek_internal(start_);
+                    return Step::busy;
+                }
+                update_ready();
+                return Step::idle;
+            }
+        }
+
+        const auto result = decode();
+        if (result != Step::yield) {
+            return result;
+        }
+
+        if (loop_skip_ != AV_NOPTS_VALUE) {
+            if (last_frame_.pts <= loop_skip_) {
+                return Step::busy;
+            }
+            loop_skip_ = AV_NOPTS_VALUE;
+        }
+
+        buffer_.push_back(last_frame_);
+
+        // NOTE: Convert the first frames ahead of time so that they are ready as soon as playback starts.
+        if (static_cast<int>(buffer_.size()) <= preroll_ || loop_capture_) {
+            buffer_.back().frame = convert(buffer_.back());
+        }
+
+        if (loop_capture_) {
+            loop_head_.push_back(buffer_.back());
+            loop_capture_ = static_cast<int>(loop_head_.size()) < loop_head_capacity_;
+        }
+
+        update_ready();
+
+        boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
+
+        graph_->set_value("frame-time", frame_timer_.elapsed() * format_desc_.fps * 0.5);
+
+        return Step::yield;
+    }
+
+    Step step_reverse()
+    {
+        const auto start = start_ != AV_NOPTS_VALUE ? start_ : 0;
+
+        if (seek_ != AV_NOPTS_VALUE) {
+            segment_end_      = seek_;
+            seek_             = AV_NOPTS_VALUE;
+            segment_decoding_ = false;
+            segment_.clear();
+        }
+
+        if (!segment_decoding_) {
+            // NOTE: The decoded segment is spliced in once the frames ahead of it have been played.
+            if (!segment_.empty()) {
+                if (buffer_.size() >= buffer_capacity_) {
+                    return Step::idle;
+                }
+                buffer_.insert(buffer_.end(), segment_.rbegin(), segment_.rend());
+                segment_.clear();
+                update_ready();
+            }
+
+            if (segment_end_ <= start) {
+                if (!loop_ || duration_ == AV_NOPTS_VALUE) {
+                    buffer_eof_ = true;
+                    update_ready();
+                    return Step::idle;
+                }
+                segment_end_ = start + duration_;
+            }
+
+            // NOTE: Segments are as long as the frame buffer, the input seeks to the key frame before the segment
+            // and the filters drop the frames ahead of it.
+            const auto frame_duration = av_rescale_q(1, format_tb_, TIME_BASE_Q);
+            segment_start_            = std::max(start, segment_end_ - buffer_capacity_ * frame_duration);
+            segment_decoding_         = true;
+            seek_internal(segment_start_, false);
+            return Step::busy;
+        }
+
+        frame_timer_.restart();
+
+        auto complete = video_filter_.eof && audio_filter_.eof;
+
+        if (!complete) {
+            const auto result = decode();
+            if (result != Step::yield) {
+                return result;
+            }
+
+            complete = last_frame_.pts >= segment_end_;
+
+            if (!complete) {
+                segment_.push_back(last_frame_);
+                segment_.back().audio = nullptr;
+            }
+
+            boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
+        }
+
+        if (complete) {
+            segment_decoding_ = false;
+            segment_end_      = segment_.empty() ? segment_start_ : std::min(segment_start_, segment_.front().pts);
+        }
+
+        graph_->set_value("frame-time", frame_timer_.elapsed() * format_desc_.fps * 0.5);
+
+        return Step::yield;
+    }
+
+    Step decode()
+    {
+        std::atomic<int> progress{schedule()};
+
+        tbb::parallel_invoke(
+            [&] {
+                tbb::parallel_for_each(decoders_.begin(),
+                                       decoders_.end(),
+                                       [&](auto& p) { progress.fetch_or(decode_frame(p.second)); },
+                                       task_context_);
+            },
+            [&] { progress.fetch_or(filter_frame(video_filter_)); },
+            [&] { progress.fetch_or(filter_frame(matte_filter_)); },
+            [&] { progress.fetch_or(filter_frame(audio_filter_, audio_cadence_[0])); },
+            task_context_);
+
+        // NOTE: The filters may have requested frames which the decoders are already holding.
+        if (!progress) {
+            progress = schedule();
+        }
+
+        if ((!video_filter_.frame && !video_filter_.eof) || (!matte_filter_.frame && !matte_filter_.eof) ||
+            (!audio_filter_.frame && !audio_filter_.eof)) {
+            if (!progress) {
+                if (warning_debounce_++ % 500 == 100) {
+                    if ((!video_filter_.frame && !video_filter_.eof) || (!matte_filter_.frame && !matte_filter_.eof)) {
+                        CASPAR_LOG(warning) << print() << " Waiting for video frame...";
+                    } else if (!audio_filter_.frame && !audio_filter_.eof) {
+                        CASPAR_LOG(warning) << print() << " Waiting for audio frame...";
+                    } else {
+                        CASPAR_LOG(warning) << print() << " Waiting for frame...";
+                    }
+                }
+                return Step::idle;
+            }
+            return Step::busy;
+        }
+
+        warning_debounce_ = 0;
+
+        // TODO (fix)
+        // if (start_ != AV_NOPTS_VALUE && last_frame_.pts < start_) {
+        //    seek_internal(start_);
+        //    continue;
+        //}
+
+        const auto start_time = input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0;
+
+        last_frame_.frame = core::draw_frame{};
+
+        if (video_filter_.frame) {
+            // NOTE: Interlaced frames are repeated by the frame rate filter, once per field on channels at the field
+            // rate, and each repeat shows the next field.
+            const auto repeat    = last_frame_.video && last_frame_.video->data[0] == video_filter_.frame->data[0];
+            last_frame_.video    = std::move(video_filter_.frame);
+            const auto tb        = av_buffersink_get_time_base(video_filter_.sink);
+            const auto fr        = av_buffersink_get_frame_rate(video_filter_.sink);
+            last_frame_.pts      = av_rescale_q(last_frame_.video->pts, tb, TIME_BASE_Q) - start_time;
+            last_frame_.duration = av_rescale_q(1, av_inv_q(fr), TIME_BASE_Q);
+
+            if (!gpu_deinterlace_ || !last_frame_.video->interlaced_frame) {
+                last_frame_.field = core::field_mode::progressive;
+            } else if (repeat && last_frame_.field != core::field_mode::progressive) {
+                last_frame_.field = last_frame_.field == core::field_mode::upper ? core::field_mode::lower
+                                                                                  : core::field_mode::upper;
+            } else {
+                last_frame_.field =
+                    last_frame_.video->top_field_first ? core::field_mode::upper : core::field_mode::lower;
+            }
+        }
+
+        // NOTE: Both graphs end in the same frame rate filter, so each matte frame belongs to the fill frame filtered
+        // with it.
+        last_frame_.matte = std::move(matte_filter_.frame);
+
+        if (audio_filter_.frame) {
+            last_frame_.audio    = std::move(audio_filter_.frame);
+            const auto tb        = av_buffersink_get_time_base(audio_filter_.sink);
+            const auto sr        = av_buffersink_get_sample_rate(audio_filter_.sink);
+            last_frame_.pts      = av_rescale_q(last_frame_.audio->pts, tb, TIME_BASE_Q) - start_time;
+            last_frame_.duration = av_rescale_q(last_frame_.audio->nb_samples, {1, sr}, TIME_BASE_Q);
+        }
+
+        frames_decoded_ += 1;
+
+        return Step::yield;
+    }
+
     bool schedule()
     {
         auto result = false;
@@ -829,6 +1515,7 @@ struct AVProducer::Impl
 
             auto frame = std::move(it->second.frame);
 
+            scoped_timer timer(filter_time_);
             for (auto& source : p.second) {
                 if (frame && !frame->data[0]) {
                     FF(av_buffersrc_close(source, frame->pts, 0));
@@ -858,6 +1545,9 @@ struct AVProducer::Impl
             return false;
         }
 
+        scoped_timer                      timer(decode_time_);
+        caspar::diagnostics::trace::scope traced("av_producer::decode");
+
         auto frame = alloc_frame();
         auto ret   = avcodec_receive_frame(decoder.ctx.get(), frame.get());
 
@@ -876,11 +1566,6 @@ struct AVProducer::Impl
         } else {
             FF_RET(ret, "avcodec_receive_frame");
 
-            // NOTE This is a workaround for DVCPRO HD.
-            if (frame->width > 1024 && frame->interlaced_frame) {
-                frame->top_field_first = 1;
-            }
-
             // TODO (fix) is this always best?
             frame->pts = frame->best_effort_timestamp;
             // TODO (fix) is this always best?
@@ -906,6 +1591,30 @@ struct AVProducer::Impl
                 decoder.next_pts = AV_NOPTS_VALUE;
             }
 
+            // NOTE: Frames decoded from the key frame before a seek target are dropped before they are downloaded or
+            // filtered. Video keeps two frames ahead of the target for the deinterlacer and the frame rate filter.
+            if (decoder.discard != AV_NOPTS_VALUE) {
+                const auto margin = decoder.ctx->codec_type == AVMEDIA_TYPE_VIDEO ? 2 * duration_pts : 0;
+                if (frame->pts != AV_NOPTS_VALUE && duration_pts > 0 &&
+                    decoder.next_pts + margin <= decoder.discard) {
+                    return true;
+                }
+                decoder.discard = AV_NOPTS_VALUE;
+            }
+
+            if (frame->format == decoder.hw_pix_fmt) {
+                auto sw_frame    = alloc_frame();
+                sw_frame->format = decoder.pix_fmt;
+                FF(av_hwframe_transfer_data(sw_frame.get(), frame.get(), 0));
+                FF(av_frame_copy_props(sw_frame.get(), frame.get()));
+                frame = std::move(sw_frame);
+            }
+
+            // NOTE This is a workaround for DVCPRO HD.
+            if (frame->width > 1024 && frame->interlaced_frame) {
+                frame->top_field_first = 1;
+            }
+
             decoder.frame = std::move(frame);
         }
 
@@ -924,6 +1633,9 @@ struct AVProducer::Impl
             return true;
         }
 
+        scoped_timer                      timer(filter_time_);
+        caspar::diagnostics::trace::scope traced("av_producer::filter");
+
         auto frame = alloc_frame();
         auto ret   = nb_samples >= 0 ? av_buffersink_get_samples(filter.sink, frame.get(), nb_samples)
                                    : av_buffersink_get_frame(filter.sink, frame.get());
@@ -950,19 +1662,25 @@ struct AVProducer::Impl
         return str.str();
     }
 
-    void seek_internal(int64_t time)
+    int64_t seek_time(int64_t time) const
     {
         time = time != AV_NOPTS_VALUE ? time : 0;
-        time = time + input_.start_time().value_or(0);
+        return time + input_.start_time().value_or(0);
+    }
+
+    void seek_internal(int64_t time, bool flush = true)
+    {
+        time = seek_time(time);
 
         // TODO (fix) Dont seek if time is close future.
         input_.seek(time);
         input_.paused(false);
-        frame_flush_ = true;
+        frame_flush_ = flush;
         buffer_eof_  = false;
 
         for (auto& p : decoders_) {
             reset_decoder(p.second);
+            p.second.discard = av_rescale_q(time, TIME_BASE_Q, p.second.st->time_base);
         }
 
         reset(time);
@@ -973,19 +1691,74 @@ struct AVProducer::Impl
         avcodec_flush_buffers(decoder.ctx.get());
         decoder.next_pts = AV_NOPTS_VALUE;
         decoder.frame    = nullptr;
+        decoder.discard  = AV_NOPTS_VALUE;
         decoder.eof      = false;
         decoder.input    = decltype(decoder.input){};
     }
 
+    std::string filter_key(int64_t start_time) const
+    {
+        std::ostringstream key;
+        key << start_time;
+        for (auto& p : decoders_) {
+            const auto& ctx = p.second.ctx;
+            key << "|" << p.first << ":" << ctx->width << "x" << ctx->height << ":" << p.second.pix_fmt << ":"
+                << ctx->sample_rate << ":" << ctx->sample_fmt << ":" << ctx->channel_layout;
+        }
+        return key.str();
+    }
+
+    void build(int64_t start_time, Filter& video_filter, Filter& matte_filter, Filter& audio_filter)
+    {
+        video_filter = audio_only_ ? Filter{}
+                                   : Filter(vfilter_,
+                                            input_,
+                                            decoders_,
+                                            start_time,
+                                            AVMEDIA_TYPE_VIDEO,
+                                            format_desc_,
+                                            hwaccel_,
+                                            gpu_deinterlace_);
+        matte_filter = audio_only_ ? Filter{}
+                                   : Filter(vfilter_,
+                                            input_,
+                                            decoders_,
+                                            start_time,
+                                            AVMEDIA_TYPE_VIDEO,
+                                            format_desc_,
+                                            hwaccel_,
+                                            gpu_deinterlace_,
+                                            true);
+        audio_filter = Filter(afilter_, input_, decoders_, start_time, AVMEDIA_TYPE_AUDIO, format_desc_, hwaccel_);
+    }
+
+    void prepare(int64_t start_time)
+    {
+        build(start_time, spare_video_filter_, spare_matte_filter_, spare_audio_filter_);
+        spare_key_ = filter_key(start_time);
+    }
+
     void reset(int64_t start_time)
     {
-        video_filter_ = Filter(vfilter_, input_, decoders_, start_time, AVMEDIA_TYPE_VIDEO, format_desc_);
-        audio_filter_ = Filter(afilter_, input_, decoders_, start_time, AVMEDIA_TYPE_AUDIO, format_desc_);
+        if (!spare_key_.empty() && spare_key_ == filter_key(start_time)) {
+            video_filter_ = std::move(spare_video_filter_);
+            matte_filter_ = std::move(spare_matte_filter_);
+            audio_filter_ = std::move(spare_audio_filter_);
+        } else {
+            build(start_time, video_filter_, matte_filter_, audio_filter_);
+        }
+        spare_key_.clear();
+        spare_video_filter_ = Filter{};
+        spare_matte_filter_ = Filter{};
+        spare_audio_filter_ = Filter{};
 
         sources_.clear();
         for (auto& p : video_filter_.sources) {
             sources_[p.first].push_back(p.second);
         }
+        for (auto& p : matte_filter_.sources) {
+            sources_[p.first].push_back(p.second);
+        }
         for (auto& p : audio_filter_.sources) {
             sources_[p.first].push_back(p.second);
         }
@@ -1007,7 +1780,11 @@ AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
                        boost::optional<std::string>         afilter,
                        boost::optional<int64_t>             start,
                        boost::optional<int64_t>             duration,
-                       boost::optional<bool>                loop)
+                       boost::optional<bool>                loop,
+                       boost::optional<int>                 preroll,
+                       boost::optional<std::string>         hwaccel,
+                       boost::optional<int>                 live_latency,
+                       boost::optional<bool>                gpu_deinterlace)
     : impl_(new Impl(std::move(frame_factory),
                      std::move(format_desc),
                      std::move(name),
@@ -1016,7 +1793,11 @@ AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
                      std::move(afilter.get_value_or("")),
                      std::move(start),
                      std::move(duration),
-                     std::move(loop.get_value_or(false))))
+                     std::move(loop.get_value_or(false)),
+                     std::move(preroll.get_value_or(0)),
+                     std::move(hwaccel.get_value_or("")),
+                     live_latency.get_value_or(0),
+                     gpu_deinterlace.get_value_or(false)))
 {
 }
 
@@ -1024,6 +1805,8 @@ core::draw_frame AVProducer::next_frame() { return impl_->next_frame(); }
 
 core::draw_frame AVProducer::prev_frame() { return impl_->prev_frame(); }
 
+void AVProducer::visible(bool visible) { impl_->visible(visible); }
+
 AVProducer& AVProducer::seek(int64_t time)
 {
     impl_->seek(time);
@@ -1056,9 +1839,26 @@ AVProducer& AVProducer::duration(int64_t duration)
 
 int64_t AVProducer::duration() const { return impl_->duration().value_or(std::numeric_limits<int64_t>::max()); }
 
+AVProducer& AVProducer::speed(double speed)
+{
+    impl_->speed(speed);
+    return *this;
+}
+
+double AVProducer::speed() const { return impl_->speed(); }
+
 core::monitor::state AVProducer::state() const {
     boost::lock_guard<boost::mutex> lock(impl_->state_mutex_);
-    return impl_->state_;
+    auto state                    = impl_->state_;
+    state["ready"]                = impl_->buffer_ready_.load();
+    state["buffer/memory"]        = impl_->memory_.load();
+    state["buffer/total-memory"]  = scheduler().memory.load();
+    state["profile/frames"]       = impl_->frames_decoded_.load();
+    state["profile/read-time"]    = impl_->input_.read_time() / 1000000.0;
+    state["profile/decode-time"]  = impl_->decode_time_.load() / 1000000.0;
+    state["profile/filter-time"]  = impl_->filter_time_.load() / 1000000.0;
+    state["profile/convert-time"] = impl_->convert_time_.load() / 1000000.0;
+    return state;
 }
 
 }} // namespace caspar::ffmpeg
@@ -22,11 +22,18 @@ class AVProducer
                boost::optional<std::string>         afilter,
                boost::optional<int64_t>             start,
                boost::optional<int64_t>             duration,
-               boost::optional<bool>                loop);
+               boost::optional<bool>                loop,
+               boost::optional<int>                 preroll         = boost::none,
+               boost::optional<std::string>         hwaccel         = boost::none,
+               boost::optional<int>                 live_latency    = boost::none,
+               boost::optional<bool>                gpu_deinterlace = boost::none);
 
     core::draw_frame prev_frame();
     core::draw_frame next_frame();
 
+    // See core::frame_producer::visible.
+    void visible(bool visible);
+
     AVProducer& seek(int64_t time);
     int64_t     time() const;
 
@@ -39,6 +46,9 @@ class AVProducer
     AVProducer& duration(int64_t duration);
     int64_t     duration() const;
 
+    AVProducer& speed(double speed);
+    double      speed() const;
+
     core::monitor::state state() const;
 
   private:
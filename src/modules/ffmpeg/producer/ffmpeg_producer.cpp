@@ -38,7 +38,13 @@
 #include <boost/filesystem.hpp>
 #include <boost/logic/tribool.hpp>
 
+#include <algorithm>
 #include <cstdint>
+#include <ctime>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <vector>
 
 #pragma warning(push, 1)
 
@@ -71,7 +77,11 @@ struct ffmpeg_producer : public core::frame_producer
                              std::wstring                         afilter,
                              boost::optional<int64_t>             start,
                              boost::optional<int64_t>             duration,
-                             boost::optional<bool>                loop)
+                             boost::optional<bool>                loop,
+                             boost::optional<int>                 preroll,
+                             std::wstring                         hwaccel,
+                             boost::optional<int>                 live_latency,
+                             bool                                 gpu_deinterlace)
         : format_desc_(format_desc)
         , filename_(filename)
         , frame_factory_(frame_factory)
@@ -83,7 +93,11 @@ struct ffmpeg_producer : public core::frame_producer
                                    u8(afilter),
                                    start,
                                    duration,
-                                   loop))
+                                   loop,
+                                   preroll,
+                                   u8(hwaccel),
+                                   live_latency,
+                                   gpu_deinterlace))
     {
     }
 
@@ -105,6 +119,8 @@ struct ffmpeg_producer : public core::frame_producer
 
     core::draw_frame receive_impl(int nb_samples) override { return producer_->next_frame(); }
 
+    void visible(bool visible) override { producer_->visible(visible); }
+
     std::uint32_t frame_number() const override { return static_cast<std::uint32_t>(producer_->time()); }
 
     std::uint32_t nb_frames() const override
@@ -147,6 +163,12 @@ struct ffmpeg_producer : public core::frame_producer
             }
 
             result = boost::lexical_cast<std::wstring>(producer_->duration());
+        } else if (boost::iequals(cmd, L"speed")) {
+            if (!value.empty()) {
+                producer_->speed(boost::lexical_cast<double>(value));
+            }
+
+            result = boost::lexical_cast<std::wstring>(producer_->speed());
         } else if (boost::iequals(cmd, L"seek") && !value.empty()) {
             int64_t seek;
             if (boost::iequals(value, L"rel")) {
@@ -271,6 +293,41 @@ bool is_valid_file(const std::wstring& filename)
     return av_probe_input_format2(&pb, true, &score) != nullptr;
 }
 
+struct directory_index
+{
+    std::time_t                                       last_write_time = 0;
+    std::map<std::wstring, std::vector<std::wstring>> files;
+};
+
+// NOTE: Directories are listed once and relisted only when their modification time changes.
+std::vector<std::wstring> find_stem(const boost::filesystem::path& dir, const std::wstring& stem)
+{
+    static std::mutex                              mutex;
+    static std::map<std::wstring, directory_index> indices;
+
+    boost::system::error_code ec;
+    const auto                last_write_time = boost::filesystem::last_write_time(dir, ec);
+    if (ec) {
+        return {};
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto& index = indices[dir.wstring()];
+    // NOTE: Modification times can be coarse, recently modified directories are always relisted.
+    if (index.files.empty() || index.last_write_time != last_write_time || std::time(nullptr) - last_write_time < 2) {
+        index.files.clear();
+        index.last_write_time = last_write_time;
+        for (auto it = boost::filesystem::directory_iterator(dir); it != boost::filesystem::directory_iterator();
+             ++it) {
+            index.files[boost::to_lower_copy(it->path().stem().wstring())].push_back(it->path().wstring());
+        }
+    }
+
+    auto it = index.files.find(boost::to_lower_copy(stem));
+    return it != index.files.end() ? it->second : std::vector<std::wstring>{};
+}
+
 std::wstring probe_stem(const std::wstring& stem)
 {
     auto stem2  = boost::filesystem::path(stem);
@@ -279,16 +336,15 @@ std::wstring probe_stem(const std::wstring& stem)
     if (!parent)
         return L"";
 
-    auto dir = boost::filesystem::path(*parent);
-
-    for (auto it = boost::filesystem::directory_iterator(dir); it != boost::filesystem::directory_iterator(); ++it) {
-        if (boost::iequals(it->path().stem().wstring(), stem2.filename().wstring()) &&
-            is_valid_file(it->path().wstring()))
-            return it->path().wstring();
+    for (const auto& path : find_stem(boost::filesystem::path(*parent), stem2.filename().wstring())) {
+        if (is_valid_file(path))
+            return path;
     }
     return L"";
 }
 
+const wchar_t* const live_protocols[] = {L"udp://", L"rtp://", L"srt://", L"rtsp://", L"rtmp://"};
+
 spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
                                                       const std::vector<std::wstring>&         params)
 {
@@ -335,13 +391,56 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
         duration = out - in;
     }
 
+    // NOTE: Number of frames decoded and converted ahead before the producer reports ready.
+    auto preroll = get_param(L"PREROLL", params, 0);
+
+    // NOTE: Device type used to decode video, e.g. cuda, vaapi, qsv, dxva2 or d3d11va.
+    auto hwaccel = boost::to_lower_copy(
+        get_param(L"HWACCEL", params, env::properties().get(L"configuration.ffmpeg.producer.hwaccel", L"")));
+    if (hwaccel == L"none") {
+        hwaccel.clear();
+    }
+
+    // NOTE: Network streams are played live from a jitter buffer of LATENCY milliseconds, which is kept against the
+    // channel clock by dropping or repeating frames.
+    const auto live = contains_param(L"LIVE", params) ||
+                      std::any_of(std::begin(live_protocols), std::end(live_protocols), [&](const wchar_t* protocol) {
+                          return boost::istarts_with(path, protocol);
+                      });
+    const auto live_latency =
+        live ? get_param(L"LATENCY", params, env::properties().get(L"configuration.ffmpeg.producer.live-latency", 200))
+             : 0;
+
+    // NOTE: Interlaced clips are deinterlaced by the image mixer rather than by the bwdif filter with DEINTERLACE GPU.
+    const auto gpu_deinterlace = boost::iequals(
+        get_param(L"DEINTERLACE",
+                  params,
+                  env::properties().get(L"configuration.ffmpeg.producer.deinterlace", std::wstring(L"cpu"))),
+        L"gpu");
+
     // TODO (fix) use raw input?
     auto vfilter = boost::to_lower_copy(get_param(L"VF", params, filter_str));
     auto afilter = boost::to_lower_copy(get_param(L"AF", params, get_param(L"FILTER", params, L"")));
 
+    // NOTE: Keys of separated producers are drawn from a single channel, so only their luma is decoded and uploaded.
+    if (contains_param(L"KEY", params)) {
+        vfilter += vfilter.empty() ? L"format=gray" : L",format=gray";
+    }
+
     try {
-        auto producer = spl::make_shared<ffmpeg_producer>(
-            dependencies.frame_factory, dependencies.format_desc, name, path, vfilter, afilter, start, duration, loop);
+        auto producer = spl::make_shared<ffmpeg_producer>(dependencies.frame_factory,
+                                                          dependencies.format_desc,
+                                                          name,
+                                                          path,
+                                                          vfilter,
+                                                          afilter,
+                                                          start,
+                                                          duration,
+                                                          loop,
+                                                          preroll,
+                                                          hwaccel,
+                                                          live_latency,
+                                                          gpu_deinterlace);
         return core::create_destroy_proxy(std::move(producer));
     } catch (...) {
         CASPAR_LOG_CURRENT_EXCEPTION();
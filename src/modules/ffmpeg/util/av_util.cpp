@@ -2,6 +2,8 @@
 
 #include "av_assert.h"
 
+#include <common/memcpy.h>
+
 #if defined(_MSC_VER)
 #pragma warning(push)
 #pragma warning(disable : 4244)
@@ -10,6 +12,7 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavfilter/avfilter.h>
 #include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 }
 #if defined(_MSC_VER)
@@ -45,28 +48,34 @@ core::mutable_frame make_frame(void*                    tag,
         video ? pixel_format_desc(static_cast<AVPixelFormat>(video->format), video->width, video->height)
               : core::pixel_format_desc(core::pixel_format::invalid);
 
-    auto frame = frame_factory.create_frame(tag, pix_desc);
+    // NOTE: Frames without an image are not drawn by the image mixers, so they are built without the frame factory
+    // and carry neither image buffers nor an upload.
+    auto frame = video ? frame_factory.create_frame(tag, pix_desc) : core::mutable_frame(tag, {}, {}, pix_desc);
 
     if (video) {
+        // NOTE: The frame buffers are write combined upload buffers, so rows are streamed past the cache and
+        // planes with matching line sizes are copied in one piece.
         for (int n = 0; n < static_cast<int>(pix_desc.planes.size()); ++n) {
-            for (int y = 0; y < pix_desc.planes[n].height; ++y) {
-                std::memcpy(frame.image_data(n).begin() + y * pix_desc.planes[n].linesize,
-                            video->data[n] + y * video->linesize[n],
-                            pix_desc.planes[n].linesize);
+            const auto& plane = pix_desc.planes[n];
+            auto        dest  = frame.image_data(n).begin();
+            if (video->linesize[n] == plane.linesize) {
+                parallel_memcpy(dest, video->data[n], static_cast<size_t>(plane.linesize) * plane.height);
+            } else {
+                tbb::parallel_for(0, plane.height, 16, [&](int first) {
+                    for (auto y = first; y < std::min(first + 16, plane.height); ++y) {
+                        stream_memcpy(
+                            dest + y * plane.linesize, video->data[n] + y * video->linesize[n], plane.linesize);
+                    }
+                });
             }
         }
     }
 
     if (audio) {
-        // TODO This is a bit of a hack
-        frame.audio_data() = std::vector<int32_t>(audio->nb_samples * 8, 0);
-        auto dst           = frame.audio_data().data();
-        auto src           = reinterpret_cast<int32_t*>(audio->data[0]);
-        for (auto i = 0; i < audio->nb_samples; ++i) {
-            for (auto j = 0; j < std::min(8, audio->channels); ++j) {
-                dst[i * 8 + j] = src[i * audio->channels + j];
-            }
-        }
+        // Producers deliver audio in the channel layout of the channel, so the samples are used as they are.
+        auto samples = array<int32_t>(static_cast<std::size_t>(audio->nb_samples * audio->channels));
+        std::memcpy(samples.data(), audio->data[0], samples.size() * sizeof(int32_t));
+        frame.audio_data() = std::move(samples);
     }
 
     return frame;
@@ -105,6 +114,22 @@ core::pixel_format get_pixel_format(AVPixelFormat pix_fmt)
             return core::pixel_format::ycbcra;
         case AV_PIX_FMT_YUVA444P:
             return core::pixel_format::ycbcra;
+        case AV_PIX_FMT_YUV444P10LE:
+        case AV_PIX_FMT_YUV422P10LE:
+        case AV_PIX_FMT_YUV420P10LE:
+            return core::pixel_format::ycbcr10;
+        case AV_PIX_FMT_NV12:
+        case AV_PIX_FMT_NV16:
+            return core::pixel_format::nv12;
+        case AV_PIX_FMT_P010LE:
+        case AV_PIX_FMT_P016LE:
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 17, 100)
+        case AV_PIX_FMT_P210LE:
+        case AV_PIX_FMT_P216LE:
+#endif
+            return core::pixel_format::p010;
+        case AV_PIX_FMT_UYVY422:
+            return core::pixel_format::uyvy;
         default:
             return core::pixel_format::invalid;
     }
@@ -151,12 +176,60 @@ core::pixel_format_desc pixel_format_desc(AVPixelFormat pix_fmt, int width, int
 
             return desc;
         }
+        case core::pixel_format::ycbcr10:
+        case core::pixel_format::nv12:
+        case core::pixel_format::p010: {
+            // NOTE: Uploaded as they are, to 16 bit textures where the samples are wider than 8 bits and to two
+            // channel textures for the interleaved chroma, which the mixer unpacks.
+            auto h2    = -((-height) >> av_pix_fmt_desc_get(pix_fmt)->log2_chroma_h);
+            auto depth = desc.format == core::pixel_format::nv12 ? 1 : 2;
+
+            desc.planes.push_back(
+                core::pixel_format_desc::plane(dummy_pict.linesize[0] / depth, height, depth, depth));
+
+            if (desc.format == core::pixel_format::ycbcr10) {
+                desc.planes.push_back(
+                    core::pixel_format_desc::plane(dummy_pict.linesize[1] / depth, h2, depth, depth));
+                desc.planes.push_back(
+                    core::pixel_format_desc::plane(dummy_pict.linesize[2] / depth, h2, depth, depth));
+            } else {
+                desc.planes.push_back(
+                    core::pixel_format_desc::plane(dummy_pict.linesize[1] / (depth * 2), h2, depth * 2, depth));
+            }
+
+            return desc;
+        }
+        case core::pixel_format::uyvy: {
+            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[0] / 4, height, 4));
+            return desc;
+        }
         default:
             desc.format = core::pixel_format::invalid;
             return desc;
     }
 }
 
+namespace {
+
+// NOTE: Wraps the frame's buffers without copying, the frame is kept alive until the last reference is released.
+template <typename T>
+AVBufferRef* wrap_buffer(const core::const_frame& frame, const T* data, std::size_t size)
+{
+    auto holder = new core::const_frame(frame);
+    auto buf    = av_buffer_create(reinterpret_cast<uint8_t*>(const_cast<T*>(data)),
+                                static_cast<int>(size),
+                                [](void* opaque, uint8_t*) { delete static_cast<core::const_frame*>(opaque); },
+                                holder,
+                                AV_BUFFER_FLAG_READONLY);
+    if (!buf) {
+        delete holder;
+        FF_RET(AVERROR(ENOMEM), "av_buffer_create");
+    }
+    return buf;
+}
+
+} // namespace
+
 std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, const core::video_format_desc& format_desc)
 {
     auto av_frame = alloc_frame();
@@ -219,16 +292,13 @@ std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, con
             break;
     }
 
-    FF(av_frame_get_buffer(av_frame.get(), 32));
-
-    // TODO (perf) Avoid extra memcpy.
     for (int n = 0; n < planes.size(); ++n) {
-        for (int y = 0; y < av_frame->height; ++y) {
-            std::memcpy(av_frame->data[n] + y * av_frame->linesize[n],
-                        frame.image_data(n).data() + y * planes[n].linesize,
-                        planes[n].linesize);
-        }
+        const auto& data      = frame.image_data(n);
+        av_frame->buf[n]      = wrap_buffer(frame, data.data(), data.size());
+        av_frame->data[n]     = av_frame->buf[n]->data;
+        av_frame->linesize[n] = planes[n].linesize;
     }
+    av_frame->extended_data = av_frame->data;
 
     return av_frame;
 }
@@ -245,8 +315,10 @@ std::shared_ptr<AVFrame> make_av_audio_frame(const core::const_frame& frame, con
     av_frame->sample_rate    = format_desc.audio_sample_rate;
     av_frame->format         = AV_SAMPLE_FMT_S32;
     av_frame->nb_samples     = static_cast<int>(buffer.size() / av_frame->channels);
-    FF(av_frame_get_buffer(av_frame.get(), 32));
-    std::memcpy(av_frame->data[0], buffer.data(), buffer.size() * sizeof(buffer.data()[0]));
+    av_frame->buf[0]         = wrap_buffer(frame, buffer.data(), buffer.size() * sizeof(buffer.data()[0]));
+    av_frame->data[0]        = av_frame->buf[0]->data;
+    av_frame->linesize[0]    = av_frame->buf[0]->size;
+    av_frame->extended_data  = av_frame->data;
 
     return av_frame;
 }
@@ -183,7 +183,7 @@ class flash_cg_proxy
         CASPAR_LOG(debug) << flash_producer_->print() << " Invoking invoke-command: " << str;
         std::vector<std::wstring> params;
         params.push_back(std::move(str));
-        // TODO: because of std::async deferred timed waiting does not work so for now we have to block
+        // NOTE: The result is needed, calls run between two frames of the renderer so this waits for one frame at most.
         return flash_producer_->call(std::move(params)).get();
     }
 };
@@ -190,6 +190,9 @@ class flash_renderer
     prec_timer                                   timer_;
     caspar::timer                                tick_timer_;
 
+    const int max_skip_ = env::properties().get(L"configuration.flash.max-frame-skip", 4);
+    int       skip_     = 0;
+
     spl::shared_ptr<diagnostics::graph> graph_;
 
   public:
@@ -208,6 +211,7 @@ class flash_renderer
         graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("param", diagnostics::color(1.0f, 0.5f, 0.0f));
+        graph_->set_color("skipped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
 
         if (FAILED(CComObject<caspar::flash::FlashAxContainer>::CreateInstance(&ax_)))
             CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Failed to create FlashAxContainer"));
@@ -292,7 +296,17 @@ class flash_renderer
         caspar::timer frame_timer;
         ax_->Tick();
 
-        if (ax_->InvalidRect()) {
+        // NOTE: A template which overruns its frame budget while drawing is not drawn for as many frames as it
+        // overran, up to flash.max-frame-skip. It is still ticked, so its timeline keeps pace with the channel while
+        // the last drawn frame is repeated, instead of the layer running out of frames.
+        if (skip_ > 0) {
+            --skip_;
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "skipped-frame");
+        } else if (ax_->InvalidRect()) {
+            caspar::timer draw_timer;
+
+            // NOTE: The frame is drawn into the pooled buffers of the frame factory, only the dib of the player is
+            // kept by the renderer.
             core::pixel_format_desc desc = core::pixel_format::bgra;
             desc.planes.push_back(core::pixel_format_desc::plane(width_, height_, 4));
             auto frame = frame_factory_->create_frame(this, desc);
@@ -302,6 +316,8 @@ class flash_renderer
 
             std::memcpy(frame.image_data(0).begin(), bmp_.data(), width_ * height_ * 4);
             head_ = core::draw_frame(std::move(frame));
+
+            skip_ = std::min(max_skip_, static_cast<int>(draw_timer.elapsed() / frame_time));
         }
 
         MSG msg;
@@ -355,6 +371,7 @@ struct flash_producer : public core::frame_producer
 
     std::unique_ptr<flash_renderer> renderer_;
     std::atomic<bool>               has_renderer_;
+    std::atomic<bool>               filling_{false};
 
     executor executor_ = L"flash_producer";
 
@@ -440,7 +457,7 @@ struct flash_producer : public core::frame_producer
                 std::wstring result = param == L"start_rendering" ? L"" : renderer_->call(param);
 
                 if (initialize_renderer) {
-                    do_fill_buffer(true);
+                    fill_buffer(false);
                 }
 
                 return result;
@@ -466,39 +483,40 @@ struct flash_producer : public core::frame_producer
 
     // flash_producer
 
-    void fill_buffer()
+    void fill_buffer(bool allow_faster_rendering = true)
     {
-        if (executor_.size() > 0)
+        if (filling_.exchange(true))
             return;
 
-        executor_.begin_invoke([this] { do_fill_buffer(false); });
+        executor_.begin_invoke([=] { do_fill_buffer(allow_faster_rendering, 0); });
     }
 
-    void do_fill_buffer(bool initial_buffer_fill)
+    // NOTE: Every task renders one frame and queues the next, so that calls which are queued meanwhile, e.g. from
+    // AMCP, run between two frames instead of waiting until the whole buffer is filled.
+    void do_fill_buffer(bool allow_faster_rendering, int nothing_rendered)
     {
-        int       nothing_rendered             = 0;
         const int MAX_NOTHING_RENDERED_RETRIES = 4;
 
-        auto to_render              = buffer_size_ - output_buffer_.size();
-        bool allow_faster_rendering = !initial_buffer_fill;
-        int  rendered               = 0;
-
-        while (rendered < to_render) {
-            bool was_rendered = next(allow_faster_rendering);
-            log_buffered();
-
-            if (was_rendered) {
-                ++rendered;
-            } else {
-                if (nothing_rendered++ < MAX_NOTHING_RENDERED_RETRIES) {
-                    // Flash player not ready with first frame, sleep to not busy-loop;
-                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                    std::this_thread::yield();
-                } else
-                    return;
-            }
+        if (output_buffer_.size() >= buffer_size_) {
+            filling_ = false;
+            return;
+        }
+
+        bool was_rendered = next(allow_faster_rendering);
+        log_buffered();
+
+        if (was_rendered) {
+            nothing_rendered = 0;
+        } else if (nothing_rendered++ < MAX_NOTHING_RENDERED_RETRIES) {
+            // Flash player not ready with first frame, sleep to not busy-loop;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        } else {
+            filling_ = false;
+            return;
+        }
 
-            // TODO yield
+        if (executor_.is_running()) {
+            executor_.begin_invoke([=] { do_fill_buffer(allow_faster_rendering, nothing_rendered); });
         }
     }
 
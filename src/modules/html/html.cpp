@@ -35,6 +35,7 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/property_tree/ptree.hpp>
+#include <boost/range/algorithm/find_if.hpp>
 #include <boost/range/algorithm/remove_if.hpp>
 
 #include <map>
@@ -64,6 +65,40 @@ void caspar_log(const CefRefPtr<CefBrowser>&        browser,
     }
 }
 
+CefRefPtr<CefV8Value> to_v8(const CefRefPtr<CefValue>& value)
+{
+    switch (value->GetType()) {
+        case VTYPE_BOOL:
+            return CefV8Value::CreateBool(value->GetBool());
+        case VTYPE_INT:
+            return CefV8Value::CreateInt(value->GetInt());
+        case VTYPE_DOUBLE:
+            return CefV8Value::CreateDouble(value->GetDouble());
+        case VTYPE_STRING:
+            return CefV8Value::CreateString(value->GetString());
+        case VTYPE_DICTIONARY: {
+            auto                        dictionary = value->GetDictionary();
+            auto                        result     = CefV8Value::CreateObject(nullptr, nullptr);
+            CefDictionaryValue::KeyList keys;
+            dictionary->GetKeys(keys);
+            for (auto& key : keys) {
+                result->SetValue(key, to_v8(dictionary->GetValue(key)), V8_PROPERTY_ATTRIBUTE_NONE);
+            }
+            return result;
+        }
+        case VTYPE_LIST: {
+            auto list   = value->GetList();
+            auto result = CefV8Value::CreateArray(static_cast<int>(list->GetSize()));
+            for (std::size_t n = 0; n < list->GetSize(); ++n) {
+                result->SetValue(static_cast<int>(n), to_v8(list->GetValue(n)));
+            }
+            return result;
+        }
+        default:
+            return CefV8Value::CreateNull();
+    }
+}
+
 class remove_handler : public CefV8Handler
 {
     CefRefPtr<CefBrowser> browser_;
@@ -137,11 +172,21 @@ class renderer_application
 				delete requestedAnimationFrames[animationFrameId];
 			}
 
-			function tickAnimations() {
+			var animationFrameTime = null;
+
+			function tickAnimations(interval) {
 				var requestedFrames = requestedAnimationFrames;
-				var timestamp = performance.now();
+				var now = performance.now();
 				requestedAnimationFrames = {};
 
+				// Frames are timed by the channel, the clock is only followed again after a stall.
+				if (animationFrameTime === null || !interval || Math.abs(now - animationFrameTime) > 1000)
+					animationFrameTime = now;
+				else
+					animationFrameTime += interval;
+
+				var timestamp = animationFrameTime;
+
 				for (var animationFrameId in requestedFrames)
 					if (requestedFrames.hasOwnProperty(animationFrameId))
 						requestedFrames[animationFrameId](timestamp);
@@ -199,10 +244,62 @@ class renderer_application
                                   CefRefPtr<CefProcessMessage> message) override
     {
         if (message->GetName().ToString() == TICK_MESSAGE_NAME) {
+            auto interval = message->GetArgumentList()->GetDouble(0);
+            auto script   = "tickAnimations(" + boost::lexical_cast<std::string>(interval) + ")";
             for (auto& context : contexts_) {
+                // NOTE: Browsers may share a renderer process, each only steps its own animations.
+                if (!context->GetBrowser()->IsSame(browser))
+                    continue;
+
+                CefRefPtr<CefV8Value>     ret;
+                CefRefPtr<CefV8Exception> exception;
+                context->Eval(script, CefString(), 1, ret, exception);
+            }
+
+            auto context = boost::find_if(
+                contexts_, [&](const CefRefPtr<CefV8Context>& c) { return c->GetBrowser()->IsSame(browser); });
+
+            if (message->GetArgumentList()->GetBool(1) && context != contexts_.end()) {
+                // NOTE: performance.memory is only reported by chromium, it covers the javascript heap of the page.
                 CefRefPtr<CefV8Value>     ret;
                 CefRefPtr<CefV8Exception> exception;
-                context->Eval("tickAnimations()", CefString(), 1, ret, exception);
+                auto                      script = "performance.memory ? performance.memory.usedJSHeapSize : 0";
+                if ((*context)->Eval(script, CefString(), 1, ret, exception) &&
+                    (ret->IsInt() || ret->IsUInt() || ret->IsDouble())) {
+                    auto reply = CefProcessMessage::Create(MEMORY_MESSAGE_NAME);
+                    reply->GetArgumentList()->SetDouble(0, ret->GetDoubleValue());
+                    browser->SendProcessMessage(PID_BROWSER, reply);
+                }
+            }
+
+            return true;
+        } else if (message->GetName().ToString() == UPDATE_MESSAGE_NAME) {
+            auto context = boost::find_if(
+                contexts_, [&](const CefRefPtr<CefV8Context>& c) { return c->GetBrowser()->IsSame(browser); });
+
+            if (context != contexts_.end() && (*context)->Enter()) {
+                auto args   = message->GetArgumentList();
+                auto window = (*context)->GetGlobal();
+                auto caspar = window->GetValue("caspar");
+                auto update = window->GetValue("update");
+
+                if (caspar && caspar->IsObject()) {
+                    caspar->SetValue("data",
+                                     args->GetSize() > 1 ? to_v8(args->GetValue(1)) : CefV8Value::CreateNull(),
+                                     V8_PROPERTY_ATTRIBUTE_NONE);
+                }
+
+                if (update && update->IsFunction()) {
+                    update->ExecuteFunction(window, {CefV8Value::CreateString(args->GetString(0))});
+                    if (update->HasException()) {
+                        caspar_log(browser,
+                                   boost::log::trivial::warning,
+                                   "update failed: " + update->GetException()->GetMessage().ToString());
+                        update->ClearException();
+                    }
+                }
+
+                (*context)->Exit();
             }
 
             return true;
@@ -261,6 +358,7 @@ void init(core::module_dependencies dependencies)
 
 void uninit()
 {
+    clear_browser_pool();
     invoke([] { CefQuitMessageLoop(); });
     g_cef_executor->begin_invoke([&] { CefShutdown(); });
     g_cef_executor.reset();
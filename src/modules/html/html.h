@@ -32,6 +32,11 @@ namespace caspar { namespace html {
 const std::string TICK_MESSAGE_NAME   = "CasparCGTick";
 const std::string REMOVE_MESSAGE_NAME = "CasparCGRemove";
 const std::string LOG_MESSAGE_NAME    = "CasparCGLog";
+const std::string MEMORY_MESSAGE_NAME = "CasparCGMemory";
+const std::string UPDATE_MESSAGE_NAME = "CasparCGUpdate";
+
+// NOTE: Producer call which hands template data to the page, instead of javascript to be evaluated.
+const std::wstring UPDATE_CALL_NAME = L"CasparCGUpdate";
 
 bool              intercept_command_line(int argc, char** argv);
 void              init(core::module_dependencies dependencies);
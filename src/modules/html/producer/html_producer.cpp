@@ -40,24 +40,35 @@
 #include <common/timer.h>
 
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/log/trivial.hpp>
+#include <boost/optional.hpp>
 #include <boost/property_tree/ptree.hpp>
 
 #include <tbb/atomic.h>
 #include <tbb/concurrent_queue.h>
 
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <map>
 #include <mutex>
+#include <tuple>
 
 #pragma warning(push)
 #pragma warning(disable : 4458)
 #include <include/cef_app.h>
 #include <include/cef_client.h>
+#include <include/cef_parser.h>
 #include <include/cef_render_handler.h>
 #include <include/cef_task.h>
 #pragma warning(pop)
 
 #include <queue>
+#include <vector>
 
 #include "../html.h"
 
@@ -66,6 +77,56 @@
 
 namespace caspar { namespace html {
 
+// Frames of the animations of pages, keyed by the page, its video format and everything that was sent to it up to the
+// call which started the animation, see html_client::begin_segment. The least recently used are evicted once the
+// entries hold more than configuration.html.bake-frames frames, 0 disables the cache.
+class bake_cache
+{
+  public:
+    typedef std::shared_ptr<const std::vector<core::draw_frame>> segment_t;
+
+    static bake_cache& instance()
+    {
+        static bake_cache cache;
+        return cache;
+    }
+
+    std::size_t capacity() const { return capacity_; }
+
+    segment_t find(std::size_t key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = std::find_if(entries_.begin(), entries_.end(), [&](const auto& e) { return e.first == key; });
+        if (it == entries_.end())
+            return nullptr;
+
+        entries_.splice(entries_.begin(), entries_, it);
+        return it->second;
+    }
+
+    void store(std::size_t key, segment_t segment)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        frames_ += segment->size();
+        entries_.emplace_front(key, std::move(segment));
+
+        while (frames_ > capacity_ && !entries_.empty()) {
+            frames_ -= entries_.back().second->size();
+            entries_.pop_back();
+        }
+    }
+
+  private:
+    const std::size_t capacity_ = static_cast<std::size_t>(
+        std::max(0, env::properties().get(L"configuration.html.bake-frames", 0)));
+
+    std::mutex                                    mutex_;
+    std::list<std::pair<std::size_t, segment_t>> entries_;
+    std::size_t                                   frames_ = 0;
+};
+
 class html_client
     : public CefClient
     , public CefRenderHandler
@@ -79,7 +140,7 @@ class html_client
     caspar::timer                       frame_timer_;
     caspar::timer                       paint_timer_;
 
-    spl::shared_ptr<core::frame_factory> frame_factory_;
+    std::shared_ptr<core::frame_factory> frame_factory_; // Empty while the browser waits in the pool.
     core::video_format_desc              format_desc_;
     tbb::concurrent_queue<std::wstring>  javascript_before_load_;
     std::atomic<bool>                    loaded_;
@@ -89,21 +150,59 @@ class html_client
     core::draw_frame   last_frame_;
     mutable std::mutex last_frame_mutex_;
 
+    core::const_frame last_paint_; // Only used on the UI thread.
+
     CefRefPtr<CefBrowser> browser_;
 
+    std::atomic<double> js_heap_size_{0.0};
+    std::uint64_t       tick_count_ = 0;
+
+    std::mutex                    update_mutex_;
+    boost::optional<std::wstring> pending_update_;
+    std::atomic<std::int64_t>     updates_applied_{0};
+    std::atomic<std::int64_t>     updates_dropped_{0};
+
+    // Animations which are started by a call are recorded into the bake cache, and are played from it once they are
+    // started by the same call after the same inputs again, see begin_segment.
+    mutable std::mutex                             bake_mutex_;
+    std::size_t                                    inputs_ = 0; // Hash of the page and everything sent to it.
+    std::shared_ptr<std::vector<core::draw_frame>> recording_;
+    std::size_t                                    recording_key_ = 0;
+    bake_cache::segment_t                          playback_;
+    std::size_t                                    playback_position_ = 0;
+    std::atomic<std::int64_t>                      segments_baked_{0};
+    std::atomic<std::int64_t>                      segments_played_{0};
+
     executor executor_;
 
   public:
-    html_client(spl::shared_ptr<core::frame_factory> frame_factory,
-                spl::shared_ptr<diagnostics::graph>  graph,
-                const core::video_format_desc&       format_desc,
-                const std::wstring&                  url)
-        : url_(url)
-        , graph_(graph)
-        , frame_factory_(std::move(frame_factory))
+    explicit html_client(const core::video_format_desc& format_desc)
+        : url_(L"about:blank")
         , format_desc_(format_desc)
         , executor_(L"html_producer")
     {
+        loaded_ = false;
+    }
+
+    // Binds the browser to a producer and navigates it to url.
+    void open(spl::shared_ptr<core::frame_factory> frame_factory,
+              spl::shared_ptr<diagnostics::graph>  graph,
+              const std::wstring&                  url)
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        // NOTE: Tasks of the previous producer must not see the new one.
+        executor_.invoke([] {});
+
+        url_           = url;
+        graph_         = std::move(graph);
+        frame_factory_ = std::move(frame_factory);
+        loaded_        = false;
+        js_heap_size_  = 0.0;
+        reset_frames();
+        reset_updates();
+        reset_bake();
+
         graph_->set_color("browser-tick-time", diagnostics::color(0.1f, 1.0f, 0.1f));
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
@@ -111,21 +210,70 @@ class html_client
         graph_->set_text(print());
         diagnostics::register_graph(graph_);
 
-        loaded_ = false;
+        if (browser_ != nullptr) {
+            browser_->GetMainFrame()->LoadURL(url_);
+        }
+
         executor_.begin_invoke([&] { update(); });
     }
 
+    // Unbinds the browser from its producer and navigates it to a blank page, so that it can be opened again.
+    void unload()
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        executor_.invoke([] {});
+
+        url_           = L"about:blank";
+        graph_         = spl::make_shared<diagnostics::graph>();
+        frame_factory_ = nullptr;
+        loaded_        = false;
+        reset_frames();
+        reset_updates();
+        reset_bake();
+
+        std::wstring javascript;
+        while (javascript_before_load_.try_pop(javascript)) {
+        }
+
+        if (browser_ != nullptr) {
+            browser_->GetMainFrame()->LoadURL(url_);
+        }
+    }
+
     void close()
     {
-        html::invoke([=] {
-            if (browser_ != nullptr) {
-                browser_->GetHost()->CloseBrowser(true);
-            }
-        });
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        if (browser_ != nullptr) {
+            browser_->GetHost()->CloseBrowser(true);
+        }
     }
 
+    const core::video_format_desc& format_desc() const { return format_desc_; }
+
+    // Bytes of javascript heap used by the page, as last reported by its renderer process.
+    double js_heap_size() const { return js_heap_size_; }
+
     core::draw_frame receive()
     {
+        {
+            std::lock_guard<std::mutex> lock(bake_mutex_);
+
+            // NOTE: The browser is not ticked while a segment is played from the cache. Updates fall back to the live
+            // page, which is then caught up with what was played.
+            if (playback_ && !has_update()) {
+                auto frame = playback_->at(playback_position_++);
+                if (playback_position_ == playback_->size())
+                    end_playback();
+
+                std::lock_guard<std::mutex> last_lock(last_frame_mutex_);
+                last_frame_ = frame;
+                return frame;
+            }
+            end_playback();
+        }
+
         auto frame = last_frame();
         executor_.begin_invoke([&] { update(); });
         return frame;
@@ -140,13 +288,46 @@ class html_client
     void execute_javascript(const std::wstring& javascript)
     {
         if (!loaded_) {
+            // NOTE: Scripts queued before the page has loaded are evaluated in order, so a pending update goes first,
+            // as a script of its own.
+            auto data = take_update();
+            if (data)
+                javascript_before_load_.push(update_script(*data));
             javascript_before_load_.push(javascript);
+            input(javascript);
         } else {
             execute_queued_javascript();
+            send_update();
             do_execute_javascript(javascript);
+            begin_segment(javascript);
         }
     }
 
+    // Hands data to the update function of the page. Updates are sent once per tick, so updates superseded within a
+    // tick are dropped, only the last one is applied.
+    void update_data(std::wstring data)
+    {
+        std::lock_guard<std::mutex> lock(update_mutex_);
+
+        if (pending_update_)
+            ++updates_dropped_;
+        pending_update_ = std::move(data);
+    }
+
+    std::int64_t updates_applied() const { return updates_applied_; }
+
+    std::int64_t updates_dropped() const { return updates_dropped_; }
+
+    std::int64_t segments_baked() const { return segments_baked_; }
+
+    std::int64_t segments_played() const { return segments_played_; }
+
+    bool playing_baked() const
+    {
+        std::lock_guard<std::mutex> lock(bake_mutex_);
+        return playback_ != nullptr;
+    }
+
     bool OnBeforePopup(CefRefPtr<CefBrowser>   browser,
                        CefRefPtr<CefFrame>     frame,
                        const CefString&        target_url,
@@ -191,24 +372,71 @@ class html_client
         paint_timer_.restart();
         CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
 
-        if (type != PET_VIEW)
+        if (type != PET_VIEW || !frame_factory_)
             return;
 
         core::pixel_format_desc pixel_desc;
         pixel_desc.format = core::pixel_format::bgra;
         pixel_desc.planes.push_back(core::pixel_format_desc::plane(width, height, 4));
 
-        auto frame = frame_factory_->create_frame(this, pixel_desc);
+        // NOTE: Most graphics only change a small part of the view, so only the dirty rects are uploaded on top of
+        // the texture of the previous paint. The host image stays complete for mixers on other devices.
+        std::vector<core::frame_region> regions;
+        for (auto& rect : dirtyRects) {
+            regions.push_back(core::frame_region{rect.x, rect.y, rect.width, rect.height});
+        }
+
+        auto frame = frame_factory_->update_frame(this, pixel_desc, last_paint_, regions);
         std::memcpy(frame.image_data(0).begin(), buffer, width * height * 4);
 
+        last_paint_ = core::const_frame(std::move(frame));
+        push_frame(core::draw_frame(last_paint_));
+    }
+
+    void OnAcceleratedPaint(CefRefPtr<CefBrowser> browser,
+                            PaintElementType      type,
+                            const RectList&       dirtyRects,
+                            void*                 shared_handle) override
+    {
+        graph_->set_value("browser-tick-time", paint_timer_.elapsed() * format_desc_.fps * 0.5);
+        paint_timer_.restart();
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        if (type != PET_VIEW || !frame_factory_)
+            return;
+
+        // NOTE: The view is copied on the gpu, the paint never passes through host memory.
+        try {
+            auto frame = frame_factory_->import_frame(
+                this, shared_handle, format_desc_.square_width, format_desc_.square_height);
+            last_paint_ = core::const_frame{};
+            push_frame(core::draw_frame(std::move(frame)));
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    void reset_frames()
+    {
         {
             std::lock_guard<std::mutex> lock(frames_mutex_);
+            frames_ = std::queue<core::draw_frame>{};
+        }
+        {
+            std::lock_guard<std::mutex> lock(last_frame_mutex_);
+            last_frame_ = core::draw_frame{};
+        }
+        last_paint_ = core::const_frame{};
+    }
 
-            frames_.push(core::draw_frame(std::move(frame)));
-            while (frames_.size() > 2) {
-                frames_.pop();
-                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
-            }
+    void push_frame(core::draw_frame frame)
+    {
+        std::lock_guard<std::mutex> lock(frames_mutex_);
+
+        frames_.push(std::move(frame));
+        while (frames_.size() > 2) {
+            frames_.pop();
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
         }
     }
 
@@ -217,6 +445,11 @@ class html_client
         CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
 
         browser_ = browser;
+
+        // NOTE: Browsers are created blank, the producer may have been opened while this one was being created.
+        if (url_ != L"about:blank") {
+            browser_->GetMainFrame()->LoadURL(url_);
+        }
     }
 
     void OnBeforeClose(CefRefPtr<CefBrowser> browser) override
@@ -252,6 +485,10 @@ class html_client
 
     void OnLoadEnd(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, int httpStatusCode) override
     {
+        // NOTE: The blank page of a recycled browser may finish loading after the browser has been opened again.
+        if (frame->GetURL().ToWString() == L"about:blank" && url_ != L"about:blank")
+            return;
+
         loaded_ = true;
         execute_queued_javascript();
     }
@@ -272,15 +509,34 @@ class html_client
             auto msg      = args->GetString(1).ToWString();
 
             BOOST_LOG_SEV(log::logger::get(), severity) << print() << L" [renderer_process] " << msg;
+        } else if (name == MEMORY_MESSAGE_NAME) {
+            js_heap_size_ = message->GetArgumentList()->GetDouble(0);
+
+            return true;
         }
 
         return false;
     }
 
-    void invoke_requested_animation_frames()
+    // Steps the animations of the page by frames channel frames, and paints it.
+    void invoke_requested_animation_frames(std::size_t frames = 1)
     {
-        if (browser_)
-            browser_->SendProcessMessage(CefProcessId::PID_RENDERER, CefProcessMessage::Create(TICK_MESSAGE_NAME));
+        if (browser_) {
+            // NOTE: Animations are stepped by exactly one channel frame per tick, see tickAnimations in html.cpp.
+            auto message = CefProcessMessage::Create(TICK_MESSAGE_NAME);
+            message->GetArgumentList()->SetDouble(0, frames * 1000.0 / format_desc_.fps);
+
+            // NOTE: The memory used by the page is reported about once a second.
+            message->GetArgumentList()->SetBool(1, tick_count_++ % static_cast<std::uint64_t>(format_desc_.fps) == 0);
+            browser_->SendProcessMessage(CefProcessId::PID_RENDERER, message);
+        }
+
+        // NOTE: The browser only paints when it is sent a begin frame, so that every tick of the channel renders
+        // exactly one frame, instead of the browser painting on a timer of its own which beats against the channel.
+        html::begin_invoke([=] {
+            if (browser_ != nullptr)
+                browser_->GetHost()->SendExternalBeginFrame();
+        });
 
         graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
         tick_timer_.restart();
@@ -313,6 +569,9 @@ class html_client
 
     void update()
     {
+        if (loaded_)
+            send_update();
+
         invoke_requested_animation_frames();
 
         auto num_frames = [&] {
@@ -321,14 +580,102 @@ class html_client
         }();
 
         if (num_frames >= 1) {
-            auto                        frame = pop();
+            auto frame = pop();
+            record(frame);
             std::lock_guard<std::mutex> lock(last_frame_mutex_);
             last_frame_ = frame;
         } else {
             graph_->set_tag(diagnostics::tag_severity::SILENT, "late-frame");
+            end_recording();
+        }
+    }
+
+    // Adds what was sent to the page to its inputs. A segment which is being recorded or played no longer follows
+    // from the call which started it.
+    void input(const std::wstring& value)
+    {
+        std::lock_guard<std::mutex> lock(bake_mutex_);
+        recording_.reset();
+        end_playback();
+        boost::hash_combine(inputs_, value);
+    }
+
+    // NOTE: A call to a page which has got the same inputs as before is assumed to start the same animation, as
+    // animations are stepped by the channel rather than the clock. It is played from the cache if it has been
+    // recorded, otherwise it is recorded until the page stops painting.
+    void begin_segment(const std::wstring& javascript)
+    {
+        input(javascript);
+
+        auto& cache = bake_cache::instance();
+        if (cache.capacity() == 0)
+            return;
+
+        std::lock_guard<std::mutex> lock(bake_mutex_);
+        playback_ = cache.find(inputs_);
+        if (playback_) {
+            playback_position_ = 0;
+            ++segments_played_;
+        } else {
+            recording_     = std::make_shared<std::vector<core::draw_frame>>();
+            recording_key_ = inputs_;
         }
     }
 
+    void record(const core::draw_frame& frame)
+    {
+        std::lock_guard<std::mutex> lock(bake_mutex_);
+        if (!recording_)
+            return;
+
+        recording_->push_back(frame);
+        if (recording_->size() > bake_cache::instance().capacity())
+            recording_.reset();
+    }
+
+    void end_recording()
+    {
+        std::lock_guard<std::mutex> lock(bake_mutex_);
+        if (!recording_ || recording_->empty())
+            return;
+
+        bake_cache::instance().store(recording_key_, std::move(recording_));
+        recording_.reset();
+        ++segments_baked_;
+    }
+
+    // Catches the page up with the frames which were played from the cache. Called with bake_mutex_ held.
+    void end_playback()
+    {
+        if (!playback_)
+            return;
+
+        auto frames = playback_position_;
+        playback_.reset();
+        if (frames > 0)
+            executor_.begin_invoke([=] { invoke_requested_animation_frames(frames); });
+    }
+
+    void reset_bake()
+    {
+        std::lock_guard<std::mutex> lock(bake_mutex_);
+        inputs_ = 0;
+        boost::hash_combine(inputs_, url_);
+        boost::hash_combine(inputs_, format_desc_.square_width);
+        boost::hash_combine(inputs_, format_desc_.square_height);
+        boost::hash_combine(inputs_, format_desc_.fps);
+        recording_.reset();
+        playback_.reset();
+        segments_baked_  = 0;
+        segments_played_ = 0;
+    }
+
+    bool has_update()
+    {
+        std::lock_guard<std::mutex> lock(update_mutex_);
+        return pending_update_.is_initialized();
+    }
+
     void do_execute_javascript(const std::wstring& javascript)
     {
         html::begin_invoke([=] {
@@ -338,6 +685,58 @@ class html_client
         });
     }
 
+    void reset_updates()
+    {
+        std::lock_guard<std::mutex> lock(update_mutex_);
+        pending_update_.reset();
+        updates_applied_ = 0;
+        updates_dropped_ = 0;
+    }
+
+    boost::optional<std::wstring> take_update()
+    {
+        std::unique_lock<std::mutex> lock(update_mutex_);
+
+        auto data = std::move(pending_update_);
+        pending_update_.reset();
+        if (data)
+            ++updates_applied_;
+        lock.unlock();
+
+        if (data)
+            input(*data);
+        return data;
+    }
+
+    static std::wstring update_script(const std::wstring& data)
+    {
+        return (boost::wformat(L"update(\"%1%\")") % boost::algorithm::replace_all_copy(data, "\"", "\\\"")).str();
+    }
+
+    // NOTE: The data is sent as a process message instead of being quoted into a script, and json is parsed here, off
+    // the main thread of the renderer, which gives it to the page as caspar.data before calling update.
+    void send_update()
+    {
+        auto data = take_update();
+        if (!data)
+            return;
+
+        auto message = CefProcessMessage::Create(UPDATE_MESSAGE_NAME);
+        auto args    = message->GetArgumentList();
+        args->SetString(0, *data);
+
+        if (!data->empty() && (data->front() == L'{' || data->front() == L'[')) {
+            auto value = CefParseJSON(*data, JSON_PARSER_RFC);
+            if (value)
+                args->SetValue(1, value);
+        }
+
+        html::begin_invoke([=] {
+            if (browser_ != nullptr)
+                browser_->SendProcessMessage(PID_RENDERER, message);
+        });
+    }
+
     void execute_queued_javascript()
     {
         std::wstring javascript;
@@ -351,6 +750,116 @@ class html_client
     IMPLEMENT_REFCOUNTING(html_client);
 };
 
+// Keeps blank browsers ready for each video format, so that starting a producer only navigates a browser instead of
+// creating one along with its renderer processes. Only used on the UI thread.
+class browser_pool
+{
+    typedef std::tuple<int, int, int> key_t;
+
+    std::map<key_t, std::vector<CefRefPtr<html_client>>> idle_;
+
+    static key_t key(const core::video_format_desc& format_desc)
+    {
+        return key_t(format_desc.square_width, format_desc.square_height, static_cast<int>(std::ceil(format_desc.fps)));
+    }
+
+    static std::size_t size()
+    {
+        return static_cast<std::size_t>(std::max(0, env::properties().get(L"configuration.html.browser-pool", 2)));
+    }
+
+    static CefRefPtr<html_client> create(const core::video_format_desc& format_desc)
+    {
+        CefRefPtr<html_client> client = new html_client(format_desc);
+
+        CefWindowInfo window_info;
+        window_info.width                        = format_desc.square_width;
+        window_info.height                       = format_desc.square_height;
+        window_info.windowless_rendering_enabled = true;
+        window_info.external_begin_frame_enabled = true;
+
+        const bool enable_gpu = env::properties().get(L"configuration.html.enable-gpu", false);
+
+#ifdef _WIN32
+        // NOTE: With the gpu enabled the browser shares its view as a texture, see OnAcceleratedPaint.
+        window_info.shared_texture_enabled =
+            enable_gpu && env::properties().get(L"configuration.html.shared-texture", true);
+#endif
+
+        CefBrowserSettings browser_settings;
+        browser_settings.web_security = cef_state_t::STATE_DISABLED;
+        browser_settings.webgl        = enable_gpu ? cef_state_t::STATE_ENABLED : cef_state_t::STATE_DISABLED;
+        double fps                    = format_desc.fps;
+        browser_settings.windowless_frame_rate = int(ceil(fps));
+        CefBrowserHost::CreateBrowser(window_info, client.get(), L"about:blank", browser_settings, nullptr);
+
+        return client;
+    }
+
+  public:
+    static browser_pool& instance()
+    {
+        static browser_pool pool;
+        return pool;
+    }
+
+    CefRefPtr<html_client> checkout(const core::video_format_desc& format_desc)
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        auto&                  idle = idle_[key(format_desc)];
+        CefRefPtr<html_client> client;
+        if (!idle.empty()) {
+            client = idle.back();
+            idle.pop_back();
+        } else {
+            client = create(format_desc);
+        }
+
+        return client;
+    }
+
+    void fill(const core::video_format_desc& format_desc)
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        auto& idle = idle_[key(format_desc)];
+        while (idle.size() < size()) {
+            idle.push_back(create(format_desc));
+        }
+    }
+
+    void recycle(CefRefPtr<html_client> client)
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        auto& idle = idle_[key(client->format_desc())];
+        if (idle.size() < size()) {
+            client->unload();
+            idle.push_back(client);
+        } else {
+            client->close();
+        }
+    }
+
+    void clear()
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        for (auto& p : idle_) {
+            for (auto& client : p.second) {
+                client->close();
+            }
+        }
+        idle_.clear();
+    }
+};
+
+void clear_browser_pool()
+{
+    html::invoke([] { browser_pool::instance().clear(); });
+}
+
 class html_producer : public core::frame_producer
 {
     core::video_format_desc             format_desc_;
@@ -368,29 +877,20 @@ class html_producer : public core::frame_producer
         , url_(url)
     {
         html::invoke([&] {
-            client_ = new html_client(frame_factory, graph_, format_desc, url_);
-
-            CefWindowInfo window_info;
-            window_info.width                        = format_desc.square_width;
-            window_info.height                       = format_desc.square_height;
-            window_info.windowless_rendering_enabled = true;
+            client_ = browser_pool::instance().checkout(format_desc);
+            client_->open(frame_factory, graph_, url_);
+        });
 
-            const bool enable_gpu = env::properties().get(L"configuration.html.enable-gpu", false);
+        // NOTE: The pool is refilled once the producer has started, so that the next one does not have to wait.
+        html::begin_invoke([format_desc] { browser_pool::instance().fill(format_desc); });
 
-            CefBrowserSettings browser_settings;
-            browser_settings.web_security = cef_state_t::STATE_DISABLED;
-            browser_settings.webgl        = enable_gpu ? cef_state_t::STATE_ENABLED : cef_state_t::STATE_DISABLED;
-            double fps                    = format_desc.fps;
-            browser_settings.windowless_frame_rate = int(ceil(fps));
-            CefBrowserHost::CreateBrowser(window_info, client_.get(), url, browser_settings, nullptr);
-        });
         state_["file/path"] = u8(url_);
     }
 
     ~html_producer()
     {
         if (client_)
-            client_->close();
+            html::invoke([=] { browser_pool::instance().recycle(client_); });
     }
 
     // frame_producer
@@ -411,6 +911,11 @@ class html_producer : public core::frame_producer
         if (!client_)
             return make_ready_future(std::wstring(L""));
 
+        if (params.size() == 2 && params.at(0) == UPDATE_CALL_NAME) {
+            client_->update_data(params.at(1));
+            return make_ready_future(std::wstring(L""));
+        }
+
         auto javascript = params.at(0);
 
         client_->execute_javascript(javascript);
@@ -420,7 +925,19 @@ class html_producer : public core::frame_producer
 
     std::wstring print() const override { return L"html[" + url_ + L"]"; }
 
-    core::monitor::state state() const override { return state_; }
+    core::monitor::state state() const override
+    {
+        auto state = state_;
+        if (client_) {
+            state["memory/js-heap"]     = client_->js_heap_size();
+            state["cg/updates/applied"] = client_->updates_applied();
+            state["cg/updates/dropped"] = client_->updates_dropped();
+            state["bake/baked"]         = client_->segments_baked();
+            state["bake/played"]        = client_->segments_played();
+            state["bake/playing"]       = client_->playing_baked();
+        }
+        return state;
+    }
 };
 
 spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_producer_dependencies& dependencies,
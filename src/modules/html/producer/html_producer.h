@@ -35,4 +35,7 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
 spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_producer_dependencies& dependencies,
                                                          const std::vector<std::wstring>&         params);
 
+// Closes the browsers which are kept ready for new producers.
+void clear_browser_pool();
+
 }} // namespace caspar::html
\ No newline at end of file
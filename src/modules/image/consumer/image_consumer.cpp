@@ -33,34 +33,135 @@
 #include <common/except.h>
 #include <common/future.h>
 #include <common/log.h>
+#include <common/param.h>
 #include <common/utf.h>
 
 #include <core/consumer/frame_consumer.h>
 #include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
 #include <core/video_format.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/property_tree/ptree.hpp>
 
-#include <tbb/concurrent_queue.h>
+#include <tbb/task_arena.h>
 
 #include <algorithm>
+#include <atomic>
 #include <vector>
 
-#include "../util/image_view.h"
 #include "image/util/image_algorithms.h"
 
 namespace caspar { namespace image {
 
+enum class snapshot_format
+{
+    png,
+    jpeg,
+    raw,
+};
+
+namespace {
+
+// NOTE: Snapshots are encoded by a few workers of their own, so that bursts of snapshots queue up instead of taking
+// cores from playout. Snapshots beyond image.snapshot-queue waiting ones are dropped.
+class snapshot_encoder
+{
+    tbb::task_arena  arena_{std::max(1, env::properties().get(L"configuration.image.snapshot-threads", 1))};
+    const int        max_pending_ = std::max(1, env::properties().get(L"configuration.image.snapshot-queue", 16));
+    std::atomic<int> pending_{0};
+
+    static void encode(const array<const std::uint8_t>& image,
+                       int                              width,
+                       int                              height,
+                       snapshot_format                  format,
+                       const std::wstring&              filename)
+    {
+        if (format == snapshot_format::raw) {
+            boost::filesystem::ofstream file(boost::filesystem::path(filename), std::ios::binary);
+            file.write(reinterpret_cast<const char*>(image.begin()), image.size());
+            if (!file) {
+                CASPAR_THROW_EXCEPTION(io_error() << msg_info(L"Failed to write " + filename));
+            }
+            return;
+        }
+
+        // NOTE: jpeg has no alpha, the premultiplied colors are the frame over black as is.
+        auto bitmap = std::shared_ptr<FIBITMAP>(FreeImage_Allocate(width, height, 32), FreeImage_Unload);
+        convert_image(FreeImage_GetBits(bitmap.get()),
+                      image.begin(),
+                      width,
+                      height,
+                      format == snapshot_format::png ? alpha_operation::unmultiply : alpha_operation::none,
+                      true,
+                      FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_RGB);
+
+        // NOTE: The zlib levels 1 to 9 are also the png flags of FreeImage.
+        auto type  = FIF_PNG;
+        auto flags = std::min(9, std::max(1, env::properties().get(L"configuration.image.png-compression", 1)));
+        if (format == snapshot_format::jpeg) {
+            bitmap = std::shared_ptr<FIBITMAP>(FreeImage_ConvertTo24Bits(bitmap.get()), FreeImage_Unload);
+            type   = FIF_JPEG;
+            flags  = JPEG_QUALITYGOOD;
+        }
+
+#ifdef WIN32
+        auto saved = FreeImage_SaveU(type, bitmap.get(), filename.c_str(), flags);
+#else
+        auto saved = FreeImage_Save(type, bitmap.get(), u8(filename).c_str(), flags);
+#endif
+        if (!saved) {
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info(L"Failed to save " + filename));
+        }
+    }
+
+  public:
+    void enqueue(array<const std::uint8_t> image,
+                 int                       width,
+                 int                       height,
+                 snapshot_format           format,
+                 std::wstring              filename)
+    {
+        if (++pending_ > max_pending_) {
+            --pending_;
+            CASPAR_LOG(warning) << L"[image_consumer] Too many pending snapshots, dropped " << filename;
+            return;
+        }
+
+        arena_.enqueue([=] {
+            try {
+                encode(image, width, height, format, filename);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+            --pending_;
+        });
+    }
+};
+
+snapshot_encoder& encoder()
+{
+    static snapshot_encoder instance;
+    return instance;
+}
+
+} // namespace
+
 struct image_consumer : public core::frame_consumer
 {
-    std::wstring         filename_;
+    const std::wstring    filename_;
+    const snapshot_format format_;
+    const bool            thumbnail_;
 
   public:
     // frame_consumer
 
-    image_consumer(const std::wstring& filename)
+    image_consumer(const std::wstring& filename, snapshot_format format, bool thumbnail)
         : filename_(filename)
+        , format_(format)
+        , thumbnail_(thumbnail)
     {
     }
 
@@ -68,43 +169,41 @@ struct image_consumer : public core::frame_consumer
 
     std::future<bool> send(core::const_frame frame) override
     {
-        auto filename = filename_;
-
-        std::thread async([frame, filename] {
-            try {
-                auto filename2 = filename;
+        auto width  = static_cast<int>(frame.width());
+        auto height = static_cast<int>(frame.height());
+        auto image  = frame.image_data(0);
+
+        if (thumbnail_) {
+            // NOTE: The mixer only downscales frames once the consumer has been added, so the first frames may arrive
+            // without the quarter image.
+            image = frame.image_data(core::output_format::quarter);
+            if (!image) {
+                return make_ready_future(true);
+            }
+            width  = (width + 3) / 4;
+            height = (height + 3) / 4;
+        }
 
-                if (filename2.empty())
-                    filename2 = env::media_folder() +
-                                boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time()) +
-                                L".png";
-                else
-                    filename2 = env::media_folder() + filename2 + L".png";
+        auto filename = filename_.empty()
+                            ? boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time())
+                            : filename_;
 
-                auto bitmap = std::shared_ptr<FIBITMAP>(
-                    FreeImage_Allocate(static_cast<int>(frame.width()), static_cast<int>(frame.height()), 32),
-                    FreeImage_Unload);
-                std::memcpy(FreeImage_GetBits(bitmap.get()), frame.image_data(0).begin(), frame.image_data(0).size());
+        static const wchar_t* extensions[] = {L".png", L".jpg", L".raw"};
+        // NOTE: Absolute paths are written as they are, e.g. by the thumbnail generator into the thumbnail folder.
+        if (!boost::filesystem::path(filename).is_absolute())
+            filename = env::media_folder() + filename;
+        filename += extensions[static_cast<int>(format_)];
 
-                image_view<bgra_pixel> original_view(
-                    FreeImage_GetBits(bitmap.get()), static_cast<int>(frame.width()), static_cast<int>(frame.height()));
-                unmultiply(original_view);
-
-                FreeImage_FlipVertical(bitmap.get());
-#ifdef WIN32
-                FreeImage_SaveU(FIF_PNG, bitmap.get(), filename2.c_str(), 0);
-#else
-                FreeImage_Save(FIF_PNG, bitmap.get(), u8(filename2).c_str(), 0);
-#endif
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-            }
-        });
-        async.detach();
+        encoder().enqueue(std::move(image), width, height, format_, std::move(filename));
 
         return make_ready_future(false);
     }
 
+    core::output_format output_format() const override
+    {
+        return thumbnail_ ? core::output_format::quarter : core::output_format::bgra;
+    }
+
     std::wstring print() const override { return L"image[]"; }
 
     std::wstring name() const override { return L"image"; }
@@ -112,6 +211,7 @@ struct image_consumer : public core::frame_consumer
     int index() const override { return 100; }
 };
 
+// ADD <channel> IMAGE [<filename>] [FORMAT PNG|JPEG|RAW] [THUMBNAIL]
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                  params,
                                                       std::vector<spl::shared_ptr<core::video_channel>> channels)
 {
@@ -120,10 +220,19 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
 
     std::wstring filename;
 
-    if (params.size() > 1)
+    if (params.size() > 1 && !boost::iequals(params.at(1), L"FORMAT") && !boost::iequals(params.at(1), L"THUMBNAIL"))
         filename = params.at(1);
 
-    return spl::make_shared<image_consumer>(filename);
+    auto format = snapshot_format::png;
+    auto name   = get_param(L"FORMAT", params, L"PNG");
+    if (boost::iequals(name, L"JPEG") || boost::iequals(name, L"JPG"))
+        format = snapshot_format::jpeg;
+    else if (boost::iequals(name, L"RAW"))
+        format = snapshot_format::raw;
+    else if (!boost::iequals(name, L"PNG"))
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unsupported snapshot format " + name));
+
+    return spl::make_shared<image_consumer>(filename, format, contains_param(L"THUMBNAIL", params));
 }
 
 }} // namespace caspar::image
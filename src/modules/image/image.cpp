@@ -29,6 +29,8 @@
 
 #include "consumer/image_consumer.h"
 #include "producer/image_producer.h"
+#include "producer/image_scroll_producer.h"
+#include "producer/image_sequence_producer.h"
 #include "util/image_loader.h"
 
 #include <core/consumer/frame_consumer.h>
@@ -47,6 +49,8 @@ std::wstring version() { return u16(FreeImage_GetVersion()); }
 void init(core::module_dependencies dependencies)
 {
     FreeImage_Initialise();
+    dependencies.producer_registry->register_producer_factory(L"Image Sequence Producer", create_sequence_producer);
+    dependencies.producer_registry->register_producer_factory(L"Image Scroll Producer", create_scroll_producer);
     dependencies.producer_registry->register_producer_factory(L"Image Producer", create_producer);
     dependencies.consumer_registry->register_consumer_factory(L"Image Consumer", create_consumer);
 }
@@ -28,6 +28,8 @@
 #endif
 #include <FreeImage.h>
 
+#include "../util/image_algorithms.h"
+#include "../util/image_cache.h"
 #include "../util/image_loader.h"
 
 #include <core/video_format.h>
@@ -51,6 +53,7 @@
 #include <boost/property_tree/ptree.hpp>
 
 #include <algorithm>
+#include <chrono>
 #include <set>
 
 namespace caspar { namespace image {
@@ -62,6 +65,7 @@ struct image_producer : public core::frame_producer
     const spl::shared_ptr<core::frame_factory> frame_factory_;
     const uint32_t                             length_ = 0;
     core::draw_frame                           frame_;
+    std::shared_future<core::draw_frame>       future_frame_;
 
     image_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
                    const std::wstring&                         description,
@@ -69,9 +73,8 @@ struct image_producer : public core::frame_producer
         : description_(description)
         , frame_factory_(frame_factory)
         , length_(length)
+        , future_frame_(load_frame(frame_factory, description))
     {
-        load(load_image(description_));
-
         CASPAR_LOG(info) << print() << L" Initialized";
     }
 
@@ -90,23 +93,52 @@ struct image_producer : public core::frame_producer
 
     void load(const std::shared_ptr<FIBITMAP>& bitmap)
     {
-        FreeImage_FlipVertical(bitmap.get());
+        auto width  = static_cast<int>(FreeImage_GetWidth(bitmap.get()));
+        auto height = static_cast<int>(FreeImage_GetHeight(bitmap.get()));
+
         core::pixel_format_desc desc;
         desc.format = core::pixel_format::bgra;
-        desc.planes.push_back(
-            core::pixel_format_desc::plane(FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()), 4));
+        desc.planes.push_back(core::pixel_format_desc::plane(width, height, 4));
         auto frame = frame_factory_->create_frame(this, desc);
 
-        std::copy_n(FreeImage_GetBits(bitmap.get()), frame.image_data(0).size(), frame.image_data(0).begin());
+        convert_image(frame.image_data(0).begin(),
+                      FreeImage_GetBits(bitmap.get()),
+                      width,
+                      height,
+                      alpha_operation::none,
+                      true,
+                      FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_RGB);
         frame_ = core::draw_frame(std::move(frame));
     }
 
+    // NOTE: The image is decoded on a worker thread, the producer is empty until it is ready. Decode errors are
+    // logged, since they arrive after the command which created the producer has completed.
+    void poll()
+    {
+        if (!future_frame_.valid() ||
+            future_frame_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+
+        try {
+            frame_ = future_frame_.get();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+        future_frame_ = std::shared_future<core::draw_frame>();
+    }
+
     // frame_producer
 
-    core::draw_frame last_frame() override { return frame_; }
+    core::draw_frame last_frame() override
+    {
+        poll();
+        return frame_;
+    }
 
     core::draw_frame receive_impl(int nb_samples) override
     {
+        poll();
         state_["file/path"] = description_;
         return frame_;
     }
@@ -138,55 +170,6 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
 {
     auto length = get_param(L"LENGTH", params, std::numeric_limits<uint32_t>::max());
 
-    // if (boost::iequals(params.at(0), L"[IMG_SEQUENCE]"))
-    //{
-    //	if (params.size() != 2)
-    //		return core::frame_producer::empty();
-
-    //	auto dir = boost::filesystem::path(env::media_folder() + params.at(1)).parent_path();
-    //	auto basename = boost::filesystem::basename(params.at(1));
-    //	std::set<std::wstring> files;
-    //	boost::filesystem::directory_iterator end;
-
-    //	for (boost::filesystem::directory_iterator it(dir); it != end; ++it)
-    //	{
-    //		auto name = it->path().filename().wstring();
-
-    //		if (!boost::algorithm::istarts_with(name, basename))
-    //			continue;
-
-    //		auto extension = it->path().extension().wstring();
-
-    //		if (std::find_if(supported_extensions().begin(), supported_extensions().end(), ieq(extension)) ==
-    // supported_extensions().end()) 			continue;
-
-    //		files.insert(it->path().wstring());
-    //	}
-
-    //	if (files.empty())
-    //		return core::frame_producer::empty();
-
-    //	int width = -1;
-    //	int height = -1;
-    //	std::vector<core::draw_frame> frames;
-    //	frames.reserve(files.size());
-
-    //	for (auto& file : files)
-    //	{
-    //		auto frame = load_image(dependencies.frame_factory, file);
-
-    //		if (width == -1)
-    //		{
-    //			width = static_cast<int>(frame.second.width.get());
-    //			height = static_cast<int>(frame.second.height.get());
-    //		}
-
-    //		frames.push_back(std::move(frame.first));
-    //	}
-
-    //	return core::create_const_producer(std::move(frames), width, height);
-    //}
-    // else
     // if (boost::iequals(params.at(0), L"[PNG_BASE64]")) {
     //    if (params.size() < 2)
     //        return core::frame_producer::empty();
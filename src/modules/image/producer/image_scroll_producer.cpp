@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_scroll_producer.h"
+
+#include "../util/image_cache.h"
+#include "../util/image_loader.h"
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/filesystem.h>
+#include <common/param.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace caspar { namespace image {
+
+// Moves an image across the channel at its own size in pixels. Images as tall as the channel or shorter scroll
+// horizontally, from beyond the right edge until they have left through the left edge, like tickers. Taller images
+// scroll vertically from below the bottom edge, centred, like credits. A negative speed scrolls the other way.
+//
+// The image is uploaded once, in tiles if it is large, and only its translation changes from frame to frame, so every
+// frame costs the mixer one textured quad for each visible tile. The translation is not rounded, the mixer samples
+// the image between pixels for speeds which are not whole pixels per frame.
+struct image_scroll_producer : public core::frame_producer
+{
+    core::monitor::state                 state_;
+    const std::wstring                   filename_;
+    const core::video_format_desc        format_desc_;
+    const std::pair<int, int>            size_;
+    const bool                           vertical_;
+    const double                         speed_;
+    const int                            blur_;
+    const double                         distance_;
+    std::shared_future<core::draw_frame> future_frame_;
+    core::draw_frame                     strip_;
+    std::uint32_t                        waited_   = 0;
+    double                               position_ = 0.0;
+
+    image_scroll_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                          const core::video_format_desc&              format_desc,
+                          const std::wstring&                         filename,
+                          double                                      speed,
+                          int                                         blur)
+        : filename_(filename)
+        , format_desc_(format_desc)
+        , size_(get_image_size(filename))
+        , vertical_(size_.second > format_desc.height)
+        , speed_(speed)
+        , blur_(std::max(1, blur))
+        , distance_(vertical_ ? format_desc.height + size_.second : format_desc.width + size_.first)
+        , future_frame_(load_frame(frame_factory, filename))
+    {
+        if (speed_ == 0.0) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"SPEED must not be 0."));
+        }
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    // NOTE: The image is decoded on a worker thread, the scroll starts once it is ready.
+    void poll()
+    {
+        if (!future_frame_.valid() ||
+            future_frame_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+
+        try {
+            strip_ = future_frame_.get();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+        future_frame_ = std::shared_future<core::draw_frame>();
+    }
+
+    // The strip when it has travelled position pixels, at its own size in the frame.
+    core::draw_frame place(double position) const
+    {
+        const auto width  = static_cast<double>(format_desc_.width);
+        const auto height = static_cast<double>(format_desc_.height);
+
+        // NOTE: A negative speed travels the same path in the opposite direction.
+        const auto travelled = speed_ > 0.0 ? position : distance_ - position;
+
+        core::frame_transform transform;
+        if (vertical_) {
+            transform.image_transform.fill_translation = {(width - size_.first) * 0.5 / width,
+                                                          (height - travelled) / height};
+        } else {
+            transform.image_transform.fill_translation = {(width - travelled) / width, 0.0};
+        }
+        transform.image_transform.fill_scale = {size_.first / width, size_.second / height};
+
+        return core::draw_frame::push(strip_, transform);
+    }
+
+    core::draw_frame render()
+    {
+        if (blur_ == 1) {
+            return place(position_);
+        }
+
+        // NOTE: The strip is drawn at evenly spaced positions across the distance travelled in one frame. Each copy is
+        // drawn over the ones before it with an opacity of one over its count, which averages opaque pixels evenly.
+        std::vector<core::draw_frame> samples;
+        for (auto n = 0; n < blur_; ++n) {
+            auto sample = place(position_ - std::abs(speed_) * n / blur_);
+            sample.transform().image_transform.opacity = 1.0 / (n + 1);
+            samples.push_back(std::move(sample));
+        }
+        return core::draw_frame(std::move(samples));
+    }
+
+    // frame_producer
+
+    core::draw_frame last_frame() override
+    {
+        poll();
+        return strip_ && position_ < distance_ ? render() : core::draw_frame{};
+    }
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        poll();
+
+        state_["file/path"]       = filename_;
+        state_["scroll/speed"]    = speed_;
+        state_["scroll/position"] = position_;
+
+        if (!strip_) {
+            ++waited_;
+            return core::draw_frame{};
+        }
+
+        if (position_ >= distance_) {
+            return core::draw_frame{};
+        }
+
+        auto frame = render();
+        position_ += std::abs(speed_);
+        return frame;
+    }
+
+    uint32_t nb_frames() const override
+    {
+        return waited_ + static_cast<uint32_t>(std::ceil(distance_ / std::abs(speed_)));
+    }
+
+    std::wstring print() const override { return L"image_scroll_producer[" + filename_ + L"]"; }
+
+    std::wstring name() const override { return L"image-scroll"; }
+
+    core::monitor::state state() const override { return state_; }
+};
+
+spl::shared_ptr<core::frame_producer> create_scroll_producer(const core::frame_producer_dependencies& dependencies,
+                                                             const std::vector<std::wstring>&         params)
+{
+    if (params.empty() || !contains_param(L"SPEED", params)) {
+        return core::frame_producer::empty();
+    }
+
+    std::wstring filename = env::media_folder() + params.at(0);
+
+    for (auto& extension : supported_extensions()) {
+        if (auto file = caspar::find_case_insensitive(boost::filesystem::path(filename).wstring() + extension)) {
+            return spl::make_shared<image_scroll_producer>(dependencies.frame_factory,
+                                                           dependencies.format_desc,
+                                                           *file,
+                                                           get_param(L"SPEED", params, 1.0),
+                                                           get_param(L"BLUR", params, 1));
+        }
+    }
+
+    return core::frame_producer::empty();
+}
+
+}} // namespace caspar::image
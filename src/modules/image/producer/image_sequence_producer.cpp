@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_sequence_producer.h"
+
+#include "../util/image_cache.h"
+#include "../util/image_loader.h"
+
+#include <core/frame/draw_frame.h>
+#include <core/monitor/monitor.h>
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/param.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <limits>
+#include <set>
+#include <utility>
+
+namespace caspar { namespace image {
+
+class image_sequence_producer : public core::frame_producer
+{
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const std::wstring                         description_;
+    const std::vector<std::wstring>            files_;
+    const bool                                 loop_;
+    const std::size_t                          prefetch_ =
+        std::max(1, env::properties().get(L"configuration.image.sequence-prefetch", 8));
+
+    std::deque<std::pair<std::uint32_t, std::future<core::draw_frame>>> queue_;
+    std::uint32_t                                                        next_     = 0;
+    std::uint32_t                                                        position_ = 0;
+    std::uint32_t                                                        late_     = 0;
+    core::draw_frame                                                     frame_;
+    core::monitor::state                                                 state_;
+
+    void fill()
+    {
+        while (queue_.size() < prefetch_) {
+            if (next_ >= files_.size()) {
+                if (!loop_) {
+                    break;
+                }
+                next_ = 0;
+            }
+            queue_.emplace_back(next_, decode_frame(frame_factory_, files_[next_]));
+            ++next_;
+        }
+    }
+
+  public:
+    image_sequence_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                            std::wstring                                description,
+                            std::vector<std::wstring>                   files,
+                            bool                                        loop)
+        : frame_factory_(frame_factory)
+        , description_(std::move(description))
+        , files_(std::move(files))
+        , loop_(loop)
+    {
+        fill();
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        if (!queue_.empty() &&
+            queue_.front().second.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            try {
+                frame_ = queue_.front().second.get();
+            } catch (...) {
+                // NOTE: A broken image is skipped, the previous one is shown instead.
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+            position_ = queue_.front().first;
+            queue_.pop_front();
+            fill();
+        } else if (!queue_.empty() && frame_) {
+            ++late_;
+        }
+
+        state_["file/path"]   = description_;
+        state_["file/frame"]  = {static_cast<int>(position_), static_cast<int>(files_.size())};
+        state_["late-frames"] = static_cast<int>(late_);
+        state_["loop"]        = loop_;
+
+        return frame_;
+    }
+
+    core::draw_frame last_frame() override { return frame_; }
+
+    uint32_t nb_frames() const override
+    {
+        return loop_ ? std::numeric_limits<uint32_t>::max() : static_cast<uint32_t>(files_.size());
+    }
+
+    std::wstring print() const override
+    {
+        return L"image_sequence_producer[" + description_ + L"|" + boost::lexical_cast<std::wstring>(position_) +
+               L"/" + boost::lexical_cast<std::wstring>(files_.size()) + L"]";
+    }
+
+    std::wstring name() const override { return L"image-sequence"; }
+
+    core::monitor::state state() const override { return state_; }
+};
+
+spl::shared_ptr<core::frame_producer> create_sequence_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"[IMG_SEQUENCE]")) {
+        return core::frame_producer::empty();
+    }
+
+    auto path   = boost::filesystem::path(env::media_folder() + params.at(1));
+    auto prefix = path.filename().wstring();
+
+    std::set<std::wstring>                files;
+    boost::system::error_code             ec;
+    boost::filesystem::directory_iterator end;
+    for (boost::filesystem::directory_iterator it(path.parent_path(), ec); !ec && it != end; it.increment(ec)) {
+        auto name      = it->path().filename().wstring();
+        auto extension = boost::to_lower_copy(it->path().extension().wstring());
+
+        if (boost::algorithm::istarts_with(name, prefix) &&
+            supported_extensions().find(extension) != supported_extensions().end()) {
+            files.insert(it->path().wstring());
+        }
+    }
+
+    if (files.empty()) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"No images found for " + params.at(1)));
+    }
+
+    return spl::make_shared<image_sequence_producer>(dependencies.frame_factory,
+                                                     params.at(1),
+                                                     std::vector<std::wstring>(files.begin(), files.end()),
+                                                     contains_param(L"LOOP", params));
+}
+
+}} // namespace caspar::image
@@ -21,29 +21,222 @@
 
 #include "image_algorithms.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <vector>
 
+#ifdef _MSC_VER
+#define CASPAR_TARGET_AVX2
+#else
+#define CASPAR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
 namespace caspar { namespace image {
 
-std::vector<std::pair<int, int>> get_line_points(int num_pixels, double angle_radians)
+namespace {
+
+bool has_avx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    // NOTE: The OS must also save the ymm registers on context switches.
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+__m128i shuffle_mask(bool swap_rb)
+{
+    return swap_rb ? _mm_set_epi8(15, 12, 13, 14, 11, 8, 9, 10, 7, 4, 5, 6, 3, 0, 1, 2)
+                   : _mm_set_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+}
+
+// NOTE: (x + 1 + (x >> 8)) >> 8 is x / 255 rounded down for every product of two bytes, so the vectorized
+// premultiply gives exactly the result of the scalar one.
+__m128i premultiply_epi16(__m128i pixels)
+{
+    auto alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, 0xFF), 0xFF);
+    alpha      = _mm_blend_epi16(alpha, _mm_set1_epi16(255), 0x88);
+    auto x     = _mm_mullo_epi16(pixels, alpha);
+    return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_srli_epi16(x, 8)), 8);
+}
+
+CASPAR_TARGET_AVX2 __m256i premultiply_epi16(__m256i pixels)
 {
-    std::vector<std::pair<int, int>> line_points;
-    line_points.reserve(num_pixels);
+    auto alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(pixels, 0xFF), 0xFF);
+    alpha      = _mm256_blend_epi16(alpha, _mm256_set1_epi16(255), 0x88);
+    auto x     = _mm256_mullo_epi16(pixels, alpha);
+    return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x, _mm256_set1_epi16(1)), _mm256_srli_epi16(x, 8)), 8);
+}
 
-    double delta_x       = std::cos(angle_radians);
-    double delta_y       = -std::sin(angle_radians); // In memory is revered
-    double max_delta     = std::max(std::abs(delta_x), std::abs(delta_y));
-    double amplification = 1.0 / max_delta;
-    delta_x *= amplification;
-    delta_y *= amplification;
+// Each function converts whole blocks of pixels and returns the number of pixels done.
+
+int shuffle_sse(std::uint8_t* dest, const std::uint8_t* source, int count, __m128i mask)
+{
+    int n = 0;
+    for (; n + 4 <= count; n += 4) {
+        auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n * 4), _mm_shuffle_epi8(pixels, mask));
+    }
+    return n;
+}
 
-    for (int i = 1; i <= num_pixels; ++i)
-        line_points.push_back(std::make_pair(static_cast<int>(std::floor(delta_x * static_cast<double>(i) + 0.5)),
-                                             static_cast<int>(std::floor(delta_y * static_cast<double>(i) + 0.5))));
+int premultiply_sse(std::uint8_t* dest, const std::uint8_t* source, int count, __m128i mask)
+{
+    const auto zero = _mm_setzero_si128();
+
+    int n = 0;
+    for (; n + 4 <= count; n += 4) {
+        auto pixels = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n * 4)), mask);
+        auto lo     = premultiply_epi16(_mm_unpacklo_epi8(pixels, zero));
+        auto hi     = premultiply_epi16(_mm_unpackhi_epi8(pixels, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n * 4), _mm_packus_epi16(lo, hi));
+    }
+    return n;
+}
+
+CASPAR_TARGET_AVX2 int premultiply_avx2(std::uint8_t* dest, const std::uint8_t* source, int count, __m128i mask)
+{
+    const auto zero    = _mm256_setzero_si256();
+    const auto mask256 = _mm256_broadcastsi128_si256(mask);
+
+    // NOTE: Unpacking and packing both work within 128 bit lanes, so the pixels keep their order.
+    int n = 0;
+    for (; n + 8 <= count; n += 8) {
+        auto pixels =
+            _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n * 4)), mask256);
+        auto lo = premultiply_epi16(_mm256_unpacklo_epi8(pixels, zero));
+        auto hi = premultiply_epi16(_mm256_unpackhi_epi8(pixels, zero));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + n * 4), _mm256_packus_epi16(lo, hi));
+    }
+    return n;
+}
+
+// NOTE: The quotients of c * 255 / a are at least 1 / 255 away from the next integer, more than the rounding error of
+// a float division, so truncating them gives exactly the result of the integer division.
+int unmultiply_sse(std::uint8_t* dest, const std::uint8_t* source, int count, __m128i mask)
+{
+    const auto scale = _mm_set1_ps(255.0f);
+    const auto bytes = _mm_set1_epi32(0xFF);
+
+    int n = 0;
+    for (; n + 4 <= count; n += 4) {
+        auto    pixels = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n * 4)), mask);
+        __m128i result[4];
+        for (int p = 0; p < 4; ++p) {
+            auto value = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(pixels));
+            auto alpha = _mm_shuffle_ps(value, value, 0xFF);
+            auto keep  = _mm_or_ps(_mm_cmpeq_ps(alpha, _mm_setzero_ps()), _mm_cmpeq_ps(alpha, scale));
+            auto div   = _mm_div_ps(_mm_mul_ps(value, scale), _mm_max_ps(alpha, _mm_set1_ps(1.0f)));
+
+            // NOTE: The alpha channel itself is also kept, the integer version wraps values above 255.
+            auto out  = _mm_blend_ps(_mm_blendv_ps(div, value, keep), value, 0x8);
+            result[p] = _mm_and_si128(_mm_cvttps_epi32(out), bytes);
+            pixels    = _mm_srli_si128(pixels, 4);
+        }
+        auto lo = _mm_packus_epi32(result[0], result[1]);
+        auto hi = _mm_packus_epi32(result[2], result[3]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n * 4), _mm_packus_epi16(lo, hi));
+    }
+    return n;
+}
+
+void convert_pixel(std::uint8_t* dest, const std::uint8_t* source, alpha_operation operation, bool swap_rb)
+{
+    int b = source[swap_rb ? 2 : 0];
+    int g = source[1];
+    int r = source[swap_rb ? 0 : 2];
+    int a = source[3];
+
+    if (operation == alpha_operation::premultiply) {
+        b = b * a / 255;
+        g = g * a / 255;
+        r = r * a / 255;
+    } else if (operation == alpha_operation::unmultiply && a != 0 && a != 255) {
+        b = b * 255 / a;
+        g = g * 255 / a;
+        r = r * 255 / a;
+    }
+
+    dest[0] = static_cast<std::uint8_t>(b);
+    dest[1] = static_cast<std::uint8_t>(g);
+    dest[2] = static_cast<std::uint8_t>(r);
+    dest[3] = static_cast<std::uint8_t>(a);
+}
+
+void convert_row(std::uint8_t*       dest,
+                 const std::uint8_t* source,
+                 int                 width,
+                 alpha_operation     operation,
+                 bool                swap_rb)
+{
+    static const bool avx2 = has_avx2();
+
+    const auto mask = shuffle_mask(swap_rb);
+
+    int done = 0;
+    switch (operation) {
+        case alpha_operation::none:
+            if (!swap_rb) {
+                std::memcpy(dest, source, width * 4);
+                done = width;
+            } else {
+                done = shuffle_sse(dest, source, width, mask);
+            }
+            break;
+        case alpha_operation::premultiply:
+            done = avx2 ? premultiply_avx2(dest, source, width, mask) : 0;
+            done += premultiply_sse(dest + done * 4, source + done * 4, width - done, mask);
+            break;
+        case alpha_operation::unmultiply:
+            done = unmultiply_sse(dest, source, width, mask);
+            break;
+    }
+
+    for (int n = done; n < width; ++n) {
+        convert_pixel(dest + n * 4, source + n * 4, operation, swap_rb);
+    }
+}
+
+} // namespace
+
+void convert_image(std::uint8_t*       dest,
+                   const std::uint8_t* source,
+                   int                 width,
+                   int                 height,
+                   alpha_operation     operation,
+                   bool                flip,
+                   bool                swap_rb)
+{
+    const auto linesize = static_cast<std::size_t>(width) * 4;
 
-    return std::move(line_points);
+    tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int>& rows) {
+        for (int y = rows.begin(); y != rows.end(); ++y) {
+            auto source_row = source + static_cast<std::size_t>(flip ? height - 1 - y : y) * linesize;
+            convert_row(dest + static_cast<std::size_t>(y) * linesize, source_row, width, operation, swap_rb);
+        }
+    });
 }
 
 }} // namespace caspar::image
\ No newline at end of file
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_cache.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#if defined(_MSC_VER)
+#include <windows.h>
+#endif
+#include <FreeImage.h>
+
+#include "image_algorithms.h"
+#include "image_compression.h"
+#include "image_loader.h"
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+
+#include <common/array.h>
+#include <common/env.h>
+#include <common/log.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace caspar { namespace image {
+
+namespace {
+
+core::draw_frame place(core::draw_frame frame, double x, double y, double width, double height)
+{
+    core::frame_transform transform;
+    transform.image_transform.fill_translation = {x, y};
+    transform.image_transform.fill_scale       = {width, height};
+    return core::draw_frame::push(std::move(frame), transform);
+}
+
+// NOTE: Images larger than image.max-tile-size in either direction do not fit in one texture. They are split into
+// tiles which are placed next to each other in one frame. The tiles are kept in host memory and are only uploaded
+// by the mixer once they are visible, so a panorama which is scrolled with MIXER FILL needs textures for the tiles on
+// screen only.
+core::draw_frame decode(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                        const std::wstring&                         filename,
+                        std::int64_t&                               size)
+{
+    static const int max_tile_size = std::max(256, env::properties().get(L"configuration.image.max-tile-size", 8192));
+
+    auto compressed = load_compressed(frame_factory, filename, size);
+    if (compressed) {
+        return compressed;
+    }
+
+    bool straight_alpha = false;
+    auto bitmap         = load_image(filename, straight_alpha);
+    auto width          = static_cast<int>(FreeImage_GetWidth(bitmap.get()));
+    auto height         = static_cast<int>(FreeImage_GetHeight(bitmap.get()));
+    auto operation      = straight_alpha ? alpha_operation::premultiply : alpha_operation::none;
+
+    size = static_cast<std::int64_t>(width) * height * 4;
+
+    if (width <= max_tile_size && height <= max_tile_size) {
+        core::pixel_format_desc desc;
+        desc.format = core::pixel_format::bgra;
+        desc.planes.push_back(core::pixel_format_desc::plane(width, height, 4));
+
+        // NOTE: Decoded frames are shared by all producers of the file, so they are not tagged with any of them.
+        auto frame = frame_factory->create_frame(nullptr, desc);
+
+        // NOTE: Premultiplying, flipping the bottom up rows and ordering the channels as bgra is one pass straight
+        // into the frame.
+        convert_image(frame.image_data(0).begin(),
+                      FreeImage_GetBits(bitmap.get()),
+                      width,
+                      height,
+                      operation,
+                      true,
+                      FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_RGB);
+
+        // NOTE: The image is shown uncompressed this time, and compressed in the background for later loads.
+        core::const_frame image(std::move(frame));
+        store_compressed(filename, image);
+
+        return core::draw_frame(std::move(image));
+    }
+
+    std::vector<std::uint8_t> image(static_cast<std::size_t>(size));
+    convert_image(image.data(),
+                  FreeImage_GetBits(bitmap.get()),
+                  width,
+                  height,
+                  operation,
+                  true,
+                  FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_RGB);
+    bitmap.reset();
+
+    std::vector<core::draw_frame> tiles;
+    for (int y = 0; y < height; y += max_tile_size) {
+        for (int x = 0; x < width; x += max_tile_size) {
+            auto tile_width  = std::min(max_tile_size, width - x);
+            auto tile_height = std::min(max_tile_size, height - y);
+
+            array<std::uint8_t> data(static_cast<std::size_t>(tile_width) * tile_height * 4);
+            tbb::parallel_for(0, tile_height, [&](int row) {
+                std::memcpy(data.begin() + static_cast<std::size_t>(row) * tile_width * 4,
+                            image.data() + (static_cast<std::size_t>(y + row) * width + x) * 4,
+                            static_cast<std::size_t>(tile_width) * 4);
+            });
+
+            core::pixel_format_desc desc;
+            desc.format = core::pixel_format::bgra;
+            desc.planes.push_back(core::pixel_format_desc::plane(tile_width, tile_height, 4));
+
+            std::vector<array<const std::uint8_t>> image_data;
+            image_data.emplace_back(std::move(data));
+
+            auto tile = core::const_frame(std::move(image_data), array<const std::int32_t>{}, desc);
+            tiles.push_back(place(core::draw_frame(std::move(tile)),
+                                  static_cast<double>(x) / width,
+                                  static_cast<double>(y) / height,
+                                  static_cast<double>(tile_width) / width,
+                                  static_cast<double>(tile_height) / height));
+        }
+    }
+
+    return core::draw_frame(std::move(tiles));
+}
+
+class image_cache
+{
+    struct entry
+    {
+        std::shared_future<core::draw_frame> frame;
+        std::int64_t                         size = 0;
+        std::list<std::wstring>::iterator    lru;
+    };
+
+    const std::int64_t budget_ = env::properties().get(L"configuration.image.cache-size", 256) * 1048576LL;
+
+    tbb::task_arena arena_;
+
+    std::mutex                              mutex_;
+    std::unordered_map<std::wstring, entry> entries_;
+    std::list<std::wstring>                 lru_; // Most recently used first.
+    std::int64_t                            size_ = 0;
+
+    void evict()
+    {
+        // NOTE: The most recently used entry is kept even if it alone exceeds the budget.
+        while (size_ > budget_ && lru_.size() > 1) {
+            auto it = entries_.find(lru_.back());
+            size_ -= it->second.size;
+            entries_.erase(it);
+            lru_.pop_back();
+        }
+    }
+
+  public:
+    tbb::task_arena& arena() { return arena_; }
+
+    std::shared_future<core::draw_frame> load(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                              const std::wstring&                         filename)
+    {
+        boost::system::error_code ec;
+        auto                      time = boost::filesystem::last_write_time(filename, ec);
+        auto                      key  = filename + L"|" + boost::lexical_cast<std::wstring>(ec ? 0 : time);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second.lru);
+            return it->second.frame;
+        }
+
+        auto promise = std::make_shared<std::promise<core::draw_frame>>();
+
+        lru_.push_front(key);
+        auto& e = entries_[key];
+        e.frame = promise->get_future().share();
+        e.lru   = lru_.begin();
+
+        arena_.enqueue([=] {
+            try {
+                std::int64_t size  = 0;
+                auto         frame = decode(frame_factory, filename, size);
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    auto                        it = entries_.find(key);
+                    if (it != entries_.end()) {
+                        it->second.size = size;
+                        size_ += size;
+                        evict();
+                    }
+                }
+
+                promise->set_value(std::move(frame));
+            } catch (...) {
+                {
+                    // NOTE: Failures are not cached, the file may be fixed and loaded again.
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    auto                        it = entries_.find(key);
+                    if (it != entries_.end()) {
+                        lru_.erase(it->second.lru);
+                        entries_.erase(it);
+                    }
+                }
+                promise->set_exception(std::current_exception());
+            }
+        });
+
+        return e.frame;
+    }
+};
+
+image_cache& cache()
+{
+    static image_cache instance;
+    return instance;
+}
+
+} // namespace
+
+std::shared_future<core::draw_frame> load_frame(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                                const std::wstring&                         filename)
+{
+    return cache().load(frame_factory, filename);
+}
+
+std::future<core::draw_frame> decode_frame(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                           const std::wstring&                         filename)
+{
+    auto promise = std::make_shared<std::promise<core::draw_frame>>();
+    auto future  = promise->get_future();
+
+    cache().arena().enqueue([=] {
+        try {
+            std::int64_t size = 0;
+            promise->set_value(decode(frame_factory, filename, size));
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+
+    return future;
+}
+
+}} // namespace caspar::image
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/fwd.h>
+
+#include <future>
+#include <string>
+
+namespace caspar { namespace image {
+
+// Decodes filename into a frame on a worker thread. Decoded frames of recently used files are kept, identified by
+// their path and modification time, so that repeated stills are only decoded once. The cache is limited to
+// image.cache-size megabytes. Images larger than image.max-tile-size pixels in either direction are split into tiles,
+// which are uploaded once they are visible.
+std::shared_future<core::draw_frame> load_frame(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                                const std::wstring&                         filename);
+
+// Decodes filename into a frame on the same worker threads as load_frame, but without caching it, for frames which
+// are only shown once such as those of image sequences.
+std::future<core::draw_frame> decode_frame(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                           const std::wstring&                         filename);
+
+}} // namespace caspar::image
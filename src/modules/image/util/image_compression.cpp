@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_compression.h"
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+
+#include <common/array.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+namespace caspar { namespace image {
+
+namespace {
+
+const char magic[8] = {'C', 'C', 'G', 'B', 'C', '3', 0, 1};
+
+std::uint16_t to_565(const std::array<float, 3>& bgr)
+{
+    auto quantize = [](float value, int max) {
+        return static_cast<int>(std::lround(std::max(0.0f, std::min(255.0f, value)) * max / 255.0f));
+    };
+    return static_cast<std::uint16_t>(quantize(bgr[2], 31) << 11 | quantize(bgr[1], 63) << 5 | quantize(bgr[0], 31));
+}
+
+std::array<int, 3> from_565(std::uint16_t color)
+{
+    const auto r = (color >> 11) & 0x1F;
+    const auto g = (color >> 5) & 0x3F;
+    const auto b = color & 0x1F;
+    return {(b << 3) | (b >> 2), (g << 2) | (g >> 4), (r << 3) | (r >> 2)};
+}
+
+// NOTE: The color endpoints are the extremes of the pixels along their principal axis, which follows gradients that
+// a bounding box of the channels would not.
+void compress_block(const std::array<std::array<std::uint8_t, 4>, 16>& pixels, std::uint8_t* block)
+{
+    auto alpha_min = 255;
+    auto alpha_max = 0;
+    for (auto& pixel : pixels) {
+        alpha_min = std::min<int>(alpha_min, pixel[3]);
+        alpha_max = std::max<int>(alpha_max, pixel[3]);
+    }
+
+    std::array<int, 8> alphas;
+    alphas.fill(alpha_max);
+    if (alpha_max > alpha_min) {
+        alphas[1] = alpha_min;
+        for (auto n = 1; n < 7; ++n) {
+            alphas[n + 1] = ((7 - n) * alpha_max + n * alpha_min) / 7;
+        }
+    }
+
+    std::uint64_t alpha_bits = 0;
+    for (auto n = 0; n < 16; ++n) {
+        auto best = 0;
+        for (auto i = 1; i < 8; ++i) {
+            if (std::abs(alphas[i] - pixels[n][3]) < std::abs(alphas[best] - pixels[n][3])) {
+                best = i;
+            }
+        }
+        alpha_bits |= static_cast<std::uint64_t>(best) << (3 * n);
+    }
+
+    block[0] = static_cast<std::uint8_t>(alpha_max);
+    block[1] = static_cast<std::uint8_t>(alpha_max > alpha_min ? alpha_min : alpha_max);
+    for (auto n = 0; n < 6; ++n) {
+        block[2 + n] = static_cast<std::uint8_t>(alpha_bits >> (8 * n));
+    }
+
+    std::array<float, 3> mean = {};
+    for (auto& pixel : pixels) {
+        for (auto c = 0; c < 3; ++c) {
+            mean[c] += pixel[c] / 16.0f;
+        }
+    }
+
+    std::array<float, 6> cov = {};
+    for (auto& pixel : pixels) {
+        const float d[3] = {pixel[0] - mean[0], pixel[1] - mean[1], pixel[2] - mean[2]};
+        cov[0] += d[0] * d[0];
+        cov[1] += d[0] * d[1];
+        cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1];
+        cov[4] += d[1] * d[2];
+        cov[5] += d[2] * d[2];
+    }
+
+    std::array<float, 3> axis = {1.0f, 1.0f, 1.0f};
+    for (auto n = 0; n < 8; ++n) {
+        std::array<float, 3> next = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                                     cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                                     cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+        const auto length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f) {
+            break;
+        }
+        axis = {next[0] / length, next[1] / length, next[2] / length};
+    }
+
+    auto t_min = 0.0f;
+    auto t_max = 0.0f;
+    for (auto& pixel : pixels) {
+        const auto t =
+            (pixel[0] - mean[0]) * axis[0] + (pixel[1] - mean[1]) * axis[1] + (pixel[2] - mean[2]) * axis[2];
+        t_min = std::min(t_min, t);
+        t_max = std::max(t_max, t);
+    }
+
+    std::array<std::uint16_t, 2> endpoints;
+    for (auto n = 0; n < 2; ++n) {
+        const auto t = n == 0 ? t_max : t_min;
+        endpoints[n] = to_565({mean[0] + t * axis[0], mean[1] + t * axis[1], mean[2] + t * axis[2]});
+    }
+
+    // NOTE: The colors of DXT5 blocks are always interpolated between the endpoints, whatever their order.
+    std::array<std::array<int, 3>, 4> colors = {from_565(endpoints[0]), from_565(endpoints[1])};
+    for (auto c = 0; c < 3; ++c) {
+        colors[2][c] = (2 * colors[0][c] + colors[1][c]) / 3;
+        colors[3][c] = (colors[0][c] + 2 * colors[1][c]) / 3;
+    }
+
+    std::uint32_t color_bits = 0;
+    for (auto n = 0; n < 16; ++n) {
+        auto best          = 0;
+        auto best_distance = std::numeric_limits<int>::max();
+        for (auto i = 0; i < 4; ++i) {
+            auto distance = 0;
+            for (auto c = 0; c < 3; ++c) {
+                const auto d = colors[i][c] - pixels[n][c];
+                distance += d * d;
+            }
+            if (distance < best_distance) {
+                best          = i;
+                best_distance = distance;
+            }
+        }
+        color_bits |= static_cast<std::uint32_t>(best) << (2 * n);
+    }
+
+    block[8]  = static_cast<std::uint8_t>(endpoints[0]);
+    block[9]  = static_cast<std::uint8_t>(endpoints[0] >> 8);
+    block[10] = static_cast<std::uint8_t>(endpoints[1]);
+    block[11] = static_cast<std::uint8_t>(endpoints[1] >> 8);
+    for (auto n = 0; n < 4; ++n) {
+        block[12 + n] = static_cast<std::uint8_t>(color_bits >> (8 * n));
+    }
+}
+
+// Compressed images are named after a hash of the path, modification time and size of the file, so that a changed
+// file is compressed again rather than loaded stale.
+boost::filesystem::path cache_path(const std::wstring& filename)
+{
+    const auto& folder = env::texture_cache_folder();
+    if (folder.empty()) {
+        return boost::filesystem::path();
+    }
+
+    boost::system::error_code ec;
+    auto                      time = boost::filesystem::last_write_time(filename, ec);
+    if (ec) {
+        return boost::filesystem::path();
+    }
+    auto size = boost::filesystem::file_size(filename, ec);
+    if (ec) {
+        return boost::filesystem::path();
+    }
+
+    std::uint64_t hash   = 14695981039346656037ULL;
+    auto          append = [&](const std::string& str) {
+        for (auto c : str)
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        hash = (hash ^ 0xFF) * 1099511628211ULL;
+    };
+
+    append(u8(filename));
+    append(std::to_string(time));
+    append(std::to_string(size));
+
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".bc3";
+
+    return boost::filesystem::path(folder) / name.str();
+}
+
+class compressor
+{
+    tbb::task_arena arena_{1};
+
+    std::mutex             mutex_;
+    std::set<std::wstring> pending_;
+
+  public:
+    void store(const std::wstring& filename, const core::const_frame& frame)
+    {
+        auto path = cache_path(filename);
+        if (path.empty()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!pending_.insert(path.wstring()).second) {
+                return;
+            }
+        }
+
+        arena_.enqueue([=] {
+            try {
+                const auto width  = static_cast<int>(frame.width());
+                const auto height = static_cast<int>(frame.height());
+                const auto plane  = core::bc3_plane(width, height);
+
+                std::vector<std::uint8_t> blocks(plane.size);
+                compress_bc3(frame.image_data(0).data(), width, height, blocks.data());
+
+                // NOTE: The image is written under a temporary name first, so that a load never reads it partly
+                // written.
+                auto tmp = path;
+                tmp += ".tmp";
+                {
+                    boost::filesystem::ofstream file(tmp, std::ios::binary);
+                    const std::int32_t          header[2] = {width, height};
+                    file.write(magic, sizeof(magic));
+                    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+                    file.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+                    if (!file) {
+                        CASPAR_THROW_EXCEPTION(io_error() << msg_info(L"Failed to write " + tmp.wstring()));
+                    }
+                }
+                boost::filesystem::rename(tmp, path);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.erase(path.wstring());
+        });
+    }
+};
+
+} // namespace
+
+void compress_bc3(const std::uint8_t* bgra, int width, int height, std::uint8_t* blocks)
+{
+    const auto columns = (width + 3) / 4;
+    const auto rows    = (height + 3) / 4;
+
+    tbb::parallel_for(0, rows, [&](int row) {
+        std::array<std::array<std::uint8_t, 4>, 16> pixels;
+        for (auto column = 0; column < columns; ++column) {
+            // NOTE: Pixels beyond the edges of the image repeat the last row and column, so that they do not skew
+            // the endpoints of partly used blocks.
+            for (auto n = 0; n < 16; ++n) {
+                const auto x = std::min(column * 4 + n % 4, width - 1);
+                const auto y = std::min(row * 4 + n / 4, height - 1);
+                std::memcpy(pixels[n].data(), bgra + (static_cast<std::size_t>(y) * width + x) * 4, 4);
+            }
+            compress_block(pixels, blocks + (static_cast<std::size_t>(row) * columns + column) * 16);
+        }
+    });
+}
+
+core::draw_frame load_compressed(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                 const std::wstring&                         filename,
+                                 std::int64_t&                               size)
+{
+    auto path = cache_path(filename);
+    if (path.empty() || !boost::filesystem::exists(path)) {
+        return core::draw_frame{};
+    }
+
+    boost::filesystem::ifstream file(path, std::ios::binary);
+
+    char         header_magic[sizeof(magic)];
+    std::int32_t header[2] = {0, 0};
+    file.read(header_magic, sizeof(header_magic));
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!file || std::memcmp(header_magic, magic, sizeof(magic)) != 0 || header[0] <= 0 || header[1] <= 0) {
+        CASPAR_LOG(warning) << L"Ignoring invalid compressed image " << path.wstring();
+        return core::draw_frame{};
+    }
+
+    core::pixel_format_desc desc(core::pixel_format::bc3);
+    desc.planes.push_back(core::bc3_plane(header[0], header[1]));
+
+    auto frame = frame_factory->create_frame(nullptr, desc);
+    file.read(reinterpret_cast<char*>(frame.image_data(0).data()), desc.planes[0].size);
+    if (!file) {
+        CASPAR_LOG(warning) << L"Ignoring truncated compressed image " << path.wstring();
+        return core::draw_frame{};
+    }
+
+    size = desc.planes[0].size;
+    return core::draw_frame(std::move(frame));
+}
+
+void store_compressed(const std::wstring& filename, const core::const_frame& frame)
+{
+    static compressor instance;
+    instance.store(filename, frame);
+}
+
+}} // namespace caspar::image
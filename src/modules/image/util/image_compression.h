@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/fwd.h>
+
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace image {
+
+// Compresses a premultiplied bgra image into the DXT5 blocks of a bc3 plane of the same size, see core::bc3_plane.
+void compress_bc3(const std::uint8_t* bgra, int width, int height, std::uint8_t* blocks);
+
+// The DXT5 compressed frame of filename from the texture cache, or an empty frame if the file has not been compressed
+// since it was last modified or the texture cache is disabled. size is set to the bytes of the compressed image.
+core::draw_frame load_compressed(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                 const std::wstring&                         filename,
+                                 std::int64_t&                               size);
+
+// Compresses the decoded bgra frame of filename on a background thread and stores it in the texture cache, so that
+// later loads of the file read it compressed. Does nothing if the texture cache is disabled.
+void store_compressed(const std::wstring& filename, const core::const_frame& frame);
+
+}} // namespace caspar::image
@@ -44,6 +44,22 @@
 namespace caspar { namespace image {
 
 std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename)
+{
+    bool straight_alpha = false;
+    auto bitmap         = load_image(filename, straight_alpha);
+
+    if (straight_alpha) {
+        image_view<bgra_pixel> original_view(
+            FreeImage_GetBits(bitmap.get()), FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()));
+        premultiply(original_view);
+    }
+
+    return bitmap;
+}
+
+namespace {
+
+FREE_IMAGE_FORMAT get_format(const std::wstring& filename)
 {
     if (!boost::filesystem::exists(filename))
         CASPAR_THROW_EXCEPTION(file_not_found() << boost::errinfo_file_name(u8(filename)));
@@ -64,6 +80,15 @@ std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename)
     if (fif == FIF_UNKNOWN || !FreeImage_FIFSupportsReading(fif))
         CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
 
+    return fif;
+}
+
+} // namespace
+
+std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename, bool& straight_alpha)
+{
+    auto fif = get_format(filename);
+
 #ifdef WIN32
     auto bitmap = std::shared_ptr<FIBITMAP>(FreeImage_LoadU(fif, filename.c_str(), 0), FreeImage_Unload);
 #else
@@ -77,15 +102,30 @@ std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename)
     }
 
     // PNG-images need to be premultiplied with their alpha
-    if (fif == FIF_PNG) {
-        image_view<bgra_pixel> original_view(
-            FreeImage_GetBits(bitmap.get()), FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()));
-        premultiply(original_view);
-    }
+    straight_alpha = fif == FIF_PNG;
 
     return bitmap;
 }
 
+std::pair<int, int> get_image_size(const std::wstring& filename)
+{
+    auto fif = get_format(filename);
+
+#ifdef WIN32
+    auto bitmap =
+        std::shared_ptr<FIBITMAP>(FreeImage_LoadU(fif, filename.c_str(), FIF_LOAD_NOPIXELS), FreeImage_Unload);
+#else
+    auto bitmap =
+        std::shared_ptr<FIBITMAP>(FreeImage_Load(fif, u8(filename).c_str(), FIF_LOAD_NOPIXELS), FreeImage_Unload);
+#endif
+
+    if (!bitmap)
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
+
+    return std::make_pair(static_cast<int>(FreeImage_GetWidth(bitmap.get())),
+                          static_cast<int>(FreeImage_GetHeight(bitmap.get())));
+}
+
 std::shared_ptr<FIBITMAP> load_png_from_memory(const void* memory_location, size_t size)
 {
     FREE_IMAGE_FORMAT fif = FIF_PNG;
@@ -24,13 +24,18 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <utility>
 
 struct FIBITMAP;
 
 namespace caspar { namespace image {
 
 std::shared_ptr<FIBITMAP>     load_image(const std::wstring& filename);
+// As load_image, but images with straight alpha are not premultiplied, straight_alpha tells the caller to do so.
+std::shared_ptr<FIBITMAP>     load_image(const std::wstring& filename, bool& straight_alpha);
 std::shared_ptr<FIBITMAP>     load_png_from_memory(const void* memory_location, size_t size);
+// The width and height of the image in filename, read without decoding its pixels.
+std::pair<int, int>           get_image_size(const std::wstring& filename);
 const std::set<std::wstring>& supported_extensions();
 
 }} // namespace caspar::image
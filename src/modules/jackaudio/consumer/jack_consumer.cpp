@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jack_consumer.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/frame/frame.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+extern "C" {
+#define __STDC_CONSTANT_MACROS
+#define __STDC_LIMIT_MACROS
+#include <libavutil/error.h>
+#include <libavutil/opt.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+}
+
+#include <jack/jack.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace jackaudio {
+
+void check(int ret, const char* call)
+{
+    if (ret < 0) {
+        char error[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(ret, error, sizeof(error));
+        CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info(std::string(call) + " failed: " + error));
+    }
+}
+
+// Outputs every audio channel of the channel to a port of its own JACK client, e.g. for the returns of an audio desk.
+// Audio is resampled to the rate of the JACK server when frames are sent and handed to the process callback, which
+// runs on the real-time thread of JACK, through a lock-free ring of interleaved samples. The channel and the server run
+// on different clocks, so like the oal consumer the resampler stretches or squeezes the audio slightly to keep the
+// ring at its target fill.
+struct jack_consumer : public core::frame_consumer
+{
+    spl::shared_ptr<diagnostics::graph> graph_;
+    caspar::timer                       perf_timer_;
+    int                                 channel_index_ = -1;
+    const std::wstring                  client_name_;
+    const int                           port_count_;
+    const std::wstring                  connect_;
+    const int                           latency_;
+
+    core::video_format_desc format_desc_;
+
+    std::shared_ptr<jack_client_t> client_;
+    std::vector<jack_port_t*>      ports_;
+    int                            channels_    = 0; // Interleaved in the ring, those of the channel.
+    int                            sample_rate_ = 0;
+
+    std::shared_ptr<SwrContext>                          swr_;
+    std::vector<float>                                   samples_;
+    std::unique_ptr<boost::lockfree::spsc_queue<float>> ring_;
+    std::size_t                                          capacity_     = 0;
+    std::size_t                                          target_       = 0; // Samples per channel in the ring.
+    std::size_t                                          duration_     = 0; // Samples per channel in a frame.
+    double                                               average_fill_ = -1.0;
+
+    // Only used by the process callback.
+    std::vector<float> block_;
+    bool               buffering_ = true;
+
+    std::atomic<bool> underrun_{false};
+    std::atomic<bool> shutdown_{false};
+
+  public:
+    jack_consumer(std::wstring client_name, int port_count, std::wstring connect, int latency)
+        : client_name_(std::move(client_name))
+        , port_count_(port_count)
+        , connect_(std::move(connect))
+        , latency_(std::max(0, latency))
+    {
+        graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("buffer", diagnostics::color(0.7f, 0.4f, 0.4f));
+        diagnostics::register_graph(graph_);
+    }
+
+    ~jack_consumer() { close(); }
+
+    // frame consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        close();
+
+        format_desc_   = format_desc;
+        channel_index_ = channel_index;
+        channels_      = format_desc_.audio_channels;
+
+        jack_status_t status = static_cast<jack_status_t>(0);
+        auto          client = jack_client_open(u8(client_name_).c_str(), JackNoStartServer, &status);
+        if (!client) {
+            CASPAR_THROW_EXCEPTION(invalid_operation()
+                                   << msg_info("Failed to connect to the JACK server (status " +
+                                               boost::lexical_cast<std::string>(static_cast<int>(status)) + ")."));
+        }
+        client_.reset(client, [](jack_client_t* ptr) {
+            jack_deactivate(ptr);
+            jack_client_close(ptr);
+        });
+        sample_rate_ = static_cast<int>(jack_get_sample_rate(client));
+
+        auto ports = port_count_ > 0 ? std::min(port_count_, channels_) : channels_;
+        for (auto n = 0; n < ports; ++n) {
+            auto name = "out_" + boost::lexical_cast<std::string>(n + 1);
+            auto port = jack_port_register(client, name.c_str(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+            if (!port) {
+                CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info("Failed to register JACK port " + name + "."));
+            }
+            ports_.push_back(port);
+        }
+
+        swr_.reset(swr_alloc(), [](SwrContext* ptr) { swr_free(&ptr); });
+        if (!swr_) {
+            CASPAR_THROW_EXCEPTION(bad_alloc());
+        }
+        // NOTE: Channels are passed through as they are, so no layout is set, which would limit them to known ones.
+        check(av_opt_set_int(swr_.get(), "in_channel_count", channels_, 0), "av_opt_set_int");
+        check(av_opt_set_int(swr_.get(), "out_channel_count", channels_, 0), "av_opt_set_int");
+        check(av_opt_set_int(swr_.get(), "in_sample_rate", format_desc_.audio_sample_rate, 0), "av_opt_set_int");
+        check(av_opt_set_int(swr_.get(), "out_sample_rate", sample_rate_, 0), "av_opt_set_int");
+        check(av_opt_set_sample_fmt(swr_.get(), "in_sample_fmt", AV_SAMPLE_FMT_S32, 0), "av_opt_set_sample_fmt");
+        check(av_opt_set_sample_fmt(swr_.get(), "out_sample_fmt", AV_SAMPLE_FMT_FLT, 0), "av_opt_set_sample_fmt");
+        // Resampling is what allows compensating for drift, even when the sample rates are the same.
+        check(av_opt_set_int(swr_.get(), "flags", SWR_FLAG_RESAMPLE, 0), "av_opt_set_int");
+        check(swr_init(swr_.get()), "swr_init");
+
+        // NOTE: Frames arrive a whole frame of audio at a time, so the ring is kept half a frame and a period above
+        // the latency on average, which leaves the latency as the margin against underruns just before a frame.
+        auto period = static_cast<std::size_t>(jack_get_buffer_size(client));
+        duration_   = static_cast<std::size_t>(format_desc_.audio_cadence[0]) * sample_rate_ /
+                    format_desc_.audio_sample_rate;
+        target_       = static_cast<std::size_t>(sample_rate_) * latency_ / 1000 + period + duration_ / 2;
+        average_fill_ = -1.0;
+        capacity_     = (target_ * 4 + duration_) * channels_;
+        ring_.reset(new boost::lockfree::spsc_queue<float>(capacity_));
+
+        block_.assign(period * channels_, 0.0f);
+        buffering_ = true;
+        underrun_  = false;
+        shutdown_  = false;
+
+        jack_set_process_callback(
+            client, [](jack_nframes_t frames, void* arg) { return static_cast<jack_consumer*>(arg)->process(frames); },
+            this);
+        jack_set_buffer_size_callback(client,
+                                      [](jack_nframes_t frames, void* arg) {
+                                          auto self = static_cast<jack_consumer*>(arg);
+                                          self->block_.assign(static_cast<std::size_t>(frames) * self->channels_,
+                                                              0.0f);
+                                          return 0;
+                                      },
+                                      this);
+        jack_on_shutdown(client, [](void* arg) { static_cast<jack_consumer*>(arg)->shutdown_ = true; }, this);
+
+        if (jack_activate(client) != 0) {
+            CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info("Failed to activate JACK client."));
+        }
+
+        connect();
+
+        graph_->set_text(print());
+        CASPAR_LOG(info) << print() << L" Connected to JACK at " << sample_rate_ << L" Hz with " << ports_.size()
+                         << L" ports.";
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        if (shutdown_) {
+            CASPAR_LOG(error) << print() << L" The JACK server has shut down.";
+            return make_ready_future(false);
+        }
+
+        if (underrun_.exchange(false)) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+        }
+
+        const auto& audio = frame.audio_data();
+        if (audio.size() == 0) {
+            return make_ready_future(true);
+        }
+
+        compensate();
+
+        auto in_samples  = static_cast<int>(audio.size() / channels_);
+        auto out_samples = swr_get_out_samples(swr_.get(), in_samples);
+        check(out_samples, "swr_get_out_samples");
+
+        samples_.resize(static_cast<std::size_t>(out_samples) * channels_);
+
+        auto in  = reinterpret_cast<const std::uint8_t*>(audio.data());
+        auto out = reinterpret_cast<std::uint8_t*>(samples_.data());
+
+        out_samples = swr_convert(swr_.get(), &out, out_samples, &in, in_samples);
+        check(out_samples, "swr_convert");
+
+        // NOTE: Frames are pushed whole or not at all, so that the ring always holds whole samples of every channel.
+        auto size = static_cast<std::size_t>(out_samples) * channels_;
+        if (ring_->write_available() < size) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        } else {
+            ring_->push(samples_.data(), size);
+        }
+
+        graph_->set_value("tick-time", perf_timer_.elapsed() * format_desc_.fps * 0.5);
+        perf_timer_.restart();
+
+        return make_ready_future(true);
+    }
+
+    std::wstring print() const override
+    {
+        return L"jack[" + boost::lexical_cast<std::wstring>(channel_index_) + L"|" + client_name_ + L"]";
+    }
+
+    std::wstring name() const override { return L"jack"; }
+
+    bool has_synchronization_clock() const override { return false; }
+
+    bool host_image() const override { return false; }
+
+    int index() const override { return 510; }
+
+  private:
+    // Nudges the resampler so that the ring drifts towards its target fill, by at most 0.5% of the samples.
+    void compensate()
+    {
+        auto fill     = static_cast<double>((capacity_ - ring_->write_available()) / channels_);
+        average_fill_ = average_fill_ < 0.0 ? fill : average_fill_ * 0.95 + fill * 0.05;
+
+        graph_->set_value("buffer", std::min(1.0, average_fill_ / static_cast<double>(target_ * 2)));
+
+        auto duration = static_cast<int>(duration_);
+        auto limit    = std::max(1, duration / 200);
+        auto delta    = static_cast<int>((static_cast<double>(target_) - average_fill_) * 0.1);
+        check(swr_set_compensation(swr_.get(), std::max(-limit, std::min(limit, delta)), duration),
+              "swr_set_compensation");
+    }
+
+    // Runs on the real-time thread of JACK, so it neither locks nor allocates. Silence is output until the ring has
+    // filled up to its target, initially and after every underrun.
+    int process(jack_nframes_t frames)
+    {
+        const auto size = static_cast<std::size_t>(frames) * channels_;
+        if (size > block_.size()) {
+            return 0;
+        }
+
+        buffering_ = buffering_ && ring_->read_available() < target_ * channels_;
+
+        auto read = buffering_ ? 0 : ring_->pop(block_.data(), size);
+        if (read < size) {
+            std::fill(block_.begin() + read, block_.begin() + size, 0.0f);
+            if (!buffering_) {
+                underrun_  = true;
+                buffering_ = true;
+            }
+        }
+
+        for (std::size_t n = 0; n < ports_.size(); ++n) {
+            auto dst = static_cast<jack_default_audio_sample_t*>(jack_port_get_buffer(ports_[n], frames));
+            auto src = block_.data() + n;
+            for (jack_nframes_t i = 0; i < frames; ++i, src += channels_) {
+                dst[i] = *src;
+            }
+        }
+
+        return 0;
+    }
+
+    // Connects the ports in order to the input ports which match the connect pattern, e.g. system:playback_.
+    void connect()
+    {
+        if (connect_.empty()) {
+            return;
+        }
+
+        auto targets = jack_get_ports(client_.get(), u8(connect_).c_str(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput);
+        if (!targets) {
+            CASPAR_LOG(warning) << print() << L" No JACK ports match " << connect_ << L".";
+            return;
+        }
+
+        for (std::size_t n = 0; n < ports_.size() && targets[n]; ++n) {
+            if (jack_connect(client_.get(), jack_port_name(ports_[n]), targets[n]) != 0) {
+                CASPAR_LOG(warning) << print() << L" Failed to connect to " << u16(targets[n]) << L".";
+            }
+        }
+        jack_free(targets);
+    }
+
+    void close()
+    {
+        client_.reset();
+        ports_.clear();
+    }
+};
+
+spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                  params,
+                                                      std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    if (params.size() < 1 || !boost::iequals(params.at(0), L"JACK"))
+        return core::frame_consumer::empty();
+
+    return spl::make_shared<jack_consumer>(get_param(L"NAME", params, L"casparcg"),
+                                           get_param(L"PORTS", params, 0),
+                                           get_param(L"CONNECT", params, L""),
+                                           get_param(L"LATENCY", params, 5));
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&               ptree,
+                              std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    return spl::make_shared<jack_consumer>(ptree.get(L"client-name", L"casparcg"),
+                                           ptree.get(L"ports", 0),
+                                           ptree.get(L"connect", L""),
+                                           ptree.get(L"latency", 5));
+}
+
+}} // namespace caspar::jackaudio
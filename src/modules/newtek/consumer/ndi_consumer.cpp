@@ -0,0 +1,224 @@
+/*
+ * Copyright 2013 Sveriges Television AB http://casparcg.com/
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "ndi_consumer.h"
+
+#include <core/consumer/frame_consumer.h>
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <common/assert.h>
+#include <common/diagnostics/graph.h>
+#include <common/executor.h>
+#include <common/future.h>
+#include <common/param.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "../util/ndi.h"
+
+namespace caspar { namespace newtek {
+
+struct ndi_consumer : public core::frame_consumer
+{
+    const std::wstring                  name_;
+    const core::output_format           pixel_format_;
+    core::video_format_desc             format_desc_;
+    int                                 channel_index_ = -1;
+    spl::shared_ptr<diagnostics::graph> graph_;
+    timer                               tick_timer_;
+
+    // NOTE: Frames are sent asynchronously, the sdk reads the image of a frame until the next frame is sent. The
+    // frame is declared before the sender, which flushes the last frame when it is destroyed.
+    core::const_frame     sending_frame_;
+    std::vector<float>    audio_buffer_;
+    std::shared_ptr<void> sender_;
+
+    // NOTE: Sending runs on its own thread, the channel drops frames instead of waiting for it.
+    executor executor_{L"ndi_consumer"};
+
+  public:
+    ndi_consumer(std::wstring name, core::output_format pixel_format)
+        : name_(std::move(name))
+        , pixel_format_(pixel_format)
+    {
+        if (!ndi::is_available()) {
+            CASPAR_THROW_EXCEPTION(not_supported() << msg_info(ndi::dll_name() + L" not available"));
+        }
+
+        executor_.set_capacity(2);
+
+        graph_->set_text(print());
+        graph_->set_color("frame-time", diagnostics::color(0.5f, 1.0f, 0.2f));
+        graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        diagnostics::register_graph(graph_);
+    }
+
+    ~ndi_consumer()
+    {
+        executor_.invoke([=] {
+            sender_.reset();
+            sending_frame_ = core::const_frame{};
+        });
+    }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        executor_.invoke([=] {
+            format_desc_   = format_desc;
+            channel_index_ = channel_index;
+
+            auto name = u8(name_.empty() ? L"CasparCG Channel " + boost::lexical_cast<std::wstring>(channel_index)
+                                         : name_);
+
+            ndi::send_create_t settings = {};
+            settings.p_ndi_name         = name.c_str();
+            settings.clock_video        = false;
+            settings.clock_audio        = false;
+
+            sender_.reset();
+            sending_frame_ = core::const_frame{};
+            sender_        = std::shared_ptr<void>(ndi::send_create(&settings), ndi::send_destroy);
+
+            if (!sender_) {
+                CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Failed to create sender."));
+            }
+        });
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
+        tick_timer_.restart();
+
+        if (executor_.size() >= executor_.capacity()) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        } else {
+            executor_.begin_invoke([=] { send_frame(frame); });
+        }
+
+        return make_ready_future(true);
+    }
+
+    void send_frame(const core::const_frame& frame)
+    {
+        caspar::timer frame_timer;
+
+        ndi::video_frame_v2_t video = {};
+        video.xres                  = format_desc_.width;
+        video.yres                  = format_desc_.height;
+        video.frame_rate_N          = format_desc_.time_scale;
+        video.frame_rate_D          = format_desc_.duration;
+        video.picture_aspect_ratio =
+            static_cast<float>(format_desc_.square_width) / static_cast<float>(format_desc_.square_height);
+        video.frame_format_type = ndi::frame_format_progressive;
+        video.timecode          = ndi::timecode_synthesize;
+
+        // NOTE: Frames which were mixed before the consumer was added are not converted, they are sent as bgra.
+        const auto& image = frame.image_data(pixel_format_);
+        if (pixel_format_ == core::output_format::uyvy &&
+            static_cast<int>(image.size()) >= format_desc_.width * format_desc_.height * 2) {
+            video.FourCC               = ndi::fourcc_uyvy;
+            video.p_data               = const_cast<uint8_t*>(image.data());
+            video.line_stride_in_bytes = format_desc_.width * 2;
+        } else {
+            video.FourCC               = ndi::fourcc_bgra;
+            video.p_data               = const_cast<uint8_t*>(frame.image_data(0).data());
+            video.line_stride_in_bytes = format_desc_.width * 4;
+        }
+
+        if (video.p_data) {
+            ndi::send_send_video_async_v2(sender_.get(), &video);
+            sending_frame_ = frame;
+        }
+
+        const auto channels = format_desc_.audio_channels;
+        const auto samples  = channels > 0 ? static_cast<int>(frame.audio_data().size()) / channels : 0;
+        if (samples > 0) {
+            // NOTE: The sdk takes planar floats.
+            audio_buffer_.resize(samples * channels);
+            for (int s = 0; s < samples; ++s) {
+                for (int c = 0; c < channels; ++c) {
+                    audio_buffer_[c * samples + s] = frame.audio_data().data()[s * channels + c] / 2147483648.0f;
+                }
+            }
+
+            ndi::audio_frame_v2_t audio   = {};
+            audio.sample_rate             = format_desc_.audio_sample_rate;
+            audio.no_channels             = channels;
+            audio.no_samples              = samples;
+            audio.timecode                = ndi::timecode_synthesize;
+            audio.p_data                  = audio_buffer_.data();
+            audio.channel_stride_in_bytes = samples * static_cast<int>(sizeof(float));
+            ndi::send_send_audio_v2(sender_.get(), &audio);
+        }
+
+        graph_->set_text(print() + L" connections: " +
+                         boost::lexical_cast<std::wstring>(ndi::send_get_no_connections(sender_.get(), 0)));
+        graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
+    }
+
+    std::wstring print() const override
+    {
+        return L"ndi[" + (name_.empty() ? boost::lexical_cast<std::wstring>(channel_index_) : name_) + L"]";
+    }
+
+    std::wstring name() const override { return L"ndi"; }
+
+    int index() const override { return 900; }
+
+    bool has_synchronization_clock() const override { return false; }
+
+    core::output_format output_format() const override { return pixel_format_; }
+};
+
+spl::shared_ptr<core::frame_consumer> create_ndi_consumer(const std::vector<std::wstring>&                  params,
+                                                          std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    if (params.size() < 1 || !boost::iequals(params.at(0), L"NDI"))
+        return core::frame_consumer::empty();
+
+    auto name         = get_param(L"NAME", params);
+    auto pixel_format = contains_param(L"BGRA", params) ? core::output_format::bgra : core::output_format::uyvy;
+
+    return spl::make_shared<ndi_consumer>(name, pixel_format);
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_ndi_consumer(const boost::property_tree::wptree&               ptree,
+                                  std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    auto name         = ptree.get(L"name", L"");
+    auto pixel_format = ptree.get(L"pixel-format", L"uyvy") == L"bgra" ? core::output_format::bgra
+                                                                      : core::output_format::uyvy;
+
+    return spl::make_shared<ndi_consumer>(name, pixel_format);
+}
+
+}} // namespace caspar::newtek
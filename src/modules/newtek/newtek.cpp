@@ -21,10 +21,13 @@
 
 #include "newtek.h"
 
+#include "consumer/ndi_consumer.h"
 #include "consumer/newtek_ivga_consumer.h"
+#include "producer/ndi_producer.h"
 #include "util/air_send.h"
 
 #include <core/consumer/frame_consumer.h>
+#include <core/producer/frame_producer.h>
 
 namespace caspar { namespace newtek {
 
@@ -34,6 +37,10 @@ void init(core::module_dependencies dependencies)
         dependencies.consumer_registry->register_consumer_factory(L"iVGA Consumer", create_ivga_consumer);
         dependencies.consumer_registry->register_preconfigured_consumer_factory(L"newtek-ivga",
                                                                                 create_preconfigured_ivga_consumer);
+        dependencies.consumer_registry->register_consumer_factory(L"NDI Consumer", create_ndi_consumer);
+        dependencies.consumer_registry->register_preconfigured_consumer_factory(L"ndi",
+                                                                                create_preconfigured_ndi_consumer);
+        dependencies.producer_registry->register_producer_factory(L"NDI Producer", create_ndi_producer);
     } catch (...) {
     }
 }
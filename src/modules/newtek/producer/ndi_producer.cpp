@@ -0,0 +1,275 @@
+/*
+ * Copyright 2013 Sveriges Television AB http://casparcg.com/
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "ndi_producer.h"
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <common/diagnostics/graph.h>
+#include <common/memcpy.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <tbb/concurrent_queue.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "../util/ndi.h"
+
+namespace caspar { namespace newtek {
+
+class ndi_producer : public core::frame_producer
+{
+    spl::shared_ptr<diagnostics::graph> graph_;
+    core::monitor::state                state_;
+    mutable std::mutex                  state_mutex_;
+    caspar::timer                       tick_timer_;
+
+    const std::wstring                   source_name_;
+    const bool                           low_bandwidth_;
+    spl::shared_ptr<core::frame_factory> frame_factory_;
+    core::video_format_desc              format_desc_;
+
+    std::shared_ptr<void> receiver_;
+
+    // NOTE: Frames are received on their own thread, the channel picks up the latest one without waiting.
+    tbb::concurrent_bounded_queue<core::draw_frame> frame_buffer_;
+    core::draw_frame                                last_frame_;
+
+    std::vector<std::int32_t> audio_; // Received since the last video frame, only used by the receive thread.
+
+    std::atomic<bool> abort_request_{false};
+    std::thread       thread_;
+
+  public:
+    ndi_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                 const core::video_format_desc&              format_desc,
+                 std::wstring                                source_name,
+                 bool                                        low_bandwidth)
+        : source_name_(std::move(source_name))
+        , low_bandwidth_(low_bandwidth)
+        , frame_factory_(frame_factory)
+        , format_desc_(format_desc)
+    {
+        if (!ndi::is_available()) {
+            CASPAR_THROW_EXCEPTION(not_supported() << msg_info(ndi::dll_name() + L" not available"));
+        }
+
+        frame_buffer_.set_capacity(2);
+
+        graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+        graph_->set_color("frame-time", diagnostics::color(1.0f, 0.0f, 0.0f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("output-buffer", diagnostics::color(0.0f, 1.0f, 0.0f));
+        graph_->set_text(print());
+        diagnostics::register_graph(graph_);
+
+        auto name = u8(source_name_);
+
+        ndi::recv_create_v3_t settings             = {};
+        settings.source_to_connect_to.p_ndi_name   = name.c_str();
+        settings.color_format                      = ndi::recv_color_format_uyvy_bgra;
+        settings.bandwidth          = low_bandwidth_ ? ndi::recv_bandwidth_lowest : ndi::recv_bandwidth_highest;
+        settings.allow_video_fields = false;
+
+        receiver_ = std::shared_ptr<void>(ndi::recv_create_v3(&settings), ndi::recv_destroy);
+        if (!receiver_) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Failed to create receiver."));
+        }
+
+        thread_ = std::thread([this] {
+            set_thread_name(L"[ndi_producer]");
+            run();
+        });
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    ~ndi_producer()
+    {
+        abort_request_ = true;
+        thread_.join();
+    }
+
+    void run()
+    {
+        while (!abort_request_) {
+            ndi::video_frame_v2_t video = {};
+            ndi::audio_frame_v2_t audio = {};
+
+            try {
+                switch (ndi::recv_capture_v2(receiver_.get(), &video, &audio, nullptr, 100)) {
+                    case ndi::frame_type_video:
+                        push_video(video);
+                        ndi::recv_free_video_v2(receiver_.get(), &video);
+                        break;
+                    case ndi::frame_type_audio:
+                        push_audio(audio);
+                        ndi::recv_free_audio_v2(receiver_.get(), &audio);
+                        break;
+                    default:
+                        break;
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    void push_video(const ndi::video_frame_v2_t& video)
+    {
+        caspar::timer frame_timer;
+
+        // NOTE: Sources without alpha are received as uyvy, which is unpacked by the mixer.
+        auto desc = core::pixel_format_desc(video.FourCC == ndi::fourcc_uyvy ? core::pixel_format::uyvy
+                                                                             : core::pixel_format::bgra);
+        if (video.FourCC == ndi::fourcc_uyvy) {
+            desc.planes.push_back(core::pixel_format_desc::plane(video.xres / 2, video.yres, 4));
+        } else if (video.FourCC == ndi::fourcc_bgra || video.FourCC == ndi::fourcc_bgrx) {
+            desc.planes.push_back(core::pixel_format_desc::plane(video.xres, video.yres, 4));
+        } else {
+            return;
+        }
+
+        auto        frame    = frame_factory_->create_frame(this, desc);
+        const auto& plane    = desc.planes[0];
+        auto        dest     = frame.image_data(0).begin();
+        const auto  linesize = video.line_stride_in_bytes;
+        if (linesize == plane.linesize) {
+            parallel_memcpy(dest, video.p_data, plane.size);
+        } else {
+            for (int y = 0; y < plane.height; ++y) {
+                std::memcpy(dest + y * plane.linesize, video.p_data + y * linesize, plane.linesize);
+            }
+        }
+
+        // NOTE: The samples are copied into a pooled buffer, so that audio_ keeps its capacity between frames.
+        frame.audio_data() = array<std::int32_t>(audio_.size());
+        std::copy(audio_.begin(), audio_.end(), frame.audio_data().begin());
+        audio_.clear();
+
+        // NOTE: Sources of other sizes are stretched to fill the channel by the mixer.
+        auto draw_frame = core::draw_frame(std::move(frame));
+
+        if (!frame_buffer_.try_push(draw_frame)) {
+            core::draw_frame dummy;
+            frame_buffer_.try_pop(dummy);
+            frame_buffer_.try_push(draw_frame);
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+
+        graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
+
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["file/name"]         = source_name_;
+        state_["file/video/width"]  = video.xres;
+        state_["file/video/height"] = video.yres;
+        state_["file/fps"] =
+            video.frame_rate_D > 0 ? static_cast<double>(video.frame_rate_N) / video.frame_rate_D : 0.0;
+        state_["buffer"]            = {frame_buffer_.size(), frame_buffer_.capacity()};
+    }
+
+    void push_audio(const ndi::audio_frame_v2_t& audio)
+    {
+        const auto channels = format_desc_.audio_channels;
+
+        // NOTE: The sdk delivers planar floats, extra channels are dropped and missing ones are silent.
+        const auto offset = audio_.size();
+        audio_.resize(offset + audio.no_samples * channels);
+        for (int c = 0; c < std::min(channels, audio.no_channels); ++c) {
+            auto src = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(audio.p_data) +
+                                                      c * audio.channel_stride_in_bytes);
+            for (int s = 0; s < audio.no_samples; ++s) {
+                const auto sample = std::max(-1.0f, std::min(1.0f, src[s]));
+                audio_[offset + s * channels + c] = static_cast<std::int32_t>(sample * 2147483647.0f);
+            }
+        }
+
+        // NOTE: Audio is attached to the next video frame, it is dropped if video stops arriving.
+        const auto max_samples = static_cast<std::size_t>(format_desc_.audio_sample_rate * channels);
+        if (audio_.size() > max_samples) {
+            audio_.erase(audio_.begin(), audio_.end() - max_samples);
+        }
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
+        tick_timer_.restart();
+
+        core::draw_frame frame;
+        if (frame_buffer_.try_pop(frame)) {
+            last_frame_ = frame;
+        } else {
+            // NOTE: Sources at lower frame rates repeat their last frame, without its audio.
+            frame = core::draw_frame::still(last_frame_);
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+        }
+
+        graph_->set_value("output-buffer",
+                          static_cast<float>(frame_buffer_.size()) / static_cast<float>(frame_buffer_.capacity()));
+
+        return frame;
+    }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+
+    std::wstring print() const override { return L"ndi[" + source_name_ + L"]"; }
+
+    std::wstring name() const override { return L"ndi"; }
+};
+
+spl::shared_ptr<core::frame_producer> create_ndi_producer(const core::frame_producer_dependencies& dependencies,
+                                                          const std::vector<std::wstring>&         params)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"NDI"))
+        return core::frame_producer::empty();
+
+    auto low_bandwidth = boost::iequals(get_param(L"BANDWIDTH", params, L"FULL"), L"LOW");
+
+    auto producer = spl::make_shared<ndi_producer>(
+        dependencies.frame_factory, dependencies.format_desc, params.at(1), low_bandwidth);
+
+    return core::create_destroy_proxy(producer);
+}
+
+}} // namespace caspar::newtek
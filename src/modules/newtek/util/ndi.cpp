@@ -0,0 +1,113 @@
+/*
+ * Copyright 2013 Sveriges Television AB http://casparcg.com/
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "ndi.h"
+
+#include <memory>
+
+#include <Windows.h>
+
+#include <common/except.h>
+
+namespace caspar { namespace newtek { namespace ndi {
+
+bool (*initialize)() = nullptr;
+
+send_instance_t (*send_create)(const send_create_t* p_create_settings)                                = nullptr;
+void (*send_destroy)(send_instance_t p_instance)                                                      = nullptr;
+void (*send_send_video_async_v2)(send_instance_t p_instance, const video_frame_v2_t* p_video_data)    = nullptr;
+void (*send_send_audio_v2)(send_instance_t p_instance, const audio_frame_v2_t* p_audio_data)          = nullptr;
+int (*send_get_no_connections)(send_instance_t p_instance, uint32_t timeout_in_ms)                    = nullptr;
+recv_instance_t (*recv_create_v3)(const recv_create_v3_t* p_create_settings)                          = nullptr;
+void (*recv_destroy)(recv_instance_t p_instance)                                                      = nullptr;
+frame_type_t (*recv_capture_v2)(recv_instance_t   p_instance,
+                                video_frame_v2_t* p_video_data,
+                                audio_frame_v2_t* p_audio_data,
+                                metadata_frame_t* p_metadata,
+                                uint32_t          timeout_in_ms)                                      = nullptr;
+void (*recv_free_video_v2)(recv_instance_t p_instance, const video_frame_v2_t* p_video_data)          = nullptr;
+void (*recv_free_audio_v2)(recv_instance_t p_instance, const audio_frame_v2_t* p_audio_data)          = nullptr;
+void (*recv_free_metadata)(recv_instance_t p_instance, const metadata_frame_t* p_metadata)            = nullptr;
+
+const std::wstring& dll_name()
+{
+    static std::wstring name = L"Processing.NDI.Lib.x64.dll";
+
+    return name;
+}
+
+template <typename T>
+bool load(HMODULE module, T*& func, const char* name)
+{
+    func = reinterpret_cast<T*>(GetProcAddress(module, name));
+    return func != nullptr;
+}
+
+std::shared_ptr<void> load_library()
+{
+    // NOTE: The NDI runtime installer puts the library in a directory which is not on the search path.
+    auto module = LoadLibrary(dll_name().c_str());
+    for (auto var : {L"NDI_RUNTIME_DIR_V4", L"NDI_RUNTIME_DIR_V3"}) {
+        wchar_t dir[MAX_PATH];
+        if (!module && GetEnvironmentVariableW(var, dir, MAX_PATH) > 0) {
+            module = LoadLibrary((std::wstring(dir) + L"\\" + dll_name()).c_str());
+        }
+    }
+
+    if (!module)
+        return nullptr;
+
+    std::shared_ptr<void> lib(module, FreeLibrary);
+
+    wchar_t actualFilename[256];
+
+    GetModuleFileNameW(module, actualFilename, sizeof(actualFilename));
+
+    auto loaded = load(module, initialize, "NDIlib_initialize") && load(module, send_create, "NDIlib_send_create") &&
+                  load(module, send_destroy, "NDIlib_send_destroy") &&
+                  load(module, send_send_video_async_v2, "NDIlib_send_send_video_async_v2") &&
+                  load(module, send_send_audio_v2, "NDIlib_send_send_audio_v2") &&
+                  load(module, send_get_no_connections, "NDIlib_send_get_no_connections") &&
+                  load(module, recv_create_v3, "NDIlib_recv_create_v3") &&
+                  load(module, recv_destroy, "NDIlib_recv_destroy") &&
+                  load(module, recv_capture_v2, "NDIlib_recv_capture_v2") &&
+                  load(module, recv_free_video_v2, "NDIlib_recv_free_video_v2") &&
+                  load(module, recv_free_audio_v2, "NDIlib_recv_free_audio_v2") &&
+                  load(module, recv_free_metadata, "NDIlib_recv_free_metadata");
+
+    if (!loaded || !initialize()) {
+        CASPAR_LOG(warning) << L"Could not initialize " << actualFilename;
+        return nullptr;
+    }
+
+    CASPAR_LOG(info) << L"Loaded " << actualFilename;
+
+    return lib;
+}
+
+bool is_available()
+{
+    static std::shared_ptr<void> lib = load_library();
+
+    return static_cast<bool>(lib);
+}
+
+}}} // namespace caspar::newtek::ndi
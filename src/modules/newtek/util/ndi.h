@@ -0,0 +1,154 @@
+/*
+ * Copyright 2013 Sveriges Television AB http://casparcg.com/
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// The subset of the NDI SDK (Processing.NDI.Lib.h) which is used by the NDI producer and consumer. The library is
+// loaded at runtime, so that the module works without the NDI runtime installed.
+namespace caspar { namespace newtek { namespace ndi {
+
+typedef void* send_instance_t;
+typedef void* recv_instance_t;
+
+constexpr int fourcc(char a, char b, char c, char d)
+{
+    return static_cast<int>(a) | (static_cast<int>(b) << 8) | (static_cast<int>(c) << 16) | (static_cast<int>(d) << 24);
+}
+
+enum fourcc_t
+{
+    fourcc_uyvy = fourcc('U', 'Y', 'V', 'Y'),
+    fourcc_bgra = fourcc('B', 'G', 'R', 'A'),
+    fourcc_bgrx = fourcc('B', 'G', 'R', 'X'),
+};
+
+enum frame_format_t
+{
+    frame_format_interleaved = 0,
+    frame_format_progressive = 1,
+    frame_format_field_0     = 2,
+    frame_format_field_1     = 3,
+};
+
+enum frame_type_t
+{
+    frame_type_none          = 0,
+    frame_type_video         = 1,
+    frame_type_audio         = 2,
+    frame_type_metadata      = 3,
+    frame_type_error         = 4,
+    frame_type_status_change = 100,
+};
+
+enum recv_bandwidth_t
+{
+    recv_bandwidth_lowest  = 0,
+    recv_bandwidth_highest = 100,
+};
+
+enum recv_color_format_t
+{
+    recv_color_format_uyvy_bgra = 1,
+};
+
+static const int64_t timecode_synthesize = INT64_MAX;
+
+struct source_t
+{
+    const char* p_ndi_name;
+    const char* p_url_address;
+};
+
+struct send_create_t
+{
+    const char* p_ndi_name;
+    const char* p_groups;
+    bool        clock_video;
+    bool        clock_audio;
+};
+
+struct recv_create_v3_t
+{
+    source_t            source_to_connect_to;
+    recv_color_format_t color_format;
+    recv_bandwidth_t    bandwidth;
+    bool                allow_video_fields;
+    const char*         p_ndi_recv_name;
+};
+
+struct video_frame_v2_t
+{
+    int            xres;
+    int            yres;
+    fourcc_t       FourCC;
+    int            frame_rate_N;
+    int            frame_rate_D;
+    float          picture_aspect_ratio;
+    frame_format_t frame_format_type;
+    int64_t        timecode;
+    uint8_t*       p_data;
+    int            line_stride_in_bytes;
+    const char*    p_metadata;
+    int64_t        timestamp;
+};
+
+struct audio_frame_v2_t
+{
+    int         sample_rate;
+    int         no_channels;
+    int         no_samples;
+    int64_t     timecode;
+    float*      p_data;
+    int         channel_stride_in_bytes;
+    const char* p_metadata;
+    int64_t     timestamp;
+};
+
+struct metadata_frame_t
+{
+    int     length;
+    int64_t timecode;
+    char*   p_data;
+};
+
+const std::wstring& dll_name();
+bool                is_available();
+
+extern bool (*initialize)();
+
+extern send_instance_t (*send_create)(const send_create_t* p_create_settings);
+extern void (*send_destroy)(send_instance_t p_instance);
+extern void (*send_send_video_async_v2)(send_instance_t p_instance, const video_frame_v2_t* p_video_data);
+extern void (*send_send_audio_v2)(send_instance_t p_instance, const audio_frame_v2_t* p_audio_data);
+extern int (*send_get_no_connections)(send_instance_t p_instance, uint32_t timeout_in_ms);
+
+extern recv_instance_t (*recv_create_v3)(const recv_create_v3_t* p_create_settings);
+extern void (*recv_destroy)(recv_instance_t p_instance);
+extern frame_type_t (*recv_capture_v2)(recv_instance_t   p_instance,
+                                        video_frame_v2_t* p_video_data,
+                                        audio_frame_v2_t* p_audio_data,
+                                        metadata_frame_t* p_metadata,
+                                        uint32_t          timeout_in_ms);
+extern void (*recv_free_video_v2)(recv_instance_t p_instance, const video_frame_v2_t* p_video_data);
+extern void (*recv_free_audio_v2)(recv_instance_t p_instance, const audio_frame_v2_t* p_audio_data);
+extern void (*recv_free_metadata)(recv_instance_t p_instance, const metadata_frame_t* p_metadata);
+
+}}} // namespace caspar::newtek::ndi
@@ -24,9 +24,9 @@
 #include <common/diagnostics/graph.h>
 #include <common/env.h>
 #include <common/except.h>
-#include <common/executor.h>
 #include <common/future.h>
 #include <common/log.h>
+#include <common/os/thread.h>
 #include <common/param.h>
 #include <common/timer.h>
 #include <common/utf.h>
@@ -40,10 +40,9 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/circular_buffer.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
 #include <boost/property_tree/ptree.hpp>
 
-#include <tbb/concurrent_queue.h>
-
 #if defined(_MSC_VER)
 #pragma warning(push)
 #pragma warning(disable : 4244)
@@ -52,6 +51,7 @@ extern "C" {
 #define __STDC_CONSTANT_MACROS
 #define __STDC_LIMIT_MACROS
 #include <libavutil/channel_layout.h>
+#include <libavutil/error.h>
 #include <libavutil/opt.h>
 #include <libavutil/samplefmt.h>
 #include <libswresample/swresample.h>
@@ -60,6 +60,10 @@ extern "C" {
 #pragma warning(pop)
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <vector>
 
 #include <AL/al.h>
@@ -111,208 +115,222 @@ void init_device()
     std::call_once(f, [] { instance.reset(new device()); });
 }
 
+void check(int ret, const char* call)
+{
+    if (ret < 0) {
+        char error[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(ret, error, sizeof(error));
+        CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info(std::string(call) + " failed: " + error));
+    }
+}
+
+// Audio is resampled to stereo when frames are sent and handed to the playback thread through a lock-free ring. The
+// playback thread keeps a few short OpenAL buffers queued, so the device is fed continuously rather than in bursts of
+// one frame. The channel and the sound device run on different clocks, so the resampler stretches or squeezes the
+// audio slightly to keep the ring at the configured latency.
 struct oal_consumer : public core::frame_consumer
 {
+    static const int buffer_count    = 4;
+    static const int buffer_duration = 10; // Milliseconds.
+
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       perf_timer_;
     int                                 channel_index_ = -1;
+    const int                           latency_;
 
     core::video_format_desc format_desc_;
 
-    ALuint              source_ = 0;
-    std::vector<ALuint> buffers_;
-    bool                started_  = false;
-    int                 duration_ = 1920;
-
-    std::shared_ptr<SwrContext> swr_;
+    std::shared_ptr<SwrContext>                                 swr_;
+    std::vector<std::int16_t>                                   samples_;
+    std::unique_ptr<boost::lockfree::spsc_queue<std::int16_t>> ring_;
+    std::size_t                                                 capacity_     = 0;
+    std::size_t                                                 target_       = 0; // Stereo samples in the ring.
+    double                                                      average_fill_ = -1.0;
 
-    executor executor_{L"oal_consumer"};
+    std::atomic<bool> abort_request_{false};
+    std::thread       thread_;
 
   public:
-    oal_consumer()
+    explicit oal_consumer(int latency)
+        : latency_(std::max(10, latency))
     {
         init_device();
 
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("buffer", diagnostics::color(0.7f, 0.4f, 0.4f));
         diagnostics::register_graph(graph_);
     }
 
-    ~oal_consumer()
-    {
-        executor_.invoke([=] {
-            if (source_) {
-                alSourceStop(source_);
-                alDeleteSources(1, &source_);
-            }
-
-            for (auto& buffer : buffers_) {
-                if (buffer)
-                    alDeleteBuffers(1, &buffer);
-            };
-        });
-    }
+    ~oal_consumer() { stop(); }
 
     // frame consumer
 
     void initialize(const core::video_format_desc& format_desc, int channel_index) override
     {
+        stop();
+
         format_desc_   = format_desc;
         channel_index_ = channel_index;
         graph_->set_text(print());
 
-        executor_.begin_invoke([=] {
-            duration_ = format_desc_.audio_cadence[0];
-            buffers_.resize(8);
-            alGenBuffers(static_cast<ALsizei>(buffers_.size()), buffers_.data());
-            alGenSources(1, &source_);
-
-            alSourcei(source_, AL_LOOPING, AL_FALSE);
-        });
+        swr_.reset(swr_alloc_set_opts(nullptr,
+                                      AV_CH_LAYOUT_STEREO,
+                                      AV_SAMPLE_FMT_S16,
+                                      format_desc_.audio_sample_rate,
+                                      av_get_default_channel_layout(format_desc_.audio_channels),
+                                      AV_SAMPLE_FMT_S32,
+                                      format_desc_.audio_sample_rate,
+                                      0,
+                                      nullptr),
+                   [](SwrContext* ptr) { swr_free(&ptr); });
+        if (!swr_) {
+            CASPAR_THROW_EXCEPTION(bad_alloc());
+        }
+        // Resampling is what allows compensating for drift, even though the sample rates are the same.
+        check(av_opt_set_int(swr_.get(), "flags", SWR_FLAG_RESAMPLE, 0), "av_opt_set_int");
+        check(swr_init(swr_.get()), "swr_init");
+
+        target_       = static_cast<std::size_t>(format_desc_.audio_sample_rate) * latency_ / 1000;
+        average_fill_ = -1.0;
+        capacity_     = (target_ * 4 + static_cast<std::size_t>(format_desc_.audio_cadence[0])) * 2;
+        ring_.reset(new boost::lockfree::spsc_queue<std::int16_t>(capacity_));
+
+        abort_request_ = false;
+        thread_        = std::thread([this] { run(); });
     }
 
     std::future<bool> send(core::const_frame frame) override
     {
-        executor_.begin_invoke([=] {
-            auto dst            = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
-            dst->format         = AV_SAMPLE_FMT_S16;
-            dst->sample_rate    = format_desc_.audio_sample_rate;
-            dst->channels       = 2;
-            dst->channel_layout = av_get_default_channel_layout(dst->channels);
-            dst->nb_samples     = duration_;
-            if (av_frame_get_buffer(dst.get(), 32) < 0) {
-                // TODO FF error
-                CASPAR_THROW_EXCEPTION(invalid_argument());
-            }
-            std::memset(dst->extended_data[0], 0, dst->linesize[0]);
-
-            if (!started_) {
-                for (auto n = 0; n < static_cast<int64_t>(buffers_.size()); ++n) {
-                    alBufferData(buffers_[n],
-                                 AL_FORMAT_STEREO16,
-                                 dst->extended_data[0],
-                                 static_cast<ALsizei>(dst->linesize[0]),
-                                 dst->sample_rate);
-                    alSourceQueueBuffers(source_, 1, &buffers_[n]);
-                }
+        const auto& audio = frame.audio_data();
+        if (audio.size() == 0) {
+            return make_ready_future(true);
+        }
 
-                alSourcePlay(source_);
-                started_ = true;
+        compensate();
 
-                return;
-            }
+        auto in_samples  = static_cast<int>(audio.size() / format_desc_.audio_channels);
+        auto out_samples = swr_get_out_samples(swr_.get(), in_samples);
+        check(out_samples, "swr_get_out_samples");
 
-            auto src            = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
-            src->format         = AV_SAMPLE_FMT_S32;
-            src->sample_rate    = format_desc_.audio_sample_rate;
-            src->channels       = format_desc_.audio_channels;
-            src->channel_layout = av_get_default_channel_layout(src->channels);
-            src->nb_samples     = static_cast<int>(frame.audio_data().size() / src->channels);
-            src->extended_data[0] = const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(frame.audio_data().data()));
-            src->linesize[0]      = static_cast<int>(frame.audio_data().size() * sizeof(int32_t));
-
-            if (av_frame_get_buffer(dst.get(), 0) < 0) {
-                // TODO FF error
-                CASPAR_THROW_EXCEPTION(invalid_argument());
-            }
+        samples_.resize(out_samples * 2);
 
-            if (!swr_) {
-                swr_.reset(swr_alloc(), [](SwrContext* ptr) { swr_free(&ptr); });
-                if (!swr_) {
-                    CASPAR_THROW_EXCEPTION(bad_alloc());
-                }
-                if (swr_config_frame(swr_.get(), dst.get(), src.get()) < 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
-                }
-                if (swr_init(swr_.get()) < 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
-                }
-            }
+        auto in  = reinterpret_cast<const std::uint8_t*>(audio.data());
+        auto out = reinterpret_cast<std::uint8_t*>(samples_.data());
 
-            if (swr_convert_frame(swr_.get(), nullptr, src.get()) < 0) {
-                // TODO FF error
-                CASPAR_THROW_EXCEPTION(invalid_argument());
-            }
+        out_samples = swr_convert(swr_.get(), &out, out_samples, &in, in_samples);
+        check(out_samples, "swr_convert");
 
-            ALint processed = 0;
-            alGetSourceiv(source_, AL_BUFFERS_PROCESSED, &processed);
+        auto size = static_cast<std::size_t>(out_samples) * 2;
+        if (ring_->push(samples_.data(), size) < size) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
 
-            auto in_duration  = swr_get_delay(swr_.get(), 48000);
-            auto out_duration = static_cast<int64_t>(processed * duration_);
-            auto delta        = static_cast<int>(out_duration - in_duration);
+        graph_->set_value("tick-time", perf_timer_.elapsed() * format_desc_.fps * 0.5);
+        perf_timer_.restart();
 
-            ALenum state;
-            alGetSourcei(source_, AL_SOURCE_STATE, &state);
-            if (state != AL_PLAYING) {
-                while (delta > duration_) {
-                    ALuint buffer = 0;
-                    alSourceUnqueueBuffers(source_, 1, &buffer);
-                    if (!buffer) {
-                        break;
-                    }
-                    alBufferData(buffer,
-                                 AL_FORMAT_STEREO16,
-                                 dst->extended_data[0],
-                                 static_cast<ALsizei>(dst->linesize[0]),
-                                 dst->sample_rate);
-                    alSourceQueueBuffers(source_, 1, &buffer);
-                    delta -= duration_;
-                }
+        return make_ready_future(true);
+    }
 
-                alSourcePlay(source_);
-            }
+    std::wstring print() const override
+    {
+        return L"oal[" + boost::lexical_cast<std::wstring>(channel_index_) + L"|" + format_desc_.name + L"]";
+    }
 
-            // TODO (fix)
-            // if (std::abs(delta) > duration_ && swr_set_compensation(swr_.get(), delta, 2000) < 0) {
-            //    // TODO FF error
-            //    CASPAR_THROW_EXCEPTION(invalid_argument());
-            //}
+    std::wstring name() const override { return L"system-audio"; }
 
-            for (auto n = 0; n < processed; ++n) {
-                if (swr_get_delay(swr_.get(), 48000) < dst->nb_samples) {
-                    break;
-                }
+    bool has_synchronization_clock() const override { return false; }
+
+    int index() const override { return 500; }
+
+  private:
+    // Nudges the resampler so that the ring drifts towards its target fill, by at most 0.5% of the samples.
+    void compensate()
+    {
+        auto fill     = static_cast<double>((capacity_ - ring_->write_available()) / 2);
+        average_fill_ = average_fill_ < 0.0 ? fill : average_fill_ * 0.95 + fill * 0.05;
+
+        graph_->set_value("buffer", std::min(1.0, average_fill_ / static_cast<double>(target_ * 2)));
+
+        auto duration = format_desc_.audio_cadence[0];
+        auto limit    = std::max(1, duration / 200);
+        auto delta    = static_cast<int>((static_cast<double>(target_) - average_fill_) * 0.1);
+        check(swr_set_compensation(swr_.get(), std::max(-limit, std::min(limit, delta)), duration),
+              "swr_set_compensation");
+    }
+
+    void stop()
+    {
+        abort_request_ = true;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    void run()
+    {
+        set_thread_name(L"oal_consumer");
+
+        const auto sample_rate = format_desc_.audio_sample_rate;
+        const auto size        = static_cast<std::size_t>(sample_rate * buffer_duration / 1000) * 2;
+
+        std::vector<std::int16_t> block(size, 0);
+
+        ALuint              source = 0;
+        std::vector<ALuint> buffers(buffer_count, 0);
+        alGenSources(1, &source);
+        alGenBuffers(buffer_count, buffers.data());
+        alSourcei(source, AL_LOOPING, AL_FALSE);
+
+        for (auto buffer : buffers) {
+            alBufferData(buffer, AL_FORMAT_STEREO16, block.data(), static_cast<ALsizei>(size * 2), sample_rate);
+            alSourceQueueBuffers(source, 1, &buffer);
+        }
+        alSourcePlay(source);
+
+        // Silence is played until the ring has filled up to its latency, initially and after every underrun.
+        auto buffering = true;
 
+        while (!abort_request_) {
+            ALint processed = 0;
+            alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+
+            for (; processed > 0; --processed) {
                 ALuint buffer = 0;
-                alSourceUnqueueBuffers(source_, 1, &buffer);
+                alSourceUnqueueBuffers(source, 1, &buffer);
                 if (!buffer) {
-                    // TODO error
                     break;
                 }
 
-                if (swr_convert_frame(swr_.get(), dst.get(), nullptr)) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
+                buffering = buffering && ring_->read_available() < target_ * 2;
+
+                auto read = buffering ? 0 : ring_->pop(block.data(), size);
+                if (read < size) {
+                    std::fill(block.begin() + read, block.end(), 0);
+                    if (!buffering) {
+                        graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+                        buffering = true;
+                    }
                 }
 
-                alBufferData(buffer,
-                             AL_FORMAT_STEREO16,
-                             dst->extended_data[0],
-                             static_cast<ALsizei>(dst->linesize[0]),
-                             dst->sample_rate);
-                alSourceQueueBuffers(source_, 1, &buffer);
+                alBufferData(buffer, AL_FORMAT_STEREO16, block.data(), static_cast<ALsizei>(size * 2), sample_rate);
+                alSourceQueueBuffers(source, 1, &buffer);
             }
 
-            graph_->set_value("tick-time", perf_timer_.elapsed() * format_desc_.fps * 0.5);
-            perf_timer_.restart();
-        });
+            ALint state = 0;
+            alGetSourcei(source, AL_SOURCE_STATE, &state);
+            if (state != AL_PLAYING) {
+                alSourcePlay(source);
+            }
 
-        return make_ready_future(true);
-    }
+            std::this_thread::sleep_for(std::chrono::milliseconds(buffer_duration / 2));
+        }
 
-    std::wstring print() const override
-    {
-        return L"oal[" + boost::lexical_cast<std::wstring>(channel_index_) + L"|" + format_desc_.name + L"]";
+        alSourceStop(source);
+        alDeleteSources(1, &source);
+        alDeleteBuffers(buffer_count, buffers.data());
     }
-
-    std::wstring name() const override { return L"system-audio"; }
-
-    bool has_synchronization_clock() const override { return false; }
-
-    int index() const override { return 500; }
 };
 
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                  params,
@@ -321,14 +339,14 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     if (params.size() < 1 || !boost::iequals(params.at(0), L"AUDIO"))
         return core::frame_consumer::empty();
 
-    return spl::make_shared<oal_consumer>();
+    return spl::make_shared<oal_consumer>(get_param(L"LATENCY", params, 60));
 }
 
 spl::shared_ptr<core::frame_consumer>
 create_preconfigured_consumer(const boost::property_tree::wptree&               ptree,
                               std::vector<spl::shared_ptr<core::video_channel>> channels)
 {
-    return spl::make_shared<oal_consumer>();
+    return spl::make_shared<oal_consumer>(ptree.get(L"latency", 60));
 }
 
 }} // namespace caspar::oal
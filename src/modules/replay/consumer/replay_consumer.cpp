@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_consumer.h"
+
+#include "../util/replay_buffer.h"
+
+#include <core/consumer/frame_consumer.h>
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <memory>
+#include <mutex>
+
+namespace caspar { namespace replay {
+
+struct replay_consumer : public core::frame_consumer
+{
+    const std::wstring                  name_;
+    const double                        length_;
+    const core::output_format           pixel_format_;
+    core::video_format_desc             format_desc_;
+    int                                 channel_index_ = -1;
+    spl::shared_ptr<diagnostics::graph> graph_;
+
+    mutable std::mutex             buffer_mutex_;
+    std::shared_ptr<replay_buffer> buffer_;
+
+    // NOTE: Frames are copied into the ring on their own thread, the channel drops frames instead of waiting for it.
+    executor executor_{L"replay_consumer"};
+
+  public:
+    replay_consumer(std::wstring name, double length, core::output_format pixel_format)
+        : name_(std::move(name))
+        , length_(length)
+        , pixel_format_(pixel_format)
+    {
+        if (length_ <= 0.0) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"The length of a replay buffer must be positive."));
+        }
+
+        executor_.set_capacity(4);
+
+        graph_->set_text(print());
+        graph_->set_color("frame-time", diagnostics::color(0.5f, 1.0f, 0.2f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        diagnostics::register_graph(graph_);
+    }
+
+    ~replay_consumer() { executor_.invoke([] {}); }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        executor_.invoke([=] {
+            format_desc_   = format_desc;
+            channel_index_ = channel_index;
+
+            const auto capacity = static_cast<std::size_t>(length_ * format_desc.fps + 0.5);
+            auto       buffer   = create_buffer(buffer_name(), format_desc, pixel_format_, capacity);
+
+            {
+                std::lock_guard<std::mutex> lock(buffer_mutex_);
+                buffer_ = std::move(buffer);
+            }
+
+            graph_->set_text(print());
+
+            CASPAR_LOG(info) << print() << L" Keeping the last " << capacity << L" frames.";
+        });
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        if (executor_.size() >= executor_.capacity()) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        } else {
+            executor_.begin_invoke([=] { write_frame(frame); });
+        }
+
+        return make_ready_future(true);
+    }
+
+    void write_frame(const core::const_frame& frame)
+    {
+        caspar::timer frame_timer;
+
+        if (!buffer_) {
+            return;
+        }
+
+        // NOTE: Frames which were mixed before the consumer was added are not converted, they are skipped.
+        const auto& image      = frame.image_data(pixel_format_);
+        const auto  pixel_size = pixel_format_ == core::output_format::uyvy ? 2 : 4;
+        const auto  image_size = static_cast<std::size_t>(format_desc_.width) * format_desc_.height * pixel_size;
+        if (image.size() < image_size) {
+            return;
+        }
+
+        const auto& audio = frame.audio_data();
+        buffer_->write(image.data(), image_size, audio.data(), audio.size());
+
+        graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
+    }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex_);
+
+        core::monitor::state state;
+        state["replay/name"] = u8(buffer_name());
+        if (buffer_) {
+            const auto range      = buffer_->range();
+            state["replay/first"] = range.first;
+            state["replay/last"]  = range.second;
+        }
+        return state;
+    }
+
+    std::wstring print() const override { return L"replay[" + buffer_name() + L"]"; }
+
+    std::wstring name() const override { return L"replay"; }
+
+    int index() const override { return 1100; }
+
+    bool has_synchronization_clock() const override { return false; }
+
+    core::output_format output_format() const override { return pixel_format_; }
+
+  private:
+    std::wstring buffer_name() const
+    {
+        return name_.empty() ? boost::lexical_cast<std::wstring>(channel_index_) : name_;
+    }
+};
+
+spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                  params,
+                                                      std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    if (params.size() < 1 || !boost::iequals(params.at(0), L"REPLAY"))
+        return core::frame_consumer::empty();
+
+    auto name         = get_param(L"NAME", params);
+    auto length       = get_param(L"LENGTH", params, 60.0);
+    auto pixel_format = contains_param(L"BGRA", params) ? core::output_format::bgra : core::output_format::uyvy;
+
+    return spl::make_shared<replay_consumer>(name, length, pixel_format);
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&               ptree,
+                              std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    auto name         = ptree.get(L"name", L"");
+    auto length       = ptree.get(L"length", 60.0);
+    auto pixel_format = ptree.get(L"pixel-format", L"uyvy") == L"bgra" ? core::output_format::bgra
+                                                                      : core::output_format::uyvy;
+
+    return spl::make_shared<replay_consumer>(name, length, pixel_format);
+}
+
+}} // namespace caspar::replay
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_producer.h"
+
+#include "../util/replay_buffer.h"
+
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+namespace caspar { namespace replay {
+
+struct replay_producer : public core::frame_producer
+{
+    static constexpr std::int64_t live = std::numeric_limits<std::int64_t>::max();
+
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const std::shared_ptr<replay_buffer>       buffer_;
+
+    mutable std::mutex   mutex_;
+    core::monitor::state state_;
+    std::int64_t         in_       = 0;
+    std::int64_t         out_      = live;
+    double               position_ = 0.0;
+    double               speed_    = 1.0;
+    bool                 loop_     = false;
+
+    std::int64_t     last_number_ = -1;
+    core::draw_frame last_frame_;
+
+  public:
+    replay_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                    std::shared_ptr<replay_buffer>              buffer,
+                    std::int64_t                                in,
+                    std::int64_t                                out,
+                    std::int64_t                                seek,
+                    double                                      speed,
+                    bool                                        loop)
+        : frame_factory_(frame_factory)
+        , buffer_(std::move(buffer))
+        , in_(resolve(in))
+        , out_(resolve(out))
+        , position_(static_cast<double>(seek < 0 ? resolve(seek) : std::max(seek, in_)))
+        , speed_(speed)
+        , loop_(loop)
+    {
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto range = buffer_->range();
+        const auto first = std::max(range.first, in_);
+        const auto last  = std::min(range.second, out_);
+
+        if (first <= last) {
+            // NOTE: Frames which the ring has overwritten, or which it does not have yet, are skipped.
+            position_ = std::max(static_cast<double>(first), std::min(position_, static_cast<double>(last)));
+
+            // NOTE: Frames which are shown more than once, when playing slowly or holding, are muted after the first
+            // time.
+            const auto number = static_cast<std::int64_t>(std::floor(position_));
+            auto       frame  = number != last_number_ ? read_frame(number, speed_ == 1.0) : core::draw_frame{};
+            if (frame) {
+                last_frame_  = std::move(frame);
+                last_number_ = number;
+            } else {
+                last_frame_ = core::draw_frame::still(last_frame_);
+            }
+
+            position_ += speed_;
+            if (loop_ && (position_ > static_cast<double>(last) + 1.0 || position_ < static_cast<double>(first))) {
+                position_ = speed_ < 0.0 ? static_cast<double>(last) : static_cast<double>(first);
+            }
+        }
+
+        state_["replay/name"]     = u8(buffer_->name());
+        state_["replay/position"] = last_number_;
+        state_["replay/range"]    = {first, last};
+        state_["replay/speed"]    = speed_;
+        state_["loop"]            = loop_;
+
+        return last_frame_;
+    }
+
+    core::draw_frame last_frame() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return core::draw_frame::still(last_frame_);
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto& cmd   = params.at(0);
+        const auto  value = params.size() > 1 ? params.at(1) : L"";
+
+        std::wstring result;
+        if (boost::iequals(cmd, L"in")) {
+            if (!value.empty()) {
+                in_ = resolve(boost::lexical_cast<std::int64_t>(value));
+            }
+            result = boost::lexical_cast<std::wstring>(in_);
+        } else if (boost::iequals(cmd, L"out")) {
+            if (boost::iequals(value, L"live")) {
+                out_ = live;
+            } else if (!value.empty()) {
+                out_ = resolve(boost::lexical_cast<std::int64_t>(value));
+            }
+            result = out_ != live ? boost::lexical_cast<std::wstring>(out_) : L"live";
+        } else if (boost::iequals(cmd, L"seek") && !value.empty()) {
+            position_ = static_cast<double>(resolve(boost::lexical_cast<std::int64_t>(value)));
+            result    = boost::lexical_cast<std::wstring>(static_cast<std::int64_t>(position_));
+        } else if (boost::iequals(cmd, L"speed")) {
+            if (!value.empty()) {
+                speed_ = boost::lexical_cast<double>(value);
+            }
+            result = boost::lexical_cast<std::wstring>(speed_);
+        } else if (boost::iequals(cmd, L"loop")) {
+            if (!value.empty()) {
+                loop_ = boost::lexical_cast<bool>(value);
+            }
+            result = boost::lexical_cast<std::wstring>(loop_);
+        } else {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info(L"Unknown replay producer command " + cmd));
+        }
+
+        return make_ready_future(std::move(result));
+    }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+
+    uint32_t frame_number() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<uint32_t>(std::max<std::int64_t>(0, last_number_));
+    }
+
+    std::wstring print() const override { return L"replay[" + buffer_->name() + L"]"; }
+
+    std::wstring name() const override { return L"replay"; }
+
+  private:
+    // Negative frame numbers count back from the newest frame of the ring.
+    std::int64_t resolve(std::int64_t number) const
+    {
+        return number < 0 ? std::max<std::int64_t>(0, buffer_->range().second + 1 + number) : number;
+    }
+
+    core::draw_frame read_frame(std::int64_t number, bool audio)
+    {
+        auto frame = frame_factory_->create_frame(this, buffer_->pixel_format_desc());
+
+        auto found = buffer_->read(number, [&](const replay_buffer::slot& slot) {
+            auto& image = frame.image_data(0);
+            std::memcpy(image.data(), slot.image.data(), std::min(image.size(), slot.image.size()));
+            if (audio) {
+                frame.audio_data() = array<std::int32_t>(slot.audio);
+            }
+        });
+
+        return found ? core::draw_frame(std::move(frame)) : core::draw_frame{};
+    }
+};
+
+constexpr std::int64_t replay_producer::live;
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    static const std::wstring prefix = L"replay://";
+
+    if (params.empty() || !boost::istarts_with(params.at(0), prefix)) {
+        return core::frame_producer::empty();
+    }
+
+    const auto name   = params.at(0).substr(prefix.size());
+    auto       buffer = find_buffer(name);
+    if (!buffer) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"There is no replay buffer named " + name + L"."));
+    }
+
+    auto in    = std::int64_t(0);
+    auto out   = replay_producer::live;
+    auto seek  = std::int64_t(0);
+    auto speed = 1.0;
+    auto loop  = false;
+
+    for (std::size_t n = 1; n < params.size(); ++n) {
+        if (boost::iequals(params[n], L"LOOP")) {
+            loop = true;
+        } else if (n + 1 < params.size()) {
+            if (boost::iequals(params[n], L"IN")) {
+                in = boost::lexical_cast<std::int64_t>(params[++n]);
+            } else if (boost::iequals(params[n], L"OUT")) {
+                out = boost::iequals(params[n + 1], L"LIVE") ? replay_producer::live
+                                                              : boost::lexical_cast<std::int64_t>(params[n + 1]);
+                ++n;
+            } else if (boost::iequals(params[n], L"SEEK")) {
+                seek = boost::lexical_cast<std::int64_t>(params[++n]);
+            } else if (boost::iequals(params[n], L"SPEED")) {
+                speed = boost::lexical_cast<double>(params[++n]);
+            }
+        }
+    }
+
+    return spl::make_shared<replay_producer>(dependencies.frame_factory, std::move(buffer), in, out, seek, speed, loop);
+}
+
+}} // namespace caspar::replay
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_buffer.h"
+
+#include <common/except.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace caspar { namespace replay {
+
+replay_buffer::replay_buffer(std::wstring                   name,
+                             const core::video_format_desc& format_desc,
+                             core::output_format            format,
+                             std::size_t                    capacity)
+    : name_(std::move(name))
+    , format_desc_(format_desc)
+    , format_(format)
+    , slots_(std::max<std::size_t>(1, capacity))
+{
+}
+
+std::int64_t
+replay_buffer::write(const std::uint8_t* image, std::size_t image_size, const std::int32_t* audio, std::size_t samples)
+{
+    const auto number = next_.load();
+    auto&      slot   = slots_[static_cast<std::size_t>(number % static_cast<std::int64_t>(slots_.size()))];
+
+    {
+        std::lock_guard<std::mutex> lock(slot.mutex);
+
+        // NOTE: The memory of a slot is reused once the ring has filled up, it is only allocated on the first lap.
+        slot.number = number;
+        slot.image.resize(image_size);
+        std::memcpy(slot.image.data(), image, image_size);
+        slot.audio.assign(audio, audio + samples);
+    }
+
+    next_ = number + 1;
+    return number;
+}
+
+std::pair<std::int64_t, std::int64_t> replay_buffer::range() const
+{
+    const auto next = next_.load();
+    return {std::max<std::int64_t>(0, next - static_cast<std::int64_t>(slots_.size())), next - 1};
+}
+
+bool replay_buffer::read(std::int64_t number, const std::function<void(const slot&)>& func) const
+{
+    if (number < 0) {
+        return false;
+    }
+
+    const auto& slot = slots_[static_cast<std::size_t>(number % static_cast<std::int64_t>(slots_.size()))];
+
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    if (slot.number != number) {
+        return false;
+    }
+    func(slot);
+    return true;
+}
+
+core::pixel_format_desc replay_buffer::pixel_format_desc() const
+{
+    if (format_ == core::output_format::uyvy) {
+        auto desc = core::pixel_format_desc(core::pixel_format::uyvy);
+        desc.planes.push_back(core::pixel_format_desc::plane(format_desc_.width / 2, format_desc_.height, 4));
+        return desc;
+    }
+
+    auto desc = core::pixel_format_desc(core::pixel_format::bgra);
+    desc.planes.push_back(core::pixel_format_desc::plane(format_desc_.width, format_desc_.height, 4));
+    return desc;
+}
+
+namespace {
+
+std::mutex                                           buffers_mutex;
+std::map<std::wstring, std::weak_ptr<replay_buffer>> buffers;
+
+} // namespace
+
+std::shared_ptr<replay_buffer> create_buffer(const std::wstring&            name,
+                                             const core::video_format_desc& format_desc,
+                                             core::output_format            format,
+                                             std::size_t                    capacity)
+{
+    auto buffer = std::make_shared<replay_buffer>(name, format_desc, format, capacity);
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    buffers[boost::to_lower_copy(name)] = buffer;
+    return buffer;
+}
+
+std::shared_ptr<replay_buffer> find_buffer(const std::wstring& name)
+{
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+
+    auto it = buffers.find(boost::to_lower_copy(name));
+    return it != buffers.end() ? it->second.lock() : nullptr;
+}
+
+}} // namespace caspar::replay
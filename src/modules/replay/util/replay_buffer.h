@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace replay {
+
+// The last frames of a channel, kept in memory in a ring which is indexed by frame number. One consumer writes the
+// frames while any number of producers read them.
+class replay_buffer
+{
+  public:
+    struct slot
+    {
+        mutable std::mutex        mutex;
+        std::int64_t              number = -1;
+        std::vector<std::uint8_t> image;
+        std::vector<std::int32_t> audio;
+    };
+
+    replay_buffer(std::wstring                   name,
+                  const core::video_format_desc& format_desc,
+                  core::output_format            format,
+                  std::size_t                    capacity);
+
+    // Appends a frame, overwriting the oldest once the ring is full, and returns its number.
+    std::int64_t
+    write(const std::uint8_t* image, std::size_t image_size, const std::int32_t* audio, std::size_t samples);
+
+    // The numbers of the oldest and the newest frame kept, the oldest is greater than the newest while it is empty.
+    std::pair<std::int64_t, std::int64_t> range() const;
+
+    // Calls func with frame number, returns false if it is not, or no longer, kept.
+    bool read(std::int64_t number, const std::function<void(const slot&)>& func) const;
+
+    const std::wstring&            name() const { return name_; }
+    const core::video_format_desc& format_desc() const { return format_desc_; }
+    core::output_format            format() const { return format_; }
+
+    // The pixel format of the images kept, for the frames of producers.
+    core::pixel_format_desc pixel_format_desc() const;
+
+  private:
+    const std::wstring            name_;
+    const core::video_format_desc format_desc_;
+    const core::output_format     format_;
+    std::vector<slot>             slots_;
+    std::atomic<std::int64_t>     next_{0};
+};
+
+// Creates the buffer of a consumer, which replaces any earlier buffer of the same name for producers opened from then
+// on. Producers which still play the earlier buffer keep it until they are removed.
+std::shared_ptr<replay_buffer> create_buffer(const std::wstring&            name,
+                                             const core::video_format_desc& format_desc,
+                                             core::output_format            format,
+                                             std::size_t                    capacity);
+
+// The buffer named name, or nullptr if no consumer records it.
+std::shared_ptr<replay_buffer> find_buffer(const std::wstring& name);
+
+}} // namespace caspar::replay
@@ -41,14 +41,23 @@
 #include <core/frame/geometry.h>
 #include <core/video_format.h>
 
+#include <accelerator/ogl/util/device.h>
+#include <accelerator/ogl/util/texture.h>
+
 #include "./screen_shader.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/property_tree/ptree.hpp>
 
-#include <tbb/concurrent_queue.h>
-
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -94,6 +103,7 @@ struct configuration
     bool            interactive   = true;
     bool            borderless    = false;
     bool            always_on_top = false;
+    bool            shared_thread = false;
 };
 
 struct frame
@@ -102,8 +112,63 @@ struct frame
     GLuint tex   = 0;
     char*  ptr   = nullptr;
     GLsync fence = 0;
+
+    // A mixer frame whose texture is drawn directly, it is held until the fence has been signaled so that the mixer
+    // does not reuse the texture while it is still being drawn.
+    core::const_frame image;
+};
+
+struct screen_consumer;
+
+// Renders the screen consumers which set shared-thread on one thread. Each pass draws every window which has a new
+// frame and then presents them, so that only the last window presented waits for vsync.
+class display : boost::noncopyable
+{
+    std::mutex                              mutex_;
+    std::condition_variable                 cond_;
+    std::deque<std::function<void()>>       tasks_;
+    bool                                    pending_ = false;
+    bool                                    running_ = true;
+    std::vector<screen_consumer*>           consumers_;
+    std::weak_ptr<accelerator::ogl::shader> shader_;
+    std::thread                             thread_;
+
+  public:
+    display();
+    ~display();
+
+    // Initializes consumer on the display thread and draws it from the next pass.
+    void add(screen_consumer* consumer);
+
+    // Removes consumer and releases its resources on the display thread, returns once they have been released.
+    void remove(screen_consumer* consumer);
+
+    // Called when a consumer has received a frame.
+    void notify();
+
+    // The program which the windows share, which is created in the context of the current window on first use.
+    std::shared_ptr<accelerator::ogl::shader> shader();
+
+  private:
+    void post(std::function<void()> task);
+    void run();
 };
 
+std::shared_ptr<display> get_display()
+{
+    static std::mutex             mutex;
+    static std::weak_ptr<display> instance;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto result = instance.lock();
+    if (!result) {
+        result   = std::make_shared<display>();
+        instance = result;
+    }
+    return result;
+}
+
 struct screen_consumer : boost::noncopyable
 {
     const configuration     config_;
@@ -125,15 +190,22 @@ struct screen_consumer : boost::noncopyable
 
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
+    caspar::timer                       frame_timer_;
 
-    tbb::concurrent_bounded_queue<core::const_frame> frame_buffer_;
+    // NOTE: The render thread sleeps on the condition until a frame arrives, or at most one frame interval so that
+    // window events are still handled while the channel is not sending.
+    std::mutex                    buffer_mutex_;
+    std::condition_variable       buffer_cond_;
+    std::deque<core::const_frame> frame_buffer_;
 
-    std::unique_ptr<accelerator::ogl::shader> shader_;
-    GLuint                                    vao_;
-    GLuint                                    vbo_;
+    std::shared_ptr<accelerator::ogl::shader> shader_;
+    GLuint                                    vao_   = 0;
+    GLuint                                    vbo_   = 0;
+    bool                                      vsync_ = false;
 
-    std::atomic<bool> is_running_{true};
-    std::thread       thread_;
+    std::atomic<bool>        is_running_{true};
+    std::shared_ptr<display> display_;
+    std::thread              thread_;
 
   public:
     screen_consumer(const configuration& config, const core::video_format_desc& format_desc, int channel_index)
@@ -152,8 +224,6 @@ struct screen_consumer : boost::noncopyable
             }
         }
 
-        frame_buffer_.set_capacity(1);
-
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
@@ -206,110 +276,156 @@ struct screen_consumer : boost::noncopyable
             }
         }
 
-        thread_ = std::thread([this] {
-            try {
-                const auto window_style = config_.borderless ? sf::Style::None
-                                                             : (config_.windowed ? sf::Style::Resize | sf::Style::Close
-                                                                                 : sf::Style::Fullscreen);
-                sf::VideoMode desktop = sf::VideoMode::getDesktopMode();
-                sf::VideoMode mode(screen_width_, screen_height_, desktop.bitsPerPixel);
-                window_.create(mode,
-                               u8(print()),
-                               window_style,
-                               sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core));
-                window_.setPosition(sf::Vector2i(screen_x_, screen_y_));
-                window_.setMouseCursorVisible(config_.interactive);
-                window_.setActive(true);
-
-                if (config_.always_on_top) {
+        if (config_.shared_thread) {
+            display_ = get_display();
+            display_->add(this);
+        } else {
+            thread_ = std::thread([this] {
+                try {
+                    init();
+                    while (is_running_) {
+                        if (tick(true)) {
+                            present(config_.vsync);
+                        }
+                    }
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                    is_running_ = false;
+                }
+                uninit();
+            });
+        }
+    }
+
+    ~screen_consumer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(buffer_mutex_);
+            is_running_ = false;
+        }
+        if (display_) {
+            display_->remove(this);
+        } else {
+            buffer_cond_.notify_all();
+            thread_.join();
+        }
+    }
+
+    // Creates the window and its resources, on the thread which renders the consumer.
+    void init()
+    {
+        const auto window_style =
+            config_.borderless ? sf::Style::None
+                               : (config_.windowed ? sf::Style::Resize | sf::Style::Close : sf::Style::Fullscreen);
+        sf::VideoMode desktop = sf::VideoMode::getDesktopMode();
+        sf::VideoMode mode(screen_width_, screen_height_, desktop.bitsPerPixel);
+        window_.create(
+            mode, u8(print()), window_style, sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core));
+        window_.setPosition(sf::Vector2i(screen_x_, screen_y_));
+        window_.setMouseCursorVisible(config_.interactive);
+        window_.setActive(true);
+
+        if (config_.always_on_top) {
 #ifdef _MSC_VER
-                    HWND hwnd = window_.getSystemHandle();
-                    SetWindowPos(hwnd, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
+            HWND hwnd = window_.getSystemHandle();
+            SetWindowPos(hwnd, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
 #else
-                    window_always_on_top(window_);
+            window_always_on_top(window_);
 #endif
-                }
+        }
 
-                if (glewInit() != GLEW_OK) {
-                    CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize GLEW."));
-                }
+        if (glewInit() != GLEW_OK) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize GLEW."));
+        }
 
-                if (!GLEW_VERSION_4_5 && !glewIsSupported("GL_ARB_sync GL_ARB_shader_objects GL_ARB_multitexture "
-                                                          "GL_ARB_direct_state_access GL_ARB_texture_barrier")) {
-                    CASPAR_THROW_EXCEPTION(not_supported() << msg_info(
-                                               "Your graphics card does not meet the minimum hardware requirements "
-                                               "since it does not support OpenGL 4.5 or higher."));
-                }
+        if (!GLEW_VERSION_4_5 && !glewIsSupported("GL_ARB_sync GL_ARB_shader_objects GL_ARB_multitexture "
+                                                  "GL_ARB_direct_state_access GL_ARB_texture_barrier")) {
+            CASPAR_THROW_EXCEPTION(not_supported() << msg_info(
+                                       "Your graphics card does not meet the minimum hardware requirements "
+                                       "since it does not support OpenGL 4.5 or higher."));
+        }
 
-                GL(glGenVertexArrays(1, &vao_));
-                GL(glGenBuffers(1, &vbo_));
-                GL(glBindVertexArray(vao_));
-                GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
-
-                shader_ = get_shader();
-                shader_->use();
-                shader_->set("background", 0);
-                shader_->set("key_only", config_.key_only);
-
-                for (int n = 0; n < 2; ++n) {
-                    screen::frame frame;
-                    auto          flags = GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_WRITE_BIT;
-                    GL(glCreateBuffers(1, &frame.pbo));
-                    GL(glNamedBufferStorage(frame.pbo, format_desc_.size, nullptr, flags));
-                    frame.ptr =
-                        reinterpret_cast<char*>(GL2(glMapNamedBufferRange(frame.pbo, 0, format_desc_.size, flags)));
-
-                    GL(glCreateTextures(GL_TEXTURE_2D, 1, &frame.tex));
-                    GL(glTextureParameteri(frame.tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-                    GL(glTextureParameteri(frame.tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-                    GL(glTextureParameteri(frame.tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-                    GL(glTextureParameteri(frame.tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-                    GL(glTextureStorage2D(frame.tex, 1, GL_RGBA8, format_desc_.width, format_desc_.height));
-                    GL(glClearTexImage(frame.tex, 0, GL_BGRA, GL_UNSIGNED_BYTE, nullptr));
-
-                    frames_.push_back(frame);
-                }
+        GL(glGenVertexArrays(1, &vao_));
+        GL(glGenBuffers(1, &vbo_));
+        GL(glBindVertexArray(vao_));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+
+        // NOTE: Windows on the shared thread use one program, which SFML contexts share like all other objects except
+        // for vertex arrays.
+        shader_ = display_ ? display_->shader() : std::shared_ptr<accelerator::ogl::shader>(get_shader());
+        shader_->use();
+        shader_->set("background", 0);
+        shader_->set("key_only", config_.key_only);
+
+        // NOTE: The vertex layout is recorded in the vao once, the vbo is only refilled when the window
+        // is resized.
+        auto stride  = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+        auto vtx_loc = shader_->get_attrib_location("Position");
+        auto tex_loc = shader_->get_attrib_location("TexCoordIn");
+
+        GL(glEnableVertexAttribArray(vtx_loc));
+        GL(glEnableVertexAttribArray(tex_loc));
+
+        GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
+        GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+
+        // NOTE: Three buffers, so that the cpu normally writes into a buffer whose fence has already been
+        // signaled while the gpu is still uploading and drawing the previous frames.
+        for (int n = 0; n < 3; ++n) {
+            screen::frame frame;
+            auto          flags = GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_WRITE_BIT;
+            GL(glCreateBuffers(1, &frame.pbo));
+            GL(glNamedBufferStorage(frame.pbo, format_desc_.size, nullptr, flags));
+            frame.ptr = reinterpret_cast<char*>(GL2(glMapNamedBufferRange(frame.pbo, 0, format_desc_.size, flags)));
+
+            GL(glCreateTextures(GL_TEXTURE_2D, 1, &frame.tex));
+            GL(glTextureParameteri(frame.tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+            GL(glTextureParameteri(frame.tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+            GL(glTextureParameteri(frame.tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+            GL(glTextureParameteri(frame.tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+            GL(glTextureStorage2D(frame.tex, 1, GL_RGBA8, format_desc_.width, format_desc_.height));
+            GL(glClearTexImage(frame.tex, 0, GL_BGRA, GL_UNSIGNED_BYTE, nullptr));
+
+            frames_.push_back(frame);
+        }
 
-                GL(glDisable(GL_DEPTH_TEST));
-                GL(glClearColor(0.0, 0.0, 0.0, 0.0));
-                GL(glViewport(0, 0, format_desc_.width, format_desc_.height));
+        GL(glDisable(GL_DEPTH_TEST));
+        GL(glClearColor(0.0, 0.0, 0.0, 0.0));
+        GL(glViewport(0, 0, format_desc_.width, format_desc_.height));
 
-                calculate_aspect();
+        calculate_aspect();
 
-                window_.setVerticalSyncEnabled(config_.vsync);
+        // NOTE: Only the last window presented in a pass of the shared thread waits for vsync, see present().
+        vsync_ = config_.vsync && !display_;
+        window_.setVerticalSyncEnabled(vsync_);
 
-                if (config_.vsync) {
-                    CASPAR_LOG(info) << print() << " Enabled vsync.";
-                }
+        if (config_.vsync) {
+            CASPAR_LOG(info) << print() << " Enabled vsync.";
+        }
+    }
 
-                while (is_running_) {
-                    tick();
-                }
-            } catch (tbb::user_abort&) {
-                // Do nothing
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-                is_running_ = false;
-            }
-            for (auto frame : frames_) {
-                GL(glUnmapNamedBuffer(frame.pbo));
-                glDeleteBuffers(1, &frame.pbo);
-                glDeleteTextures(1, &frame.tex);
-            }
+    // Releases the resources of the window and closes it, on the thread which renders the consumer.
+    void uninit()
+    {
+        if (window_.isOpen()) {
+            window_.setActive(true);
+        }
 
-            shader_.reset();
-            GL(glDeleteVertexArrays(1, &vao_));
-            GL(glDeleteBuffers(1, &vbo_));
+        for (auto frame : frames_) {
+            if (frame.fence) {
+                glDeleteSync(frame.fence);
+            }
+            GL(glUnmapNamedBuffer(frame.pbo));
+            glDeleteBuffers(1, &frame.pbo);
+            glDeleteTextures(1, &frame.tex);
+        }
+        frames_.clear();
 
-            window_.close();
-        });
-    }
+        shader_.reset();
+        GL(glDeleteVertexArrays(1, &vao_));
+        GL(glDeleteBuffers(1, &vbo_));
 
-    ~screen_consumer()
-    {
-        is_running_ = false;
-        frame_buffer_.abort();
-        thread_.join();
+        window_.close();
     }
 
     bool poll()
@@ -327,92 +443,118 @@ struct screen_consumer : boost::noncopyable
         return count > 0;
     }
 
-    void tick()
+    // Draws the next frame into the back buffer of the window, waiting at most one frame interval for it if wait is
+    // set. Returns whether there was a frame, which is then shown by present().
+    bool tick(bool wait)
     {
+        if (display_) {
+            window_.setActive(true);
+        }
+
+        poll();
+
         core::const_frame in_frame;
+        {
+            std::unique_lock<std::mutex> lock(buffer_mutex_);
+            if (wait) {
+                buffer_cond_.wait_for(lock, std::chrono::duration<double>(1.0 / format_desc_.fps), [&] {
+                    return !frame_buffer_.empty() || !is_running_;
+                });
+            }
 
-        while (!frame_buffer_.try_pop(in_frame) && is_running_) {
-            // TODO (fix)
-            if (!poll()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            if (frame_buffer_.empty()) {
+                return false;
             }
-        }
 
-        if (!in_frame) {
-            return;
+            in_frame = std::move(frame_buffer_.front());
+            frame_buffer_.pop_front();
         }
 
+        frame_timer_.restart();
+
+        auto&  frame   = frames_.front();
+        GLuint texture = frame.tex;
+
         // Upload
         {
-            auto& frame = frames_.front();
-
             while (frame.fence) {
-                auto wait = glClientWaitSync(frame.fence, 0, 0);
-                if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED) {
-                    glDeleteSync(frame.fence);
-                    frame.fence = 0;
-                }
-                if (!poll()) {
-                    // TODO (fix)
-                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                auto wait = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 10000000); // 10 ms
+                if (wait == GL_TIMEOUT_EXPIRED && is_running_) {
+                    poll();
+                    continue;
                 }
+                glDeleteSync(frame.fence);
+                frame.fence = 0;
             }
+            frame.image = core::const_frame{};
+
+            // NOTE: The window context shares objects with the mixer, so the mixer's texture is drawn directly and the
+            // frame is not read back at all. Frames which do not come from the mixer's device are uploaded again.
+            auto source = accelerator::ogl::readback_texture(in_frame.device_image_data(0));
+            if (source && source->width() == format_desc_.width && source->height() == format_desc_.height) {
+                frame.image = in_frame;
+                texture     = source->id();
+            } else {
+                std::memcpy(frame.ptr, in_frame.image_data(0).begin(), format_desc_.size);
 
-            std::memcpy(frame.ptr, in_frame.image_data(0).begin(), format_desc_.size);
-
-            GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, frame.pbo));
-            GL(glTextureSubImage2D(
-                frame.tex, 0, 0, 0, format_desc_.width, format_desc_.height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr));
-            GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
-
-            frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, frame.pbo));
+                GL(glTextureSubImage2D(
+                    frame.tex, 0, 0, 0, format_desc_.width, format_desc_.height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr));
+                GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+            }
         }
 
         // Display
         {
-            auto& frame = frames_.back();
-
+            // NOTE: The frame is drawn in the same tick that it arrives, the draw is ordered after its upload by the
+            // driver.
             GL(glClear(GL_COLOR_BUFFER_BIT));
 
             GL(glActiveTexture(GL_TEXTURE0));
-            GL(glBindTexture(GL_TEXTURE_2D, frame.tex));
-
-            GL(glBufferData(GL_ARRAY_BUFFER,
-                            static_cast<GLsizei>(sizeof(core::frame_geometry::coord)) * draw_coords_.size(),
-                            draw_coords_.data(),
-                            GL_STATIC_DRAW));
-
-            auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+            GL(glBindTexture(GL_TEXTURE_2D, texture));
 
-            auto vtx_loc = shader_->get_attrib_location("Position");
-            auto tex_loc = shader_->get_attrib_location("TexCoordIn");
-
-            GL(glEnableVertexAttribArray(vtx_loc));
-            GL(glEnableVertexAttribArray(tex_loc));
+            GL(glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(draw_coords_.size())));
 
-            GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
-            GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+            GL(glBindTexture(GL_TEXTURE_2D, 0));
 
-            GL(glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(draw_coords_.size())));
+            frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
 
-            GL(glDisableVertexAttribArray(vtx_loc));
-            GL(glDisableVertexAttribArray(tex_loc));
+        return true;
+    }
 
-            GL(glBindTexture(GL_TEXTURE_2D, 0));
+    // Shows the frame drawn by tick(), waiting for vsync if it is set.
+    void present(bool vsync)
+    {
+        if (vsync != vsync_) {
+            vsync_ = vsync;
+            window_.setVerticalSyncEnabled(vsync_);
         }
 
         window_.display();
 
         std::rotate(frames_.begin(), frames_.begin() + 1, frames_.end());
 
+        graph_->set_value("frame-time", frame_timer_.elapsed() * format_desc_.fps * 0.5);
         graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
         tick_timer_.restart();
     }
 
     std::future<bool> send(core::const_frame frame)
     {
-        if (!frame_buffer_.try_push(frame)) {
-            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        {
+            std::lock_guard<std::mutex> lock(buffer_mutex_);
+            // NOTE: A frame which has not been displayed yet is replaced, the newest frame is always shown.
+            if (!frame_buffer_.empty()) {
+                frame_buffer_.clear();
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            }
+            frame_buffer_.push_back(std::move(frame));
+        }
+        if (display_) {
+            display_->notify();
+        } else {
+            buffer_cond_.notify_one();
         }
         return make_ready_future(is_running_.load());
     }
@@ -452,6 +594,11 @@ struct screen_consumer : boost::noncopyable
             {target_ratio.first, -target_ratio.second, 1.0, 1.0}, // lower right
             {-target_ratio.first, -target_ratio.second, 0.0, 1.0} // lower left
         };
+
+        GL(glBufferData(GL_ARRAY_BUFFER,
+                        static_cast<GLsizei>(sizeof(core::frame_geometry::coord)) * draw_coords_.size(),
+                        draw_coords_.data(),
+                        GL_STATIC_DRAW));
     }
 
     std::pair<float, float> none()
@@ -486,6 +633,128 @@ struct screen_consumer : boost::noncopyable
     }
 };
 
+display::display()
+    : thread_([this] { run(); })
+{
+}
+
+display::~display()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void display::add(screen_consumer* consumer)
+{
+    post([this, consumer] {
+        try {
+            consumer->init();
+            consumers_.push_back(consumer);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            consumer->is_running_ = false;
+        }
+    });
+}
+
+void display::remove(screen_consumer* consumer)
+{
+    std::promise<void> promise;
+    post([&] {
+        consumers_.erase(std::remove(consumers_.begin(), consumers_.end(), consumer), consumers_.end());
+        consumer->uninit();
+        promise.set_value();
+    });
+    promise.get_future().wait();
+}
+
+void display::notify()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = true;
+    }
+    cond_.notify_one();
+}
+
+std::shared_ptr<accelerator::ogl::shader> display::shader()
+{
+    auto result = shader_.lock();
+    if (!result) {
+        result  = get_shader();
+        shader_ = result;
+    }
+    return result;
+}
+
+void display::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    cond_.notify_one();
+}
+
+void display::run()
+{
+    while (true) {
+        // NOTE: Without frames the thread still wakes once per frame interval of the fastest channel, so that window
+        // events are handled.
+        auto interval = 1.0 / 25.0;
+        for (auto consumer : consumers_) {
+            interval = std::min(interval, 1.0 / consumer->format_desc_.fps);
+        }
+
+        std::deque<std::function<void()>> tasks;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait_for(lock, std::chrono::duration<double>(interval), [&] {
+                return pending_ || !tasks_.empty() || !running_;
+            });
+
+            if (!running_ && tasks_.empty()) {
+                break;
+            }
+
+            pending_ = false;
+            tasks.swap(tasks_);
+        }
+
+        for (auto& task : tasks) {
+            task();
+        }
+
+        std::vector<screen_consumer*> drawn;
+        for (auto consumer : consumers_) {
+            try {
+                if (consumer->is_running_ && consumer->tick(false)) {
+                    drawn.push_back(consumer);
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                consumer->is_running_ = false;
+            }
+        }
+
+        const auto vsync = std::any_of(drawn.begin(), drawn.end(), [](screen_consumer* consumer) {
+            return consumer->config_.vsync;
+        });
+        for (std::size_t n = 0; n < drawn.size(); ++n) {
+            try {
+                drawn[n]->present(vsync && n + 1 == drawn.size());
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                drawn[n]->is_running_ = false;
+            }
+        }
+    }
+}
+
 struct screen_consumer_proxy : public core::frame_consumer
 {
     const configuration              config_;
@@ -514,6 +783,8 @@ struct screen_consumer_proxy : public core::frame_consumer
     bool has_synchronization_clock() const override { return false; }
 
     int index() const override { return 600 + (config_.key_only ? 10 : 0) + config_.screen_index; }
+
+    bool host_image() const override { return false; }
 };
 
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                  params,
@@ -532,10 +803,11 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
         }
     }
 
-    config.windowed    = !contains_param(L"FULLSCREEN", params);
-    config.key_only    = contains_param(L"KEY_ONLY", params);
-    config.interactive = !contains_param(L"NON_INTERACTIVE", params);
-    config.borderless  = contains_param(L"BORDERLESS", params);
+    config.windowed      = !contains_param(L"FULLSCREEN", params);
+    config.key_only      = contains_param(L"KEY_ONLY", params);
+    config.interactive   = !contains_param(L"NON_INTERACTIVE", params);
+    config.borderless    = contains_param(L"BORDERLESS", params);
+    config.shared_thread = contains_param(L"SHARED_THREAD", params);
 
     if (contains_param(L"NAME", params)) {
         config.name = get_param(L"NAME", params);
@@ -561,6 +833,7 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
     config.interactive   = ptree.get(L"interactive", config.interactive);
     config.borderless    = ptree.get(L"borderless", config.borderless);
     config.always_on_top = ptree.get(L"always-on-top", config.always_on_top);
+    config.shared_thread = ptree.get(L"shared-thread", config.shared_thread);
 
     auto stretch_str = ptree.get(L"stretch", L"fill");
     if (stretch_str == L"none") {
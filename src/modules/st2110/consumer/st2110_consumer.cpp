@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "st2110_consumer.h"
+
+#include "../util/rtp.h"
+
+#include <core/consumer/frame_consumer.h>
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/optional.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+
+namespace caspar { namespace st2110 {
+
+struct configuration
+{
+    boost::asio::ip::udp::endpoint                   video;
+    boost::optional<boost::asio::ip::udp::endpoint> audio;
+    std::string                                      nic;
+    int                                              ttl                = 32;
+    bool                                             txtime             = false;
+    int                                              video_payload_type = 96;
+    int                                              audio_payload_type = 97;
+    int                                              audio_channels     = 8;
+    int                                              packet_size        = 1200; // Bytes of pixel groups per packet.
+};
+
+struct st2110_consumer : public core::frame_consumer
+{
+    using clock = std::chrono::steady_clock;
+
+    // NOTE: Every packet holds the extended sequence number and one segment header after the RTP header.
+    static const std::size_t video_header_size = rtp_header::size + 2 + 6;
+
+    const configuration                 config_;
+    core::video_format_desc             format_desc_;
+    int                                 channel_index_ = -1;
+    spl::shared_ptr<diagnostics::graph> graph_;
+
+    mutable std::mutex   state_mutex_;
+    core::monitor::state state_;
+
+    std::unique_ptr<rtp_socket> video_socket_;
+    std::unique_ptr<rtp_socket> audio_socket_;
+    std::uint32_t               video_ssrc_;
+    std::uint32_t               audio_ssrc_;
+    std::uint32_t               video_sequence_ = 0; // Extended to 32 bits by the payload header of RFC 4175.
+    std::uint16_t               audio_sequence_ = 0;
+
+    // NOTE: Frames are scheduled on a fixed cadence from the first one, which is restarted once sending falls behind.
+    boost::optional<clock::time_point> start_;
+    std::int64_t                       frame_count_     = 0;
+    std::uint32_t                      video_timestamp_ = 0;
+    std::uint32_t                      audio_timestamp_ = 0;
+    std::int64_t                       audio_count_     = 0;
+    std::vector<std::int32_t>          audio_;
+
+    std::vector<std::uint8_t>       video_buffer_;
+    std::vector<std::uint8_t>       audio_buffer_;
+    std::vector<rtp_socket::packet> video_packets_;
+    std::vector<rtp_socket::packet> audio_packets_;
+    std::vector<rtp_socket::packet> run_;
+
+    // NOTE: Packets are sent on their own thread, paced over the frame, the channel drops frames instead of waiting.
+    executor executor_{L"st2110_consumer"};
+
+  public:
+    explicit st2110_consumer(configuration config)
+        : config_(std::move(config))
+    {
+        std::random_device random;
+        video_ssrc_ = random();
+        audio_ssrc_ = random();
+
+        executor_.set_capacity(2);
+
+        graph_->set_text(print());
+        graph_->set_color("frame-time", diagnostics::color(0.5f, 1.0f, 0.2f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        diagnostics::register_graph(graph_);
+    }
+
+    ~st2110_consumer() { executor_.invoke([] {}); }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        executor_.invoke([=] {
+            format_desc_   = format_desc;
+            channel_index_ = channel_index;
+
+            video_socket_ = std::make_unique<rtp_socket>(config_.video, config_.nic, true, config_.ttl, config_.txtime);
+            if (config_.audio) {
+                audio_socket_ =
+                    std::make_unique<rtp_socket>(*config_.audio, config_.nic, true, config_.ttl, config_.txtime);
+            }
+            start_.reset();
+
+            const auto sdp = make_sdp();
+            {
+                std::lock_guard<std::mutex> lock(state_mutex_);
+                state_["st2110/sdp"] = sdp;
+            }
+
+            graph_->set_text(print());
+
+            CASPAR_LOG(info) << print() << L" Initialized\n" << u16(sdp);
+        });
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        if (executor_.size() >= executor_.capacity()) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        } else {
+            executor_.begin_invoke([=] {
+                try {
+                    send_frame(frame);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            });
+        }
+
+        return make_ready_future(true);
+    }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+
+    std::wstring print() const override
+    {
+        return L"st2110[" + u16(config_.video.address().to_string()) + L":" +
+               std::to_wstring(config_.video.port()) + L"]";
+    }
+
+    std::wstring name() const override { return L"st2110"; }
+
+    int index() const override { return 1200 + config_.video.port(); }
+
+    bool has_synchronization_clock() const override { return false; }
+
+    core::output_format output_format() const override { return core::output_format::rfc4175; }
+
+  private:
+    void send_frame(const core::const_frame& frame)
+    {
+        caspar::timer frame_timer;
+
+        const auto groups = (format_desc_.width + 1) / 2;
+        const auto stride = (groups * 5 + 3) / 4 * 4;
+
+        // NOTE: Frames which were mixed before the consumer was added are not converted, they are skipped.
+        const auto& image = frame.image_data(core::output_format::rfc4175);
+        if (image.size() < static_cast<std::size_t>(stride) * format_desc_.height) {
+            return;
+        }
+
+        const auto period = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(format_desc_.duration) / format_desc_.time_scale));
+
+        const auto now = clock::now();
+        if (!start_ || now > *start_ + period * (frame_count_ + 1)) {
+            if (start_) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+            }
+            const auto system_now = std::chrono::system_clock::now();
+            start_                = now;
+            frame_count_          = 0;
+            video_timestamp_      = rtp_timestamp(system_now, 90000);
+            audio_timestamp_      = rtp_timestamp(system_now, format_desc_.audio_sample_rate);
+            audio_count_          = 0;
+            audio_.clear();
+        }
+
+        const auto time      = *start_ + period * frame_count_;
+        const auto timestamp = static_cast<std::uint32_t>(
+            video_timestamp_ + frame_count_ * 90000 * format_desc_.duration / format_desc_.time_scale);
+
+        // NOTE: Every tick of an interlaced channel is sent as one field, the rows of the first field from even
+        // ticks and of the second from odd ones, which is what weaving them would send.
+        const auto fields = format_desc_.field_count;
+        const auto field  = fields == 2 ? static_cast<int>(frame_count_ % 2) : 0;
+
+        pack_video(image.data(), stride, field, fields, timestamp, time, period);
+        pack_audio(frame.audio_data(), time);
+
+        graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
+
+        send_packets();
+
+        frame_count_ += 1;
+
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["st2110/packets"] = static_cast<std::int64_t>(video_packets_.size() + audio_packets_.size());
+        state_["st2110/txtime"]  = video_socket_->txtime();
+    }
+
+    void pack_video(const std::uint8_t* image,
+                    int                 stride,
+                    int                 field,
+                    int                 fields,
+                    std::uint32_t       timestamp,
+                    clock::time_point   time,
+                    clock::duration     period)
+    {
+        const auto groups            = (format_desc_.width + 1) / 2;
+        const auto groups_per_packet = std::max(1, config_.packet_size / 5);
+        const auto packets_per_line  = (groups + groups_per_packet - 1) / groups_per_packet;
+        const auto lines             = (format_desc_.height - field + fields - 1) / fields;
+        const auto count             = static_cast<std::size_t>(lines) * packets_per_line;
+        const auto packet_size       = video_header_size + groups_per_packet * 5;
+
+        video_buffer_.resize(count * packet_size);
+        video_packets_.resize(count);
+
+        // NOTE: Packets are spread evenly over nine tenths of the period, leaving a gap where the vertical blanking
+        // of SDI would be, as narrow senders of ST 2110-21 do.
+        const auto spacing = period * 9 / 10 / static_cast<int>(std::max<std::size_t>(1, count));
+
+        std::size_t n = 0;
+        for (auto line = 0; line < lines; ++line) {
+            const auto row = line * fields + field;
+            for (auto group = 0; group < groups; group += groups_per_packet, ++n) {
+                const auto length = std::min(groups_per_packet, groups - group) * 5;
+                const auto offset = group * 2;
+                auto       dst    = video_buffer_.data() + n * packet_size;
+
+                rtp_header header;
+                header.marker       = n + 1 == count;
+                header.payload_type = config_.video_payload_type;
+                header.sequence     = static_cast<std::uint16_t>(video_sequence_);
+                header.timestamp    = timestamp;
+                header.ssrc         = video_ssrc_;
+                write_rtp_header(dst, header);
+                dst += rtp_header::size;
+
+                dst[0] = static_cast<std::uint8_t>(video_sequence_ >> 24);
+                dst[1] = static_cast<std::uint8_t>(video_sequence_ >> 16);
+                dst[2] = static_cast<std::uint8_t>(length >> 8);
+                dst[3] = static_cast<std::uint8_t>(length);
+                dst[4] = static_cast<std::uint8_t>((field << 7) | ((line >> 8) & 0x7F));
+                dst[5] = static_cast<std::uint8_t>(line);
+                dst[6] = static_cast<std::uint8_t>((offset >> 8) & 0x7F);
+                dst[7] = static_cast<std::uint8_t>(offset);
+                std::memcpy(dst + 8, image + static_cast<std::size_t>(row) * stride + group * 5, length);
+
+                video_packets_[n].data = video_buffer_.data() + n * packet_size;
+                video_packets_[n].size = video_header_size + length;
+                video_packets_[n].time = time + spacing * static_cast<int>(n);
+
+                video_sequence_ += 1;
+            }
+        }
+    }
+
+    void pack_audio(const array<const std::int32_t>& samples, clock::time_point time)
+    {
+        audio_packets_.clear();
+        if (!audio_socket_) {
+            return;
+        }
+
+        const auto in_channels = format_desc_.audio_channels;
+        const auto channels    = std::min(config_.audio_channels, in_channels);
+        const auto frames      = samples.size() / in_channels;
+
+        const auto offset = audio_.size();
+        audio_.resize(offset + frames * channels);
+        for (std::size_t s = 0; s < frames; ++s) {
+            std::copy_n(samples.data() + s * in_channels, channels, audio_.data() + offset + s * channels);
+        }
+
+        // NOTE: Packets of 1 ms, the leftover samples are sent with the next frame.
+        const auto samples_per_packet = format_desc_.audio_sample_rate / 1000;
+        const auto count              = audio_.size() / (samples_per_packet * channels);
+        const auto packet_size        = rtp_header::size + samples_per_packet * channels * 3;
+
+        audio_buffer_.resize(count * packet_size);
+        audio_packets_.resize(count);
+
+        for (std::size_t n = 0; n < count; ++n) {
+            auto dst = audio_buffer_.data() + n * packet_size;
+
+            rtp_header header;
+            header.payload_type = config_.audio_payload_type;
+            header.sequence     = audio_sequence_++;
+            header.timestamp    = static_cast<std::uint32_t>(audio_timestamp_ + audio_count_);
+            header.ssrc         = audio_ssrc_;
+            write_rtp_header(dst, header);
+            dst += rtp_header::size;
+
+            const auto src = audio_.data() + n * samples_per_packet * channels;
+            for (auto s = 0; s < samples_per_packet * channels; ++s, dst += 3) {
+                dst[0] = static_cast<std::uint8_t>(src[s] >> 24);
+                dst[1] = static_cast<std::uint8_t>(src[s] >> 16);
+                dst[2] = static_cast<std::uint8_t>(src[s] >> 8);
+            }
+
+            audio_packets_[n].data = audio_buffer_.data() + n * packet_size;
+            audio_packets_[n].size = packet_size;
+            audio_packets_[n].time = time + std::chrono::duration_cast<clock::duration>(std::chrono::milliseconds(n));
+
+            audio_count_ += samples_per_packet;
+        }
+
+        audio_.erase(audio_.begin(), audio_.begin() + count * samples_per_packet * channels);
+    }
+
+    // Sends the video and audio packets of a frame in the order of their times, in runs of packets of one flow.
+    void send_packets()
+    {
+        auto video = video_packets_.begin();
+        auto audio = audio_packets_.begin();
+        while (video != video_packets_.end() || audio != audio_packets_.end()) {
+            run_.clear();
+            if (audio == audio_packets_.end() || (video != video_packets_.end() && video->time <= audio->time)) {
+                while (video != video_packets_.end() && (audio == audio_packets_.end() || video->time <= audio->time)) {
+                    run_.push_back(*video++);
+                }
+                video_socket_->send(run_);
+            } else {
+                while (audio != audio_packets_.end() && (video == video_packets_.end() || audio->time < video->time)) {
+                    run_.push_back(*audio++);
+                }
+                audio_socket_->send(run_);
+            }
+        }
+    }
+
+    std::string make_sdp() const
+    {
+        // NOTE: Channels tick once per field, the SDP carries the frame rate.
+        const auto framerate = format_desc_.framerate / format_desc_.field_count;
+        const auto rate      = framerate.denominator() == 1
+                              ? std::to_string(framerate.numerator())
+                              : std::to_string(framerate.numerator()) + "/" + std::to_string(framerate.denominator());
+
+        std::ostringstream sdp;
+        sdp << "v=0\r\n";
+        sdp << "o=- " << video_ssrc_ << " 0 IN IP4 " << (config_.nic.empty() ? "0.0.0.0" : config_.nic)
+            << "\r\n";
+        sdp << "s=CasparCG channel " << channel_index_ << "\r\n";
+        sdp << "t=0 0\r\n";
+
+        // NOTE: The timestamps are taken from the system clock, which is assumed to be disciplined by PTP.
+        sdp << "m=video " << config_.video.port() << " RTP/AVP " << config_.video_payload_type << "\r\n";
+        sdp << "c=IN IP4 " << config_.video.address().to_string()
+            << (config_.video.address().is_multicast() ? "/" + std::to_string(config_.ttl) : "") << "\r\n";
+        sdp << "a=rtpmap:" << config_.video_payload_type << " raw/90000\r\n";
+        sdp << "a=fmtp:" << config_.video_payload_type << " sampling=YCbCr-4:2:2; width=" << format_desc_.width
+            << "; height=" << format_desc_.height << "; exactframerate=" << rate
+            << "; depth=10; TCS=SDR; colorimetry=" << (format_desc_.height >= 720 ? "BT709" : "BT601")
+            << "; PM=2110GPM; SSN=ST2110-20:2017; TP=2110TPN;" << (format_desc_.field_count == 2 ? " interlace;" : "")
+            << "\r\n";
+        sdp << "a=mediaclk:direct=0\r\n";
+        sdp << "a=ts-refclk:ptp=traceable\r\n";
+
+        if (config_.audio) {
+            const auto channels = std::min(config_.audio_channels, format_desc_.audio_channels);
+            sdp << "m=audio " << config_.audio->port() << " RTP/AVP " << config_.audio_payload_type << "\r\n";
+            sdp << "c=IN IP4 " << config_.audio->address().to_string()
+                << (config_.audio->address().is_multicast() ? "/" + std::to_string(config_.ttl) : "") << "\r\n";
+            sdp << "a=rtpmap:" << config_.audio_payload_type << " L24/" << format_desc_.audio_sample_rate << "/"
+                << channels << "\r\n";
+            sdp << "a=ptime:1\r\n";
+            sdp << "a=mediaclk:direct=0\r\n";
+            sdp << "a=ts-refclk:ptp=traceable\r\n";
+        }
+
+        return sdp.str();
+    }
+};
+
+spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                  params,
+                                                      std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"ST2110"))
+        return core::frame_consumer::empty();
+
+    configuration config;
+    config.video = parse_endpoint(params.at(1));
+
+    const auto audio = get_param(L"AUDIO", params);
+    if (!audio.empty()) {
+        config.audio = parse_endpoint(audio);
+    }
+    config.nic            = u8(get_param(L"INTERFACE", params));
+    config.ttl            = get_param(L"TTL", params, config.ttl);
+    config.txtime         = contains_param(L"TXTIME", params);
+    config.audio_channels = get_param(L"CHANNELS", params, config.audio_channels);
+
+    return spl::make_shared<st2110_consumer>(config);
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&               ptree,
+                              std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    configuration config;
+    config.video = parse_endpoint(ptree.get<std::wstring>(L"video"));
+
+    const auto audio = ptree.get(L"audio", L"");
+    if (!audio.empty()) {
+        config.audio = parse_endpoint(audio);
+    }
+    config.nic                = u8(ptree.get(L"interface", L""));
+    config.ttl                = ptree.get(L"ttl", config.ttl);
+    config.txtime             = ptree.get(L"txtime", config.txtime);
+    config.video_payload_type = ptree.get(L"video-payload-type", config.video_payload_type);
+    config.audio_payload_type = ptree.get(L"audio-payload-type", config.audio_payload_type);
+    config.audio_channels     = ptree.get(L"audio-channels", config.audio_channels);
+    config.packet_size        = ptree.get(L"packet-size", config.packet_size);
+
+    return spl::make_shared<st2110_consumer>(config);
+}
+
+}} // namespace caspar::st2110
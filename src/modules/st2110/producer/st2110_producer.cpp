@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "st2110_producer.h"
+
+#include "../util/rtp.h"
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <tbb/concurrent_queue.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace st2110 {
+
+class st2110_producer : public core::frame_producer
+{
+    spl::shared_ptr<diagnostics::graph> graph_;
+    core::monitor::state                state_;
+    mutable std::mutex                  state_mutex_;
+    caspar::timer                       tick_timer_;
+
+    const std::wstring                   address_;
+    spl::shared_ptr<core::frame_factory> frame_factory_;
+    core::video_format_desc              format_desc_;
+    const int                            audio_channels_;
+
+    rtp_socket                  video_socket_;
+    std::unique_ptr<rtp_socket> audio_socket_;
+
+    // NOTE: Frames are received on their own thread, the channel picks up the latest one without waiting.
+    tbb::concurrent_bounded_queue<core::draw_frame> frame_buffer_;
+    core::draw_frame                                last_frame_;
+
+    // NOTE: Only used by the video thread.
+    std::unique_ptr<core::mutable_frame> frame_;
+    std::uint32_t                        timestamp_ = 0;
+    int                                  field_     = 0;
+    std::uint32_t                        sequence_  = 0;
+    bool                                 received_  = false;
+    std::int64_t                         lost_      = 0;
+
+    std::mutex                audio_mutex_;
+    std::vector<std::int32_t> audio_; // Received since the last video frame.
+
+    std::atomic<bool> abort_request_{false};
+    std::thread       video_thread_;
+    std::thread       audio_thread_;
+
+  public:
+    st2110_producer(const spl::shared_ptr<core::frame_factory>&     frame_factory,
+                    const core::video_format_desc&                  format_desc,
+                    std::wstring                                    address,
+                    boost::optional<boost::asio::ip::udp::endpoint> audio,
+                    int                                             audio_channels,
+                    const std::string&                              nic)
+        : address_(std::move(address))
+        , frame_factory_(frame_factory)
+        , format_desc_(format_desc)
+        , audio_channels_(audio_channels)
+        , video_socket_(parse_endpoint(address_), nic, false)
+    {
+        if (audio) {
+            audio_socket_ = std::make_unique<rtp_socket>(*audio, nic, false);
+        }
+
+        frame_buffer_.set_capacity(2);
+
+        graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("lost-packet", diagnostics::color(1.0f, 0.2f, 0.2f));
+        graph_->set_color("output-buffer", diagnostics::color(0.0f, 1.0f, 0.0f));
+        graph_->set_text(print());
+        diagnostics::register_graph(graph_);
+
+        video_thread_ = std::thread([this] {
+            set_thread_name(L"[st2110_producer]");
+            run(video_socket_, [this](const std::uint8_t* data, std::size_t size) { push_video(data, size); });
+        });
+
+        if (audio_socket_) {
+            audio_thread_ = std::thread([this] {
+                set_thread_name(L"[st2110_producer]");
+                run(*audio_socket_, [this](const std::uint8_t* data, std::size_t size) { push_audio(data, size); });
+            });
+        }
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    ~st2110_producer()
+    {
+        abort_request_ = true;
+        video_thread_.join();
+        if (audio_thread_.joinable()) {
+            audio_thread_.join();
+        }
+    }
+
+    template <typename Func>
+    void run(rtp_socket& socket, const Func& func)
+    {
+        // NOTE: Large enough for jumbo frames.
+        std::vector<std::vector<std::uint8_t>> buffers(64, std::vector<std::uint8_t>(9000));
+        std::vector<std::size_t>               sizes;
+
+        while (!abort_request_) {
+            try {
+                const auto count = socket.receive(buffers, sizes, std::chrono::milliseconds(100));
+                for (std::size_t n = 0; n < count; ++n) {
+                    func(buffers[n].data(), sizes[n]);
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    void push_video(const std::uint8_t* data, std::size_t size)
+    {
+        rtp_header header;
+        auto       offset = read_rtp_header(data, size, header);
+        if (offset == 0 || size < offset + 2 + 6) {
+            return;
+        }
+
+        const auto sequence = static_cast<std::uint32_t>(data[offset] << 8 | data[offset + 1]) << 16 | header.sequence;
+        if (received_ && sequence != sequence_ + 1) {
+            lost_ += static_cast<std::int32_t>(sequence - sequence_ - 1) > 0 ? sequence - sequence_ - 1 : 0;
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "lost-packet");
+        }
+        sequence_ = sequence;
+        received_ = true;
+        offset += 2;
+
+        // NOTE: Segment headers follow each other while their continuation bit is set, their pixel groups follow the
+        // last one in the same order.
+        struct segment
+        {
+            int length;
+            int field;
+            int line;
+            int offset;
+        };
+        std::vector<segment> segments;
+        while (offset + 6 <= size) {
+            const auto src = data + offset;
+            segments.push_back(
+                {src[0] << 8 | src[1], src[2] >> 7, (src[2] & 0x7F) << 8 | src[3], (src[4] & 0x7F) << 8 | src[5]});
+            offset += 6;
+            if (!(src[4] & 0x80)) {
+                break;
+            }
+        }
+
+        const auto interlaced = format_desc_.field_count == 2;
+        const auto field      = segments.empty() ? 0 : segments.front().field;
+
+        // NOTE: The two fields of an interlaced frame have timestamps of their own, a frame which did not end with a
+        // marker is passed on as it is.
+        if (frame_ && header.timestamp != timestamp_ && !(interlaced && field_ == 0 && field == 1)) {
+            push_frame();
+        }
+        if (!frame_) {
+            frame_ = std::make_unique<core::mutable_frame>(frame_factory_->create_frame(this, pixel_format_desc()));
+        }
+        timestamp_ = header.timestamp;
+        field_     = field;
+
+        const auto width  = format_desc_.width;
+        const auto height = format_desc_.height;
+        auto       y      = reinterpret_cast<std::uint16_t*>(frame_->image_data(0).data());
+        auto       cb     = reinterpret_cast<std::uint16_t*>(frame_->image_data(1).data());
+        auto       cr     = reinterpret_cast<std::uint16_t*>(frame_->image_data(2).data());
+
+        for (const auto& s : segments) {
+            const auto row    = interlaced ? s.line * 2 + s.field : s.line;
+            const auto groups = std::min(s.length / 5, (width - s.offset + 1) / 2);
+            if (row >= height || groups <= 0 || offset + s.length > size) {
+                offset += s.length;
+                continue;
+            }
+
+            auto src = data + offset;
+            for (auto g = 0; g < groups; ++g, src += 5) {
+                const auto x = s.offset + g * 2;
+
+                cb[(row * width + x) / 2] = static_cast<std::uint16_t>(src[0] << 2 | src[1] >> 6);
+                y[row * width + x]        = static_cast<std::uint16_t>((src[1] & 0x3F) << 4 | src[2] >> 4);
+                cr[(row * width + x) / 2] = static_cast<std::uint16_t>((src[2] & 0x0F) << 6 | src[3] >> 2);
+                if (x + 1 < width) {
+                    y[row * width + x + 1] = static_cast<std::uint16_t>((src[3] & 0x03) << 8 | src[4]);
+                }
+            }
+            offset += s.length;
+        }
+
+        if (header.marker && (!interlaced || field == 1)) {
+            push_frame();
+        }
+    }
+
+    void push_frame()
+    {
+        {
+            std::lock_guard<std::mutex> lock(audio_mutex_);
+            frame_->audio_data() = array<std::int32_t>(audio_.size());
+            std::copy(audio_.begin(), audio_.end(), frame_->audio_data().begin());
+            audio_.clear();
+        }
+
+        auto draw_frame = core::draw_frame(std::move(*frame_));
+        frame_.reset();
+
+        if (!frame_buffer_.try_push(draw_frame)) {
+            core::draw_frame dummy;
+            frame_buffer_.try_pop(dummy);
+            frame_buffer_.try_push(draw_frame);
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["file/name"]         = u8(address_);
+        state_["file/video/width"]  = format_desc_.width;
+        state_["file/video/height"] = format_desc_.height;
+        state_["st2110/lost"]       = lost_;
+        state_["buffer"]            = {frame_buffer_.size(), frame_buffer_.capacity()};
+    }
+
+    void push_audio(const std::uint8_t* data, std::size_t size)
+    {
+        rtp_header header;
+        const auto offset = read_rtp_header(data, size, header);
+        if (offset == 0) {
+            return;
+        }
+
+        // NOTE: Extra channels are dropped and missing ones are silent.
+        const auto channels = format_desc_.audio_channels;
+        const auto samples  = (size - offset) / (3 * audio_channels_);
+
+        std::lock_guard<std::mutex> lock(audio_mutex_);
+
+        const auto start = audio_.size();
+        audio_.resize(start + samples * channels);
+        for (std::size_t s = 0; s < samples; ++s) {
+            auto src = data + offset + s * 3 * audio_channels_;
+            for (int c = 0; c < std::min(channels, audio_channels_); ++c, src += 3) {
+                audio_[start + s * channels + c] = static_cast<std::int32_t>(static_cast<std::uint32_t>(src[0]) << 24 |
+                                                                             static_cast<std::uint32_t>(src[1]) << 16 |
+                                                                             static_cast<std::uint32_t>(src[2]) << 8);
+            }
+        }
+
+        // NOTE: Audio is attached to the next video frame, it is dropped if video stops arriving.
+        const auto max_samples = static_cast<std::size_t>(format_desc_.audio_sample_rate * channels);
+        if (audio_.size() > max_samples) {
+            audio_.erase(audio_.begin(), audio_.end() - max_samples);
+        }
+    }
+
+    // Samples of 10 bits in 16 bit words, in planes of Y, Cb and Cr, which the mixer unpacks.
+    core::pixel_format_desc pixel_format_desc() const
+    {
+        auto desc = core::pixel_format_desc(core::pixel_format::ycbcr10);
+        desc.planes.push_back(core::pixel_format_desc::plane(format_desc_.width, format_desc_.height, 2, 2));
+        desc.planes.push_back(core::pixel_format_desc::plane(format_desc_.width / 2, format_desc_.height, 2, 2));
+        desc.planes.push_back(core::pixel_format_desc::plane(format_desc_.width / 2, format_desc_.height, 2, 2));
+        return desc;
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
+        tick_timer_.restart();
+
+        core::draw_frame frame;
+        if (frame_buffer_.try_pop(frame)) {
+            last_frame_ = frame;
+        } else {
+            frame = core::draw_frame::still(last_frame_);
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+        }
+
+        graph_->set_value("output-buffer",
+                          static_cast<float>(frame_buffer_.size()) / static_cast<float>(frame_buffer_.capacity()));
+
+        return frame;
+    }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+
+    std::wstring print() const override { return L"st2110[" + address_ + L"]"; }
+
+    std::wstring name() const override { return L"st2110"; }
+};
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    static const std::wstring prefix = L"st2110://";
+
+    if (params.empty() || !boost::istarts_with(params.at(0), prefix)) {
+        return core::frame_producer::empty();
+    }
+
+    boost::optional<boost::asio::ip::udp::endpoint> audio;
+    {
+        const auto address = get_param(L"AUDIO", params);
+        if (!address.empty()) {
+            audio = parse_endpoint(address);
+        }
+    }
+
+    const auto channels = get_param(L"CHANNELS", params, 8);
+    if (channels < 1) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"CHANNELS must be positive."));
+    }
+
+    auto producer = spl::make_shared<st2110_producer>(dependencies.frame_factory,
+                                                      dependencies.format_desc,
+                                                      params.at(0).substr(prefix.size()),
+                                                      audio,
+                                                      channels,
+                                                      u8(get_param(L"INTERFACE", params)));
+
+    return core::create_destroy_proxy(producer);
+}
+
+}} // namespace caspar::st2110
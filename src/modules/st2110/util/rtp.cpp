@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rtp.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+
+#ifdef __linux__
+#include <linux/net_tstamp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+using namespace boost::asio::ip;
+
+namespace caspar { namespace st2110 {
+
+namespace {
+
+// NOTE: Packets which are due within this time of the first of a batch are sent with it, since the sending thread
+// cannot sleep much shorter than this.
+const auto PACING_SLACK = std::chrono::microseconds(100);
+
+const std::size_t MAX_BATCH = 64;
+
+} // namespace
+
+void write_rtp_header(std::uint8_t* dst, const rtp_header& header)
+{
+    dst[0]  = 0x80;
+    dst[1]  = static_cast<std::uint8_t>((header.marker ? 0x80 : 0x00) | (header.payload_type & 0x7F));
+    dst[2]  = static_cast<std::uint8_t>(header.sequence >> 8);
+    dst[3]  = static_cast<std::uint8_t>(header.sequence);
+    dst[4]  = static_cast<std::uint8_t>(header.timestamp >> 24);
+    dst[5]  = static_cast<std::uint8_t>(header.timestamp >> 16);
+    dst[6]  = static_cast<std::uint8_t>(header.timestamp >> 8);
+    dst[7]  = static_cast<std::uint8_t>(header.timestamp);
+    dst[8]  = static_cast<std::uint8_t>(header.ssrc >> 24);
+    dst[9]  = static_cast<std::uint8_t>(header.ssrc >> 16);
+    dst[10] = static_cast<std::uint8_t>(header.ssrc >> 8);
+    dst[11] = static_cast<std::uint8_t>(header.ssrc);
+}
+
+std::size_t read_rtp_header(const std::uint8_t* src, std::size_t size, rtp_header& header)
+{
+    if (size < rtp_header::size || (src[0] >> 6) != 2) {
+        return 0;
+    }
+
+    header.marker       = (src[1] & 0x80) != 0;
+    header.payload_type = src[1] & 0x7F;
+    header.sequence     = static_cast<std::uint16_t>(src[2] << 8 | src[3]);
+    header.timestamp    = static_cast<std::uint32_t>(src[4]) << 24 | static_cast<std::uint32_t>(src[5]) << 16 |
+                       static_cast<std::uint32_t>(src[6]) << 8 | src[7];
+    header.ssrc = static_cast<std::uint32_t>(src[8]) << 24 | static_cast<std::uint32_t>(src[9]) << 16 |
+                  static_cast<std::uint32_t>(src[10]) << 8 | src[11];
+
+    auto offset = rtp_header::size + (src[0] & 0x0F) * 4;
+    if (src[0] & 0x10) {
+        if (size < offset + 4) {
+            return 0;
+        }
+        offset += 4 + (src[offset + 2] << 8 | src[offset + 3]) * 4;
+    }
+
+    return offset <= size ? offset : 0;
+}
+
+std::uint32_t rtp_timestamp(std::chrono::system_clock::time_point time, int clock_rate)
+{
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    return static_cast<std::uint32_t>(ns / 1000000000 * clock_rate + ns % 1000000000 * clock_rate / 1000000000);
+}
+
+udp::endpoint parse_endpoint(const std::wstring& address)
+{
+    const auto colon = address.rfind(L':');
+    if (colon == std::wstring::npos) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Expected ip:port instead of " + address + L"."));
+    }
+
+    try {
+        return udp::endpoint(make_address(u8(address.substr(0, colon))),
+                             boost::lexical_cast<unsigned short>(address.substr(colon + 1)));
+    } catch (...) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid address " + address + L"."));
+    }
+}
+
+struct rtp_socket::impl
+{
+    boost::asio::io_context io_;
+    udp::socket             socket_;
+    const udp::endpoint     endpoint_;
+    bool                    txtime_ = false;
+
+    impl(const udp::endpoint& endpoint, const std::string& nic, bool sender, int ttl, bool txtime)
+        : socket_(io_)
+        , endpoint_(endpoint)
+    {
+        const auto address  = endpoint.address();
+        const auto local_if = nic.empty() ? address_v4::any() : make_address_v4(nic);
+
+        socket_.open(endpoint.protocol());
+        socket_.set_option(udp::socket::reuse_address(true));
+
+        // NOTE: A frame of uncompressed UHD is tens of megabytes, which are queued in the socket buffers.
+        try {
+            socket_.set_option(boost::asio::socket_base::send_buffer_size(32 * 1024 * 1024));
+            socket_.set_option(boost::asio::socket_base::receive_buffer_size(32 * 1024 * 1024));
+        } catch (...) {
+            CASPAR_LOG(warning) << L"[st2110] Could not enlarge the socket buffers.";
+        }
+
+        if (sender) {
+            if (address.is_multicast()) {
+                socket_.set_option(multicast::outbound_interface(local_if));
+                socket_.set_option(multicast::hops(ttl));
+                socket_.set_option(multicast::enable_loopback(false));
+            }
+            socket_.connect(endpoint);
+        } else if (address.is_multicast()) {
+            socket_.bind(udp::endpoint(address_v4::any(), endpoint.port()));
+            socket_.set_option(multicast::join_group(address.to_v4(), local_if));
+        } else {
+            socket_.bind(endpoint);
+        }
+
+        if (txtime) {
+#if defined(__linux__) && defined(SO_TXTIME)
+            sock_txtime config = {};
+            config.clockid     = CLOCK_TAI;
+            txtime_ = setsockopt(socket_.native_handle(), SOL_SOCKET, SO_TXTIME, &config, sizeof(config)) == 0;
+#endif
+            if (!txtime_) {
+                CASPAR_LOG(warning) << L"[st2110] SO_TXTIME is not supported, packets are paced in software.";
+            }
+        }
+    }
+
+    void send(const std::vector<packet>& packets)
+    {
+        std::size_t n = 0;
+        while (n < packets.size()) {
+            const auto time = packets[n].time;
+            if (!txtime_ && time != std::chrono::steady_clock::time_point{}) {
+                std::this_thread::sleep_until(time);
+            }
+
+            auto count = std::size_t(1);
+            while (n + count < packets.size() && count < MAX_BATCH &&
+                   (txtime_ || packets[n + count].time <= time + PACING_SLACK)) {
+                ++count;
+            }
+
+            n += send_batch(packets.data() + n, count);
+        }
+    }
+
+    std::size_t send_batch(const packet* packets, std::size_t count)
+    {
+#ifdef __linux__
+        mmsghdr msgs[MAX_BATCH] = {};
+        iovec   iovs[MAX_BATCH] = {};
+#ifdef SO_TXTIME
+        char control[MAX_BATCH][CMSG_SPACE(sizeof(std::uint64_t))] = {};
+
+        // NOTE: Send times are on the steady clock, the qdisc expects them on CLOCK_TAI.
+        std::int64_t offset = 0;
+        if (txtime_) {
+            timespec tai;
+            clock_gettime(CLOCK_TAI, &tai);
+            const auto steady = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now().time_since_epoch())
+                                    .count();
+            offset = static_cast<std::int64_t>(tai.tv_sec) * 1000000000 + tai.tv_nsec - steady;
+        }
+#endif
+
+        for (std::size_t n = 0; n < count; ++n) {
+            iovs[n].iov_base           = const_cast<std::uint8_t*>(packets[n].data);
+            iovs[n].iov_len            = packets[n].size;
+            msgs[n].msg_hdr.msg_iov    = &iovs[n];
+            msgs[n].msg_hdr.msg_iovlen = 1;
+#ifdef SO_TXTIME
+            if (txtime_ && packets[n].time != std::chrono::steady_clock::time_point{}) {
+                const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      packets[n].time.time_since_epoch())
+                                      .count() +
+                                  offset;
+                msgs[n].msg_hdr.msg_control    = control[n];
+                msgs[n].msg_hdr.msg_controllen = sizeof(control[n]);
+                auto cmsg                      = CMSG_FIRSTHDR(&msgs[n].msg_hdr);
+                cmsg->cmsg_level               = SOL_SOCKET;
+                cmsg->cmsg_type                = SCM_TXTIME;
+                cmsg->cmsg_len                 = CMSG_LEN(sizeof(std::uint64_t));
+                const auto txtime              = static_cast<std::uint64_t>(time);
+                std::memcpy(CMSG_DATA(cmsg), &txtime, sizeof(txtime));
+            }
+#endif
+        }
+
+        // NOTE: A full send buffer is retried, so that a burst is delayed instead of dropped.
+        std::size_t sent = 0;
+        while (sent < count) {
+            const auto result = sendmmsg(socket_.native_handle(), msgs + sent, static_cast<unsigned>(count - sent), 0);
+            if (result > 0) {
+                sent += static_cast<std::size_t>(result);
+            } else if (errno == EINTR || errno == EAGAIN || errno == ENOBUFS) {
+                std::this_thread::yield();
+            } else {
+                CASPAR_THROW_EXCEPTION(io_error() << msg_info("Failed to send to " + endpoint_.address().to_string() +
+                                                              ": " + std::strerror(errno)));
+            }
+        }
+#else
+        for (std::size_t n = 0; n < count; ++n) {
+            socket_.send(boost::asio::buffer(packets[n].data, packets[n].size));
+        }
+#endif
+        return count;
+    }
+
+    std::size_t receive(std::vector<std::vector<std::uint8_t>>& buffers,
+                        std::vector<std::size_t>&               sizes,
+                        std::chrono::milliseconds               timeout)
+    {
+        sizes.resize(buffers.size());
+
+#ifdef __linux__
+        pollfd fd = {};
+        fd.fd     = socket_.native_handle();
+        fd.events = POLLIN;
+        if (poll(&fd, 1, static_cast<int>(timeout.count())) <= 0) {
+            return 0;
+        }
+
+        const auto count = std::min(buffers.size(), MAX_BATCH);
+
+        mmsghdr msgs[MAX_BATCH] = {};
+        iovec   iovs[MAX_BATCH] = {};
+        for (std::size_t n = 0; n < count; ++n) {
+            iovs[n].iov_base           = buffers[n].data();
+            iovs[n].iov_len            = buffers[n].size();
+            msgs[n].msg_hdr.msg_iov    = &iovs[n];
+            msgs[n].msg_hdr.msg_iovlen = 1;
+        }
+
+        const auto result =
+            recvmmsg(socket_.native_handle(), msgs, static_cast<unsigned>(count), MSG_DONTWAIT, nullptr);
+        if (result <= 0) {
+            return 0;
+        }
+        for (auto n = 0; n < result; ++n) {
+            sizes[n] = msgs[n].msg_len;
+        }
+        return static_cast<std::size_t>(result);
+#else
+        socket_.non_blocking(true);
+
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        std::size_t count = 0;
+        while (count < buffers.size()) {
+            boost::system::error_code ec;
+            const auto size = socket_.receive(boost::asio::buffer(buffers[count]), 0, ec);
+            if (!ec) {
+                sizes[count++] = size;
+            } else if (ec != boost::asio::error::would_block || count > 0 ||
+                       std::chrono::steady_clock::now() >= deadline) {
+                break;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        return count;
+#endif
+    }
+};
+
+rtp_socket::rtp_socket(const udp::endpoint& endpoint, const std::string& nic, bool sender, int ttl, bool txtime)
+    : impl_(new impl(endpoint, nic, sender, ttl, txtime))
+{
+}
+rtp_socket::~rtp_socket() {}
+void        rtp_socket::send(const std::vector<packet>& packets) { impl_->send(packets); }
+std::size_t rtp_socket::receive(std::vector<std::vector<std::uint8_t>>& buffers,
+                                std::vector<std::size_t>&               sizes,
+                                std::chrono::milliseconds               timeout)
+{
+    return impl_->receive(buffers, sizes, timeout);
+}
+bool rtp_socket::txtime() const { return impl_->txtime_; }
+
+}} // namespace caspar::st2110
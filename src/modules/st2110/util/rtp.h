@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/asio/ip/udp.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace st2110 {
+
+// The RTP fixed header, without CSRCs and extensions, which the flows of ST 2110 do not use.
+struct rtp_header
+{
+    static const std::size_t size = 12;
+
+    bool          marker       = false;
+    int           payload_type = 96;
+    std::uint16_t sequence     = 0;
+    std::uint32_t timestamp    = 0;
+    std::uint32_t ssrc         = 0;
+};
+
+void write_rtp_header(std::uint8_t* dst, const rtp_header& header);
+
+// Reads the header of an RTP packet, returns the offset of its payload or 0 if it is not a valid RTP packet.
+std::size_t read_rtp_header(const std::uint8_t* src, std::size_t size, rtp_header& header);
+
+// The RTP timestamp at clock_rate of time, counted from the epoch of the system clock as ST 2059 counts from the PTP
+// epoch, so that senders with synchronized clocks stamp the same instant alike.
+std::uint32_t rtp_timestamp(std::chrono::system_clock::time_point time, int clock_rate);
+
+// Parses ip:port into an endpoint.
+boost::asio::ip::udp::endpoint parse_endpoint(const std::wstring& address);
+
+// A UDP socket of an RTP flow, which sends to or receives from a unicast or multicast endpoint.
+class rtp_socket
+{
+  public:
+    // A packet to send and the time to send it at, or the default time to send it at once.
+    struct packet
+    {
+        const std::uint8_t*                   data = nullptr;
+        std::size_t                           size = 0;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    // nic is the address of the network interface to send multicast from or join multicast groups on, any
+    // interface if it is empty. txtime hands the send times to the SO_TXTIME qdisc, so that the NIC paces the packets
+    // where it supports launch time, instead of pacing them on the sending thread.
+    rtp_socket(const boost::asio::ip::udp::endpoint& endpoint,
+               const std::string&                    nic,
+               bool                                  sender,
+               int                                   ttl    = 32,
+               bool                                  txtime = false);
+    ~rtp_socket();
+
+    rtp_socket(const rtp_socket&) = delete;
+    rtp_socket& operator=(const rtp_socket&) = delete;
+
+    // Sends packets, in batches of one system call where the platform allows it.
+    void send(const std::vector<packet>& packets);
+
+    // Receives up to buffers.size() packets of at most the size of the buffers, waiting up to timeout for the first.
+    // The sizes of the received packets are written to sizes, their number is returned.
+    std::size_t receive(std::vector<std::vector<std::uint8_t>>& buffers,
+                        std::vector<std::size_t>&               sizes,
+                        std::chrono::milliseconds               timeout);
+
+    bool txtime() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::st2110
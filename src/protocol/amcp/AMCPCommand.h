@@ -23,6 +23,7 @@
 
 #include "../util/ClientInfo.h"
 #include "amcp_shared.h"
+#include "data_store.h"
 #include <core/consumer/frame_consumer.h>
 #include <core/producer/frame_producer.h>
 
@@ -40,6 +41,8 @@ struct command_context
     spl::shared_ptr<core::cg_producer_registry>          cg_registry;
     spl::shared_ptr<const core::frame_producer_registry> producer_registry;
     spl::shared_ptr<const core::frame_consumer_registry> consumer_registry;
+    std::shared_ptr<core::thumbnail_generator>           thumbnail_generator; // Null if not enabled.
+    spl::shared_ptr<data_store>                          data;
     std::function<void(bool)>                            shutdown_server_now;
     std::vector<std::wstring>                            parameters;
     std::string                                          proxy_host;
@@ -55,6 +58,8 @@ struct command_context
                     spl::shared_ptr<core::cg_producer_registry>          cg_registry,
                     spl::shared_ptr<const core::frame_producer_registry> producer_registry,
                     spl::shared_ptr<const core::frame_consumer_registry> consumer_registry,
+                    std::shared_ptr<core::thumbnail_generator>           thumbnail_generator,
+                    spl::shared_ptr<data_store>                          data,
                     std::function<void(bool)>                            shutdown_server_now,
                     std::string                                          proxy_host,
                     std::string                                          proxy_port)
@@ -66,6 +71,8 @@ struct command_context
         , cg_registry(std::move(cg_registry))
         , producer_registry(std::move(producer_registry))
         , consumer_registry(std::move(consumer_registry))
+        , thumbnail_generator(std::move(thumbnail_generator))
+        , data(std::move(data))
         , shutdown_server_now(shutdown_server_now)
         , proxy_host(std::move(proxy_host))
         , proxy_port(std::move(proxy_port))
@@ -86,14 +93,11 @@ class AMCPCommand
     std::wstring      request_id_;
 
   public:
-    AMCPCommand(const command_context&   ctx,
-                const amcp_command_func& command,
-                int                      min_num_params,
-                const std::wstring&      name)
-        : ctx_(ctx)
+    AMCPCommand(command_context ctx, const amcp_command_func& command, int min_num_params, std::wstring name)
+        : ctx_(std::move(ctx))
         , command_(command)
         , min_num_params_(min_num_params)
-        , name_(name)
+        , name_(std::move(name))
     {
     }
 
@@ -119,6 +123,11 @@ class AMCPCommand
 
     IO::ClientInfoPtr client() { return ctx_.client; }
 
+    const command_context& context() const { return ctx_; }
+
+    // The layer the command was addressed to, or -1 for commands to a whole channel or to no channel.
+    int layer_id() const { return ctx_.layer_id; }
+
     std::wstring print() const { return name_; }
 
     void set_request_id(std::wstring request_id) { request_id_ = std::move(request_id); }
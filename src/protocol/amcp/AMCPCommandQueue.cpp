@@ -22,10 +22,14 @@
 #include "../StdAfx.h"
 
 #include "AMCPCommandQueue.h"
+#include "admission.h"
 
 #include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <common/env.h>
 #include <common/except.h>
 
+#include <algorithm>
 #include <cmath>
 
 namespace caspar { namespace protocol { namespace amcp {
@@ -48,9 +52,17 @@ std::map<std::wstring, AMCPCommandQueue*>& get_instances()
 
 } // namespace
 
-AMCPCommandQueue::AMCPCommandQueue(const std::wstring& name)
-    : executor_(L"AMCPCommandQueue " + name)
+AMCPCommandQueue::AMCPCommandQueue(const std::wstring& name, int concurrency)
+    : name_(name)
+    , max_size_(env::properties().get(L"configuration.amcp.max-queue", std::size_t(1024)))
 {
+    for (int n = 0; n < std::max(1, concurrency); ++n) {
+        auto suffix = n == 0 ? L"" : L" " + boost::lexical_cast<std::wstring>(n);
+        workers_.push_back(std::make_unique<executor>(L"AMCPCommandQueue " + name + suffix, executor_mode::strand));
+        running_.push_back(none_);
+        idle_.push_back(workers_.size() - 1);
+    }
+
     std::lock_guard<std::mutex> lock(get_global_mutex());
 
     get_instances().insert(std::make_pair(name, this));
@@ -58,9 +70,19 @@ AMCPCommandQueue::AMCPCommandQueue(const std::wstring& name)
 
 AMCPCommandQueue::~AMCPCommandQueue()
 {
-    std::lock_guard<std::mutex> lock(get_global_mutex());
+    {
+        std::lock_guard<std::mutex> lock(get_global_mutex());
+
+        get_instances().erase(name_);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        waiting_.clear();
+    }
 
-    get_instances().erase(executor_.name());
+    // NOTE: Waits for the running commands, which find nothing left to schedule once they complete.
+    workers_.clear();
 }
 
 void AMCPCommandQueue::AddCommand(AMCPCommand::ptr_type pCurrentCommand)
@@ -68,7 +90,9 @@ void AMCPCommandQueue::AddCommand(AMCPCommand::ptr_type pCurrentCommand)
     if (!pCurrentCommand)
         return;
 
-    if (executor_.size() > 128) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (waiting_.size() >= max_size_) {
         try {
             CASPAR_LOG(error) << "AMCP Command Queue Overflow.";
             CASPAR_LOG(error) << "Failed to execute command:" << pCurrentCommand->print();
@@ -80,47 +104,102 @@ void AMCPCommandQueue::AddCommand(AMCPCommand::ptr_type pCurrentCommand)
         return;
     }
 
-    executor_.begin_invoke([=] {
-        try {
-            try {
-                caspar::timer timer;
-
-                auto print  = pCurrentCommand->print();
-                auto params = boost::join(pCurrentCommand->parameters(), L" ");
-
-                CASPAR_LOG(debug) << "Executing command: " << print;
-
-                if (pCurrentCommand->Execute())
-                    CASPAR_LOG(debug) << "Executed command (" << timer.elapsed() << "s): " << print;
-                else
-                    CASPAR_LOG(warning) << "Failed to execute command: " << print;
-            } catch (file_not_found&) {
-                CASPAR_LOG(error) << " Turn on log level debug for stacktrace.";
-                pCurrentCommand->SetReplyString(L"404 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (expected_user_error&) {
-                pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (user_error&) {
-                CASPAR_LOG(error) << " Check syntax. Turn on log level debug for stacktrace.";
-                pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (std::out_of_range&) {
-                CASPAR_LOG(error) << L"Missing parameter. Check syntax. Turn on log level debug for stacktrace.";
-                pCurrentCommand->SetReplyString(L"402 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (boost::bad_lexical_cast&) {
-                CASPAR_LOG(error) << L"Invalid parameter. Check syntax. Turn on log level debug for stacktrace.";
-                pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-                CASPAR_LOG(error) << "Failed to execute command: " << pCurrentCommand->print();
-                pCurrentCommand->SetReplyString(L"501 " + pCurrentCommand->print() + L" FAILED\r\n");
+    waiting_.push_back(pending_command{pCurrentCommand, pCurrentCommand->layer_id(), caspar::timer()});
+    schedule();
+}
+
+// Starts the waiting commands which neither wait for an earlier command to the same layer, nor for a command
+// without a layer. Called with the mutex held.
+void AMCPCommandQueue::schedule()
+{
+    auto conflicts = [](int layer, int other) { return layer == -1 || other == -1 || layer == other; };
+
+    std::vector<int> ahead;
+    for (auto it = waiting_.begin(); it != waiting_.end() && !idle_.empty();) {
+        auto layer   = it->layer;
+        auto blocked = false;
+        for (auto other : ahead) {
+            blocked = blocked || conflicts(layer, other);
+        }
+        for (auto other : running_) {
+            blocked = blocked || (other != none_ && conflicts(layer, other));
+        }
+
+        if (blocked) {
+            ahead.push_back(layer);
+            if (layer == -1) {
+                break;
             }
+            ++it;
+            continue;
+        }
 
-            pCurrentCommand->SendReply();
+        auto worker = idle_.back();
+        idle_.pop_back();
+        running_[worker] = layer;
+
+        workers_[worker]->begin_invoke(
+            [this, worker, pending = std::move(*it)]() mutable { execute(worker, std::move(pending)); });
+        it = waiting_.erase(it);
+    }
+}
+
+void AMCPCommandQueue::execute(std::size_t worker, pending_command pending)
+{
+    auto pCurrentCommand = pending.command;
+    auto wait_time       = pending.queued.elapsed();
+    auto strand_time     = workers_[worker]->strand_latency();
 
-            CASPAR_LOG(trace) << "Ready for a new command";
+    try {
+        try {
+            caspar::timer timer;
+
+            auto print  = pCurrentCommand->print();
+            auto params = boost::join(pCurrentCommand->parameters(), L" ");
+
+            // NOTE: The time queued includes the time the worker waited for a thread of the pool, see executor_mode.
+            CASPAR_LOG(debug) << "Executing command (queued " << wait_time << "s, strand " << strand_time
+                              << "s): " << print;
+
+            if (pCurrentCommand->Execute())
+                CASPAR_LOG(debug) << "Executed command (queued " << wait_time << "s, executed " << timer.elapsed()
+                                  << "s): " << print;
+            else
+                CASPAR_LOG(warning) << "Failed to execute command: " << print;
+        } catch (file_not_found&) {
+            CASPAR_LOG(error) << " Turn on log level debug for stacktrace.";
+            pCurrentCommand->SetReplyString(L"404 " + pCurrentCommand->print() + L" FAILED\r\n");
+        } catch (admission_refused&) {
+            pCurrentCommand->SetReplyString(L"505 " + pCurrentCommand->print() + L" FAILED\r\n");
+        } catch (expected_user_error&) {
+            pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
+        } catch (user_error&) {
+            CASPAR_LOG(error) << " Check syntax. Turn on log level debug for stacktrace.";
+            pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
+        } catch (std::out_of_range&) {
+            CASPAR_LOG(error) << L"Missing parameter. Check syntax. Turn on log level debug for stacktrace.";
+            pCurrentCommand->SetReplyString(L"402 " + pCurrentCommand->print() + L" FAILED\r\n");
+        } catch (boost::bad_lexical_cast&) {
+            CASPAR_LOG(error) << L"Invalid parameter. Check syntax. Turn on log level debug for stacktrace.";
+            pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
         } catch (...) {
             CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(error) << "Failed to execute command: " << pCurrentCommand->print();
+            pCurrentCommand->SetReplyString(L"501 " + pCurrentCommand->print() + L" FAILED\r\n");
         }
-    });
+
+        pCurrentCommand->SendReply();
+
+        CASPAR_LOG(trace) << "Ready for a new command";
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    running_[worker] = none_;
+    idle_.push_back(worker);
+    schedule();
 }
 
 }}} // namespace caspar::protocol::amcp
@@ -27,10 +27,15 @@
 #include <common/memory.h>
 #include <common/timer.h>
 
+#include <list>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 namespace caspar { namespace protocol { namespace amcp {
 
+// Executes commands in the order they were added for each layer, with commands for different layers running
+// concurrently on up to a number of threads. Commands without a layer wait for, and hold back, all others.
 class AMCPCommandQueue
 {
     AMCPCommandQueue(const AMCPCommandQueue&);
@@ -39,13 +44,33 @@ class AMCPCommandQueue
   public:
     typedef spl::shared_ptr<AMCPCommandQueue> ptr_type;
 
-    AMCPCommandQueue(const std::wstring& name);
+    AMCPCommandQueue(const std::wstring& name, int concurrency = 1);
     ~AMCPCommandQueue();
 
     void AddCommand(AMCPCommand::ptr_type pCommand);
 
   private:
-    executor executor_;
+    struct pending_command
+    {
+        AMCPCommand::ptr_type command;
+        int                   layer;
+        caspar::timer         queued;
+    };
+
+    void schedule();
+    void execute(std::size_t worker, pending_command pending);
+
+    std::wstring name_;
+    std::size_t  max_size_;
+
+    std::mutex                 mutex_;
+    std::list<pending_command> waiting_;
+    std::vector<int>           running_; // The layer of the command each worker runs, or none_.
+    std::vector<std::size_t>   idle_;
+
+    static const int none_ = -2;
+
+    std::vector<std::unique_ptr<executor>> workers_;
 };
 
 }}} // namespace caspar::protocol::amcp
@@ -29,11 +29,14 @@
 
 #include "../util/http_request.h"
 #include "AMCPCommandQueue.h"
+#include "admission.h"
 #include "amcp_command_repository.h"
 
 #include <common/env.h>
+#include <common/executor.h>
 
 #include <common/base64.h>
+#include <common/diagnostics/trace.h>
 #include <common/filesystem.h>
 #include <common/log.h>
 #include <common/os/filesystem.h>
@@ -49,14 +52,18 @@
 #include <core/producer/layer.h>
 #include <core/producer/stage.h>
 #include <core/producer/transition/transition_producer.h>
+#include <core/thumbnail_generator.h>
 #include <core/video_format.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <fstream>
 #include <future>
 #include <locale>
+#include <map>
 #include <memory>
+#include <mutex>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/archive/iterators/base64_from_binary.hpp>
@@ -66,11 +73,8 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/locale.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
-#include <boost/range/adaptor/transformed.hpp>
-#include <boost/range/algorithm/copy.hpp>
 #include <boost/regex.hpp>
 
 #include <tbb/concurrent_unordered_map.h>
@@ -95,6 +99,7 @@
 502 [command] FAILED			could not read file
 503 [command] FAILED			access denied
 504 [command] QUEUE OVERFLOW	command queue overflow
+505 [command] FAILED			memory budget exceeded, see INFO SERVER
 
 600 [command] FAILED	[command] not implemented
 */
@@ -122,68 +127,6 @@ std::wstring read_file_base64(const boost::filesystem::path& file)
     return std::wstring(result.begin(), result.end());
 }
 
-std::wstring read_utf8_file(const boost::filesystem::path& file)
-{
-    std::wstringstream           result;
-    boost::filesystem::wifstream filestream(file);
-
-    if (filestream) {
-        // Consume BOM first
-        filestream.get();
-        // read all data
-        result << filestream.rdbuf();
-    }
-
-    return result.str();
-}
-
-std::wstring read_latin1_file(const boost::filesystem::path& file)
-{
-    boost::locale::generator gen;
-    gen.locale_cache_enabled(true);
-    gen.categories(boost::locale::codepage_facet);
-
-    std::stringstream           result_stream;
-    boost::filesystem::ifstream filestream(file);
-    filestream.imbue(gen("en_US.ISO8859-1"));
-
-    if (filestream) {
-        // read all data
-        result_stream << filestream.rdbuf();
-    }
-
-    std::string  result = result_stream.str();
-    std::wstring widened_result;
-
-    // The first 255 codepoints in unicode is the same as in latin1
-    boost::copy(result | boost::adaptors::transformed([](char c) { return static_cast<unsigned char>(c); }),
-                std::back_inserter(widened_result));
-
-    return widened_result;
-}
-
-std::wstring read_file(const boost::filesystem::path& file)
-{
-    static const uint8_t BOM[] = {0xef, 0xbb, 0xbf};
-
-    if (!boost::filesystem::exists(file)) {
-        return L"";
-    }
-
-    if (boost::filesystem::file_size(file) >= 3) {
-        boost::filesystem::ifstream bom_stream(file);
-
-        char header[3];
-        bom_stream.read(header, 3);
-        bom_stream.close();
-
-        if (std::memcmp(BOM, header, 3) == 0)
-            return read_utf8_file(file);
-    }
-
-    return read_latin1_file(file);
-}
-
 std::wstring get_sub_directory(const std::wstring& base_folder, const std::wstring& sub_directory)
 {
     if (sub_directory.empty())
@@ -216,9 +159,88 @@ core::frame_producer_dependencies get_producer_dependencies(const std::shared_pt
                                              ctx.cg_registry);
 }
 
-// Basic Commands
+// A producer for the background of a layer, created by LOADBG and PLAY but not yet loaded.
+struct background_load
+{
+    spl::shared_ptr<frame_producer> producer = frame_producer::empty();
+    bool                            auto_play = false;
+    int                             duration  = 0;
+};
 
-std::wstring loadbg_command(command_context& ctx)
+// A load which LOADBG ... ASYNC has started but not finished.
+struct pending_load
+{
+    unsigned                 id;
+    std::shared_future<void> loaded;
+};
+
+std::mutex& pending_loads_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+// By channel and layer, only used with pending_loads_mutex held.
+std::map<std::pair<int, int>, pending_load>& pending_loads()
+{
+    static std::map<std::pair<int, int>, pending_load> loads;
+    return loads;
+}
+
+admission& load_admission()
+{
+    static admission instance;
+    return instance;
+}
+
+// Html producers are recognized as in create_cg_producer, everything else is estimated as a clip.
+admission::footprint estimate_load(const command_context& ctx)
+{
+    const auto  format_desc = ctx.channel.channel->video_format_desc();
+    const auto& name        = ctx.parameters.at(0);
+    if (boost::iequals(name, L"[HTML]") || boost::istarts_with(name, L"http:") ||
+        boost::istarts_with(name, L"https:") || find_case_insensitive(env::template_folder() + name + L".html")) {
+        return load_admission().html(format_desc);
+    }
+    return load_admission().clip(format_desc);
+}
+
+admission::reservation admit_load(const command_context& ctx)
+{
+    return load_admission().admit(ctx.channels, ctx.channel.channel, ctx.layer_index(), estimate_load(ctx));
+}
+
+// NOTE: Commands which touch the background of a layer wait for its asynchronous load, so that e.g. a PLAY sent after
+// LOADBG ... ASYNC plays what was loaded.
+void wait_for_pending_load(const command_context& ctx)
+{
+    std::shared_future<void> load;
+    {
+        std::lock_guard<std::mutex> lock(pending_loads_mutex());
+        auto it = pending_loads().find(std::make_pair(ctx.channel_index, ctx.layer_index()));
+        if (it == pending_loads().end())
+            return;
+        load = it->second.loaded;
+    }
+    load.wait();
+}
+
+// Producers are opened by a pool of threads, so that slow opens, e.g. of network streams, run in parallel.
+executor& load_executor()
+{
+    static std::vector<std::unique_ptr<executor>> executors = [] {
+        std::vector<std::unique_ptr<executor>> result;
+        auto threads = std::max(1, env::properties().get(L"configuration.amcp.load-threads", 8));
+        for (int n = 0; n < threads; ++n)
+            result.push_back(std::make_unique<executor>(L"AMCP load " + boost::lexical_cast<std::wstring>(n)));
+        return result;
+    }();
+    static std::atomic<unsigned> next{0};
+
+    return *executors[next++ % executors.size()];
+}
+
+background_load create_background(command_context& ctx)
 {
     transition_info transitionInfo;
 
@@ -229,7 +251,7 @@ std::wstring loadbg_command(command_context& ctx)
         message += boost::to_upper_copy(ctx.parameters[n]) + L" ";
 
     static const boost::wregex expr(
-        LR"(.*(?<TRANSITION>CUT|PUSH|SLIDE|WIPE|MIX)\s*(?<DURATION>\d+)\s*(?<TWEEN>(LINEAR)|(EASE[^\s]*))?\s*(?<DIRECTION>FROMLEFT|FROMRIGHT|LEFT|RIGHT)?.*)");
+        LR"(.*(?<TRANSITION>CUT|PUSH|SLIDE|WIPE|MIX|LUMA|STING)\s*(?<DURATION>\d+)\s*(?<TWEEN>(LINEAR)|(EASE[^\s]*))?\s*(?<DIRECTION>FROMLEFT|FROMRIGHT|LEFT|RIGHT)?.*)");
     boost::wsmatch what;
     if (boost::regex_match(message, what, expr)) {
         auto transition         = what["TRANSITION"].str();
@@ -248,6 +270,10 @@ std::wstring loadbg_command(command_context& ctx)
             transitionInfo.type = transition_type::slide;
         else if (transition == L"WIPE")
             transitionInfo.type = transition_type::wipe;
+        else if (transition == L"LUMA")
+            transitionInfo.type = transition_type::luma;
+        else if (transition == L"STING")
+            transitionInfo.type = transition_type::sting;
 
         if (direction == L"FROMLEFT")
             transitionInfo.direction = transition_direction::from_left;
@@ -270,19 +296,131 @@ std::wstring loadbg_command(command_context& ctx)
     if (pFP == frame_producer::empty())
         CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters.size() > 0 ? ctx.parameters[0] : L""));
 
-    bool auto_play = contains_param(L"AUTO", ctx.parameters);
+    // LUMA <duration> [<tween>] MATTE <matte> [SOFTNESS <softness>]
+    if (transitionInfo.type == transition_type::luma) {
+        auto matte    = get_param(L"MATTE", ctx.parameters);
+        auto producer = matte.empty() ? frame_producer::empty()
+                                      : ctx.producer_registry->create_producer(
+                                            get_producer_dependencies(channel, ctx), std::vector<std::wstring>{matte});
+        if (producer == frame_producer::empty())
+            CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"Could not open luma matte " + matte));
+
+        transitionInfo.matte    = producer;
+        transitionInfo.softness = get_param(L"SOFTNESS", ctx.parameters, 0.1);
+    }
 
-    auto pFP2 = create_transition_producer(pFP, transitionInfo);
-    if (auto_play)
-        channel->stage().load(ctx.layer_index(), pFP2, false, transitionInfo.duration); // TODO: LOOP
+    // STING <duration> STINGER <clip> [TRIGGER <frame>] [AUDIO FADE|CUT], a duration of 0 plays the whole stinger
+    if (transitionInfo.type == transition_type::sting) {
+        auto stinger = get_param(L"STINGER", ctx.parameters);
+        auto frames  = stinger.empty() ? nullptr : load_stinger(stinger, channel->video_format_desc(), [&] {
+            return ctx.producer_registry->create_producer(get_producer_dependencies(channel, ctx),
+                                                          std::vector<std::wstring>{stinger});
+        });
+        if (!frames)
+            CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"Could not open stinger " + stinger));
+
+        if (transitionInfo.duration == 0)
+            transitionInfo.duration = static_cast<int>(frames->size());
+
+        transitionInfo.stinger    = frames;
+        transitionInfo.trigger    = get_param(L"TRIGGER", ctx.parameters, static_cast<int>(frames->size()) / 2);
+        transitionInfo.audio_fade = !boost::iequals(get_param(L"AUDIO", ctx.parameters), L"CUT");
+    }
+
+    background_load result;
+    result.producer  = create_transition_producer(pFP, transitionInfo);
+    result.auto_play = contains_param(L"AUTO", ctx.parameters);
+    result.duration  = transitionInfo.duration;
+    return result;
+}
+
+void load_background(command_context& ctx, const background_load& load)
+{
+    auto& stage = ctx.channel.channel->stage();
+    if (load.auto_play)
+        stage.load(ctx.layer_index(), load.producer, false, load.duration); // TODO: LOOP
     else
-        channel->stage().load(ctx.layer_index(), pFP2, false); // TODO: LOOP
+        stage.load(ctx.layer_index(), load.producer, false); // TODO: LOOP
+}
+
+// LOADBG ... ASYNC replies at once and opens the producer on the load threads. The client is sent READY once it has
+// been loaded, or FAILED.
+std::wstring loadbg_async(command_context& ctx)
+{
+    auto key  = std::make_pair(ctx.channel_index, ctx.layer_index());
+    auto spec = boost::lexical_cast<std::wstring>(ctx.channel_index + 1) + L"-" +
+                boost::lexical_cast<std::wstring>(ctx.layer_index());
+
+    static std::atomic<unsigned> next_id{0};
+
+    auto reservation = std::make_shared<admission::reservation>(admit_load(ctx));
+
+    std::lock_guard<std::mutex> lock(pending_loads_mutex());
+
+    // NOTE: Loads of the same layer are chained, so that the one sent last is loaded last.
+    auto it       = pending_loads().find(key);
+    auto previous = it != pending_loads().end() ? it->second.loaded : std::shared_future<void>();
+    auto id       = ++next_id;
+
+    auto load = [ctx, key, spec, previous, id, reservation]() mutable {
+        if (previous.valid())
+            previous.wait();
+
+        core::diagnostics::scoped_call_context save;
+        core::diagnostics::call_context::for_thread().video_channel = ctx.channel_index + 1;
+        core::diagnostics::call_context::for_thread().layer         = ctx.layer_index();
+
+        std::wstring reply;
+        try {
+            auto background = create_background(ctx);
+            load_background(ctx, background);
+            reservation->commit(background.producer);
+            reply = L"202 LOADBG " + spec + L" READY\r\n";
+        } catch (file_not_found&) {
+            reply = L"404 LOADBG " + spec + L" FAILED\r\n";
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            reply = L"501 LOADBG " + spec + L" FAILED\r\n";
+        }
+        ctx.client->send(std::move(reply));
+
+        std::lock_guard<std::mutex> lock(pending_loads_mutex());
+        auto                        it = pending_loads().find(key);
+        if (it != pending_loads().end() && it->second.id == id)
+            pending_loads().erase(it);
+    };
+
+    pending_loads()[key] = pending_load{id, load_executor().begin_invoke(std::move(load)).share()};
+
+    return L"202 LOADBG OK\r\n";
+}
+
+// Basic Commands
+
+std::wstring loadbg_command(command_context& ctx)
+{
+    wait_for_pending_load(ctx);
+
+    auto async = std::find_if(ctx.parameters.begin(), ctx.parameters.end(), [](const std::wstring& param) {
+        return boost::iequals(param, L"ASYNC");
+    });
+    if (async != ctx.parameters.end()) {
+        ctx.parameters.erase(async);
+        return loadbg_async(ctx);
+    }
+
+    auto reservation = admit_load(ctx);
+    auto background  = create_background(ctx);
+    load_background(ctx, background);
+    reservation.commit(background.producer);
 
     return L"202 LOADBG OK\r\n";
 }
 
 std::wstring load_command(command_context& ctx)
 {
+    wait_for_pending_load(ctx);
+
     core::diagnostics::scoped_call_context save;
     core::diagnostics::call_context::for_thread().video_channel = ctx.channel_index + 1;
     core::diagnostics::call_context::for_thread().layer         = ctx.layer_index();
@@ -295,11 +433,27 @@ std::wstring load_command(command_context& ctx)
     return L"202 LOAD OK\r\n";
 }
 
+std::wstring preload_command(command_context& ctx)
+{
+    // NOTE: The producer is created and dropped, producers which cache what they load, e.g. stills, then start
+    // without loading when they are played.
+    auto producer =
+        ctx.producer_registry->create_producer(get_producer_dependencies(ctx.channel.channel, ctx), ctx.parameters);
+
+    if (producer == frame_producer::empty())
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters.size() > 0 ? ctx.parameters[0] : L""));
+
+    return L"202 PRELOAD OK\r\n";
+}
+
 std::wstring play_command(command_context& ctx)
 {
     if (!ctx.parameters.empty())
         loadbg_command(ctx);
 
+    // NOTE: Also waits for PLAY ... ASYNC, which is only asynchronous up to the play.
+    wait_for_pending_load(ctx);
+
     ctx.channel.channel->stage().play(ctx.layer_index());
 
     return L"202 PLAY OK\r\n";
@@ -443,55 +597,32 @@ std::wstring set_command(command_context& ctx)
         CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video mode"));
     }
 
+    // SET 1-10 PRIORITY -1, layers of negative priority are shed while the channel is overloaded.
+    if (name == L"PRIORITY") {
+        ctx.channel.channel->layer_priority(ctx.layer_index(), boost::lexical_cast<int>(value));
+        return L"202 SET PRIORITY OK\r\n";
+    }
+
     CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid channel variable"));
 }
 
+// NOTE: The data is kept in memory by ctx.data, which writes it to the .ftd files of the data folder in the
+// background.
+
 std::wstring data_store_command(command_context& ctx)
 {
-    std::wstring filename = env::data_folder();
-    filename.append(ctx.parameters[0]);
-    filename.append(L".ftd");
-
-    auto data_path       = boost::filesystem::path(filename).parent_path().wstring();
-    auto found_data_path = find_case_insensitive(data_path);
-
-    if (found_data_path)
-        data_path = *found_data_path;
-
-    if (!boost::filesystem::exists(data_path))
-        boost::filesystem::create_directories(data_path);
-
-    auto found_filename = find_case_insensitive(filename);
-
-    if (found_filename)
-        filename = *found_filename; // Overwrite case insensitive.
-
-    boost::filesystem::wofstream datafile(filename);
-    if (!datafile)
-        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not open file " + filename));
-
-    datafile << static_cast<wchar_t>(65279); // UTF-8 BOM character
-    datafile << ctx.parameters[1] << std::flush;
-    datafile.close();
+    ctx.data->store(ctx.parameters[0], ctx.parameters[1]);
 
     return L"202 DATA STORE OK\r\n";
 }
 
 std::wstring data_retrieve_command(command_context& ctx)
 {
-    std::wstring filename = env::data_folder();
-    filename.append(ctx.parameters[0]);
-    filename.append(L".ftd");
-
-    std::wstring file_contents;
-
-    auto found_file = find_case_insensitive(filename);
-
-    if (found_file)
-        file_contents = read_file(boost::filesystem::path(*found_file));
+    auto file_contents = ctx.data->retrieve(ctx.parameters[0]).get_value_or(L"");
 
     if (file_contents.empty())
-        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(filename + L" not found"));
+        CASPAR_THROW_EXCEPTION(file_not_found()
+                               << msg_info(env::data_folder() + ctx.parameters[0] + L".ftd not found"));
 
     std::wstringstream reply;
     reply << L"201 DATA RETRIEVE OK\r\n";
@@ -520,6 +651,9 @@ std::wstring data_list_command(command_context& ctx)
     if (!ctx.parameters.empty())
         sub_directory = ctx.parameters.at(0);
 
+    // The files of data which has been stored, but not yet written, are listed as well.
+    ctx.data->flush();
+
     std::wstringstream replyString;
     replyString << L"200 DATA LIST OK\r\n";
 
@@ -547,21 +681,45 @@ std::wstring data_list_command(command_context& ctx)
 
 std::wstring data_remove_command(command_context& ctx)
 {
-    std::wstring filename = env::data_folder();
-    filename.append(ctx.parameters[0]);
-    filename.append(L".ftd");
-
-    if (!boost::filesystem::exists(filename))
-        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(filename + L" not found"));
-
-    if (!boost::filesystem::remove(filename))
-        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(filename + L" could not be removed"));
+    if (!ctx.data->remove(ctx.parameters[0]))
+        CASPAR_THROW_EXCEPTION(file_not_found()
+                               << msg_info(env::data_folder() + ctx.parameters[0] + L".ftd not found"));
 
     return L"202 DATA REMOVE OK\r\n";
 }
 
 // Template Graphics Commands
 
+std::wstring cg_data_subscriber(command_context& ctx, int layer)
+{
+    return L"cg " + std::to_wstring(ctx.channel.channel->index()) + L"-" +
+           std::to_wstring(ctx.layer_index(core::cg_proxy::DEFAULT_LAYER)) + L"-" + std::to_wstring(layer);
+}
+
+// NOTE: A template given stored data is updated whenever that data is stored again, for as long as the producer it
+// was added to stays on the layer.
+void subscribe_cg_data(command_context& ctx, int layer, const std::wstring& name)
+{
+    auto render_layer = ctx.layer_index(core::cg_proxy::DEFAULT_LAYER);
+    auto weak_channel = std::weak_ptr<core::video_channel>(ctx.channel.channel);
+    auto cg_registry  = ctx.cg_registry;
+
+    std::weak_ptr<core::frame_producer> producer = ctx.channel.channel->stage().foreground(render_layer).get();
+
+    ctx.data->subscribe(cg_data_subscriber(ctx, layer), name, [=](const std::wstring& data) {
+        auto channel = weak_channel.lock();
+        if (!channel)
+            return false;
+
+        auto current = channel->stage().foreground(render_layer).get();
+        if (!current || current != producer.lock())
+            return false;
+
+        cg_registry->get_proxy(spl::make_shared_ptr(current))->update(layer, data);
+        return true;
+    });
+}
+
 std::wstring cg_add_command(command_context& ctx)
 {
     // CG 1 ADD 0 "template_folder/templatename" [STARTLABEL] 0/1 [DATA]
@@ -583,30 +741,37 @@ std::wstring cg_add_command(command_context& ctx)
 
     const wchar_t* pDataString = 0;
     std::wstring   dataFromFile;
+    std::wstring   dataName;
     if (ctx.parameters.size() > dataIndex) { // read data
         const std::wstring& dataString = ctx.parameters.at(dataIndex);
 
         if (dataString.at(0) == L'<' || dataString.at(0) == L'{') // the data is XML or Json
             pDataString = dataString.c_str();
         else {
-            // The data is not an XML-string, it must be a filename
-            std::wstring filename = env::data_folder();
-            filename.append(dataString);
-            filename.append(L".ftd");
+            // The data is not an XML-string, it must be the name of stored data
+            auto data = ctx.data->retrieve(dataString);
 
-            auto found_file = find_case_insensitive(filename);
-
-            if (found_file) {
-                dataFromFile = read_file(boost::filesystem::path(*found_file));
+            if (data) {
+                dataFromFile = *data;
                 pDataString  = dataFromFile.c_str();
             }
+            dataName = dataString;
         }
     }
 
     auto filename = ctx.parameters.at(1);
-    auto proxy    = ctx.cg_registry->get_or_create_proxy(spl::make_shared_ptr(ctx.channel.channel),
+
+    auto render_layer = ctx.layer_index(core::cg_proxy::DEFAULT_LAYER);
+
+    // NOTE: The template is counted as a new producer unless the one on the layer is reused.
+    auto& stage       = ctx.channel.channel->stage();
+    auto  footprint   = load_admission().html(ctx.channel.channel->video_format_desc());
+    auto  reservation = load_admission().admit(ctx.channels, ctx.channel.channel, render_layer, footprint);
+    auto  previous    = stage.foreground(render_layer).get();
+
+    auto proxy = ctx.cg_registry->get_or_create_proxy(spl::make_shared_ptr(ctx.channel.channel),
                                                       get_producer_dependencies(ctx.channel.channel, ctx),
-                                                      ctx.layer_index(core::cg_proxy::DEFAULT_LAYER),
+                                                      render_layer,
                                                       filename);
 
     if (proxy == core::cg_proxy::empty())
@@ -614,6 +779,15 @@ std::wstring cg_add_command(command_context& ctx)
     else
         proxy->add(layer, filename, bDoStart, label, (pDataString != 0) ? pDataString : L"");
 
+    auto current = stage.foreground(render_layer).get();
+    if (current != previous)
+        reservation.commit(current);
+
+    if (dataName.empty())
+        ctx.data->unsubscribe(cg_data_subscriber(ctx, layer));
+    else
+        subscribe_cg_data(ctx, layer, dataName);
+
     return L"202 CG OK\r\n";
 }
 
@@ -658,6 +832,7 @@ std::wstring cg_remove_command(command_context& ctx)
 {
     int layer = boost::lexical_cast<int>(ctx.parameters.at(0));
     get_expected_cg_proxy(ctx)->remove(layer);
+    ctx.data->unsubscribe(cg_data_subscriber(ctx, layer));
 
     return L"202 CG OK\r\n";
 }
@@ -674,17 +849,20 @@ std::wstring cg_update_command(command_context& ctx)
     int layer = boost::lexical_cast<int>(ctx.parameters.at(0));
 
     std::wstring dataString = ctx.parameters.at(1);
+    std::wstring dataName;
     if (dataString.at(0) != L'<' && dataString.at(0) != L'{') {
-        // The data is not XML or Json, it must be a filename
-        std::wstring filename = env::data_folder();
-        filename.append(dataString);
-        filename.append(L".ftd");
-
-        dataString = read_file(boost::filesystem::path(filename));
+        // The data is not XML or Json, it must be the name of stored data
+        dataName   = dataString;
+        dataString = ctx.data->retrieve(dataName).get_value_or(L"");
     }
 
     get_expected_cg_proxy(ctx)->update(layer, dataString);
 
+    if (dataName.empty())
+        ctx.data->unsubscribe(cg_data_subscriber(ctx, layer));
+    else
+        subscribe_cg_data(ctx, layer, dataName);
+
     return L"202 CG OK\r\n";
 }
 
@@ -714,43 +892,88 @@ std::wstring reply_value(command_context& ctx, const Func& extractor)
     return L"201 MIXER OK\r\n" + boost::lexical_cast<std::wstring>(value) + L"\r\n";
 }
 
+// MIXER ... [KEYFRAME] [DEFER], KEYFRAME appends the tween to the animation of the layer, to start once the tweens
+// before it have completed, rather than replacing the animation.
 class transforms_applier
 {
-    static tbb::concurrent_unordered_map<int, std::vector<stage::transform_tuple_t>> deferred_transforms_;
+    typedef tbb::concurrent_unordered_map<int, std::vector<stage::transform_tuple_t>> deferred_t;
+
+    static deferred_t deferred_transforms_;
+    static deferred_t deferred_keyframes_;
 
     std::vector<stage::transform_tuple_t> transforms_;
     command_context&                      ctx_;
-    bool                                  defer_;
+    bool                                  defer_    = false;
+    bool                                  keyframe_ = false;
 
   public:
     transforms_applier(command_context& ctx)
         : ctx_(ctx)
     {
-        defer_ = !ctx.parameters.empty() && boost::iequals(ctx.parameters.back(), L"DEFER");
-
-        if (defer_)
+        while (!ctx.parameters.empty()) {
+            if (boost::iequals(ctx.parameters.back(), L"DEFER"))
+                defer_ = true;
+            else if (boost::iequals(ctx.parameters.back(), L"KEYFRAME"))
+                keyframe_ = true;
+            else
+                break;
             ctx.parameters.pop_back();
+        }
     }
 
     void add(stage::transform_tuple_t&& transform) { transforms_.push_back(std::move(transform)); }
 
-    void commit_deferred()
+    // Commits the deferred transforms of the channel and of the other channels, all at the same tick. Transforms
+    // replacing animations are applied before keyframes.
+    void commit_deferred(const std::vector<int>& other_channel_indices)
     {
-        auto& transforms = deferred_transforms_[ctx_.channel_index];
-        ctx_.channel.channel->stage().apply_transforms(transforms).get();
-        transforms.clear();
+        if (other_channel_indices.empty()) {
+            auto& stage = ctx_.channel.channel->stage();
+            stage.apply_transforms(take(deferred_transforms_, ctx_.channel_index));
+            stage.append_transforms(take(deferred_keyframes_, ctx_.channel_index)).get();
+            return;
+        }
+
+        std::vector<int> channel_indices{ctx_.channel_index};
+        channel_indices.insert(channel_indices.end(), other_channel_indices.begin(), other_channel_indices.end());
+
+        // NOTE: Ticks are counted per channel, so each channel gets its own target, read here at about the same
+        // time. The tick after the next leaves a frame of headroom for the channels to receive the transforms.
+        std::vector<std::future<void>> futures;
+        for (auto index : channel_indices) {
+            auto& stage        = ctx_.channels.at(index).channel->stage();
+            auto  frame_number = stage.frame_number() + 1;
+            stage.apply_transforms(take(deferred_transforms_, index), frame_number);
+            futures.push_back(stage.append_transforms(take(deferred_keyframes_, index), frame_number));
+        }
+        for (auto& future : futures) {
+            future.get();
+        }
     }
 
     void apply()
     {
         if (defer_) {
-            auto& defer_tranforms = deferred_transforms_[ctx_.channel_index];
-            defer_tranforms.insert(defer_tranforms.end(), transforms_.begin(), transforms_.end());
-        } else
-            ctx_.channel.channel->stage().apply_transforms(transforms_);
+            auto& deferred = (keyframe_ ? deferred_keyframes_ : deferred_transforms_)[ctx_.channel_index];
+            deferred.insert(deferred.end(),
+                            std::make_move_iterator(transforms_.begin()),
+                            std::make_move_iterator(transforms_.end()));
+        } else if (keyframe_)
+            ctx_.channel.channel->stage().append_transforms(std::move(transforms_));
+        else
+            ctx_.channel.channel->stage().apply_transforms(std::move(transforms_));
+    }
+
+  private:
+    static std::vector<stage::transform_tuple_t> take(deferred_t& deferred, int channel_index)
+    {
+        std::vector<stage::transform_tuple_t> transforms;
+        std::swap(transforms, deferred[channel_index]);
+        return transforms;
     }
 };
-tbb::concurrent_unordered_map<int, std::vector<stage::transform_tuple_t>> transforms_applier::deferred_transforms_;
+transforms_applier::deferred_t transforms_applier::deferred_transforms_;
+transforms_applier::deferred_t transforms_applier::deferred_keyframes_;
 
 std::wstring mixer_keyer_command(command_context& ctx)
 {
@@ -1192,8 +1415,19 @@ std::wstring mixer_grid_command(command_context& ctx)
 
 std::wstring mixer_commit_command(command_context& ctx)
 {
+    // MIXER [channel] COMMIT [<channel>...], transforms of several channels are committed to the same tick
     transforms_applier transforms(ctx);
-    transforms.commit_deferred();
+
+    std::vector<int> channel_indices;
+    for (auto& param : ctx.parameters) {
+        auto index = boost::lexical_cast<int>(param) - 1;
+        if (index < 0 || index >= static_cast<int>(ctx.channels.size()))
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid channel " + param));
+        if (index != ctx.channel_index)
+            channel_indices.push_back(index);
+    }
+
+    transforms.commit_deferred(channel_indices);
 
     return L"202 MIXER OK\r\n";
 }
@@ -1253,9 +1487,18 @@ std::wstring channel_grid_command(command_context& ctx)
 
 // Thumbnail Commands
 
-std::wstring make_request(command_context& ctx, const std::string path, const std::wstring default_response)
+// NOTE: Cacheable requests are answered from a short lived cache, so that clients listing the media repeatedly do
+// not each wait for the media scanner to respond.
+std::wstring make_request(command_context&   ctx,
+                          const std::string  path,
+                          const std::wstring default_response,
+                          bool               cacheable = false)
 {
-    auto res = http::request(ctx.proxy_host, ctx.proxy_port, path);
+    auto timeout = std::chrono::milliseconds(env::properties().get(L"configuration.amcp.media-server.timeout", 30000));
+    auto ttl     = std::chrono::milliseconds(env::properties().get(L"configuration.amcp.media-server.cache-ttl", 2000));
+
+    auto res = cacheable && ttl.count() > 0 ? http::cached_request(ctx.proxy_host, ctx.proxy_port, path, ttl, timeout)
+                                            : http::request(ctx.proxy_host, ctx.proxy_port, path, timeout);
     if (res.status_code >= 500 || res.body.size() == 0) {
         CASPAR_LOG(error) << "Failed to connect to media-scanner. Is it running? \nReason: " << res.status_message;
         return default_response;
@@ -1263,26 +1506,59 @@ std::wstring make_request(command_context& ctx, const std::string path, const st
     return u16(res.body);
 }
 
+// NOTE: With thumbnails.enabled the thumbnail commands are served by the thumbnail generator of the server instead of
+// the media scanner, in the same reply formats.
+
 std::wstring thumbnail_list_command(command_context& ctx)
 {
-    return make_request(ctx, "/thumbnail", L"501 THUMBNAIL LIST FAILED\r\n");
+    if (!ctx.thumbnail_generator)
+        return make_request(ctx, "/thumbnail", L"501 THUMBNAIL LIST FAILED\r\n");
+
+    std::wstringstream reply;
+    reply << L"200 THUMBNAIL LIST OK\r\n";
+
+    for (auto& thumbnail : ctx.thumbnail_generator->list()) {
+        auto modified = boost::posix_time::from_time_t(boost::filesystem::last_write_time(thumbnail.path));
+        reply << L"\"" << thumbnail.name << L"\" " << boost::posix_time::to_iso_wstring(modified) << L" "
+              << boost::filesystem::file_size(thumbnail.path) << L"\r\n";
+    }
+
+    reply << L"\r\n";
+    return reply.str();
 }
 
 std::wstring thumbnail_retrieve_command(command_context& ctx)
 {
-    return make_request(
-        ctx, "/thumbnail/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 THUMBNAIL RETRIEVE FAILED\r\n");
+    if (!ctx.thumbnail_generator)
+        return make_request(
+            ctx, "/thumbnail/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 THUMBNAIL RETRIEVE FAILED\r\n");
+
+    auto path = ctx.thumbnail_generator->find(ctx.parameters.at(0));
+    auto data = path.empty() ? L"" : read_file_base64(path);
+    if (data.empty())
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"No thumbnail of " + ctx.parameters.at(0)));
+
+    return L"201 THUMBNAIL RETRIEVE OK\r\n" + data + L"\r\n";
 }
 
 std::wstring thumbnail_generate_command(command_context& ctx)
 {
-    return make_request(
-        ctx, "/thumbnail/generate/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 THUMBNAIL GENERATE FAILED\r\n");
+    if (!ctx.thumbnail_generator)
+        return make_request(ctx,
+                            "/thumbnail/generate/" + http::url_encode(u8(ctx.parameters.at(0))),
+                            L"501 THUMBNAIL GENERATE FAILED\r\n");
+
+    ctx.thumbnail_generator->generate(ctx.parameters.at(0)).get();
+    return L"202 THUMBNAIL GENERATE OK\r\n";
 }
 
 std::wstring thumbnail_generateall_command(command_context& ctx)
 {
-    return make_request(ctx, "/thumbnail/generate", L"501 THUMBNAIL GENERATE_ALL FAILED\r\n");
+    if (!ctx.thumbnail_generator)
+        return make_request(ctx, "/thumbnail/generate", L"501 THUMBNAIL GENERATE_ALL FAILED\r\n");
+
+    ctx.thumbnail_generator->generate_all();
+    return L"202 THUMBNAIL GENERATE_ALL OK\r\n";
 }
 
 // Query Commands
@@ -1292,11 +1568,11 @@ std::wstring cinf_command(command_context& ctx)
     return make_request(ctx, "/cinf/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 CINF FAILED\r\n");
 }
 
-std::wstring cls_command(command_context& ctx) { return make_request(ctx, "/cls", L"501 CLS FAILED\r\n"); }
+std::wstring cls_command(command_context& ctx) { return make_request(ctx, "/cls", L"501 CLS FAILED\r\n", true); }
 
-std::wstring fls_command(command_context& ctx) { return make_request(ctx, "/fls", L"501 FLS FAILED\r\n"); }
+std::wstring fls_command(command_context& ctx) { return make_request(ctx, "/fls", L"501 FLS FAILED\r\n", true); }
 
-std::wstring tls_command(command_context& ctx) { return make_request(ctx, "/tls", L"501 TLS FAILED\r\n"); }
+std::wstring tls_command(command_context& ctx) { return make_request(ctx, "/tls", L"501 TLS FAILED\r\n", true); }
 
 std::wstring version_command(command_context& ctx) { return L"201 VERSION OK\r\n" + env::version() + L"\r\n"; }
 
@@ -1331,16 +1607,11 @@ struct param_visitor : public boost::static_visitor<void>
     void operator()(const std::wstring& value) { o.add(path, value); }
 };
 
-std::wstring info_channel_command(command_context& ctx)
+std::wstring info_xml(const core::monitor::state& state, const std::wstring& root)
 {
-    std::wstringstream replyString;
-    // This is needed for backwards compatibility with old clients
-    replyString << L"201 INFO OK\r\n";
-
     pt::wptree info;
     pt::wptree channel_info;
 
-    auto state = ctx.channel.channel->state();
     for (const auto& p : state) {
         const auto    path = boost::algorithm::replace_all_copy(p.first, "/", ".");
         param_visitor param_visitor(path, channel_info);
@@ -1349,7 +1620,81 @@ std::wstring info_channel_command(command_context& ctx)
         }
     }
 
-    info.add_child(L"channel", channel_info);
+    info.add_child(root, channel_info);
+
+    std::wstringstream                    xml;
+    pt::xml_writer_settings<std::wstring> w(' ', 3);
+    pt::xml_parser::write_xml(xml, info, w);
+    return xml.str();
+}
+
+// NOTE: The xml of a channel is built from the state snapshot of its last tick and kept until the state changes, so
+// that clients polling INFO on the same tick share one serialization and never wait on the channel.
+std::wstring cached_channel_info_xml(const std::shared_ptr<core::video_channel>& channel)
+{
+    struct entry
+    {
+        std::weak_ptr<core::video_channel>  channel;
+        std::uint64_t                       revision = 0;
+        std::shared_ptr<const std::wstring> xml;
+    };
+
+    static std::mutex           mutex;
+    static std::map<int, entry> cache;
+
+    const auto revision = channel->state_revision();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto&                       cached = cache[channel->index()];
+        if (cached.xml && cached.revision == revision && cached.channel.lock() == channel) {
+            return *cached.xml;
+        }
+    }
+
+    const auto state = channel->state();
+    auto       xml   = std::make_shared<const std::wstring>(info_xml(state, L"channel"));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto&                       cached = cache[channel->index()];
+    if (!cached.xml || cached.channel.lock() != channel || cached.revision < state.revision()) {
+        cached = entry{channel, state.revision(), xml};
+    }
+    return *xml;
+}
+
+std::wstring info_channel_command(command_context& ctx)
+{
+    // This is needed for backwards compatibility with old clients
+    return L"201 INFO OK\r\n" + cached_channel_info_xml(ctx.channel.channel) + L"\r\n";
+}
+
+std::wstring info_profile_command(command_context& ctx)
+{
+    std::wstringstream replyString;
+    replyString << L"201 INFO PROFILE OK\r\n";
+
+    pt::wptree info;
+    pt::wptree profile_info;
+
+    static const std::vector<std::string> names = {"last", "average", "max"};
+
+    auto profile = ctx.channel.channel->profile();
+    for (const auto& p : profile) {
+        const auto path = boost::algorithm::replace_all_copy(p.first, "/", ".");
+        if (p.second.size() == names.size()) {
+            for (std::size_t n = 0; n < names.size(); ++n) {
+                param_visitor param_visitor(path + "." + names[n], profile_info);
+                boost::apply_visitor(param_visitor, p.second[n]);
+            }
+        } else {
+            param_visitor param_visitor(path, profile_info);
+            for (const auto& element : p.second) {
+                boost::apply_visitor(param_visitor, element);
+            }
+        }
+    }
+
+    info.add_child(L"profile", profile_info);
 
     pt::xml_writer_settings<std::wstring> w(' ', 3);
     pt::xml_parser::write_xml(replyString, info, w);
@@ -1371,6 +1716,12 @@ std::wstring info_command(command_context& ctx)
     return replyString.str();
 }
 
+// The memory budgets of LOADBG and CG ADD, and the headroom left in them.
+std::wstring info_server_command(command_context& ctx)
+{
+    return L"201 INFO SERVER OK\r\n" + info_xml(load_admission().state(ctx.channels), L"server") + L"\r\n";
+}
+
 std::wstring diag_command(command_context& ctx)
 {
     core::diagnostics::osd::show_graphs(true);
@@ -1378,6 +1729,32 @@ std::wstring diag_command(command_context& ctx)
     return L"202 DIAG OK\r\n";
 }
 
+std::wstring diag_trace_command(command_context& ctx)
+{
+    auto action = boost::to_upper_copy(ctx.parameters.at(0));
+
+    if (action == L"START") {
+        caspar::diagnostics::trace::enable(true);
+        return L"202 DIAG TRACE OK\r\n";
+    }
+    if (action == L"STOP") {
+        caspar::diagnostics::trace::enable(false);
+        return L"202 DIAG TRACE OK\r\n";
+    }
+    if (action == L"DUMP") {
+        auto path = ctx.parameters.size() > 1
+                        ? ctx.parameters.at(1)
+                        : env::log_folder() + L"trace-" +
+                              boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time()) +
+                              L".json";
+
+        caspar::diagnostics::trace::dump(path);
+        return L"201 DIAG TRACE OK\r\n" + path + L"\r\n";
+    }
+
+    CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unknown DIAG TRACE action " + action));
+}
+
 std::wstring bye_command(command_context& ctx)
 {
     ctx.client->disconnect();
@@ -1438,6 +1815,7 @@ void register_commands(amcp_command_repository& repo)
 {
     repo.register_channel_command(L"Basic Commands", L"LOADBG", loadbg_command, 1);
     repo.register_channel_command(L"Basic Commands", L"LOAD", load_command, 1);
+    repo.register_channel_command(L"Basic Commands", L"PRELOAD", preload_command, 1);
     repo.register_channel_command(L"Basic Commands", L"PLAY", play_command, 0);
     repo.register_channel_command(L"Basic Commands", L"PAUSE", pause_command, 0);
     repo.register_channel_command(L"Basic Commands", L"RESUME", resume_command, 0);
@@ -1498,11 +1876,14 @@ void register_commands(amcp_command_repository& repo)
     repo.register_command(L"Query Commands", L"TLS", tls_command, 0);
     repo.register_command(L"Query Commands", L"VERSION", version_command, 0);
     repo.register_command(L"Query Commands", L"DIAG", diag_command, 0);
+    repo.register_command(L"Query Commands", L"DIAG TRACE", diag_trace_command, 1);
     repo.register_command(L"Query Commands", L"BYE", bye_command, 0);
     repo.register_command(L"Query Commands", L"KILL", kill_command, 0);
     repo.register_command(L"Query Commands", L"RESTART", restart_command, 0);
     repo.register_channel_command(L"Query Commands", L"INFO", info_channel_command, 0);
+    repo.register_channel_command(L"Query Commands", L"INFO PROFILE", info_profile_command, 0);
     repo.register_command(L"Query Commands", L"INFO", info_command, 0);
+    repo.register_command(L"Query Commands", L"INFO SERVER", info_server_command, 0);
 }
 
 }}} // namespace caspar::protocol::amcp
@@ -26,17 +26,26 @@
 #include "AMCPProtocolStrategy.h"
 #include "amcp_command_repository.h"
 #include "amcp_shared.h"
+#include "replicator.h"
 
 #include <algorithm>
 #include <cctype>
+#include <cwctype>
 #include <future>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <set>
 #include <stdio.h>
 #include <string.h>
 
 #include <boost/algorithm/string/replace.hpp>
-#include <boost/algorithm/string/split.hpp>
-#include <boost/algorithm/string/trim.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <common/env.h>
+
+#include <core/producer/stage.h>
+#include <core/video_channel.h>
 
 #if defined(_MSC_VER)
 #pragma warning(push, 1) // TODO: Legacy code, just disable warnings
@@ -63,16 +72,36 @@ struct AMCPProtocolStrategy::impl
   private:
     std::vector<AMCPCommandQueue::ptr_type>  commandQueues_;
     spl::shared_ptr<amcp_command_repository> repo_;
+    std::shared_ptr<replicator>              replicator_;
+
+    // The commands a client sent between BEGIN and COMMIT, and the messages they were parsed from.
+    struct batch
+    {
+        std::weak_ptr<IO::client_connection<wchar_t>> client;
+        std::vector<AMCPCommand::ptr_type>            commands;
+        std::vector<std::wstring>                     messages;
+        std::shared_ptr<AMCPCommandQueue>             queue;
+        bool                                          failed = false;
+    };
+
+    std::mutex                                       batches_mutex_;
+    std::map<IO::client_connection<wchar_t>*, batch> batches_;
 
   public:
-    impl(const std::wstring& name, const spl::shared_ptr<amcp_command_repository>& repo)
+    impl(const std::wstring&                             name,
+         const spl::shared_ptr<amcp_command_repository>& repo,
+         std::shared_ptr<replicator>                     replicator)
         : repo_(repo)
+        , replicator_(std::move(replicator))
     {
         commandQueues_.push_back(spl::make_shared<AMCPCommandQueue>(L"General Queue for " + name));
 
+        // NOTE: Commands for different layers of a channel run concurrently, so that a slow LOADBG does not hold
+        // back the other layers.
+        auto layer_threads = env::properties().get(L"configuration.amcp.layer-threads", 4);
         for (int i = 0; i < repo_->channels().size(); ++i) {
             commandQueues_.push_back(spl::make_shared<AMCPCommandQueue>(
-                L"Channel " + boost::lexical_cast<std::wstring>(i + 1) + L" for " + name));
+                L"Channel " + boost::lexical_cast<std::wstring>(i + 1) + L" for " + name, layer_threads));
         }
     }
 
@@ -85,7 +114,8 @@ struct AMCPProtocolStrategy::impl
         channel_error,
         parameters_error,
         unknown_error,
-        access_error
+        access_error,
+        batch_error
     };
 
     struct command_interpreter_result
@@ -102,16 +132,16 @@ struct AMCPProtocolStrategy::impl
     // Thesefore the AMCPProtocolStrategy should be decorated with a delimiter_based_chunking_strategy
     void Parse(const std::wstring& message, ClientInfoPtr client)
     {
-        std::list<std::wstring> tokens;
+        std::vector<std::wstring> tokens;
+        tokens.reserve(16);
         tokenize(message, tokens);
 
         if (!tokens.empty() && boost::iequals(tokens.front(), L"PING")) {
-            tokens.pop_front();
             std::wstringstream answer;
             answer << L"PONG";
 
-            for (auto t : tokens)
-                answer << L" " << t;
+            for (auto t = std::next(tokens.begin()); t != tokens.end(); ++t)
+                answer << L" " << *t;
 
             answer << "\r\n";
             client->send(answer.str(), true);
@@ -120,15 +150,24 @@ struct AMCPProtocolStrategy::impl
 
         CASPAR_LOG(info) << L"Received message from " << client->address() << ": " << message << L"\\r\\n";
 
+        if (handle_batch(tokens, client))
+            return;
+
         command_interpreter_result result;
         if (interpret_command_string(tokens, result, client)) {
             if (result.lock && !result.lock->check_access(client))
                 result.error = error_state::access_error;
-            else
-                result.queue->AddCommand(result.command);
+            else if (!add_to_batch(result, client, message)) {
+                if (replicator_ && is_batchable(*result.command))
+                    replicate(result, message);
+                else
+                    result.queue->AddCommand(result.command);
+            }
         }
 
         if (result.error != error_state::no_error) {
+            fail_batch(client);
+
             std::wstringstream answer;
 
             if (!result.request_id.empty())
@@ -147,6 +186,9 @@ struct AMCPProtocolStrategy::impl
                 case error_state::access_error:
                     answer << L"503 " << result.command_name << " FAILED\r\n";
                     break;
+                case error_state::batch_error:
+                    answer << L"403 " << result.command_name << " FAILED\r\n";
+                    break;
                 case error_state::unknown_error:
                     answer << L"500 FAILED\r\n";
                     break;
@@ -160,57 +202,278 @@ struct AMCPProtocolStrategy::impl
     }
 
   private:
-    bool
-    interpret_command_string(std::list<std::wstring> tokens, command_interpreter_result& result, ClientInfoPtr client)
+    // BEGIN starts buffering the commands of the client, which are validated as they arrive. COMMIT [DELAY frames]
+    // executes them in order and applies what they send to the stages of their channels on the same tick, the next
+    // one or frames after it, with one reply for the whole batch. COMMIT FRAME number applies them on that frame
+    // boundary of the reference clock of the channels, as replicated batches are. DISCARD drops them.
+    bool handle_batch(const std::vector<std::wstring>& tokens, const ClientInfoPtr& client)
+    {
+        if (tokens.empty())
+            return false;
+
+        const auto& token = tokens.front();
+        if (!boost::iequals(token, L"BEGIN") && !boost::iequals(token, L"COMMIT") && !boost::iequals(token, L"DISCARD"))
+            return false;
+
+        auto name = boost::to_upper_copy(token);
+
+        std::unique_lock<std::mutex> lock(batches_mutex_);
+
+        auto it = find_batch(client);
+        if (name == L"BEGIN") {
+            if (it != batches_.end()) {
+                client->send(L"403 BEGIN FAILED\r\n");
+            } else {
+                batches_[client.get()].client = client;
+                client->send(L"202 BEGIN OK\r\n");
+            }
+            return true;
+        }
+
+        if (it == batches_.end()) {
+            client->send(L"403 " + name + L" FAILED\r\n");
+            return true;
+        }
+
+        auto pending = std::move(it->second);
+        batches_.erase(it);
+        lock.unlock();
+
+        if (name == L"DISCARD") {
+            client->send(L"202 DISCARD OK\r\n");
+            return true;
+        }
+
+        int          delay           = 0;
+        std::int64_t reference_frame = -1;
+        auto         params          = std::vector<std::wstring>(std::next(tokens.begin()), tokens.end());
+        if (!params.empty() &&
+            (params.size() != 2 ||
+             !(boost::iequals(params[0], L"DELAY") ? try_lexical_cast(params[1], delay) && delay >= 0
+                                                   : boost::iequals(params[0], L"FRAME") &&
+                                                         try_lexical_cast(params[1], reference_frame) &&
+                                                         reference_frame >= 0))) {
+            client->send(L"402 COMMIT ERROR\r\n");
+            return true;
+        }
+
+        if (pending.failed) {
+            client->send(L"403 COMMIT FAILED\r\n");
+            return true;
+        }
+
+        if (pending.commands.empty()) {
+            client->send(L"202 COMMIT OK\r\n");
+            return true;
+        }
+
+        auto ctx     = pending.commands.front()->context();
+        ctx.layer_id = -1;
+        ctx.parameters.clear();
+
+        // NOTE: Batches which are committed on a reference frame come from a primary, and are not replicated again.
+        // Replicated batches are delayed at least as long as single commands, to give the backup time to create
+        // their producers.
+        auto replicate = reference_frame < 0 ? replicator_ : nullptr;
+        if (replicate)
+            delay = std::max(delay, replicate->delay());
+
+        auto commands = std::make_shared<std::vector<AMCPCommand::ptr_type>>(std::move(pending.commands));
+        auto messages = std::make_shared<std::vector<std::wstring>>(std::move(pending.messages));
+        pending.queue->AddCommand(std::make_shared<AMCPCommand>(
+            ctx,
+            [commands, messages, delay, reference_frame, replicate](command_context&) {
+                return commit(*commands, delay, reference_frame, replicate.get(), *messages);
+            },
+            0,
+            L"COMMIT"));
+        return true;
+    }
+
+    // Runs a stage command which is not part of a batch as a batch of its own, which takes effect on the same frame
+    // here and on the backup, delayed by the time the backup is given to create its producers.
+    void replicate(command_interpreter_result& result, const std::wstring& message)
+    {
+        auto commands  = std::make_shared<std::vector<AMCPCommand::ptr_type>>(1, result.command);
+        auto messages  = std::make_shared<std::vector<std::wstring>>(1, message);
+        auto delay     = replicator_->delay();
+        auto replicate = replicator_;
+        result.queue->AddCommand(std::make_shared<AMCPCommand>(
+            result.command->context(),
+            [commands, messages, delay, replicate](command_context&) {
+                commit(*commands, delay, -1, replicate.get(), *messages);
+                commands->front()->SendReply();
+                return std::wstring();
+            },
+            0,
+            result.command->print()));
+    }
+
+    // Buffers the command if the client has begun a batch.
+    bool add_to_batch(command_interpreter_result& result, const ClientInfoPtr& client, const std::wstring& message)
+    {
+        std::lock_guard<std::mutex> lock(batches_mutex_);
+
+        auto it = find_batch(client);
+        if (it == batches_.end())
+            return false;
+
+        if (!is_batchable(*result.command)) {
+            result.error = error_state::batch_error;
+            return true;
+        }
+
+        auto& pending = it->second;
+        pending.commands.push_back(result.command);
+        pending.messages.push_back(message);
+
+        // NOTE: A batch for one channel is queued with the commands of that channel, one for several channels
+        // with the general commands.
+        if (!pending.queue)
+            pending.queue = result.queue;
+        else if (pending.queue != result.queue)
+            pending.queue = commandQueues_.at(0);
+
+        return true;
+    }
+
+    void fail_batch(const ClientInfoPtr& client)
+    {
+        std::lock_guard<std::mutex> lock(batches_mutex_);
+
+        auto it = find_batch(client);
+        if (it != batches_.end())
+            it->second.failed = true;
+    }
+
+    std::map<IO::client_connection<wchar_t>*, batch>::iterator find_batch(const ClientInfoPtr& client)
+    {
+        // NOTE: The batch of a disconnected client is dropped once its address is reused.
+        auto it = batches_.find(client.get());
+        if (it != batches_.end() && it->second.client.lock().get() != client.get()) {
+            batches_.erase(it);
+            return batches_.end();
+        }
+        return it;
+    }
+
+    // Only commands which send to the stage without waiting for it can be batched, since the stage holds back what
+    // they send until the batch is committed. E.g. MIXER queries and CALL would wait for themselves.
+    static bool is_batchable(AMCPCommand& command)
+    {
+        static const std::set<std::wstring> commands = {
+            L"LOADBG", L"LOAD", L"PLAY", L"PAUSE", L"RESUME", L"STOP", L"CLEAR", L"MIXER CLEAR"};
+
+        if (!command.context().channel.channel)
+            return false;
+
+        auto name = command.print();
+        return commands.count(name) > 0 ||
+               (boost::starts_with(name, L"MIXER ") && name != L"MIXER COMMIT" && !command.parameters().empty());
+    }
+
+    // The batch is sent to the backup, if any, to be committed on the reference frame of the tick it is committed on
+    // here.
+    static std::wstring commit(const std::vector<AMCPCommand::ptr_type>& commands,
+                               int                                       delay,
+                               std::int64_t                              reference_frame,
+                               replicator*                               backup,
+                               const std::vector<std::wstring>&          messages)
+    {
+        std::vector<std::shared_ptr<core::video_channel>> channels;
+        for (auto& command : commands) {
+            auto channel = command->context().channel.channel;
+            if (std::find(channels.begin(), channels.end(), channel) == channels.end())
+                channels.push_back(channel);
+        }
+
+        for (auto& channel : channels)
+            channel->stage().begin_batch();
+
+        for (auto& command : commands) {
+            try {
+                command->Execute();
+            } catch (...) {
+                CASPAR_LOG(error) << L"Discarded batch after failing to execute: " << command->print();
+                for (auto& channel : channels)
+                    channel->stage().abort_batch();
+                throw;
+            }
+        }
+
+        // NOTE: Ticks are counted per channel, so each channel gets its own target. Without a reference clock a
+        // batch for a reference frame is committed on the next tick.
+        std::int64_t replicated_frame = -1;
+        for (auto& channel : channels) {
+            auto& stage  = channel->stage();
+            auto  offset = channel->reference_offset();
+            auto  next   = stage.frame_number();
+            auto  target = next + delay;
+
+            if (reference_frame >= 0) {
+                target = offset ? reference_frame - *offset : next;
+                if (target < next)
+                    CASPAR_LOG(warning) << L"Committed replicated batch " << next - target << L" frames late on "
+                                        << channel->index() << L".";
+            } else if (offset && replicated_frame < 0) {
+                replicated_frame = target + *offset;
+            }
+
+            stage.commit_batch(target);
+        }
+
+        if (backup)
+            backup->send(messages, replicated_frame);
+
+        return L"202 COMMIT OK\r\n";
+    }
+
+    // Consumes the tokens, which are left as the parameters of the command.
+    bool interpret_command_string(std::vector<std::wstring>& tokens,
+                                  command_interpreter_result& result,
+                                  ClientInfoPtr               client)
     {
         try {
+            auto token = tokens.begin();
+
             // Discard GetSwitch
-            if (!tokens.empty() && tokens.front().at(0) == L'/')
-                tokens.pop_front();
+            if (token != tokens.end() && token->at(0) == L'/')
+                ++token;
 
-            if (!tokens.empty() && boost::iequals(tokens.front(), L"REQ")) {
-                tokens.pop_front();
+            if (token != tokens.end() && boost::iequals(*token, L"REQ")) {
+                ++token;
 
-                if (tokens.empty()) {
+                if (token == tokens.end()) {
                     result.error = error_state::parameters_error;
                     return false;
                 }
 
-                result.request_id = tokens.front();
-                tokens.pop_front();
+                result.request_id = std::move(*token++);
             }
 
             // Fail if no more tokens.
-            if (tokens.empty()) {
+            if (token == tokens.end()) {
                 result.error = error_state::command_error;
                 return false;
             }
 
             // Consume command name
-            result.command_name = boost::to_upper_copy(tokens.front());
-            tokens.pop_front();
+            result.command_name = std::move(*token++);
+            boost::to_upper(result.command_name);
+
+            tokens.erase(tokens.begin(), token);
 
             // Determine whether the next parameter is a channel spec or not
             int          channel_index = -1;
             int          layer_index   = -1;
             std::wstring channel_spec;
 
-            if (!tokens.empty()) {
-                channel_spec                            = tokens.front();
-                std::wstring              channelid_str = boost::trim_copy(channel_spec);
-                std::vector<std::wstring> split;
-                boost::split(split, channelid_str, boost::is_any_of("-"));
+            if (!tokens.empty() && parse_channel_spec(tokens.front(), channel_index, layer_index)) {
+                --channel_index;
 
-                // Use non_throwing lexical cast to not hit exception break point all the time.
-                if (try_lexical_cast(split[0], channel_index)) {
-                    --channel_index;
-
-                    if (split.size() > 1)
-                        try_lexical_cast(split[1], layer_index);
-
-                    // Consume channel-spec
-                    tokens.pop_front();
-                }
+                // Consume channel-spec
+                channel_spec = std::move(tokens.front());
+                tokens.erase(tokens.begin());
             }
 
             bool is_channel_command = channel_index != -1;
@@ -226,7 +489,7 @@ struct AMCPProtocolStrategy::impl
                 } else // Might be a non channel command, although the first argument is numeric
                 {
                     // Restore backed up channel spec string.
-                    tokens.push_front(channel_spec);
+                    tokens.insert(tokens.begin(), std::move(channel_spec));
                     result.command = repo_->create_command(result.command_name, client, tokens);
 
                     if (result.command)
@@ -242,9 +505,7 @@ struct AMCPProtocolStrategy::impl
             if (!result.command)
                 result.error = error_state::command_error;
             else {
-                std::vector<std::wstring> parameters(tokens.begin(), tokens.end());
-
-                result.command->parameters() = std::move(parameters);
+                result.command->parameters() = std::move(tokens);
 
                 if (result.command->parameters().size() < result.command->minimum_parameters())
                     result.error = error_state::parameters_error;
@@ -263,76 +524,122 @@ struct AMCPProtocolStrategy::impl
         return result.error == error_state::no_error;
     }
 
-    template <typename C>
-    std::size_t tokenize(const std::wstring& message, C& pTokenVector)
+    // Parses "channel[-layer]" in place, as it is tried on the first parameter of every command. A layer which is
+    // not a number is left as -1.
+    static bool parse_channel_spec(const std::wstring& spec, int& channel_index, int& layer_index)
     {
-        // split on whitespace but keep strings within quotationmarks
-        // treat \ as the start of an escape-sequence: the following char will indicate what to actually put in the
-        // string
-
-        std::wstring currentToken;
-
-        bool inQuote        = false;
-        bool getSpecialCode = false;
-
-        for (unsigned int charIndex = 0; charIndex < message.size(); ++charIndex) {
-            if (getSpecialCode) {
-                // insert code-handling here
-                switch (message[charIndex]) {
-                    case L'\\':
-                        currentToken += L"\\";
-                        break;
-                    case L'\"':
-                        currentToken += L"\"";
-                        break;
-                    case L'n':
-                        currentToken += L"\n";
-                        break;
-                    default:
-                        break;
-                };
-                getSpecialCode = false;
-                continue;
-            }
+        auto begin = spec.data();
+        auto end   = begin + spec.size();
 
-            if (message[charIndex] == L'\\') {
-                getSpecialCode = true;
-                continue;
-            }
+        while (begin != end && std::iswspace(*begin))
+            ++begin;
+        while (begin != end && std::iswspace(*(end - 1)))
+            --end;
 
-            if (message[charIndex] == L' ' && inQuote == false) {
-                if (!currentToken.empty()) {
-                    pTokenVector.push_back(currentToken);
-                    currentToken.clear();
-                }
-                continue;
-            }
+        auto dash = std::find(begin, end, L'-');
+        if (!parse_int(begin, dash, channel_index))
+            return false;
+
+        if (dash != end)
+            parse_int(dash + 1, std::find(dash + 1, end, L'-'), layer_index);
+
+        return true;
+    }
+
+    static bool parse_int(const wchar_t* begin, const wchar_t* end, int& result)
+    {
+        if (begin != end && *begin == L'+')
+            ++begin;
+
+        if (begin == end)
+            return false;
+
+        long long value = 0;
+        for (auto it = begin; it != end; ++it) {
+            if (*it < L'0' || *it > L'9')
+                return false;
+            value = value * 10 + (*it - L'0');
+            if (value > std::numeric_limits<int>::max())
+                return false;
+        }
+
+        result = static_cast<int>(value);
+        return true;
+    }
+};
 
-            if (message[charIndex] == L'\"') {
+std::size_t tokenize(const std::wstring& message, std::vector<std::wstring>& pTokenVector)
+{
+    // split on whitespace but keep strings within quotationmarks
+    // treat \ as the start of an escape-sequence: the following char will indicate what to actually put in the
+    // string. Runs of ordinary characters are appended at once.
+
+    std::wstring currentToken;
+
+    bool inQuote = false;
+
+    auto it  = message.data();
+    auto end = it + message.size();
+
+    while (it != end) {
+        auto run = it;
+        while (run != end && *run != L'\\' && *run != L'\"' && (inQuote || *run != L' '))
+            ++run;
+
+        currentToken.append(it, run);
+
+        if (run == end)
+            break;
+
+        it = run + 1;
+
+        switch (*run) {
+            case L'\\':
+                if (it != end) {
+                    switch (*it++) {
+                        case L'\\':
+                            currentToken += L'\\';
+                            break;
+                        case L'\"':
+                            currentToken += L'\"';
+                            break;
+                        case L'n':
+                            currentToken += L'\n';
+                            break;
+                        default:
+                            break;
+                    };
+                }
+                break;
+            case L'\"':
                 inQuote = !inQuote;
 
                 if (!currentToken.empty() || !inQuote) {
-                    pTokenVector.push_back(currentToken);
+                    pTokenVector.push_back(std::move(currentToken));
                     currentToken.clear();
                 }
-                continue;
-            }
-
-            currentToken += message[charIndex];
-        }
-
-        if (!currentToken.empty()) {
-            pTokenVector.push_back(currentToken);
-            currentToken.clear();
+                break;
+            default:
+                if (!currentToken.empty()) {
+                    pTokenVector.push_back(std::move(currentToken));
+                    currentToken.clear();
+                }
+                break;
         }
+    }
 
-        return pTokenVector.size();
+    if (!currentToken.empty()) {
+        pTokenVector.push_back(std::move(currentToken));
+        currentToken.clear();
     }
-};
+
+    return pTokenVector.size();
+}
 
 AMCPProtocolStrategy::AMCPProtocolStrategy(const std::wstring&                             name,
-                                           const spl::shared_ptr<amcp_command_repository>& repo)
-    : impl_(spl::make_unique<impl>(name, repo))
+                                           const spl::shared_ptr<amcp_command_repository>& repo,
+                                           std::shared_ptr<replicator>                     replicator)
+    : impl_(spl::make_unique<impl>(name, repo, std::move(replicator)))
 {
 }
 AMCPProtocolStrategy::~AMCPProtocolStrategy() {}
@@ -32,15 +32,22 @@
 
 #include <future>
 #include <string>
+#include <vector>
 
 namespace caspar { namespace protocol { namespace amcp {
 
+// Splits an AMCP message into tokens on spaces, keeping quoted strings whole and resolving \\, \" and \n escapes.
+std::size_t tokenize(const std::wstring& message, std::vector<std::wstring>& tokens);
+
 class AMCPProtocolStrategy
     : public IO::IProtocolStrategy
     , boost::noncopyable
 {
   public:
-    AMCPProtocolStrategy(const std::wstring& name, const spl::shared_ptr<class amcp_command_repository>& repo);
+    // Stage commands are replicated to a backup if a replicator is given.
+    AMCPProtocolStrategy(const std::wstring&                                   name,
+                         const spl::shared_ptr<class amcp_command_repository>& repo,
+                         std::shared_ptr<class replicator>                     replicator = nullptr);
 
     virtual ~AMCPProtocolStrategy();
 
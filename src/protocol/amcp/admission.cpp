@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "admission.h"
+
+#include <common/env.h>
+#include <common/log.h>
+
+#include <core/producer/frame_producer.h>
+#include <core/producer/stage.h>
+#include <core/video_channel.h>
+#include <core/video_format.h>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+namespace {
+
+const std::int64_t MB = 1024 * 1024;
+
+// Resident bytes of a pool of the ogl device a channel mixes on, see ogl::device::state.
+std::int64_t pool_resident(const core::monitor::state& state, const std::string& pool)
+{
+    const auto key = "mixer/image/pool/" + pool + "/resident";
+    for (auto& p : state) {
+        if (p.first == key && !p.second.empty()) {
+            if (auto value = boost::get<std::int64_t>(&p.second.front())) {
+                return *value;
+            }
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+struct admission::reservation::entry
+{
+    std::mutex                            mutex;
+    std::weak_ptr<core::video_channel>    channel;
+    int                                   layer = 0;
+    admission::footprint                  size;
+    std::chrono::steady_clock::time_point admitted = std::chrono::steady_clock::now();
+    std::weak_ptr<core::frame_producer>   producer;
+    bool                                  committed = false;
+    bool                                  released  = false;
+};
+
+admission::reservation::~reservation()
+{
+    if (!entry_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(entry_->mutex);
+    entry_->released = entry_->released || !entry_->committed;
+}
+
+void admission::reservation::commit(const std::shared_ptr<core::frame_producer>& producer)
+{
+    std::lock_guard<std::mutex> lock(entry_->mutex);
+    entry_->producer  = producer;
+    entry_->committed = true;
+}
+
+struct admission::impl
+{
+    typedef reservation::entry entry;
+
+    // An entry which is still counted. Entries without a producer are loads which are in progress.
+    struct counted
+    {
+        std::shared_ptr<entry>                reserved;
+        std::shared_ptr<core::frame_producer> producer;
+        bool                                  cold;
+    };
+
+    const std::int64_t host_budget_;
+    const std::int64_t gpu_budget_;
+    const bool         evict_;
+    const std::int64_t clip_frames_;
+    const std::int64_t html_host_;
+
+    mutable std::mutex                          mutex_;
+    mutable std::vector<std::shared_ptr<entry>> entries_;
+
+    impl()
+        : host_budget_(env::properties().get(L"configuration.amcp.admission.host-budget", 0) * MB)
+        , gpu_budget_(env::properties().get(L"configuration.amcp.admission.gpu-budget", 0) * MB)
+        , evict_(env::properties().get(L"configuration.amcp.admission.evict", false))
+        , clip_frames_(std::max(1, env::properties().get(L"configuration.amcp.admission.clip-frames", 8)))
+        , html_host_(std::max(1, env::properties().get(L"configuration.amcp.admission.html-footprint", 200)) * MB)
+    {
+    }
+
+    // Drops the entries of released reservations and of producers which have been destroyed. Preloads count as cold
+    // until they have produced a frame, which is when their textures are allocated and counted in the pools.
+    std::vector<counted> count() const
+    {
+        std::vector<counted>                result;
+        std::vector<std::shared_ptr<entry>> kept;
+        for (auto& e : entries_) {
+            std::lock_guard<std::mutex> lock(e->mutex);
+            auto                        producer = e->producer.lock();
+            if (e->released || (e->committed && !producer)) {
+                continue;
+            }
+            kept.push_back(e);
+            result.push_back(counted{e, producer, !producer || producer->frame_number() == 0});
+        }
+        entries_ = std::move(kept);
+        return result;
+    }
+
+    // The pools are shared by the channels of a device, so the largest of the channels is taken rather than the sum.
+    footprint used(const std::vector<channel_context>& channels, const std::vector<counted>& entries) const
+    {
+        footprint result;
+        for (auto& channel : channels) {
+            auto state  = channel.channel->state();
+            result.host = std::max(result.host,
+                                   pool_resident(state, "read-buffer") + pool_resident(state, "write-buffer") +
+                                       pool_resident(state, "upload-ring"));
+            result.gpu = std::max(result.gpu, pool_resident(state, "texture"));
+        }
+        for (auto& counted : entries) {
+            result.host += counted.reserved->size.host;
+            result.gpu += counted.cold ? counted.reserved->size.gpu : 0;
+        }
+        return result;
+    }
+
+    bool fits(const footprint& used, const footprint& size) const
+    {
+        return (host_budget_ == 0 || used.host + size.host <= host_budget_) &&
+               (gpu_budget_ == 0 || used.gpu + size.gpu <= gpu_budget_);
+    }
+
+    reservation admit(const std::vector<channel_context>&         channels,
+                      const std::shared_ptr<core::video_channel>& channel,
+                      int                                         layer,
+                      const footprint&                            size)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // NOTE: The producers on the layer are not counted, as the load replaces them.
+        auto entries = count();
+        entries.erase(std::remove_if(entries.begin(),
+                                     entries.end(),
+                                     [&](const counted& counted) {
+                                         return counted.reserved->layer == layer &&
+                                                counted.reserved->channel.lock() == channel;
+                                     }),
+                      entries.end());
+        auto usage = used(channels, entries);
+
+        if (!fits(usage, size) && evict_) {
+            std::vector<counted> preloads;
+            std::copy_if(entries.begin(), entries.end(), std::back_inserter(preloads), [](const counted& counted) {
+                return counted.producer && counted.cold;
+            });
+            std::sort(preloads.begin(), preloads.end(), [](const counted& lhs, const counted& rhs) {
+                return lhs.reserved->admitted < rhs.reserved->admitted;
+            });
+
+            // NOTE: The unload is not waited for, since it is held back until the commit of a batch this load is part
+            // of. Preloads which have been played meanwhile are left as they are.
+            for (auto& preload : preloads) {
+                if (fits(usage, size)) {
+                    break;
+                }
+                auto preload_channel = preload.reserved->channel.lock();
+                if (!preload_channel) {
+                    continue;
+                }
+                preload_channel->stage().unload(preload.reserved->layer, preload.producer);
+                {
+                    std::lock_guard<std::mutex> entry_lock(preload.reserved->mutex);
+                    preload.reserved->released = true;
+                }
+                usage.host -= preload.reserved->size.host;
+                usage.gpu -= preload.reserved->size.gpu;
+
+                CASPAR_LOG(info) << L"Evicted preload " << preload.producer->print() << L" of "
+                                 << preload_channel->index() << L"-" << preload.reserved->layer << L" to load onto "
+                                 << channel->index() << L"-" << layer << L".";
+            }
+        }
+
+        if (!fits(usage, size)) {
+            CASPAR_LOG(warning) << L"Refused to load onto " << channel->index() << L"-" << layer << L", which needs "
+                                << size.host / MB << L" MB of host memory and " << size.gpu / MB
+                                << L" MB of gpu memory, while " << usage.host / MB << L" MB and " << usage.gpu / MB
+                                << L" MB are in use.";
+            CASPAR_THROW_EXCEPTION(admission_refused() << msg_info(L"Memory budget exceeded"));
+        }
+
+        auto e     = std::make_shared<entry>();
+        e->channel = channel;
+        e->layer   = layer;
+        e->size    = size;
+        entries_.push_back(e);
+
+        reservation result;
+        result.entry_ = std::move(e);
+        return result;
+    }
+
+    core::monitor::state state(const std::vector<channel_context>& channels) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto entries = count();
+        auto usage   = used(channels, entries);
+
+        core::monitor::state state;
+        auto                 report = [&](const std::string& name, std::int64_t budget, std::int64_t used) {
+            state["admission"][name]["budget"] = budget;
+            state["admission"][name]["used"]   = used;
+            if (budget > 0) {
+                state["admission"][name]["headroom"] = budget - used;
+            }
+        };
+        report("host", host_budget_, usage.host);
+        report("gpu", gpu_budget_, usage.gpu);
+        state["admission"]["producers"] = static_cast<std::int64_t>(entries.size());
+        state["admission"]["preloads"]  = static_cast<std::int64_t>(
+            std::count_if(entries.begin(), entries.end(), [](const counted& c) { return c.producer && c.cold; }));
+        return state;
+    }
+};
+
+admission::admission()
+    : impl_(std::make_shared<impl>())
+{
+}
+
+// NOTE: Clips are estimated to buffer clip-frames decoded frames in host memory and to upload two frames ahead.
+admission::footprint admission::clip(const core::video_format_desc& format_desc) const
+{
+    footprint result;
+    result.host = static_cast<std::int64_t>(format_desc.size) * impl_->clip_frames_;
+    result.gpu  = static_cast<std::int64_t>(format_desc.size) * 2;
+    return result;
+}
+
+admission::footprint admission::html(const core::video_format_desc& format_desc) const
+{
+    footprint result;
+    result.host = impl_->html_host_;
+    result.gpu  = static_cast<std::int64_t>(format_desc.size) * 2;
+    return result;
+}
+
+admission::reservation admission::admit(const std::vector<channel_context>&         channels,
+                                        const std::shared_ptr<core::video_channel>& channel,
+                                        int                                         layer,
+                                        const footprint&                            size)
+{
+    return impl_->admit(channels, channel, layer, size);
+}
+
+core::monitor::state admission::state(const std::vector<channel_context>& channels) const
+{
+    return impl_->state(channels);
+}
+
+}}} // namespace caspar::protocol::amcp
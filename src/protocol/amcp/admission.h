@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "amcp_shared.h"
+
+#include <common/except.h>
+
+#include <core/fwd.h>
+#include <core/monitor/monitor.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+// Thrown when a load does not fit in the memory budgets, replied to with 505.
+struct admission_refused : virtual user_error
+{
+};
+
+// Estimates the memory which LOADBG and CG ADD are about to take, and checks it against the budgets of
+// configuration.amcp.admission before anything is loaded. Memory in use is the resident memory of the gpu pools of
+// the channels, plus the estimates of the producers which have been admitted and are still alive. Preloads which are
+// still in the background of their layer are counted in gpu memory as well, since they have not rendered yet.
+class admission
+{
+  public:
+    struct footprint
+    {
+        std::int64_t host = 0;
+        std::int64_t gpu  = 0;
+    };
+
+    // Held by a load while it is being loaded. Its footprint is released when the reservation is destroyed, unless it
+    // has been handed the loaded producer, which then holds it for as long as it lives.
+    class reservation
+    {
+      public:
+        reservation() = default;
+        reservation(reservation&&) = default;
+        ~reservation();
+
+        void commit(const std::shared_ptr<core::frame_producer>& producer);
+
+      private:
+        friend class admission;
+        struct entry;
+        std::shared_ptr<entry> entry_;
+    };
+
+    admission();
+
+    footprint clip(const core::video_format_desc& format_desc) const;
+    footprint html(const core::video_format_desc& format_desc) const;
+
+    // Reserves the footprint of a load onto the layer. Preloads which have waited longest are evicted to make room
+    // if eviction is enabled, otherwise or if that is not enough admission_refused is thrown.
+    reservation admit(const std::vector<channel_context>&         channels,
+                      const std::shared_ptr<core::video_channel>& channel,
+                      int                                         layer,
+                      const footprint&                            size);
+
+    // Budgets, use and headroom in bytes, and the number of admitted producers alive.
+    core::monitor::state state(const std::vector<channel_context>& channels) const;
+
+  private:
+    struct impl;
+    std::shared_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::amcp
@@ -25,40 +25,57 @@
 
 #include <common/env.h>
 
+#include <boost/algorithm/string/case_conv.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/property_tree/ptree.hpp>
 
-#include <map>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace caspar { namespace protocol { namespace amcp {
 
-AMCPCommand::ptr_type find_command(const std::map<std::wstring, std::pair<amcp_command_func, int>>& commands,
-                                   const std::wstring&                                              str,
-                                   const command_context&                                           ctx,
-                                   std::list<std::wstring>&                                         tokens)
+// The commands by name, and the names which start subcommands like MIXER CLEAR, so that commands without
+// subcommands are found with a single hash lookup.
+struct command_table
 {
-    std::wstring subcommand;
+    std::unordered_map<std::wstring, std::pair<amcp_command_func, int>> commands;
+    std::unordered_set<std::wstring>                                    prefixes;
 
-    if (!tokens.empty())
-        subcommand = boost::to_upper_copy(tokens.front());
+    void insert(std::wstring name, amcp_command_func command, int min_num_params)
+    {
+        auto space = name.find(L' ');
+        if (space != std::wstring::npos)
+            prefixes.insert(name.substr(0, space));
 
-    // Start with subcommand syntax like MIXER CLEAR etc
-    if (!subcommand.empty()) {
-        auto s      = str + L" " + subcommand;
-        auto subcmd = commands.find(s);
+        commands.insert(std::make_pair(std::move(name), std::make_pair(std::move(command), min_num_params)));
+    }
+};
 
-        if (subcmd != commands.end()) {
-            tokens.pop_front();
-            return std::make_shared<AMCPCommand>(ctx, subcmd->second.first, subcmd->second.second, s);
+AMCPCommand::ptr_type find_command(const command_table&       table,
+                                   const std::wstring&        str,
+                                   command_context            ctx,
+                                   std::vector<std::wstring>& tokens)
+{
+    // Start with subcommand syntax like MIXER CLEAR etc
+    if (!tokens.empty() && !tokens.front().empty() && table.prefixes.count(str) > 0) {
+        std::wstring s;
+        s.reserve(str.size() + 1 + tokens.front().size());
+        s.append(str).append(1, L' ').append(boost::to_upper_copy(tokens.front()));
+
+        auto subcmd = table.commands.find(s);
+        if (subcmd != table.commands.end()) {
+            tokens.erase(tokens.begin());
+            return std::make_shared<AMCPCommand>(
+                std::move(ctx), subcmd->second.first, subcmd->second.second, std::move(s));
         }
     }
 
     // Resort to ordinary command
-    auto s       = str;
-    auto command = commands.find(s);
+    auto command = table.commands.find(str);
 
-    if (command != commands.end())
-        return std::make_shared<AMCPCommand>(ctx, command->second.first, command->second.second, s);
+    if (command != table.commands.end())
+        return std::make_shared<AMCPCommand>(std::move(ctx), command->second.first, command->second.second, str);
 
     return nullptr;
 }
@@ -69,21 +86,27 @@ struct amcp_command_repository::impl
     spl::shared_ptr<core::cg_producer_registry>          cg_registry;
     spl::shared_ptr<const core::frame_producer_registry> producer_registry;
     spl::shared_ptr<const core::frame_consumer_registry> consumer_registry;
+    std::shared_ptr<core::thumbnail_generator>           thumbnail_generator;
+    spl::shared_ptr<data_store>                          data = spl::make_shared<data_store>(
+        env::data_folder(),
+        std::chrono::milliseconds(env::properties().get(L"configuration.amcp.data-flush-interval", 100)));
     std::function<void(bool)>                            shutdown_server_now;
     std::string proxy_host = u8(caspar::env::properties().get(L"configuration.amcp.media-server.host", L"127.0.0.1"));
     std::string proxy_port = u8(caspar::env::properties().get(L"configuration.amcp.media-server.port", L"8000"));
 
-    std::map<std::wstring, std::pair<amcp_command_func, int>> commands;
-    std::map<std::wstring, std::pair<amcp_command_func, int>> channel_commands;
+    command_table commands;
+    command_table channel_commands;
 
     impl(const std::vector<spl::shared_ptr<core::video_channel>>&    channels,
          const spl::shared_ptr<core::cg_producer_registry>&          cg_registry,
          const spl::shared_ptr<const core::frame_producer_registry>& producer_registry,
          const spl::shared_ptr<const core::frame_consumer_registry>& consumer_registry,
+         const std::shared_ptr<core::thumbnail_generator>&           thumbnail_generator,
          std::function<void(bool)>                                   shutdown_server_now)
         : cg_registry(cg_registry)
         , producer_registry(producer_registry)
         , consumer_registry(consumer_registry)
+        , thumbnail_generator(thumbnail_generator)
         , shutdown_server_now(shutdown_server_now)
     {
         int index = 0;
@@ -100,14 +123,16 @@ amcp_command_repository::amcp_command_repository(
     const spl::shared_ptr<core::cg_producer_registry>&          cg_registry,
     const spl::shared_ptr<const core::frame_producer_registry>& producer_registry,
     const spl::shared_ptr<const core::frame_consumer_registry>& consumer_registry,
+    const std::shared_ptr<core::thumbnail_generator>&           thumbnail_generator,
     std::function<void(bool)>                                   shutdown_server_now)
-    : impl_(new impl(channels, cg_registry, producer_registry, consumer_registry, shutdown_server_now))
+    : impl_(new impl(
+          channels, cg_registry, producer_registry, consumer_registry, thumbnail_generator, shutdown_server_now))
 {
 }
 
-AMCPCommand::ptr_type amcp_command_repository::create_command(const std::wstring&      s,
-                                                              IO::ClientInfoPtr        client,
-                                                              std::list<std::wstring>& tokens) const
+AMCPCommand::ptr_type amcp_command_repository::create_command(const std::wstring&        s,
+                                                              IO::ClientInfoPtr          client,
+                                                              std::vector<std::wstring>& tokens) const
 {
     auto& self = *impl_;
 
@@ -119,11 +144,13 @@ AMCPCommand::ptr_type amcp_command_repository::create_command(const std::wstring
                         self.cg_registry,
                         self.producer_registry,
                         self.consumer_registry,
+                        self.thumbnail_generator,
+                        self.data,
                         self.shutdown_server_now,
                         self.proxy_host,
                         self.proxy_port);
 
-    auto command = find_command(self.commands, s, ctx, tokens);
+    auto command = find_command(self.commands, s, std::move(ctx), tokens);
 
     if (command)
         return command;
@@ -133,11 +160,11 @@ AMCPCommand::ptr_type amcp_command_repository::create_command(const std::wstring
 
 const std::vector<channel_context>& amcp_command_repository::channels() const { return impl_->channels; }
 
-AMCPCommand::ptr_type amcp_command_repository::create_channel_command(const std::wstring&      s,
-                                                                      IO::ClientInfoPtr        client,
-                                                                      unsigned int             channel_index,
-                                                                      int                      layer_index,
-                                                                      std::list<std::wstring>& tokens) const
+AMCPCommand::ptr_type amcp_command_repository::create_channel_command(const std::wstring&        s,
+                                                                      IO::ClientInfoPtr          client,
+                                                                      unsigned int               channel_index,
+                                                                      int                        layer_index,
+                                                                      std::vector<std::wstring>& tokens) const
 {
     auto& self = *impl_;
 
@@ -151,11 +178,13 @@ AMCPCommand::ptr_type amcp_command_repository::create_channel_command(const std:
                         self.cg_registry,
                         self.producer_registry,
                         self.consumer_registry,
+                        self.thumbnail_generator,
+                        self.data,
                         self.shutdown_server_now,
                         self.proxy_host,
                         self.proxy_port);
 
-    auto command = find_command(self.channel_commands, s, ctx, tokens);
+    auto command = find_command(self.channel_commands, s, std::move(ctx), tokens);
 
     if (command)
         return command;
@@ -169,7 +198,7 @@ void amcp_command_repository::register_command(std::wstring      category,
                                                int               min_num_params)
 {
     auto& self = *impl_;
-    self.commands.insert(std::make_pair(std::move(name), std::make_pair(std::move(command), min_num_params)));
+    self.commands.insert(std::move(name), std::move(command), min_num_params);
 }
 
 void amcp_command_repository::register_channel_command(std::wstring      category,
@@ -178,7 +207,7 @@ void amcp_command_repository::register_channel_command(std::wstring      categor
                                                        int               min_num_params)
 {
     auto& self = *impl_;
-    self.channel_commands.insert(std::make_pair(std::move(name), std::make_pair(std::move(command), min_num_params)));
+    self.channel_commands.insert(std::move(name), std::move(command), min_num_params);
 }
 
 }}} // namespace caspar::protocol::amcp
@@ -30,6 +30,8 @@
 
 #include <functional>
 #include <future>
+#include <string>
+#include <vector>
 
 namespace caspar { namespace protocol { namespace amcp {
 
@@ -40,15 +42,19 @@ class amcp_command_repository : boost::noncopyable
                             const spl::shared_ptr<core::cg_producer_registry>&          cg_registry,
                             const spl::shared_ptr<const core::frame_producer_registry>& producer_registry,
                             const spl::shared_ptr<const core::frame_consumer_registry>& consumer_registry,
+                            const std::shared_ptr<core::thumbnail_generator>&           thumbnail_generator,
                             std::function<void(bool)>                                   shutdown_server_now);
 
-    AMCPCommand::ptr_type
-                          create_command(const std::wstring& s, IO::ClientInfoPtr client, std::list<std::wstring>& tokens) const;
-    AMCPCommand::ptr_type create_channel_command(const std::wstring&      s,
-                                                 IO::ClientInfoPtr        client,
-                                                 unsigned int             channel_index,
-                                                 int                      layer_index,
-                                                 std::list<std::wstring>& tokens) const;
+    // Creates the command named s, or the subcommand named by s and the first token, which is then removed. The
+    // tokens are left untouched if there is no such command.
+    AMCPCommand::ptr_type create_command(const std::wstring&        s,
+                                         IO::ClientInfoPtr          client,
+                                         std::vector<std::wstring>& tokens) const;
+    AMCPCommand::ptr_type create_channel_command(const std::wstring&        s,
+                                                 IO::ClientInfoPtr          client,
+                                                 unsigned int               channel_index,
+                                                 int                        layer_index,
+                                                 std::vector<std::wstring>& tokens) const;
 
     const std::vector<channel_context>& channels() const;
 
@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "data_store.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/filesystem.h>
+#include <common/os/thread.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/locale.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/algorithm/copy.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+namespace {
+
+std::wstring read_utf8_file(const boost::filesystem::path& file)
+{
+    std::wstringstream           result;
+    boost::filesystem::wifstream filestream(file);
+
+    if (filestream) {
+        // Consume BOM first
+        filestream.get();
+        // read all data
+        result << filestream.rdbuf();
+    }
+
+    return result.str();
+}
+
+std::wstring read_latin1_file(const boost::filesystem::path& file)
+{
+    boost::locale::generator gen;
+    gen.locale_cache_enabled(true);
+    gen.categories(boost::locale::codepage_facet);
+
+    std::stringstream           result_stream;
+    boost::filesystem::ifstream filestream(file);
+    filestream.imbue(gen("en_US.ISO8859-1"));
+
+    if (filestream) {
+        // read all data
+        result_stream << filestream.rdbuf();
+    }
+
+    std::string  result = result_stream.str();
+    std::wstring widened_result;
+
+    // The first 255 codepoints in unicode is the same as in latin1
+    boost::copy(result | boost::adaptors::transformed([](char c) { return static_cast<unsigned char>(c); }),
+                std::back_inserter(widened_result));
+
+    return widened_result;
+}
+
+std::wstring read_file(const boost::filesystem::path& file)
+{
+    static const uint8_t BOM[] = {0xef, 0xbb, 0xbf};
+
+    if (!boost::filesystem::exists(file)) {
+        return L"";
+    }
+
+    if (boost::filesystem::file_size(file) >= 3) {
+        boost::filesystem::ifstream bom_stream(file);
+
+        char header[3];
+        bom_stream.read(header, 3);
+        bom_stream.close();
+
+        if (std::memcmp(BOM, header, 3) == 0)
+            return read_utf8_file(file);
+    }
+
+    return read_latin1_file(file);
+}
+
+std::wstring to_key(const std::wstring& name)
+{
+    return boost::to_lower_copy(boost::replace_all_copy(name, L"\\", L"/"));
+}
+
+} // namespace
+
+struct data_store::impl
+{
+    struct entry
+    {
+        std::wstring name;
+        std::wstring data;
+        bool         present = false; // False once removed, until stored again.
+    };
+
+    struct subscription
+    {
+        std::wstring  key;
+        listener_t    listener;
+        std::uint64_t id;
+    };
+
+    const std::wstring              folder_;
+    const std::chrono::milliseconds flush_interval_;
+
+    std::mutex                              mutex_;
+    std::condition_variable                 cond_;
+    std::unordered_map<std::wstring, entry> entries_;
+    std::set<std::wstring>                  dirty_;
+    bool                                    running_ = true;
+
+    // NOTE: Held from taking the dirty entries until they are written, so that a flush and the writer do not write
+    // the same file out of order.
+    std::mutex write_mutex_;
+
+    std::mutex                           subscriptions_mutex_;
+    std::map<std::wstring, subscription> subscriptions_;
+    std::uint64_t                        next_subscription_id_ = 0;
+
+    std::thread thread_;
+
+    impl(std::wstring folder, std::chrono::milliseconds flush_interval)
+        : folder_(std::move(folder))
+        , flush_interval_(flush_interval)
+        , thread_([this] { run(); })
+    {
+    }
+
+    ~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        cond_.notify_all();
+        thread_.join();
+
+        try {
+            write_dirty();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    void run()
+    {
+        set_thread_name(L"data store");
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] { return !running_ || !dirty_.empty(); });
+                if (!running_) {
+                    return;
+                }
+
+                // NOTE: Waiting before writing merges the changes of the whole interval into one write per file.
+                cond_.wait_for(lock, flush_interval_, [&] { return !running_; });
+                if (!running_) {
+                    return;
+                }
+            }
+
+            try {
+                write_dirty();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    void write_dirty()
+    {
+        std::lock_guard<std::mutex> write_lock(write_mutex_);
+
+        std::vector<entry> entries;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& key : dirty_) {
+                entries.push_back(entries_.at(key));
+            }
+            dirty_.clear();
+        }
+
+        for (auto& entry : entries) {
+            try {
+                write(entry);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    void write(const entry& entry)
+    {
+        std::wstring filename = folder_ + entry.name + L".ftd";
+
+        if (!entry.present) {
+            auto found_file = find_case_insensitive(filename);
+            if (found_file && !boost::filesystem::remove(*found_file))
+                CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(filename + L" could not be removed"));
+            return;
+        }
+
+        auto data_path       = boost::filesystem::path(filename).parent_path().wstring();
+        auto found_data_path = find_case_insensitive(data_path);
+
+        if (found_data_path)
+            data_path = *found_data_path;
+
+        if (!boost::filesystem::exists(data_path))
+            boost::filesystem::create_directories(data_path);
+
+        auto found_filename = find_case_insensitive(filename);
+
+        if (found_filename)
+            filename = *found_filename; // Overwrite case insensitive.
+
+        boost::filesystem::wofstream datafile(filename);
+        if (!datafile)
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not open file " + filename));
+
+        datafile << static_cast<wchar_t>(65279); // UTF-8 BOM character
+        datafile << entry.data << std::flush;
+        datafile.close();
+    }
+
+    // Finds the entry of key, reading its file the first time. Returns null if there is neither.
+    entry* find(const std::wstring& key, const std::wstring& name, std::unique_lock<std::mutex>& lock)
+    {
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            return &it->second;
+        }
+
+        lock.unlock();
+        auto found_file = find_case_insensitive(folder_ + name + L".ftd");
+        auto data       = found_file ? read_file(boost::filesystem::path(*found_file)) : L"";
+        lock.lock();
+
+        // NOTE: The data may have been stored or removed while the file was read, which then takes precedence.
+        it = entries_.find(key);
+        if (it != entries_.end()) {
+            return &it->second;
+        }
+
+        // NOTE: As before, empty files count as missing.
+        if (data.empty()) {
+            return nullptr;
+        }
+
+        auto& result   = entries_[key];
+        result.name    = name;
+        result.data    = std::move(data);
+        result.present = true;
+        return &result;
+    }
+
+    void store(const std::wstring& name, std::wstring data)
+    {
+        auto key = to_key(name);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto& entry = entries_[key];
+            if (entry.name.empty())
+                entry.name = name;
+            entry.data    = data;
+            entry.present = true;
+            dirty_.insert(key);
+        }
+        cond_.notify_all();
+
+        notify(key, data);
+    }
+
+    boost::optional<std::wstring> retrieve(const std::wstring& name)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        auto entry = find(to_key(name), name, lock);
+        if (!entry || !entry->present) {
+            return boost::none;
+        }
+        return entry->data;
+    }
+
+    bool remove(const std::wstring& name)
+    {
+        auto key = to_key(name);
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            auto entry = find(key, name, lock);
+            if (!entry || !entry->present) {
+                return false;
+            }
+            entry->present = false;
+            entry->data.clear();
+            dirty_.insert(key);
+        }
+        cond_.notify_all();
+        return true;
+    }
+
+    void notify(const std::wstring& key, const std::wstring& data)
+    {
+        std::vector<subscription> subscriptions;
+        {
+            std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+            for (auto& subscription : subscriptions_) {
+                if (subscription.second.key == key)
+                    subscriptions.push_back(subscription.second);
+            }
+        }
+
+        for (auto& subscription : subscriptions) {
+            bool keep = false;
+            try {
+                keep = subscription.listener(data);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            if (!keep) {
+                std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+                for (auto it = subscriptions_.begin(); it != subscriptions_.end(); ++it) {
+                    if (it->second.id == subscription.id) {
+                        subscriptions_.erase(it);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    void subscribe(const std::wstring& subscriber, const std::wstring& name, listener_t listener)
+    {
+        std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+        subscriptions_[subscriber] = subscription{to_key(name), std::move(listener), next_subscription_id_++};
+    }
+
+    void unsubscribe(const std::wstring& subscriber)
+    {
+        std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+        subscriptions_.erase(subscriber);
+    }
+};
+
+data_store::data_store(std::wstring folder, std::chrono::milliseconds flush_interval)
+    : impl_(new impl(std::move(folder), flush_interval))
+{
+}
+data_store::~data_store() {}
+void data_store::store(const std::wstring& name, std::wstring data) { impl_->store(name, std::move(data)); }
+boost::optional<std::wstring> data_store::retrieve(const std::wstring& name) { return impl_->retrieve(name); }
+bool                          data_store::remove(const std::wstring& name) { return impl_->remove(name); }
+void                          data_store::flush() { impl_->write_dirty(); }
+void data_store::subscribe(const std::wstring& subscriber, const std::wstring& name, listener_t listener)
+{
+    impl_->subscribe(subscriber, name, std::move(listener));
+}
+void data_store::unsubscribe(const std::wstring& subscriber) { impl_->unsubscribe(subscriber); }
+
+}}} // namespace caspar::protocol::amcp
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <boost/optional.hpp>
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+// The .ftd files of the data folder, kept in memory by case insensitive name. Stored data is written to its file by a
+// background thread at most once per flush interval, however often it changes.
+class data_store final
+{
+    data_store(const data_store&);
+    data_store& operator=(const data_store&);
+
+  public:
+    // Returns false to be unsubscribed.
+    typedef std::function<bool(const std::wstring& data)> listener_t;
+
+    data_store(std::wstring folder, std::chrono::milliseconds flush_interval);
+    ~data_store(); // Writes what has not been written yet.
+
+    void                          store(const std::wstring& name, std::wstring data);
+    boost::optional<std::wstring> retrieve(const std::wstring& name);
+    bool                          remove(const std::wstring& name); // Returns false if there is no such data.
+
+    // Waits until everything stored or removed so far is on disk.
+    void flush();
+
+    // Calls listener with the data of name whenever it is stored. A subscriber has at most one subscription, which a
+    // later subscribe replaces.
+    void subscribe(const std::wstring& subscriber, const std::wstring& name, listener_t listener);
+    void unsubscribe(const std::wstring& subscriber);
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::amcp
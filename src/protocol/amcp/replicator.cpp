@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "replicator.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+
+#include <array>
+#include <chrono>
+#include <deque>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+using boost::asio::ip::tcp;
+
+// NOTE: All members but the constants are only used on the io_service, which runs one handler at a time.
+struct replicator::impl : std::enable_shared_from_this<impl>
+{
+    std::shared_ptr<boost::asio::io_service> service_;
+    const std::wstring                       address_;
+    const std::string                        host_;
+    const std::string                        port_;
+    const int                                delay_;
+
+    tcp::resolver             resolver_;
+    tcp::socket               socket_;
+    boost::asio::steady_timer retry_timer_;
+    bool                      connected_ = false;
+    bool                      closed_    = false;
+    std::deque<std::string>   queue_;
+    std::array<char, 1024>    replies_;
+
+    impl(std::shared_ptr<boost::asio::io_service> service, const std::wstring& address, int delay)
+        : service_(std::move(service))
+        , address_(address)
+        , host_(u8(address.substr(0, address.rfind(L':'))))
+        , port_(address.rfind(L':') == std::wstring::npos ? "5250" : u8(address.substr(address.rfind(L':') + 1)))
+        , delay_(delay)
+        , resolver_(*service_)
+        , socket_(*service_)
+        , retry_timer_(*service_)
+    {
+        if (host_.empty()) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid replication backup: " + address));
+        }
+    }
+
+    void connect()
+    {
+        auto self = shared_from_this();
+        resolver_.async_resolve(
+            tcp::resolver::query(host_, port_),
+            [self](const boost::system::error_code& ec, tcp::resolver::iterator endpoints) {
+                if (ec) {
+                    self->retry();
+                    return;
+                }
+                boost::asio::async_connect(
+                    self->socket_, endpoints, [self](const boost::system::error_code& ec, tcp::resolver::iterator) {
+                        if (ec) {
+                            self->retry();
+                            return;
+                        }
+                        self->socket_.set_option(tcp::no_delay(true));
+                        self->connected_ = true;
+                        CASPAR_LOG(info) << L"Replicating stage commands to " << self->address_ << L".";
+                        self->read();
+                    });
+            });
+    }
+
+    void retry()
+    {
+        boost::system::error_code ec;
+        socket_.close(ec);
+        connected_ = false;
+        queue_.clear();
+
+        if (closed_) {
+            return;
+        }
+
+        auto self = shared_from_this();
+        retry_timer_.expires_from_now(std::chrono::seconds(1));
+        retry_timer_.async_wait([self](const boost::system::error_code& ec) {
+            if (!ec && !self->closed_) {
+                self->connect();
+            }
+        });
+    }
+
+    void disconnected()
+    {
+        if (!connected_) {
+            return;
+        }
+        CASPAR_LOG(warning) << L"Lost replication backup " << address_ << L", stage commands are dropped until it "
+                            << L"reconnects.";
+        retry();
+    }
+
+    // The replies of the backup are only read to keep its send queue from filling up.
+    void read()
+    {
+        auto self = shared_from_this();
+        socket_.async_read_some(boost::asio::buffer(replies_),
+                                [self](const boost::system::error_code& ec, std::size_t) {
+                                    if (ec) {
+                                        self->disconnected();
+                                        return;
+                                    }
+                                    self->read();
+                                });
+    }
+
+    void write()
+    {
+        auto self = shared_from_this();
+        boost::asio::async_write(
+            socket_, boost::asio::buffer(queue_.front()), [self](const boost::system::error_code& ec, std::size_t) {
+                if (ec) {
+                    self->disconnected();
+                    return;
+                }
+                self->queue_.pop_front();
+                if (!self->queue_.empty()) {
+                    self->write();
+                }
+            });
+    }
+
+    void send(std::string batch)
+    {
+        auto self = shared_from_this();
+        service_->post([self, batch = std::move(batch)]() mutable {
+            if (!self->connected_) {
+                return;
+            }
+            self->queue_.push_back(std::move(batch));
+            if (self->queue_.size() == 1) {
+                self->write();
+            }
+        });
+    }
+
+    void close()
+    {
+        auto self = shared_from_this();
+        service_->post([self] {
+            self->closed_ = true;
+            self->retry_timer_.cancel();
+            self->resolver_.cancel();
+            self->retry();
+        });
+    }
+};
+
+replicator::replicator(std::shared_ptr<boost::asio::io_service> service, const std::wstring& address, int delay)
+    : impl_(std::make_shared<impl>(std::move(service), address, delay))
+{
+    impl_->connect();
+}
+replicator::~replicator() { impl_->close(); }
+int  replicator::delay() const { return impl_->delay_; }
+void replicator::send(const std::vector<std::wstring>& messages, std::int64_t reference_frame)
+{
+    std::wstring batch = L"BEGIN\r\n";
+    for (auto& message : messages) {
+        batch += message + L"\r\n";
+    }
+    batch += reference_frame < 0 ? L"COMMIT\r\n" : L"COMMIT FRAME " + std::to_wstring(reference_frame) + L"\r\n";
+
+    impl_->send(u8(batch));
+}
+
+}}} // namespace caspar::protocol::amcp
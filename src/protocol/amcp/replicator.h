@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/asio/io_service.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+// Sends the stage commands of this server to the AMCP port of a backup, as batches committed on a frame of the
+// reference clock the channels of both servers are paced by, so that the backup plays out the same frames. Commands
+// are dropped while the backup is not connected, it is reconnected to every second.
+class replicator
+{
+  public:
+    replicator(std::shared_ptr<boost::asio::io_service> service, const std::wstring& address, int delay);
+    ~replicator();
+
+    replicator(const replicator&) = delete;
+    replicator& operator=(const replicator&) = delete;
+
+    // Ticks from the one a replicated command is received on to the one it takes effect on, on both servers, which
+    // is the time the backup has to create its producers.
+    int delay() const;
+
+    // Sends the AMCP messages to the backup as a batch which is committed on reference_frame, or on its next tick if
+    // it is negative.
+    void send(const std::vector<std::wstring>& messages, std::int64_t reference_frame);
+
+  private:
+    struct impl;
+    std::shared_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::amcp
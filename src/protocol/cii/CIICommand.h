@@ -25,6 +25,7 @@
 
 namespace caspar { namespace protocol { namespace cii {
 
+// Commands are reused, so Setup() replaces all state left by the previous message.
 class ICIICommand
 {
   public:
@@ -49,6 +49,10 @@ void MediaCommand::Execute() { pCIIStrategy_->SetProfile(graphicProfile_); }
 // WriteCommand
 void WriteCommand::Setup(const std::vector<std::wstring>& parameters)
 {
+    targetName_.clear();
+    templateName_.clear();
+    xmlData_.clear();
+
     try {
         if (parameters.size() > 2) {
             targetName_   = parameters[1];
@@ -76,6 +80,8 @@ void WriteCommand::Execute() { pCIIStrategy_->WriteTemplateData(templateName_, t
 // ImagestoreCommand
 void ImagestoreCommand::Setup(const std::vector<std::wstring>& parameters)
 {
+    titleName_.clear();
+
     if (parameters[1] == L"7" && parameters.size() > 2)
         titleName_ = parameters[2].substr(0, 4);
 }
@@ -86,6 +92,11 @@ void ImagestoreCommand::Execute() { pCIIStrategy_->DisplayTemplate(titleName_);
 // MiscellaneousCommand
 void MiscellaneousCommand::Setup(const std::vector<std::wstring>& parameters)
 {
+    filename_.clear();
+    xmlData_.clear();
+    state_ = -1;
+    layer_ = 0;
+
     // HAWRYS:	V\5\3\1\1\namn.tga\1
     //			Display still
     if ((parameters.size() > 5) && parameters[1] == L"5" && parameters[2] == L"3") {
@@ -165,6 +176,10 @@ void KeydataCommand::Execute()
 
 void KeydataCommand::Setup(const std::vector<std::wstring>& parameters)
 {
+    titleName_.clear();
+    state_ = -1;
+    layer_ = 0;
+
     // HAWRYS:	Y\<205><247><202><196><192><192><200><248>
     // parameter[1] looks like this: "=g:XXXXh" where XXXX is the name that we want
     if (parameters[1].size() > 6) {
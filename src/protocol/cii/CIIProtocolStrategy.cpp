@@ -23,6 +23,9 @@
 
 #include "CIICommandsImpl.h"
 #include "CIIProtocolStrategy.h"
+
+#include "../util/field_tokenizer.h"
+
 #include <algorithm>
 #include <common/env.h>
 #include <core/diagnostics/call_context.h>
@@ -47,7 +50,12 @@ const wchar_t      CIIProtocolStrategy::TokenDelimiter   = L'\\';
 CIIProtocolStrategy::CIIProtocolStrategy(const std::vector<spl::shared_ptr<core::video_channel>>&    channels,
                                          const spl::shared_ptr<core::cg_producer_registry>&          cg_registry,
                                          const spl::shared_ptr<const core::frame_producer_registry>& producer_registry)
-    : executor_(L"CIIProtocolStrategy")
+    : mediaCommand_(std::make_shared<MediaCommand>(this))
+    , writeCommand_(std::make_shared<WriteCommand>(this))
+    , imagestoreCommand_(std::make_shared<ImagestoreCommand>(this))
+    , miscellaneousCommand_(std::make_shared<MiscellaneousCommand>(this))
+    , keydataCommand_(std::make_shared<KeydataCommand>(this))
+    , executor_(L"CIIProtocolStrategy", executor_mode::strand)
     , pChannel_(channels.at(0))
     , channels_(channels)
     , cg_registry_(cg_registry)
@@ -70,39 +78,27 @@ void CIIProtocolStrategy::ProcessMessage(const std::wstring& message, IO::Client
     CASPAR_LOG(info) << L"Received message from " << pClientInfo->address() << ": " << message << L"\\r\\n";
 
     std::vector<std::wstring> tokens;
-    int                       tokenCount = TokenizeMessage(message, &tokens);
+    tokens.reserve(8);
+    int tokenCount = TokenizeMessage(message, &tokens);
 
-    CIICommandPtr pCommand = Create(tokens[0]);
+    CIICommandPtr pCommand = GetCommand(tokens[0]);
     if ((pCommand != 0) && (tokenCount - 1) >= pCommand->GetMinimumParameters()) {
-        pCommand->Setup(tokens);
-        executor_.begin_invoke([=] { pCommand->Execute(); });
+        // The command is shared, so it is set up where it is executed.
+        executor_.begin_invoke([=, tokens = std::move(tokens)] {
+            pCommand->Setup(tokens);
+            pCommand->Execute();
+        });
     } else {
     } // report error
 }
 
 int CIIProtocolStrategy::TokenizeMessage(const std::wstring& message, std::vector<std::wstring>* pTokenVector)
 {
-    std::wstringstream currentToken;
-
-    for (unsigned int charIndex = 0; charIndex < message.size(); ++charIndex) {
-        if (message[charIndex] == TokenDelimiter) {
-            pTokenVector->push_back(currentToken.str());
-            currentToken.str(L"");
-            continue;
-        }
-
-        if (message[charIndex] == L'\"')
-            currentToken << L"&quot;";
-        else if (message[charIndex] == L'<')
-            currentToken << L"&lt;";
-        else if (message[charIndex] == L'>')
-            currentToken << L"&gt;";
-        else
-            currentToken << message[charIndex];
-    }
+    IO::split_fields(message.data(), message.data() + message.size(), TokenDelimiter, *pTokenVector);
 
-    if (currentToken.str().size() > 0)
-        pTokenVector->push_back(currentToken.str());
+    // A message ending with a delimiter has no last field.
+    if (pTokenVector->size() > 1 && pTokenVector->back().empty())
+        pTokenVector->pop_back();
 
     return (int)pTokenVector->size();
 }
@@ -141,19 +137,19 @@ att skickas med (<27> = ESC) Y\<254>\\ Clear Canvas. H�r kommer ett lagerID oc
 t�mmas Y\<213><243>\\ Play. H�r kommer ett lagerID ocks� att skickas med
 
 **********************/
-CIICommandPtr CIIProtocolStrategy::Create(const std::wstring& name)
+CIICommandPtr CIIProtocolStrategy::GetCommand(const std::wstring& name) const
 {
     switch (name[0]) {
         case L'M':
-            return std::make_shared<MediaCommand>(this);
+            return mediaCommand_;
         case L'W':
-            return std::make_shared<WriteCommand>(this);
+            return writeCommand_;
         case L'T':
-            return std::make_shared<ImagestoreCommand>(this);
+            return imagestoreCommand_;
         case L'V':
-            return std::make_shared<MiscellaneousCommand>(this);
+            return miscellaneousCommand_;
         case L'Y':
-            return std::make_shared<KeydataCommand>(this);
+            return keydataCommand_;
         default:
             return nullptr;
     }
@@ -108,7 +108,14 @@ class CIIProtocolStrategy : public IO::IProtocolStrategy
 
     void          ProcessMessage(const std::wstring& message, IO::ClientInfoPtr pClientInfo);
     int           TokenizeMessage(const std::wstring& message, std::vector<std::wstring>* pTokenVector);
-    CIICommandPtr Create(const std::wstring& name);
+    CIICommandPtr GetCommand(const std::wstring& name) const;
+
+    // NOTE: One instance of each command is set up and executed in turn on executor_.
+    CIICommandPtr mediaCommand_;
+    CIICommandPtr writeCommand_;
+    CIICommandPtr imagestoreCommand_;
+    CIICommandPtr miscellaneousCommand_;
+    CIICommandPtr keydataCommand_;
 
     executor     executor_;
     std::wstring currentMessage_;
@@ -24,26 +24,30 @@
 #include "CLKProtocolStrategy.h"
 #include "clk_commands.h"
 
-#include <algorithm>
+#include "../util/field_tokenizer.h"
+
 #include <boost/algorithm/string/case_conv.hpp>
-#include <locale>
-#include <sstream>
+
+#include <algorithm>
 #include <string>
 #include <vector>
 
 namespace caspar { namespace protocol { namespace CLK {
 
+// A message is <SOH>command[<STX>parameter...]<NUL>. The bytes of a message are collected as they arrive, possibly
+// over several reads, and split once its terminator is seen. The buffers are kept from one message to the next, as
+// clock feeds send many small messages per second.
 class CLKProtocolStrategy : public IO::protocol_strategy<wchar_t>
 {
-    enum class ParserState
+    enum : wchar_t
     {
-        ExpectingNewCommand,
-        ExpectingCommand,
-        ExpectingParameter
+        start_of_message = 1,
+        start_of_text    = 2,
+        end_of_message   = 0
     };
 
-    ParserState                         currentState_ = ParserState::ExpectingNewCommand;
-    std::wstringstream                  currentCommandString_;
+    bool                                in_message_ = false;
+    std::wstring                        message_;
     std::wstring                        command_name_;
     std::vector<std::wstring>           parameters_;
     clk_command_processor&              command_processor_;
@@ -55,76 +59,88 @@ class CLKProtocolStrategy : public IO::protocol_strategy<wchar_t>
         : command_processor_(command_processor)
         , client_connection_(client_connection)
     {
+        parameters_.reserve(8);
     }
 
     void parse(const std::basic_string<wchar_t>& data)
     {
-        for (int index = 0; index < data.length(); ++index) {
-            wchar_t currentByte = data[index];
+        auto begin = data.data();
+        auto end   = begin + data.size();
 
-            if (currentByte < 32)
-                currentCommandString_ << L"<" << static_cast<int>(currentByte) << L">";
-            else
-                currentCommandString_ << currentByte;
-
-            if (currentByte != 0) {
-                switch (currentState_) {
-                    case ParserState::ExpectingNewCommand:
-                        if (currentByte == 1)
-                            currentState_ = ParserState::ExpectingCommand;
-                        // just throw anything else away
-                        break;
-                    case ParserState::ExpectingCommand:
-                        if (currentByte == 2)
-                            currentState_ = ParserState::ExpectingParameter;
-                        else
-                            command_name_ += currentByte;
-                        break;
-                    case ParserState::ExpectingParameter:
-                        // allocate new parameter
-                        if (parameters_.size() == 0 || currentByte == 2)
-                            parameters_.push_back(std::wstring());
-
-                        // add the character to end end of the last parameter
-                        if (currentByte != 2) {
-                            // add the character to end end of the last parameter
-                            if (currentByte == L'<')
-                                parameters_.back() += L"&lt;";
-                            else if (currentByte == L'>')
-                                parameters_.back() += L"&gt;";
-                            else if (currentByte == L'\"')
-                                parameters_.back() += L"&quot;";
-                            else
-                                parameters_.back() += currentByte;
-                        }
-
-                        break;
-                }
-            } else {
-                boost::to_upper(command_name_);
-
-                try {
-                    if (!command_processor_.handle(command_name_, parameters_))
-                        CASPAR_LOG(error) << "CLK: Unknown command: " << command_name_;
-                    else
-                        CASPAR_LOG(info) << L"CLK: Executed valid command: " << currentCommandString_.str();
-                } catch (...) {
-                    CASPAR_LOG_CURRENT_EXCEPTION();
-                    CASPAR_LOG(error) << "CLK: Failed to interpret command: " << currentCommandString_.str();
-                }
-
-                reset();
-            }
+        while (begin != end) {
+            auto terminator = std::find(begin, end, static_cast<wchar_t>(end_of_message));
+
+            append(begin, terminator);
+
+            if (terminator == end)
+                break;
+
+            if (in_message_)
+                handle_message();
+
+            in_message_ = false;
+            message_.clear();
+            begin = terminator + 1;
         }
     }
 
   private:
-    void reset()
+    void append(const wchar_t* begin, const wchar_t* end)
+    {
+        if (!in_message_) {
+            // just throw anything before the start of a message away
+            begin = std::find(begin, end, static_cast<wchar_t>(start_of_message));
+            if (begin == end)
+                return;
+
+            in_message_ = true;
+            ++begin;
+        }
+
+        message_.append(begin, end);
+    }
+
+    void handle_message()
     {
-        currentState_ = ParserState::ExpectingNewCommand;
-        currentCommandString_.str(L"");
-        command_name_.clear();
+        auto begin      = message_.data();
+        auto end        = begin + message_.size();
+        auto parameters = std::find(begin, end, static_cast<wchar_t>(start_of_text));
+
+        command_name_.assign(begin, parameters);
+        boost::to_upper(command_name_);
+
         parameters_.clear();
+        if (parameters != end && ++parameters != end) {
+            // A delimiter right after the one ending the command name does not start an empty parameter.
+            if (*parameters == start_of_text)
+                ++parameters;
+
+            IO::split_fields(parameters, end, start_of_text, parameters_);
+        }
+
+        try {
+            if (!command_processor_.handle(command_name_, parameters_))
+                CASPAR_LOG(error) << "CLK: Unknown command: " << command_name_;
+            else
+                CASPAR_LOG(debug) << L"CLK: Executed valid command: " << printable_message();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(error) << "CLK: Failed to interpret command: " << printable_message();
+        }
+    }
+
+    std::wstring printable_message() const
+    {
+        std::wstring result = L"<1>";
+
+        for (auto c : message_) {
+            if (c < 32)
+                result += L"<" + std::to_wstring(static_cast<int>(c)) + L">";
+            else
+                result += c;
+        }
+
+        return result + L"<0>";
     }
 };
 
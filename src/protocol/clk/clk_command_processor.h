@@ -21,8 +21,8 @@
 
 #pragma once
 
-#include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <common/memory.h>
@@ -40,7 +40,7 @@ typedef boost::function<void(const std::vector<std::wstring>&)> clk_command_hand
  */
 class clk_command_processor
 {
-    std::map<std::wstring, clk_command_handler> handlers_;
+    std::unordered_map<std::wstring, clk_command_handler> handlers_;
 
   public:
     /**
@@ -22,7 +22,7 @@
 #include "../StdAfx.h"
 
 #include <future>
-#include <sstream>
+#include <mutex>
 #include <stdexcept>
 
 #include <boost/lexical_cast.hpp>
@@ -38,9 +38,12 @@
 
 namespace caspar { namespace protocol { namespace CLK {
 
+// Clock data is sent to the proxy the clock template was added with, which spares each update a round trip to the
+// channel for the producer on the layer. The lock serializes clock feeds on different connections.
 class command_context
 {
-    bool                                                 clock_loaded_ = false;
+    std::mutex                                           mutex_;
+    std::shared_ptr<core::cg_proxy>                      clock_;
     std::vector<spl::shared_ptr<core::video_channel>>    channels_;
     spl::shared_ptr<core::video_channel>                 channel_;
     spl::shared_ptr<core::cg_producer_registry>          cg_registry_;
@@ -60,24 +63,28 @@ class command_context
 
     void send_to_flash(const std::wstring& data)
     {
-        if (!clock_loaded_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!clock_) {
             core::frame_producer_dependencies dependencies(
                 channel_->frame_factory(), channels_, channel_->video_format_desc(), producer_registry_, cg_registry_);
-            cg_registry_
-                ->get_or_create_proxy(channel_, dependencies, core::cg_proxy::DEFAULT_LAYER, L"hawrysklocka/clock")
-                ->add(0, L"hawrysklocka/clock", true, L"", data);
-            clock_loaded_ = true;
+            auto clock = cg_registry_->get_or_create_proxy(
+                channel_, dependencies, core::cg_proxy::DEFAULT_LAYER, L"hawrysklocka/clock");
+            clock->add(0, L"hawrysklocka/clock", true, L"", data);
+            clock_ = std::move(clock);
         } else {
-            cg_registry_->get_proxy(channel_, core::cg_proxy::DEFAULT_LAYER)->update(0, data);
+            clock_->update(0, data);
         }
 
-        CASPAR_LOG(info) << L"CLK: Clockdata sent: " << data;
+        CASPAR_LOG(debug) << L"CLK: Clockdata sent: " << data;
     }
 
     void reset()
     {
+        std::lock_guard<std::mutex> lock(mutex_);
+
         channel_->stage().clear(core::cg_proxy::DEFAULT_LAYER);
-        clock_loaded_ = false;
+        clock_.reset();
         CASPAR_LOG(info) << L"CLK: Recieved and executed reset-command";
     }
 };
@@ -100,39 +107,48 @@ T require_param(std::vector<std::wstring>::const_iterator&       params_current,
 std::wstring
 get_xml(const std::wstring& command_name, bool has_clock_id, bool has_time, const std::vector<std::wstring>& parameters)
 {
-    std::wstringstream stream;
+    std::wstring xml;
+    xml.reserve(128);
 
-    stream << L"<templateData>";
-    stream << L"<componentData id=\"command\">";
-    stream << L"<command id=\"" << command_name << "\"";
+    xml += L"<templateData>";
+    xml += L"<componentData id=\"command\">";
+    xml += L"<command id=\"";
+    xml += command_name;
+    xml += L"\"";
 
     std::vector<std::wstring>::const_iterator it  = parameters.begin();
     std::vector<std::wstring>::const_iterator end = parameters.end();
 
     if (has_clock_id) {
-        stream << L" clockID=\"" << require_param<int>(it, end, "clock id") << L"\"";
+        xml += L" clockID=\"";
+        xml += std::to_wstring(require_param<int>(it, end, "clock id"));
+        xml += L"\"";
     }
 
     if (has_time) {
-        stream << L" time=\"" << require_param<std::wstring>(it, end, "time") << L"\"";
+        xml += L" time=\"";
+        xml += require_param<std::wstring>(it, end, "time");
+        xml += L"\"";
     }
 
     bool has_parameters = it != end;
 
-    stream << (has_parameters ? L">" : L" />");
+    xml += has_parameters ? L">" : L" />";
 
     if (has_parameters) {
         for (; it != end; ++it) {
-            stream << L"<parameter>" << (*it) << L"</parameter>";
+            xml += L"<parameter>";
+            xml += *it;
+            xml += L"</parameter>";
         }
 
-        stream << L"</command>";
+        xml += L"</command>";
     }
 
-    stream << L"</componentData>";
-    stream << L"</templateData>";
+    xml += L"</componentData>";
+    xml += L"</templateData>";
 
-    return stream.str();
+    return xml;
 }
 
 clk_command_handler create_send_xml_handler(const std::wstring&                     command_name,
@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "metrics_exporter.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/diagnostics/call_context.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The series of the graphs are sampled every 10 ms and served as:
+//
+//   casparcg_graph_value        histogram of the values of a series. Timings are scaled like in the OSD, where 0.5 is
+//                               a whole frame, so the 0.5 bucket counts the values which were within budget.
+//   casparcg_graph_last_value   gauge of the latest value of a series.
+//   casparcg_graph_tags_total   counter of the tags of a series, e.g. underflow, late-frame or dropped-frame.
+//
+// Each with the labels channel, layer, producer and series. Producer is the text of the graph up to its first '[',
+// e.g. "ffmpeg" or "video_channel". Only the latest value is seen when a series changes more than once between two
+// samples, tags are counted exactly.
+
+namespace caspar { namespace protocol { namespace metrics {
+
+namespace {
+
+const double value_buckets[] = {0.05, 0.1, 0.25, 0.5, 0.75, 1.0, 1.5};
+const int    bucket_count    = sizeof(value_buckets) / sizeof(value_buckets[0]);
+
+struct series_metrics
+{
+    std::int64_t buckets[bucket_count + 1] = {}; // Not cumulative, the last one is +Inf.
+    std::int64_t count                     = 0;
+    double       sum                       = 0.0;
+    double       last                      = 0.0;
+    std::int64_t tags                      = 0;
+
+    void observe(double value)
+    {
+        auto n = std::lower_bound(std::begin(value_buckets), std::end(value_buckets), value) - value_buckets;
+        ++buckets[n];
+        ++count;
+        sum += value;
+        last = value;
+    }
+};
+
+std::string escape_label(const std::string& value)
+{
+    std::string result;
+    result.reserve(value.size());
+    for (auto c : value) {
+        if (c == '\\' || c == '"')
+            result += '\\';
+        if (c == '\n')
+            result += "\\n";
+        else
+            result += c;
+    }
+    return result;
+}
+
+std::string producer_label(const std::wstring& text)
+{
+    return boost::trim_copy(u8(text.substr(0, text.find(L'['))));
+}
+
+std::string context_labels(const core::diagnostics::call_context& context, const std::string& producer)
+{
+    auto label = [](int value) { return value < 0 ? std::string() : boost::lexical_cast<std::string>(value); };
+
+    return "channel=\"" + label(context.video_channel) + "\",layer=\"" + label(context.layer) + "\",producer=\"" +
+           escape_label(producer) + "\"";
+}
+
+} // namespace
+
+struct metrics_exporter::impl : public spl::enable_shared_from_this<metrics_exporter::impl>
+{
+    struct source
+    {
+        std::weak_ptr<const diagnostics::spi::graph_state>              state;
+        core::diagnostics::call_context                                 context;
+        std::map<std::string, std::pair<std::uint32_t, std::uint32_t>> seen; // Values and tags by series.
+    };
+
+    // NOTE: A sink only hands its graph to the exporter, which keeps it weakly, so that a graph does not outlive its
+    // owner through its sinks.
+    class sink : public diagnostics::spi::graph_sink
+    {
+        std::weak_ptr<impl>             exporter_;
+        core::diagnostics::call_context context_ = core::diagnostics::call_context::for_thread();
+
+      public:
+        explicit sink(std::weak_ptr<impl> exporter)
+            : exporter_(std::move(exporter))
+        {
+        }
+
+        void activate(const spl::shared_ptr<const diagnostics::spi::graph_state>& state) override
+        {
+            auto exporter = exporter_.lock();
+            if (exporter)
+                exporter->add(state, context_);
+        }
+    };
+
+    std::mutex                            mutex_;
+    std::condition_variable               cond_;
+    std::vector<source>                   sources_;
+    std::map<std::string, series_metrics> metrics_; // By labels, kept after their graphs are gone.
+    bool                                  abort_request_ = false;
+    std::thread                           thread_;
+
+    impl()
+        : thread_([this] { run(); })
+    {
+    }
+
+    ~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_request_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    void add(const spl::shared_ptr<const diagnostics::spi::graph_state>& state,
+             const core::diagnostics::call_context&                       context)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sources_.push_back(source{state, context, {}});
+    }
+
+    std::string render()
+    {
+        std::string values = "# HELP casparcg_graph_value Values of the diagnostics graph series.\n"
+                             "# TYPE casparcg_graph_value histogram\n";
+        std::string lasts  = "# HELP casparcg_graph_last_value Latest value of the diagnostics graph series.\n"
+                             "# TYPE casparcg_graph_last_value gauge\n";
+        std::string tags   = "# HELP casparcg_graph_tags_total Tags of the diagnostics graph series.\n"
+                             "# TYPE casparcg_graph_tags_total counter\n";
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (auto& p : metrics_) {
+            auto& labels = p.first;
+            auto& m      = p.second;
+
+            if (m.count > 0) {
+                std::int64_t cumulative = 0;
+                for (int n = 0; n <= bucket_count; ++n) {
+                    cumulative += m.buckets[n];
+                    auto le = n < bucket_count ? boost::lexical_cast<std::string>(value_buckets[n]) : "+Inf";
+                    values += "casparcg_graph_value_bucket{" + labels + ",le=\"" + le + "\"} " +
+                              boost::lexical_cast<std::string>(cumulative) + "\n";
+                }
+                values += "casparcg_graph_value_sum{" + labels + "} " + boost::lexical_cast<std::string>(m.sum) + "\n";
+                values += "casparcg_graph_value_count{" + labels + "} " + boost::lexical_cast<std::string>(m.count) +
+                          "\n";
+                lasts += "casparcg_graph_last_value{" + labels + "} " + boost::lexical_cast<std::string>(m.last) + "\n";
+            }
+
+            if (m.tags > 0)
+                tags += "casparcg_graph_tags_total{" + labels + "} " + boost::lexical_cast<std::string>(m.tags) + "\n";
+        }
+
+        return values + lasts + tags;
+    }
+
+  private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        while (!abort_request_) {
+            try {
+                sample();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+            cond_.wait_for(lock, std::chrono::milliseconds(10), [this] { return abort_request_; });
+        }
+    }
+
+    // Called with mutex_ held.
+    void sample()
+    {
+        auto it = sources_.begin();
+        while (it != sources_.end()) {
+            auto state = it->state.lock();
+            if (!state) {
+                it = sources_.erase(it);
+                continue;
+            }
+
+            auto& seen   = it->seen;
+            auto  labels = context_labels(it->context, producer_label(state->text()));
+
+            state->for_each([&](const std::string& name, const diagnostics::spi::graph_series& series) {
+                auto  values = series.values.load(std::memory_order_acquire);
+                auto  tags   = series.tags.load(std::memory_order_acquire);
+                auto& last   = seen[name];
+
+                if (values == last.first && tags == last.second)
+                    return;
+
+                auto& m = metrics_[labels + ",series=\"" + escape_label(name) + "\""];
+                if (values != last.first)
+                    m.observe(series.value.load(std::memory_order_relaxed));
+                m.tags += static_cast<std::uint32_t>(tags - last.second);
+
+                last = std::make_pair(values, tags);
+            });
+
+            ++it;
+        }
+    }
+};
+
+namespace {
+
+// Answers every complete request on a connection, which is kept open for the next scrape.
+class metrics_protocol : public IO::protocol_strategy<char>
+{
+    std::shared_ptr<metrics_exporter::impl> exporter_;
+    IO::client_connection<char>::ptr        client_;
+    std::string                             input_;
+
+  public:
+    metrics_protocol(std::shared_ptr<metrics_exporter::impl> exporter, IO::client_connection<char>::ptr client)
+        : exporter_(std::move(exporter))
+        , client_(std::move(client))
+    {
+    }
+
+    void parse(const std::string& data) override
+    {
+        input_ += data;
+
+        std::size_t pos;
+        while ((pos = input_.find("\r\n\r\n")) != std::string::npos) {
+            auto request_line = input_.substr(0, input_.find("\r\n"));
+            input_.erase(0, pos + 4);
+
+            std::string status = "200 OK";
+            std::string body;
+
+            if (boost::starts_with(request_line, "GET /metrics ") || boost::starts_with(request_line, "GET / ")) {
+                body = exporter_->render();
+            } else {
+                status = "404 Not Found";
+                body   = "Not Found\n";
+            }
+
+            std::string response = "HTTP/1.1 " + status + "\r\n";
+            response += "Content-Type: text/plain; version=0.0.4\r\n";
+            response += "Content-Length: " + boost::lexical_cast<std::string>(body.size()) + "\r\n\r\n";
+            response += body;
+
+            client_->send(std::move(response), true);
+        }
+    }
+};
+
+class metrics_protocol_factory : public IO::protocol_strategy_factory<char>
+{
+    std::shared_ptr<metrics_exporter::impl> exporter_;
+
+  public:
+    explicit metrics_protocol_factory(std::shared_ptr<metrics_exporter::impl> exporter)
+        : exporter_(std::move(exporter))
+    {
+    }
+
+    IO::protocol_strategy<char>::ptr create(const IO::client_connection<char>::ptr& client_connection) override
+    {
+        return spl::make_shared<metrics_protocol>(exporter_, client_connection);
+    }
+};
+
+} // namespace
+
+metrics_exporter::metrics_exporter()
+    : impl_(spl::make_shared<impl>())
+{
+    std::weak_ptr<impl> weak_impl = impl_;
+    diagnostics::spi::register_sink_factory([weak_impl] { return spl::make_shared<impl::sink>(weak_impl); });
+}
+
+metrics_exporter::~metrics_exporter() {}
+
+spl::shared_ptr<IO::protocol_strategy_factory<char>> metrics_exporter::protocol_factory()
+{
+    return spl::make_shared<metrics_protocol_factory>(impl_);
+}
+
+}}} // namespace caspar::protocol::metrics
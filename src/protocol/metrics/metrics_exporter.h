@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../util/protocol_strategy.h"
+
+#include <common/memory.h>
+
+namespace caspar { namespace protocol { namespace metrics {
+
+// Aggregates the series of every diagnostics graph registered after it was created into histograms and counters,
+// labelled by the channel, layer and producer of the graph, and serves them to Prometheus over HTTP. See
+// metrics_exporter.cpp for the metrics.
+class metrics_exporter
+{
+  public:
+    metrics_exporter();
+    ~metrics_exporter();
+
+    metrics_exporter(const metrics_exporter&) = delete;
+    metrics_exporter& operator=(const metrics_exporter&) = delete;
+
+    // The protocol of a controller which answers HTTP GET /metrics requests.
+    spl::shared_ptr<IO::protocol_strategy_factory<char>> protocol_factory();
+
+    struct impl;
+
+  private:
+    spl::shared_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::metrics
@@ -24,19 +24,27 @@
 
 #include "client.h"
 
+#include "../util/address_pattern.h"
+
 #include "oscpack/OscHostEndianness.h"
 #include "oscpack/OscOutboundPacketStream.h"
 
 #include <common/endian.h>
+#include <common/env.h>
 #include <common/except.h>
+#include <common/log.h>
 #include <common/utf.h>
 
 #include <core/monitor/monitor.h>
 
 #include <boost/asio.hpp>
-#include <boost/optional.hpp>
+#include <boost/property_tree/ptree.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <map>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -66,73 +74,140 @@ struct param_visitor : public boost::static_visitor<void>
     void operator()(const std::wstring& value) { o << u8(value).c_str(); }
 };
 
+bundle_writer::bundle_writer(std::size_t max_packet_size)
+    : max_packet_size_(max_packet_size)
+    , message_buffer_(65507)
+{
+}
+
+void bundle_writer::write(const core::monitor::state&                                    state,
+                          const std::string&                                             filter,
+                          const std::function<void(const char* data, std::size_t size)>& send)
+{
+    // An immediate bundle, see the OSC 1.0 specification.
+    static const char header[16] = {'#', 'b', 'u', 'n', 'd', 'l', 'e', 0, 0, 0, 0, 0, 0, 0, 0, 1};
+
+    packet_.assign(std::begin(header), std::end(header));
+
+    auto flush = [&] {
+        if (packet_.size() > sizeof(header)) {
+            send(packet_.data(), packet_.size());
+        }
+        packet_.assign(std::begin(header), std::end(header));
+    };
+
+    for (auto& p : state) {
+        if (p.second.empty() || (!filter.empty() && !IO::match_address(filter.c_str(), p.first.c_str()))) {
+            continue;
+        }
+
+        ::osc::OutboundPacketStream o(message_buffer_.data(), static_cast<unsigned long>(message_buffer_.size()));
+
+        try {
+            o << ::osc::BeginMessage(p.first.c_str());
+
+            param_visitor<decltype(o)> param_visitor(o);
+            for (const auto& element : p.second) {
+                boost::apply_visitor(param_visitor, element);
+            }
+
+            o << ::osc::EndMessage;
+        } catch (::osc::OutOfBufferMemoryException&) {
+            CASPAR_LOG_LIMITED(warning, 1) << L"[osc] Skipped message larger than a datagram: " << u16(p.first);
+            continue;
+        }
+
+        // NOTE: A message which does not fit a packet on its own is still sent, in a bundle of its own.
+        if (packet_.size() + 4 + o.Size() > max_packet_size_) {
+            flush();
+        }
+
+        auto size = static_cast<std::uint32_t>(o.Size());
+        packet_.push_back(static_cast<char>(size >> 24));
+        packet_.push_back(static_cast<char>(size >> 16));
+        packet_.push_back(static_cast<char>(size >> 8));
+        packet_.push_back(static_cast<char>(size));
+        packet_.insert(packet_.end(), o.Data(), o.Data() + o.Size());
+    }
+
+    flush();
+}
+
 struct client::impl : public spl::enable_shared_from_this<client::impl>
 {
+    struct subscriber
+    {
+        int                                   reference_count = 0;
+        subscription_settings                 settings;
+        std::uint64_t                         sent_revision = 0; // New subscribers get the complete state.
+        std::chrono::steady_clock::time_point next_send;
+    };
+
+    // The subscribers which are sent the same delta with the same filter, which is serialized once for all of them.
+    struct group
+    {
+        std::uint64_t              since;
+        std::string                filter;
+        std::vector<udp::endpoint> endpoints;
+    };
+
     std::shared_ptr<boost::asio::io_context> service_;
     udp::socket                              socket_;
-    std::map<udp::endpoint, int>             reference_counts_by_endpoint_;
-    std::vector<char>                        buffer_;
+    std::map<udp::endpoint, subscriber>      subscribers_;
 
-    std::mutex                                 mutex_;
-    std::condition_variable                    cond_;
-    boost::optional<core::monitor::state>      bundle_opt_;
-    std::atomic<bool>                          abort_request_{false};
-    std::thread                                thread_;
+    // NOTE: Bundles are split into packets which fit the MTU, since fragmented datagrams are easily dropped.
+    bundle_writer writer_;
+
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    core::monitor::state    state_;
+    std::atomic<bool>       abort_request_{false};
+    std::thread             thread_;
 
   public:
     impl(std::shared_ptr<boost::asio::io_service> service)
         : service_(std::move(service))
         , socket_(*service_, udp::v4())
-        // TODO (fix) Split into smaller packets.
-        , buffer_(1000000)
+        , writer_(std::max<std::size_t>(
+              64, env::properties().get(L"configuration.osc.max-packet-size", std::size_t(1472))))
     {
         thread_ = std::thread([=] {
             try {
                 while (!abort_request_) {
-                    core::monitor::state  bundle;
-                    std::vector<udp::endpoint> endpoints;
+                    std::vector<group>                             groups;
+                    std::map<std::uint64_t, core::monitor::state> deltas;
 
                     {
                         std::unique_lock<std::mutex> lock(mutex_);
-                        cond_.wait(lock, [&] { return bundle_opt_ || abort_request_; });
-
-                        if (abort_request_) {
-                            return;
-                        }
-
-                        bundle = std::move(*bundle_opt_);
-                        bundle_opt_.reset();
-
-                        for (auto& p : reference_counts_by_endpoint_) {
-                            endpoints.push_back(p.first);
-                        }
-                    }
-
-                    if (endpoints.empty()) {
-                        continue;
-                    }
 
-                    ::osc::OutboundPacketStream o(reinterpret_cast<char*>(buffer_.data()),
-                                                  static_cast<unsigned long>(buffer_.size()));
+                        while (groups.empty()) {
+                            if (abort_request_) {
+                                return;
+                            }
 
-                    o << ::osc::BeginBundle();
+                            auto wake = collect(std::chrono::steady_clock::now(), groups);
 
-                    for (auto& p : bundle) {
-                        o << ::osc::BeginMessage(p.first.c_str());
+                            if (!groups.empty()) {
+                                break;
+                            }
 
-                        param_visitor<decltype(o)> param_visitor(o);
-                        for (const auto& element : p.second) {
-                            boost::apply_visitor(param_visitor, element);
+                            if (wake == std::chrono::steady_clock::time_point::max()) {
+                                cond_.wait(lock);
+                            } else {
+                                cond_.wait_until(lock, wake);
+                            }
                         }
 
-                        o << ::osc::EndMessage;
+                        // Only entries changed since the last bundle of a subscriber are sent.
+                        for (auto& g : groups) {
+                            if (deltas.find(g.since) == deltas.end()) {
+                                deltas[g.since] = state_.delta(g.since);
+                            }
+                        }
                     }
 
-                    o << ::osc::EndBundle;
-
-                    boost::system::error_code ec;
-                    for (const auto& endpoint : endpoints) {
-                        socket_.send_to(boost::asio::buffer(o.Data(), o.Size()), endpoint, 0, ec);
+                    for (auto& g : groups) {
+                        send_packets(deltas[g.since], g.filter, g.endpoints);
                     }
                 }
             } catch (...) {
@@ -148,12 +223,67 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
         thread_.join();
     }
 
+    // Groups the subscribers which are due and missing changes, and returns when the next one which is held back by
+    // its rate becomes due.
+    std::chrono::steady_clock::time_point collect(std::chrono::steady_clock::time_point now, std::vector<group>& groups)
+    {
+        auto wake = std::chrono::steady_clock::time_point::max();
+
+        for (auto& p : subscribers_) {
+            auto& s = p.second;
+
+            if (s.sent_revision == state_.revision()) {
+                continue;
+            }
+
+            if (s.next_send > now) {
+                wake = std::min(wake, s.next_send);
+                continue;
+            }
+
+            auto it = std::find_if(groups.begin(), groups.end(), [&](const group& g) {
+                return g.since == s.sent_revision && g.filter == s.settings.filter;
+            });
+            if (it == groups.end()) {
+                it = groups.insert(groups.end(), group{s.sent_revision, s.settings.filter, {}});
+            }
+            it->endpoints.push_back(p.first);
+
+            s.sent_revision = state_.revision();
+            if (s.settings.max_rate > 0.0) {
+                s.next_send = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                        std::chrono::duration<double>(1.0 / s.settings.max_rate));
+            }
+        }
+
+        return wake;
+    }
+
+    void send_packets(const core::monitor::state&       bundle,
+                      const std::string&                filter,
+                      const std::vector<udp::endpoint>& endpoints)
+    {
+        writer_.write(bundle, filter, [&](const char* data, std::size_t size) {
+            boost::system::error_code ec;
+            for (const auto& endpoint : endpoints) {
+                socket_.send_to(boost::asio::buffer(data, size), endpoint, 0, ec);
+            }
+        });
+    }
+
     // TODO (refactor) This is wierd...
-    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint)
+    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                 const subscription_settings&          settings)
     {
-        std::lock_guard<std::mutex> lock(mutex_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
 
-        ++reference_counts_by_endpoint_[endpoint];
+            auto& s = subscribers_[endpoint];
+            if (++s.reference_count == 1) {
+                s.settings = settings;
+            }
+        }
+        cond_.notify_all();
 
         std::weak_ptr<impl> weak_self = shared_from_this();
 
@@ -167,19 +297,18 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
 
             std::lock_guard<std::mutex> lock(self.mutex_);
 
-            int reference_count_after = --self.reference_counts_by_endpoint_[endpoint];
-
-            if (reference_count_after == 0) {
-                self.reference_counts_by_endpoint_.erase(endpoint);
+            auto it = self.subscribers_.find(endpoint);
+            if (it != self.subscribers_.end() && --it->second.reference_count == 0) {
+                self.subscribers_.erase(it);
             }
         });
     }
 
-    void send(core::monitor::state state)
+    void send(core::monitor::state delta)
     {
         {
             std::lock_guard<std::mutex> lock(mutex_);
-            bundle_opt_ = state;
+            state_.apply(delta);
         }
         cond_.notify_all();
     }
@@ -203,11 +332,12 @@ client& client::operator=(client&& other)
 
 client::~client() {}
 
-std::shared_ptr<void> client::get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint)
+std::shared_ptr<void> client::get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                     const subscription_settings&          settings)
 {
-    return impl_->get_subscription_token(endpoint);
+    return impl_->get_subscription_token(endpoint, settings);
 }
 
-void client::send(core::monitor::state state) { impl_->send(state); }
+void client::send(core::monitor::state delta) { impl_->send(std::move(delta)); }
 
 }}} // namespace caspar::protocol::osc
@@ -28,8 +28,36 @@
 #include <common/memory.h>
 #include <core/monitor/monitor.h>
 
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
 namespace caspar { namespace protocol { namespace osc {
 
+struct subscription_settings final
+{
+    double      max_rate = 0.0; // Bundles per second at most, 0 = whenever the state changes.
+    std::string filter;         // Address pattern of the messages sent, * matches any characters, empty = all.
+};
+
+// Serializes monitor state into OSC bundles which fit a datagram.
+class bundle_writer
+{
+  public:
+    explicit bundle_writer(std::size_t max_packet_size);
+
+    // Passes every bundle of the messages of state whose address matches filter, empty = all, to send.
+    void write(const core::monitor::state&                                    state,
+               const std::string&                                             filter,
+               const std::function<void(const char* data, std::size_t size)>& send);
+
+  private:
+    std::size_t       max_packet_size_;
+    std::vector<char> message_buffer_;
+    std::vector<char> packet_;
+};
+
 class client
 {
     client(const client&);
@@ -47,16 +75,19 @@ class client
      * previously been checked out.
      *
      * @param endpoint The UDP endpoint to send OSC messages to.
+     * @param settings How often and what is sent, used by the first token of the endpoint.
      *
      * @return The token. It is ok for the token to outlive the client
      */
-    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint);
+    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                 const subscription_settings& settings = subscription_settings());
 
     ~client();
 
     client& operator=(client&&);
 
-    void send(core::monitor::state state);
+    // Merges a delta, as returned by core::monitor::state::delta, and sends what changed.
+    void send(core::monitor::state delta);
 
   private:
     struct impl;
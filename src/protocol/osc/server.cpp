@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "server.h"
+
+#include "oscpack/OscException.h"
+#include "oscpack/OscReceivedElements.h"
+
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/frame/frame_transform.h>
+#include <core/producer/stage.h>
+
+#include <boost/asio.hpp>
+#include <boost/optional.hpp>
+
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+using namespace boost::asio::ip;
+
+namespace caspar { namespace protocol { namespace osc {
+
+namespace {
+
+const double PI = std::atan(1.0) * 4.0;
+
+// The latest values received for a layer, which have not been applied yet.
+struct layer_values
+{
+    boost::optional<double>                opacity;
+    boost::optional<double>                volume;
+    boost::optional<std::array<double, 4>> fill;
+    boost::optional<std::array<double, 2>> anchor;
+    boost::optional<double>                rotation;
+
+    // Whether a transform, which takes these values when it runs, has been sent to the stage.
+    bool queued = false;
+
+    void apply(core::frame_transform& transform) const
+    {
+        auto& image = transform.image_transform;
+        if (opacity) {
+            image.opacity = *opacity;
+        }
+        if (volume) {
+            transform.audio_transform.volume = *volume;
+        }
+        if (fill) {
+            image.fill_translation = {(*fill)[0], (*fill)[1]};
+            image.fill_scale       = {(*fill)[2], (*fill)[3]};
+        }
+        if (anchor) {
+            image.anchor = *anchor;
+        }
+        if (rotation) {
+            image.angle = *rotation * PI / 180.0;
+        }
+    }
+};
+
+// The values of layers by channel and layer index, shared with the transforms sent to the stages.
+struct pending_values
+{
+    std::mutex                                  mutex;
+    std::map<std::pair<int, int>, layer_values> layers;
+};
+
+// Reads the arguments of a message as numbers, if there are N of them.
+template <std::size_t N>
+bool read_numbers(const ::osc::ReceivedMessage& message, std::array<double, N>& values)
+{
+    if (message.ArgumentCount() != N) {
+        return false;
+    }
+
+    auto arg = message.ArgumentsBegin();
+    for (std::size_t n = 0; n < N; ++n, ++arg) {
+        if (arg->IsFloat()) {
+            values[n] = arg->AsFloatUnchecked();
+        } else if (arg->IsDouble()) {
+            values[n] = arg->AsDoubleUnchecked();
+        } else if (arg->IsInt32()) {
+            values[n] = arg->AsInt32Unchecked();
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Stores the value of a message in values, returning false if its property or arguments are not known.
+bool read_property(const std::string& property, const ::osc::ReceivedMessage& message, layer_values& values)
+{
+    std::array<double, 1> value;
+
+    if (property == "opacity" && read_numbers(message, value)) {
+        values.opacity = value[0];
+    } else if (property == "volume" && read_numbers(message, value)) {
+        values.volume = value[0];
+    } else if (property == "rotation" && read_numbers(message, value)) {
+        values.rotation = value[0];
+    } else if (property == "fill") {
+        std::array<double, 4> fill;
+        if (!read_numbers(message, fill)) {
+            return false;
+        }
+        values.fill = fill;
+    } else if (property == "anchor") {
+        std::array<double, 2> anchor;
+        if (!read_numbers(message, anchor)) {
+            return false;
+        }
+        values.anchor = anchor;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+struct server::impl : public std::enable_shared_from_this<server::impl>
+{
+    std::shared_ptr<boost::asio::io_context>        service_;
+    udp::socket                                     socket_;
+    udp::endpoint                                   sender_;
+    std::vector<char>                               buffer_;
+    std::vector<std::weak_ptr<core::video_channel>> channels_;
+    std::shared_ptr<pending_values>                 pending_ = std::make_shared<pending_values>();
+
+    impl(std::shared_ptr<boost::asio::io_context>          service,
+         const udp::endpoint&                              endpoint,
+         std::vector<spl::shared_ptr<core::video_channel>> channels)
+        : service_(std::move(service))
+        , socket_(*service_, endpoint)
+        , buffer_(65536)
+    {
+        for (auto& channel : channels) {
+            channels_.push_back(channel);
+        }
+
+        CASPAR_LOG(info) << L"[osc] Listening for control messages on " << u16(endpoint.address().to_string())
+                         << L":" << endpoint.port() << L".";
+    }
+
+    void start_receive()
+    {
+        auto self = shared_from_this();
+        socket_.async_receive_from(
+            boost::asio::buffer(buffer_), sender_, [self](const boost::system::error_code& ec, std::size_t size) {
+                if (ec == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                if (!ec) {
+                    self->on_packet(size);
+                }
+                self->start_receive();
+            });
+    }
+
+    void close()
+    {
+        auto self = shared_from_this();
+        service_->post([self] {
+            boost::system::error_code ec;
+            self->socket_.close(ec);
+        });
+    }
+
+    void on_packet(std::size_t size)
+    {
+        // The layers of each channel whose values are not taken by a transform sent to the stage yet.
+        std::map<int, std::vector<int>> queue;
+
+        try {
+            ::osc::ReceivedPacket packet(buffer_.data(), static_cast<::osc::int32>(size));
+            if (packet.IsBundle()) {
+                on_bundle(::osc::ReceivedBundle(packet), queue);
+            } else {
+                on_message(::osc::ReceivedMessage(packet), queue);
+            }
+        } catch (::osc::Exception& e) {
+            CASPAR_LOG_LIMITED(debug, 1) << L"[osc] Dropped malformed packet from "
+                                         << u16(sender_.address().to_string()) << L": " << e.what();
+        }
+
+        for (auto& p : queue) {
+            send_transforms(p.first, p.second);
+        }
+    }
+
+    void on_bundle(const ::osc::ReceivedBundle& bundle, std::map<int, std::vector<int>>& queue)
+    {
+        for (auto it = bundle.ElementsBegin(); it != bundle.ElementsEnd(); ++it) {
+            if (it->IsBundle()) {
+                on_bundle(::osc::ReceivedBundle(*it), queue);
+            } else {
+                on_message(::osc::ReceivedMessage(*it), queue);
+            }
+        }
+    }
+
+    void on_message(const ::osc::ReceivedMessage& message, std::map<int, std::vector<int>>& queue)
+    {
+        int  channel = 0;
+        int  layer   = 0;
+        int  offset  = 0;
+        auto address = message.AddressPattern();
+        if (std::sscanf(address, "/channel/%d/stage/layer/%d/%n", &channel, &layer, &offset) != 2 || offset == 0 ||
+            channel < 1 || channel > static_cast<int>(channels_.size())) {
+            CASPAR_LOG_LIMITED(debug, 1) << L"[osc] Ignored message to " << u16(address);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(pending_->mutex);
+
+        auto& values = pending_->layers[std::make_pair(channel, layer)];
+        if (!read_property(address + offset, message, values)) {
+            CASPAR_LOG_LIMITED(debug, 1) << L"[osc] Ignored message to " << u16(address) << L" with arguments "
+                                         << u16(message.TypeTags());
+            return;
+        }
+
+        if (!values.queued) {
+            values.queued = true;
+            queue[channel].push_back(layer);
+        }
+    }
+
+    // NOTE: The transforms take the values of their layers when the stage runs them, so that every value received
+    // before the next tick is applied by one transform, and the stage is sent at most one per layer and tick.
+    void send_transforms(int channel_index, const std::vector<int>& layers)
+    {
+        auto channel = channels_.at(channel_index - 1).lock();
+        if (!channel) {
+            return;
+        }
+
+        std::vector<core::stage::transform_tuple_t> transforms;
+        for (auto layer : layers) {
+            auto key     = std::make_pair(channel_index, layer);
+            auto pending = pending_;
+            transforms.push_back(core::stage::transform_tuple_t(
+                layer,
+                [pending, key](core::frame_transform transform) {
+                    std::lock_guard<std::mutex> lock(pending->mutex);
+                    auto                        it = pending->layers.find(key);
+                    if (it != pending->layers.end()) {
+                        it->second.apply(transform);
+                        pending->layers.erase(it);
+                    }
+                    return transform;
+                },
+                0,
+                tweener(L"linear")));
+        }
+
+        channel->stage().apply_transforms(std::move(transforms));
+    }
+};
+
+server::server(std::shared_ptr<boost::asio::io_context>          service,
+               const boost::asio::ip::udp::endpoint&             endpoint,
+               std::vector<spl::shared_ptr<core::video_channel>> channels)
+    : impl_(std::make_shared<impl>(std::move(service), endpoint, std::move(channels)))
+{
+    impl_->start_receive();
+}
+
+server::~server() { impl_->close(); }
+
+}}} // namespace caspar::protocol::osc
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+#include <common/memory.h>
+
+#include <core/video_channel.h>
+
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace osc {
+
+// Receives OSC messages which set the transforms of layers directly, for high rate control such as faders and
+// joysticks, without going through AMCP:
+//
+//   /channel/<n>/stage/layer/<l>/opacity  <opacity>
+//   /channel/<n>/stage/layer/<l>/volume   <volume>
+//   /channel/<n>/stage/layer/<l>/fill     <x> <y> <x-scale> <y-scale>
+//   /channel/<n>/stage/layer/<l>/anchor   <x> <y>
+//   /channel/<n>/stage/layer/<l>/rotation <degrees>
+//
+// Arguments may be int32, float or double, and messages may be sent in bundles. The values received for a layer are
+// merged until the next tick of its channel, which applies the latest of them at once.
+class server
+{
+  public:
+    server(std::shared_ptr<boost::asio::io_context>          service,
+           const boost::asio::ip::udp::endpoint&             endpoint,
+           std::vector<spl::shared_ptr<core::video_channel>> channels);
+    ~server();
+
+    server(const server&) = delete;
+    server& operator=(const server&) = delete;
+
+  private:
+    struct impl;
+    std::shared_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::osc
@@ -0,0 +1,453 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "state_stream.h"
+
+#include "../util/address_pattern.h"
+
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Every frame sent to a client is a little endian uint32 length, of what follows it, and a uint8 type:
+//
+//   1 KEY       uint32 id, uint16 length, utf-8 address. Announces the id of an address before it is first used.
+//   2 SNAPSHOT  uint32 count, count entries. Replaces everything the client knows.
+//   3 DELTA     uint32 count, count entries. Updates the entries, an entry without values was removed.
+//
+// An entry is a uint32 key id, a uint8 value count and the values, each a uint8 tag followed by its value:
+//
+//   1 bool uint8, 2 int32, 3 int64, 4 float, 5 double, 6 string as uint32 length and utf-8.
+//
+// Clients send lines of text:
+//
+//   FILTER [pattern ...]  Only sends the addresses which match any of the patterns, where * matches any characters,
+//                         none sends everything. Followed by a new snapshot.
+//   RATE frames/second    Sends at most as many frames per second, changes in between are merged. 0 sends every
+//                         change.
+
+namespace caspar { namespace protocol { namespace state {
+
+namespace {
+
+enum class frame_type : std::uint8_t
+{
+    key      = 1,
+    snapshot = 2,
+    delta    = 3,
+};
+
+void write_u8(std::string& out, std::uint8_t value) { out.push_back(static_cast<char>(value)); }
+
+void write_u16(std::string& out, std::uint16_t value)
+{
+    for (int n = 0; n < 2; ++n)
+        out.push_back(static_cast<char>(value >> (n * 8)));
+}
+
+void write_u32(std::string& out, std::uint32_t value)
+{
+    for (int n = 0; n < 4; ++n)
+        out.push_back(static_cast<char>(value >> (n * 8)));
+}
+
+void write_u64(std::string& out, std::uint64_t value)
+{
+    for (int n = 0; n < 8; ++n)
+        out.push_back(static_cast<char>(value >> (n * 8)));
+}
+
+void write_string(std::string& out, const std::string& value)
+{
+    write_u32(out, static_cast<std::uint32_t>(value.size()));
+    out.append(value);
+}
+
+struct value_writer : public boost::static_visitor<void>
+{
+    std::string& out;
+
+    explicit value_writer(std::string& out)
+        : out(out)
+    {
+    }
+
+    void operator()(bool value)
+    {
+        write_u8(out, 1);
+        write_u8(out, value ? 1 : 0);
+    }
+
+    void operator()(std::int32_t value)
+    {
+        write_u8(out, 2);
+        write_u32(out, static_cast<std::uint32_t>(value));
+    }
+
+    void operator()(std::int64_t value)
+    {
+        write_u8(out, 3);
+        write_u64(out, static_cast<std::uint64_t>(value));
+    }
+
+    void operator()(float value)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        write_u8(out, 4);
+        write_u32(out, bits);
+    }
+
+    void operator()(double value)
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        write_u8(out, 5);
+        write_u64(out, bits);
+    }
+
+    void operator()(const std::string& value)
+    {
+        write_u8(out, 6);
+        write_string(out, value);
+    }
+
+    void operator()(const std::wstring& value) { (*this)(u8(value)); }
+};
+
+void write_frame(std::string& out, frame_type type, const std::string& payload)
+{
+    write_u32(out, static_cast<std::uint32_t>(payload.size() + 1));
+    write_u8(out, static_cast<std::uint8_t>(type));
+    out.append(payload);
+}
+
+} // namespace
+
+struct state_stream::impl : public spl::enable_shared_from_this<state_stream::impl>
+{
+    // What has been announced to a client, only used on the stream thread.
+    struct client_session
+    {
+        IO::client_connection<char>::ptr client;
+        std::vector<bool>                announced; // By key id.
+
+        explicit client_session(IO::client_connection<char>::ptr client)
+            : client(std::move(client))
+        {
+        }
+    };
+
+    struct subscriber
+    {
+        std::shared_ptr<client_session>       session;
+        std::vector<std::string>              filters;
+        double                                max_rate      = 0.0;
+        std::uint64_t                         sent_revision = 0; // New subscribers get a snapshot.
+        std::chrono::steady_clock::time_point next_send;
+    };
+
+    struct job
+    {
+        std::shared_ptr<client_session> session;
+        std::vector<std::string>        filters;
+        std::uint64_t                   since;
+    };
+
+    std::mutex                                     mutex_;
+    std::condition_variable                        cond_;
+    core::monitor::state                           state_;
+    std::map<int, subscriber>                      subscribers_;
+    int                                            next_id_ = 0;
+    std::atomic<bool>                              abort_request_{false};
+    std::unordered_map<std::string, std::uint32_t> key_ids_; // Only used on the stream thread.
+    std::thread                                    thread_;
+
+    impl()
+        : thread_([this] { run(); })
+    {
+    }
+
+    ~impl()
+    {
+        abort_request_ = true;
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    void send(core::monitor::state delta)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            state_.apply(delta);
+        }
+        cond_.notify_all();
+    }
+
+    int subscribe(IO::client_connection<char>::ptr client)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        id = next_id_++;
+        subscribers_[id].session       = std::make_shared<client_session>(std::move(client));
+        cond_.notify_all();
+        return id;
+    }
+
+    void unsubscribe(int id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        subscribers_.erase(id);
+    }
+
+    void command(int id, const std::string& line)
+    {
+        std::vector<std::string> tokens;
+        boost::split(tokens, line, boost::is_any_of(" "), boost::token_compress_on);
+        tokens.erase(std::remove(tokens.begin(), tokens.end(), std::string()), tokens.end());
+
+        if (tokens.empty())
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = subscribers_.find(id);
+        if (it == subscribers_.end())
+            return;
+
+        auto& s = it->second;
+
+        if (boost::iequals(tokens[0], "FILTER")) {
+            s.filters.assign(tokens.begin() + 1, tokens.end());
+            s.sent_revision = 0;
+            s.next_send     = std::chrono::steady_clock::time_point();
+        } else if (boost::iequals(tokens[0], "RATE") && tokens.size() > 1) {
+            s.max_rate = std::max(0.0, boost::lexical_cast<double>(tokens[1]));
+        } else {
+            CASPAR_LOG(warning) << L"[state] Unknown command: " << u16(line);
+        }
+        cond_.notify_all();
+    }
+
+  private:
+    void run()
+    {
+        try {
+            while (true) {
+                std::vector<job>                               jobs;
+                std::map<std::uint64_t, core::monitor::state> deltas;
+
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+
+                    while (true) {
+                        if (abort_request_)
+                            return;
+
+                        auto wake = collect(std::chrono::steady_clock::now(), jobs);
+
+                        if (!jobs.empty())
+                            break;
+
+                        if (wake == std::chrono::steady_clock::time_point::max())
+                            cond_.wait(lock);
+                        else
+                            cond_.wait_until(lock, wake);
+                    }
+
+                    for (auto& j : jobs) {
+                        if (deltas.find(j.since) == deltas.end())
+                            deltas[j.since] = state_.delta(j.since);
+                    }
+                }
+
+                for (auto& j : jobs) {
+                    std::string out;
+                    encode(deltas[j.since], j, out);
+                    j.session->client->send(std::move(out), true);
+                }
+            }
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    std::chrono::steady_clock::time_point collect(std::chrono::steady_clock::time_point now, std::vector<job>& jobs)
+    {
+        auto wake = std::chrono::steady_clock::time_point::max();
+
+        for (auto& p : subscribers_) {
+            auto& s = p.second;
+
+            if (s.sent_revision == state_.revision())
+                continue;
+
+            if (s.next_send > now) {
+                wake = std::min(wake, s.next_send);
+                continue;
+            }
+
+            jobs.push_back(job{s.session, s.filters, s.sent_revision});
+
+            s.sent_revision = state_.revision();
+            if (s.max_rate > 0.0) {
+                s.next_send = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                        std::chrono::duration<double>(1.0 / s.max_rate));
+            }
+        }
+
+        return wake;
+    }
+
+    void encode(const core::monitor::state& delta, const job& j, std::string& out)
+    {
+        std::string   entries;
+        std::uint32_t count = 0;
+
+        for (auto& p : delta) {
+            // NOTE: A snapshot replaces everything, so removed entries are left out of it.
+            if (j.since == 0 && p.second.empty())
+                continue;
+
+            if (!j.filters.empty() && std::none_of(j.filters.begin(), j.filters.end(), [&](const std::string& f) {
+                    return IO::match_address(f.c_str(), p.first.c_str());
+                }))
+                continue;
+
+            auto id = key_ids_.emplace(p.first, static_cast<std::uint32_t>(key_ids_.size())).first->second;
+
+            auto& announced = j.session->announced;
+            if (id >= announced.size())
+                announced.resize(id + 1, false);
+
+            if (!announced[id]) {
+                std::string key;
+                write_u32(key, id);
+                write_u16(key, static_cast<std::uint16_t>(std::min<std::size_t>(p.first.size(), 0xFFFF)));
+                key.append(p.first, 0, 0xFFFF);
+                write_frame(out, frame_type::key, key);
+                announced[id] = true;
+            }
+
+            write_u32(entries, id);
+            write_u8(entries, static_cast<std::uint8_t>(std::min<std::size_t>(p.second.size(), 0xFF)));
+
+            value_writer writer(entries);
+            for (std::size_t n = 0; n < p.second.size() && n < 0xFF; ++n)
+                boost::apply_visitor(writer, p.second[n]);
+
+            ++count;
+        }
+
+        if (count == 0 && j.since != 0)
+            return;
+
+        std::string payload;
+        write_u32(payload, count);
+        payload.append(entries);
+        write_frame(out, j.since == 0 ? frame_type::snapshot : frame_type::delta, payload);
+    }
+};
+
+namespace {
+
+class state_protocol : public IO::protocol_strategy<char>
+{
+    std::shared_ptr<state_stream::impl> stream_;
+    int                                 id_;
+    std::string                         input_;
+
+  public:
+    state_protocol(std::shared_ptr<state_stream::impl> stream, const IO::client_connection<char>::ptr& client)
+        : stream_(std::move(stream))
+        , id_(stream_->subscribe(client))
+    {
+    }
+
+    ~state_protocol() override { stream_->unsubscribe(id_); }
+
+    void parse(const std::string& data) override
+    {
+        input_ += data;
+
+        std::size_t pos;
+        while ((pos = input_.find('\n')) != std::string::npos) {
+            auto line = boost::trim_copy(input_.substr(0, pos));
+            input_.erase(0, pos + 1);
+
+            try {
+                stream_->command(id_, line);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+};
+
+class state_protocol_factory : public IO::protocol_strategy_factory<char>
+{
+    std::shared_ptr<state_stream::impl> stream_;
+
+  public:
+    explicit state_protocol_factory(std::shared_ptr<state_stream::impl> stream)
+        : stream_(std::move(stream))
+    {
+    }
+
+    IO::protocol_strategy<char>::ptr create(const IO::client_connection<char>::ptr& client_connection) override
+    {
+        return spl::make_shared<state_protocol>(stream_, client_connection);
+    }
+};
+
+} // namespace
+
+state_stream::state_stream()
+    : impl_(spl::make_shared<impl>())
+{
+}
+
+state_stream::~state_stream() {}
+
+void state_stream::send(core::monitor::state delta) { impl_->send(std::move(delta)); }
+
+spl::shared_ptr<IO::protocol_strategy_factory<char>> state_stream::protocol_factory()
+{
+    return spl::make_shared<state_protocol_factory>(impl_);
+}
+
+}}} // namespace caspar::protocol::state
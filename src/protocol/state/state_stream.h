@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../util/protocol_strategy.h"
+
+#include <common/memory.h>
+
+#include <core/monitor/monitor.h>
+
+namespace caspar { namespace protocol { namespace state {
+
+// Streams the monitor state to the clients of a controller as a snapshot followed by binary deltas, a compact
+// alternative to OSC for dashboards. See state_stream.cpp for the format and the commands clients send.
+class state_stream
+{
+  public:
+    state_stream();
+    ~state_stream();
+
+    state_stream(const state_stream&) = delete;
+    state_stream& operator=(const state_stream&) = delete;
+
+    // Merges a delta, as returned by core::monitor::state::delta, and sends what changed.
+    void send(core::monitor::state delta);
+
+    // The protocol of a controller whose clients are sent the state.
+    spl::shared_ptr<IO::protocol_strategy_factory<char>> protocol_factory();
+
+    struct impl;
+
+  private:
+    spl::shared_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::state
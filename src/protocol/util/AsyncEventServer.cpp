@@ -25,10 +25,13 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/lexical_cast.hpp>
@@ -43,7 +46,37 @@ namespace caspar { namespace IO {
 
 class connection;
 
-typedef std::set<spl::shared_ptr<connection>> connection_set;
+// The open connections of a server, which remove themselves from it on whichever io thread runs their strand.
+class connection_set
+{
+    std::mutex                            mutex_;
+    std::set<spl::shared_ptr<connection>> connections_;
+
+  public:
+    void insert(const spl::shared_ptr<connection>& conn)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.insert(conn);
+    }
+
+    void erase(const spl::shared_ptr<connection>& conn)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.erase(conn);
+    }
+
+    std::size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connections_.size();
+    }
+
+    std::set<spl::shared_ptr<connection>> connections()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connections_;
+    }
+};
 
 class connection : public spl::enable_shared_from_this<connection>
 {
@@ -52,15 +85,22 @@ class connection : public spl::enable_shared_from_this<connection>
 
     const spl::shared_ptr<tcp::socket>       socket_;
     std::shared_ptr<boost::asio::io_service> service_;
+    boost::asio::io_service::strand          strand_; // Runs the handlers of the connection one at a time.
     const std::wstring                       listen_port_;
     const spl::shared_ptr<connection_set>    connection_set_;
     protocol_strategy_factory<char>::ptr     protocol_factory_;
     std::shared_ptr<protocol_strategy<char>> protocol_;
 
-    std::array<char, 32768> data_;
-    lifecycle_map_type      lifecycle_bound_objects_;
-    send_queue              send_queue_;
-    bool                    is_writing_;
+    std::array<char, 32768>   data_;
+    lifecycle_map_type        lifecycle_bound_objects_;
+    const connection_settings settings_;
+    send_queue                send_queue_;
+    std::atomic<std::size_t>  queued_bytes_{0};
+    bool                      is_writing_;
+
+    // The strings of the write in progress and their buffers, reused by every write, only used on the strand.
+    std::vector<std::string>               writing_;
+    std::vector<boost::asio::const_buffer> write_buffers_;
 
     class connection_holder : public client_connection<char>
     {
@@ -121,10 +161,11 @@ class connection : public spl::enable_shared_from_this<connection>
     static spl::shared_ptr<connection> create(std::shared_ptr<boost::asio::io_service>    service,
                                               spl::shared_ptr<tcp::socket>                socket,
                                               const protocol_strategy_factory<char>::ptr& protocol,
-                                              spl::shared_ptr<connection_set>             connection_set)
+                                              spl::shared_ptr<connection_set>             connection_set,
+                                              const connection_settings&                  settings)
     {
-        spl::shared_ptr<connection> con(
-            new connection(std::move(service), std::move(socket), std::move(protocol), std::move(connection_set)));
+        spl::shared_ptr<connection> con(new connection(
+            std::move(service), std::move(socket), std::move(protocol), std::move(connection_set), settings));
         con->init();
         con->read_some();
         return con;
@@ -145,15 +186,33 @@ class connection : public spl::enable_shared_from_this<connection>
 
     void send(std::string&& data)
     {
+        auto size   = data.size();
+        auto queued = queued_bytes_.fetch_add(size) + size;
+
+        // NOTE: A client which does not read what it is sent, e.g. large INFO replies, would otherwise grow the queue
+        // without bound.
+        if (settings_.max_send_queue > 0 && queued > settings_.max_send_queue) {
+            queued_bytes_ -= size;
+
+            if (settings_.overflow == send_overflow_policy::drop) {
+                CASPAR_LOG_LIMITED(warning, 1)
+                    << print() << L" Send queue of " << ipv4_address() << L" is full, dropped " << size << L" bytes.";
+            } else {
+                CASPAR_LOG(warning) << print() << L" Send queue of " << ipv4_address() << L" is full, disconnecting.";
+                disconnect();
+            }
+            return;
+        }
+
         send_queue_.push(std::move(data));
         auto self = shared_from_this();
-        service_->dispatch([=] { self->do_write(); });
+        strand_.dispatch([=] { self->do_write(); });
     }
 
     void disconnect()
     {
         std::weak_ptr<connection> self = shared_from_this();
-        service_->dispatch([=] {
+        strand_.dispatch([=] {
             auto strong = self.lock();
 
             if (strong)
@@ -179,17 +238,32 @@ class connection : public spl::enable_shared_from_this<connection>
     }
 
   private:
-    void do_write() // always called from the asio-service-thread
+    void do_write() // always called on the strand
     {
-        if (!is_writing_) {
-            std::string data;
-            if (send_queue_.try_pop(data)) {
-                write_some(std::move(data));
-            }
-        }
+        if (is_writing_)
+            return;
+
+        // NOTE: Everything queued is written at once with a gather write, rather than a write per reply.
+        std::string data;
+        while (send_queue_.try_pop(data))
+            writing_.push_back(std::move(data));
+
+        if (writing_.empty())
+            return;
+
+        write_buffers_.clear();
+        for (auto& str : writing_)
+            write_buffers_.push_back(boost::asio::buffer(str));
+
+        is_writing_ = true;
+        boost::asio::async_write(
+            *socket_,
+            write_buffers_,
+            strand_.wrap(std::bind(
+                &connection::handle_write, shared_from_this(), std::placeholders::_1, std::placeholders::_2)));
     }
 
-    void stop() // always called from the asio-service-thread
+    void stop() // always called on the strand
     {
         connection_set_->erase(shared_from_this());
 
@@ -204,13 +278,16 @@ class connection : public spl::enable_shared_from_this<connection>
     connection(const std::shared_ptr<boost::asio::io_service>& service,
                const spl::shared_ptr<tcp::socket>&             socket,
                const protocol_strategy_factory<char>::ptr&     protocol_factory,
-               const spl::shared_ptr<connection_set>&          connection_set)
+               const spl::shared_ptr<connection_set>&          connection_set,
+               const connection_settings&                      settings)
         : socket_(socket)
         , service_(service)
+        , strand_(*service_)
         , listen_port_(socket_->is_open() ? boost::lexical_cast<std::wstring>(socket_->local_endpoint().port())
                                           : L"no-port")
         , connection_set_(connection_set)
         , protocol_factory_(protocol_factory)
+        , settings_(settings)
         , is_writing_(false)
     {
         CASPAR_LOG(info) << print() << L" Accepted connection from " << ipv4_address() << L" ("
@@ -218,7 +295,7 @@ class connection : public spl::enable_shared_from_this<connection>
     }
 
     void handle_read(const boost::system::error_code& error,
-                     size_t                           bytes_transferred) // always called from the asio-service-thread
+                     size_t                           bytes_transferred) // always called on the strand
     {
         if (!error) {
             try {
@@ -234,42 +311,29 @@ class connection : public spl::enable_shared_from_this<connection>
             stop();
     }
 
-    void handle_write(const spl::shared_ptr<std::string>& str,
-                      const boost::system::error_code&    error,
-                      size_t bytes_transferred) // always called from the asio-service-thread
+    void handle_write(const boost::system::error_code& error,
+                      size_t bytes_transferred) // always called on the strand
     {
-        if (!error) {
-            if (bytes_transferred != str->size()) {
-                str->assign(str->substr(bytes_transferred));
-                socket_->async_write_some(boost::asio::buffer(str->data(), str->size()),
-                                          std::bind(&connection::handle_write,
-                                                    shared_from_this(),
-                                                    str,
-                                                    std::placeholders::_1,
-                                                    std::placeholders::_2));
-            } else {
-                is_writing_ = false;
-                do_write();
-            }
-        } else if (error != boost::asio::error::operation_aborted && socket_->is_open())
+        std::size_t size = 0;
+        for (auto& str : writing_)
+            size += str.size();
+
+        queued_bytes_ -= size;
+        writing_.clear();
+        is_writing_ = false;
+
+        if (!error)
+            do_write();
+        else if (error != boost::asio::error::operation_aborted && socket_->is_open())
             stop();
     }
 
-    void read_some() // always called from the asio-service-thread
+    void read_some() // always called on the strand
     {
         socket_->async_read_some(
             boost::asio::buffer(data_.data(), data_.size()),
-            std::bind(&connection::handle_read, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
-    }
-
-    void write_some(std::string&& data) // always called from the asio-service-thread
-    {
-        is_writing_ = true;
-        auto str    = spl::make_shared<std::string>(std::move(data));
-        socket_->async_write_some(
-            boost::asio::buffer(str->data(), str->size()),
-            std::bind(
-                &connection::handle_write, shared_from_this(), str, std::placeholders::_1, std::placeholders::_2));
+            strand_.wrap(
+                std::bind(&connection::handle_read, shared_from_this(), std::placeholders::_1, std::placeholders::_2)));
     }
 
     friend struct AsyncEventServer::implementation;
@@ -278,18 +342,23 @@ class connection : public spl::enable_shared_from_this<connection>
 struct AsyncEventServer::implementation : public spl::enable_shared_from_this<implementation>
 {
     std::shared_ptr<boost::asio::io_service> service_;
+    boost::asio::io_service::strand          strand_; // Runs the accept handler and guards lifecycle_factories_.
     tcp::acceptor                            acceptor_;
     protocol_strategy_factory<char>::ptr     protocol_factory_;
     spl::shared_ptr<connection_set>          connection_set_;
     std::vector<lifecycle_factory_t>         lifecycle_factories_;
     tbb::mutex                               mutex_;
+    const connection_settings                settings_;
 
     implementation(std::shared_ptr<boost::asio::io_service>    service,
                    const protocol_strategy_factory<char>::ptr& protocol,
-                   unsigned short                              port)
+                   unsigned short                              port,
+                   const connection_settings&                  settings)
         : service_(std::move(service))
+        , strand_(*service_)
         , acceptor_(*service_, tcp::endpoint(tcp::v4(), port))
         , protocol_factory_(protocol)
+        , settings_(settings)
     {
     }
 
@@ -305,20 +374,16 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
 
     ~implementation()
     {
-        auto conns_set = connection_set_;
-
-        service_->post([conns_set] {
-            auto connections = *conns_set;
-            for (auto& connection : connections)
-                connection->stop();
-        });
+        for (auto& connection : connection_set_->connections())
+            connection->disconnect();
     }
 
     void start_accept()
     {
         spl::shared_ptr<tcp::socket> socket(new tcp::socket(*service_));
         acceptor_.async_accept(
-            *socket, std::bind(&implementation::handle_accept, shared_from_this(), socket, std::placeholders::_1));
+            *socket,
+            strand_.wrap(std::bind(&implementation::handle_accept, shared_from_this(), socket, std::placeholders::_1)));
     }
 
     void handle_accept(const spl::shared_ptr<tcp::socket>& socket, const boost::system::error_code& error)
@@ -333,7 +398,12 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
             if (ec)
                 CASPAR_LOG(warning) << print() << L" Failed to enable TCP keep-alive on socket";
 
-            auto conn = connection::create(service_, socket, protocol_factory_, connection_set_);
+            socket->set_option(tcp::no_delay(settings_.no_delay), ec);
+
+            if (ec)
+                CASPAR_LOG(warning) << print() << L" Failed to set TCP no-delay on socket";
+
+            auto conn = connection::create(service_, socket, protocol_factory_, connection_set_, settings_);
             connection_set_->insert(conn);
 
             for (auto& lifecycle_factory : lifecycle_factories_) {
@@ -352,14 +422,15 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
     void add_client_lifecycle_object_factory(const lifecycle_factory_t& factory)
     {
         auto self = shared_from_this();
-        service_->post([=] { self->lifecycle_factories_.push_back(factory); });
+        strand_.post([=] { self->lifecycle_factories_.push_back(factory); });
     }
 };
 
 AsyncEventServer::AsyncEventServer(std::shared_ptr<boost::asio::io_service>    service,
                                    const protocol_strategy_factory<char>::ptr& protocol,
-                                   unsigned short                              port)
-    : impl_(new implementation(std::move(service), protocol, port))
+                                   unsigned short                              port,
+                                   const connection_settings&                  settings)
+    : impl_(new implementation(std::move(service), protocol, port, settings))
 {
     impl_->start_accept();
 }
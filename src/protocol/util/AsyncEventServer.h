@@ -34,12 +34,27 @@ namespace caspar { namespace IO {
 typedef std::function<std::pair<std::wstring, std::shared_ptr<void>>(const std::string& ipv4_address)>
     lifecycle_factory_t;
 
+// What happens to data sent to a client whose send queue is full.
+enum class send_overflow_policy
+{
+    disconnect,
+    drop,
+};
+
+struct connection_settings final
+{
+    std::size_t          max_send_queue = 16 * 1024 * 1024; // Bytes waiting to be written per client, 0 = unlimited.
+    send_overflow_policy overflow       = send_overflow_policy::disconnect;
+    bool                 no_delay       = true; // Disables Nagle's algorithm, replies are written as they are queued.
+};
+
 class AsyncEventServer : boost::noncopyable
 {
   public:
     explicit AsyncEventServer(std::shared_ptr<boost::asio::io_service>    service,
                               const protocol_strategy_factory<char>::ptr& protocol,
-                              unsigned short                              port);
+                              unsigned short                              port,
+                              const connection_settings&                  settings = connection_settings());
     ~AsyncEventServer();
 
     void add_client_lifecycle_object_factory(const lifecycle_factory_t& lifecycle_factory);
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+namespace caspar { namespace IO {
+
+// Matches a monitor state address against a pattern where * matches any characters, including /.
+inline bool match_address(const char* pattern, const char* address)
+{
+    const char* star  = nullptr;
+    const char* retry = nullptr;
+
+    while (*address) {
+        if (*pattern == '*') {
+            star  = pattern++;
+            retry = address;
+        } else if (*pattern == *address) {
+            ++pattern;
+            ++address;
+        } else if (star) {
+            pattern = star + 1;
+            address = ++retry;
+        } else {
+            return false;
+        }
+    }
+
+    while (*pattern == '*')
+        ++pattern;
+
+    return *pattern == '\0';
+}
+
+}} // namespace caspar::IO
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace IO {
+
+// Appends [begin, end) to result with <, > and " escaped, as the fields of the CII and CLK protocols end up as
+// attribute values in template data. Runs of ordinary characters are appended at once.
+inline void append_xml_escaped(std::wstring& result, const wchar_t* begin, const wchar_t* end)
+{
+    while (begin != end) {
+        auto run = begin;
+        while (run != end && *run != L'<' && *run != L'>' && *run != L'"')
+            ++run;
+
+        result.append(begin, run);
+
+        if (run == end)
+            break;
+
+        result += *run == L'<' ? L"&lt;" : *run == L'>' ? L"&gt;" : L"&quot;";
+        begin = run + 1;
+    }
+}
+
+// Splits [begin, end) into delimiter separated, escaped fields, so n delimiters give n + 1 fields. The strings
+// already in fields are reused, which keeps their capacity from one message to the next. Returns the field count.
+inline std::size_t
+split_fields(const wchar_t* begin, const wchar_t* end, wchar_t delimiter, std::vector<std::wstring>& fields)
+{
+    std::size_t count = 0;
+
+    while (true) {
+        auto field_end = begin;
+        while (field_end != end && *field_end != delimiter)
+            ++field_end;
+
+        if (count == fields.size())
+            fields.emplace_back();
+
+        auto& field = fields[count++];
+        field.clear();
+        append_xml_escaped(field, begin, field_end);
+
+        if (field_end == end)
+            break;
+
+        begin = field_end + 1;
+    }
+
+    fields.resize(count);
+
+    return count;
+}
+
+}} // namespace caspar::IO
@@ -2,101 +2,333 @@
 
 #include <common/except.h>
 
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
 #include <iomanip>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <vector>
 
 namespace caspar { namespace http {
 
-HTTPResponse request(const std::string& host, const std::string& port, const std::string& path)
+using boost::asio::ip::tcp;
+namespace asio = boost::asio;
+
+namespace {
+
+// A kept alive connection, which runs its operations on its own io_service in the thread making the request.
+struct connection
 {
-    using boost::asio::ip::tcp;
-    using namespace boost;
+    asio::io_service service;
+    tcp::socket      socket{service};
+    asio::streambuf  buffer;
+};
 
-    HTTPResponse res;
+// NOTE: Idle connections are kept per host:port, so that e.g. CLS and TLS do not reconnect to the media scanner.
+const std::size_t max_idle_connections = 4;
 
-    asio::io_service io_service;
+std::mutex& pool_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
 
-    // Get a list of endpoints corresponding to the server name.
-    tcp::resolver           resolver(io_service);
-    tcp::resolver::query    query(host, port, boost::asio::ip::resolver_query_base::numeric_service);
-    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
+std::multimap<std::string, std::unique_ptr<connection>>& pool()
+{
+    static std::multimap<std::string, std::unique_ptr<connection>> connections;
+    return connections;
+}
 
-    // Try each endpoint until we successfully establish a connection.
-    tcp::socket               socket(io_service);
-    boost::system::error_code error;
-    asio::connect(socket, endpoint_iterator, error);
-    if (error == asio::error::connection_refused) {
-        res.status_code    = 503;
-        res.status_message = "Connection refused";
-        return res;
-    } else if (error) {
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
-    }
+std::unique_ptr<connection> take_idle(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex());
+
+    auto it = pool().find(key);
+    if (it == pool().end())
+        return nullptr;
+
+    auto conn = std::move(it->second);
+    pool().erase(it);
+    return conn;
+}
+
+void put_idle(const std::string& key, std::unique_ptr<connection> conn)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex());
 
-    // Form the request. We specify the "Connection: close" header so that the
-    // server will close the socket after transmitting the response. This will
-    // allow us to treat all data up until the EOF as the content.
+    if (pool().count(key) < max_idle_connections)
+        pool().emplace(key, std::move(conn));
+}
+
+// Runs an asynchronous operation to completion, closing the socket if it takes longer than timeout.
+template <typename Start>
+boost::system::error_code run(connection& conn, std::chrono::milliseconds timeout, Start&& start)
+{
+    boost::system::error_code result    = asio::error::would_block;
+    bool                      timed_out = false;
+
+    asio::steady_timer timer(conn.service);
+    timer.expires_from_now(timeout);
+    timer.async_wait([&](const boost::system::error_code& ec) {
+        if (!ec) {
+            timed_out = true;
+            boost::system::error_code ignored;
+            conn.socket.close(ignored);
+        }
+    });
+
+    start([&](const boost::system::error_code& ec, auto&&...) {
+        result = ec;
+        timer.cancel();
+    });
+
+    conn.service.restart();
+    conn.service.run();
+
+    return timed_out ? asio::error::timed_out : result;
+}
+
+std::string read_line(std::istream& stream)
+{
+    std::string line;
+    std::getline(stream, line);
+    if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+    return line;
+}
+
+// Sends the request and reads the response, returns whether the connection can be reused.
+bool exchange(connection&                              conn,
+              const std::string&                       host,
+              const std::string&                       port,
+              const std::string&                       path,
+              const std::map<std::string, std::string>& extra_headers,
+              std::chrono::milliseconds                timeout,
+              HTTPResponse&                            res)
+{
     asio::streambuf request;
     std::ostream    request_stream(&request);
-    request_stream << "GET " << path << " HTTP/1.0\r\n";
+    request_stream << "GET " << path << " HTTP/1.1\r\n";
     request_stream << "Host: " << host << ":" << port << "\r\n";
     request_stream << "Accept: */*\r\n";
-    request_stream << "Connection: close\r\n\r\n";
+    for (auto& header : extra_headers)
+        request_stream << header.first << ": " << header.second << "\r\n";
+    request_stream << "Connection: keep-alive\r\n\r\n";
 
-    // Send the request.
-    asio::write(socket, request);
+    auto ec = run(conn, timeout, [&](auto&& handler) { asio::async_write(conn.socket, request, handler); });
+    if (ec)
+        CASPAR_THROW_EXCEPTION(io_error() << msg_info(ec.message()));
 
-    // Read the response status line. The response streambuf will automatically
-    // grow to accommodate the entire line. The growth may be limited by passing
-    // a maximum size to the streambuf constructor.
-    asio::streambuf response;
-    asio::read_until(socket, response, "\r\n");
+    ec = run(conn, timeout, [&](auto&& handler) {
+        asio::async_read_until(conn.socket, conn.buffer, "\r\n\r\n", handler);
+    });
+    if (ec)
+        CASPAR_THROW_EXCEPTION(io_error() << msg_info(ec.message()));
 
-    // Check that response is OK.
-    std::istream response_stream(&response);
+    std::istream response_stream(&conn.buffer);
     std::string  http_version;
     response_stream >> http_version;
     response_stream >> res.status_code;
-    std::getline(response_stream, res.status_message);
+    res.status_message = boost::trim_copy(read_line(response_stream));
 
-    if (!response_stream || http_version.substr(0, 5) != "HTTP/") {
-        // TODO
+    if (!response_stream || http_version.substr(0, 5) != "HTTP/")
         CASPAR_THROW_EXCEPTION(io_error() << msg_info("Invalid Response"));
+
+    for (auto header = read_line(response_stream); !header.empty(); header = read_line(response_stream)) {
+        auto colon = header.find(':');
+        if (colon != std::string::npos)
+            res.headers[boost::to_lower_copy(header.substr(0, colon))] = boost::trim_copy(header.substr(colon + 1));
     }
 
+    auto keep_alive = http_version != "HTTP/1.0";
+    auto connection = res.headers.find("connection");
+    if (connection != res.headers.end())
+        keep_alive = !boost::iequals(connection->second, "close");
+
+    auto read_exactly = [&](std::size_t size) {
+        if (conn.buffer.size() < size) {
+            auto ec = run(conn, timeout, [&](auto&& handler) {
+                asio::async_read(conn.socket, conn.buffer, asio::transfer_exactly(size - conn.buffer.size()), handler);
+            });
+            if (ec)
+                CASPAR_THROW_EXCEPTION(io_error() << msg_info(ec.message()));
+        }
+        std::string data(asio::buffers_begin(conn.buffer.data()), asio::buffers_begin(conn.buffer.data()) + size);
+        conn.buffer.consume(size);
+        return data;
+    };
+
+    auto read_until = [&](const std::string& delimiter) {
+        auto ec = run(conn, timeout, [&](auto&& handler) {
+            asio::async_read_until(conn.socket, conn.buffer, delimiter, handler);
+        });
+        if (ec)
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info(ec.message()));
+        std::istream stream(&conn.buffer);
+        return read_line(stream);
+    };
+
+    auto content_length    = res.headers.find("content-length");
+    auto transfer_encoding = res.headers.find("transfer-encoding");
+
+    if (res.status_code == 204 || res.status_code == 304) {
+        // No body.
+    } else if (transfer_encoding != res.headers.end() && boost::iequals(transfer_encoding->second, "chunked")) {
+        while (true) {
+            auto size = std::stoul(read_until("\r\n"), nullptr, 16);
+            if (size == 0) {
+                while (!read_until("\r\n").empty()) {
+                    // Trailers
+                }
+                break;
+            }
+            res.body += read_exactly(size);
+            read_exactly(2);
+        }
+    } else if (content_length != res.headers.end()) {
+        res.body = read_exactly(std::stoul(content_length->second));
+    } else {
+        // Without a length the body ends with the connection.
+        boost::system::error_code ec;
+        while (!ec) {
+            ec = run(conn, timeout, [&](auto&& handler) {
+                asio::async_read(conn.socket, conn.buffer, asio::transfer_at_least(1), handler);
+            });
+        }
+        if (ec != asio::error::eof)
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info(ec.message()));
+
+        res.body.assign(asio::buffers_begin(conn.buffer.data()), asio::buffers_end(conn.buffer.data()));
+        conn.buffer.consume(conn.buffer.size());
+        keep_alive = false;
+    }
+
+    return keep_alive && conn.buffer.size() == 0;
+}
+
+HTTPResponse do_request(const std::string&                        host,
+                        const std::string&                        port,
+                        const std::string&                        path,
+                        const std::map<std::string, std::string>& extra_headers,
+                        std::chrono::milliseconds                 timeout)
+{
+    auto key = host + ":" + port;
+
+    // NOTE: An idle connection may have been closed by the server in the meantime, which is only found out when it
+    // is used, so the request is then sent again on a new connection.
+    while (auto conn = take_idle(key)) {
+        HTTPResponse res;
+        try {
+            if (exchange(*conn, host, port, path, extra_headers, timeout, res))
+                put_idle(key, std::move(conn));
+            return res;
+        } catch (io_error&) {
+        }
+    }
+
+    HTTPResponse res;
+    auto         conn = std::make_unique<connection>();
+
+    // Get a list of endpoints corresponding to the server name.
+    tcp::resolver           resolver(conn->service);
+    tcp::resolver::query    query(host, port, asio::ip::resolver_query_base::numeric_service);
+    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
+
+    // Try each endpoint until we successfully establish a connection.
+    auto error = run(*conn, timeout, [&](auto&& handler) {
+        asio::async_connect(conn->socket, endpoint_iterator, handler);
+    });
+    if (error == asio::error::connection_refused) {
+        res.status_code    = 503;
+        res.status_message = "Connection refused";
+        return res;
+    } else if (error) {
+        CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+    }
+
+    if (exchange(*conn, host, port, path, extra_headers, timeout, res))
+        put_idle(key, std::move(conn));
+
+    return res;
+}
+
+void check_status(const HTTPResponse& res)
+{
+    if (res.status_code == 503 && res.status_message == "Connection refused")
+        return;
+
     if (res.status_code < 200 || res.status_code >= 300) {
         // TODO
         CASPAR_THROW_EXCEPTION(io_error() << msg_info("Invalid Response"));
     }
+}
 
-    // Read the response headers, which are terminated by a blank line.
-    asio::read_until(socket, response, "\r\n\r\n");
+struct cache_entry
+{
+    HTTPResponse                          response;
+    std::chrono::steady_clock::time_point fetched;
+};
 
-    // Process the response headers.
-    std::string header;
-    while (std::getline(response_stream, header) && header != "\r") {
-        // TODO
-    }
+} // namespace
 
-    std::stringstream body;
+HTTPResponse
+request(const std::string& host, const std::string& port, const std::string& path, std::chrono::milliseconds timeout)
+{
+    auto res = do_request(host, port, path, {}, timeout);
+    check_status(res);
+    return res;
+}
 
-    // Write whatever content we already have to output.
-    if (response.size() > 0) {
-        body << &response;
-    }
+HTTPResponse cached_request(const std::string&        host,
+                            const std::string&        port,
+                            const std::string&        path,
+                            std::chrono::milliseconds ttl,
+                            std::chrono::milliseconds timeout)
+{
+    static std::mutex                         mutex;
+    static std::map<std::string, cache_entry> cache;
+
+    auto key = host + ":" + port + path;
+    auto now = std::chrono::steady_clock::now();
 
-    // Read until EOF, writing data to output as we go.
-    while (asio::read(socket, response, asio::transfer_at_least(1), error)) {
-        body << &response;
+    std::map<std::string, std::string> extra_headers;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+            if (now - it->second.fetched < ttl)
+                return it->second.response;
+
+            auto etag = it->second.response.headers.find("etag");
+            if (etag != it->second.response.headers.end())
+                extra_headers["If-None-Match"] = etag->second;
+        }
     }
 
-    if (error != asio::error::eof) {
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+    auto res = do_request(host, port, path, extra_headers, timeout);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (res.status_code == 304) {
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+            it->second.fetched = now;
+            return it->second.response;
+        }
+        CASPAR_THROW_EXCEPTION(io_error() << msg_info("Not modified response to an uncached request"));
     }
 
-    res.body = body.str();
+    check_status(res);
+
+    if (res.status_code >= 200 && res.status_code < 300)
+        cache[key] = cache_entry{res, now};
 
     return res;
 }
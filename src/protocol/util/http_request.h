@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <map>
 #include <string>
 
@@ -9,11 +10,24 @@ struct HTTPResponse
 {
     unsigned int                       status_code;
     std::string                        status_message;
-    std::map<std::string, std::string> headers;
+    std::map<std::string, std::string> headers; // By lower case name.
     std::string                        body;
 };
 
-HTTPResponse request(const std::string& host, const std::string& port, const std::string& path);
+// Sends a GET on a kept alive connection to host:port, reusing an idle one if there is any. Each step of the exchange
+// fails with an io_error after timeout.
+HTTPResponse request(const std::string&        host,
+                     const std::string&        port,
+                     const std::string&        path,
+                     std::chrono::milliseconds timeout = std::chrono::seconds(30));
+
+// Like request, but answers repeated requests for path from a cache for ttl. After that the cached response is
+// revalidated with its ETag, if it had one.
+HTTPResponse cached_request(const std::string&        host,
+                            const std::string&        port,
+                            const std::string&        path,
+                            std::chrono::milliseconds ttl,
+                            std::chrono::milliseconds timeout = std::chrono::seconds(30));
 
 std::string url_encode(const std::string& str);
 
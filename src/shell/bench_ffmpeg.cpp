@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Plays media files through the ffmpeg producer as fast as it decodes, without channels or consumers, and writes the
+// results as JSON to stdout:
+//
+//   casparcg_bench_ffmpeg [--config casparcg.config] [--format 1080i5000] [--producers 1] [--frames 500]
+//                         [--frame-factory null|gl] [--gpu 0] [--loop] [--seek-every 0]
+//                         [--vfilter <filter>] [--afilter <filter>] file...
+//
+// Every file is played by the given number of concurrent producers. The null frame factory only allocates host
+// memory, so the results are those of decoding and filtering, while the gl frame factory also uploads every frame.
+// Per stage times are the totals of all producers, divided by the frames they delivered.
+
+#include <accelerator/ogl/image/image_mixer.h>
+#include <accelerator/ogl/util/device.h>
+
+#include <modules/ffmpeg/ffmpeg.h>
+#include <modules/ffmpeg/producer/av_producer.h>
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/module_dependencies.h>
+#include <core/producer/cg_proxy.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/task_scheduler_init.h>
+
+#ifdef _WIN32
+#include <windows.h>
+
+#include <psapi.h>
+#include <tlhelp32.h>
+#else
+#include <fstream>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace caspar {
+
+using clock_type = std::chrono::steady_clock;
+
+struct bench_settings
+{
+    std::wstring                 config        = L"casparcg.config";
+    std::wstring                 format        = L"1080i5000";
+    std::wstring                 frame_factory = L"null";
+    std::vector<std::string>     files;
+    boost::optional<std::string> vfilter;
+    boost::optional<std::string> afilter;
+    int                          producers  = 1;
+    int                          frames     = 500;
+    int                          seek_every = 0;
+    int                          gpu        = 0;
+    bool                         loop       = false;
+};
+
+// Only allocates host memory, so that nothing but the producer itself is measured.
+class null_frame_factory : public core::frame_factory
+{
+  public:
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
+    {
+        std::vector<array<std::uint8_t>> image_data;
+        for (auto& plane : desc.planes)
+            image_data.push_back(array<std::uint8_t>(plane.size));
+        return core::mutable_frame(tag, std::move(image_data), array<std::int32_t>{}, desc);
+    }
+
+    core::mutable_frame update_frame(const void*                            tag,
+                                     const core::pixel_format_desc&         desc,
+                                     const core::const_frame&               previous,
+                                     const std::vector<core::frame_region>& regions) override
+    {
+        return create_frame(tag, desc);
+    }
+
+    core::mutable_frame import_frame(const void* tag, void* shared_handle, int width, int height) override
+    {
+        CASPAR_THROW_EXCEPTION(not_supported() << msg_info("Textures cannot be imported by the null frame factory."));
+    }
+};
+
+struct process_sample
+{
+    double memory_mb = 0.0;
+    int    threads   = 0;
+};
+
+// Memory is the peak resident set of the process.
+process_sample sample_process()
+{
+    process_sample sample;
+
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        sample.memory_mb = counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+
+    auto snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot != INVALID_HANDLE_VALUE) {
+        THREADENTRY32 entry;
+        entry.dwSize = sizeof(entry);
+        for (auto ok = Thread32First(snapshot, &entry); ok; ok = Thread32Next(snapshot, &entry)) {
+            if (entry.th32OwnerProcessID == GetCurrentProcessId())
+                ++sample.threads;
+        }
+        CloseHandle(snapshot);
+    }
+#else
+    std::ifstream status("/proc/self/status");
+    std::string   line;
+    while (std::getline(status, line)) {
+        if (boost::starts_with(line, "VmHWM:")) {
+            auto kb          = boost::trim_copy(line.substr(6, line.find("kB") - 6));
+            sample.memory_mb = boost::lexical_cast<double>(kb) / 1024.0;
+        } else if (boost::starts_with(line, "Threads:")) {
+            sample.threads = boost::lexical_cast<int>(boost::trim_copy(line.substr(8)));
+        }
+    }
+#endif
+
+    return sample;
+}
+
+struct numeric_visitor : public boost::static_visitor<double>
+{
+    template <typename T>
+    double operator()(const T& value, typename std::enable_if<std::is_arithmetic<T>::value>::type* = nullptr) const
+    {
+        return static_cast<double>(value);
+    }
+
+    template <typename T>
+    double operator()(const T&, typename std::enable_if<!std::is_arithmetic<T>::value>::type* = nullptr) const
+    {
+        return 0.0;
+    }
+};
+
+// Sums the profile/ entries of the producer states.
+std::map<std::string, double> profile_totals(const std::vector<std::unique_ptr<ffmpeg::AVProducer>>& producers)
+{
+    std::map<std::string, double> totals;
+
+    for (auto& producer : producers) {
+        for (auto& p : producer->state()) {
+            if (boost::starts_with(p.first, "profile/") && !p.second.empty())
+                totals[p.first.substr(8)] += boost::apply_visitor(numeric_visitor(), p.second.front());
+        }
+    }
+
+    return totals;
+}
+
+boost::property_tree::ptree
+run_file(const std::string& file, const bench_settings& settings, const spl::shared_ptr<core::frame_factory>& factory)
+{
+    core::video_format_desc format_desc(settings.format);
+
+    std::vector<std::unique_ptr<ffmpeg::AVProducer>> producers;
+    for (int n = 0; n < settings.producers; ++n) {
+        producers.push_back(std::make_unique<ffmpeg::AVProducer>(factory,
+                                                                 format_desc,
+                                                                 file,
+                                                                 file,
+                                                                 settings.vfilter,
+                                                                 settings.afilter,
+                                                                 boost::none,
+                                                                 boost::none,
+                                                                 settings.loop));
+    }
+
+    std::vector<int64_t> times(producers.size(), -1);
+    std::vector<int>     delivered(producers.size(), 0);
+    std::vector<bool>    finished(producers.size(), false);
+
+    process_sample peak;
+    int            underflows = 0;
+    int            seeks      = 0;
+    auto           started    = clock_type::now();
+    auto           progressed = started;
+
+    // NOTE: A producer which has stopped delivering new frames for a few seconds has either reached the end of a file
+    // which does not loop, or failed.
+    while (std::find(finished.begin(), finished.end(), false) != finished.end() &&
+           clock_type::now() - progressed < std::chrono::seconds(5)) {
+        auto any = false;
+
+        for (size_t n = 0; n < producers.size(); ++n) {
+            if (finished[n])
+                continue;
+
+            auto& producer = *producers[n];
+
+            if (producer.next_frame() == core::draw_frame{})
+                ++underflows;
+
+            auto time = producer.time();
+            if (time == times[n])
+                continue;
+
+            times[n] = time;
+            any      = true;
+
+            if (++delivered[n] >= settings.frames) {
+                finished[n] = true;
+            } else if (settings.seek_every > 0 && delivered[n] % settings.seek_every == 0) {
+                // Jumps around the file, or within its first minute when the duration is unknown.
+                auto duration = producer.duration();
+                auto span     = duration != std::numeric_limits<int64_t>::max()
+                                ? duration
+                                : static_cast<int64_t>(format_desc.fps * 60);
+                producer.seek(span > 0 ? (delivered[n] * 7919) % span : 0);
+                ++seeks;
+            }
+        }
+
+        if (any) {
+            progressed = clock_type::now();
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        auto sample    = sample_process();
+        peak.memory_mb = std::max(peak.memory_mb, sample.memory_mb);
+        peak.threads   = std::max(peak.threads, sample.threads);
+    }
+
+    auto total_ms = std::chrono::duration<double, std::milli>(clock_type::now() - started).count();
+    auto frames   = 0;
+    for (auto count : delivered)
+        frames += count;
+
+    auto totals = profile_totals(producers);
+    auto per    = [&](const std::string& key) { return frames > 0 ? totals[key] / frames : 0.0; };
+
+    boost::property_tree::ptree pt;
+    pt.put("file", file);
+    pt.put("frames", frames);
+    pt.put("decoded_frames", totals["frames"]);
+    pt.put("fps", frames * 1000.0 / total_ms);
+    pt.put("fps_per_producer", frames * 1000.0 / total_ms / producers.size());
+    pt.put("read_ms", per("read-time"));
+    pt.put("decode_ms", per("decode-time"));
+    pt.put("filter_ms", per("filter-time"));
+    pt.put("make_frame_ms", per("convert-time"));
+    pt.put("underflows", underflows);
+    pt.put("seeks", seeks);
+    pt.put("memory_high_water_mb", peak.memory_mb);
+    pt.put("threads", peak.threads);
+    pt.put("completed", std::find(finished.begin(), finished.end(), false) == finished.end());
+
+    return pt;
+}
+
+bench_settings parse_settings(int argc, char** argv)
+{
+    bench_settings settings;
+
+    for (int n = 1; n < argc; ++n) {
+        std::string arg = argv[n];
+
+        auto value = [&]() -> std::string {
+            if (n + 1 >= argc)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Missing value of " + arg));
+            return argv[++n];
+        };
+
+        if (arg == "--config")
+            settings.config = u16(value());
+        else if (arg == "--format")
+            settings.format = u16(value());
+        else if (arg == "--frame-factory")
+            settings.frame_factory = u16(value());
+        else if (arg == "--producers")
+            settings.producers = std::max(1, boost::lexical_cast<int>(value()));
+        else if (arg == "--frames")
+            settings.frames = std::max(1, boost::lexical_cast<int>(value()));
+        else if (arg == "--seek-every")
+            settings.seek_every = std::max(0, boost::lexical_cast<int>(value()));
+        else if (arg == "--gpu")
+            settings.gpu = boost::lexical_cast<int>(value());
+        else if (arg == "--vfilter")
+            settings.vfilter = value();
+        else if (arg == "--afilter")
+            settings.afilter = value();
+        else if (arg == "--loop")
+            settings.loop = true;
+        else if (boost::starts_with(arg, "--"))
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid argument: " + arg));
+        else
+            settings.files.push_back(arg);
+    }
+
+    if (settings.files.empty())
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("No media files given."));
+
+    if (core::video_format_desc(settings.format).format == core::video_format::invalid)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + settings.format));
+
+    if (settings.frame_factory != L"null" && settings.frame_factory != L"gl")
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid frame factory: " + settings.frame_factory));
+
+    return settings;
+}
+
+boost::property_tree::ptree run(const bench_settings& settings)
+{
+    boost::property_tree::ptree pt;
+
+    std::shared_ptr<accelerator::ogl::device> device;
+    spl::shared_ptr<core::frame_factory>      factory = spl::make_shared<null_frame_factory>();
+
+    if (settings.frame_factory == L"gl") {
+        device  = std::make_shared<accelerator::ogl::device>(settings.gpu);
+        factory = spl::make_shared<accelerator::ogl::image_mixer>(spl::make_shared_ptr(device->for_channel(1)), 1);
+        pt.put("device", u8(device->version()));
+    }
+
+    auto& config = pt.put_child("settings", boost::property_tree::ptree());
+    config.put("format", u8(settings.format));
+    config.put("frame_factory", u8(settings.frame_factory));
+    config.put("producers", settings.producers);
+    config.put("frames", settings.frames);
+    config.put("loop", settings.loop);
+    config.put("seek_every", settings.seek_every);
+    config.put("vfilter", settings.vfilter.value_or(""));
+    config.put("afilter", settings.afilter.value_or(""));
+    config.put("hardware_threads", std::thread::hardware_concurrency());
+
+    auto& results = pt.put_child("results", boost::property_tree::ptree());
+    for (auto& file : settings.files)
+        results.push_back(std::make_pair("", run_file(file, settings, factory)));
+
+    return pt;
+}
+
+} // namespace caspar
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    tbb::task_scheduler_init init;
+
+    try {
+        auto settings = parse_settings(argc, argv);
+
+        // The producer and the device read their settings from the configuration.
+        env::configure(settings.config);
+
+        ffmpeg::init(core::module_dependencies(spl::make_shared<core::cg_producer_registry>(),
+                                               spl::make_shared<core::frame_producer_registry>(),
+                                               spl::make_shared<core::frame_consumer_registry>(),
+                                               spl::make_shared<core::reference_clock_registry>()));
+
+        boost::property_tree::write_json(std::cout, run(settings));
+
+        ffmpeg::uninit();
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        return 1;
+    }
+
+    return 0;
+}
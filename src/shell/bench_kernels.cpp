@@ -0,0 +1,408 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measures the hot kernels of the server in isolation and writes the results as JSON to stdout:
+//
+//   casparcg_bench_kernels [--filter memshfl] [--min-time 0.5] [--format 1080i5000]
+//
+// Every kernel is called in batches, which grow until a batch takes a hundredth of the minimum time, so that the
+// clock is read rarely even for kernels which take nanoseconds. Batches are repeated until the minimum time has
+// passed. The mean, median and fastest time of a call are reported, with the throughput of kernels which stream
+// through memory.
+
+#include <common/array.h>
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/log.h>
+#include <common/memshfl.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/audio/audio_mixer.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+// NOTE: The ffmpeg declarations come first, av_util.h only forward declares them.
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+
+#include <modules/ffmpeg/util/av_util.h>
+#include <modules/image/util/image_algorithms.h>
+#include <modules/image/util/image_view.h>
+
+#include <protocol/amcp/AMCPProtocolStrategy.h>
+#include <protocol/osc/client.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/task_scheduler_init.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace caspar {
+
+using clock_type = std::chrono::steady_clock;
+
+struct bench_settings
+{
+    std::wstring filter;
+    double       min_time = 0.5;
+    std::wstring format   = L"1080i5000";
+};
+
+class null_frame_factory : public core::frame_factory
+{
+  public:
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
+    {
+        std::vector<array<std::uint8_t>> image_data;
+        for (auto& plane : desc.planes)
+            image_data.push_back(array<std::uint8_t>(plane.size));
+        return core::mutable_frame(tag, std::move(image_data), array<std::int32_t>{}, desc);
+    }
+
+    core::mutable_frame update_frame(const void*                            tag,
+                                     const core::pixel_format_desc&         desc,
+                                     const core::const_frame&               previous,
+                                     const std::vector<core::frame_region>& regions) override
+    {
+        return create_frame(tag, desc);
+    }
+
+    core::mutable_frame import_frame(const void* tag, void* shared_handle, int width, int height) override
+    {
+        CASPAR_THROW_EXCEPTION(not_supported() << msg_info("Textures cannot be imported by the null frame factory."));
+    }
+};
+
+class kernel_bench
+{
+    const bench_settings&       settings_;
+    boost::property_tree::ptree results_;
+
+  public:
+    explicit kernel_bench(const bench_settings& settings)
+        : settings_(settings)
+    {
+    }
+
+    // Measures func, which processes bytes of memory for every call, 0 if it does not stream through memory.
+    void measure(const std::string& name, std::size_t bytes, const std::function<void()>& func)
+    {
+        if (!settings_.filter.empty() && name.find(u8(settings_.filter)) == std::string::npos)
+            return;
+
+        auto run_batch = [&](std::int64_t count) {
+            auto start = clock_type::now();
+            for (std::int64_t n = 0; n < count; ++n)
+                func();
+            return std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+        };
+
+        run_batch(1);
+
+        const auto min_ns = settings_.min_time * 1e9;
+
+        std::int64_t batch = 1;
+        while (batch < (std::int64_t(1) << 40) && run_batch(batch) < min_ns / 100.0)
+            batch *= 2;
+
+        std::vector<double> per_call;
+        std::int64_t        iterations = 0;
+        double              total_ns   = 0.0;
+        while (total_ns < min_ns || per_call.size() < 3) {
+            auto ns = run_batch(batch);
+            per_call.push_back(ns / static_cast<double>(batch));
+            iterations += batch;
+            total_ns += ns;
+        }
+
+        std::sort(per_call.begin(), per_call.end());
+
+        const auto mean_ns = total_ns / static_cast<double>(iterations);
+
+        boost::property_tree::ptree result;
+        result.put("name", name);
+        result.put("iterations", iterations);
+        result.put("ns_per_call", mean_ns);
+        result.put("median_ns", per_call[per_call.size() / 2]);
+        result.put("min_ns", per_call.front());
+        if (bytes > 0)
+            result.put("bytes_per_second", static_cast<double>(bytes) * 1e9 / mean_ns);
+        results_.push_back(std::make_pair("", result));
+
+        CASPAR_LOG(info) << L"[bench] " << u16(name) << L" " << mean_ns << L" ns";
+    }
+
+    const boost::property_tree::ptree& results() const { return results_; }
+};
+
+void bench_memshfl(kernel_bench& bench, const core::video_format_desc& format_desc)
+{
+    const auto  size = static_cast<std::size_t>(format_desc.size);
+    array<char> source(size);
+    array<char> dest(size);
+    std::memset(source.data(), 0x40, size);
+
+    // The key of a bgra image, as keyers and key-only outputs shuffle it.
+    bench.measure("memshfl/key", size, [&] {
+        memshfl(dest.data(), source.data(), size, 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+    });
+    bench.measure("parallel_memshfl/key", size, [&] {
+        parallel_memshfl(dest.data(), source.data(), size, 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+    });
+}
+
+void bench_audio_mixer(kernel_bench& bench, const core::video_format_desc& format_desc)
+{
+    const auto nb_samples = format_desc.audio_cadence.front();
+
+    for (auto items : {1, 8, 32}) {
+        core::audio_mixer mixer(spl::make_shared<diagnostics::graph>());
+
+        // NOTE: Every item has a tag of its own, as layers do, so the mixer ramps and tracks them separately.
+        std::vector<int>              tags(items);
+        std::vector<core::draw_frame> frames;
+        for (auto n = 0; n < items; ++n) {
+            auto samples = array<std::int32_t>(static_cast<std::size_t>(nb_samples * format_desc.audio_channels));
+            std::fill(samples.begin(), samples.end(), (n + 1) * 1000);
+            frames.push_back(core::draw_frame(core::mutable_frame(
+                &tags[n], {}, std::move(samples), core::pixel_format_desc(core::pixel_format::invalid))));
+        }
+
+        bench.measure("audio_mixer/mix/" + boost::lexical_cast<std::string>(items), 0, [&] {
+            for (auto& frame : frames)
+                frame.accept(mixer);
+            mixer(format_desc, nb_samples);
+        });
+    }
+}
+
+void bench_premultiply(kernel_bench& bench, const core::video_format_desc& format_desc)
+{
+    const auto          size = static_cast<std::size_t>(format_desc.size);
+    array<std::uint8_t> source(size);
+    array<std::uint8_t> dest(size);
+    for (std::size_t n = 0; n < size; ++n)
+        source.data()[n] = static_cast<std::uint8_t>(n * 7);
+
+    bench.measure("premultiply/view", size, [&] {
+        std::memcpy(dest.data(), source.data(), size);
+        image::image_view<image::bgra_pixel> view(dest.data(), format_desc.width, format_desc.height);
+        image::premultiply(view);
+    });
+    bench.measure("premultiply/convert_image", size, [&] {
+        image::convert_image(dest.data(),
+                             source.data(),
+                             format_desc.width,
+                             format_desc.height,
+                             image::alpha_operation::premultiply,
+                             false);
+    });
+}
+
+void bench_av_frames(kernel_bench& bench, const core::video_format_desc& format_desc)
+{
+    null_frame_factory factory;
+
+    for (auto format : {AV_PIX_FMT_BGRA, AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P, AV_PIX_FMT_UYVY422}) {
+        auto av_frame    = ffmpeg::alloc_frame();
+        av_frame->format = format;
+        av_frame->width  = format_desc.width;
+        av_frame->height = format_desc.height;
+        if (av_frame_get_buffer(av_frame.get(), 64) < 0)
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to allocate a video frame."));
+
+        std::size_t bytes = 0;
+        for (const auto& plane : ffmpeg::pixel_format_desc(format, format_desc.width, format_desc.height).planes)
+            bytes += plane.size;
+
+        bench.measure(std::string("make_frame/") + av_get_pix_fmt_name(format), bytes, [&] {
+            ffmpeg::make_frame(nullptr, factory, av_frame, nullptr);
+        });
+    }
+
+    auto desc = core::pixel_format_desc(core::pixel_format::bgra);
+    desc.planes.push_back(core::pixel_format_desc::plane(format_desc.width, format_desc.height, 4));
+    auto frame = factory.create_frame(nullptr, desc);
+    frame.audio_data() =
+        array<std::int32_t>(static_cast<std::size_t>(format_desc.audio_cadence.front() * format_desc.audio_channels));
+    std::fill(frame.audio_data().begin(), frame.audio_data().end(), 0);
+    auto const_frame = core::const_frame(std::move(frame));
+
+    bench.measure("make_av_video_frame/bgra", static_cast<std::size_t>(format_desc.size), [&] {
+        ffmpeg::make_av_video_frame(const_frame, format_desc);
+    });
+    bench.measure("make_av_audio_frame", 0, [&] { ffmpeg::make_av_audio_frame(const_frame, format_desc); });
+}
+
+// A state like the one of a channel playing a clip on each of 20 layers.
+core::monitor::state make_channel_state()
+{
+    core::monitor::state state;
+    for (auto layer = 1; layer <= 20; ++layer) {
+        auto foreground                         = state["channel"][1]["stage"]["layer"][layer]["foreground"];
+        foreground["producer"]                  = std::string("ffmpeg");
+        foreground["file"]["name"]              = std::wstring(L"AMB.mp4");
+        foreground["file"]["path"]              = std::wstring(L"media/AMB.mp4");
+        foreground["file"]["time"]              = {12.5, 30.0};
+        foreground["file"]["streams"][0]["fps"] = {25, 1};
+        foreground["paused"]                    = false;
+        foreground["loop"]                      = true;
+        foreground["frame"]                     = {std::int64_t{312}, std::int64_t{750}};
+        foreground["audio"]["volume"]           = {-12.0f, -14.0f, -20.0f, -20.0f};
+    }
+    return state;
+}
+
+void bench_monitor(kernel_bench& bench)
+{
+    bench.measure("monitor/state", 0, [&] { make_channel_state(); });
+
+    auto                         state = make_channel_state();
+    protocol::osc::bundle_writer writer(1472);
+    std::size_t                  sent = 0;
+    bench.measure("osc/write_bundles", 0, [&] {
+        writer.write(state, "", [&](const char* data, std::size_t size) { sent += size; });
+    });
+}
+
+void bench_tokenizer(kernel_bench& bench)
+{
+    const std::wstring message =
+        L"PLAY 1-10 \"AMB\" LOOP SEEK 100 LENGTH 500 FILTER \"yadif=0:-1\" MIX 25 EASEINSINE AUTO "
+        L"PARAM \"escaped \\\"quote\\\" and \\\\ backslash\"";
+
+    std::vector<std::wstring> tokens;
+    bench.measure("amcp/tokenize", 0, [&] {
+        tokens.clear();
+        protocol::amcp::tokenize(message, tokens);
+    });
+}
+
+void bench_executor(kernel_bench& bench)
+{
+    executor tasks(L"bench");
+
+    bench.measure("executor/begin_invoke", 0, [&] { tasks.begin_invoke([] {}).get(); });
+
+    // NOTE: A burst of tasks, as the channel queues them, waits only for the last one.
+    bench.measure("executor/begin_invoke/burst16", 0, [&] {
+        std::future<void> last;
+        for (auto n = 0; n < 16; ++n)
+            last = tasks.begin_invoke([] {});
+        last.get();
+    });
+}
+
+bench_settings parse_settings(int argc, char** argv)
+{
+    bench_settings settings;
+
+    for (int n = 1; n < argc; ++n) {
+        std::string arg = argv[n];
+
+        auto value = [&]() -> std::wstring {
+            if (n + 1 >= argc)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Missing value of " + arg));
+            return u16(argv[++n]);
+        };
+
+        if (arg == "--filter")
+            settings.filter = value();
+        else if (arg == "--min-time")
+            settings.min_time = std::max(0.01, boost::lexical_cast<double>(value()));
+        else if (arg == "--format")
+            settings.format = value();
+        else
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid argument: " + arg));
+    }
+
+    return settings;
+}
+
+boost::property_tree::ptree run(const bench_settings& settings)
+{
+    core::video_format_desc format_desc(settings.format);
+    if (format_desc.format == core::video_format::invalid)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + settings.format));
+
+    boost::property_tree::ptree pt;
+
+    auto& config = pt.put_child("settings", boost::property_tree::ptree());
+    config.put("format", u8(format_desc.name));
+    config.put("min_time", settings.min_time);
+    config.put("filter", u8(settings.filter));
+
+    kernel_bench bench(settings);
+
+    bench_memshfl(bench, format_desc);
+    bench_audio_mixer(bench, format_desc);
+    bench_premultiply(bench, format_desc);
+    bench_av_frames(bench, format_desc);
+    bench_monitor(bench);
+    bench_tokenizer(bench);
+    bench_executor(bench);
+
+    pt.put_child("results", bench.results());
+
+    return pt;
+}
+
+} // namespace caspar
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    tbb::task_scheduler_init init;
+
+    try {
+        boost::property_tree::write_json(std::cout, run(parse_settings(argc, argv)));
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        return 1;
+    }
+
+    return 0;
+}
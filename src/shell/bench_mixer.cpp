@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measures the OpenGL image mixer on synthesized layers, without producers or consumers, and writes the results as
+// JSON to stdout:
+//
+//   casparcg_bench_mixer [--config casparcg.config] [--formats 720p5000,1080i5000,...] [--layers 4] [--frames 300]
+//                        [--warmup 25] [--depth 2] [--gpu 0] [--pixel-formats bgra,ycbcr,ycbcra]
+//                        [--blend-mode normal] [--transform] [--keys] [--chroma]
+//
+// Each format is rendered twice. The static pass draws the same frames every time, so their textures are already
+// uploaded and only compositing and readback remain. The streaming pass creates new frames for every render, as
+// producers do, and the difference between the two is reported as upload time.
+
+#include <accelerator/ogl/image/image_mixer.h>
+#include <accelerator/ogl/util/device.h>
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/blend_modes.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/task_scheduler_init.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace caspar {
+
+using clock_type = std::chrono::steady_clock;
+
+struct bench_settings
+{
+    std::wstring                    config = L"casparcg.config";
+    std::vector<std::wstring>       formats{L"PAL", L"720p5000", L"1080i5000", L"1080p5000", L"2160p5000"};
+    std::vector<core::pixel_format> pixel_formats{core::pixel_format::bgra};
+    int                             layers     = 4;
+    int                             frames     = 300;
+    int                             warmup     = 25;
+    int                             depth      = 2;
+    int                             gpu        = 0;
+    core::blend_mode                blend_mode = core::blend_mode::normal;
+    bool                            transform  = false;
+    bool                            keys       = false;
+    bool                            chroma     = false;
+};
+
+struct pass_result
+{
+    double fps            = 0.0;
+    double host_ms        = 0.0;
+    double gpu_ms         = 0.0;
+    double latency_ms     = 0.0;
+    double latency_p95_ms = 0.0;
+};
+
+double elapsed_ms(clock_type::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - since).count();
+}
+
+core::pixel_format parse_pixel_format(const std::wstring& name)
+{
+    if (boost::iequals(name, L"bgra"))
+        return core::pixel_format::bgra;
+    if (boost::iequals(name, L"ycbcr"))
+        return core::pixel_format::ycbcr;
+    if (boost::iequals(name, L"ycbcra"))
+        return core::pixel_format::ycbcra;
+
+    CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid pixel format: " + name));
+}
+
+std::wstring pixel_format_name(core::pixel_format format)
+{
+    switch (format) {
+        case core::pixel_format::ycbcr:
+            return L"ycbcr";
+        case core::pixel_format::ycbcra:
+            return L"ycbcra";
+        default:
+            return L"bgra";
+    }
+}
+
+// ycbcr is 4:2:2, with chroma planes of half the width.
+core::pixel_format_desc create_pixel_format_desc(core::pixel_format format, int width, int height)
+{
+    core::pixel_format_desc desc(format);
+
+    if (format == core::pixel_format::bgra) {
+        desc.planes.push_back(core::pixel_format_desc::plane(width, height, 4));
+    } else {
+        desc.planes.push_back(core::pixel_format_desc::plane(width, height, 1));
+        desc.planes.push_back(core::pixel_format_desc::plane(width / 2, height, 1));
+        desc.planes.push_back(core::pixel_format_desc::plane(width / 2, height, 1));
+        if (format == core::pixel_format::ycbcra)
+            desc.planes.push_back(core::pixel_format_desc::plane(width, height, 1));
+    }
+
+    return desc;
+}
+
+std::vector<core::draw_frame> create_layers(core::image_mixer&             mixer,
+                                            const core::video_format_desc& format_desc,
+                                            const bench_settings&          settings,
+                                            int                            frame_number)
+{
+    static const int tag = 0;
+
+    std::vector<core::draw_frame> layers;
+
+    for (int n = 0; n < settings.layers; ++n) {
+        auto format = settings.pixel_formats[n % settings.pixel_formats.size()];
+        auto desc   = create_pixel_format_desc(format, format_desc.width, format_desc.height);
+        auto frame  = mixer.create_frame(&tag, desc);
+
+        // The contents change with every frame, so that nothing can be skipped as unchanged.
+        for (int plane = 0; plane < static_cast<int>(desc.planes.size()); ++plane) {
+            auto value = (frame_number * 7 + n * 31 + plane * 13) & 0xFF;
+            std::memset(frame.image_data(plane).data(), value, desc.planes[plane].size);
+        }
+
+        core::draw_frame layer(std::move(frame));
+
+        auto& transform       = layer.transform().image_transform;
+        transform.layer_depth = 1;
+        transform.blend_mode  = settings.blend_mode;
+
+        if (settings.transform) {
+            transform.opacity          = 0.9;
+            transform.fill_scale       = {0.75, 0.75};
+            transform.fill_translation = {0.05 * (n % 5), 0.05 * (n % 3)};
+            transform.angle            = 0.05 * n;
+        }
+
+        // A key applies to the layer above it.
+        if (settings.keys && n % 2 == 0 && n + 1 < settings.layers)
+            transform.is_key = true;
+
+        if (settings.chroma) {
+            transform.chroma.enable         = true;
+            transform.chroma.target_hue     = 120.0;
+            transform.chroma.hue_width      = 0.1;
+            transform.chroma.min_saturation = 0.1;
+            transform.chroma.min_brightness = 0.1;
+            transform.chroma.softness       = 0.1;
+            transform.chroma.spill_suppress = 0.1;
+        }
+
+        layers.push_back(std::move(layer));
+    }
+
+    return layers;
+}
+
+// Keeps depth renders in flight, as the channel does with its mixer buffer. Latency is the time from handing the
+// layers to the mixer until the image has been read back into host memory.
+pass_result run_pass(core::image_mixer&             mixer,
+                     const core::video_format_desc& format_desc,
+                     const bench_settings&          settings,
+                     int                            frames,
+                     bool                           streaming)
+{
+    typedef std::future<std::vector<array<const std::uint8_t>>> image_future;
+
+    pass_result result;
+
+    std::deque<std::pair<clock_type::time_point, image_future>> in_flight;
+    std::vector<double>                                         latencies;
+    double                                                      host_total = 0.0;
+    double                                                      gpu_total  = 0.0;
+    int                                                         gpu_count  = 0;
+
+    auto layers  = create_layers(mixer, format_desc, settings, 0);
+    auto started = clock_type::now();
+
+    auto collect = [&] {
+        in_flight.front().second.get();
+        latencies.push_back(elapsed_ms(in_flight.front().first));
+        in_flight.pop_front();
+
+        // The draw times of a frame are known some frames after it was read back.
+        auto draw_times = mixer.layer_draw_times();
+        if (!draw_times.empty()) {
+            gpu_total += std::accumulate(draw_times.begin(), draw_times.end(), 0.0);
+            ++gpu_count;
+        }
+    };
+
+    for (int n = 0; n < frames; ++n) {
+        if (streaming && n > 0) {
+            auto host_started = clock_type::now();
+            layers            = create_layers(mixer, format_desc, settings, n);
+            host_total += elapsed_ms(host_started);
+        }
+
+        auto submitted = clock_type::now();
+        for (auto& layer : layers)
+            layer.accept(mixer);
+        in_flight.emplace_back(submitted, mixer(format_desc, {}, {}));
+
+        while (static_cast<int>(in_flight.size()) > settings.depth)
+            collect();
+    }
+
+    while (!in_flight.empty())
+        collect();
+
+    auto total_ms = elapsed_ms(started);
+
+    std::sort(latencies.begin(), latencies.end());
+
+    result.fps            = frames * 1000.0 / total_ms;
+    result.host_ms        = streaming && frames > 1 ? host_total / (frames - 1) : 0.0;
+    result.gpu_ms         = gpu_count > 0 ? gpu_total / gpu_count : 0.0;
+    result.latency_ms     = std::accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
+    result.latency_p95_ms = latencies.at(std::min(latencies.size() - 1, latencies.size() * 95 / 100));
+
+    return result;
+}
+
+boost::property_tree::ptree to_ptree(const pass_result& result)
+{
+    boost::property_tree::ptree pt;
+    pt.put("fps", result.fps);
+    pt.put("gpu_ms", result.gpu_ms);
+    pt.put("latency_ms", result.latency_ms);
+    pt.put("latency_p95_ms", result.latency_p95_ms);
+    return pt;
+}
+
+std::vector<std::wstring> split_list(const std::wstring& list)
+{
+    std::vector<std::wstring> result;
+    boost::split(result, list, boost::is_any_of(L","), boost::token_compress_on);
+    return result;
+}
+
+bench_settings parse_settings(int argc, char** argv)
+{
+    bench_settings settings;
+
+    for (int n = 1; n < argc; ++n) {
+        std::string arg = argv[n];
+
+        auto value = [&]() -> std::wstring {
+            if (n + 1 >= argc)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Missing value of " + arg));
+            return u16(argv[++n]);
+        };
+
+        if (arg == "--config")
+            settings.config = value();
+        else if (arg == "--formats")
+            settings.formats = split_list(value());
+        else if (arg == "--layers")
+            settings.layers = std::max(1, boost::lexical_cast<int>(value()));
+        else if (arg == "--frames")
+            settings.frames = std::max(1, boost::lexical_cast<int>(value()));
+        else if (arg == "--warmup")
+            settings.warmup = std::max(0, boost::lexical_cast<int>(value()));
+        else if (arg == "--depth")
+            settings.depth = std::max(1, boost::lexical_cast<int>(value()));
+        else if (arg == "--gpu")
+            settings.gpu = boost::lexical_cast<int>(value());
+        else if (arg == "--pixel-formats") {
+            settings.pixel_formats.clear();
+            for (auto& name : split_list(value()))
+                settings.pixel_formats.push_back(parse_pixel_format(name));
+        } else if (arg == "--blend-mode")
+            settings.blend_mode = core::get_blend_mode(value());
+        else if (arg == "--transform")
+            settings.transform = true;
+        else if (arg == "--keys")
+            settings.keys = true;
+        else if (arg == "--chroma")
+            settings.chroma = true;
+        else
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid argument: " + arg));
+    }
+
+    return settings;
+}
+
+boost::property_tree::ptree run(const bench_settings& settings)
+{
+    boost::property_tree::ptree pt;
+
+    auto device = std::make_shared<accelerator::ogl::device>(settings.gpu);
+
+    accelerator::ogl::image_mixer mixer(spl::make_shared_ptr(device->for_channel(1)), 1);
+
+    pt.put("device", u8(device->version()));
+
+    auto& config = pt.put_child("settings", boost::property_tree::ptree());
+    config.put("layers", settings.layers);
+    config.put("frames", settings.frames);
+    config.put("depth", settings.depth);
+    config.put("blend_mode", u8(core::get_blend_mode(settings.blend_mode)));
+    config.put("transform", settings.transform);
+    config.put("keys", settings.keys);
+    config.put("chroma", settings.chroma);
+    std::wstring pixel_formats;
+    for (auto format : settings.pixel_formats)
+        pixel_formats += (pixel_formats.empty() ? L"" : L",") + pixel_format_name(format);
+    config.put("pixel_formats", u8(pixel_formats));
+
+    auto& results = pt.put_child("results", boost::property_tree::ptree());
+
+    for (auto& name : settings.formats) {
+        core::video_format_desc format_desc(name);
+        if (format_desc.format == core::video_format::invalid)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + name));
+
+        if (settings.warmup > 0)
+            run_pass(mixer, format_desc, settings, settings.warmup, true);
+
+        auto still     = run_pass(mixer, format_desc, settings, settings.frames, false);
+        auto streaming = run_pass(mixer, format_desc, settings, settings.frames, true);
+
+        boost::property_tree::ptree result;
+        result.put("format", u8(format_desc.name));
+        result.put("width", format_desc.width);
+        result.put("height", format_desc.height);
+        result.put_child("static", to_ptree(still));
+
+        auto streaming_pt = to_ptree(streaming);
+        streaming_pt.put("host_ms", streaming.host_ms);
+        streaming_pt.put("upload_ms", std::max(0.0, streaming.latency_ms - still.latency_ms));
+        result.put_child("streaming", streaming_pt);
+
+        results.push_back(std::make_pair("", result));
+    }
+
+    return pt;
+}
+
+} // namespace caspar
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    tbb::task_scheduler_init init;
+
+    try {
+        auto settings = parse_settings(argc, argv);
+
+        // The device reads its pool settings from the configuration.
+        env::configure(settings.config);
+
+        boost::property_tree::write_json(std::cout, run(settings));
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        return 1;
+    }
+
+    return 0;
+}
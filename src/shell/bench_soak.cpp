@@ -0,0 +1,465 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs the configured channels headless for a long time and writes tick time and latency statistics as JSON lines to
+// stdout:
+//
+//   casparcg_bench_soak [--config casparcg.config] [--duration 3600] [--report-every 60] [--clock system]
+//                       [--play "1-10 AMB LOOP"]...
+//
+// The consumers of the configuration are not created. Every channel is paced by the given reference clock instead
+// and sends its frames to a null consumer, which records when they arrive. Tick time is the produce, mix and consume
+// time of a tick, a frame is late when that exceeds the frame duration. Latency is the time from the frame boundary
+// a tick started on until its frame arrived at the consumer.
+
+#include "included_modules.h"
+
+#include <accelerator/accelerator.h>
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/ptree.h>
+#include <common/utf.h>
+
+#include <core/clock/clock.h>
+#include <core/consumer/frame_consumer.h>
+#include <core/consumer/output.h>
+#include <core/frame/frame.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/mixer/mixer.h>
+#include <core/module_dependencies.h>
+#include <core/producer/cg_proxy.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/stage.h>
+#include <core/video_channel.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/task_scheduler_init.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace caspar {
+
+using clock_type = std::chrono::steady_clock;
+
+struct bench_settings
+{
+    std::wstring              config = L"casparcg.config";
+    std::wstring              clock  = L"system";
+    std::vector<std::wstring> plays;
+    int                       duration     = 3600;
+    int                       report_every = 60;
+};
+
+// Counts of samples in buckets of 10us up to one second, and above.
+class histogram
+{
+    std::vector<std::int64_t> counts_ = std::vector<std::int64_t>(100001);
+    std::int64_t              total_  = 0;
+    double                    sum_    = 0.0;
+    double                    max_    = 0.0;
+
+  public:
+    void add(double ms)
+    {
+        auto n = std::min<std::size_t>(counts_.size() - 1, static_cast<std::size_t>(std::max(0.0, ms) * 100.0));
+        ++counts_[n];
+        ++total_;
+        sum_ += ms;
+        max_ = std::max(max_, ms);
+    }
+
+    // Upper bound of the bucket holding the given share of the samples.
+    double percentile(double share) const
+    {
+        auto target = static_cast<std::int64_t>(std::ceil(share * total_));
+        auto count  = std::int64_t(0);
+        for (std::size_t n = 0; n < counts_.size(); ++n) {
+            count += counts_[n];
+            if (count >= target && count > 0)
+                return (n + 1) / 100.0;
+        }
+        return 0.0;
+    }
+
+    boost::property_tree::ptree to_ptree() const
+    {
+        boost::property_tree::ptree pt;
+        pt.put("count", total_);
+        pt.put("mean", total_ > 0 ? sum_ / total_ : 0.0);
+        pt.put("p50", percentile(0.5));
+        pt.put("p99", percentile(0.99));
+        pt.put("p99_9", percentile(0.999));
+        pt.put("max", max_);
+        return pt;
+    }
+};
+
+struct channel_stats
+{
+    const core::video_format_desc  format_desc;
+    const std::chrono::nanoseconds frame_duration;
+
+    std::mutex                              mutex;
+    histogram                               tick_time;
+    histogram                               interval;
+    histogram                               latency;
+    std::int64_t                            ticks   = 0;
+    std::int64_t                            frames  = 0;
+    std::int64_t                            late    = 0;
+    std::int64_t                            dropped = 0;
+    boost::optional<std::int64_t>           last_frame;
+    boost::optional<clock_type::time_point> last_arrival;
+
+    // Boundaries of ticks and arrivals of frames, paired up in order as both become known.
+    std::deque<clock_type::time_point> boundaries;
+    std::deque<clock_type::time_point> arrivals;
+
+    explicit channel_stats(const core::video_format_desc& format_desc)
+        : format_desc(format_desc)
+        , frame_duration(static_cast<std::int64_t>(1e9 / format_desc.fps))
+    {
+    }
+
+    void on_tick(double tick_ms, boost::optional<std::int64_t> frame)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        ++ticks;
+        tick_time.add(tick_ms);
+        if (tick_ms > std::chrono::duration<double, std::milli>(frame_duration).count())
+            ++late;
+
+        if (frame) {
+            if (last_frame && *frame - *last_frame > 1)
+                dropped += *frame - *last_frame - 1;
+            last_frame = frame;
+
+            // NOTE: The system reference clock counts boundaries from the epoch of the steady clock.
+            boundaries.push_back(clock_type::time_point(
+                std::chrono::duration_cast<clock_type::duration>(frame_duration * *frame)));
+            pair();
+        }
+    }
+
+    void on_arrival(clock_type::time_point now)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        ++frames;
+        if (last_arrival)
+            interval.add(std::chrono::duration<double, std::milli>(now - *last_arrival).count());
+        last_arrival = now;
+
+        arrivals.push_back(now);
+        pair();
+    }
+
+    void pair()
+    {
+        while (!boundaries.empty() && !arrivals.empty()) {
+            auto ms = std::chrono::duration<double, std::milli>(arrivals.front() - boundaries.front()).count();
+            if (ms >= 0.0)
+                latency.add(ms);
+            boundaries.pop_front();
+            arrivals.pop_front();
+        }
+    }
+
+    boost::property_tree::ptree to_ptree()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        boost::property_tree::ptree pt;
+        pt.put("format", u8(format_desc.name));
+        pt.put("ticks", ticks);
+        pt.put("frames", frames);
+        pt.put("late_frames", late);
+        pt.put("dropped_ticks", dropped);
+        pt.put_child("tick_ms", tick_time.to_ptree());
+        pt.put_child("interval_ms", interval.to_ptree());
+        pt.put_child("latency_ms", latency.to_ptree());
+        return pt;
+    }
+};
+
+// Records when frames arrive, without a synchronization clock of its own.
+class null_consumer : public core::frame_consumer
+{
+    const std::shared_ptr<channel_stats> stats_;
+    int                                  channel_index_ = -1;
+
+  public:
+    explicit null_consumer(std::shared_ptr<channel_stats> stats)
+        : stats_(std::move(stats))
+    {
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        stats_->on_arrival(clock_type::now());
+        return make_ready_future(true);
+    }
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        channel_index_ = channel_index;
+    }
+
+    std::wstring print() const override
+    {
+        return L"null_consumer[" + boost::lexical_cast<std::wstring>(channel_index_) + L"]";
+    }
+
+    std::wstring name() const override { return L"null"; }
+    int          index() const override { return 100000; }
+};
+
+void on_channel_tick(channel_stats& stats, const core::monitor::state& state)
+{
+    double                        tick_ms = 0.0;
+    boost::optional<std::int64_t> frame;
+
+    for (auto& p : state) {
+        if (p.second.size() != 1)
+            continue;
+
+        if (p.first == "profile/produce-time" || p.first == "profile/mix-time" || p.first == "profile/consume-time") {
+            if (auto value = boost::get<double>(&p.second[0]))
+                tick_ms += *value;
+        } else if (p.first == "clock/frame") {
+            if (auto value = boost::get<std::int64_t>(&p.second[0]))
+                frame = *value;
+        }
+    }
+
+    stats.on_tick(tick_ms, frame);
+}
+
+bench_settings parse_settings(int argc, char** argv)
+{
+    bench_settings settings;
+
+    for (int n = 1; n < argc; ++n) {
+        std::string arg = argv[n];
+
+        auto value = [&]() -> std::wstring {
+            if (n + 1 >= argc)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Missing value of " + arg));
+            return u16(argv[++n]);
+        };
+
+        if (arg == "--config")
+            settings.config = value();
+        else if (arg == "--clock")
+            settings.clock = value();
+        else if (arg == "--play")
+            settings.plays.push_back(value());
+        else if (arg == "--duration")
+            settings.duration = std::max(1, boost::lexical_cast<int>(value()));
+        else if (arg == "--report-every")
+            settings.report_every = std::max(0, boost::lexical_cast<int>(value()));
+        else
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid argument: " + arg));
+    }
+
+    return settings;
+}
+
+class soak
+{
+    const bench_settings settings_;
+
+    accelerator::accelerator                        accelerator_;
+    spl::shared_ptr<core::cg_producer_registry>     cg_registry_;
+    spl::shared_ptr<core::frame_producer_registry>  producer_registry_;
+    spl::shared_ptr<core::frame_consumer_registry>  consumer_registry_;
+    spl::shared_ptr<core::reference_clock_registry> clock_registry_;
+
+    std::vector<std::shared_ptr<channel_stats>>       stats_;
+    std::vector<spl::shared_ptr<core::video_channel>> channels_;
+
+  public:
+    explicit soak(const bench_settings& settings)
+        : settings_(settings)
+        , accelerator_(env::properties().get(L"configuration.accelerator", L"auto"))
+        , producer_registry_(spl::make_shared<core::frame_producer_registry>())
+        , consumer_registry_(spl::make_shared<core::frame_consumer_registry>())
+        , clock_registry_(spl::make_shared<core::reference_clock_registry>())
+    {
+        core::module_dependencies dependencies(cg_registry_, producer_registry_, consumer_registry_, clock_registry_);
+
+        initialize_modules(dependencies);
+        core::init_cg_proxy_as_producer(dependencies);
+    }
+
+    ~soak()
+    {
+        channels_.clear();
+        core::destroy_producers_synchronously();
+        uninitialize_modules();
+    }
+
+    void setup_channels(const boost::property_tree::wptree& pt)
+    {
+        std::shared_ptr<core::clock_scheduler> clock;
+
+        for (auto& xml_channel : pt | witerate_children(L"configuration.channels") | welement_context_iteration) {
+            ptree_verify_element_name(xml_channel, L"channel");
+
+            auto format_desc_str = xml_channel.second.get(L"video-mode", L"PAL");
+            auto format_desc     = core::video_format_desc(format_desc_str);
+            if (format_desc.format == core::video_format::invalid)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + format_desc_str));
+
+            format_desc.audio_channels = xml_channel.second.get(L"audio-channels", format_desc.audio_channels);
+
+            if (!clock) {
+                std::vector<std::wstring> params;
+                boost::split(params, settings_.clock, boost::is_space(), boost::token_compress_on);
+                clock = std::make_shared<core::clock_scheduler>(clock_registry_->create_clock(params, format_desc));
+            }
+
+            auto channel_id = static_cast<int>(channels_.size() + 1);
+            auto stats      = std::make_shared<channel_stats>(format_desc);
+            auto channel    = spl::make_shared<core::video_channel>(
+                channel_id,
+                format_desc,
+                accelerator_.create_image_mixer(channel_id,
+                                                xml_channel.second.get(L"gpu", 0),
+                                                xml_channel.second.get(L"mixer.color-depth", 8)),
+                [stats](const core::monitor::state& state) { on_channel_tick(*stats, state); });
+
+            channel->pipeline_depth(xml_channel.second.get(L"pipeline-depth", 0));
+            channel->mixer().set_buffer_depth(xml_channel.second.get(L"mixer.buffer-depth", 1));
+            channel->clock(clock);
+            channel->output().add(spl::make_shared<null_consumer>(stats));
+
+            stats_.push_back(stats);
+            channels_.push_back(channel);
+        }
+
+        if (channels_.empty())
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No channels configured."));
+    }
+
+    // play is "<channel>-<layer> <producer parameters>", e.g. "1-10 AMB LOOP".
+    void play(const std::wstring& play)
+    {
+        std::vector<std::wstring> params;
+        boost::split(params, boost::trim_copy(play), boost::is_space(), boost::token_compress_on);
+
+        std::vector<std::wstring> address;
+        boost::split(address, params.at(0), boost::is_any_of(L"-"));
+        if (params.size() < 2 || address.size() != 2)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid play: " + play));
+
+        auto index = boost::lexical_cast<int>(address[0]) - 1;
+        auto layer = boost::lexical_cast<int>(address[1]);
+        if (index < 0 || index >= static_cast<int>(channels_.size()))
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid channel: " + address[0]));
+
+        auto& channel = channels_[index];
+
+        core::frame_producer_dependencies dependencies(
+            channel->frame_factory(), channels_, channel->video_format_desc(), producer_registry_, cg_registry_);
+
+        params.erase(params.begin());
+        auto producer = producer_registry_->create_producer(dependencies, params);
+        if (producer == core::frame_producer::empty())
+            CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"No producer found for: " + play));
+
+        channel->stage().load(layer, producer).get();
+        channel->stage().play(layer).get();
+    }
+
+    boost::property_tree::ptree report(clock_type::time_point started)
+    {
+        boost::property_tree::ptree pt;
+        pt.put("elapsed_s", std::chrono::duration<double>(clock_type::now() - started).count());
+
+        auto& channels = pt.put_child("channels", boost::property_tree::ptree());
+        for (auto& stats : stats_)
+            channels.push_back(std::make_pair("", stats->to_ptree()));
+
+        return pt;
+    }
+
+    void run()
+    {
+        setup_channels(env::properties());
+
+        for (auto& play : settings_.plays)
+            this->play(play);
+
+        auto started  = clock_type::now();
+        auto deadline = started + std::chrono::seconds(settings_.duration);
+        auto next     = settings_.report_every > 0 ? started + std::chrono::seconds(settings_.report_every) : deadline;
+
+        while (clock_type::now() < deadline) {
+            std::this_thread::sleep_until(std::min(deadline, next));
+
+            if (clock_type::now() >= next && clock_type::now() < deadline) {
+                boost::property_tree::write_json(std::cout, report(started), false);
+                std::cout.flush();
+                next += std::chrono::seconds(settings_.report_every);
+            }
+        }
+
+        boost::property_tree::write_json(std::cout, report(started), false);
+    }
+};
+
+} // namespace caspar
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    tbb::task_scheduler_init init;
+
+    try {
+        auto settings = parse_settings(argc, argv);
+
+        env::configure(settings.config);
+
+        soak(settings).run();
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        return 1;
+    }
+
+    return 0;
+}
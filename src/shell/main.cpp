@@ -41,8 +41,10 @@
 
 #include <common/env.h>
 #include <common/except.h>
+#include <common/filesystem.h>
 #include <common/gl/gl_check.h>
 #include <common/log.h>
+#include <common/os/memory.h>
 
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string/classification.hpp>
@@ -215,6 +217,9 @@ int main(int argc, char** argv)
         log::add_cout_sink();
         env::configure(config_file_name);
 
+        configure_frame_memory(env::properties().get(L"configuration.memory.huge-pages", true),
+                               env::properties().get(L"configuration.memory.lock", false));
+
         {
             std::wstring target_level = env::properties().get(L"configuration.log-level", L"info");
             if (!log::set_log_level(target_level)) {
@@ -235,6 +240,9 @@ int main(int argc, char** argv)
         // Once logging to file, log configuration warnings.
         env::log_configuration_warnings();
 
+        // Index the media folders so that case insensitive lookups do not read them on the first commands.
+        warm_path_index({env::media_folder(), env::template_folder(), env::data_folder(), env::font_folder()});
+
         // Setup console window.
         setup_console_window();
 
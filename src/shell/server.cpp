@@ -26,9 +26,11 @@
 #include <common/env.h>
 #include <common/except.h>
 #include <common/memory.h>
+#include <common/os/thread.h>
 #include <common/ptree.h>
 #include <common/utf.h>
 
+#include <core/clock/clock.h>
 #include <core/consumer/output.h>
 #include <core/diagnostics/call_context.h>
 #include <core/diagnostics/osd_graph.h>
@@ -38,6 +40,7 @@
 #include <core/producer/color/color_producer.h>
 #include <core/producer/frame_producer.h>
 #include <core/producer/stage.h>
+#include <core/thumbnail_generator.h>
 #include <core/video_channel.h>
 #include <core/video_format.h>
 
@@ -46,9 +49,13 @@
 #include <protocol/amcp/AMCPCommandsImpl.h>
 #include <protocol/amcp/AMCPProtocolStrategy.h>
 #include <protocol/amcp/amcp_command_repository.h>
+#include <protocol/amcp/replicator.h>
 #include <protocol/cii/CIIProtocolStrategy.h>
 #include <protocol/clk/CLKProtocolStrategy.h>
+#include <protocol/metrics/metrics_exporter.h>
 #include <protocol/osc/client.h>
+#include <protocol/osc/server.h>
+#include <protocol/state/state_stream.h>
 #include <protocol/util/AsyncEventServer.h>
 #include <protocol/util/strategy_adapters.h>
 
@@ -58,41 +65,56 @@
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <future>
+#include <map>
 #include <thread>
+#include <vector>
 
 namespace caspar {
 
 using namespace core;
 using namespace protocol;
 
+// NOTE: The service is run by a pool of threads, so that a client sending a large command or a slow one does not
+// hold back the others. Each connection runs its handlers on its own strand.
 std::shared_ptr<boost::asio::io_service> create_running_io_service()
 {
-    auto service = std::make_shared<boost::asio::io_service>();
+    auto thread_count = std::max(1, env::properties().get(L"configuration.io-threads", 4));
+
+    auto service = std::make_shared<boost::asio::io_service>(thread_count);
     // To keep the io_service::run() running although no pending async
     // operations are posted.
     auto work      = std::make_shared<boost::asio::io_service::work>(*service);
     auto weak_work = std::weak_ptr<boost::asio::io_service::work>(work);
-    auto thread    = std::make_shared<std::thread>([service, weak_work] {
-        while (auto strong = weak_work.lock()) {
-            try {
-                service->run();
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
+    auto threads   = std::make_shared<std::vector<std::thread>>();
+    for (int n = 0; n < thread_count; ++n) {
+        threads->emplace_back([service, weak_work, n] {
+            set_thread_name(L"asio " + boost::lexical_cast<std::wstring>(n));
+
+            while (auto strong = weak_work.lock()) {
+                try {
+                    service->run();
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
             }
-        }
 
-        CASPAR_LOG(info) << "[asio] Global io_service uninitialized.";
-    });
+            CASPAR_LOG(info) << "[asio] Global io_service uninitialized.";
+        });
+    }
 
-    return std::shared_ptr<boost::asio::io_service>(service.get(), [service, work, thread](void*) mutable {
+    return std::shared_ptr<boost::asio::io_service>(service.get(), [service, work, threads](void*) mutable {
         CASPAR_LOG(info) << "[asio] Shutting down global io_service.";
         work.reset();
         service->stop();
-        if (thread->get_id() != std::this_thread::get_id())
-            thread->join();
-        else
-            thread->detach();
+        for (auto& thread : *threads) {
+            if (thread.get_id() != std::this_thread::get_id())
+                thread.join();
+            else
+                thread.detach();
+        }
     });
 }
 
@@ -101,40 +123,69 @@ struct server::impl : boost::noncopyable
     std::shared_ptr<boost::asio::io_service>           io_service_ = create_running_io_service();
     accelerator::accelerator                           accelerator_;
     std::shared_ptr<amcp::amcp_command_repository>     amcp_command_repo_;
+    std::shared_ptr<amcp::replicator>                  replicator_;
     std::vector<spl::shared_ptr<IO::AsyncEventServer>> async_servers_;
     std::shared_ptr<IO::AsyncEventServer>              primary_amcp_server_;
     std::shared_ptr<osc::client>                       osc_client_ = std::make_shared<osc::client>(io_service_);
+    std::unique_ptr<osc::server>                       osc_server_;
+    std::shared_ptr<state::state_stream>               state_stream_ = std::make_shared<state::state_stream>();
+    std::shared_ptr<metrics::metrics_exporter>         metrics_exporter_;
     std::vector<std::shared_ptr<void>>                 predefined_osc_subscriptions_;
     std::vector<spl::shared_ptr<video_channel>>        channels_;
+    std::shared_ptr<core::thumbnail_generator>         thumbnail_generator_;
     spl::shared_ptr<core::cg_producer_registry>        cg_registry_;
     spl::shared_ptr<core::frame_producer_registry>     producer_registry_;
     spl::shared_ptr<core::frame_consumer_registry>     consumer_registry_;
+    spl::shared_ptr<core::reference_clock_registry>    clock_registry_;
     std::function<void(bool)>                          shutdown_server_now_;
 
     explicit impl(std::function<void(bool)> shutdown_server_now)
         : accelerator_(env::properties().get(L"configuration.accelerator", L"auto"))
         , producer_registry_(spl::make_shared<core::frame_producer_registry>())
         , consumer_registry_(spl::make_shared<core::frame_consumer_registry>())
+        , clock_registry_(spl::make_shared<core::reference_clock_registry>())
         , shutdown_server_now_(shutdown_server_now)
     {
         caspar::core::diagnostics::osd::register_sink();
 
-        module_dependencies dependencies(cg_registry_, producer_registry_, consumer_registry_);
+        // NOTE: The exporter only sees graphs which are registered after it, so it is created before the channels.
+        if (has_controller_protocol(env::properties(), L"METRICS"))
+            metrics_exporter_ = std::make_shared<metrics::metrics_exporter>();
+
+        module_dependencies dependencies(cg_registry_, producer_registry_, consumer_registry_, clock_registry_);
 
         initialize_modules(dependencies);
         core::init_cg_proxy_as_producer(dependencies);
     }
 
+    // NOTE: Channels are created in parallel once their image mixers have been created in order, which creates each
+    // GL device once. The controllers start accepting connections before the consumers are added, in parallel as well,
+    // since opening devices and outputs is what takes time.
     void start()
     {
+        auto started = std::chrono::steady_clock::now();
+
         setup_channels(env::properties());
-        CASPAR_LOG(info) << L"Initialized channels.";
+        CASPAR_LOG(info) << L"Initialized channels in " << elapsed_ms(started) << L" ms.";
+
+        setup_thumbnails(env::properties());
 
         setup_controllers(env::properties());
         CASPAR_LOG(info) << L"Initialized controllers.";
 
         setup_osc(env::properties());
         CASPAR_LOG(info) << L"Initialized osc.";
+
+        auto consumers_started = std::chrono::steady_clock::now();
+        setup_consumers(env::properties());
+        CASPAR_LOG(info) << L"Initialized consumers in " << elapsed_ms(consumers_started) << L" ms.";
+
+        CASPAR_LOG(info) << L"Server started in " << elapsed_ms(started) << L" ms.";
+    }
+
+    static std::int64_t elapsed_ms(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since).count();
     }
 
     ~impl()
@@ -142,9 +193,14 @@ struct server::impl : boost::noncopyable
         std::weak_ptr<boost::asio::io_service> weak_io_service = io_service_;
         io_service_.reset();
         osc_client_.reset();
+        osc_server_.reset();
+        state_stream_.reset();
+        metrics_exporter_.reset();
         amcp_command_repo_.reset();
         primary_amcp_server_.reset();
+        replicator_.reset();
         async_servers_.clear();
+        thumbnail_generator_.reset();
         destroy_producers_synchronously();
         destroy_consumers_synchronously();
         channels_.clear();
@@ -158,12 +214,12 @@ struct server::impl : boost::noncopyable
 
     void setup_channels(const boost::property_tree::wptree& pt)
     {
-        using boost::property_tree::wptree;
+        std::vector<std::future<spl::shared_ptr<video_channel>>> channels;
 
-        std::vector<wptree> xml_channels;
+        // Channels naming the same clock share its scheduler and tick in phase.
+        std::map<std::wstring, std::shared_ptr<core::clock_scheduler>> clocks;
 
         for (auto& xml_channel : pt | witerate_children(L"configuration.channels") | welement_context_iteration) {
-            xml_channels.push_back(xml_channel.second);
             ptree_verify_element_name(xml_channel, L"channel");
 
             auto format_desc_str = xml_channel.second.get(L"video-mode", L"PAL");
@@ -171,45 +227,188 @@ struct server::impl : boost::noncopyable
             if (format_desc.format == video_format::invalid)
                 CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + format_desc_str));
 
-            auto weak_client = std::weak_ptr<osc::client>(osc_client_);
-            auto channel_id  = static_cast<int>(channels_.size() + 1);
-            auto channel     = spl::make_shared<video_channel>(
-                channel_id,
-                format_desc,
-                accelerator_.create_image_mixer(channel_id),
-                [channel_id, weak_client](core::monitor::state channel_state) {
+            format_desc.audio_channels = xml_channel.second.get(L"audio-channels", format_desc.audio_channels);
+            if (format_desc.audio_channels < 1 || format_desc.audio_channels > 64)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid audio-channels."));
+
+            std::shared_ptr<core::clock_scheduler> clock;
+
+            auto clock_str = boost::to_lower_copy(boost::trim_copy(xml_channel.second.get(L"clock", L"")));
+            if (!clock_str.empty()) {
+                clock = clocks[clock_str];
+                if (!clock) {
+                    std::vector<std::wstring> params;
+                    boost::split(params, clock_str, boost::is_space(), boost::token_compress_on);
+                    clock = std::make_shared<core::clock_scheduler>(clock_registry_->create_clock(params, format_desc));
+                    clocks[clock_str] = clock;
+                }
+            }
+
+            auto channel_id  = static_cast<int>(channels.size() + 1);
+            auto image_mixer = accelerator_.create_image_mixer(
+                channel_id, xml_channel.second.get(L"gpu", 0), xml_channel.second.get(L"mixer.color-depth", 8));
+
+            auto setup = [this, channel_id, format_desc, clock, xml_channel = xml_channel.second](
+                             std::unique_ptr<core::image_mixer> image_mixer) {
+                return setup_channel(channel_id, format_desc, clock, xml_channel, std::move(image_mixer));
+            };
+            channels.push_back(std::async(std::launch::async, std::move(setup), std::move(image_mixer)));
+        }
+
+        for (auto& channel : channels)
+            channels_.push_back(channel.get());
+    }
+
+    spl::shared_ptr<video_channel> setup_channel(int                                           channel_id,
+                                                 const video_format_desc&                      format_desc,
+                                                 const std::shared_ptr<core::clock_scheduler>& clock,
+                                                 const boost::property_tree::wptree&           xml_channel,
+                                                 std::unique_ptr<core::image_mixer>            image_mixer)
+    {
+        auto started     = std::chrono::steady_clock::now();
+        auto weak_client = std::weak_ptr<osc::client>(osc_client_);
+        auto weak_stream = std::weak_ptr<state::state_stream>(state_stream_);
+        auto channel     = spl::make_shared<video_channel>(
+            channel_id,
+            format_desc,
+            std::move(image_mixer),
+            [channel_id, weak_client, weak_stream, revision = std::uint64_t(0)](
+                const core::monitor::state& channel_state) mutable {
+                auto client = weak_client.lock();
+                auto stream = weak_stream.lock();
+                if (client || stream) {
                     monitor::state state;
-                    state[""]["channel"][channel_id] = channel_state;
-                    auto client = weak_client.lock();
-                    if (client) {
+                    state[""]["channel"][channel_id] = channel_state.delta(revision);
+                    if (stream)
+                        stream->send(client ? state : std::move(state));
+                    if (client)
                         client->send(std::move(state));
-                    }
-                });
+                }
+                revision = channel_state.revision();
+            });
+
+        channel->pipeline_depth(xml_channel.get(L"pipeline-depth", 0));
+        channel->frame_divisor(xml_channel.get(L"frame-divisor", 1));
 
-            channels_.push_back(channel);
+        if (auto priorities = xml_channel.get_child_optional(L"layer-priorities")) {
+            for (auto& xml_layer : *priorities) {
+                channel->layer_priority(xml_layer.second.get<int>(L"index"), xml_layer.second.get(L"priority", 0));
+            }
         }
 
-        for (auto& channel : channels_) {
-            core::diagnostics::scoped_call_context save;
-            core::diagnostics::call_context::for_thread().video_channel = channel->index();
-
-            if (xml_channels.at(channel->index() - 1).get_child_optional(L"consumers")) {
-                for (auto& xml_consumer : xml_channels.at(channel->index() - 1) | witerate_children(L"consumers") |
-                                              welement_context_iteration) {
-                    auto name = xml_consumer.first;
-
-                    try {
-                        if (name != L"<xmlcomment>")
-                            channel->output().add(
-                                consumer_registry_->create_consumer(name, xml_consumer.second, channels_));
-                    } catch (...) {
-                        CASPAR_LOG_CURRENT_EXCEPTION();
-                    }
+        auto affinity = xml_channel.get(L"affinity", L"");
+        auto realtime = xml_channel.get(L"realtime", false);
+        if (!affinity.empty() || realtime) {
+            channel->thread_placement(affinity, realtime);
+        }
+        channel->mixer().set_buffer_depth(xml_channel.get(L"mixer.buffer-depth", 1));
+
+        if (clock)
+            channel->clock(clock);
+
+        CASPAR_LOG(info) << L"Initialized channel " << channel_id << L" in " << elapsed_ms(started) << L" ms.";
+
+        return channel;
+    }
+
+    void setup_consumers(const boost::property_tree::wptree& pt)
+    {
+        std::vector<std::future<void>> consumers;
+
+        auto channel = channels_.begin();
+        for (auto& xml_channel : pt | witerate_children(L"configuration.channels") | welement_context_iteration) {
+            if (channel == channels_.end())
+                break;
+
+            if (xml_channel.second.get_child_optional(L"consumers")) {
+                for (auto& xml_consumer :
+                     xml_channel.second | witerate_children(L"consumers") | welement_context_iteration) {
+                    if (xml_consumer.first == L"<xmlcomment>")
+                        continue;
+
+                    consumers.push_back(std::async(std::launch::async,
+                                                   &impl::setup_consumer,
+                                                   this,
+                                                   *channel,
+                                                   xml_consumer.first,
+                                                   xml_consumer.second));
                 }
             }
+
+            ++channel;
+        }
+
+        for (auto& consumer : consumers)
+            consumer.get();
+    }
+
+    void setup_consumer(const spl::shared_ptr<video_channel>& channel,
+                        const std::wstring&                   name,
+                        const boost::property_tree::wptree&   xml_consumer)
+    {
+        core::diagnostics::scoped_call_context save;
+        core::diagnostics::call_context::for_thread().video_channel = channel->index();
+
+        auto started = std::chrono::steady_clock::now();
+
+        try {
+            channel->output().add(consumer_registry_->create_consumer(name, xml_consumer, channels_),
+                                  get_port_settings(xml_consumer));
+
+            CASPAR_LOG(info) << L"Initialized " << name << L" consumer on channel " << channel->index() << L" in "
+                             << elapsed_ms(started) << L" ms.";
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
         }
     }
 
+    void setup_thumbnails(const boost::property_tree::wptree& pt)
+    {
+        if (!pt.get(L"configuration.thumbnails.enabled", false))
+            return;
+
+        auto format_desc_str = pt.get(L"configuration.thumbnails.video-mode", L"720p2500");
+        auto format_desc     = video_format_desc(format_desc_str);
+        if (format_desc.format == video_format::invalid)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid thumbnails video-mode: " + format_desc_str));
+
+        // NOTE: The thumbnail mixer is assigned a GL thread as if it were one more channel, so that it does not share
+        // one with the first channel.
+        auto id = static_cast<int>(channels_.size() + 1);
+
+        thumbnail_generator_ = std::make_shared<core::thumbnail_generator>(
+            accelerator_.create_image_mixer(id, pt.get(L"configuration.thumbnails.gpu", 0)),
+            format_desc,
+            producer_registry_,
+            consumer_registry_,
+            cg_registry_,
+            pt.get(L"configuration.thumbnails.threads", 1),
+            pt.get(L"configuration.thumbnails.max-queue", 256));
+
+        CASPAR_LOG(info) << L"Initialized thumbnail generator.";
+    }
+
+    static core::port_settings get_port_settings(const boost::property_tree::wptree& xml_consumer)
+    {
+        core::port_settings settings;
+        settings.capacity = xml_consumer.get(L"queue-depth", settings.capacity);
+        settings.deadline = std::chrono::milliseconds(xml_consumer.get(L"deadline", 0));
+        settings.priority = xml_consumer.get(L"priority", settings.priority);
+        settings.delay    = std::max(0, xml_consumer.get(L"delay", settings.delay));
+
+        auto overflow = xml_consumer.get(L"overflow", L"block");
+        if (boost::iequals(overflow, L"drop-oldest"))
+            settings.overflow = core::overflow_policy::drop_oldest;
+        else if (boost::iequals(overflow, L"drop-newest"))
+            settings.overflow = core::overflow_policy::drop_newest;
+        else if (boost::iequals(overflow, L"block"))
+            settings.overflow = core::overflow_policy::block;
+        else
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid consumer overflow policy: " + overflow));
+
+        return settings;
+    }
+
     void setup_osc(const boost::property_tree::wptree& pt)
     {
         using boost::property_tree::wptree;
@@ -218,6 +417,14 @@ struct server::impl : boost::noncopyable
         auto default_port                 = pt.get<unsigned short>(L"configuration.osc.default-port", 6250);
         auto disable_send_to_amcp_clients = pt.get(L"configuration.osc.disable-send-to-amcp-clients", false);
         auto predefined_clients           = pt.get_child_optional(L"configuration.osc.predefined-clients");
+        auto control_port                 = pt.get<unsigned short>(L"configuration.osc.control-port", 0);
+
+        if (control_port != 0)
+            osc_server_ = std::make_unique<osc::server>(io_service_, udp::endpoint(udp::v4(), control_port), channels_);
+
+        osc::subscription_settings default_settings;
+        default_settings.max_rate = pt.get(L"configuration.osc.max-rate", default_settings.max_rate);
+        default_settings.filter   = u8(pt.get(L"configuration.osc.filter", L""));
 
         if (predefined_clients) {
             for (auto& predefined_client :
@@ -227,11 +434,15 @@ struct server::impl : boost::noncopyable
                 const auto address = ptree_get<std::wstring>(predefined_client.second, L"address");
                 const auto port    = ptree_get<unsigned short>(predefined_client.second, L"port");
 
+                auto settings     = default_settings;
+                settings.max_rate = predefined_client.second.get(L"max-rate", settings.max_rate);
+                settings.filter   = u8(predefined_client.second.get(L"filter", u16(settings.filter)));
+
                 boost::system::error_code ec;
                 auto                      ipaddr = address_v4::from_string(u8(address), ec);
                 if (!ec)
                     predefined_osc_subscriptions_.push_back(
-                        osc_client_->get_subscription_token(udp::endpoint(ipaddr, port)));
+                        osc_client_->get_subscription_token(udp::endpoint(ipaddr, port), settings));
                 else
                     CASPAR_LOG(warning) << "Invalid OSC client. Must be valid ipv4 address: " << address;
             }
@@ -244,16 +455,35 @@ struct server::impl : boost::noncopyable
 
                     return std::make_pair(std::wstring(L"osc_subscribe"),
                                           osc_client_->get_subscription_token(
-                                              udp::endpoint(address_v4::from_string(ipv4_address), default_port)));
+                                              udp::endpoint(address_v4::from_string(ipv4_address), default_port),
+                                              default_settings));
                 });
     }
 
+    static bool has_controller_protocol(const boost::property_tree::wptree& pt, const std::wstring& protocol)
+    {
+        for (auto& xml_controller : pt | witerate_children(L"configuration.controllers") | welement_context_iteration) {
+            if (boost::iequals(xml_controller.second.get(L"protocol", L""), protocol))
+                return true;
+        }
+        return false;
+    }
+
     void setup_controllers(const boost::property_tree::wptree& pt)
     {
-        amcp_command_repo_ = spl::make_shared<amcp::amcp_command_repository>(
-            channels_, cg_registry_, producer_registry_, consumer_registry_, shutdown_server_now_);
+        amcp_command_repo_ = spl::make_shared<amcp::amcp_command_repository>(channels_,
+                                                                             cg_registry_,
+                                                                             producer_registry_,
+                                                                             consumer_registry_,
+                                                                             thumbnail_generator_,
+                                                                             shutdown_server_now_);
         amcp::register_commands(*amcp_command_repo_);
 
+        auto backup = pt.get(L"configuration.amcp.replication.backup", L"");
+        if (!backup.empty())
+            replicator_ = std::make_shared<amcp::replicator>(
+                io_service_, backup, std::max(0, pt.get(L"configuration.amcp.replication.delay", 2)));
+
         using boost::property_tree::wptree;
         for (auto& xml_controller : pt | witerate_children(L"configuration.controllers") | welement_context_iteration) {
             auto name     = xml_controller.first;
@@ -264,7 +494,8 @@ struct server::impl : boost::noncopyable
                 auto asyncbootstrapper = spl::make_shared<IO::AsyncEventServer>(
                     io_service_,
                     create_protocol(protocol, L"TCP Port " + boost::lexical_cast<std::wstring>(port)),
-                    static_cast<short>(port));
+                    static_cast<short>(port),
+                    get_connection_settings(xml_controller.second));
                 async_servers_.push_back(asyncbootstrapper);
 
                 if (!primary_amcp_server_ && boost::iequals(protocol, L"AMCP"))
@@ -274,6 +505,23 @@ struct server::impl : boost::noncopyable
         }
     }
 
+    static IO::connection_settings get_connection_settings(const boost::property_tree::wptree& xml_controller)
+    {
+        IO::connection_settings settings;
+        settings.max_send_queue = xml_controller.get(L"max-send-queue", settings.max_send_queue);
+        settings.no_delay       = xml_controller.get(L"no-delay", settings.no_delay);
+
+        auto overflow = xml_controller.get(L"send-overflow", L"disconnect");
+        if (boost::iequals(overflow, L"disconnect"))
+            settings.overflow = IO::send_overflow_policy::disconnect;
+        else if (boost::iequals(overflow, L"drop"))
+            settings.overflow = IO::send_overflow_policy::drop;
+        else
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid controller send overflow policy: " + overflow));
+
+        return settings;
+    }
+
     IO::protocol_strategy_factory<char>::ptr create_protocol(const std::wstring& name,
                                                              const std::wstring& port_description) const
     {
@@ -282,7 +530,7 @@ struct server::impl : boost::noncopyable
         if (boost::iequals(name, L"AMCP"))
             return wrap_legacy_protocol("\r\n",
                                         spl::make_shared<amcp::AMCPProtocolStrategy>(
-                                            port_description, spl::make_shared_ptr(amcp_command_repo_)));
+                                            port_description, spl::make_shared_ptr(amcp_command_repo_), replicator_));
         else if (boost::iequals(name, L"CII"))
             return wrap_legacy_protocol(
                 "\r\n", spl::make_shared<cii::CIIProtocolStrategy>(channels_, cg_registry_, producer_registry_));
@@ -290,6 +538,10 @@ struct server::impl : boost::noncopyable
             return spl::make_shared<to_unicode_adapter_factory>(
                 "ISO-8859-1",
                 spl::make_shared<CLK::clk_protocol_strategy_factory>(channels_, cg_registry_, producer_registry_));
+        else if (boost::iequals(name, L"STATE"))
+            return state_stream_->protocol_factory();
+        else if (boost::iequals(name, L"METRICS") && metrics_exporter_)
+            return metrics_exporter_->protocol_factory();
 
         CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid protocol: " + name));
     }